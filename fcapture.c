@@ -0,0 +1,295 @@
+/*
+ * fcapture.c - capture isochronous packets of AMDTP streams into pcap file
+ *
+ * The proc node "capture" of the sound card is mapped, then the records in the
+ * ring are converted to packets in pcap format. Each packet starts with the
+ * header of isochronous packet in IEEE 1394 (data length, tag, channel, tcode
+ * and sy), followed by the captured quadlets, in big endian. pcap has no link
+ * type for isochronous packet of IEEE 1394, thus LINKTYPE_USER0 is used.
+ *
+ * gcc ./fcapture.c -o ./fcapture
+ *
+ * ./fcapture /proc/asound/card1/firewire/capture out.pcap [QUADLETS]
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "include/uapi/sound/firewire.h"
+
+#define LINKTYPE_USER0		147
+#define TCODE_STREAM_DATA	0xa
+#define CYCLES_PER_SECOND	8000
+#define CYCLE_MODULUS		(CYCLES_PER_SECOND * 8)
+
+/* Just for the maximum length of record. */
+#define MAX_QUADLETS		256
+
+bool run;
+
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_packet_header {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/* The cycle of record is unwrapped into the count since the first record. */
+struct timeline {
+	bool started;
+	uint32_t last_cycle;
+	uint64_t cycles;
+	struct timespec base;
+};
+
+static uint64_t
+timeline_update(struct timeline *t, uint32_t cycle)
+{
+	if (!t->started) {
+		t->started = true;
+		t->last_cycle = cycle;
+		t->cycles = 0;
+		clock_gettime(CLOCK_REALTIME, &t->base);
+	} else {
+		t->cycles += (cycle + CYCLE_MODULUS - t->last_cycle) %
+			     CYCLE_MODULUS;
+		t->last_cycle = cycle;
+	}
+
+	/* In microseconds. */
+	return t->base.tv_sec * 1000000ull + t->base.tv_nsec / 1000 +
+	       t->cycles * 125;
+}
+
+static int
+write_file_header(FILE *out)
+{
+	struct pcap_file_header header = {
+		.magic = 0xa1b2c3d4,
+		.version_major = 2,
+		.version_minor = 4,
+		.thiszone = 0,
+		.sigfigs = 0,
+		.snaplen = sizeof(uint32_t) * (1 + MAX_QUADLETS),
+		.linktype = LINKTYPE_USER0,
+	};
+
+	if (fwrite(&header, sizeof(header), 1, out) != 1)
+		return -EIO;
+
+	return 0;
+}
+
+static int
+write_record(FILE *out, struct timeline *t,
+	     const struct snd_firewire_packet_record *record)
+{
+	struct pcap_packet_header header;
+	unsigned int quadlets;
+	uint32_t iso_header;
+	uint64_t usec;
+
+	quadlets = record->header_quadlets + record->payload_quadlets;
+	if (quadlets > MAX_QUADLETS)
+		return -EINVAL;
+
+	usec = timeline_update(t, record->cycle);
+	header.ts_sec = usec / 1000000;
+	header.ts_usec = usec % 1000000;
+	header.caplen = sizeof(uint32_t) * (1 + quadlets);
+	header.len = sizeof(uint32_t) + record->length;
+
+	/* The tag is 1 for the packet with CIP header. */
+	iso_header = (record->length << 16) |
+		     ((record->header_quadlets > 0 ? 1 : 0) << 14) |
+		     ((record->channel & 0x3f) << 8) |
+		     (TCODE_STREAM_DATA << 4);
+	iso_header = htonl(iso_header);
+
+	if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+	    fwrite(&iso_header, sizeof(iso_header), 1, out) != 1 ||
+	    fwrite(record->quadlets, sizeof(uint32_t), quadlets, out) != quadlets)
+		return -EIO;
+
+	return 0;
+}
+
+/* Consume records from the tail to the head. */
+static int
+consume(struct snd_firewire_event_ring *ctrl, FILE *out, struct timeline *t,
+	unsigned long *count)
+{
+	const uint8_t *data = (const uint8_t *)ctrl + ctrl->offset;
+	uint32_t head = __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = ctrl->tail;
+	int err = 0;
+
+	while (tail != head) {
+		uint32_t length = *(const uint32_t *)(data + tail);
+
+		if (length == 0) {
+			/* The marker of wrap around. */
+			tail = 0;
+			continue;
+		}
+
+		if (length < sizeof(uint32_t) +
+			     sizeof(struct snd_firewire_packet_record) ||
+		    tail + length > ctrl->size) {
+			err = -EPROTO;
+			break;
+		}
+
+		err = write_record(out, t,
+			(const struct snd_firewire_packet_record *)(data + tail +
+								     sizeof(uint32_t)));
+		if (err < 0)
+			break;
+		(*count)++;
+
+		tail += length;
+		if (tail >= ctrl->size)
+			tail = 0;
+	}
+
+	__atomic_store_n(&ctrl->tail, tail, __ATOMIC_RELEASE);
+
+	return err;
+}
+
+static int
+set_quadlets(const char *node, unsigned int quadlets)
+{
+	char path[256];
+	const char *sep;
+	FILE *f;
+
+	/* The node "capture_quadlets" is in the same directory. */
+	sep = strrchr(node, '/');
+	if (sep == NULL)
+		snprintf(path, sizeof(path), "capture_quadlets");
+	else
+		snprintf(path, sizeof(path), "%.*s/capture_quadlets",
+			 (int)(sep - node), node);
+
+	f = fopen(path, "w");
+	if (f == NULL)
+		return -errno;
+	fprintf(f, "%u\n", quadlets);
+	fclose(f);
+
+	return 0;
+}
+
+static void signal_handler(int sig)
+{
+	run = false;
+}
+
+int main(int argc, char *argv[])
+{
+	struct snd_firewire_event_ring *ctrl;
+	struct timeline t = {0};
+	unsigned long count = 0;
+	size_t length;
+	FILE *out;
+	void *map;
+	int fd, err;
+
+	if (argc < 3) {
+		printf("./fcapture PROC_NODE PCAP_FILE [QUADLETS]\n");
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 3) {
+		err = set_quadlets(argv[1], atoi(argv[3]));
+		if (err < 0) {
+			printf("Fail to set the number of quadlets: %s\n",
+			       strerror(-err));
+			return EXIT_FAILURE;
+		}
+	}
+
+	fd = open(argv[1], O_RDWR);
+	if (fd < 0) {
+		printf("Fail to open %s: %s\n", argv[1], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* Map the control area at first to get the size of data area. */
+	map = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		printf("Fail to map: %s\n", strerror(errno));
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	ctrl = map;
+	length = ctrl->offset + ctrl->size;
+	munmap(map, sysconf(_SC_PAGESIZE));
+
+	/* The records are delivered since the mapping with full size. */
+	map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		printf("Fail to map: %s\n", strerror(errno));
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	ctrl = map;
+
+	out = fopen(argv[2], "w");
+	if (out == NULL) {
+		printf("Fail to open %s: %s\n", argv[2], strerror(errno));
+		err = -errno;
+		goto unmap;
+	}
+
+	err = write_file_header(out);
+	if (err < 0)
+		goto close;
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	run = true;
+	while (run) {
+		err = consume(ctrl, out, &t, &count);
+		if (err < 0)
+			break;
+
+		/* The ring has space for some milliseconds of packets. */
+		usleep(1000);
+	}
+
+	printf("%lu packets captured, %u dropped\n", count, ctrl->dropped);
+close:
+	fclose(out);
+unmap:
+	munmap(map, length);
+	close(fd);
+
+	if (err < 0)
+		printf("Error: %s\n", strerror(-err));
+	return err < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
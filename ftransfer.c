@@ -4,17 +4,33 @@
  * This program is just for profiling,
  * not comparing their advantages/disadvantages.
  *
- * gcc ./ftransfer.c -lasound -lffado -lm -o ./ftransfer
+ * gcc ./ftransfer.c -lasound -lffado -lm -lpthread -o ./ftransfer
  *
+ * Each run reports the number of xruns, CPU time and wakeups per second in
+ * CSV or JSON, thus the output is available for regression tests. In loopback
+ * mode (ALSA only), an impulse is transferred periodically and captured again
+ * through the cable between output and input of the device, to measure the
+ * round-trip latency. In sweep mode, the runs are repeated for some
+ * combinations of period and buffer size. In multi-card mode, several cards
+ * are driven at once by threads pinned to CPUs, to see the scaling in the
+ * paths shared by cards.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include <signal.h>
 #include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
 
 #include <alsa/asoundlib.h>
 #include "include/uapi/sound/firewire.h"
@@ -28,6 +44,36 @@ enum driver_type {
 	DRIVER_FFADO
 };
 
+enum output_format {
+	OUTPUT_CSV,
+	OUTPUT_JSON
+};
+
+/* The impulse is transferred once per this number of periods in loopback. */
+#define IMPULSE_INTERVAL_PERIODS	16
+#define IMPULSE_LEVEL			0x7fffff00
+#define IMPULSE_THRESHOLD		(IMPULSE_LEVEL / 2)
+
+struct statistics {
+	unsigned int xruns;
+	unsigned long long frames;
+	double elapsed;
+	double cpu_user;
+	double cpu_system;
+	unsigned long wakeups;
+	/* In frames, or negative if not detected. */
+	long latency_min;
+	long latency_max;
+	unsigned int impulses;
+	unsigned int detected;
+	/* The deviation of interval between wakeups from the period, in seconds. */
+	unsigned long periods;
+	unsigned long paced;
+	double jitter_sum;
+	double jitter_max;
+	struct timespec last_wakeup;
+};
+
 struct something {
 	enum driver_type driver;
 	unsigned int card;
@@ -44,9 +90,59 @@ struct something {
 	unsigned int seconds;
 	uint8_t *buffer;
 
+	bool loopback;
+	bool sweep;
+	enum output_format format;
+	snd_pcm_t *capture;
+	unsigned int capture_channels;
+	int32_t *playback_frames;
+	int32_t *capture_frames;
+
+	struct statistics stats;
+	/* RUSAGE_THREAD when several cards are driven by threads. */
+	int usage_who;
+	int err;
+
 	unsigned int verbose;
 };
 
+static double
+timeval_to_seconds(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+static double
+timespec_to_seconds(const struct timespec *ts)
+{
+	return ts->tv_sec + ts->tv_nsec / 1000000000.0;
+}
+
+static void
+record_wakeup(struct something *opts)
+{
+	struct statistics *stats = &opts->stats;
+	struct timespec now;
+	double interval, jitter;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	/* The periods to fill the buffer at first are not paced. */
+	if (stats->periods > opts->periods_per_buffer) {
+		interval = timespec_to_seconds(&now) -
+			   timespec_to_seconds(&stats->last_wakeup);
+		jitter = fabs(interval - (double)opts->frames_per_period /
+					 opts->frames_per_second);
+		stats->jitter_sum += jitter;
+		stats->paced++;
+		if (jitter > stats->jitter_max)
+			stats->jitter_max = jitter;
+	}
+
+	stats->last_wakeup = now;
+	stats->periods++;
+}
+
 static int
 keep_buffer(struct something *opts)
 {
@@ -86,6 +182,18 @@ card_open(void **handle, struct something *opts)
 				   SND_PCM_NO_AUTO_RESAMPLE |
 				   SND_PCM_NO_AUTO_CHANNELS |
 				   SND_PCM_NO_AUTO_FORMAT);
+		if (err < 0 || !opts->loopback)
+			goto end;
+
+		err = snd_pcm_open(&opts->capture, opts->sdev,
+				   SND_PCM_STREAM_CAPTURE,
+				   SND_PCM_NO_AUTO_RESAMPLE |
+				   SND_PCM_NO_AUTO_CHANNELS |
+				   SND_PCM_NO_AUTO_FORMAT);
+		if (err < 0) {
+			snd_pcm_close((snd_pcm_t *)*handle);
+			opts->capture = NULL;
+		}
 	} else {
 		char target[16] = {0};
 		char *strings[1];
@@ -140,62 +248,139 @@ card_open(void **handle, struct something *opts)
 		if (*handle == NULL)
 			err = -EINVAL;
 	}
-
+end:
 	return err;
 }
 
 static int
-card_hw_params(void *handle, struct something *opts)
+alsa_hw_params(snd_pcm_t *snd, struct something *opts,
+	       snd_pcm_format_t *format, unsigned int *channels)
 {
+	snd_pcm_hw_params_t *params;
 	int err;
 
-	if (opts->driver == DRIVER_ALSA) {
-		snd_pcm_t *snd = handle;
-		snd_pcm_hw_params_t *params;
-		snd_pcm_format_t format;
+	snd_pcm_hw_params_alloca(&params);
+
+	err = snd_pcm_hw_params_any(snd, params);
+	if (err < 0)
+		goto end;
 
-		snd_pcm_hw_params_alloca(&params);
+	err = snd_pcm_hw_params_set_access(snd, params,
+				SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (err < 0)
+		goto end;
 
-		err = snd_pcm_hw_params_any(snd, params);
+	/* The impulse is generated and detected in 32 bit sample. */
+	if (opts->loopback) {
+		err = snd_pcm_hw_params_set_format(snd, params,
+						   SND_PCM_FORMAT_S32);
 		if (err < 0)
 			goto end;
+	}
 
-		err = snd_pcm_hw_params_set_access(snd, params,
-					SND_PCM_ACCESS_RW_INTERLEAVED);
-		if (err < 0)
-			goto end;
+	err = snd_pcm_hw_params_set_rate(snd, params,
+			opts->frames_per_second, SND_PCM_STREAM_PLAYBACK);
+	if (err < 0)
+		goto end;
 
-		err = snd_pcm_hw_params_set_rate(snd, params,
-				opts->frames_per_second, SND_PCM_STREAM_PLAYBACK);
-		if (err < 0)
-			goto end;
+	err = snd_pcm_hw_params_set_period_size(snd, params,
+		opts->frames_per_period, SND_PCM_STREAM_PLAYBACK);
+	if (err < 0)
+		goto end;
+
+	err = snd_pcm_hw_params_set_buffer_size(snd, params,
+		opts->frames_per_period * opts->periods_per_buffer);
+	if (err < 0)
+		goto end;
+
+	/* snd_pcm_prepare() is also called in this function. */
+	err = snd_pcm_hw_params(snd, params);
+	if (err < 0)
+		goto end;
+
+	err = snd_pcm_hw_params_get_format(params, format);
+	if (err < 0)
+		goto end;
+
+	err = snd_pcm_hw_params_get_channels(params, channels);
+end:
+	return err;
+}
+
+static int
+alsa_sw_params(snd_pcm_t *snd, snd_pcm_uframes_t start_threshold)
+{
+	snd_pcm_sw_params_t *params;
+	int err;
+
+	snd_pcm_sw_params_alloca(&params);
+
+	err = snd_pcm_sw_params_current(snd, params);
+	if (err < 0)
+		return err;
+
+	err = snd_pcm_sw_params_set_start_threshold(snd, params,
+						    start_threshold);
+	if (err < 0)
+		return err;
+
+	return snd_pcm_sw_params(snd, params);
+}
+
+static int
+keep_loopback_buffers(struct something *opts, unsigned int capture_channels)
+{
+	unsigned int frames = opts->frames_per_period;
+
+	opts->playback_frames = calloc(frames * opts->samples_per_frame,
+				       sizeof(*opts->playback_frames));
+	opts->capture_frames = calloc(frames * capture_channels,
+				      sizeof(*opts->capture_frames));
+	if (opts->playback_frames == NULL || opts->capture_frames == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int
+card_hw_params(void *handle, struct something *opts)
+{
+	int err;
+
+	if (opts->driver == DRIVER_ALSA) {
+		snd_pcm_t *snd = handle;
+		snd_pcm_format_t format;
 
-		err = snd_pcm_hw_params_set_period_size(snd, params,
-			opts->frames_per_period, SND_PCM_STREAM_PLAYBACK);
+		err = alsa_hw_params(snd, opts, &format,
+				     &opts->samples_per_frame);
 		if (err < 0)
 			goto end;
+		opts->bits_per_sample = snd_pcm_format_width(format);
 
-		err = snd_pcm_hw_params_set_buffer_size(snd, params,
-			opts->frames_per_period * opts->periods_per_buffer);
-		if (err < 0)
+		err = keep_buffer(opts);
+		if (err < 0 || !opts->loopback)
 			goto end;
 
-		/* snd_pcm_prepare() is also called in this function. */
-		err = snd_pcm_hw_params(snd, params);
+		err = alsa_hw_params(opts->capture, opts, &format,
+				     &opts->capture_channels);
 		if (err < 0)
 			goto end;
 
-		err = snd_pcm_hw_params_get_format(params, &format);
+		err = keep_loopback_buffers(opts, opts->capture_channels);
 		if (err < 0)
 			goto end;
-		opts->bits_per_sample = snd_pcm_format_width(format);
 
-		err = snd_pcm_hw_params_get_channels(params,
-						     &opts->samples_per_frame);
+		/*
+		 * Both streams start at the same time when the buffer for
+		 * playback is filled, thus a frame has the same position in
+		 * both of them.
+		 */
+		err = alsa_sw_params(snd, opts->frames_per_period *
+					  opts->periods_per_buffer);
 		if (err < 0)
 			goto end;
 
-		err = keep_buffer(opts);
+		err = snd_pcm_link(snd, opts->capture);
 	} else {
 		ffado_device_t *ffado = handle;
 		unsigned int ch, data_channels;
@@ -276,20 +461,24 @@ card_process(void *handle, struct something *opts)
 				if (err == -EAGAIN) {
 					continue;
 				} else {
-					if (err == -EPIPE)
+					if (err == -EPIPE) {
+						opts->stats.xruns++;
 						err = snd_pcm_prepare(snd);
+					}
 					if (err < 0)
 						goto end;
 				}
 				frames -= err;
 				total_frames += err;
 			}
+			record_wakeup(opts);
 		} else {
 			ffado_device_t *ffado = handle;
 
 			err = ffado_streaming_wait(ffado);
 			switch (err) {
 			case ffado_wait_xrun:
+				opts->stats.xruns++;
 				err = ffado_streaming_reset(ffado);
 				if (err < 0)
 					goto end;
@@ -306,9 +495,174 @@ card_process(void *handle, struct something *opts)
 			ffado_streaming_transfer_playback_buffers(ffado);
 
 			total_frames += frames;
+			record_wakeup(opts);
 		}
 	}
 end:
+	opts->stats.frames = total_frames;
+	return err;
+}
+
+static void
+detect_impulse(struct something *opts, unsigned int channels,
+	       unsigned long long captured, long long *impulse_pos)
+{
+	struct statistics *stats = &opts->stats;
+	unsigned int f;
+	long latency;
+
+	if (*impulse_pos < 0)
+		return;
+
+	for (f = 0; f < opts->frames_per_period; f++) {
+		int32_t sample = opts->capture_frames[f * channels];
+
+		if (sample > IMPULSE_THRESHOLD || sample < -IMPULSE_THRESHOLD) {
+			latency = (long)(captured + f - *impulse_pos);
+			if (stats->detected == 0 || latency < stats->latency_min)
+				stats->latency_min = latency;
+			if (stats->detected == 0 || latency > stats->latency_max)
+				stats->latency_max = latency;
+			stats->detected++;
+			*impulse_pos = -1;
+			return;
+		}
+	}
+
+	/* Give up when the impulse is not captured till next one. */
+	if (captured + opts->frames_per_period - *impulse_pos >=
+	    (unsigned long long)opts->frames_per_period * IMPULSE_INTERVAL_PERIODS)
+		*impulse_pos = -1;
+}
+
+static int
+loopback_write(snd_pcm_t *snd, struct something *opts, int32_t *frames_buf)
+{
+	unsigned int frames = opts->frames_per_period;
+	int err;
+
+	while (frames > 0) {
+		err = snd_pcm_writei(snd, frames_buf +
+				(opts->frames_per_period - frames) *
+				opts->samples_per_frame, frames);
+		if (err == -EAGAIN)
+			continue;
+		if (err < 0)
+			return err;
+		frames -= err;
+	}
+
+	return 0;
+}
+
+static int
+loopback_read(struct something *opts, unsigned int channels)
+{
+	unsigned int frames = opts->frames_per_period;
+	int err;
+
+	while (frames > 0) {
+		err = snd_pcm_readi(opts->capture, opts->capture_frames +
+				(opts->frames_per_period - frames) * channels,
+				frames);
+		if (err == -EAGAIN)
+			continue;
+		if (err < 0)
+			return err;
+		frames -= err;
+	}
+
+	return 0;
+}
+
+/* Restart both streams with the prefilled buffer after xrun. */
+static int
+loopback_prepare(snd_pcm_t *snd, struct something *opts)
+{
+	unsigned int i;
+	int err;
+
+	err = snd_pcm_drop(snd);
+	if (err < 0)
+		return err;
+
+	err = snd_pcm_prepare(snd);
+	if (err < 0)
+		return err;
+
+	memset(opts->playback_frames, 0, sizeof(*opts->playback_frames) *
+	       opts->frames_per_period * opts->samples_per_frame);
+	for (i = 0; i < opts->periods_per_buffer; i++) {
+		err = loopback_write(snd, opts, opts->playback_frames);
+		if (err < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static int
+card_process_loopback(void *handle, struct something *opts)
+{
+	snd_pcm_t *snd = handle;
+	unsigned long long written, captured, max_frames;
+	unsigned int channels, s, periods;
+	long long impulse_pos = -1;
+	int err;
+
+	channels = opts->capture_channels;
+
+	err = loopback_prepare(snd, opts);
+	if (err < 0)
+		goto end;
+	written = (unsigned long long)opts->frames_per_period *
+		  opts->periods_per_buffer;
+	captured = 0;
+	periods = 0;
+
+	max_frames = (unsigned long long)opts->frames_per_second * opts->seconds;
+
+	run = true;
+	while (run && captured < max_frames) {
+		memset(opts->playback_frames, 0,
+		       sizeof(*opts->playback_frames) *
+		       opts->frames_per_period * opts->samples_per_frame);
+		if (periods++ % IMPULSE_INTERVAL_PERIODS == 0 &&
+		    impulse_pos < 0) {
+			for (s = 0; s < opts->samples_per_frame; s++)
+				opts->playback_frames[s] = IMPULSE_LEVEL;
+			impulse_pos = written;
+			opts->stats.impulses++;
+		}
+
+		err = loopback_write(snd, opts, opts->playback_frames);
+		if (err == 0)
+			err = loopback_read(opts, channels);
+		if (err == -EPIPE) {
+			opts->stats.xruns++;
+			opts->stats.periods = 0;
+			impulse_pos = -1;
+			err = loopback_prepare(snd, opts);
+			if (err < 0)
+				goto end;
+			/* The streams are restarted at the position again. */
+			opts->stats.frames += captured;
+			written = (unsigned long long)opts->frames_per_period *
+				  opts->periods_per_buffer;
+			max_frames -= captured;
+			captured = 0;
+			continue;
+		}
+		if (err < 0)
+			goto end;
+		written += opts->frames_per_period;
+
+		detect_impulse(opts, channels, captured, &impulse_pos);
+		captured += opts->frames_per_period;
+		record_wakeup(opts);
+	}
+end:
+	opts->stats.frames += captured;
 	return err;
 }
 
@@ -317,8 +671,18 @@ card_close(void *handle, struct something *opts)
 {
 	if (opts->buffer != NULL)
 		free(opts->buffer);
+	opts->buffer = NULL;
+	free(opts->playback_frames);
+	opts->playback_frames = NULL;
+	free(opts->capture_frames);
+	opts->capture_frames = NULL;
 
 	if (opts->driver == DRIVER_ALSA) {
+		if (opts->capture != NULL) {
+			snd_pcm_unlink(opts->capture);
+			snd_pcm_close(opts->capture);
+			opts->capture = NULL;
+		}
 		/* snd_pcm_hw_free() is also called in this function. */
 		snd_pcm_close((snd_pcm_t *)handle);
 	} else {
@@ -327,20 +691,24 @@ card_close(void *handle, struct something *opts)
 	}
 }
 
-static int
-get_first_card(struct something *opts)
+/* Fill the device information of cards found at first. */
+static unsigned int
+get_cards(struct something *cards, unsigned int count)
 {
 	struct snd_firewire_get_info info = {0};
+	struct something *opts;
 	snd_hwdep_t *hw;
+	unsigned int found;
 	int number, err;
 	char buf[6];
 
+	found = 0;
 	number = -1;
-	do {
+	while (found < count) {
 		err = snd_card_next(&number);
 		if (err < 0)
 			break;
-		if (number < 0)
+		if (number < 0 || number >= 100)
 			break;
 
 		sprintf(buf, "hw:%d", number);
@@ -350,20 +718,24 @@ get_first_card(struct something *opts)
 
 		err = snd_hwdep_ioctl(hw, SNDRV_FIREWIRE_IOCTL_GET_INFO,
 				      (void *)&info);
-		if (err >= 0) {
-			strcpy(opts->sdev, buf);
-			memcpy(opts->guid, info.guid, sizeof(info.guid));
-			memcpy(opts->fdev, info.device_name, sizeof(info.device_name));
-			snd_hwdep_close(hw);
-			return 0;
-		}
-	} while (number < 100);
+		snd_hwdep_close(hw);
+		if (err < 0)
+			continue;
+
+		opts = cards + found;
+		opts->card = number;
+		strcpy(opts->sdev, buf);
+		memcpy(opts->guid, info.guid, sizeof(info.guid));
+		memcpy(opts->fdev, info.device_name, sizeof(info.device_name));
+		found++;
+	}
 
-	return -1;
+	return found;
 }
 
 static void
-parse_options(int argc, char *argv[], struct something *opts)
+parse_options(int argc, char *argv[], struct something *opts,
+	      unsigned int *cards)
 {
 	const struct option long_options[] = {
 		{"driver",	1, NULL, 'd'},
@@ -372,6 +744,10 @@ parse_options(int argc, char *argv[], struct something *opts)
 		{"fpp",		1, NULL, 'p'},
 		{"rtprio",	1, NULL, 'i'},
 		{"seconds",	1, NULL, 's'},
+		{"loopback",	0, NULL, 'l'},
+		{"sweep",	0, NULL, 'w'},
+		{"format",	1, NULL, 'f'},
+		{"cards",	1, NULL, 'n'},
 		{NULL,		0, NULL, 0},
 	};
 
@@ -383,10 +759,15 @@ parse_options(int argc, char *argv[], struct something *opts)
 	opts->seconds = 3;
 	opts->rtprio = 0;
 	opts->verbose = 0;
+	opts->loopback = false;
+	opts->sweep = false;
+	opts->format = OUTPUT_CSV;
+	opts->usage_who = RUSAGE_SELF;
+	*cards = 1;
 
 	while (1) {
 		int c;
-		c = getopt_long(argc, argv, "d:r:b:p:i:s:v:", long_options, NULL);
+		c = getopt_long(argc, argv, "d:r:b:p:i:s:v:lwf:n:", long_options, NULL);
 		if (c < 0)
 			break;
 
@@ -413,6 +794,19 @@ parse_options(int argc, char *argv[], struct something *opts)
 		case 'v':
 			opts->verbose = atoi(optarg);
 			break;
+		case 'l':
+			opts->loopback = true;
+			break;
+		case 'w':
+			opts->sweep = true;
+			break;
+		case 'f':
+			if (strcmp("json", optarg) == 0)
+				opts->format = OUTPUT_JSON;
+			break;
+		case 'n':
+			*cards = atoi(optarg);
+			break;
 		}
 	}
 }
@@ -422,40 +816,296 @@ static void signal_handler(int sig)
 	run = false;
 }
 
-int main(int argv, char *argc[])
+static void
+print_header(struct something *opts)
 {
-	struct something opts = {0};
-	void *handle;
-	int err;
+	if (opts->format == OUTPUT_CSV)
+		printf("card,driver,rate,period,periods,frames,seconds,xruns,"
+		       "cpu_user,cpu_system,wakeups_per_second,"
+		       "jitter_avg_us,jitter_max_us,"
+		       "impulses,detected,latency_min,latency_max\n");
+}
 
-	signal(SIGINT, signal_handler);
-	signal(SIGTERM, signal_handler);
-	signal(SIGABRT, signal_handler);
+static void
+print_result(struct something *opts, const char *card)
+{
+	const struct statistics *stats = &opts->stats;
+	const char *driver = opts->driver == DRIVER_ALSA ? "alsa" : "ffado";
+	double wakeups = 0.0;
+	double jitter_avg = 0.0;
+
+	if (stats->elapsed > 0.0)
+		wakeups = stats->wakeups / stats->elapsed;
+	if (stats->paced > 0)
+		jitter_avg = stats->jitter_sum / stats->paced;
+
+	if (opts->format == OUTPUT_CSV) {
+		printf("%s,%s,%u,%u,%u,%llu,%.3f,%u,%.3f,%.3f,%.1f,%.1f,%.1f,"
+		       "%u,%u,%ld,%ld\n",
+		       card, driver, opts->frames_per_second,
+		       opts->frames_per_period, opts->periods_per_buffer,
+		       stats->frames, stats->elapsed, stats->xruns,
+		       stats->cpu_user, stats->cpu_system, wakeups,
+		       jitter_avg * 1000000.0, stats->jitter_max * 1000000.0,
+		       stats->impulses, stats->detected,
+		       stats->latency_min, stats->latency_max);
+	} else {
+		printf("{\"card\": \"%s\", \"driver\": \"%s\", \"rate\": %u, "
+		       "\"period\": %u, \"periods\": %u, \"frames\": %llu, "
+		       "\"seconds\": %.3f, \"xruns\": %u, \"cpu_user\": %.3f, "
+		       "\"cpu_system\": %.3f, \"wakeups_per_second\": %.1f, "
+		       "\"jitter_avg_us\": %.1f, \"jitter_max_us\": %.1f, "
+		       "\"impulses\": %u, \"detected\": %u, "
+		       "\"latency_min\": %ld, \"latency_max\": %ld, "
+		       "\"error\": %d}\n",
+		       card, driver, opts->frames_per_second,
+		       opts->frames_per_period, opts->periods_per_buffer,
+		       stats->frames, stats->elapsed, stats->xruns,
+		       stats->cpu_user, stats->cpu_system, wakeups,
+		       jitter_avg * 1000000.0, stats->jitter_max * 1000000.0,
+		       stats->impulses, stats->detected,
+		       stats->latency_min, stats->latency_max, opts->err);
+	}
+	fflush(stdout);
+}
 
-	parse_options(argv, argc, &opts);
+static int
+run_once(struct something *opts)
+{
+	struct rusage usage_begin, usage_end;
+	struct timespec begin, end;
+	void *handle = NULL;
+	int err;
 
-	err = get_first_card(&opts);
-	if (err < 0)
-		goto end;
+	memset(&opts->stats, 0, sizeof(opts->stats));
+	opts->stats.latency_min = -1;
+	opts->stats.latency_max = -1;
 
 	/* open character device */
-	err = card_open(&handle, &opts);
+	err = card_open(&handle, opts);
 	if (err < 0)
 		goto end;
 
 	/* set parameters and start streams */
-	err = card_hw_params(handle, &opts);
+	err = card_hw_params(handle, opts);
 	if (err < 0)
 		goto close;
 
+	getrusage(opts->usage_who, &usage_begin);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
 	/* transfer PCM samples */
-	err = card_process(handle, &opts);
+	if (opts->loopback)
+		err = card_process_loopback(handle, opts);
+	else
+		err = card_process(handle, opts);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(opts->usage_who, &usage_end);
+
+	opts->stats.elapsed = timespec_to_seconds(&end) -
+			      timespec_to_seconds(&begin);
+	opts->stats.cpu_user = timeval_to_seconds(&usage_end.ru_utime) -
+			       timeval_to_seconds(&usage_begin.ru_utime);
+	opts->stats.cpu_system = timeval_to_seconds(&usage_end.ru_stime) -
+				 timeval_to_seconds(&usage_begin.ru_stime);
+	/* The thread sleeps voluntarily to wait for period. */
+	opts->stats.wakeups = usage_end.ru_nvcsw - usage_begin.ru_nvcsw;
 close:
 	/* stop streams and close character devices */
 	if (handle != NULL)
-		card_close(handle, &opts);
+		card_close(handle, opts);
+end:
+	opts->err = err;
+	return err;
+}
+
+static void *
+card_thread(void *arg)
+{
+	run_once(arg);
+
+	return NULL;
+}
+
+/*
+ * Drive the cards at once by threads. Each thread is pinned to CPU in turn,
+ * and scheduled in SCHED_FIFO when realtime priority is given. The CPU time
+ * of each card is for the thread. The total is for the process, including the
+ * threads of FFADO.
+ */
+static int
+run_cards(struct something *cards, unsigned int count)
+{
+	struct something total = cards[0];
+	struct rusage usage_begin, usage_end;
+	struct timespec begin, end;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t *threads;
+	unsigned int i;
+	char label[8];
+	int err = 0;
+
+	threads = calloc(count, sizeof(*threads));
+	if (threads == NULL)
+		return -ENOMEM;
+
+	getrusage(RUSAGE_SELF, &usage_begin);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (i = 0; i < count; i++) {
+		pthread_attr_t attr;
+		cpu_set_t cpuset;
+
+		cards[i].usage_who = RUSAGE_THREAD;
+
+		pthread_attr_init(&attr);
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpus > 0 ? i % cpus : 0, &cpuset);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+
+		if (cards[i].rtprio > 0) {
+			struct sched_param param = {
+				.sched_priority = cards[i].rtprio,
+			};
+
+			pthread_attr_setinheritsched(&attr,
+						     PTHREAD_EXPLICIT_SCHED);
+			pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+			pthread_attr_setschedparam(&attr, &param);
+		}
+
+		err = -pthread_create(&threads[i], &attr, card_thread,
+				      cards + i);
+		pthread_attr_destroy(&attr);
+		if (err < 0) {
+			run = false;
+			break;
+		}
+	}
+	count = i;
+
+	for (i = 0; i < count; i++)
+		pthread_join(threads[i], NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &usage_end);
+	free(threads);
+
+	memset(&total.stats, 0, sizeof(total.stats));
+	total.stats.latency_min = -1;
+	total.stats.latency_max = -1;
+	total.err = err;
+
+	for (i = 0; i < count; i++) {
+		const struct statistics *stats = &cards[i].stats;
+
+		snprintf(label, sizeof(label), "%u", cards[i].card);
+		print_result(cards + i, label);
+
+		total.stats.frames += stats->frames;
+		total.stats.xruns += stats->xruns;
+		total.stats.wakeups += stats->wakeups;
+		total.stats.impulses += stats->impulses;
+		total.stats.detected += stats->detected;
+		total.stats.paced += stats->paced;
+		total.stats.jitter_sum += stats->jitter_sum;
+		if (stats->jitter_max > total.stats.jitter_max)
+			total.stats.jitter_max = stats->jitter_max;
+		if (stats->detected > 0) {
+			if (total.stats.latency_min < 0 ||
+			    stats->latency_min < total.stats.latency_min)
+				total.stats.latency_min = stats->latency_min;
+			if (stats->latency_max > total.stats.latency_max)
+				total.stats.latency_max = stats->latency_max;
+		}
+		if (cards[i].err < 0 && total.err == 0)
+			total.err = cards[i].err;
+	}
+
+	total.stats.elapsed = timespec_to_seconds(&end) -
+			      timespec_to_seconds(&begin);
+	total.stats.cpu_user = timeval_to_seconds(&usage_end.ru_utime) -
+			       timeval_to_seconds(&usage_begin.ru_utime);
+	total.stats.cpu_system = timeval_to_seconds(&usage_end.ru_stime) -
+				 timeval_to_seconds(&usage_begin.ru_stime);
+	print_result(&total, "all");
+
+	return total.err;
+}
+
+int main(int argv, char *argc[])
+{
+	static const unsigned int sweep_periods[] = {
+		32, 64, 128, 256, 512, 1024,
+	};
+	static const unsigned int sweep_buffers[] = {
+		2, 3, 4,
+	};
+	struct something opts = {0};
+	struct something *cards;
+	unsigned int count, found;
+	unsigned int i, j, k;
+	char label[8];
+	int err;
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	signal(SIGABRT, signal_handler);
+
+	parse_options(argv, argc, &opts, &count);
+	if (count == 0)
+		count = 1;
+
+	if (opts.loopback && opts.driver != DRIVER_ALSA) {
+		printf("Loopback mode is available just for ALSA\n");
+		exit(EXIT_FAILURE);
+	}
+
+	cards = calloc(count, sizeof(*cards));
+	if (cards == NULL) {
+		err = -ENOMEM;
+		goto end;
+	}
+	for (i = 0; i < count; i++)
+		cards[i] = opts;
+
+	found = get_cards(cards, count);
+	if (found < count) {
+		fprintf(stderr, "%u of %u cards found\n", found, count);
+		err = -ENODEV;
+		goto end;
+	}
+
+	print_header(&opts);
+
+	run = true;
+	for (i = 0; run && i < sizeof(sweep_periods) / sizeof(*sweep_periods); i++) {
+		for (j = 0; run && j < sizeof(sweep_buffers) / sizeof(*sweep_buffers); j++) {
+			if (opts.sweep) {
+				for (k = 0; k < count; k++) {
+					cards[k].frames_per_period = sweep_periods[i];
+					cards[k].periods_per_buffer = sweep_buffers[j];
+				}
+			}
+
+			/* Continue to next combination at failure. */
+			if (count > 1) {
+				err = run_cards(cards, count);
+			} else {
+				err = run_once(cards);
+				snprintf(label, sizeof(label), "%u", cards->card);
+				print_result(cards, label);
+			}
+
+			if (!opts.sweep)
+				goto end;
+		}
+	}
 end:
+	free(cards);
 	if (err < 0)
-		printf("Error :%s\n", snd_strerror(err));
-	exit(EXIT_SUCCESS);
+		fprintf(stderr, "Error :%s\n", snd_strerror(err));
+	exit(err < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
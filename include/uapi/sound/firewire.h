@@ -14,6 +14,7 @@
 #define SNDRV_FIREWIRE_EVENT_MOTU_NOTIFICATION	0x64776479
 #define SNDRV_FIREWIRE_EVENT_TASCAM_CONTROL	0x7473636d
 #define SNDRV_FIREWIRE_EVENT_MOTU_REGISTER_DSP_CHANGE	0x4d545244
+#define SNDRV_FIREWIRE_EVENT_MIDI_TIMESTAMP	0x4d494454
 
 struct snd_firewire_event_common {
 	unsigned int type; /* SNDRV_FIREWIRE_EVENT_xxx */
@@ -72,6 +73,22 @@ struct snd_firewire_event_motu_register_dsp_change {
 	__u32 changes[];	/* Encoded event for change of register DSP. */
 };
 
+/*
+ * Delivered only through the mapped ring, in addition to the rawmidi substream.
+ * The cycle field is the count of isochronous cycle in which the packet
+ * including the MIDI bytes was received, in the range of 8000 * 8 (3 bits of
+ * second and 13 bits of cycle, as 1394 OHCI timestamp). The offset field is the
+ * position of data block in the cycle, in ticks of 24.576 MHz less than 3072.
+ */
+struct snd_firewire_event_midi_timestamp {
+	unsigned int type;
+	__u32 cycle;
+	__u16 offset;
+	__u8 port;
+	__u8 length;
+	__u8 bytes[4];
+};
+
 union snd_firewire_event {
 	struct snd_firewire_event_common            common;
 	struct snd_firewire_event_lock_status       lock_status;
@@ -81,9 +98,80 @@ union snd_firewire_event {
 	struct snd_firewire_event_tascam_control    tascam_control;
 	struct snd_firewire_event_motu_notification motu_notification;
 	struct snd_firewire_event_motu_register_dsp_change motu_register_dsp_change;
+	struct snd_firewire_event_midi_timestamp    midi_timestamp;
+};
+
+/*
+ * Some hwdep devices can also be mapped by mmap(2) from offset 0 to consume
+ * events without read(2). The mapping starts with struct
+ * snd_firewire_event_ring, and the data area begins at the given offset.
+ *
+ * The data area is a single-producer/single-consumer ring of records. Each
+ * record starts with a __u32 field for the length of the record in bytes,
+ * including the field itself and aligned to 4 bytes, and the event in the
+ * layout of union snd_firewire_event follows. The record of zero length means
+ * that the next record starts at the beginning of the data area.
+ *
+ * The kernel advances the head field after writing records, then wakes up
+ * pollers. The userspace should read the head field with acquire semantics,
+ * consume records from the tail field, then advance the tail field with
+ * release semantics. While the device is mapped, the events in the ring are
+ * not delivered by read(2).
+ */
+struct snd_firewire_event_ring {
+	__u32 head;	/* Written by the kernel. */
+	__u32 tail;	/* Written by the userspace. */
+	__u32 size;	/* The size of data area in bytes. */
+	__u32 offset;	/* The offset of data area in the mapping. */
+	__u32 dropped;	/* The number of events dropped due to no space. */
 };
 
+/*
+ * The proc node "capture" of the sound card can be mapped by mmap(2) in the
+ * same layout as struct snd_firewire_event_ring, to capture isochronous packets
+ * of the streams. Each record in the data area has the layout of struct
+ * snd_firewire_packet_record after the length field. The cycle field is in the
+ * same range as struct snd_firewire_event_midi_timestamp. The length field is
+ * the data length of isochronous packet in bytes. The quadlets field includes
+ * the CIP header and then the first quadlets of payload, up to the number
+ * written to the proc node "capture_quadlets", in the order on the bus.
+ */
+#define SNDRV_FIREWIRE_PACKET_RECORD_IN	0x01	/* From the device. */
+
+struct snd_firewire_packet_record {
+	__u32 cycle;
+	__u8 flags;		/* SNDRV_FIREWIRE_PACKET_RECORD_xxx */
+	__u8 channel;
+	__u8 header_quadlets;	/* The number of quadlets of CIP header. */
+	__u8 payload_quadlets;	/* The number of quadlets of captured payload. */
+	__u32 length;
+	__be32 quadlets[];
+};
 
+/*
+ * The proc node "firewire_events" of snd-firewire-lib module can be read by
+ * read(2) to consume the events from all of sound cards for FireWire audio
+ * devices. Each record has the layout below, and the event in the layout of
+ * union snd_firewire_event follows. The length field is the length of record
+ * in bytes including the header, aligned to 4 bytes. The card field is the
+ * index of sound card. The dropped field is the number of events dropped due
+ * to no space just before the record. One read(2) returns as many whole
+ * records as fit in the given buffer. The events are not queued till the node
+ * is opened, and the node can be opened by one process at a time.
+ */
+struct snd_firewire_event_record {
+	__u32 length;
+	__u32 card;
+	__u32 dropped;
+	__u32 event[];
+};
+
+
+#define SNDRV_FIREWIRE_IOCTL_GET_PCM_METER	_IOWR('H', 0xf3, struct snd_firewire_pcm_meter)
+#define SNDRV_FIREWIRE_IOCTL_EFW_TRANSACTION	_IOWR('H', 0xf4, struct snd_firewire_efw_transaction)
+#define SNDRV_FIREWIRE_IOCTL_SYNC_START	_IOWR('H', 0xf5, struct snd_firewire_sync_start)
+#define SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE	_IOWR('H', 0xf6, struct snd_firewire_stream_rate)
+#define SNDRV_FIREWIRE_IOCTL_TASCAM_STATE_DELTA _IOWR('H', 0xf7, struct snd_firewire_tascam_state_delta)
 #define SNDRV_FIREWIRE_IOCTL_GET_INFO _IOR('H', 0xf8, struct snd_firewire_get_info)
 #define SNDRV_FIREWIRE_IOCTL_LOCK      _IO('H', 0xf9)
 #define SNDRV_FIREWIRE_IOCTL_UNLOCK    _IO('H', 0xfa)
@@ -91,6 +179,7 @@ union snd_firewire_event {
 #define SNDRV_FIREWIRE_IOCTL_MOTU_REGISTER_DSP_METER	_IOR('H', 0xfc, struct snd_firewire_motu_register_dsp_meter)
 #define SNDRV_FIREWIRE_IOCTL_MOTU_COMMAND_DSP_METER	_IOR('H', 0xfd, struct snd_firewire_motu_command_dsp_meter)
 #define SNDRV_FIREWIRE_IOCTL_MOTU_REGISTER_DSP_PARAMETER	_IOR('H', 0xfe, struct snd_firewire_motu_register_dsp_parameter)
+#define SNDRV_FIREWIRE_IOCTL_JOIN_DOMAIN	_IOW('H', 0xff, struct snd_firewire_join_domain)
 
 #define SNDRV_FIREWIRE_TYPE_DICE	1
 #define SNDRV_FIREWIRE_TYPE_FIREWORKS	2
@@ -113,12 +202,129 @@ struct snd_firewire_get_info {
  * Returns -EBUSY if the driver is already streaming.
  */
 
+/*
+ * SNDRV_FIREWIRE_IOCTL_JOIN_DOMAIN lets the packet streaming of the unit be driven by the hardware
+ * IRQ of the other unit handled by the same driver on the same bus, so that the units are
+ * processed in lockstep. The number of sound card for the other unit is given, or -1 to leave.
+ * Returns -EBUSY if any of the units is streaming. The unit can start streaming just while the
+ * other unit is streaming, and the streaming is aborted when the other unit stops streaming.
+ */
+struct snd_firewire_join_domain {
+	int card;
+};
+
+/*
+ * SNDRV_FIREWIRE_IOCTL_EFW_TRANSACTION sends the command frame of Fireworks transaction and waits
+ * for its response, which is copied just to the buffer of the caller instead of the queue shared
+ * by the readers of the hwdep device. Several callers can run transactions at the same time. The
+ * sequence number in the command should be within SND_EFW_TRANSACTION_USER_SEQNUM_MAX, and the
+ * response has the number plus 1 as the device does. The size of response frame is returned.
+ */
+struct snd_firewire_efw_transaction {
+	__u64 command;		/* in: the address of command frame in user space. */
+	__u64 response;		/* in: the address of buffer for response frame in user space. */
+	__u32 command_size;	/* in: the size of command frame in bytes. */
+	__u32 response_size;	/* in: the size of buffer. out: the size of response frame. */
+};
+
+/*
+ * SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE returns the rate of events in the isochronous packet stream
+ * transmitted by the unit, estimated by delay-locked loop from the history of isochronous cycle
+ * and SYT field. The index of stream is given for the unit which transmits several streams. The
+ * nominal rate is 0 when the stream is not running, and the estimation is reliable just after
+ * SNDRV_FIREWIRE_STREAM_RATE_LOCKED is set.
+ */
+#define SNDRV_FIREWIRE_STREAM_RATE_LOCKED	0x00000001
+
+struct snd_firewire_stream_rate {
+	__u32 index;		/* in: the index of stream transmitted by the unit. */
+	__u32 flags;		/* out: SNDRV_FIREWIRE_STREAM_RATE_XXX. */
+	__u32 nominal;		/* out: the nominal rate in Hz. */
+	__s32 deviation;	/* out: the deviation of estimated rate from nominal one in ppb. */
+};
+
+/*
+ * SNDRV_FIREWIRE_IOCTL_GET_PCM_METER returns the peak of PCM samples in each channel of AM824
+ * data block, accumulated in the pass of kernel to encode or decode the samples. The peaks are
+ * accumulated for one second since the last call, thus the first call enables the metering and
+ * returns nothing meaningful. The peak is the maximum absolute value of 24 bit samples since
+ * the last call, and the hold is the maximum since the stream starts or the hold is reset by
+ * SNDRV_FIREWIRE_PCM_METER_RESET_HOLD. The number of channels is 0 when the stream is not running.
+ */
+#define SNDRV_FIREWIRE_PCM_METER_IN		0x00000000	/* From the unit. */
+#define SNDRV_FIREWIRE_PCM_METER_OUT		0x00000001	/* To the unit. */
+#define SNDRV_FIREWIRE_PCM_METER_RESET_HOLD	0x00000001
+#define SNDRV_FIREWIRE_PCM_METER_CHANNELS	64
+
+struct snd_firewire_pcm_meter {
+	__u32 direction;	/* in: SNDRV_FIREWIRE_PCM_METER_IN or OUT. */
+	__u32 index;		/* in: the index of stream in the direction. */
+	__u32 flags;		/* in: SNDRV_FIREWIRE_PCM_METER_XXX. */
+	__u32 channels;		/* out: the number of PCM channels in data block. */
+	__u32 peaks[SNDRV_FIREWIRE_PCM_METER_CHANNELS];
+	__u32 holds[SNDRV_FIREWIRE_PCM_METER_CHANNELS];
+};
+
+/*
+ * SNDRV_FIREWIRE_IOCTL_SYNC_START arms the isochronous cycle at which the unit begins processing
+ * content of packets in both directions, so that several sound cards begin on the same cycle.
+ * The cycle is in the range of 8 seconds of bus, as seconds * 8000 + cycle. The same cycle should
+ * be armed for all of the cards before starting PCM substreams, then the substreams should be
+ * started before the cycle. The cards are expected to be on the same bus, which is identified by
+ * the card field of struct snd_firewire_get_info, with the common clock source. The armed cycle
+ * is consumed when the streaming starts. SNDRV_FIREWIRE_SYNC_START_MISSED is set when the
+ * streaming in the last session was not ready to begin at the armed cycle, thus began later.
+ */
+#define SNDRV_FIREWIRE_SYNC_START_QUERY		0	/* Just retrieve the current cycle. */
+#define SNDRV_FIREWIRE_SYNC_START_ARM		1
+#define SNDRV_FIREWIRE_SYNC_START_DISARM	2
+
+#define SNDRV_FIREWIRE_SYNC_START_ARMED		0x00000001
+#define SNDRV_FIREWIRE_SYNC_START_MISSED	0x00000002
+
+struct snd_firewire_sync_start {
+	__u32 request;		/* in: SNDRV_FIREWIRE_SYNC_START_QUERY/ARM/DISARM. */
+	__u32 cycle;		/* in: the cycle to arm. out: the current cycle of bus. */
+	__u32 flags;		/* out: SNDRV_FIREWIRE_SYNC_START_XXX. */
+};
+
+/*
+ * The element control "AMDTP In Stream Counters" and "AMDTP Out Stream Counters" in card interface
+ * has read-only 64 bit integer values for each stream. The value at the index below is the
+ * number of events since the unit is detected, kept across sessions of streaming.
+ */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_PACKETS		0	/* Packets processed. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_LOST_CYCLES	1	/* Discontinuities of cycle. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_DBC_DISCONTINUITIES 2	/* Discontinuities of DBC field. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_CIP_HEADER_ERRORS	3	/* Invalid CIP headers. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_XRUNS		4	/* Cancellation or resync. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_RESTARTS		5	/* Sessions after the first. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_BUS_RESETS	6	/* Bus resets survived in session. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_SHED_PASSES	7	/* Passes shedding optional stages. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_CONCEALED_CYCLES	8	/* Lost cycles filled with silence. */
+#define SNDRV_FIREWIRE_STREAM_COUNTER_COUNT		9
+
 #define SNDRV_FIREWIRE_TASCAM_STATE_COUNT	64
 
 struct snd_firewire_tascam_state {
 	__be32 data[SNDRV_FIREWIRE_TASCAM_STATE_COUNT];
 };
 
+/*
+ * SNDRV_FIREWIRE_IOCTL_TASCAM_STATE_DELTA returns the state changed since the given generation.
+ * The generation is bumped for each batch of packets in which any state changes. The generation
+ * returned by the last call should be given for the next call, or 0 to retrieve all of the state.
+ * When SNDRV_FIREWIRE_TASCAM_STATE_DELTA_WAIT is given, the call blocks till any change.
+ */
+#define SNDRV_FIREWIRE_TASCAM_STATE_DELTA_WAIT	0x00000001
+
+struct snd_firewire_tascam_state_delta {
+	__u32 generation;	/* in: the last generation. out: the current generation. */
+	__u32 flags;		/* in: SNDRV_FIREWIRE_TASCAM_STATE_DELTA_XXX. */
+	__u64 mask;		/* out: the bit N is set if the state at index N changed. */
+	__be32 data[SNDRV_FIREWIRE_TASCAM_STATE_COUNT];	/* out: valid at the indices in mask. */
+};
+
 /*
  * In below MOTU models, software is allowed to control their DSP by accessing to registers.
  *  - 828mk2
@@ -258,4 +464,148 @@ struct snd_firewire_motu_command_dsp_meter {
 #endif
 };
 
+/*
+ * The hwdep device for MOTU models with DSP can be mapped by mmap(2) at the offset to read meters
+ * without ioctl(2). The mapping is read-only and one page long.
+ */
+#define SNDRV_FIREWIRE_MOTU_METER_PAGE_OFFSET	0x10000000
+
+/**
+ * struct snd_firewire_motu_meter_page - the layout of page for meter information
+ * @sequence: The sequence counter. It is odd while the kernel updates the page, and bumped
+ *	      again after the update.
+ * @register_dsp: The meter for models with DSP controlled by registers.
+ * @command_dsp: The meter for models with DSP controlled by command.
+ *
+ * The userspace application should read the sequence counter, then copy the meter, then read the
+ * counter again to retry when it is odd or changed, with read memory barriers between them.
+ */
+struct snd_firewire_motu_meter_page {
+	__u32 sequence;
+	__u32 reserved;
+	union {
+		struct snd_firewire_motu_register_dsp_meter register_dsp;
+		struct snd_firewire_motu_command_dsp_meter command_dsp;
+	};
+};
+
+/*
+ * The hwdep device for Fireworks can be mapped by mmap(2) at the offset to read the snapshot of
+ * physical meters polled by the driver, without issuing EFW transactions. The mapping is read-only
+ * and one page long. The driver polls the meters when the module parameter "meter_interval" is not
+ * zero.
+ */
+#define SNDRV_FIREWIRE_EFW_METER_PAGE_OFFSET	0x10000000
+
+/**
+ * struct snd_firewire_efw_meter_page - the layout of page for snapshot of physical meters
+ * @sequence: The sequence counter. It is odd while the kernel updates the page, and bumped
+ *	      again after the update. It stays zero till the first poll.
+ * @status: The status of guitar, MIDI signal and clock input detection.
+ * @out_meters: The number of meters for physical outputs.
+ * @in_meters: The number of meters for physical inputs, following to the outputs.
+ * @values: Linear values of signal level. The dB is 20 * log10(value / 0x01000000).
+ *
+ * The userspace application should read the sequence counter, then copy the meters, then read
+ * the counter again to retry when it is odd or changed, with read memory barriers between them.
+ */
+struct snd_firewire_efw_meter_page {
+	__u32 sequence;
+	__u32 status;
+	__u32 out_meters;
+	__u32 in_meters;
+	__u32 values[];
+};
+
+/*
+ * The hwdep device of each unit can be mapped by mmap(2) at the offset below, with one page for
+ * each isochronous packet stream. The offset of page is the base plus PAGE_SIZE multiplied by the
+ * index of stream. The streams transmitted by the unit come first, then the streams received by
+ * the unit follow in the same order as the PCM devices.
+ */
+#define SNDRV_FIREWIRE_STREAM_TIMING_PAGE_OFFSET	0x20000000
+
+/**
+ * struct snd_firewire_stream_timing_page - the layout of page for timing of packet stream
+ * @sequence: The sequence counter. It is odd while the kernel updates the page, and bumped
+ *	      again after the update. It stays zero till the first update.
+ * @flags: SNDRV_FIREWIRE_STREAM_RATE_XXX for the estimated rate.
+ * @frames: The number of PCM frames transferred since PCM substream was prepared.
+ * @cycle: The isochronous cycle of the last packet processed for the frames, in the same range
+ *	   as struct snd_firewire_event_midi_timestamp.
+ * @syt: The SYT field of the packet, or 0xffff without it.
+ * @nominal: The nominal rate in Hz.
+ * @deviation: The deviation of estimated rate from nominal one in ppb, for the stream
+ *	       transmitted by the unit.
+ *
+ * The page is updated whenever the PCM frames in the batch of packets are processed. The reader
+ * should follow the same protocol as struct snd_firewire_efw_meter_page.
+ */
+struct snd_firewire_stream_timing_page {
+	__u32 sequence;
+	__u32 flags;
+	__u64 frames;
+	__u32 cycle;
+	__u32 syt;
+	__u32 nominal;
+	__s32 deviation;
+};
+
+/*
+ * The hwdep device of each unit can be mapped by mmap(2) at the offset below for the packets of
+ * each isochronous packet stream, in read-only. The window for the stream is at the base plus
+ * SNDRV_FIREWIRE_STREAM_PACKETS_WINDOW multiplied by the index of stream, in the same order as the
+ * pages for timing. The window begins with struct snd_firewire_stream_packets_page, then the
+ * payload of packets is at SNDRV_FIREWIRE_STREAM_PACKETS_PAYLOAD_OFFSET in the window.
+ */
+#define SNDRV_FIREWIRE_STREAM_PACKETS_OFFSET		0x30000000
+#define SNDRV_FIREWIRE_STREAM_PACKETS_WINDOW		0x01000000
+#define SNDRV_FIREWIRE_STREAM_PACKETS_PAYLOAD_OFFSET	0x00800000
+
+/**
+ * struct snd_firewire_stream_packet - the descriptor of packet in the slot of queue
+ * @cycle: The isochronous cycle of packet, in the same range as struct
+ *	   snd_firewire_event_midi_timestamp.
+ * @syt: The SYT field of the packet, or 0xffff without it.
+ * @data_blocks: The number of data blocks in the packet.
+ * @data_block_counter: The data block counter of the packet.
+ * @reserved: Padding.
+ */
+struct snd_firewire_stream_packet {
+	__u16 cycle;
+	__u16 syt;
+	__u16 data_blocks;
+	__u8 data_block_counter;
+	__u8 reserved;
+};
+
+/**
+ * struct snd_firewire_stream_packets_page - the layout of pages for packets of packet stream
+ * @sequence: The sequence counter, in the same protocol as struct snd_firewire_stream_timing_page.
+ * @queue_size: The number of slots in the queue of isochronous context.
+ * @packet_size: The size of slot in bytes.
+ * @packets_per_page: The number of slots in one page, or zero when the slots are contiguous over
+ *		      pages.
+ * @head: The index of slot next to the one of the last processed packet.
+ * @reserved: Padding.
+ * @count: The number of packets processed since the pages are mapped at first.
+ * @packets: The descriptors for the slots, with @queue_size entries.
+ *
+ * The slot at index i begins at i * @packet_size in the payload area, or at
+ * (i / @packets_per_page) * PAGE_SIZE + (i % @packets_per_page) * @packet_size when
+ * @packets_per_page is not zero. The payload of packet transmitted by the unit excludes the CIP
+ * header. The pages are updated whenever the batch of packets is processed, while the kernel
+ * keeps building and parsing the payload.
+ */
+struct snd_firewire_stream_packets_page {
+	__u32 sequence;
+	__u32 queue_size;
+	__u32 packet_size;
+	__u32 packets_per_page;
+	__u32 head;
+	__u32 reserved;
+	__u64 count;
+	struct snd_firewire_stream_packet packets[];
+};
+
 #endif /* _UAPI_SOUND_FIREWIRE_H_INCLUDED */
@@ -0,0 +1,99 @@
+/*
+ * pcmbench-shim.h - definitions for sound/firewire/amdtp-pcm.h in userspace
+ *
+ * The definitions are the same as the kernel, sound/firewire/amdtp-stream.h and
+ * amdtp-stream.c, just for the fields which the kernels of sample conversion
+ * and the cache of silence use. Keep them in sync.
+ */
+
+#ifndef PCMBENCH_SHIM_H_INCLUDED
+#define PCMBENCH_SHIM_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <endian.h>
+
+#include "timestamp-shim.h"
+
+/* The kernel defines it just for little endian host. */
+#if __BYTE_ORDER == __BIG_ENDIAN
+#undef __LITTLE_ENDIAN
+#endif
+
+typedef int32_t s32;
+typedef uint32_t u32;
+typedef uint32_t __le32;
+typedef uint32_t __be32;
+
+#ifndef __always_inline
+#define __always_inline		inline __attribute__((__always_inline__))
+#endif
+#define __force
+#define __read_mostly
+
+#define cpu_to_le32(x)		htole32(x)
+#define cpu_to_be32(x)		htobe32(x)
+#define le32_to_cpu(x)		le32toh(x)
+#define be32_to_cpu(x)		be32toh(x)
+
+#define min_t(type, x, y)	((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+
+/* The same values as include/uapi/sound/asound.h for little endian host. */
+typedef int snd_pcm_format_t;
+typedef unsigned long snd_pcm_uframes_t;
+
+#define SNDRV_PCM_FORMAT_S24_LE			6
+#define SNDRV_PCM_FORMAT_S32_LE			10
+#define SNDRV_PCM_FORMAT_S24_3LE		32
+#define SNDRV_PCM_FORMAT_S24			SNDRV_PCM_FORMAT_S24_LE
+#define SNDRV_PCM_FORMAT_S32			SNDRV_PCM_FORMAT_S32_LE
+
+#define SNDRV_PCM_ACCESS_MMAP_INTERLEAVED	0
+#define SNDRV_PCM_ACCESS_MMAP_NONINTERLEAVED	1
+#define SNDRV_PCM_ACCESS_RW_INTERLEAVED		3
+#define SNDRV_PCM_ACCESS_RW_NONINTERLEAVED	4
+
+struct snd_pcm_runtime {
+	int access;
+	snd_pcm_format_t format;
+	unsigned int channels;
+	unsigned int frame_bits;
+	snd_pcm_uframes_t buffer_size;
+	unsigned char *dma_area;
+	size_t dma_bytes;
+};
+
+struct snd_pcm_substream {
+	struct snd_pcm_runtime *runtime;
+};
+
+static inline size_t
+frames_to_bytes(const struct snd_pcm_runtime *runtime, snd_pcm_uframes_t frames)
+{
+	return frames * runtime->frame_bits / 8;
+}
+
+struct pkt_desc {
+	u16 cycle;
+	u16 syt;
+	u16 data_blocks;
+	u8 data_block_counter;
+	__be32 *ctx_payload;
+};
+
+struct amdtp_stream {
+	unsigned int data_block_quadlets;
+	unsigned int pcm_buffer_pointer;
+	unsigned int queue_size;
+	int packet_index;
+	struct pkt_desc *pkt_descs;
+	union {
+		struct {
+			u16 *pcm_silence;
+		} rx;
+	} ctx_data;
+};
+
+#endif
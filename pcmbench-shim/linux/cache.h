@@ -0,0 +1,2 @@
+/* sound/firewire/digi00x/amdtp-dot-scrt.c includes this instead of the header of kernel. */
+#include "../../pcmbench-shim.h"
@@ -0,0 +1,2 @@
+/* sound/firewire/amdtp-pcm.h includes this instead of the header of kernel. */
+#include "../../pcmbench-shim.h"
@@ -0,0 +1,858 @@
+/*
+ * pcmbench.c - benchmark for the packet pass of PCM frames over simulated
+ * isochronous cycles
+ *
+ * No hardware is required. The simulated isochronous contexts run at the
+ * 8,000 cycles per second of IEEE 1394 bus for the given number of streams.
+ * Per cycle, each stream pools the sequence descriptor of ideal packet from
+ * sound/firewire/amdtp-ideal-seq.c, then the IT side encodes PCM frames into
+ * the payload of AM824 data blocks with the kernels in
+ * sound/firewire/amdtp-pcm.h and the IR side parses the CIP header of the
+ * packet and decodes the PCM frames again, then both of PCM buffer pointers
+ * are moved forward with the check of period elapse. The code of kernel is
+ * built in userspace with the shim headers, thus the run is available for
+ * perf(1).
+ *
+ * The protocols mode runs the packet path of PCM frames in the protocols of
+ * AM824, Fireface, TASCAM, Digi 00x and MOTU, with their parameters, for each
+ * rate and the representative numbers of channels, then reports the time per
+ * data block for each direction.
+ *
+ * gcc -O2 -I. -I./pcmbench-shim ./pcmbench.c -o ./pcmbench
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pcmbench-shim.h"
+#include "sound/firewire/amdtp-ideal-seq.c"
+#include "sound/firewire/amdtp-pcm.h"
+#include "sound/firewire/digi00x/amdtp-dot-scrt.c"
+
+/* The size of ring for sequence descriptors, and the number per callback. */
+#define SEQ_SIZE		256
+#define SEQ_CHUNK		16
+
+/* The same as sound/firewire/amdtp-stream.c. */
+#define CIP_HEADER_QUADLETS	2
+#define CIP_EOH			(1u << 31)
+#define CIP_FMT_AM		0x10
+#define CIP_DBS_SHIFT		16
+#define CIP_DBS_MASK		0x00ff0000
+#define CIP_DBC_MASK		0x000000ff
+#define CIP_FMT_SHIFT		24
+#define CIP_FDF_SHIFT		16
+
+/* The same as amdtp_syt_intervals for 192.0 kHz, the maximum per packet. */
+#define MAX_DATA_BLOCKS		32
+
+#define BUFFER_FRAMES		4096
+#define PERIOD_FRAMES		256
+
+#define CHECK_SECONDS		1
+#define BENCH_SECONDS		60
+#define PROTOCOLS_SECONDS	10
+
+struct sim_stream {
+	struct amdtp_stream s;
+	struct snd_pcm_runtime runtime;
+	struct snd_pcm_substream pcm;
+	unsigned int period_tick;
+	unsigned int dbc;
+};
+
+struct sim_domain {
+	enum cip_sfc sfc;
+	unsigned int mode;
+	unsigned int channels;
+	unsigned int count;
+	struct sim_stream *its;
+	struct sim_stream *irs;
+	__be32 *payloads;
+	struct seq_desc descs[SEQ_SIZE];
+	unsigned int seq_tail;
+	unsigned int seq_phase;
+	unsigned long long packets;
+	unsigned long long data_blocks;
+	unsigned long long periods;
+	unsigned int discontinuities;
+};
+
+static int
+sim_stream_init(struct sim_stream *stream, unsigned int channels,
+		snd_pcm_format_t format)
+{
+	struct snd_pcm_runtime *runtime = &stream->runtime;
+	unsigned int bytes = amdtp_pcm_sample_bytes(format);
+
+	memset(stream, 0, sizeof(*stream));
+	stream->s.data_block_quadlets = channels;
+
+	runtime->access = SNDRV_PCM_ACCESS_MMAP_INTERLEAVED;
+	runtime->format = format;
+	runtime->channels = channels;
+	runtime->frame_bits = channels * bytes * 8;
+	runtime->buffer_size = BUFFER_FRAMES;
+	runtime->dma_bytes = frames_to_bytes(runtime, BUFFER_FRAMES);
+	runtime->dma_area = calloc(1, runtime->dma_bytes);
+	if (runtime->dma_area == NULL)
+		return -1;
+
+	stream->pcm.runtime = runtime;
+
+	return 0;
+}
+
+static void
+sim_stream_fill(struct sim_stream *stream)
+{
+	struct snd_pcm_runtime *runtime = &stream->runtime;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
+	unsigned int count = BUFFER_FRAMES * runtime->channels;
+	unsigned int i;
+
+	/* The sample aligned to MSB, without the bits lost in AM824. */
+	for (i = 0; i < count; i++)
+		amdtp_pcm_store_sample(runtime->dma_area + i * bytes,
+				       (i * 0x9e3779b1u) & 0xffffff00,
+				       runtime->format);
+}
+
+/* The same as update_pcm_pointers() in sound/firewire/amdtp-stream.c. */
+static void
+sim_stream_update_pointer(struct sim_domain *d, struct sim_stream *stream,
+			  unsigned int frames)
+{
+	stream->s.pcm_buffer_pointer += frames;
+	if (stream->s.pcm_buffer_pointer >= stream->runtime.buffer_size)
+		stream->s.pcm_buffer_pointer -= stream->runtime.buffer_size;
+
+	stream->period_tick += frames;
+	if (stream->period_tick >= PERIOD_FRAMES) {
+		stream->period_tick -= PERIOD_FRAMES;
+		d->periods++;
+	}
+}
+
+static void
+sim_stream_destroy(struct sim_stream *stream)
+{
+	free(stream->runtime.dma_area);
+}
+
+static void
+sim_domain_destroy(struct sim_domain *d)
+{
+	unsigned int i;
+
+	if (d->its != NULL) {
+		for (i = 0; i < d->count; i++)
+			sim_stream_destroy(d->its + i);
+	}
+	if (d->irs != NULL) {
+		for (i = 0; i < d->count; i++)
+			sim_stream_destroy(d->irs + i);
+	}
+	free(d->its);
+	free(d->irs);
+	free(d->payloads);
+}
+
+static int
+sim_domain_init(struct sim_domain *d, enum cip_sfc sfc, unsigned int mode,
+		unsigned int count, unsigned int channels,
+		snd_pcm_format_t format)
+{
+	unsigned int i;
+
+	memset(d, 0, sizeof(*d));
+	d->sfc = sfc;
+	d->mode = mode;
+	d->count = count;
+	d->channels = channels;
+
+	d->its = calloc(count, sizeof(*d->its));
+	d->irs = calloc(count, sizeof(*d->irs));
+	d->payloads = calloc(count, (CIP_HEADER_QUADLETS + MAX_DATA_BLOCKS * channels) *
+				    sizeof(*d->payloads));
+	if (d->its == NULL || d->irs == NULL || d->payloads == NULL)
+		goto error;
+
+	for (i = 0; i < count; i++) {
+		if (sim_stream_init(d->its + i, channels, format) < 0 ||
+		    sim_stream_init(d->irs + i, channels, format) < 0)
+			goto error;
+		sim_stream_fill(d->its + i);
+	}
+
+	return 0;
+error:
+	sim_domain_destroy(d);
+	return -1;
+}
+
+/* The IT side: the same as generate_pkt_descs() and build_it_pkt_header(). */
+static unsigned int
+sim_it_packet(struct sim_domain *d, struct sim_stream *stream,
+	      const struct seq_desc *desc, unsigned int cycle, __be32 *payload)
+{
+	unsigned int data_blocks = desc->data_blocks;
+	unsigned int syt = CIP_SYT_NO_INFO;
+
+	if (desc->syt_offset != CIP_SYT_NO_INFO)
+		syt = ((cycle & 0xf) << 12) | desc->syt_offset;
+
+	payload[0] = cpu_to_be32((stream->s.data_block_quadlets << CIP_DBS_SHIFT) |
+				 stream->dbc);
+	payload[1] = cpu_to_be32(CIP_EOH | (CIP_FMT_AM << CIP_FMT_SHIFT) |
+				 ((unsigned int)d->sfc << CIP_FDF_SHIFT) | syt);
+
+	if (data_blocks > 0)
+		amdtp_pcm_write(&stream->s, &stream->pcm,
+				payload + CIP_HEADER_QUADLETS, data_blocks, 0,
+				d->channels, 8, 0x40000000, false);
+
+	stream->dbc = (stream->dbc + data_blocks) & CIP_DBC_MASK;
+	sim_stream_update_pointer(d, stream, data_blocks);
+
+	return CIP_HEADER_QUADLETS + data_blocks * stream->s.data_block_quadlets;
+}
+
+/* The IR side: the same as check_cip_header() and the following process. */
+static void
+sim_ir_packet(struct sim_domain *d, struct sim_stream *stream,
+	      const __be32 *payload, unsigned int payload_quadlets)
+{
+	u32 cip_header[CIP_HEADER_QUADLETS];
+	unsigned int data_block_quadlets;
+	unsigned int data_blocks;
+	unsigned int dbc;
+
+	cip_header[0] = be32_to_cpu(payload[0]);
+	cip_header[1] = be32_to_cpu(payload[1]);
+
+	data_block_quadlets = (cip_header[0] & CIP_DBS_MASK) >> CIP_DBS_SHIFT;
+	data_blocks = (payload_quadlets - CIP_HEADER_QUADLETS) / data_block_quadlets;
+	dbc = cip_header[0] & CIP_DBC_MASK;
+
+	if (dbc != stream->dbc)
+		d->discontinuities++;
+	stream->dbc = (dbc + data_blocks) & CIP_DBC_MASK;
+
+	if (data_blocks > 0)
+		amdtp_pcm_read(&stream->s, &stream->pcm,
+			       payload + CIP_HEADER_QUADLETS, data_blocks, 0,
+			       d->channels, 8, 0xffffffff, false);
+
+	sim_stream_update_pointer(d, stream, data_blocks);
+}
+
+/*
+ * One callback of the simulated isochronous contexts, for the chunk of
+ * cycles. Each IT packet is received by the IR context of the same stream.
+ */
+static void
+sim_domain_process(struct sim_domain *d, unsigned int cycle)
+{
+	unsigned int head = d->seq_tail;
+	unsigned int i, j;
+
+	amdtp_ideal_seq_pool(d->descs, SEQ_SIZE, &d->seq_tail, &d->seq_phase,
+			     d->sfc, d->mode, SEQ_CHUNK);
+
+	for (i = 0; i < SEQ_CHUNK; i++) {
+		const struct seq_desc *desc = d->descs + (head + i) % SEQ_SIZE;
+
+		for (j = 0; j < d->count; j++) {
+			__be32 *payload = d->payloads +
+				j * (CIP_HEADER_QUADLETS + MAX_DATA_BLOCKS * d->channels);
+			unsigned int quadlets;
+
+			quadlets = sim_it_packet(d, d->its + j, desc, cycle + i,
+						 payload);
+			sim_ir_packet(d, d->irs + j, payload, quadlets);
+		}
+
+		d->packets += 2 * d->count;
+		d->data_blocks += 2 * d->count * desc->data_blocks;
+	}
+}
+
+static const char *
+format_name(snd_pcm_format_t format)
+{
+	if (format == SNDRV_PCM_FORMAT_S24_3LE)
+		return "S24_3LE";
+	else if (format == SNDRV_PCM_FORMAT_S24)
+		return "S24_LE";
+	else
+		return "S32_LE";
+}
+
+static const snd_pcm_format_t formats[] = {
+	SNDRV_PCM_FORMAT_S32,
+	SNDRV_PCM_FORMAT_S24,
+	SNDRV_PCM_FORMAT_S24_3LE,
+};
+
+static int
+check_domain(enum cip_sfc sfc, unsigned int mode, unsigned int channels,
+	     snd_pcm_format_t format)
+{
+	struct sim_domain d;
+	unsigned int cycle;
+	int err = 0;
+
+	if (sim_domain_init(&d, sfc, mode, 1, channels, format) < 0)
+		return -1;
+
+	for (cycle = 0; cycle < CYCLES_PER_SECOND * CHECK_SECONDS; cycle += SEQ_CHUNK)
+		sim_domain_process(&d, cycle);
+
+	/* The PCM frames go around the buffer, then each sample returns. */
+	if (d.discontinuities > 0 ||
+	    d.its[0].s.pcm_buffer_pointer != d.irs[0].s.pcm_buffer_pointer ||
+	    memcmp(d.its[0].runtime.dma_area, d.irs[0].runtime.dma_area,
+		   d.its[0].runtime.dma_bytes) != 0)
+		err = -1;
+
+	/* In non-blocking mode, the number of events per second is the rate. */
+	if (mode == CIP_NONBLOCKING &&
+	    d.data_blocks != 2ull * amdtp_rate_table[sfc] * CHECK_SECONDS)
+		err = -1;
+
+	sim_domain_destroy(&d);
+
+	return err;
+}
+
+/* The number of slots in the ring of packet buffer for the check of span. */
+#define SPAN_QUEUE_SIZE		48
+
+/*
+ * The IT side with the cache of silence, the same as
+ * amdtp_am824_process_it_ctx_payloads().
+ */
+static void
+sim_span_packets(struct sim_stream *stream, const struct pkt_desc *descs,
+		 unsigned int packets, struct snd_pcm_substream *pcm,
+		 unsigned int channels)
+{
+	struct amdtp_stream *s = &stream->s;
+	unsigned int pcm_frames = 0;
+	unsigned int i;
+
+	for (i = 0; i < packets; i++) {
+		const struct pkt_desc *desc = descs + i;
+
+		if (pcm) {
+			amdtp_pcm_write(s, pcm, desc->ctx_payload, desc->data_blocks,
+					pcm_frames, channels, 8, 0x40000000, false);
+			pcm_frames += desc->data_blocks;
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+		} else if (!amdtp_stream_pcm_silence_cached(s, desc, desc->data_blocks)) {
+			amdtp_pcm_write_silence(s, desc->ctx_payload, desc->data_blocks,
+						channels, 0x40000000, false);
+		}
+	}
+}
+
+/*
+ * The PCM substream starts in the middle of the packets in one callback, then
+ * stops at the end of it, like the span of PCM substream over several streams
+ * in process_ctx_payloads(). After the ring of packet buffer goes around
+ * several times, any slot should have silence again.
+ */
+static int
+check_span_start(unsigned int skip, unsigned int channels)
+{
+	unsigned int payload_quadlets = MAX_DATA_BLOCKS * channels;
+	struct pkt_desc descs[SEQ_CHUNK];
+	struct seq_desc seq[SEQ_SIZE];
+	unsigned int seq_tail = 0, seq_phase = 0;
+	struct sim_stream stream;
+	__be32 *payloads;
+	u16 *silence;
+	unsigned int callback, i;
+	int err = 0;
+
+	if (sim_stream_init(&stream, channels, SNDRV_PCM_FORMAT_S32) < 0)
+		return -1;
+	sim_stream_fill(&stream);
+
+	payloads = calloc(SPAN_QUEUE_SIZE * payload_quadlets, sizeof(*payloads));
+	silence = calloc(SPAN_QUEUE_SIZE, sizeof(*silence));
+	if (payloads == NULL || silence == NULL) {
+		err = -1;
+		goto end;
+	}
+
+	stream.s.queue_size = SPAN_QUEUE_SIZE;
+	stream.s.packet_index = 0;
+	stream.s.pkt_descs = descs;
+	stream.s.ctx_data.rx.pcm_silence = silence;
+
+	/* The PCM substream runs in the fourth callback, then the ring goes around 4 times. */
+	for (callback = 0; callback < 3 + 1 + 4 * SPAN_QUEUE_SIZE / SEQ_CHUNK; callback++) {
+		unsigned int head = seq_tail;
+
+		amdtp_ideal_seq_pool(seq, SEQ_SIZE, &seq_tail, &seq_phase, CIP_SFC_48000,
+				     CIP_NONBLOCKING, SEQ_CHUNK);
+
+		for (i = 0; i < SEQ_CHUNK; i++) {
+			unsigned int slot = (stream.s.packet_index + i) % SPAN_QUEUE_SIZE;
+
+			descs[i].data_blocks = seq[(head + i) % SEQ_SIZE].data_blocks;
+			descs[i].ctx_payload = payloads + slot * payload_quadlets;
+		}
+
+		if (callback == 3) {
+			sim_span_packets(&stream, descs, skip, NULL, channels);
+			sim_span_packets(&stream, descs + skip, SEQ_CHUNK - skip, &stream.pcm,
+					 channels);
+		} else {
+			sim_span_packets(&stream, descs, SEQ_CHUNK, NULL, channels);
+		}
+
+		stream.s.packet_index = (stream.s.packet_index + SEQ_CHUNK) % SPAN_QUEUE_SIZE;
+	}
+
+	for (i = 0; i < SPAN_QUEUE_SIZE * payload_quadlets; i++) {
+		if (payloads[i] != 0 && payloads[i] != cpu_to_be32(0x40000000))
+			err = -1;
+	}
+end:
+	free(silence);
+	free(payloads);
+	sim_stream_destroy(&stream);
+
+	return err;
+}
+
+static int
+check_span(void)
+{
+	unsigned int skip;
+	int failures = 0;
+
+	for (skip = 0; skip < SEQ_CHUNK; skip++) {
+		int err = check_span_start(skip, 8);
+
+		printf("span start at packet %2u of %u %s\n", skip, SEQ_CHUNK,
+		       err < 0 ? "FAIL" : "ok");
+		if (err < 0)
+			failures++;
+	}
+
+	return failures;
+}
+
+static int
+check(void)
+{
+	static const unsigned int channels[] = { 1, 2, 8, 18 };
+	unsigned int sfc, mode, f, c;
+	int failures = 0;
+
+	for (sfc = 0; sfc < CIP_SFC_COUNT; sfc++) {
+		for (mode = CIP_NONBLOCKING; mode <= CIP_BLOCKING; mode++) {
+			for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+				int err = 0;
+
+				for (c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+					if (check_domain(sfc, mode, channels[c], formats[f]) < 0)
+						err = -1;
+				}
+
+				printf("%6u %-12s %-7s %s\n", amdtp_rate_table[sfc],
+				       mode == CIP_BLOCKING ? "blocking" : "non-blocking",
+				       format_name(formats[f]), err < 0 ? "FAIL" : "ok");
+				if (err < 0)
+					failures++;
+			}
+		}
+	}
+
+	return failures + check_span();
+}
+
+static double
+elapsed_seconds(const struct timespec *begin, const struct timespec *end)
+{
+	return (end->tv_sec - begin->tv_sec) +
+	       (end->tv_nsec - begin->tv_nsec) / 1000000000.0;
+}
+
+static int
+bench(unsigned int count, unsigned int channels, unsigned int seconds)
+{
+	unsigned int cycles = CYCLES_PER_SECOND * seconds;
+	unsigned int sfc, f;
+
+	printf("%u stream(s) for each direction, %u channels, %u seconds\n",
+	       count, channels, seconds);
+
+	for (sfc = 0; sfc < CIP_SFC_COUNT; sfc++) {
+		for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+			struct timespec begin, end;
+			struct sim_domain d;
+			unsigned int cycle;
+			double elapsed;
+
+			if (sim_domain_init(&d, sfc, CIP_NONBLOCKING, count, channels,
+					    formats[f]) < 0)
+				return -1;
+
+			clock_gettime(CLOCK_MONOTONIC, &begin);
+			for (cycle = 0; cycle < cycles; cycle += SEQ_CHUNK)
+				sim_domain_process(&d, cycle);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			elapsed = elapsed_seconds(&begin, &end);
+			printf("%6u %-7s %12.0f packets/sec %8.3f ns/packet %8.3f ns/data-block %8.1fx realtime (%llu)\n",
+			       amdtp_rate_table[sfc], format_name(formats[f]),
+			       d.packets / elapsed, elapsed * 1000000000.0 / d.packets,
+			       elapsed * 1000000000.0 / d.data_blocks,
+			       seconds / elapsed, d.periods);
+
+			sim_domain_destroy(&d);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The packet paths of protocols. The parameters of the kernels are the same
+ * as the ones of the protocol in each driver, thus keep them in sync.
+ */
+enum sim_proto {
+	SIM_PROTO_AM824 = 0,
+	SIM_PROTO_FF,
+	SIM_PROTO_TASCAM,
+	SIM_PROTO_DOT,
+	SIM_PROTO_MOTU,
+	SIM_PROTO_COUNT,
+};
+
+/* The same as MOTU protocol v2 and v3 in sound/firewire/motu/amdtp-motu.c. */
+#define MOTU_MSG_CHUNKS		2
+#define MOTU_PCM_BYTE_OFFSET	10
+
+static const struct {
+	const char *name;
+	/* The representative numbers of PCM channels in supported models. */
+	unsigned int channels[3];
+} sim_protos[SIM_PROTO_COUNT] = {
+	[SIM_PROTO_AM824]	= { "am824",	{  2,  8, 18 } },
+	[SIM_PROTO_FF]		= { "ff",	{ 10, 18, 28 } },
+	[SIM_PROTO_TASCAM]	= { "tascam",	{  8, 10, 18 } },
+	[SIM_PROTO_DOT]		= { "dot",	{  8, 14, 18 } },
+	[SIM_PROTO_MOTU]	= { "motu",	{ 10, 16, 24 } },
+};
+
+/* The same as the set_parameters() of each protocol. */
+static unsigned int
+sim_proto_data_block_quadlets(enum sim_proto proto, bool is_ir,
+			      unsigned int channels)
+{
+	switch (proto) {
+	case SIM_PROTO_TASCAM:
+		/* The first data channel is for event counter in IR packet. */
+		return is_ir ? channels + 2 : channels;
+	case SIM_PROTO_DOT:
+		/* The first data channel is for MIDI. */
+		return channels + 1;
+	case SIM_PROTO_MOTU:
+		/* The first quadlet is for source packet header. */
+		return 1 + DIV_ROUND_UP((MOTU_MSG_CHUNKS + channels) * 3, 4);
+	default:
+		return channels;
+	}
+}
+
+/* The same as write_pcm_s32() in sound/firewire/digi00x/amdtp-dot.c. */
+static void
+sim_dot_write(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+	      struct dot_state *dot, __be32 *buffer, unsigned int frames,
+	      unsigned int pcm_frames, unsigned int channels)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
+	struct dot_state state = *dot;
+	int remaining_frames;
+	const void *src;
+	unsigned int i, c;
+
+	buffer++;
+
+	src = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
+
+	for (i = 0; i < frames; ++i) {
+		for (c = 0; c < channels; ++c) {
+			u32 sample = amdtp_pcm_load_sample(src, runtime->format);
+
+			buffer[c] = cpu_to_be32((sample >> 8) | 0x40000000);
+			dot_encode_step(&state, &buffer[c]);
+			src += bytes;
+		}
+		buffer += s->data_block_quadlets;
+		if (--remaining_frames == 0)
+			src = (void *)runtime->dma_area;
+	}
+
+	*dot = state;
+}
+
+/* The same as the process_it_ctx_payloads() of each protocol. */
+static void
+sim_proto_it(enum sim_proto proto, struct sim_stream *stream,
+	     struct dot_state *dot, __be32 *buffer, unsigned int data_blocks,
+	     unsigned int pcm_frames, unsigned int channels)
+{
+	struct amdtp_stream *s = &stream->s;
+	struct snd_pcm_substream *pcm = &stream->pcm;
+
+	switch (proto) {
+	case SIM_PROTO_AM824:
+		amdtp_pcm_write(s, pcm, buffer, data_blocks, pcm_frames, channels,
+				8, 0x40000000, false);
+		break;
+	case SIM_PROTO_FF:
+		amdtp_pcm_write(s, pcm, buffer, data_blocks, pcm_frames, channels,
+				0, 0x00000000, true);
+		break;
+	case SIM_PROTO_TASCAM:
+		amdtp_pcm_write(s, pcm, buffer, data_blocks, pcm_frames, channels,
+				0, 0x00000000, false);
+		break;
+	case SIM_PROTO_DOT:
+		sim_dot_write(s, pcm, dot, buffer, data_blocks, pcm_frames, channels);
+		break;
+	case SIM_PROTO_MOTU:
+		amdtp_pcm_write_packed24(s, pcm, (u8 *)buffer + MOTU_PCM_BYTE_OFFSET,
+					 data_blocks, pcm_frames, channels);
+		break;
+	default:
+		break;
+	}
+}
+
+/* The same as the process_ir_ctx_payloads() of each protocol. */
+static void
+sim_proto_ir(enum sim_proto proto, struct sim_stream *stream,
+	     const __be32 *buffer, unsigned int data_blocks,
+	     unsigned int pcm_frames, unsigned int channels)
+{
+	struct amdtp_stream *s = &stream->s;
+	struct snd_pcm_substream *pcm = &stream->pcm;
+
+	switch (proto) {
+	case SIM_PROTO_AM824:
+		amdtp_pcm_read(s, pcm, buffer, data_blocks, pcm_frames, channels,
+			       8, 0xffffffff, false);
+		break;
+	case SIM_PROTO_FF:
+		amdtp_pcm_read(s, pcm, buffer, data_blocks, pcm_frames, channels,
+			       0, 0xffffff00, true);
+		break;
+	case SIM_PROTO_TASCAM:
+		amdtp_pcm_read(s, pcm, buffer + 1, data_blocks, pcm_frames, channels,
+			       0, 0xffffffff, false);
+		break;
+	case SIM_PROTO_DOT:
+		amdtp_pcm_read(s, pcm, buffer + 1, data_blocks, pcm_frames, channels,
+			       8, 0xffffffff, false);
+		break;
+	case SIM_PROTO_MOTU:
+		amdtp_pcm_read_packed24(s, pcm, (const u8 *)buffer + MOTU_PCM_BYTE_OFFSET,
+					data_blocks, pcm_frames, channels);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Per callback, the payloads of the chunk of packets are processed with the
+ * offset of PCM frames from the buffer pointer, then the pointer is moved
+ * forward, like process_ctx_payloads() in sound/firewire/amdtp-stream.c.
+ */
+static double
+sim_proto_run(enum sim_proto proto, struct sim_stream *stream, bool is_ir,
+	      enum cip_sfc sfc, unsigned int channels, __be32 *payloads,
+	      unsigned int cycles, unsigned long long *data_blocks)
+{
+	unsigned int payload_quadlets = MAX_DATA_BLOCKS * stream->s.data_block_quadlets;
+	struct seq_desc descs[SEQ_SIZE];
+	unsigned int seq_tail = 0, seq_phase = 0;
+	struct dot_state dot = { 0 };
+	struct timespec begin, end;
+	unsigned int cycle, i;
+
+	*data_blocks = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (cycle = 0; cycle < cycles; cycle += SEQ_CHUNK) {
+		unsigned int head = seq_tail;
+		unsigned int pcm_frames = 0;
+
+		amdtp_ideal_seq_pool(descs, SEQ_SIZE, &seq_tail, &seq_phase, sfc,
+				     CIP_NONBLOCKING, SEQ_CHUNK);
+
+		for (i = 0; i < SEQ_CHUNK; i++) {
+			const struct seq_desc *desc = descs + (head + i) % SEQ_SIZE;
+			__be32 *buffer = payloads + i * payload_quadlets;
+
+			if (is_ir)
+				sim_proto_ir(proto, stream, buffer, desc->data_blocks,
+					     pcm_frames, channels);
+			else
+				sim_proto_it(proto, stream, &dot, buffer,
+					     desc->data_blocks, pcm_frames, channels);
+			pcm_frames += desc->data_blocks;
+		}
+
+		stream->s.pcm_buffer_pointer += pcm_frames;
+		stream->s.pcm_buffer_pointer %= stream->runtime.buffer_size;
+		*data_blocks += pcm_frames;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed_seconds(&begin, &end);
+}
+
+static int
+bench_proto(enum sim_proto proto, enum cip_sfc sfc, unsigned int channels,
+	    unsigned int seconds)
+{
+	unsigned int cycles = CYCLES_PER_SECOND * seconds;
+	unsigned long long it_blocks, ir_blocks;
+	struct sim_stream it, ir;
+	double it_elapsed, ir_elapsed;
+	__be32 *payloads;
+	unsigned int i, count;
+	int err = -1;
+
+	if (sim_stream_init(&it, channels, SNDRV_PCM_FORMAT_S32) < 0)
+		return -1;
+	if (sim_stream_init(&ir, channels, SNDRV_PCM_FORMAT_S32) < 0)
+		goto end_it;
+	sim_stream_fill(&it);
+	it.s.data_block_quadlets = sim_proto_data_block_quadlets(proto, false, channels);
+	ir.s.data_block_quadlets = sim_proto_data_block_quadlets(proto, true, channels);
+
+	count = SEQ_CHUNK * MAX_DATA_BLOCKS * ir.s.data_block_quadlets;
+	if (count < SEQ_CHUNK * MAX_DATA_BLOCKS * it.s.data_block_quadlets)
+		count = SEQ_CHUNK * MAX_DATA_BLOCKS * it.s.data_block_quadlets;
+	payloads = malloc(count * sizeof(*payloads));
+	if (payloads == NULL)
+		goto end_ir;
+
+	/* The arbitrary samples in the payload of IR packets. */
+	for (i = 0; i < count; i++)
+		payloads[i] = cpu_to_be32(i * 0x9e3779b1u);
+
+	ir_elapsed = sim_proto_run(proto, &ir, true, sfc, channels, payloads,
+				   cycles, &ir_blocks);
+	it_elapsed = sim_proto_run(proto, &it, false, sfc, channels, payloads,
+				   cycles, &it_blocks);
+
+	printf("%-6s %6u %2u ch %8.3f ns/data-block (IT) %8.3f ns/data-block (IR)\n",
+	       sim_protos[proto].name, amdtp_rate_table[sfc], channels,
+	       it_elapsed * 1000000000.0 / it_blocks,
+	       ir_elapsed * 1000000000.0 / ir_blocks);
+
+	free(payloads);
+	err = 0;
+end_ir:
+	sim_stream_destroy(&ir);
+end_it:
+	sim_stream_destroy(&it);
+
+	return err;
+}
+
+static int
+bench_protocols(unsigned int seconds)
+{
+	unsigned int proto, sfc, c;
+
+	printf("S32_LE, non-blocking, %u seconds\n", seconds);
+
+	for (proto = 0; proto < SIM_PROTO_COUNT; proto++) {
+		for (sfc = 0; sfc < CIP_SFC_COUNT; sfc++) {
+			for (c = 0; c < 3; c++) {
+				if (bench_proto(proto, sfc, sim_protos[proto].channels[c],
+						seconds) < 0)
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void
+print_usage(void)
+{
+	printf("./pcmbench check\n");
+	printf("    compare the PCM frames after the round trip of packets, and check\n");
+	printf("    the cache of silence when PCM substream starts in the middle\n");
+	printf("./pcmbench bench [STREAMS [CHANNELS [SECONDS]]]\n");
+	printf("    benchmark the packet pass for the number of streams\n");
+	printf("./pcmbench protocols [SECONDS]\n");
+	printf("    benchmark the packet path of each protocol for each rate\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long count = 1, channels = 2, seconds = BENCH_SECONDS;
+
+	if (argc < 2) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	amdtp_stream_build_ideal_seqs();
+	amdtp_dot_build_scrt_table();
+	if (shim_warnings > 0)
+		return EXIT_FAILURE;
+
+	if (strcmp(argv[1], "check") == 0)
+		return check() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	if (strcmp(argv[1], "protocols") == 0) {
+		if (argc > 2)
+			seconds = strtoul(argv[2], NULL, 10);
+		else
+			seconds = PROTOCOLS_SECONDS;
+		if (seconds == 0) {
+			print_usage();
+			return EXIT_FAILURE;
+		}
+		return bench_protocols(seconds) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (strcmp(argv[1], "bench") != 0) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 2)
+		count = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		channels = strtoul(argv[3], NULL, 10);
+	if (argc > 4)
+		seconds = strtoul(argv[4], NULL, 10);
+	if (count == 0 || channels == 0 || seconds == 0) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	return bench(count, channels, seconds) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -6,9 +6,15 @@
  * Copyright (c) 2015 Takashi Sakamoto <o-takashi@sakamocchi.jp>
  */
 
+#include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
+#if IS_ENABLED(CONFIG_SND_UMP)
+#include <sound/ump_convert.h>
+#endif
 
 #include "amdtp-am824.h"
+#include "amdtp-pcm.h"
 
 #define CIP_FMT_AM		0x10
 
@@ -27,6 +33,26 @@
  */
 #define MAX_MIDI_RX_BLOCKS	8
 
+/* The number of bytes in MIDI conformant data channel with label 0x81-0x83. */
+#define MAX_MIDI_BYTES_PER_BLOCK	3
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+/* The number of UMP words delivered to the endpoint at once. */
+#define AMDTP_UMP_BATCH_WORDS	64
+
+struct amdtp_am824_ump_fifo {
+	u8 bytes[AMDTP_MIDI_BATCH_BYTES * 2];
+	unsigned int len;
+};
+#else
+struct snd_ump_endpoint;
+#endif
+
+static bool fast_midi;
+module_param(fast_midi, bool, 0644);
+MODULE_PARM_DESC(fast_midi,
+		 "Transfer MIDI bytes faster than the rate of MIDI DIN port for the stream initialized later (default: false)");
+
 struct amdtp_am824 {
 	struct snd_rawmidi_substream *midi[AM824_MAX_CHANNELS_FOR_MIDI * 8];
 	int midi_fifo_limit;
@@ -36,8 +62,50 @@ struct amdtp_am824 {
 
 	u8 pcm_positions[AM824_MAX_CHANNELS_FOR_PCM];
 	u8 midi_position;
+	// The position map for PCM channels is identical, thus samples are contiguous.
+	bool pcm_contiguous;
+	// The index of the first channel for the stream in PCM frame, when the PCM substream spans
+	// several streams.
+	unsigned int pcm_channel_offset;
 
 	unsigned int frame_multiplier;
+
+	// The device tolerates several bytes in data block without the ratelimit.
+	bool fast_midi;
+
+	// The bytes for each port in the packets processed in one callback.
+	struct amdtp_midi_batch midi_batch[8];
+
+	// For optional metering of PCM samples. The peaks are accumulated in the pass of packets
+	// till the expiration, extended by each read of meter. The holds are updated by the read.
+	struct {
+		bool enabled;
+		unsigned long expires;
+		u32 peaks[AM824_MAX_CHANNELS_FOR_PCM];
+		u32 holds[AM824_MAX_CHANNELS_FOR_PCM];
+	} meter;
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+	// The UMP endpoint carrying the ports as groups.
+	struct snd_ump_endpoint *ump;
+	union {
+		// The messages converted from the bytes in the packets processed in one callback.
+		struct {
+			struct ump_cvt_to_ump cvts[8];
+			u32 words[AMDTP_UMP_BATCH_WORDS];
+			unsigned int count;
+		} ump_in;
+		// The bytes converted from the messages, queued for each port.
+		struct {
+			u32 words[4];
+			unsigned int filled;
+			u8 pending[12];
+			unsigned int pending_len;
+			unsigned char pending_group;
+			struct amdtp_am824_ump_fifo fifos[8];
+		} ump_out;
+	};
+#endif
 };
 
 /**
@@ -102,6 +170,11 @@ int amdtp_am824_set_parameters(struct amdtp_stream *s, unsigned int rate,
 	for (i = 0; i < pcm_channels; i++)
 		p->pcm_positions[i] = i;
 	p->midi_position = p->pcm_channels;
+	p->pcm_contiguous = true;
+	p->pcm_channel_offset = 0;
+
+	memset(p->meter.peaks, 0, sizeof(p->meter.peaks));
+	memset(p->meter.holds, 0, sizeof(p->meter.holds));
 
 	/*
 	 * We do not know the actual MIDI FIFO size of most devices.  Just
@@ -126,12 +199,39 @@ void amdtp_am824_set_pcm_position(struct amdtp_stream *s, unsigned int index,
 				 unsigned int position)
 {
 	struct amdtp_am824 *p = s->protocol;
+	unsigned int i;
 
 	if (index < p->pcm_channels)
 		p->pcm_positions[index] = position;
+
+	p->pcm_contiguous = true;
+	for (i = 0; i < p->pcm_channels; ++i) {
+		if (p->pcm_positions[i] != i) {
+			p->pcm_contiguous = false;
+			break;
+		}
+	}
 }
 EXPORT_SYMBOL_GPL(amdtp_am824_set_pcm_position);
 
+/**
+ * amdtp_am824_set_pcm_channel_offset - set the index of channel in PCM frame for the first PCM
+ *					channel of the stream
+ * @s: the AMDTP stream
+ * @offset: the index of channel in PCM frame
+ *
+ * When the PCM substream spans several streams, each stream transfers the samples of channels
+ * from the offset in each PCM frame. The PCM channels are expected to be contiguous in the data
+ * block. It must not be changed while the stream is running.
+ */
+void amdtp_am824_set_pcm_channel_offset(struct amdtp_stream *s, unsigned int offset)
+{
+	struct amdtp_am824 *p = s->protocol;
+
+	p->pcm_channel_offset = offset;
+}
+EXPORT_SYMBOL_GPL(amdtp_am824_set_pcm_channel_offset);
+
 /**
  * amdtp_am824_set_midi_position - set a index of data channel for MIDI
  *				   conformant data channel
@@ -147,6 +247,205 @@ void amdtp_am824_set_midi_position(struct amdtp_stream *s,
 }
 EXPORT_SYMBOL_GPL(amdtp_am824_set_midi_position);
 
+/**
+ * amdtp_am824_set_fast_midi - enable or disable the fast mode of MIDI transmission
+ * @s: the AMDTP stream
+ * @enable: whether to transfer MIDI bytes faster than the rate of MIDI DIN port
+ *
+ * In the fast mode, up to three bytes are transferred in the MIDI conformant data channel of
+ * each data block, without the ratelimit for MIDI DIN port. It is available just for the
+ * device of which firmware tolerates it. It must not be changed while the stream is running.
+ */
+void amdtp_am824_set_fast_midi(struct amdtp_stream *s, bool enable)
+{
+	struct amdtp_am824 *p = s->protocol;
+
+	p->fast_midi = enable;
+}
+EXPORT_SYMBOL_GPL(amdtp_am824_set_fast_midi);
+
+// For non-interleaved access. One data block can transfer several PCM frames, thus the index of
+// sample in the data block is mapped to the channel and the frame.
+static void write_pcm_s32_planar(struct amdtp_stream *s, struct snd_pcm_runtime *runtime,
+				 __be32 *buffer, unsigned int frames,
+				 unsigned int pcm_frames)
+{
+	struct amdtp_am824 *p = s->protocol;
+	unsigned int channels = p->pcm_channels / p->frame_multiplier;
+	unsigned int offset = p->pcm_channel_offset;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
+	unsigned int frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+	int i, j, c;
+
+	for (i = 0; i < frames; ++i) {
+		for (j = 0; j < p->frame_multiplier; ++j) {
+			const u8 *positions = p->pcm_positions + j * channels;
+
+			for (c = 0; c < channels; ++c) {
+				const void *src = amdtp_pcm_planar_sample(runtime, offset + c, frame,
+									  bytes);
+				u32 sample = amdtp_pcm_load_sample(src, runtime->format);
+
+				buffer[positions[c]] = cpu_to_be32((sample >> 8) | 0x40000000);
+			}
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+static void read_pcm_s32_planar(struct amdtp_stream *s, struct snd_pcm_runtime *runtime,
+				__be32 *buffer, unsigned int frames,
+				unsigned int pcm_frames)
+{
+	struct amdtp_am824 *p = s->protocol;
+	unsigned int channels = p->pcm_channels / p->frame_multiplier;
+	unsigned int offset = p->pcm_channel_offset;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
+	unsigned int frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+	int i, j, c;
+
+	for (i = 0; i < frames; ++i) {
+		for (j = 0; j < p->frame_multiplier; ++j) {
+			const u8 *positions = p->pcm_positions + j * channels;
+
+			for (c = 0; c < channels; ++c) {
+				void *dst = amdtp_pcm_planar_sample(runtime, offset + c, frame,
+								    bytes);
+
+				amdtp_pcm_store_sample(dst, be32_to_cpu(buffer[positions[c]]) << 8,
+						       runtime->format);
+			}
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+// For interleaved access when the PCM substream spans several streams. The samples for the stream
+// are at the offset in each PCM frame, and the stride is the size of PCM frame.
+static __always_inline void __write_pcm_s32_spanned(struct amdtp_stream *s,
+						    struct snd_pcm_runtime *runtime,
+						    __be32 *buffer, unsigned int frames,
+						    unsigned int pcm_frames,
+						    snd_pcm_format_t format)
+{
+	struct amdtp_am824 *p = s->protocol;
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	unsigned int channels = p->pcm_channels / p->frame_multiplier;
+	unsigned int frame_bytes = runtime->channels * bytes;
+	void *origin = (void *)runtime->dma_area + p->pcm_channel_offset * bytes;
+	int remaining_frames;
+	const void *src;
+	int i, j, c;
+
+	src = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames) +
+	      p->pcm_channel_offset * bytes;
+
+	for (i = 0; i < frames; ++i) {
+		for (j = 0; j < p->frame_multiplier; ++j) {
+			const u8 *positions = p->pcm_positions + j * channels;
+
+			if (p->pcm_contiguous) {
+				amdtp_pcm_encode_frame((u32 *)buffer + j * channels, src, channels,
+						       8, 0x40000000, false, format);
+			} else {
+				for (c = 0; c < channels; ++c) {
+					u32 sample = amdtp_pcm_load_sample(src + c * bytes, format);
+
+					buffer[positions[c]] = cpu_to_be32((sample >> 8) | 0x40000000);
+				}
+			}
+			src += frame_bytes;
+			if (--remaining_frames == 0)
+				src = origin;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+static void write_pcm_s32_spanned(struct amdtp_stream *s, struct snd_pcm_runtime *runtime,
+				  __be32 *buffer, unsigned int frames,
+				  unsigned int pcm_frames)
+{
+	switch (runtime->format) {
+	case SNDRV_PCM_FORMAT_S24_3LE:
+		__write_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames,
+					SNDRV_PCM_FORMAT_S24_3LE);
+		break;
+	case SNDRV_PCM_FORMAT_S24:
+		__write_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames,
+					SNDRV_PCM_FORMAT_S24);
+		break;
+	default:
+		__write_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames,
+					SNDRV_PCM_FORMAT_S32);
+		break;
+	}
+}
+
+static __always_inline void __read_pcm_s32_spanned(struct amdtp_stream *s,
+						   struct snd_pcm_runtime *runtime,
+						   __be32 *buffer, unsigned int frames,
+						   unsigned int pcm_frames,
+						   snd_pcm_format_t format)
+{
+	struct amdtp_am824 *p = s->protocol;
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	unsigned int channels = p->pcm_channels / p->frame_multiplier;
+	unsigned int frame_bytes = runtime->channels * bytes;
+	void *origin = (void *)runtime->dma_area + p->pcm_channel_offset * bytes;
+	int remaining_frames;
+	void *dst;
+	int i, j, c;
+
+	dst = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames) +
+	      p->pcm_channel_offset * bytes;
+
+	for (i = 0; i < frames; ++i) {
+		for (j = 0; j < p->frame_multiplier; ++j) {
+			const u8 *positions = p->pcm_positions + j * channels;
+
+			if (p->pcm_contiguous) {
+				amdtp_pcm_decode_frame(dst, (u32 *)buffer + j * channels, channels,
+						       8, 0xffffffff, false, format);
+			} else {
+				for (c = 0; c < channels; ++c) {
+					u32 sample = be32_to_cpu(buffer[positions[c]]) << 8;
+
+					amdtp_pcm_store_sample(dst + c * bytes, sample, format);
+				}
+			}
+			dst += frame_bytes;
+			if (--remaining_frames == 0)
+				dst = origin;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+static void read_pcm_s32_spanned(struct amdtp_stream *s, struct snd_pcm_runtime *runtime,
+				 __be32 *buffer, unsigned int frames,
+				 unsigned int pcm_frames)
+{
+	switch (runtime->format) {
+	case SNDRV_PCM_FORMAT_S24_3LE:
+		__read_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames,
+				       SNDRV_PCM_FORMAT_S24_3LE);
+		break;
+	case SNDRV_PCM_FORMAT_S24:
+		__read_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames,
+				       SNDRV_PCM_FORMAT_S24);
+		break;
+	default:
+		__read_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames,
+				       SNDRV_PCM_FORMAT_S32);
+		break;
+	}
+}
+
 static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			  __be32 *buffer, unsigned int frames,
 			  unsigned int pcm_frames)
@@ -154,23 +453,35 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 	struct amdtp_am824 *p = s->protocol;
 	unsigned int channels = p->pcm_channels;
 	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
 	int remaining_frames;
-	const u32 *src;
+	const void *src;
 	int i, c;
 
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
+	if (amdtp_pcm_is_planar(runtime)) {
+		write_pcm_s32_planar(s, runtime, buffer, frames, pcm_frames);
+		return;
+	}
+
+	if (runtime->channels * p->frame_multiplier != channels) {
+		write_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames);
+		return;
+	}
+
+	if (p->pcm_contiguous) {
+		amdtp_pcm_write(s, pcm, buffer, frames, pcm_frames, channels,
+				8, 0x40000000, false);
+		return;
+	}
 
-	src = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
+	src = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
 
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c) {
-			buffer[p->pcm_positions[c]] =
-					cpu_to_be32((*src >> 8) | 0x40000000);
-			src++;
+			u32 sample = amdtp_pcm_load_sample(src, runtime->format);
+
+			buffer[p->pcm_positions[c]] = cpu_to_be32((sample >> 8) | 0x40000000);
+			src += bytes;
 		}
 		buffer += s->data_block_quadlets;
 		if (--remaining_frames == 0)
@@ -185,22 +496,34 @@ static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 	struct amdtp_am824 *p = s->protocol;
 	unsigned int channels = p->pcm_channels;
 	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
 	int remaining_frames;
-	u32 *dst;
+	void *dst;
 	int i, c;
 
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
+	if (amdtp_pcm_is_planar(runtime)) {
+		read_pcm_s32_planar(s, runtime, buffer, frames, pcm_frames);
+		return;
+	}
+
+	if (runtime->channels * p->frame_multiplier != channels) {
+		read_pcm_s32_spanned(s, runtime, buffer, frames, pcm_frames);
+		return;
+	}
+
+	if (p->pcm_contiguous) {
+		amdtp_pcm_read(s, pcm, buffer, frames, pcm_frames, channels,
+			       8, 0xffffffff, false);
+		return;
+	}
 
-	dst  = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
+	dst = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
 
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c) {
-			*dst = be32_to_cpu(buffer[p->pcm_positions[c]]) << 8;
-			dst++;
+			amdtp_pcm_store_sample(dst, be32_to_cpu(buffer[p->pcm_positions[c]]) << 8,
+					       runtime->format);
+			dst += bytes;
 		}
 		buffer += s->data_block_quadlets;
 		if (--remaining_frames == 0)
@@ -214,6 +537,11 @@ static void write_pcm_silence(struct amdtp_stream *s,
 	struct amdtp_am824 *p = s->protocol;
 	unsigned int i, c, channels = p->pcm_channels;
 
+	if (p->pcm_contiguous) {
+		amdtp_pcm_write_silence(s, buffer, frames, channels, 0x40000000, false);
+		return;
+	}
+
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c)
 			buffer[p->pcm_positions[c]] = cpu_to_be32(0x40000000);
@@ -221,6 +549,143 @@ static void write_pcm_silence(struct amdtp_stream *s,
 	}
 }
 
+// The payload of packet is still in cache just after encoding or decoding PCM samples.
+static void accumulate_pcm_peaks(struct amdtp_stream *s, const __be32 *buffer,
+				 unsigned int data_blocks)
+{
+	struct amdtp_am824 *p = s->protocol;
+	unsigned int channels = p->pcm_channels;
+	unsigned int i, c;
+
+	for (c = 0; c < channels; ++c) {
+		const __be32 *pos = buffer + p->pcm_positions[c];
+		u32 peak = p->meter.peaks[c];
+
+		for (i = 0; i < data_blocks; ++i) {
+			u32 sample = abs(sign_extend32(be32_to_cpu(*pos), 23));
+
+			if (sample > peak)
+				peak = sample;
+			pos += s->data_block_quadlets;
+		}
+
+		WRITE_ONCE(p->meter.peaks[c], peak);
+	}
+}
+
+// The payload of incoming packets has consumer except for PCM substream when any MIDI port or UMP
+// endpoint is attached, or when the metering is enabled.
+static void update_idle_payloads(struct amdtp_stream *s)
+{
+	struct amdtp_am824 *p = s->protocol;
+	bool idle = !READ_ONCE(p->meter.enabled);
+	unsigned int i;
+
+	for (i = 0; i < p->midi_ports; ++i) {
+		if (p->midi[i])
+			idle = false;
+	}
+#if IS_ENABLED(CONFIG_SND_UMP)
+	if (p->ump)
+		idle = false;
+#endif
+
+	amdtp_stream_set_idle_payloads(s, idle);
+}
+
+static bool is_meter_enabled(struct amdtp_stream *s)
+{
+	struct amdtp_am824 *p = s->protocol;
+
+	if (likely(!READ_ONCE(p->meter.enabled)))
+		return false;
+
+	if (time_after(jiffies, READ_ONCE(p->meter.expires))) {
+		WRITE_ONCE(p->meter.enabled, false);
+		if (s->direction == AMDTP_IN_STREAM)
+			update_idle_payloads(s);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * amdtp_am824_get_pcm_meter - get the peaks of PCM samples for one of streams
+ * @tx_streams: the array of AMDTP streams for incoming packets
+ * @tx_count: the number of streams in the array for incoming packets
+ * @rx_streams: the array of AMDTP streams for outgoing packets
+ * @rx_count: the number of streams in the array for outgoing packets
+ * @arg: the pointer to struct snd_firewire_pcm_meter in userspace
+ *
+ * This function is for SNDRV_FIREWIRE_IOCTL_GET_PCM_METER of hwdep devices. The metering is
+ * enabled for one second since the call. Returns zero on success, or a negative error code.
+ */
+int amdtp_am824_get_pcm_meter(struct amdtp_stream *tx_streams, unsigned int tx_count,
+			      struct amdtp_stream *rx_streams, unsigned int rx_count,
+			      void __user *arg)
+{
+	struct snd_firewire_pcm_meter *meter;
+	struct amdtp_stream *s;
+	struct amdtp_am824 *p;
+	unsigned int c;
+	int err = 0;
+
+	meter = memdup_user(arg, sizeof(*meter));
+	if (IS_ERR(meter))
+		return PTR_ERR(meter);
+
+	if (meter->direction == SNDRV_FIREWIRE_PCM_METER_IN && meter->index < tx_count) {
+		s = tx_streams + meter->index;
+	} else if (meter->direction == SNDRV_FIREWIRE_PCM_METER_OUT && meter->index < rx_count) {
+		s = rx_streams + meter->index;
+	} else {
+		err = -EINVAL;
+		goto end;
+	}
+	p = s->protocol;
+
+	meter->channels = 0;
+	memset(meter->peaks, 0, sizeof(meter->peaks));
+	memset(meter->holds, 0, sizeof(meter->holds));
+
+	if (meter->flags & SNDRV_FIREWIRE_PCM_METER_RESET_HOLD)
+		memset(p->meter.holds, 0, sizeof(p->meter.holds));
+
+	if (amdtp_stream_running(s)) {
+		meter->channels = p->pcm_channels;
+
+		// The stale peaks are discarded when the metering is enabled again.
+		if (!READ_ONCE(p->meter.enabled))
+			memset(p->meter.peaks, 0, sizeof(p->meter.peaks));
+
+		for (c = 0; c < meter->channels; ++c) {
+			u32 peak = xchg(&p->meter.peaks[c], 0);
+
+			if (peak > p->meter.holds[c])
+				p->meter.holds[c] = peak;
+			meter->peaks[c] = peak;
+			meter->holds[c] = p->meter.holds[c];
+		}
+
+		WRITE_ONCE(p->meter.expires, jiffies + HZ);
+		WRITE_ONCE(p->meter.enabled, true);
+
+		// The peaks of captured samples are accumulated even if nothing else consumes the
+		// payload of packets.
+		if (s->direction == AMDTP_IN_STREAM)
+			update_idle_payloads(s);
+	}
+
+	if (copy_to_user(arg, meter, sizeof(*meter)))
+		err = -EFAULT;
+end:
+	kfree(meter);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(amdtp_am824_get_pcm_meter);
+
 /**
  * amdtp_am824_add_pcm_hw_constraints - add hw constraints for PCM substream
  * @s:		the AMDTP stream for AM824 data block, must be initialized.
@@ -256,11 +721,160 @@ void amdtp_am824_midi_trigger(struct amdtp_stream *s, unsigned int port,
 {
 	struct amdtp_am824 *p = s->protocol;
 
-	if (port < p->midi_ports)
-		WRITE_ONCE(p->midi[port], midi);
+	if (port >= p->midi_ports)
+		return;
+
+	WRITE_ONCE(p->midi[port], midi);
+	amdtp_stream_midi_trigger(s, port, midi != NULL);
+
+	if (s->direction == AMDTP_IN_STREAM)
+		update_idle_payloads(s);
 }
 EXPORT_SYMBOL_GPL(amdtp_am824_midi_trigger);
 
+#if IS_ENABLED(CONFIG_SND_UMP)
+/**
+ * amdtp_am824_ump_trigger - start/stop playback/capture with an UMP endpoint
+ * @s: the AMDTP stream
+ * @ump: the UMP endpoint to be started, or %NULL to stop the current endpoint
+ *
+ * The MIDI ports of the stream are carried as the groups of UMP endpoint in MIDI 1.0 protocol.
+ * The messages from the ports in the batch of packets are delivered to the endpoint at once.
+ * For playback, the rawmidi substream triggered for the port has precedence over the endpoint.
+ * This function should be called from the .trigger callback of the endpoint.
+ */
+void amdtp_am824_ump_trigger(struct amdtp_stream *s, struct snd_ump_endpoint *ump)
+{
+	struct amdtp_am824 *p = s->protocol;
+	unsigned int i;
+
+	if (ump) {
+		if (s->direction == AMDTP_IN_STREAM) {
+			for (i = 0; i < ARRAY_SIZE(p->ump_in.cvts); ++i)
+				snd_ump_convert_reset(&p->ump_in.cvts[i]);
+			p->ump_in.count = 0;
+		} else {
+			memset(&p->ump_out, 0, sizeof(p->ump_out));
+		}
+	}
+
+	WRITE_ONCE(p->ump, ump);
+	// The endpoint is reported as the port next to the MIDI ports.
+	amdtp_stream_midi_trigger(s, p->midi_ports, ump != NULL);
+
+	if (s->direction == AMDTP_IN_STREAM)
+		update_idle_payloads(s);
+}
+EXPORT_SYMBOL_GPL(amdtp_am824_ump_trigger);
+
+// The number of words in UMP packet for each message type.
+static const u8 ump_packet_words[16] = {
+	1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4,
+};
+
+// Read a packet from the endpoint and convert it to MIDI 1.0 bytes. A part of packet is kept
+// till the rest is written by the application.
+static bool read_ump_packet(struct amdtp_am824 *p, struct snd_ump_endpoint *ump)
+{
+	u8 *buf = (u8 *)p->ump_out.words;
+	unsigned int bytes;
+	int len;
+
+	for (;;) {
+		if (p->ump_out.filled < sizeof(u32))
+			bytes = sizeof(u32);
+		else
+			bytes = ump_packet_words[p->ump_out.words[0] >> 28] * sizeof(u32);
+		if (p->ump_out.filled >= bytes)
+			break;
+
+		len = snd_ump_transmit(ump, (u32 *)(buf + p->ump_out.filled),
+				       bytes - p->ump_out.filled);
+		if (len <= 0)
+			return false;
+		p->ump_out.filled += len;
+	}
+	p->ump_out.filled = 0;
+
+	len = snd_ump_convert_from_ump(p->ump_out.words, p->ump_out.pending,
+				       &p->ump_out.pending_group);
+	p->ump_out.pending_len = max(len, 0);
+
+	return true;
+}
+
+static void fetch_ump_messages(struct amdtp_stream *s, struct snd_ump_endpoint *ump,
+			       unsigned int port, unsigned int count)
+{
+	struct amdtp_am824 *p = s->protocol;
+	struct amdtp_midi_batch *batch = &p->midi_batch[port];
+
+	// Fill the FIFOs with the messages as long as they have room.
+	for (;;) {
+		unsigned int group;
+
+		if (p->ump_out.pending_len == 0 && !read_ump_packet(p, ump))
+			break;
+
+		group = p->ump_out.pending_group;
+		if (group < p->midi_ports) {
+			struct amdtp_am824_ump_fifo *fifo = &p->ump_out.fifos[group];
+
+			if (fifo->len + p->ump_out.pending_len > sizeof(fifo->bytes))
+				break;
+			memcpy(fifo->bytes + fifo->len, p->ump_out.pending, p->ump_out.pending_len);
+			fifo->len += p->ump_out.pending_len;
+		}
+		p->ump_out.pending_len = 0;
+	}
+
+	batch->substream = NULL;
+	batch->pos = 0;
+	batch->len = min3(count, p->ump_out.fifos[port].len, (unsigned int)sizeof(batch->bytes));
+	memcpy(batch->bytes, p->ump_out.fifos[port].bytes, batch->len);
+}
+
+static void commit_ump_messages(struct amdtp_am824 *p, unsigned int port)
+{
+	struct amdtp_am824_ump_fifo *fifo = &p->ump_out.fifos[port];
+	unsigned int pos = p->midi_batch[port].pos;
+
+	if (pos > 0) {
+		fifo->len -= pos;
+		memmove(fifo->bytes, fifo->bytes + pos, fifo->len);
+	}
+}
+
+static void flush_ump_messages(struct amdtp_am824 *p, struct snd_ump_endpoint *ump)
+{
+	if (p->ump_in.count > 0) {
+		snd_ump_receive(ump, p->ump_in.words, p->ump_in.count * sizeof(u32));
+		p->ump_in.count = 0;
+	}
+}
+
+static void queue_ump_messages(struct amdtp_am824 *p, struct snd_ump_endpoint *ump,
+			       unsigned int port, const u8 *bytes, unsigned int len)
+{
+	struct ump_cvt_to_ump *cvt = &p->ump_in.cvts[port];
+	unsigned int i;
+
+	for (i = 0; i < len; ++i) {
+		unsigned int words;
+
+		snd_ump_convert_to_ump(cvt, port, SNDRV_UMP_EP_INFO_PROTO_MIDI1, bytes[i]);
+		if (cvt->ump_bytes == 0)
+			continue;
+
+		words = cvt->ump_bytes / sizeof(u32);
+		if (p->ump_in.count + words > ARRAY_SIZE(p->ump_in.words))
+			flush_ump_messages(p, ump);
+		memcpy(p->ump_in.words + p->ump_in.count, cvt->ump, cvt->ump_bytes);
+		p->ump_in.count += words;
+	}
+}
+#endif
+
 /*
  * To avoid sending MIDI bytes at too high a rate, assume that the receiving
  * device has a FIFO, and track how much it is filled.  This values increases
@@ -305,56 +919,217 @@ static void write_midi_messages(struct amdtp_stream *s, __be32 *buffer,
 		b = (u8 *)&buffer[p->midi_position];
 
 		port = (data_block_counter + f) % 8;
-		if (f < MAX_MIDI_RX_BLOCKS &&
+		if (p->fast_midi) {
+			int len = 0;
+
+			if (f < MAX_MIDI_RX_BLOCKS)
+				len = amdtp_midi_batch_pull(&p->midi_batch[port], &b[1],
+							    MAX_MIDI_BYTES_PER_BLOCK);
+			if (len == 0)
+				b[1] = 0;
+			// The rest of bytes are cleared.
+			if (len < 2)
+				b[2] = 0;
+			if (len < 3)
+				b[3] = 0;
+			b[0] = 0x80 + len;
+		} else if (f < MAX_MIDI_RX_BLOCKS &&
 		    midi_ratelimit_per_packet(s, port) &&
-		    p->midi[port] != NULL &&
-		    snd_rawmidi_transmit(p->midi[port], &b[1], 1) == 1) {
+		    amdtp_midi_batch_pull(&p->midi_batch[port], &b[1], 1) == 1) {
 			midi_rate_use_one_byte(s, port);
 			b[0] = 0x81;
+			b[2] = 0;
+			b[3] = 0;
 		} else {
 			b[0] = 0x80;
 			b[1] = 0;
+			b[2] = 0;
+			b[3] = 0;
 		}
-		b[2] = 0;
-		b[3] = 0;
 
 		buffer += s->data_block_quadlets;
 	}
 }
 
-static void read_midi_messages(struct amdtp_stream *s, __be32 *buffer,
-			unsigned int frames, unsigned int data_block_counter)
+// Each port has one data block at most in each packet, thus the bytes for the packets are fetched
+// from rawmidi substream at once.
+static void fetch_midi_messages(struct amdtp_stream *s, unsigned int packets)
 {
 	struct amdtp_am824 *p = s->protocol;
+	unsigned int count = packets * (p->fast_midi ? MAX_MIDI_BYTES_PER_BLOCK : 1);
+	unsigned int port;
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+	struct snd_ump_endpoint *ump = READ_ONCE(p->ump);
+#endif
+
+	for (port = 0; port < ARRAY_SIZE(p->midi_batch); ++port) {
+		struct snd_rawmidi_substream *midi = READ_ONCE(p->midi[port]);
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+		if (!midi && ump) {
+			fetch_ump_messages(s, ump, port, count);
+			continue;
+		}
+#endif
+		amdtp_midi_batch_fetch(&p->midi_batch[port], midi, count);
+	}
+}
+
+static void commit_midi_messages(struct amdtp_stream *s)
+{
+	struct amdtp_am824 *p = s->protocol;
+	unsigned int port;
+
+	for (port = 0; port < ARRAY_SIZE(p->midi_batch); ++port) {
+#if IS_ENABLED(CONFIG_SND_UMP)
+		// The batch fetched from the endpoint has no substream.
+		if (!p->midi_batch[port].substream && READ_ONCE(p->ump))
+			commit_ump_messages(p, port);
+#endif
+		amdtp_midi_batch_commit(&p->midi_batch[port]);
+	}
+}
+
+static void read_midi_messages(struct amdtp_stream *s, const struct pkt_desc *desc,
+			       struct snd_ump_endpoint *ump)
+{
+	struct amdtp_am824 *p = s->protocol;
+	__be32 *buffer = desc->ctx_payload;
 	int len;
 	u8 *b;
 	int f;
 
-	for (f = 0; f < frames; f++) {
+	for (f = 0; f < desc->data_blocks; f++) {
 		unsigned int port = f;
 
 		if (!(s->flags & CIP_UNALIGHED_DBC))
-			port += data_block_counter;
+			port += desc->data_block_counter;
 		port %= 8;
 		b = (u8 *)&buffer[p->midi_position];
 
 		len = b[0] - 0x80;
-		if ((1 <= len) &&  (len <= 3) && (p->midi[port]))
-			snd_rawmidi_receive(p->midi[port], b + 1, len);
+		if ((1 <= len) &&  (len <= 3) && (p->midi[port])) {
+			amdtp_midi_batch_push(&p->midi_batch[port], p->midi[port], b + 1, len);
+			amdtp_stream_queue_midi_event(s, desc, f, port, b + 1, len);
+		}
+#if IS_ENABLED(CONFIG_SND_UMP)
+		if ((1 <= len) && (len <= 3) && ump && port < p->midi_ports)
+			queue_ump_messages(p, ump, port, b + 1, len);
+#endif
 
 		buffer += s->data_block_quadlets;
 	}
 }
 
-static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
-					    const struct pkt_desc *descs,
-					    unsigned int packets,
-					    struct snd_pcm_substream *pcm)
+// The captured samples for the routes are queued to the FIFO of domain. The oldest data block is
+// discarded when the FIFO is full.
+static void queue_monitor_samples(struct amdtp_stream *s, const struct pkt_desc *descs,
+				  unsigned int packets)
 {
+	struct amdtp_domain *d = s->domain;
 	struct amdtp_am824 *p = s->protocol;
+	struct amdtp_monitor *m;
+	int i;
+
+	spin_lock(&d->monitor.lock);
+
+	m = d->monitor.state;
+	if (!m || d->monitor.source != s)
+		goto end;
+
+	for (i = 0; i < packets; ++i) {
+		const __be32 *buf = descs[i].ctx_payload;
+		unsigned int j;
+
+		for (j = 0; j < descs[i].data_blocks; ++j) {
+			unsigned int tail = (m->head + m->used) % AMDTP_MONITOR_FIFO_BLOCKS;
+			s32 *samples = m->samples + tail * m->route_count;
+			unsigned int r;
+
+			for (r = 0; r < m->route_count; ++r) {
+				unsigned int src = m->routes[r].src;
+				u32 quad;
+
+				if (src < p->pcm_channels) {
+					quad = be32_to_cpu(buf[p->pcm_positions[src]]);
+					samples[r] = sign_extend32(quad, 23);
+				} else {
+					samples[r] = 0;
+				}
+			}
+
+			if (m->used < AMDTP_MONITOR_FIFO_BLOCKS)
+				++m->used;
+			else
+				m->head = (m->head + 1) % AMDTP_MONITOR_FIFO_BLOCKS;
+
+			buf += s->data_block_quadlets;
+		}
+	}
+end:
+	spin_unlock(&d->monitor.lock);
+}
+
+// The queued samples are summed into the outgoing data blocks with the gain. Returns whether any
+// sample is summed.
+static bool mix_monitor_samples(struct amdtp_stream *s, __be32 *buf, unsigned int data_blocks)
+{
+	struct amdtp_domain *d = s->domain;
+	struct amdtp_am824 *p = s->protocol;
+	struct amdtp_monitor *m;
+	bool mixed = false;
+	unsigned int i;
+
+	spin_lock(&d->monitor.lock);
+
+	m = d->monitor.state;
+	if (!m || d->monitor.sink != s)
+		goto end;
+
+	for (i = 0; i < data_blocks && m->used > 0; ++i) {
+		const s32 *samples = m->samples + m->head * m->route_count;
+		unsigned int r;
+
+		for (r = 0; r < m->route_count; ++r) {
+			unsigned int dst = m->routes[r].dst;
+			__be32 *quad;
+			s64 val;
+
+			if (dst >= p->pcm_channels)
+				continue;
+			quad = buf + p->pcm_positions[dst];
+
+			val = sign_extend32(be32_to_cpu(*quad), 23);
+			val += ((s64)samples[r] * m->routes[r].gain) >> AMDTP_MONITOR_GAIN_SHIFT;
+			val = clamp_t(s64, val, -0x800000, 0x7fffff);
+			*quad = cpu_to_be32(0x40000000 | ((u32)val & 0x00ffffff));
+		}
+
+		m->head = (m->head + 1) % AMDTP_MONITOR_FIFO_BLOCKS;
+		--m->used;
+		buf += s->data_block_quadlets;
+		mixed = true;
+	}
+end:
+	spin_unlock(&d->monitor.lock);
+
+	return mixed;
+}
+
+unsigned int amdtp_am824_process_it_ctx_payloads(struct amdtp_stream *s,
+						 const struct pkt_desc *descs,
+						 unsigned int packets,
+						 struct snd_pcm_substream *pcm)
+{
+	struct amdtp_am824 *p = s->protocol;
+	bool metering = is_meter_enabled(s);
 	unsigned int pcm_frames = 0;
 	int i;
 
+	if (p->midi_ports)
+		fetch_midi_messages(s, packets);
+
 	for (i = 0; i < packets; ++i) {
 		const struct pkt_desc *desc = descs + i;
 		__be32 *buf = desc->ctx_payload;
@@ -363,28 +1138,45 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 		if (pcm) {
 			write_pcm_s32(s, pcm, buf, data_blocks, pcm_frames);
 			pcm_frames += data_blocks * p->frame_multiplier;
-		} else {
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+		} else if (!amdtp_stream_pcm_silence_cached(s, desc, data_blocks)) {
 			write_pcm_silence(s, buf, data_blocks);
 		}
 
+		if (unlikely(READ_ONCE(s->domain->monitor.sink) == s) &&
+		    mix_monitor_samples(s, buf, data_blocks))
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+
+		if (unlikely(metering))
+			accumulate_pcm_peaks(s, buf, data_blocks);
+
 		if (p->midi_ports) {
 			write_midi_messages(s, buf, data_blocks,
 					    desc->data_block_counter);
 		}
 	}
 
+	if (p->midi_ports)
+		commit_midi_messages(s);
+
 	return pcm_frames;
 }
 
-static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
-					    const struct pkt_desc *descs,
-					    unsigned int packets,
-					    struct snd_pcm_substream *pcm)
+unsigned int amdtp_am824_process_ir_ctx_payloads(struct amdtp_stream *s,
+						 const struct pkt_desc *descs,
+						 unsigned int packets,
+						 struct snd_pcm_substream *pcm)
 {
 	struct amdtp_am824 *p = s->protocol;
+	struct snd_ump_endpoint *ump = NULL;
+	bool metering = is_meter_enabled(s);
 	unsigned int pcm_frames = 0;
 	int i;
 
+#if IS_ENABLED(CONFIG_SND_UMP)
+	ump = READ_ONCE(p->ump);
+#endif
+
 	for (i = 0; i < packets; ++i) {
 		const struct pkt_desc *desc = descs + i;
 		__be32 *buf = desc->ctx_payload;
@@ -395,10 +1187,88 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 			pcm_frames += data_blocks * p->frame_multiplier;
 		}
 
-		if (p->midi_ports) {
-			read_midi_messages(s, buf, data_blocks,
-					   desc->data_block_counter);
+		if (unlikely(metering))
+			accumulate_pcm_peaks(s, buf, data_blocks);
+
+		if (p->midi_ports)
+			read_midi_messages(s, desc, ump);
+	}
+
+	// The bytes in the batch of packets are delivered at once.
+	if (p->midi_ports) {
+		for (i = 0; i < ARRAY_SIZE(p->midi_batch); ++i)
+			amdtp_midi_batch_deliver(&p->midi_batch[i]);
+	}
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+	// The messages in the batch of packets are delivered at once.
+	if (ump)
+		flush_ump_messages(p, ump);
+#endif
+
+	if (unlikely(READ_ONCE(s->domain->monitor.source) == s))
+		queue_monitor_samples(s, descs, packets);
+
+	return pcm_frames;
+}
+
+// For the PCM substream sharing the stream. The channels out of the range are left as they are.
+static unsigned int process_shared_pcm(struct amdtp_stream *s, const struct pkt_desc *descs,
+				       unsigned int packets, struct amdtp_shared_pcm *shared)
+{
+	struct amdtp_am824 *p = s->protocol;
+	struct snd_pcm_runtime *runtime = shared->pcm->runtime;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
+	unsigned int channels_per_frame = p->pcm_channels / p->frame_multiplier;
+	unsigned int channels = min(shared->channels, runtime->channels);
+	bool planar = amdtp_pcm_is_planar(runtime);
+	unsigned int frame = shared->buffer_pointer;
+	unsigned int pcm_frames = 0;
+	int i, j, k, c;
+
+	if (shared->channel_offset >= channels_per_frame)
+		channels = 0;
+	else
+		channels = min(channels, channels_per_frame - shared->channel_offset);
+
+	for (i = 0; i < packets; ++i) {
+		const struct pkt_desc *desc = descs + i;
+		__be32 *buf = desc->ctx_payload;
+
+		for (j = 0; j < desc->data_blocks; ++j) {
+			for (k = 0; k < p->frame_multiplier; ++k) {
+				const u8 *positions = p->pcm_positions + k * channels_per_frame +
+						      shared->channel_offset;
+
+				for (c = 0; c < channels; ++c) {
+					void *sample;
+
+					if (planar)
+						sample = amdtp_pcm_planar_sample(runtime, c, frame, bytes);
+					else
+						sample = (void *)runtime->dma_area +
+							 frames_to_bytes(runtime, frame) + c * bytes;
+
+					if (s->direction == AMDTP_OUT_STREAM) {
+						u32 val = amdtp_pcm_load_sample(sample, runtime->format);
+
+						buf[positions[c]] = cpu_to_be32((val >> 8) | 0x40000000);
+					} else {
+						u32 val = be32_to_cpu(buf[positions[c]]) << 8;
+
+						amdtp_pcm_store_sample(sample, val, runtime->format);
+					}
+				}
+
+				if (++frame >= runtime->buffer_size)
+					frame = 0;
+				++pcm_frames;
+			}
+			buf += s->data_block_quadlets;
 		}
+
+		if (s->direction == AMDTP_OUT_STREAM && channels > 0)
+			amdtp_stream_pcm_silence_invalidate(s, desc);
 	}
 
 	return pcm_frames;
@@ -416,13 +1286,28 @@ int amdtp_am824_init(struct amdtp_stream *s, struct fw_unit *unit,
 		     enum amdtp_stream_direction dir, unsigned int flags)
 {
 	amdtp_stream_process_ctx_payloads_t process_ctx_payloads;
+	struct amdtp_am824 *p;
+	int err;
 
 	if (dir == AMDTP_IN_STREAM)
-		process_ctx_payloads = process_ir_ctx_payloads;
+		process_ctx_payloads = amdtp_am824_process_ir_ctx_payloads;
 	else
-		process_ctx_payloads = process_it_ctx_payloads;
+		process_ctx_payloads = amdtp_am824_process_it_ctx_payloads;
 
-	return amdtp_stream_init(s, unit, dir, flags, CIP_FMT_AM,
-			process_ctx_payloads, sizeof(struct amdtp_am824));
+	err = amdtp_stream_init(s, unit, dir, flags, CIP_FMT_AM,
+				process_ctx_payloads, sizeof(struct amdtp_am824));
+	if (err < 0)
+		return err;
+
+	s->process_shared_pcm = process_shared_pcm;
+
+	p = s->protocol;
+	p->fast_midi = fast_midi;
+
+	// MIDI substreams are not attached yet.
+	if (dir == AMDTP_IN_STREAM)
+		amdtp_stream_set_idle_payloads(s, true);
+
+	return 0;
 }
 EXPORT_SYMBOL_GPL(amdtp_am824_init);
@@ -4,12 +4,15 @@
 
 #include <sound/pcm.h>
 #include <sound/rawmidi.h>
+#if IS_ENABLED(CONFIG_SND_UMP)
+#include <sound/ump.h>
+#endif
 
 #include "amdtp-stream.h"
 
-#define AM824_IN_PCM_FORMAT_BITS	SNDRV_PCM_FMTBIT_S32
+#define AM824_IN_PCM_FORMAT_BITS	AMDTP_PCM_FORMAT_BITS
 
-#define AM824_OUT_PCM_FORMAT_BITS	SNDRV_PCM_FMTBIT_S32
+#define AM824_OUT_PCM_FORMAT_BITS	AMDTP_PCM_FORMAT_BITS
 
 /*
  * This module supports maximum 64 PCM channels for one PCM stream
@@ -38,12 +41,34 @@ void amdtp_am824_set_pcm_position(struct amdtp_stream *s, unsigned int index,
 void amdtp_am824_set_midi_position(struct amdtp_stream *s,
 				   unsigned int position);
 
+void amdtp_am824_set_pcm_channel_offset(struct amdtp_stream *s, unsigned int offset);
+
+void amdtp_am824_set_fast_midi(struct amdtp_stream *s, bool enable);
+
+int amdtp_am824_get_pcm_meter(struct amdtp_stream *tx_streams, unsigned int tx_count,
+			      struct amdtp_stream *rx_streams, unsigned int rx_count,
+			      void __user *arg);
+
 int amdtp_am824_add_pcm_hw_constraints(struct amdtp_stream *s,
 				       struct snd_pcm_runtime *runtime);
 
 void amdtp_am824_midi_trigger(struct amdtp_stream *s, unsigned int port,
 			      struct snd_rawmidi_substream *midi);
 
+#if IS_ENABLED(CONFIG_SND_UMP)
+void amdtp_am824_ump_trigger(struct amdtp_stream *s, struct snd_ump_endpoint *ump);
+#endif
+
+/* Not exported. Called directly by amdtp-stream.c instead of indirect call. */
+unsigned int amdtp_am824_process_it_ctx_payloads(struct amdtp_stream *s,
+						 const struct pkt_desc *descs,
+						 unsigned int packets,
+						 struct snd_pcm_substream *pcm);
+unsigned int amdtp_am824_process_ir_ctx_payloads(struct amdtp_stream *s,
+						 const struct pkt_desc *descs,
+						 unsigned int packets,
+						 struct snd_pcm_substream *pcm);
+
 int amdtp_am824_init(struct amdtp_stream *s, struct fw_unit *unit,
 		     enum amdtp_stream_direction dir, unsigned int flags);
 #endif
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * The tables of ideal sequence of packets for Audio and Music Data Transmission Protocol
+ * (IEC 61883-6) streams
+ *
+ * Copyright (c) Clemens Ladisch <clemens@ladisch.de>
+ */
+
+#include "amdtp-ideal-seq.h"
+
+static struct ideal_seq_entry ideal_seq_entries[IDEAL_SEQ_CYCLES_BASE_32000 +
+						IDEAL_SEQ_CYCLES_BASE_48000 * 3 +
+						IDEAL_SEQ_CYCLES_BASE_44100 * 3];
+
+struct amdtp_ideal_seq amdtp_ideal_seqs[CIP_SFC_COUNT];
+
+static unsigned int __init calculate_nonblocking_data_blocks(unsigned int *data_block_state,
+							     enum cip_sfc sfc)
+{
+	unsigned int data_blocks;
+
+	if (!cip_sfc_is_base_44100(sfc)) {
+		// Sample_rate / 8000 is an integer, and precomputed.
+		data_blocks = *data_block_state;
+	} else {
+		unsigned int phase = *data_block_state;
+
+	/*
+	 * This calculates the number of data blocks per packet so that
+	 * 1) the overall rate is correct and exactly synchronized to
+	 *    the bus clock, and
+	 * 2) packets with a rounded-up number of blocks occur as early
+	 *    as possible in the sequence (to prevent underruns of the
+	 *    device's buffer).
+	 */
+		if (sfc == CIP_SFC_44100)
+			/* 6 6 5 6 5 6 5 ... */
+			data_blocks = 5 + ((phase & 1) ^ (phase == 0 || phase >= 40));
+		else
+			/* 12 11 11 11 11 ... or 23 22 22 22 22 ... */
+			data_blocks = 11 * (sfc >> 1) + (phase == 0);
+		if (++phase >= (80 >> (sfc >> 1)))
+			phase = 0;
+		*data_block_state = phase;
+	}
+
+	return data_blocks;
+}
+
+static unsigned int __init calculate_syt_offset(unsigned int *last_syt_offset,
+			unsigned int *syt_offset_state, enum cip_sfc sfc)
+{
+	unsigned int syt_offset;
+
+	if (*last_syt_offset < TICKS_PER_CYCLE) {
+		if (!cip_sfc_is_base_44100(sfc))
+			syt_offset = *last_syt_offset + *syt_offset_state;
+		else {
+		/*
+		 * The time, in ticks, of the n'th SYT_INTERVAL sample is:
+		 *   n * SYT_INTERVAL * 24576000 / sample_rate
+		 * Modulo TICKS_PER_CYCLE, the difference between successive
+		 * elements is about 1386.23.  Rounding the results of this
+		 * formula to the SYT precision results in a sequence of
+		 * differences that begins with:
+		 *   1386 1386 1387 1386 1386 1386 1387 1386 1386 1386 1387 ...
+		 * This code generates _exactly_ the same sequence.
+		 */
+			unsigned int phase = *syt_offset_state;
+			unsigned int index = phase % 13;
+
+			syt_offset = *last_syt_offset;
+			syt_offset += 1386 + ((index && !(index & 3)) ||
+					      phase == 146);
+			if (++phase >= 147)
+				phase = 0;
+			*syt_offset_state = phase;
+		}
+	} else
+		syt_offset = *last_syt_offset - TICKS_PER_CYCLE;
+	*last_syt_offset = syt_offset;
+
+	if (syt_offset >= TICKS_PER_CYCLE)
+		syt_offset = CIP_SYT_NO_INFO;
+
+	return syt_offset;
+}
+
+/**
+ * amdtp_stream_build_ideal_seqs - build the tables of ideal sequence for each SFC
+ *
+ * This function is expected to be called once at module load. The sequence of ideal packets is
+ * simulated just for the period, then the tables are used for any IT context in softirq without
+ * the arithmetic per packet.
+ */
+void __init amdtp_stream_build_ideal_seqs(void)
+{
+	static const struct {
+		unsigned int data_block;
+		unsigned int syt_offset;
+		unsigned int cycles;
+	} initial_state[] = {
+		[CIP_SFC_32000]  = {  4, 3072, IDEAL_SEQ_CYCLES_BASE_32000 },
+		[CIP_SFC_48000]  = {  6, 1024, IDEAL_SEQ_CYCLES_BASE_48000 },
+		[CIP_SFC_96000]  = { 12, 1024, IDEAL_SEQ_CYCLES_BASE_48000 },
+		[CIP_SFC_192000] = { 24, 1024, IDEAL_SEQ_CYCLES_BASE_48000 },
+		[CIP_SFC_44100]  = {  0,   67, IDEAL_SEQ_CYCLES_BASE_44100 },
+		[CIP_SFC_88200]  = {  0,   67, IDEAL_SEQ_CYCLES_BASE_44100 },
+		[CIP_SFC_176400] = {  0,   67, IDEAL_SEQ_CYCLES_BASE_44100 },
+	};
+	struct ideal_seq_entry *entry = ideal_seq_entries;
+	enum cip_sfc sfc;
+
+	for (sfc = 0; sfc < CIP_SFC_COUNT; ++sfc) {
+		unsigned int data_block_state = initial_state[sfc].data_block;
+		unsigned int syt_offset_state = initial_state[sfc].syt_offset;
+		unsigned int last_syt_offset = TICKS_PER_CYCLE;
+		int i;
+
+		amdtp_ideal_seqs[sfc].entries = entry;
+		amdtp_ideal_seqs[sfc].size = initial_state[sfc].cycles;
+
+		for (i = 0; i < initial_state[sfc].cycles; ++i) {
+			unsigned int syt_offset = calculate_syt_offset(&last_syt_offset,
+								       &syt_offset_state, sfc);
+
+			entry->syt_offset = syt_offset;
+			entry->data_blocks[CIP_NONBLOCKING] =
+				calculate_nonblocking_data_blocks(&data_block_state, sfc);
+			if (syt_offset != CIP_SYT_NO_INFO)
+				entry->data_blocks[CIP_BLOCKING] = amdtp_syt_intervals[sfc];
+			else
+				entry->data_blocks[CIP_BLOCKING] = 0;
+			++entry;
+		}
+	}
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef SOUND_FIREWIRE_AMDTP_IDEAL_SEQ_H_INCLUDED
+#define SOUND_FIREWIRE_AMDTP_IDEAL_SEQ_H_INCLUDED
+
+// The code for the sequence of ideal packets depends on nothing but the definitions in this
+// header and amdtp-stream.h, so that it is built also in userspace by timestamp.c with a shim
+// header for the definitions.
+#include "amdtp-stream.h"
+
+#define TICKS_PER_CYCLE		3072
+#define CYCLES_PER_SECOND	8000
+#define TICKS_PER_SECOND	(TICKS_PER_CYCLE * CYCLES_PER_SECOND)
+
+#define CIP_SYT_NO_INFO		0xffff
+
+// The sequence of syt offset and the number of data blocks in ideal packets repeats in the period
+// of cycles below for each SFC, from the initial state at stream start.
+#define IDEAL_SEQ_CYCLES_BASE_32000	2
+#define IDEAL_SEQ_CYCLES_BASE_48000	4
+#define IDEAL_SEQ_CYCLES_BASE_44100	640
+
+struct ideal_seq_entry {
+	u16 syt_offset;
+	// Indexed by CIP_BLOCKING flag.
+	u8 data_blocks[2];
+};
+
+struct amdtp_ideal_seq {
+	const struct ideal_seq_entry *entries;
+	unsigned int size;
+};
+
+// Built by amdtp_stream_build_ideal_seqs() at module load.
+extern struct amdtp_ideal_seq amdtp_ideal_seqs[CIP_SFC_COUNT];
+
+// Fill the ring of sequence descriptors from the table, continuing at the phase.
+static inline void amdtp_ideal_seq_pool(struct seq_desc *descs, unsigned int seq_size,
+					unsigned int *seq_tail, unsigned int *seq_phase,
+					enum cip_sfc sfc, unsigned int mode, unsigned int count)
+{
+	const struct ideal_seq_entry *entries = amdtp_ideal_seqs[sfc].entries;
+	const unsigned int phase_size = amdtp_ideal_seqs[sfc].size;
+	unsigned int tail = *seq_tail;
+	unsigned int phase = *seq_phase;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		const struct ideal_seq_entry *entry = entries + phase;
+		struct seq_desc *desc = descs + tail;
+
+		desc->syt_offset = entry->syt_offset;
+		desc->data_blocks = entry->data_blocks[mode];
+
+		if (++phase >= phase_size)
+			phase = 0;
+		if (++tail >= seq_size)
+			tail = 0;
+	}
+
+	*seq_tail = tail;
+	*seq_phase = phase;
+}
+
+#endif
@@ -0,0 +1,619 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef SOUND_FIREWIRE_AMDTP_PCM_H_INCLUDED
+#define SOUND_FIREWIRE_AMDTP_PCM_H_INCLUDED
+
+#include <linux/types.h>
+#include <sound/pcm.h>
+
+#include "amdtp-stream.h"
+
+// Parameterized kernels to convert PCM samples between the intermediate buffer of PCM substream
+// and the data channels in data blocks of packet payload. The data channels for PCM samples are
+// expected to be contiguous in each data block. The parameters are expected to be constant in
+// each call site so that the compiler generates code specialized for each protocol. Both
+// interleaved and non-interleaved access to the intermediate buffer are supported, as well as
+// the sample formats in AMDTP_PCM_FORMAT_BITS.
+
+static __always_inline u32 amdtp_pcm_to_wire(u32 val, bool little_endian)
+{
+	if (little_endian)
+		return (__force u32)cpu_to_le32(val);
+	else
+		return (__force u32)cpu_to_be32(val);
+}
+
+static __always_inline u32 amdtp_pcm_from_wire(u32 val, bool little_endian)
+{
+	if (little_endian)
+		return le32_to_cpu((__force __le32)val);
+	else
+		return be32_to_cpu((__force __be32)val);
+}
+
+// Whether the byte order of data channel is the same as the one of host.
+static __always_inline bool amdtp_pcm_is_native_endian(bool little_endian)
+{
+#ifdef __LITTLE_ENDIAN
+	return little_endian;
+#else
+	return !little_endian;
+#endif
+}
+
+static __always_inline unsigned int amdtp_pcm_sample_bytes(snd_pcm_format_t format)
+{
+	if (format == SNDRV_PCM_FORMAT_S24_3LE)
+		return 3;
+	else
+		return 4;
+}
+
+// The sample is loaded as the value aligned to the most significant bit of 32 bit, like S32.
+static __always_inline u32 amdtp_pcm_load_sample(const void *src, snd_pcm_format_t format)
+{
+	if (format == SNDRV_PCM_FORMAT_S24_3LE) {
+		const u8 *byte = src;
+
+		return (byte[0] << 8) | (byte[1] << 16) | ((u32)byte[2] << 24);
+	} else if (format == SNDRV_PCM_FORMAT_S24) {
+		return *(const u32 *)src << 8;
+	} else {
+		return *(const u32 *)src;
+	}
+}
+
+static __always_inline void amdtp_pcm_store_sample(void *dst, u32 val, snd_pcm_format_t format)
+{
+	if (format == SNDRV_PCM_FORMAT_S24_3LE) {
+		u8 *byte = dst;
+
+		byte[0] = (val >> 8) & 0xff;
+		byte[1] = (val >> 16) & 0xff;
+		byte[2] = (val >> 24) & 0xff;
+	} else if (format == SNDRV_PCM_FORMAT_S24) {
+		// The most significant byte is for sign extension.
+		*(u32 *)dst = (u32)((s32)val >> 8);
+	} else {
+		*(u32 *)dst = val;
+	}
+}
+
+/**
+ * amdtp_pcm_is_planar - check the intermediate buffer is for non-interleaved access
+ * @runtime: the runtime of PCM substream
+ *
+ * For non-interleaved access, the samples of each channel are consecutive in each area of the
+ * intermediate buffer, which the value of dma_bytes is divided by the number of channels to.
+ */
+static inline bool amdtp_pcm_is_planar(const struct snd_pcm_runtime *runtime)
+{
+	return runtime->access == SNDRV_PCM_ACCESS_MMAP_NONINTERLEAVED ||
+	       runtime->access == SNDRV_PCM_ACCESS_RW_NONINTERLEAVED;
+}
+
+// Return the index of PCM frame in the intermediate buffer for non-interleaved access.
+static inline unsigned int amdtp_pcm_planar_position(const struct amdtp_stream *s,
+						     const struct snd_pcm_runtime *runtime,
+						     unsigned int pcm_frames)
+{
+	return (s->pcm_buffer_pointer + pcm_frames) % runtime->buffer_size;
+}
+
+// Return the sample of the channel in the PCM frame for non-interleaved access.
+static inline void *amdtp_pcm_planar_sample(const struct snd_pcm_runtime *runtime,
+					    unsigned int channel, unsigned int frame,
+					    unsigned int sample_bytes)
+{
+	return (void *)runtime->dma_area + channel * (runtime->dma_bytes / runtime->channels) +
+	       frame * sample_bytes;
+}
+
+// Return the position in the intermediate buffer for the PCM frame, with the number of frames
+// till the end of the buffer.
+static inline void *amdtp_pcm_buffer_position(const struct amdtp_stream *s,
+					      const struct snd_pcm_runtime *runtime,
+					      unsigned int pcm_frames, int *remaining_frames)
+{
+	unsigned int pcm_buffer_pointer;
+
+	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
+	pcm_buffer_pointer %= runtime->buffer_size;
+
+	*remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
+
+	return (void *)runtime->dma_area + frames_to_bytes(runtime, pcm_buffer_pointer);
+}
+
+// The channels are unrolled by four.
+static __always_inline void amdtp_pcm_encode_frame(u32 *dst, const void *src,
+						   unsigned int channels, unsigned int shift,
+						   u32 label, bool little_endian,
+						   snd_pcm_format_t format)
+{
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	unsigned int c;
+
+#define ENCODE(c)								\
+	amdtp_pcm_to_wire((amdtp_pcm_load_sample(src + (c) * bytes, format) >> shift) | label, \
+			  little_endian)
+	for (c = 0; c + 4 <= channels; c += 4) {
+		dst[c] = ENCODE(c);
+		dst[c + 1] = ENCODE(c + 1);
+		dst[c + 2] = ENCODE(c + 2);
+		dst[c + 3] = ENCODE(c + 3);
+	}
+	for (; c < channels; ++c)
+		dst[c] = ENCODE(c);
+#undef ENCODE
+}
+
+static __always_inline void amdtp_pcm_decode_frame(void *dst, const u32 *src,
+						   unsigned int channels, unsigned int shift,
+						   u32 mask, bool little_endian,
+						   snd_pcm_format_t format)
+{
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	unsigned int c;
+
+#define DECODE(c)								\
+	amdtp_pcm_store_sample(dst + (c) * bytes,				\
+			       (amdtp_pcm_from_wire(src[c], little_endian) << shift) & mask, \
+			       format)
+	for (c = 0; c + 4 <= channels; c += 4) {
+		DECODE(c);
+		DECODE(c + 1);
+		DECODE(c + 2);
+		DECODE(c + 3);
+	}
+	for (; c < channels; ++c)
+		DECODE(c);
+#undef DECODE
+}
+
+// When the data blocks consist of the data channels for PCM samples only and the data channel is
+// S32 sample without shift, the PCM frames and the data blocks have the same layout. They are
+// copied in bulk for each contiguous region of the intermediate buffer, with byte swap as a flat
+// loop which the compiler can vectorize if the byte order differs from the one of host.
+static __always_inline bool amdtp_pcm_is_bulk(const struct amdtp_stream *s, unsigned int channels,
+					      unsigned int shift, snd_pcm_format_t format)
+{
+	return format == SNDRV_PCM_FORMAT_S32 && shift == 0 && channels == s->data_block_quadlets;
+}
+
+static __always_inline void amdtp_pcm_write_bulk(struct snd_pcm_runtime *runtime, u32 *dst,
+						 const void *src, int remaining_frames,
+						 unsigned int data_blocks, unsigned int channels,
+						 u32 label, bool little_endian)
+{
+	while (data_blocks > 0) {
+		unsigned int frames = min_t(unsigned int, data_blocks, remaining_frames);
+		unsigned int count = frames * channels;
+
+		if (label == 0 && amdtp_pcm_is_native_endian(little_endian)) {
+			memcpy(dst, src, count * sizeof(*dst));
+		} else {
+			const u32 *samples = src;
+			unsigned int i;
+
+			for (i = 0; i < count; ++i)
+				dst[i] = amdtp_pcm_to_wire(samples[i] | label, little_endian);
+		}
+
+		dst += count;
+		data_blocks -= frames;
+		remaining_frames -= frames;
+		if (remaining_frames == 0) {
+			src = (void *)runtime->dma_area;
+			remaining_frames = runtime->buffer_size;
+		} else {
+			src += count * sizeof(*dst);
+		}
+	}
+}
+
+static __always_inline void amdtp_pcm_read_bulk(struct snd_pcm_runtime *runtime, void *dst,
+						const u32 *src, int remaining_frames,
+						unsigned int data_blocks, unsigned int channels,
+						u32 mask, bool little_endian)
+{
+	while (data_blocks > 0) {
+		unsigned int frames = min_t(unsigned int, data_blocks, remaining_frames);
+		unsigned int count = frames * channels;
+
+		if (mask == 0xffffffff && amdtp_pcm_is_native_endian(little_endian)) {
+			memcpy(dst, src, count * sizeof(*src));
+		} else {
+			u32 *samples = dst;
+			unsigned int i;
+
+			for (i = 0; i < count; ++i)
+				samples[i] = amdtp_pcm_from_wire(src[i], little_endian) & mask;
+		}
+
+		src += count;
+		data_blocks -= frames;
+		remaining_frames -= frames;
+		if (remaining_frames == 0) {
+			dst = (void *)runtime->dma_area;
+			remaining_frames = runtime->buffer_size;
+		} else {
+			dst += count * sizeof(*src);
+		}
+	}
+}
+
+static __always_inline void __amdtp_pcm_write(struct amdtp_stream *s,
+					      struct snd_pcm_runtime *runtime, u32 *dst,
+					      unsigned int data_blocks, unsigned int pcm_frames,
+					      unsigned int channels, unsigned int shift,
+					      u32 label, bool little_endian,
+					      snd_pcm_format_t format)
+{
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	int remaining_frames;
+	const void *src;
+	int i, c;
+
+	if (amdtp_pcm_is_planar(runtime)) {
+		unsigned int frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+
+		for (i = 0; i < data_blocks; ++i) {
+			for (c = 0; c < channels; ++c) {
+				u32 sample;
+
+				src = amdtp_pcm_planar_sample(runtime, c, frame, bytes);
+				sample = amdtp_pcm_load_sample(src, format);
+				dst[c] = amdtp_pcm_to_wire((sample >> shift) | label,
+							   little_endian);
+			}
+			dst += s->data_block_quadlets;
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		}
+		return;
+	}
+
+	src = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
+
+	if (amdtp_pcm_is_bulk(s, channels, shift, format)) {
+		amdtp_pcm_write_bulk(runtime, dst, src, remaining_frames, data_blocks, channels,
+				     label, little_endian);
+		return;
+	}
+
+	for (i = 0; i < data_blocks; ++i) {
+		amdtp_pcm_encode_frame(dst, src, channels, shift, label, little_endian, format);
+		src += channels * bytes;
+		dst += s->data_block_quadlets;
+		if (--remaining_frames == 0)
+			src = (void *)runtime->dma_area;
+	}
+}
+
+static __always_inline void __amdtp_pcm_read(struct amdtp_stream *s,
+					     struct snd_pcm_runtime *runtime, const u32 *src,
+					     unsigned int data_blocks, unsigned int pcm_frames,
+					     unsigned int channels, unsigned int shift,
+					     u32 mask, bool little_endian,
+					     snd_pcm_format_t format)
+{
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	int remaining_frames;
+	void *dst;
+	int i, c;
+
+	if (amdtp_pcm_is_planar(runtime)) {
+		unsigned int frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+
+		for (i = 0; i < data_blocks; ++i) {
+			for (c = 0; c < channels; ++c) {
+				u32 sample = amdtp_pcm_from_wire(src[c], little_endian);
+
+				dst = amdtp_pcm_planar_sample(runtime, c, frame, bytes);
+				amdtp_pcm_store_sample(dst, (sample << shift) & mask, format);
+			}
+			src += s->data_block_quadlets;
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		}
+		return;
+	}
+
+	dst = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
+
+	if (amdtp_pcm_is_bulk(s, channels, shift, format)) {
+		amdtp_pcm_read_bulk(runtime, dst, src, remaining_frames, data_blocks, channels,
+				    mask, little_endian);
+		return;
+	}
+
+	for (i = 0; i < data_blocks; ++i) {
+		amdtp_pcm_decode_frame(dst, src, channels, shift, mask, little_endian, format);
+		dst += channels * bytes;
+		src += s->data_block_quadlets;
+		if (--remaining_frames == 0)
+			dst = (void *)runtime->dma_area;
+	}
+}
+
+/**
+ * amdtp_pcm_write - encode PCM frames into quadlet data channels
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream
+ * @buffer: the first data channel for PCM sample in the first data block
+ * @data_blocks: the number of data blocks to encode
+ * @pcm_frames: the number of PCM frames already processed in the callback
+ * @channels: the number of PCM channels
+ * @shift: the number of bits to shift the sample aligned to MSB to right
+ * @label: the bits to add to the shifted sample
+ * @little_endian: whether the data channel is little endian or big endian
+ *
+ * The code is specialized for each format of the PCM substream.
+ */
+static __always_inline void amdtp_pcm_write(struct amdtp_stream *s,
+					    struct snd_pcm_substream *pcm, void *buffer,
+					    unsigned int data_blocks, unsigned int pcm_frames,
+					    unsigned int channels, unsigned int shift,
+					    u32 label, bool little_endian)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+
+	switch (runtime->format) {
+	case SNDRV_PCM_FORMAT_S24_3LE:
+		__amdtp_pcm_write(s, runtime, buffer, data_blocks, pcm_frames, channels, shift,
+				  label, little_endian, SNDRV_PCM_FORMAT_S24_3LE);
+		break;
+	case SNDRV_PCM_FORMAT_S24:
+		__amdtp_pcm_write(s, runtime, buffer, data_blocks, pcm_frames, channels, shift,
+				  label, little_endian, SNDRV_PCM_FORMAT_S24);
+		break;
+	default:
+		__amdtp_pcm_write(s, runtime, buffer, data_blocks, pcm_frames, channels, shift,
+				  label, little_endian, SNDRV_PCM_FORMAT_S32);
+		break;
+	}
+}
+
+/**
+ * amdtp_pcm_read - decode quadlet data channels into PCM frames
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream
+ * @buffer: the first data channel for PCM sample in the first data block
+ * @data_blocks: the number of data blocks to decode
+ * @pcm_frames: the number of PCM frames already processed in the callback
+ * @channels: the number of PCM channels
+ * @shift: the number of bits to shift the data channel to left for the sample aligned to MSB
+ * @mask: the bits of shifted data channel available as sample
+ * @little_endian: whether the data channel is little endian or big endian
+ *
+ * The code is specialized for each format of the PCM substream.
+ */
+static __always_inline void amdtp_pcm_read(struct amdtp_stream *s,
+					   struct snd_pcm_substream *pcm, const void *buffer,
+					   unsigned int data_blocks, unsigned int pcm_frames,
+					   unsigned int channels, unsigned int shift,
+					   u32 mask, bool little_endian)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+
+	switch (runtime->format) {
+	case SNDRV_PCM_FORMAT_S24_3LE:
+		__amdtp_pcm_read(s, runtime, buffer, data_blocks, pcm_frames, channels, shift,
+				 mask, little_endian, SNDRV_PCM_FORMAT_S24_3LE);
+		break;
+	case SNDRV_PCM_FORMAT_S24:
+		__amdtp_pcm_read(s, runtime, buffer, data_blocks, pcm_frames, channels, shift,
+				 mask, little_endian, SNDRV_PCM_FORMAT_S24);
+		break;
+	default:
+		__amdtp_pcm_read(s, runtime, buffer, data_blocks, pcm_frames, channels, shift,
+				 mask, little_endian, SNDRV_PCM_FORMAT_S32);
+		break;
+	}
+}
+
+/**
+ * amdtp_pcm_write_silence - fill quadlet data channels with silence
+ * @s: the AMDTP stream
+ * @buffer: the first data channel for PCM sample in the first data block
+ * @data_blocks: the number of data blocks to fill
+ * @channels: the number of PCM channels
+ * @label: the bits of data channel for silence
+ * @little_endian: whether the data channel is little endian or big endian
+ */
+static __always_inline void amdtp_pcm_write_silence(struct amdtp_stream *s, void *buffer,
+						    unsigned int data_blocks,
+						    unsigned int channels, u32 label,
+						    bool little_endian)
+{
+	const u32 val = amdtp_pcm_to_wire(label, little_endian);
+	u32 *dst = buffer;
+	int i, c;
+
+	for (i = 0; i < data_blocks; ++i) {
+		for (c = 0; c < channels; ++c)
+			dst[c] = val;
+		dst += s->data_block_quadlets;
+	}
+}
+
+/**
+ * amdtp_pcm_write_packed24 - encode PCM frames into 3 byte data channels
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream
+ * @buffer: the first data channel for PCM sample in the first data block
+ * @data_blocks: the number of data blocks to encode
+ * @pcm_frames: the number of PCM frames already processed in the callback
+ * @channels: the number of PCM channels
+ *
+ * The data channel has the most significant 24 bits of sample in big endian order.
+ */
+static inline void amdtp_pcm_write_packed24(struct amdtp_stream *s,
+					    struct snd_pcm_substream *pcm, void *buffer,
+					    unsigned int data_blocks, unsigned int pcm_frames,
+					    unsigned int channels)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+	const snd_pcm_format_t format = runtime->format;
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	bool planar = amdtp_pcm_is_planar(runtime);
+	int remaining_frames = 0;
+	unsigned int frame = 0;
+	const void *src = NULL;
+	int i, c;
+
+	if (planar)
+		frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+	else
+		src = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
+
+	for (i = 0; i < data_blocks; ++i) {
+		u8 *byte = buffer;
+
+		for (c = 0; c < channels; ++c) {
+			u32 sample;
+
+			if (planar)
+				src = amdtp_pcm_planar_sample(runtime, c, frame, bytes);
+			sample = amdtp_pcm_load_sample(src, format);
+
+			byte[0] = (sample >> 24) & 0xff;
+			byte[1] = (sample >> 16) & 0xff;
+			byte[2] = (sample >>  8) & 0xff;
+			byte += 3;
+			if (!planar)
+				src += bytes;
+		}
+
+		buffer += s->data_block_quadlets * sizeof(__be32);
+		if (planar) {
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		} else if (--remaining_frames == 0) {
+			src = (void *)runtime->dma_area;
+		}
+	}
+}
+
+/**
+ * amdtp_pcm_read_packed24 - decode 3 byte data channels into PCM frames
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream
+ * @buffer: the first data channel for PCM sample in the first data block
+ * @data_blocks: the number of data blocks to decode
+ * @pcm_frames: the number of PCM frames already processed in the callback
+ * @channels: the number of PCM channels
+ *
+ * The data channel has the most significant 24 bits of sample in big endian order.
+ */
+static inline void amdtp_pcm_read_packed24(struct amdtp_stream *s,
+					   struct snd_pcm_substream *pcm, const void *buffer,
+					   unsigned int data_blocks, unsigned int pcm_frames,
+					   unsigned int channels)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+	const snd_pcm_format_t format = runtime->format;
+	const unsigned int bytes = amdtp_pcm_sample_bytes(format);
+	bool planar = amdtp_pcm_is_planar(runtime);
+	int remaining_frames = 0;
+	unsigned int frame = 0;
+	void *dst = NULL;
+	int i, c;
+
+	if (planar)
+		frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+	else
+		dst = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
+
+	for (i = 0; i < data_blocks; ++i) {
+		const u8 *byte = buffer;
+
+		for (c = 0; c < channels; ++c) {
+			u32 sample = ((u32)byte[0] << 24) | (byte[1] << 16) | (byte[2] << 8);
+
+			if (planar)
+				dst = amdtp_pcm_planar_sample(runtime, c, frame, bytes);
+			amdtp_pcm_store_sample(dst, sample, format);
+
+			byte += 3;
+			if (!planar)
+				dst += bytes;
+		}
+
+		buffer += s->data_block_quadlets * sizeof(__be32);
+		if (planar) {
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		} else if (--remaining_frames == 0) {
+			dst = (void *)runtime->dma_area;
+		}
+	}
+}
+
+/**
+ * amdtp_pcm_write_silence_packed24 - fill 3 byte data channels with silence
+ * @s: the AMDTP stream
+ * @buffer: the first data channel for PCM sample in the first data block
+ * @data_blocks: the number of data blocks to fill
+ * @channels: the number of PCM channels
+ */
+static inline void amdtp_pcm_write_silence_packed24(struct amdtp_stream *s, void *buffer,
+						    unsigned int data_blocks,
+						    unsigned int channels)
+{
+	int i;
+
+	for (i = 0; i < data_blocks; ++i) {
+		memset(buffer, 0, channels * 3);
+		buffer += s->data_block_quadlets * sizeof(__be32);
+	}
+}
+
+// The slot of packet buffer for the descriptor. The descriptors given to process_ctx_payloads
+// callback of outgoing stream start at the one for the slot of packet_index, while the callback
+// can be called several times with the part of them, e.g. when PCM substream starts in the middle.
+static inline unsigned int amdtp_stream_rx_slot(const struct amdtp_stream *s,
+						const struct pkt_desc *desc)
+{
+	unsigned int slot = s->packet_index + (desc - s->pkt_descs);
+
+	if (slot >= s->queue_size)
+		slot -= s->queue_size;
+	return slot;
+}
+
+/**
+ * amdtp_stream_pcm_silence_cached - check whether the payload already has silence
+ * @s: the AMDTP stream for outgoing packets
+ * @desc: the descriptor given to process_ctx_payloads callback
+ * @data_blocks: the number of data blocks to fill with silence
+ *
+ * The slots of packet buffer are reused in the ring. If this function returns true, the PCM
+ * channels of the data blocks in the payload still have silence written by the former cycle of
+ * the ring, thus the backend can skip writing it. Else the slot is marked to have silence, which
+ * the backend should write.
+ */
+static inline bool amdtp_stream_pcm_silence_cached(struct amdtp_stream *s,
+						   const struct pkt_desc *desc,
+						   unsigned int data_blocks)
+{
+	u16 *silence = s->ctx_data.rx.pcm_silence + amdtp_stream_rx_slot(s, desc);
+
+	if (data_blocks <= *silence)
+		return true;
+	*silence = data_blocks;
+	return false;
+}
+
+/**
+ * amdtp_stream_pcm_silence_invalidate - mark the payload to have PCM samples
+ * @s: the AMDTP stream for outgoing packets
+ * @desc: the descriptor given to process_ctx_payloads callback
+ */
+static inline void amdtp_stream_pcm_silence_invalidate(struct amdtp_stream *s,
+						       const struct pkt_desc *desc)
+{
+	s->ctx_data.rx.pcm_silence[amdtp_stream_rx_slot(s, desc)] = 0;
+}
+
+#endif
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * amdtp-stream-test.c - KUnit tests for the sequence of packets in firewire-lib
+ *
+ * Copyright (c) Clemens Ladisch <clemens@ladisch.de>
+ */
+
+#include <kunit/test.h>
+#include "amdtp-stream.h"
+#include "amdtp-ideal-seq.h"
+
+// Check the table against the reference simulation of ideal packets; the total number of events
+// in the period of table matches the rate, and the interval between the events with SYT is the
+// nominal interval rounded down or up, including the wrap-around to the next period.
+static void check_ideal_seq(struct kunit *test, enum cip_sfc sfc)
+{
+	const struct ideal_seq_entry *entries = amdtp_ideal_seqs[sfc].entries;
+	const unsigned int cycles = amdtp_ideal_seqs[sfc].size;
+	const unsigned int rate = amdtp_rate_table[sfc];
+	const unsigned int syt_interval = amdtp_syt_intervals[sfc];
+	const unsigned int period_ticks = cycles * TICKS_PER_CYCLE;
+	unsigned int gap_min, gap_max;
+	unsigned int events[2] = { 0 };
+	unsigned int first_tick = 0, last_tick = 0;
+	unsigned int syts = 0;
+	int i;
+
+	KUNIT_ASSERT_NOT_NULL(test, entries);
+	KUNIT_ASSERT_GT(test, cycles, 0);
+
+	gap_min = syt_interval * TICKS_PER_SECOND / rate;
+	gap_max = DIV_ROUND_UP(syt_interval * TICKS_PER_SECOND, rate);
+
+	for (i = 0; i < cycles; ++i) {
+		const struct ideal_seq_entry *entry = entries + i;
+		unsigned int tick;
+
+		events[CIP_NONBLOCKING] += entry->data_blocks[CIP_NONBLOCKING];
+		events[CIP_BLOCKING] += entry->data_blocks[CIP_BLOCKING];
+
+		if (entry->syt_offset == CIP_SYT_NO_INFO)
+			continue;
+		KUNIT_ASSERT_LT(test, entry->syt_offset, TICKS_PER_CYCLE);
+
+		tick = i * TICKS_PER_CYCLE + entry->syt_offset;
+		if (syts == 0) {
+			first_tick = tick;
+		} else {
+			KUNIT_EXPECT_GE(test, tick - last_tick, gap_min);
+			KUNIT_EXPECT_LE(test, tick - last_tick, gap_max);
+		}
+		last_tick = tick;
+		++syts;
+	}
+
+	KUNIT_EXPECT_EQ(test, events[CIP_NONBLOCKING] * CYCLES_PER_SECOND, rate * cycles);
+	KUNIT_EXPECT_EQ(test, events[CIP_BLOCKING], events[CIP_NONBLOCKING]);
+	KUNIT_EXPECT_EQ(test, syts * syt_interval, events[CIP_NONBLOCKING]);
+
+	KUNIT_ASSERT_GT(test, syts, 0);
+	KUNIT_EXPECT_GE(test, first_tick + period_ticks - last_tick, gap_min);
+	KUNIT_EXPECT_LE(test, first_tick + period_ticks - last_tick, gap_max);
+}
+
+static void test_ideal_seq(struct kunit *test)
+{
+	enum cip_sfc sfc;
+
+	for (sfc = 0; sfc < CIP_SFC_COUNT; ++sfc)
+		check_ideal_seq(test, sfc);
+}
+
+#define REPLAY_CHECK_CACHE_SIZE		48
+#define REPLAY_CHECK_SEQ_SIZE		32
+#define REPLAY_CHECK_PACKETS		20
+
+// Check the cache and the replay with a pair of streams out of any domain. The tx stream caches
+// packets across the end of cache, then the rx stream pools them across the end of its sequence
+// in two chunks, while the number of cached cycles, the peak and the trough follow the positions.
+static void test_replay_seq(struct kunit *test)
+{
+	static const unsigned int counts[] = { 8, REPLAY_CHECK_PACKETS - 8 };
+	struct pkt_desc descs[REPLAY_CHECK_PACKETS];
+	unsigned int cache_head = REPLAY_CHECK_CACHE_SIZE - 8;
+	unsigned int seq_tail = REPLAY_CHECK_SEQ_SIZE - 2;
+	struct amdtp_stream *tx, *rx;
+	struct seq_desc *cache, *seq;
+	unsigned int i, j;
+
+	tx = kunit_kzalloc(test, sizeof(*tx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, tx);
+	rx = kunit_kzalloc(test, sizeof(*rx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, rx);
+	cache = kunit_kcalloc(test, REPLAY_CHECK_CACHE_SIZE, sizeof(*cache), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, cache);
+	seq = kunit_kcalloc(test, REPLAY_CHECK_SEQ_SIZE, sizeof(*seq), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, seq);
+
+	// The syt is one cycle later than the packet, thus the offset is the lower bits of syt
+	// after subtracting the transfer delay of one cycle.
+	for (i = 0; i < REPLAY_CHECK_PACKETS; ++i) {
+		unsigned int cycle = CYCLES_PER_SECOND - 4 + i;
+
+		descs[i].cycle = cycle % CYCLES_PER_SECOND;
+		if (i % 4 == 3)
+			descs[i].syt = CIP_SYT_NO_INFO;
+		else
+			descs[i].syt = (((cycle + 1) & 0x0f) << 12) | (i * 151);
+		descs[i].data_blocks = i % 7;
+	}
+
+	tx->transfer_delay = TICKS_PER_CYCLE;
+	tx->ctx_data.tx.cache.descs = cache;
+	tx->ctx_data.tx.cache.size = REPLAY_CHECK_CACHE_SIZE;
+	tx->ctx_data.tx.cache.tail = cache_head;
+
+	rx->ctx_data.rx.replay_target = tx;
+	rx->ctx_data.rx.seq.descs = seq;
+	rx->ctx_data.rx.seq.size = REPLAY_CHECK_SEQ_SIZE;
+	rx->ctx_data.rx.seq.tail = seq_tail;
+	rx->ctx_data.rx.cache_head = cache_head;
+	rx->ctx_data.rx.cache_peak = 0;
+	rx->ctx_data.rx.cache_trough = UINT_MAX;
+
+	amdtp_stream_cache_seq(tx, descs, REPLAY_CHECK_PACKETS);
+	KUNIT_EXPECT_EQ(test, tx->ctx_data.tx.cache.tail, REPLAY_CHECK_PACKETS - 8);
+	KUNIT_EXPECT_EQ(test, amdtp_stream_cached_cycle_count(tx, cache_head),
+			REPLAY_CHECK_PACKETS);
+
+	for (i = 0; i < REPLAY_CHECK_PACKETS; ++i) {
+		const struct seq_desc *desc = cache + (cache_head + i) % REPLAY_CHECK_CACHE_SIZE;
+		unsigned int syt_offset = (i % 4 == 3) ? CIP_SYT_NO_INFO : i * 151;
+
+		KUNIT_EXPECT_EQ(test, desc->syt_offset, syt_offset);
+		KUNIT_EXPECT_EQ(test, desc->data_blocks, i % 7);
+	}
+
+	for (i = 0, j = 0; i < ARRAY_SIZE(counts); j += counts[i], ++i) {
+		unsigned int cached_cycles = REPLAY_CHECK_PACKETS - j;
+
+		KUNIT_EXPECT_EQ(test, amdtp_stream_cached_cycle_count(tx, rx->ctx_data.rx.cache_head),
+				cached_cycles);
+		amdtp_stream_pool_replayed_seq(rx, counts[i]);
+		KUNIT_EXPECT_EQ(test, rx->ctx_data.rx.cache_peak, REPLAY_CHECK_PACKETS);
+		KUNIT_EXPECT_EQ(test, rx->ctx_data.rx.cache_trough, cached_cycles - counts[i]);
+	}
+
+	KUNIT_EXPECT_EQ(test, rx->ctx_data.rx.cache_head, tx->ctx_data.tx.cache.tail);
+	KUNIT_EXPECT_EQ(test, amdtp_stream_cached_cycle_count(tx, rx->ctx_data.rx.cache_head), 0);
+	KUNIT_EXPECT_EQ(test, rx->ctx_data.rx.seq.tail,
+			(seq_tail + REPLAY_CHECK_PACKETS) % REPLAY_CHECK_SEQ_SIZE);
+
+	for (i = 0; i < REPLAY_CHECK_PACKETS; ++i) {
+		const struct seq_desc *src = cache + (cache_head + i) % REPLAY_CHECK_CACHE_SIZE;
+		const struct seq_desc *dst = seq + (seq_tail + i) % REPLAY_CHECK_SEQ_SIZE;
+
+		KUNIT_EXPECT_EQ(test, dst->syt_offset, src->syt_offset);
+		KUNIT_EXPECT_EQ(test, dst->data_blocks, src->data_blocks);
+	}
+
+	// The shortage of cache is counted as the trough at zero.
+	rx->ctx_data.rx.cache_trough = UINT_MAX;
+	amdtp_stream_pool_replayed_seq(rx, 1);
+	KUNIT_EXPECT_EQ(test, rx->ctx_data.rx.cache_trough, 0);
+}
+
+static struct kunit_case amdtp_stream_test_cases[] = {
+	KUNIT_CASE(test_ideal_seq),
+	KUNIT_CASE(test_replay_seq),
+	{}
+};
+
+static struct kunit_suite amdtp_stream_test_suite = {
+	.name = "snd-firewire-lib-amdtp-stream",
+	.test_cases = amdtp_stream_test_cases,
+};
+kunit_test_suite(amdtp_stream_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests for the sequence of packets in firewire-lib");
+MODULE_LICENSE("GPL v2");
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
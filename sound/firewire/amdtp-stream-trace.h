@@ -69,6 +69,124 @@ TRACE_EVENT(amdtp_packet,
 			      __get_dynamic_array_len(cip_header), 1))
 );
 
+DECLARE_EVENT_CLASS(amdtp_stream_callback,
+	TP_PROTO(const struct amdtp_stream *s, unsigned int packets, bool period_elapsed),
+	TP_ARGS(s, packets, period_elapsed),
+	TP_STRUCT__entry(
+		__field(int, channel)
+		__field(bool, in_stream)
+		__field(bool, irq_target)
+		__field(unsigned int, packets)
+		__field(int, packet_index)
+		__field(unsigned int, queue_depth)
+		__field(unsigned int, queue_size)
+		__field(bool, period_elapsed)
+		__field(unsigned int, irq)
+	),
+	TP_fast_assign(
+		__entry->channel = s->context->channel;
+		__entry->in_stream = s->direction == AMDTP_IN_STREAM;
+		__entry->irq_target = s == s->domain->irq_target;
+		__entry->packets = packets;
+		__entry->packet_index = s->packet_index;
+		// The packets for IR context are queued again as soon as completed.
+		if (s->direction == AMDTP_IN_STREAM)
+			__entry->queue_depth = s->queue_size;
+		else
+			__entry->queue_depth = s->ctx_data.rx.queue_depth;
+		__entry->queue_size = s->queue_size;
+		__entry->period_elapsed = period_elapsed;
+		__entry->irq = !!in_softirq();
+	),
+	TP_printk(
+		"%02d %s%s %03u %03d %03u/%03u %01u %01u",
+		__entry->channel,
+		__entry->in_stream ? "IR" : "IT",
+		__entry->irq_target ? "*" : "",
+		__entry->packets,
+		__entry->packet_index,
+		__entry->queue_depth,
+		__entry->queue_size,
+		__entry->period_elapsed,
+		__entry->irq)
+);
+
+DEFINE_EVENT(amdtp_stream_callback, amdtp_process_packets_enter,
+	TP_PROTO(const struct amdtp_stream *s, unsigned int packets, bool period_elapsed),
+	TP_ARGS(s, packets, period_elapsed)
+);
+
+DEFINE_EVENT(amdtp_stream_callback, amdtp_process_packets_exit,
+	TP_PROTO(const struct amdtp_stream *s, unsigned int packets, bool period_elapsed),
+	TP_ARGS(s, packets, period_elapsed)
+);
+
+DECLARE_EVENT_CLASS(amdtp_irq_target_callback,
+	TP_PROTO(const struct amdtp_stream *s, unsigned int packets),
+	TP_ARGS(s, packets),
+	TP_STRUCT__entry(
+		__field(int, channel)
+		__field(unsigned int, packets)
+		__field(int, packet_index)
+		__field(unsigned int, queue_depth)
+		__field(unsigned int, queue_size)
+	),
+	TP_fast_assign(
+		__entry->channel = s->context->channel;
+		__entry->packets = packets;
+		__entry->packet_index = s->packet_index;
+		__entry->queue_depth = s->ctx_data.rx.queue_depth;
+		__entry->queue_size = s->queue_size;
+	),
+	TP_printk(
+		"%02d %03u %03d %03u/%03u",
+		__entry->channel,
+		__entry->packets,
+		__entry->packet_index,
+		__entry->queue_depth,
+		__entry->queue_size)
+);
+
+DEFINE_EVENT(amdtp_irq_target_callback, amdtp_irq_target_enter,
+	TP_PROTO(const struct amdtp_stream *s, unsigned int packets),
+	TP_ARGS(s, packets)
+);
+
+DEFINE_EVENT(amdtp_irq_target_callback, amdtp_irq_target_exit,
+	TP_PROTO(const struct amdtp_stream *s, unsigned int packets),
+	TP_ARGS(s, packets)
+);
+
+DECLARE_EVENT_CLASS(amdtp_domain_callback,
+	TP_PROTO(const struct amdtp_domain *d, bool deferred),
+	TP_ARGS(d, deferred),
+	TP_STRUCT__entry(
+		__field(int, channel)
+		__field(bool, deferred)
+		__field(unsigned int, irq)
+	),
+	TP_fast_assign(
+		__entry->channel = d->irq_target ? d->irq_target->context->channel : -1;
+		__entry->deferred = deferred;
+		__entry->irq = !!in_softirq();
+	),
+	TP_printk(
+		"%02d %01u %01u",
+		__entry->channel,
+		__entry->deferred,
+		__entry->irq)
+);
+
+DEFINE_EVENT(amdtp_domain_callback, amdtp_process_ctxs_enter,
+	TP_PROTO(const struct amdtp_domain *d, bool deferred),
+	TP_ARGS(d, deferred)
+);
+
+DEFINE_EVENT(amdtp_domain_callback, amdtp_process_ctxs_exit,
+	TP_PROTO(const struct amdtp_domain *d, bool deferred),
+	TP_ARGS(d, deferred)
+);
+
 #endif
 
 #undef TRACE_INCLUDE_PATH
@@ -10,22 +10,63 @@
 #include <linux/err.h>
 #include <linux/firewire.h>
 #include <linux/firewire-constants.h>
+#include <linux/fs.h>
+#include <linux/indirect_call_wrapper.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/rculist.h>
+#include <linux/sched/types.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <kunit/visibility.h>
+#include <sound/control.h>
+#include <sound/info.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
+#include <sound/rawmidi.h>
 #include "amdtp-stream.h"
+#include "amdtp-am824.h"
+#include "amdtp-ideal-seq.h"
+#include "amdtp-pcm.h"
+#include "lib.h"
 
 /* TODO: remove when merging to upstream. */
 #include "../../backport.h"
 
 
-#define TICKS_PER_CYCLE		3072
-#define CYCLES_PER_SECOND	8000
-#define TICKS_PER_SECOND	(TICKS_PER_CYCLE * CYCLES_PER_SECOND)
-
 #define OHCI_SECOND_MODULUS		8
 
+static bool precise_bandwidth;
+module_param(precise_bandwidth, bool, 0644);
+MODULE_PARM_DESC(precise_bandwidth,
+		 "Reserve bandwidth for the actual maximum number of data blocks in packet (default: false)");
+
+static bool multichannel_ir;
+module_param(multichannel_ir, bool, 0644);
+MODULE_PARM_DESC(multichannel_ir,
+		 "Receive packets for IR streams on the same controller by one multichannel context (default: false)");
+
+static bool low_latency;
+module_param(low_latency, bool, 0644);
+MODULE_PARM_DESC(low_latency,
+		 "Allow PCM period as short as one isochronous cycle for live monitoring (default: false)");
+
+static bool cycle_lag_histogram;
+module_param(cycle_lag_histogram, bool, 0644);
+MODULE_PARM_DESC(cycle_lag_histogram,
+		 "Read CYCLE_TIME register in each callback for histogram of cycle lag (default: false)");
+
+// In low latency mode, the minimum number of packets queued in advance so that 1394 OHCI
+// controller can prefetch the descriptors for them.
+#define LOW_LATENCY_MIN_QUEUE_SIZE	4
+
+// In adaptive queue mode, the number of isochronous cycles between the current cycle and the cycle
+// of the last packet queued in IT context, which the callback should keep.
+#define ADAPTIVE_QUEUE_MIN_SLACK	4
+
 /* Always support Linux tracing subsystem. */
 #define CREATE_TRACE_POINTS
 #include "amdtp-stream-trace.h"
@@ -55,7 +96,6 @@
 #define CIP_FDF_SHIFT		16
 #define CIP_FDF_NO_DATA		0xff
 #define CIP_SYT_MASK		0x0000ffff
-#define CIP_SYT_NO_INFO		0xffff
 #define CIP_SYT_CYCLE_MODULUS	16
 #define CIP_NO_DATA		((CIP_FDF_NO_DATA << CIP_FDF_SHIFT) | CIP_SYT_NO_INFO)
 
@@ -81,6 +121,61 @@
 // overrun. Actual device can skip more, then this module stops the packet streaming.
 #define IR_JUMBO_PAYLOAD_MAX_SKIP_CYCLES	5
 
+// In concealment mode, the cycles lost beyond the tolerance above are filled with empty packets,
+// up to the number below at once. The descriptors of tx stream have additional entries for them.
+#define IR_CONCEAL_MAX_CYCLES		16
+
+// The number of cycles in timing profile. It's the multiple of the period of ideal sequence for
+// each rate.
+#define TIMING_PROFILE_CYCLES		1280
+
+// The minimum interval to flush the isochronous context of IRQ target for PCM operations.
+#define FLUSH_INTERVAL_NS		(NSEC_PER_SEC / CYCLES_PER_SECOND)
+
+// The margin added to the swing of cached cycles in the replay target measured in former session.
+#define REPLAY_CACHE_MARGIN_CYCLES	16
+
+// The margin to start handling the PCM frames in several streams at the same cycle.
+#define PCM_SPAN_MARGIN_CYCLES		16
+
+// The cycle of PCM span is decided when the suspended domain is resumed.
+#define PCM_SPAN_UNDECIDED		UINT_MAX
+
+// The interval of hardware IRQ for the streams running just for MIDI substreams by default.
+#define MIDI_INTERVAL_US_DEFAULT	(USEC_PER_SEC / 100)
+
+// The number of passes to shed the optional stages of payload processing after the pass exceeding
+// the budget, as hysteresis.
+#define SHEDDING_PASSES			8
+
+// The size of ring to capture packets, and the maximum number of payload quadlets per packet.
+#define CAPTURE_RING_SIZE		(4 * SND_FW_EVENT_RING_SIZE)
+#define CAPTURE_MAX_QUADLETS		64
+
+// The size of pages for descriptors of packets mapped by userspace, and the maximum number of slots
+// in them. The descriptors are not updated for the queue with more slots.
+#define PACKETS_PAGE_SIZE		(16 * PAGE_SIZE)
+#define PACKETS_PAGE_SLOTS							\
+	((PACKETS_PAGE_SIZE - sizeof(struct snd_firewire_stream_packets_page)) /	\
+	 sizeof(struct snd_firewire_stream_packet))
+
+// The parameters of delay-locked loop to estimate the rate of events in tx stream. The gains are
+// given by shift, and the loop is regarded as locked after the number of updates.
+#define RATE_DLL_TSTAMP_MODULUS		(OHCI_SECOND_MODULUS * TICKS_PER_SECOND)
+#define RATE_DLL_SHIFT_B		6
+#define RATE_DLL_SHIFT_C		14
+#define RATE_DLL_LOCK_UPDATES		1024
+
+struct timing_profile_rate {
+	struct seq_desc *descs;
+	unsigned int count;
+	bool valid;
+};
+
+struct amdtp_timing_profile {
+	struct timing_profile_rate rates[CIP_SFC_COUNT];
+};
+
 /**
  * amdtp_stream_init - initialize an AMDTP stream structure
  * @s: the AMDTP stream to initialize
@@ -110,16 +205,167 @@ int amdtp_stream_init(struct amdtp_stream *s, struct fw_unit *unit,
 	s->context = ERR_PTR(-1);
 	mutex_init(&s->mutex);
 	s->packet_index = 0;
+	s->suspended = false;
+	s->domain = NULL;
+
+	seqcount_init(&s->pcm_tstamp.seq);
+	s->timing_page = NULL;
+	s->packets_page = NULL;
+	s->replay_cache.queue_size = 0;
+	s->replay_cache.size = 0;
 
-	init_waitqueue_head(&s->ready_wait);
+	s->mc = NULL;
+	s->mc_headers = NULL;
 
 	s->fmt = fmt;
 	s->process_ctx_payloads = process_ctx_payloads;
+	s->process_shared_pcm = NULL;
+	s->idle_payloads = false;
+	s->shared_pcms = NULL;
+
+	s->midi_inputs = 0;
+
+	memset(s->counters, 0, sizeof(s->counters));
+	s->started = false;
 
 	return 0;
 }
 EXPORT_SYMBOL(amdtp_stream_init);
 
+// The pages of payload can be reused by the other streams in the pool of domain after released,
+// thus the mapping of them by userspace is zapped beforehand. The access after it gets SIGBUS.
+static void zap_packets_payload(struct amdtp_stream *s)
+{
+	struct inode *inode = s->payload_inode;
+
+	if (!inode)
+		return;
+
+	unmap_mapping_range(inode->i_mapping, (loff_t)s->payload_pgoff << PAGE_SHIFT,
+			    SNDRV_FIREWIRE_STREAM_PACKETS_WINDOW -
+			    SNDRV_FIREWIRE_STREAM_PACKETS_PAYLOAD_OFFSET, 1);
+	iput(inode);
+	s->payload_inode = NULL;
+}
+
+static void release_resources(struct amdtp_stream *s)
+{
+	if (!s->resources.allocated)
+		return;
+
+	zap_packets_payload(s);
+	iso_packets_buffer_destroy(&s->buffer, s->unit);
+	kfree(s->pkt_descs);
+
+	if (s->direction == AMDTP_OUT_STREAM) {
+		kfree(s->ctx_data.rx.seq.descs);
+		kfree(s->ctx_data.rx.pcm_silence);
+	} else if (s->resources.cache_size > 0) {
+		kfree(s->ctx_data.tx.cache.descs);
+	}
+
+	s->resources.allocated = false;
+}
+
+static int prepare_timing_profile(struct amdtp_stream *s)
+{
+	struct timing_profile_rate *rate = &s->timing_profile->rates[s->sfc];
+
+	if (!rate->descs) {
+		rate->descs = kcalloc_node(TIMING_PROFILE_CYCLES, sizeof(*rate->descs), GFP_KERNEL,
+					   snd_fw_unit_node(s->unit));
+		if (!rate->descs)
+			return -ENOMEM;
+	}
+
+	// Record newly unless the profile is available.
+	if (!rate->valid)
+		rate->count = 0;
+	s->ctx_data.tx.profile_skip = s->ctx_data.tx.cache.size;
+
+	return 0;
+}
+
+// Reuse the resources when they are kept with the same parameters, or allocate them newly.
+static int prepare_resources(struct amdtp_stream *s, unsigned int queue_size,
+			     unsigned int max_ctx_payload_size, unsigned int cache_size,
+			     enum dma_data_direction dir)
+{
+	int node, err;
+
+	if (s->resources.allocated) {
+		if (s->resources.queue_size == queue_size &&
+		    s->resources.max_ctx_payload_size == max_ctx_payload_size &&
+		    s->resources.cache_size == cache_size)
+			return 0;
+
+		release_resources(s);
+	}
+
+	// Carve the packet buffer from the pool of domain, or allocate own buffer when the pool is
+	// not reserved or exhausted.
+	err = iso_packets_buffer_init_in_pool(&s->buffer, &s->domain->packet_pools[s->direction],
+					      queue_size, max_ctx_payload_size, dir);
+	if (err < 0) {
+		err = iso_packets_buffer_init(&s->buffer, s->unit, queue_size, max_ctx_payload_size,
+					      dir);
+		if (err < 0)
+			return err;
+	}
+
+	// The descriptors are accessed in software IRQ context of the controller.
+	node = snd_fw_unit_node(s->unit);
+
+	if (s->direction == AMDTP_IN_STREAM)
+		s->pkt_descs = kcalloc_node(queue_size + IR_CONCEAL_MAX_CYCLES,
+					    sizeof(*s->pkt_descs), GFP_KERNEL, node);
+	else
+		s->pkt_descs = kcalloc_node(queue_size, sizeof(*s->pkt_descs), GFP_KERNEL, node);
+	if (!s->pkt_descs) {
+		err = -ENOMEM;
+		goto err_buffer;
+	}
+
+	if (s->direction == AMDTP_OUT_STREAM) {
+		s->ctx_data.rx.seq.descs = kcalloc_node(queue_size,
+							sizeof(*s->ctx_data.rx.seq.descs),
+							GFP_KERNEL, node);
+		if (!s->ctx_data.rx.seq.descs) {
+			err = -ENOMEM;
+			goto err_pkt_descs;
+		}
+
+		s->ctx_data.rx.pcm_silence = kcalloc_node(queue_size,
+							  sizeof(*s->ctx_data.rx.pcm_silence),
+							  GFP_KERNEL, node);
+		if (!s->ctx_data.rx.pcm_silence) {
+			kfree(s->ctx_data.rx.seq.descs);
+			err = -ENOMEM;
+			goto err_pkt_descs;
+		}
+	} else if (cache_size > 0) {
+		s->ctx_data.tx.cache.descs = kcalloc_node(cache_size,
+							  sizeof(*s->ctx_data.tx.cache.descs),
+							  GFP_KERNEL, node);
+		if (!s->ctx_data.tx.cache.descs) {
+			err = -ENOMEM;
+			goto err_pkt_descs;
+		}
+	}
+
+	s->resources.queue_size = queue_size;
+	s->resources.max_ctx_payload_size = max_ctx_payload_size;
+	s->resources.cache_size = cache_size;
+	s->resources.allocated = true;
+
+	return 0;
+err_pkt_descs:
+	kfree(s->pkt_descs);
+err_buffer:
+	iso_packets_buffer_destroy(&s->buffer, s->unit);
+	return err;
+}
+
 /**
  * amdtp_stream_destroy - free stream resources
  * @s: the AMDTP stream to destroy
@@ -131,11 +377,56 @@ void amdtp_stream_destroy(struct amdtp_stream *s)
 		return;
 
 	WARN_ON(amdtp_stream_running(s));
+	release_resources(s);
+
+	if (s->timing_profile) {
+		int i;
+
+		for (i = 0; i < CIP_SFC_COUNT; ++i)
+			kfree(s->timing_profile->rates[i].descs);
+		kfree(s->timing_profile);
+		s->timing_profile = NULL;
+	}
+
+	vfree(s->timing_page);
+	s->timing_page = NULL;
+	vfree(s->packets_page);
+	s->packets_page = NULL;
+
+	kfree(s->shared_pcms);
+	s->shared_pcms = NULL;
+
 	kfree(s->protocol);
 	mutex_destroy(&s->mutex);
 }
 EXPORT_SYMBOL(amdtp_stream_destroy);
 
+/**
+ * amdtp_stream_enable_timing_profile - enable timing profile for tx stream
+ * @s: the AMDTP stream for tx packets
+ *
+ * The sequence of tx packets is recorded in each rate at the first session of replay, then the rx
+ * streams in later sessions replay the recorded sequence without waiting for the sequence of tx
+ * packets to be cached. The replay of cached sequence begins when the cache is primed. It's
+ * useful for the device which takes long time to transfer available tx packets.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_stream_enable_timing_profile(struct amdtp_stream *s)
+{
+	if (s->direction != AMDTP_IN_STREAM)
+		return -EINVAL;
+
+	if (!s->timing_profile) {
+		s->timing_profile = kzalloc(sizeof(*s->timing_profile), GFP_KERNEL);
+		if (!s->timing_profile)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_enable_timing_profile);
+
 const unsigned int amdtp_syt_intervals[CIP_SFC_COUNT] = {
 	[CIP_SFC_32000]  =  8,
 	[CIP_SFC_44100]  =  8,
@@ -158,6 +449,9 @@ const unsigned int amdtp_rate_table[CIP_SFC_COUNT] = {
 };
 EXPORT_SYMBOL(amdtp_rate_table);
 
+// Defined in amdtp-ideal-seq.c, which is also built in userspace.
+EXPORT_SYMBOL_IF_KUNIT(amdtp_ideal_seqs);
+
 static int apply_constraint_to_size(struct snd_pcm_hw_params *params,
 				    struct snd_pcm_hw_rule *rule)
 {
@@ -195,10 +489,12 @@ int amdtp_stream_add_pcm_hw_constraints(struct amdtp_stream *s,
 
 	hw->info = SNDRV_PCM_INFO_BLOCK_TRANSFER |
 		   SNDRV_PCM_INFO_INTERLEAVED |
+		   SNDRV_PCM_INFO_NONINTERLEAVED |
 		   SNDRV_PCM_INFO_JOINT_DUPLEX |
 		   SNDRV_PCM_INFO_MMAP |
 		   SNDRV_PCM_INFO_MMAP_VALID |
-		   SNDRV_PCM_INFO_NO_PERIOD_WAKEUP;
+		   SNDRV_PCM_INFO_NO_PERIOD_WAKEUP |
+		   SNDRV_PCM_INFO_HAS_LINK_ATIME;
 
 	hw->periods_min = 2;
 	hw->periods_max = UINT_MAX;
@@ -237,9 +533,13 @@ int amdtp_stream_add_pcm_hw_constraints(struct amdtp_stream *s,
 	// Due to the above protocol design, the minimum PCM frames per
 	// interrupt should be double of the value of syt interval, thus it is
 	// 250 usec.
+	// In low latency mode, the interrupt is allowed for each isoc packet
+	// at the cost of CPU usage, thus it is 125 usec. In blocking mode, the
+	// period size is still aligned to the value of syt interval below.
 	err = snd_pcm_hw_constraint_minmax(runtime,
 					   SNDRV_PCM_HW_PARAM_PERIOD_TIME,
-					   250, maximum_usec_per_period);
+					   READ_ONCE(low_latency) ? USEC_PER_SEC / CYCLES_PER_SECOND : 250,
+					   maximum_usec_per_period);
 	if (err < 0)
 		goto end;
 
@@ -319,23 +619,49 @@ static int amdtp_stream_get_max_ctx_payload_size(struct amdtp_stream *s)
 	return s->syt_interval * s->data_block_quadlets * sizeof(__be32) * multiplier;
 }
 
+// In blocking mode, the packet includes the events as many as SYT_INTERVAL. In non-blocking
+// mode, it includes the events up to the ceiling of events per isochronous cycle.
+static unsigned int amdtp_stream_get_max_data_blocks(struct amdtp_stream *s)
+{
+	if (s->flags & CIP_BLOCKING)
+		return s->syt_interval;
+	else
+		return DIV_ROUND_UP(amdtp_rate_table[s->sfc], CYCLES_PER_SECOND);
+}
+
 /**
  * amdtp_stream_get_max_payload - get the stream's packet size
  * @s: the AMDTP stream
  *
  * This function must not be called before the stream has been configured
  * with amdtp_stream_set_parameters().
+ *
+ * The returned value is expected to be used to reserve isochronous bandwidth. By default, it is
+ * sized for SYT_INTERVAL data blocks in packet. When precise_bandwidth parameter of the module is
+ * enabled, it is sized for the actual maximum number of data blocks in packet at the sampling rate
+ * and the blocking mode. In both cases, the packet for CIP_JUMBO_PAYLOAD is multiplied.
  */
 unsigned int amdtp_stream_get_max_payload(struct amdtp_stream *s)
 {
 	unsigned int cip_header_size;
+	unsigned int multiplier;
 
 	if (!(s->flags & CIP_NO_HEADER))
 		cip_header_size = CIP_HEADER_SIZE;
 	else
 		cip_header_size = 0;
 
-	return cip_header_size + amdtp_stream_get_max_ctx_payload_size(s);
+	if (!READ_ONCE(precise_bandwidth))
+		return cip_header_size + amdtp_stream_get_max_ctx_payload_size(s);
+
+	if (s->flags & CIP_JUMBO_PAYLOAD)
+		multiplier = IR_JUMBO_PAYLOAD_MAX_SKIP_CYCLES;
+	else
+		multiplier = 1;
+
+	return cip_header_size +
+	       amdtp_stream_get_max_data_blocks(s) * s->data_block_quadlets * sizeof(__be32) *
+	       multiplier;
 }
 EXPORT_SYMBOL(amdtp_stream_get_max_payload);
 
@@ -349,130 +675,13 @@ void amdtp_stream_pcm_prepare(struct amdtp_stream *s)
 {
 	s->pcm_buffer_pointer = 0;
 	s->pcm_period_pointer = 0;
+	s->pcm_tstamp.valid = false;
+	s->timing_frames = 0;
+	s->pcm_span.pending = false;
+	s->pcm_span.follower = false;
 }
 EXPORT_SYMBOL(amdtp_stream_pcm_prepare);
 
-static void pool_blocking_data_blocks(struct amdtp_stream *s, struct seq_desc *descs,
-				      const unsigned int seq_size, unsigned int seq_tail,
-				      unsigned int count)
-{
-	const unsigned int syt_interval = s->syt_interval;
-	int i;
-
-	for (i = 0; i < count; ++i) {
-		struct seq_desc *desc = descs + seq_tail;
-
-		if (desc->syt_offset != CIP_SYT_NO_INFO)
-			desc->data_blocks = syt_interval;
-		else
-			desc->data_blocks = 0;
-
-		seq_tail = (seq_tail + 1) % seq_size;
-	}
-}
-
-static void pool_ideal_nonblocking_data_blocks(struct amdtp_stream *s, struct seq_desc *descs,
-					       const unsigned int seq_size, unsigned int seq_tail,
-					       unsigned int count)
-{
-	const enum cip_sfc sfc = s->sfc;
-	unsigned int state = s->ctx_data.rx.data_block_state;
-	int i;
-
-	for (i = 0; i < count; ++i) {
-		struct seq_desc *desc = descs + seq_tail;
-
-		if (!cip_sfc_is_base_44100(sfc)) {
-			// Sample_rate / 8000 is an integer, and precomputed.
-			desc->data_blocks = state;
-		} else {
-			unsigned int phase = state;
-
-		/*
-		 * This calculates the number of data blocks per packet so that
-		 * 1) the overall rate is correct and exactly synchronized to
-		 *    the bus clock, and
-		 * 2) packets with a rounded-up number of blocks occur as early
-		 *    as possible in the sequence (to prevent underruns of the
-		 *    device's buffer).
-		 */
-			if (sfc == CIP_SFC_44100)
-				/* 6 6 5 6 5 6 5 ... */
-				desc->data_blocks = 5 + ((phase & 1) ^ (phase == 0 || phase >= 40));
-			else
-				/* 12 11 11 11 11 ... or 23 22 22 22 22 ... */
-				desc->data_blocks = 11 * (sfc >> 1) + (phase == 0);
-			if (++phase >= (80 >> (sfc >> 1)))
-				phase = 0;
-			state = phase;
-		}
-
-		seq_tail = (seq_tail + 1) % seq_size;
-	}
-
-	s->ctx_data.rx.data_block_state = state;
-}
-
-static unsigned int calculate_syt_offset(unsigned int *last_syt_offset,
-			unsigned int *syt_offset_state, enum cip_sfc sfc)
-{
-	unsigned int syt_offset;
-
-	if (*last_syt_offset < TICKS_PER_CYCLE) {
-		if (!cip_sfc_is_base_44100(sfc))
-			syt_offset = *last_syt_offset + *syt_offset_state;
-		else {
-		/*
-		 * The time, in ticks, of the n'th SYT_INTERVAL sample is:
-		 *   n * SYT_INTERVAL * 24576000 / sample_rate
-		 * Modulo TICKS_PER_CYCLE, the difference between successive
-		 * elements is about 1386.23.  Rounding the results of this
-		 * formula to the SYT precision results in a sequence of
-		 * differences that begins with:
-		 *   1386 1386 1387 1386 1386 1386 1387 1386 1386 1386 1387 ...
-		 * This code generates _exactly_ the same sequence.
-		 */
-			unsigned int phase = *syt_offset_state;
-			unsigned int index = phase % 13;
-
-			syt_offset = *last_syt_offset;
-			syt_offset += 1386 + ((index && !(index & 3)) ||
-					      phase == 146);
-			if (++phase >= 147)
-				phase = 0;
-			*syt_offset_state = phase;
-		}
-	} else
-		syt_offset = *last_syt_offset - TICKS_PER_CYCLE;
-	*last_syt_offset = syt_offset;
-
-	if (syt_offset >= TICKS_PER_CYCLE)
-		syt_offset = CIP_SYT_NO_INFO;
-
-	return syt_offset;
-}
-
-static void pool_ideal_syt_offsets(struct amdtp_stream *s, struct seq_desc *descs,
-				   const unsigned int seq_size, unsigned int seq_tail,
-				   unsigned int count)
-{
-	const enum cip_sfc sfc = s->sfc;
-	unsigned int last = s->ctx_data.rx.last_syt_offset;
-	unsigned int state = s->ctx_data.rx.syt_offset_state;
-	int i;
-
-	for (i = 0; i < count; ++i) {
-		struct seq_desc *desc = descs + seq_tail;
-
-		desc->syt_offset = calculate_syt_offset(&last, &state, sfc);
-
-		seq_tail = (seq_tail + 1) % seq_size;
-	}
-
-	s->ctx_data.rx.last_syt_offset = last;
-	s->ctx_data.rx.syt_offset_state = state;
-}
-
 static unsigned int compute_syt_offset(unsigned int syt, unsigned int cycle,
 				       unsigned int transfer_delay)
 {
@@ -510,6 +719,39 @@ static unsigned int calculate_cached_cycle_count(struct amdtp_stream *s, unsigne
 	return cycles;
 }
 
+// Record the cached sequence after skipping the initial part of the session, which can be
+// unstable.
+static void record_timing_profile(struct amdtp_stream *s, unsigned int cache_pos,
+				  unsigned int desc_count)
+{
+	const struct seq_desc *cache = s->ctx_data.tx.cache.descs;
+	const unsigned int cache_size = s->ctx_data.tx.cache.size;
+	struct timing_profile_rate *rate = &s->timing_profile->rates[s->sfc];
+	unsigned int skip = s->ctx_data.tx.profile_skip;
+	int i;
+
+	if (rate->valid || !rate->descs)
+		return;
+
+	for (i = 0; i < desc_count; ++i) {
+		if (skip > 0) {
+			--skip;
+		} else {
+			rate->descs[rate->count] = cache[cache_pos];
+			if (++rate->count >= TIMING_PROFILE_CYCLES) {
+				// Paired with the load in amdtp_stream_start() for rx stream.
+				smp_store_release(&rate->valid, true);
+				break;
+			}
+		}
+
+		if (++cache_pos >= cache_size)
+			cache_pos = 0;
+	}
+
+	s->ctx_data.tx.profile_skip = skip;
+}
+
 static void cache_seq(struct amdtp_stream *s, const struct pkt_desc *descs, unsigned int desc_count)
 {
 	const unsigned int transfer_delay = s->transfer_delay;
@@ -529,26 +771,21 @@ static void cache_seq(struct amdtp_stream *s, const struct pkt_desc *descs, unsi
 			dst->syt_offset = CIP_SYT_NO_INFO;
 		dst->data_blocks = src->data_blocks;
 
-		cache_tail = (cache_tail + 1) % cache_size;
+		if (++cache_tail >= cache_size)
+			cache_tail = 0;
 	}
 
+	if (s->timing_profile)
+		record_timing_profile(s, s->ctx_data.tx.cache.tail, desc_count);
+
 	s->ctx_data.tx.cache.tail = cache_tail;
 }
 
 static void pool_ideal_seq_descs(struct amdtp_stream *s, unsigned int count)
 {
-	struct seq_desc *descs = s->ctx_data.rx.seq.descs;
-	unsigned int seq_tail = s->ctx_data.rx.seq.tail;
-	const unsigned int seq_size = s->ctx_data.rx.seq.size;
-
-	pool_ideal_syt_offsets(s, descs, seq_size, seq_tail, count);
-
-	if (s->flags & CIP_BLOCKING)
-		pool_blocking_data_blocks(s, descs, seq_size, seq_tail, count);
-	else
-		pool_ideal_nonblocking_data_blocks(s, descs, seq_size, seq_tail, count);
-
-	s->ctx_data.rx.seq.tail = (seq_tail + count) % seq_size;
+	amdtp_ideal_seq_pool(s->ctx_data.rx.seq.descs, s->ctx_data.rx.seq.size,
+			     &s->ctx_data.rx.seq.tail, &s->ctx_data.rx.seq_phase, s->sfc,
+			     s->flags & CIP_BLOCKING, count);
 }
 
 static void pool_replayed_seq(struct amdtp_stream *s, unsigned int count)
@@ -560,18 +797,58 @@ static void pool_replayed_seq(struct amdtp_stream *s, unsigned int count)
 	struct seq_desc *descs = s->ctx_data.rx.seq.descs;
 	const unsigned int seq_size = s->ctx_data.rx.seq.size;
 	unsigned int seq_tail = s->ctx_data.rx.seq.tail;
+	unsigned int cached_cycles = calculate_cached_cycle_count(target, cache_head);
 	int i;
 
+	if (cached_cycles > s->ctx_data.rx.cache_peak)
+		s->ctx_data.rx.cache_peak = cached_cycles;
+	if (cached_cycles < count)
+		s->ctx_data.rx.cache_trough = 0;
+	else if (cached_cycles - count < s->ctx_data.rx.cache_trough)
+		s->ctx_data.rx.cache_trough = cached_cycles - count;
+
 	for (i = 0; i < count; ++i) {
 		descs[seq_tail] = cache[cache_head];
-		seq_tail = (seq_tail + 1) % seq_size;
-		cache_head = (cache_head + 1) % cache_size;
+		if (++seq_tail >= seq_size)
+			seq_tail = 0;
+		if (++cache_head >= cache_size)
+			cache_head = 0;
 	}
 
 	s->ctx_data.rx.seq.tail = seq_tail;
 	s->ctx_data.rx.cache_head = cache_head;
 }
 
+// Replay the timing profile till the cache of replay target is primed, then replay the cache.
+static void pool_profiled_seq(struct amdtp_stream *s, unsigned int count)
+{
+	struct amdtp_stream *target = s->ctx_data.rx.replay_target;
+	const struct seq_desc *profile = s->ctx_data.rx.profile;
+	unsigned int phase = s->ctx_data.rx.profile_phase;
+	struct seq_desc *descs = s->ctx_data.rx.seq.descs;
+	const unsigned int seq_size = s->ctx_data.rx.seq.size;
+	unsigned int seq_tail = s->ctx_data.rx.seq.tail;
+	int i;
+
+	if (calculate_cached_cycle_count(target, s->ctx_data.rx.cache_head) >
+	    target->ctx_data.tx.cache.size / 2) {
+		s->ctx_data.rx.profile = NULL;
+		pool_replayed_seq(s, count);
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		descs[seq_tail] = profile[phase];
+		if (++seq_tail >= seq_size)
+			seq_tail = 0;
+		if (++phase >= TIMING_PROFILE_CYCLES)
+			phase = 0;
+	}
+
+	s->ctx_data.rx.seq.tail = seq_tail;
+	s->ctx_data.rx.profile_phase = phase;
+}
+
 static void pool_seq_descs(struct amdtp_stream *s, unsigned int count)
 {
 	struct amdtp_domain *d = s->domain;
@@ -580,7 +857,10 @@ static void pool_seq_descs(struct amdtp_stream *s, unsigned int count)
 		pool_ideal_seq_descs(s, count);
 	} else {
 		if (!d->replay.on_the_fly) {
-			pool_replayed_seq(s, count);
+			if (s->ctx_data.rx.profile)
+				pool_profiled_seq(s, count);
+			else
+				pool_replayed_seq(s, count);
 		} else {
 			struct amdtp_stream *tx = s->ctx_data.rx.replay_target;
 			const unsigned int cache_size = tx->ctx_data.tx.cache.size;
@@ -595,73 +875,293 @@ static void pool_seq_descs(struct amdtp_stream *s, unsigned int count)
 	}
 }
 
-static void update_pcm_pointers(struct amdtp_stream *s,
-				struct snd_pcm_substream *pcm,
-				unsigned int frames)
+#if IS_ENABLED(CONFIG_KUNIT)
+// The entries for the KUnit test of replay. The functions above are kept static so that they are
+// inlined in the path of packet processing.
+unsigned int amdtp_stream_cached_cycle_count(struct amdtp_stream *s, unsigned int head)
 {
-	unsigned int ptr;
+	return calculate_cached_cycle_count(s, head);
+}
+EXPORT_SYMBOL_IF_KUNIT(amdtp_stream_cached_cycle_count);
 
-	ptr = s->pcm_buffer_pointer + frames;
-	if (ptr >= pcm->runtime->buffer_size)
-		ptr -= pcm->runtime->buffer_size;
-	WRITE_ONCE(s->pcm_buffer_pointer, ptr);
+void amdtp_stream_cache_seq(struct amdtp_stream *s, const struct pkt_desc *descs,
+			    unsigned int desc_count)
+{
+	cache_seq(s, descs, desc_count);
+}
+EXPORT_SYMBOL_IF_KUNIT(amdtp_stream_cache_seq);
 
-	s->pcm_period_pointer += frames;
-	if (s->pcm_period_pointer >= pcm->runtime->period_size) {
-		s->pcm_period_pointer -= pcm->runtime->period_size;
-
-		// The program in user process should periodically check the status of intermediate
-		// buffer associated to PCM substream to process PCM frames in the buffer, instead
-		// of receiving notification of period elapsed by poll wait.
-		if (!pcm->runtime->no_period_wakeup) {
-			if (in_softirq()) {
-				// In software IRQ context for 1394 OHCI.
-				snd_pcm_period_elapsed(pcm);
-			} else {
-				// In process context of ALSA PCM application under acquired lock of
-				// PCM substream.
-				snd_pcm_period_elapsed_under_stream_lock(pcm);
-			}
+void amdtp_stream_pool_replayed_seq(struct amdtp_stream *s, unsigned int count)
+{
+	pool_replayed_seq(s, count);
+}
+EXPORT_SYMBOL_IF_KUNIT(amdtp_stream_pool_replayed_seq);
+#endif
+
+static void __notify_pcm_period_elapsed(struct snd_pcm_substream *pcm)
+{
+	// The program in user process should periodically check the status of intermediate
+	// buffer associated to PCM substream to process PCM frames in the buffer, instead
+	// of receiving notification of period elapsed by poll wait.
+	if (!pcm->runtime->no_period_wakeup) {
+		if (in_softirq()) {
+			// In software IRQ context for 1394 OHCI.
+			snd_pcm_period_elapsed(pcm);
+		} else {
+			// In process context of ALSA PCM application under acquired lock of
+			// PCM substream.
+			snd_pcm_period_elapsed_under_stream_lock(pcm);
 		}
 	}
 }
 
-static int queue_packet(struct amdtp_stream *s, struct fw_iso_packet *params,
-			bool sched_irq)
+// In the pass of domain in software IRQ context, the notification is deferred till the end of
+// the pass. In process context, the PCM substream is under acquired lock, thus it's notified
+// immediately.
+static void notify_pcm_period_elapsed(struct amdtp_stream *s, struct snd_pcm_substream *pcm)
 {
-	int err;
-
-	params->interrupt = sched_irq;
-	params->tag = s->tag;
-	params->sy = 0;
+	struct amdtp_domain *d = s->domain;
+	bool deferred = false;
+	int i;
 
-	err = fw_iso_context_queue(s->context, params, &s->buffer.iso_buffer,
-				   s->buffer.packets[s->packet_index].offset);
-	if (err < 0) {
-		dev_err(&s->unit->device, "queueing error: %d\n", err);
-		goto end;
+	if (in_softirq() && READ_ONCE(d->deferred_period.deferring)) {
+		spin_lock(&d->deferred_period.lock);
+		if (d->deferred_period.deferring) {
+			for (i = 0; i < d->deferred_period.count; ++i) {
+				if (d->deferred_period.pcms[i] == pcm)
+					break;
+			}
+			if (i < d->deferred_period.count) {
+				deferred = true;
+			} else if (i < AMDTP_DOMAIN_DEFERRED_PCMS) {
+				d->deferred_period.pcms[i] = pcm;
+				++d->deferred_period.count;
+				deferred = true;
+			}
+		}
+		spin_unlock(&d->deferred_period.lock);
 	}
 
-	if (++s->packet_index >= s->queue_size)
-		s->packet_index = 0;
-end:
-	return err;
+	if (!deferred)
+		__notify_pcm_period_elapsed(pcm);
 }
 
-static inline int queue_out_packet(struct amdtp_stream *s,
-				   struct fw_iso_packet *params, bool sched_irq)
+static inline void count_stream_event(struct amdtp_stream *s, unsigned int index,
+				      unsigned int count)
 {
-	params->skip =
-		!!(params->header_length == 0 && params->payload_length == 0);
-	return queue_packet(s, params, sched_irq);
+	WRITE_ONCE(s->counters[index], s->counters[index] + count);
 }
 
-static inline int queue_in_packet(struct amdtp_stream *s,
-				  struct fw_iso_packet *params)
+static void begin_deferred_period(struct amdtp_domain *d)
 {
-	// Queue one packet for IR context.
-	params->header_length = s->ctx_data.tx.ctx_header_size;
-	params->payload_length = s->ctx_data.tx.max_ctx_payload_length;
+	if (!READ_ONCE(d->coalesce_period))
+		return;
+
+	spin_lock(&d->deferred_period.lock);
+	WRITE_ONCE(d->deferred_period.deferring, true);
+	spin_unlock(&d->deferred_period.lock);
+}
+
+static void end_deferred_period(struct amdtp_domain *d)
+{
+	struct snd_pcm_substream *pcms[AMDTP_DOMAIN_DEFERRED_PCMS];
+	unsigned int count;
+	int i;
+
+	if (!READ_ONCE(d->deferred_period.deferring))
+		return;
+
+	spin_lock(&d->deferred_period.lock);
+	WRITE_ONCE(d->deferred_period.deferring, false);
+	count = d->deferred_period.count;
+	memcpy(pcms, d->deferred_period.pcms, sizeof(*pcms) * count);
+	d->deferred_period.count = 0;
+	spin_unlock(&d->deferred_period.lock);
+
+	for (i = 0; i < count; ++i)
+		__notify_pcm_period_elapsed(pcms[i]);
+}
+
+static void begin_shedding_pass(struct amdtp_domain *d)
+{
+	if (READ_ONCE(d->shedding.budget_ns) > 0)
+		d->shedding.begin_ns = ktime_get_ns();
+}
+
+// The optional stages are shed in the streams of follower domains as well, since they are
+// processed in the same pass.
+static void end_shedding_pass(struct amdtp_domain *d)
+{
+	unsigned int budget_ns = READ_ONCE(d->shedding.budget_ns);
+	unsigned int passes = d->shedding.passes;
+	struct amdtp_domain *follower;
+
+	if (passes > 0 && d->irq_target)
+		count_stream_event(d->irq_target, SNDRV_FIREWIRE_STREAM_COUNTER_SHED_PASSES, 1);
+
+	if (budget_ns > 0 && ktime_get_ns() - d->shedding.begin_ns > budget_ns)
+		passes = SHEDDING_PASSES;
+	else if (passes > 0)
+		--passes;
+
+	if (passes == d->shedding.passes)
+		return;
+
+	WRITE_ONCE(d->shedding.passes, passes);
+	rcu_read_lock();
+	list_for_each_entry_rcu(follower, &d->group.followers, group.list)
+		WRITE_ONCE(follower->shedding.passes, passes);
+	rcu_read_unlock();
+}
+
+// The streams in follower domains are processed in the same pass as leader domain. The list of
+// followers is protected by RCU against amdtp_domain_leave() and amdtp_domain_destroy().
+static void begin_domain_pass(struct amdtp_domain *d)
+{
+	struct amdtp_domain *follower;
+
+	begin_shedding_pass(d);
+	begin_deferred_period(d);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(follower, &d->group.followers, group.list) {
+		if (smp_load_acquire(&follower->group.active))
+			begin_deferred_period(follower);
+	}
+	rcu_read_unlock();
+}
+
+static void end_domain_pass(struct amdtp_domain *d)
+{
+	struct amdtp_domain *follower;
+
+	end_deferred_period(d);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(follower, &d->group.followers, group.list)
+		end_deferred_period(follower);
+	rcu_read_unlock();
+
+	end_shedding_pass(d);
+}
+
+// Return true when the period elapses.
+static bool update_pcm_pointers(struct amdtp_stream *s,
+				struct snd_pcm_substream *pcm,
+				unsigned int frames)
+{
+	unsigned int ptr;
+
+	ptr = s->pcm_buffer_pointer + frames;
+	if (ptr >= pcm->runtime->buffer_size)
+		ptr -= pcm->runtime->buffer_size;
+	WRITE_ONCE(s->pcm_buffer_pointer, ptr);
+
+	s->pcm_period_pointer += frames;
+	if (s->pcm_period_pointer < pcm->runtime->period_size)
+		return false;
+	s->pcm_period_pointer -= pcm->runtime->period_size;
+
+	if (s->pcm_span.follower)
+		return false;
+
+	notify_pcm_period_elapsed(s, pcm);
+
+	return true;
+}
+
+static struct amdtp_shared_pcm *find_shared_pcm(struct amdtp_stream *s,
+						struct snd_pcm_substream *pcm)
+{
+	struct amdtp_shared_pcms *shared_pcms = smp_load_acquire(&s->shared_pcms);
+	int i;
+
+	if (!shared_pcms)
+		return NULL;
+
+	for (i = 0; i < AMDTP_STREAM_SHARED_PCMS; ++i) {
+		if (shared_pcms->entries[i].pcm == pcm)
+			return shared_pcms->entries + i;
+	}
+
+	return NULL;
+}
+
+static void update_shared_pcm_pointers(struct amdtp_stream *s, struct amdtp_shared_pcm *shared,
+				       unsigned int frames)
+{
+	struct snd_pcm_runtime *runtime = shared->pcm->runtime;
+	unsigned int ptr;
+
+	ptr = shared->buffer_pointer + frames;
+	if (ptr >= runtime->buffer_size)
+		ptr -= runtime->buffer_size;
+	WRITE_ONCE(shared->buffer_pointer, ptr);
+
+	shared->period_pointer += frames;
+	if (shared->period_pointer >= runtime->period_size) {
+		shared->period_pointer -= runtime->period_size;
+		notify_pcm_period_elapsed(s, shared->pcm);
+	}
+}
+
+// The PCM substreams sharing the stream are processed in the same pass as the attached one.
+static void process_shared_pcms(struct amdtp_stream *s, struct amdtp_shared_pcms *shared_pcms,
+				unsigned long running, const struct pkt_desc *descs,
+				unsigned int packets)
+{
+	int i;
+
+	for_each_set_bit(i, &running, AMDTP_STREAM_SHARED_PCMS) {
+		struct amdtp_shared_pcm *shared = shared_pcms->entries + i;
+		unsigned int frames;
+
+		frames = s->process_shared_pcm(s, descs, packets, shared);
+		update_shared_pcm_pointers(s, shared, frames);
+	}
+}
+
+static int queue_packet(struct amdtp_stream *s, struct fw_iso_packet *params,
+			bool sched_irq)
+{
+	int err;
+
+	params->interrupt = sched_irq;
+	params->tag = s->tag;
+	params->sy = 0;
+
+	// The receiver in multichannel mode fills the buffer of packet.
+	if (!s->mc) {
+		err = fw_iso_context_queue(s->context, params, iso_packets_buffer_iso(&s->buffer),
+					   s->buffer.packets[s->packet_index].offset);
+		if (err < 0) {
+			dev_err(&s->unit->device, "queueing error: %d\n", err);
+			goto end;
+		}
+	} else {
+		err = 0;
+	}
+
+	if (++s->packet_index >= s->queue_size)
+		s->packet_index = 0;
+end:
+	return err;
+}
+
+static inline int queue_out_packet(struct amdtp_stream *s,
+				   struct fw_iso_packet *params, bool sched_irq)
+{
+	params->skip =
+		!!(params->header_length == 0 && params->payload_length == 0);
+	return queue_packet(s, params, sched_irq);
+}
+
+static inline int queue_in_packet(struct amdtp_stream *s,
+				  struct fw_iso_packet *params)
+{
+	// Queue one packet for IR context.
+	params->header_length = s->ctx_data.tx.ctx_header_size;
+	params->payload_length = s->ctx_data.tx.max_ctx_payload_length;
 	params->skip = false;
 	return queue_packet(s, params, false);
 }
@@ -669,14 +1169,65 @@ static inline int queue_in_packet(struct amdtp_stream *s,
 static void generate_cip_header(struct amdtp_stream *s, __be32 cip_header[2],
 			unsigned int data_block_counter, unsigned int syt)
 {
-	cip_header[0] = cpu_to_be32(READ_ONCE(s->source_node_id_field) |
-				(s->data_block_quadlets << CIP_DBS_SHIFT) |
-				((s->sph << CIP_SPH_SHIFT) & CIP_SPH_MASK) |
-				data_block_counter);
-	cip_header[1] = cpu_to_be32(CIP_EOH |
-			((s->fmt << CIP_FMT_SHIFT) & CIP_FMT_MASK) |
-			((s->ctx_data.rx.fdf << CIP_FDF_SHIFT) & CIP_FDF_MASK) |
-			(syt & CIP_SYT_MASK));
+	// Patch the template precomputed by amdtp_stream_update().
+	cip_header[0] = cpu_to_be32(READ_ONCE(s->cip_header_template[0]) | data_block_counter);
+	cip_header[1] = cpu_to_be32(s->cip_header_template[1] | (syt & CIP_SYT_MASK));
+}
+
+static void __capture_packet(struct amdtp_stream *s, struct snd_fw_event_ring *ring,
+			     unsigned int cycle, const __be32 *cip_header, const void *payload,
+			     unsigned int length)
+{
+	struct amdtp_domain *d = s->domain;
+	struct snd_firewire_packet_record *record;
+	unsigned int header_quadlets = cip_header ? CIP_HEADER_QUADLETS : 0;
+	unsigned int payload_quadlets;
+
+	payload_quadlets = length / sizeof(__be32);
+	if (payload_quadlets > header_quadlets)
+		payload_quadlets -= header_quadlets;
+	else
+		payload_quadlets = 0;
+	payload_quadlets = min(payload_quadlets, READ_ONCE(d->capture.quadlets));
+
+	spin_lock(&d->capture.lock);
+
+	if (!snd_fw_event_ring_is_mapped(ring))
+		goto end;
+
+	record = snd_fw_event_ring_reserve(ring, struct_size(record, quadlets,
+							     header_quadlets + payload_quadlets));
+	if (!record)
+		goto end;
+
+	record->cycle = cycle;
+	record->flags = s->direction == AMDTP_IN_STREAM ? SNDRV_FIREWIRE_PACKET_RECORD_IN : 0;
+	record->channel = s->context->channel;
+	record->header_quadlets = header_quadlets;
+	record->payload_quadlets = payload_quadlets;
+	record->length = length;
+	if (header_quadlets > 0)
+		memcpy(record->quadlets, cip_header, header_quadlets * sizeof(__be32));
+	if (payload_quadlets > 0)
+		memcpy(record->quadlets + header_quadlets, payload,
+		       payload_quadlets * sizeof(__be32));
+
+	snd_fw_event_ring_commit(ring, struct_size(record, quadlets,
+						   header_quadlets + payload_quadlets));
+	snd_fw_event_ring_publish(ring);
+end:
+	spin_unlock(&d->capture.lock);
+}
+
+// The packet is recorded just while userspace maps the ring of domain.
+static inline void capture_packet(struct amdtp_stream *s, unsigned int cycle,
+				  const __be32 *cip_header, const void *payload,
+				  unsigned int length)
+{
+	struct snd_fw_event_ring *ring = READ_ONCE(s->domain->capture.ring);
+
+	if (unlikely(ring && snd_fw_event_ring_is_mapped(ring)))
+		__capture_packet(s, ring, cycle, cip_header, payload, length);
 }
 
 static void build_it_pkt_header(struct amdtp_stream *s, unsigned int cycle,
@@ -690,23 +1241,26 @@ static void build_it_pkt_header(struct amdtp_stream *s, unsigned int cycle,
 
 	payload_length = data_blocks * sizeof(__be32) * s->data_block_quadlets;
 	params->payload_length = payload_length;
+	params->header_length = header_length;
 
 	if (header_length > 0) {
 		cip_header = (__be32 *)params->header;
 		generate_cip_header(s, cip_header, data_block_counter, syt);
-		params->header_length = header_length;
 	} else {
 		cip_header = NULL;
 	}
 
 	trace_amdtp_packet(s, cycle, cip_header, payload_length + header_length, data_blocks,
 			   data_block_counter, s->packet_index, index);
+	capture_packet(s, cycle, cip_header, s->buffer.packets[s->packet_index].buffer,
+		       payload_length + header_length);
 }
 
-static int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
-			    unsigned int payload_length,
-			    unsigned int *data_blocks,
-			    unsigned int *data_block_counter, unsigned int *syt)
+static __always_inline int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
+					    unsigned int payload_length,
+					    unsigned int *data_blocks,
+					    unsigned int *data_block_counter, unsigned int *syt,
+					    const unsigned int flags)
 {
 	u32 cip_header[2];
 	unsigned int sph;
@@ -724,10 +1278,11 @@ static int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
 	 */
 	if ((((cip_header[0] & CIP_EOH_MASK) == CIP_EOH) ||
 	     ((cip_header[1] & CIP_EOH_MASK) != CIP_EOH)) &&
-	    (!(s->flags & CIP_HEADER_WITHOUT_EOH))) {
+	    (!(flags & CIP_HEADER_WITHOUT_EOH))) {
 		dev_info_ratelimited(&s->unit->device,
 				"Invalid CIP header for AMDTP: %08X:%08X\n",
 				cip_header[0], cip_header[1]);
+		count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_CIP_HEADER_ERRORS, 1);
 		return -EAGAIN;
 	}
 
@@ -738,6 +1293,7 @@ static int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
 		dev_info_ratelimited(&s->unit->device,
 				     "Detect unexpected protocol: %08x %08x\n",
 				     cip_header[0], cip_header[1]);
+		count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_CIP_HEADER_ERRORS, 1);
 		return -EAGAIN;
 	}
 
@@ -753,9 +1309,10 @@ static int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
 			dev_err(&s->unit->device,
 				"Detect invalid value in dbs field: %08X\n",
 				cip_header[0]);
+			count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_CIP_HEADER_ERRORS, 1);
 			return -EPROTO;
 		}
-		if (s->flags & CIP_WRONG_DBS)
+		if (flags & CIP_WRONG_DBS)
 			data_block_quadlets = s->data_block_quadlets;
 
 		*data_blocks = payload_length / sizeof(__be32) / data_block_quadlets;
@@ -763,14 +1320,14 @@ static int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
 
 	/* Check data block counter continuity */
 	dbc = cip_header[0] & CIP_DBC_MASK;
-	if (*data_blocks == 0 && (s->flags & CIP_EMPTY_HAS_WRONG_DBC) &&
+	if (*data_blocks == 0 && (flags & CIP_EMPTY_HAS_WRONG_DBC) &&
 	    *data_block_counter != UINT_MAX)
 		dbc = *data_block_counter;
 
-	if ((dbc == 0x00 && (s->flags & CIP_SKIP_DBC_ZERO_CHECK)) ||
+	if ((dbc == 0x00 && (flags & CIP_SKIP_DBC_ZERO_CHECK)) ||
 	    *data_block_counter == UINT_MAX) {
 		lost = false;
-	} else if (!(s->flags & CIP_DBC_IS_END_EVENT)) {
+	} else if (!(flags & CIP_DBC_IS_END_EVENT)) {
 		lost = dbc != *data_block_counter;
 	} else {
 		unsigned int dbc_interval;
@@ -787,22 +1344,24 @@ static int check_cip_header(struct amdtp_stream *s, const __be32 *buf,
 		dev_err(&s->unit->device,
 			"Detect discontinuity of CIP: %02X %02X\n",
 			*data_block_counter, dbc);
+		count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_DBC_DISCONTINUITIES, 1);
 		return -EIO;
 	}
 
 	*data_block_counter = dbc;
 
-	if (!(s->flags & CIP_UNAWARE_SYT))
+	if (!(flags & CIP_UNAWARE_SYT))
 		*syt = cip_header[1] & CIP_SYT_MASK;
 
 	return 0;
 }
 
-static int parse_ir_ctx_header(struct amdtp_stream *s, unsigned int cycle,
-			       const __be32 *ctx_header,
-			       unsigned int *data_blocks,
-			       unsigned int *data_block_counter,
-			       unsigned int *syt, unsigned int packet_index, unsigned int index)
+static __always_inline int parse_ir_ctx_header(struct amdtp_stream *s, unsigned int cycle,
+					       const __be32 *ctx_header,
+					       unsigned int *data_blocks,
+					       unsigned int *data_block_counter,
+					       unsigned int *syt, unsigned int packet_index,
+					       unsigned int index, const unsigned int flags)
 {
 	unsigned int payload_length;
 	const __be32 *cip_header;
@@ -810,7 +1369,7 @@ static int parse_ir_ctx_header(struct amdtp_stream *s, unsigned int cycle,
 
 	payload_length = be32_to_cpu(ctx_header[0]) >> ISO_DATA_LENGTH_SHIFT;
 
-	if (!(s->flags & CIP_NO_HEADER))
+	if (!(flags & CIP_NO_HEADER))
 		cip_header_size = CIP_HEADER_SIZE;
 	else
 		cip_header_size = 0;
@@ -819,6 +1378,7 @@ static int parse_ir_ctx_header(struct amdtp_stream *s, unsigned int cycle,
 		dev_err(&s->unit->device,
 			"Detect jumbo payload: %04x %04x\n",
 			payload_length, cip_header_size + s->ctx_data.tx.max_ctx_payload_length);
+		count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_CIP_HEADER_ERRORS, 1);
 		return -EIO;
 	}
 
@@ -828,7 +1388,7 @@ static int parse_ir_ctx_header(struct amdtp_stream *s, unsigned int cycle,
 
 			cip_header = ctx_header + IR_CTX_HEADER_DEFAULT_QUADLETS;
 			err = check_cip_header(s, cip_header, payload_length - cip_header_size,
-					       data_blocks, data_block_counter, syt);
+					       data_blocks, data_block_counter, syt, flags);
 			if (err < 0)
 				return err;
 		} else {
@@ -848,6 +1408,8 @@ static int parse_ir_ctx_header(struct amdtp_stream *s, unsigned int cycle,
 
 	trace_amdtp_packet(s, cycle, cip_header, payload_length, *data_blocks,
 			   *data_block_counter, packet_index, index);
+	capture_packet(s, cycle, cip_header, s->buffer.packets[packet_index].buffer,
+		       payload_length);
 
 	return 0;
 }
@@ -861,6 +1423,13 @@ static inline u32 compute_ohci_cycle_count(__be32 ctx_header_tstamp)
 	return (((tstamp >> 13) & 0x07) * 8000) + (tstamp & 0x1fff);
 }
 
+// The value of CYCLE_TIMER register consists of 7 bits for second, 13 bits for cycle, and 12 bits for
+// offset. Pick up the same 3 bits of second as isochronous context header.
+static inline u32 compute_ohci_cycle_count_from_cycle_time(u32 cycle_time)
+{
+	return (((cycle_time >> 25) & 0x07) * 8000) + ((cycle_time >> 12) & 0x1fff);
+}
+
 static inline u32 increment_ohci_cycle_count(u32 cycle, unsigned int addend)
 {
 	cycle += addend;
@@ -890,19 +1459,89 @@ static inline u32 compute_ohci_it_cycle(const __be32 ctx_header_tstamp,
 	return increment_ohci_cycle_count(cycle, queue_size);
 }
 
-static int generate_device_pkt_descs(struct amdtp_stream *s,
-				     struct pkt_desc *descs,
-				     const __be32 *ctx_header,
-				     unsigned int packets,
-				     unsigned int *desc_count)
+// In concealment mode, fill the descriptors with empty packets for the lost cycles so that the
+// sequence replay keeps a descriptor per cycle. The number of PCM frames expected in the cycles
+// is delivered as silence after the descriptors processed so far. Once per callback. The nominal
+// number of frames is refined by conceal_dbc_gap() with the packet after the lost cycles.
+static bool conceal_lost_cycles(struct amdtp_stream *s, struct pkt_desc *descs,
+				unsigned int *desc_count, unsigned int lost_cycle,
+				unsigned int cycle, unsigned int remaining_packets)
+{
+	unsigned int cycles;
+	int i;
+
+	if (!READ_ONCE(s->domain->conceal) || s->ctx_data.tx.conceal.cycles > 0)
+		return false;
+	if (compare_ohci_cycle_count(cycle, lost_cycle) < 0)
+		return false;
+
+	cycles = (cycle + OHCI_SECOND_MODULUS * CYCLES_PER_SECOND - lost_cycle) %
+		 (OHCI_SECOND_MODULUS * CYCLES_PER_SECOND);
+	if (cycles > IR_CONCEAL_MAX_CYCLES ||
+	    *desc_count + cycles + remaining_packets > s->queue_size + IR_CONCEAL_MAX_CYCLES)
+		return false;
+
+	for (i = 0; i < cycles; ++i) {
+		struct pkt_desc *desc = descs + *desc_count;
+
+		desc->cycle = increment_ohci_cycle_count(lost_cycle, i);
+		desc->syt = CIP_SYT_NO_INFO;
+		desc->data_blocks = 0;
+		desc->data_block_counter = 0;
+		desc->ctx_payload = NULL;
+		++(*desc_count);
+	}
+
+	s->ctx_data.tx.conceal.cycles = cycles;
+	s->ctx_data.tx.conceal.index = *desc_count;
+	s->ctx_data.tx.conceal.frames = DIV_ROUND_CLOSEST(cycles * amdtp_rate_table[s->sfc],
+							  CYCLES_PER_SECOND);
+	count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_CONCEALED_CYCLES, cycles);
+
+	return true;
+}
+
+// The device continues the data block counter over the lost cycles, thus the gap of the counter
+// at the packet after them is the number of data blocks in them, including the cadence of
+// NO-DATA packets in blocking mode. The gap is ambiguous modulo 256, thus the count nearest to the
+// nominal one is used as long as the difference is within the interval of SYT.
+static void conceal_dbc_gap(struct amdtp_stream *s, unsigned int expected_dbc, unsigned int dbc,
+			    unsigned int data_blocks, const unsigned int flags)
+{
+	unsigned int nominal = s->ctx_data.tx.conceal.frames;
+	int diff;
+
+	if (flags & (CIP_NO_HEADER | CIP_UNALIGHED_DBC))
+		return;
+	if (data_blocks == 0 && (flags & CIP_EMPTY_HAS_WRONG_DBC))
+		return;
+
+	if (flags & CIP_DBC_IS_END_EVENT)
+		dbc -= data_blocks;
+	diff = sign_extend32((dbc - expected_dbc - nominal) & 0xff, 7);
+
+	if (abs(diff) <= amdtp_syt_intervals[s->sfc] && (int)nominal + diff >= 0)
+		s->ctx_data.tx.conceal.frames = nominal + diff;
+}
+
+static __always_inline int __generate_device_pkt_descs(struct amdtp_stream *s,
+							struct pkt_desc *descs,
+							const __be32 *ctx_header,
+							unsigned int packets,
+							unsigned int *desc_count,
+							const unsigned int flags)
 {
 	unsigned int next_cycle = s->next_cycle;
 	unsigned int dbc = s->data_block_counter;
+	unsigned int expected_dbc = UINT_MAX;
 	unsigned int packet_index = s->packet_index;
 	unsigned int queue_size = s->queue_size;
 	int i;
 	int err;
 
+	s->ctx_data.tx.conceal.cycles = 0;
+	s->ctx_data.tx.conceal.frames = 0;
+
 	*desc_count = 0;
 	for (i = 0; i < packets; ++i) {
 		struct pkt_desc *desc = descs + *desc_count;
@@ -914,7 +1553,9 @@ static int generate_device_pkt_descs(struct amdtp_stream *s,
 		cycle = compute_ohci_cycle_count(ctx_header[1]);
 		lost = (next_cycle != cycle);
 		if (lost) {
-			if (s->flags & CIP_NO_HEADER) {
+			unsigned int lost_cycle = next_cycle;
+
+			if (flags & CIP_NO_HEADER) {
 				// Fireface skips transmission just for an isoc cycle corresponding
 				// to empty packet.
 				unsigned int prev_cycle = next_cycle;
@@ -932,7 +1573,7 @@ static int generate_device_pkt_descs(struct amdtp_stream *s,
 					++desc;
 					++(*desc_count);
 				}
-			} else if (s->flags & CIP_JUMBO_PAYLOAD) {
+			} else if (flags & CIP_JUMBO_PAYLOAD) {
 				// OXFW970 skips transmission for several isoc cycles during
 				// asynchronous transaction. The sequence replay is impossible due
 				// to the reason.
@@ -941,30 +1582,47 @@ static int generate_device_pkt_descs(struct amdtp_stream *s,
 				lost = (compare_ohci_cycle_count(safe_cycle, cycle) > 0);
 			}
 			if (lost) {
-				dev_err(&s->unit->device, "Detect discontinuity of cycle: %d %d\n",
-					next_cycle, cycle);
-				return -EIO;
+				count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_LOST_CYCLES, 1);
+				if (!conceal_lost_cycles(s, descs, desc_count, lost_cycle, cycle,
+							 packets - i)) {
+					dev_err(&s->unit->device,
+						"Detect discontinuity of cycle: %d %d\n",
+						next_cycle, cycle);
+					return -EIO;
+				}
+				desc = descs + *desc_count;
+				next_cycle = cycle;
+				// The device continues the data block counter from the lost
+				// packets, thus it is re-seeded by the next packet.
+				expected_dbc = dbc;
+				dbc = UINT_MAX;
 			}
 		}
 
 		err = parse_ir_ctx_header(s, cycle, ctx_header, &data_blocks, &dbc, &syt,
-					  packet_index, i);
+					  packet_index, i, flags);
 		if (err < 0)
 			return err;
 
+		if (expected_dbc != UINT_MAX) {
+			conceal_dbc_gap(s, expected_dbc, dbc, data_blocks, flags);
+			expected_dbc = UINT_MAX;
+		}
+
 		desc->cycle = cycle;
 		desc->syt = syt;
 		desc->data_blocks = data_blocks;
 		desc->data_block_counter = dbc;
 		desc->ctx_payload = s->buffer.packets[packet_index].buffer;
 
-		if (!(s->flags & CIP_DBC_IS_END_EVENT))
+		if (!(flags & CIP_DBC_IS_END_EVENT))
 			dbc = (dbc + desc->data_blocks) & 0xff;
 
 		next_cycle = increment_ohci_cycle_count(next_cycle, 1);
 		++(*desc_count);
 		ctx_header += s->ctx_data.tx.ctx_header_size / sizeof(*ctx_header);
-		packet_index = (packet_index + 1) % queue_size;
+		if (++packet_index >= queue_size)
+			packet_index = 0;
 	}
 
 	s->next_cycle = next_cycle;
@@ -973,6 +1631,34 @@ static int generate_device_pkt_descs(struct amdtp_stream *s,
 	return 0;
 }
 
+// The flags tested in the loop for packets of tx stream. The loop is instantiated for each
+// combination of them so that it has no branch for them.
+#define IR_SPECIALIZED_FLAGS	(CIP_DBC_IS_END_EVENT | CIP_NO_HEADER | CIP_UNAWARE_SYT)
+
+#define CASE_DEVICE_PKT_DESCS(bits)							\
+	case (bits):									\
+		return __generate_device_pkt_descs(s, descs, ctx_header, packets,	\
+				desc_count, (s->flags & ~IR_SPECIALIZED_FLAGS) | (bits))
+
+static int generate_device_pkt_descs(struct amdtp_stream *s, struct pkt_desc *descs,
+				     const __be32 *ctx_header, unsigned int packets,
+				     unsigned int *desc_count)
+{
+	switch (s->flags & IR_SPECIALIZED_FLAGS) {
+	CASE_DEVICE_PKT_DESCS(0);
+	CASE_DEVICE_PKT_DESCS(CIP_DBC_IS_END_EVENT);
+	CASE_DEVICE_PKT_DESCS(CIP_NO_HEADER);
+	CASE_DEVICE_PKT_DESCS(CIP_DBC_IS_END_EVENT | CIP_NO_HEADER);
+	CASE_DEVICE_PKT_DESCS(CIP_UNAWARE_SYT);
+	CASE_DEVICE_PKT_DESCS(CIP_DBC_IS_END_EVENT | CIP_UNAWARE_SYT);
+	CASE_DEVICE_PKT_DESCS(CIP_NO_HEADER | CIP_UNAWARE_SYT);
+	CASE_DEVICE_PKT_DESCS(CIP_DBC_IS_END_EVENT | CIP_NO_HEADER | CIP_UNAWARE_SYT);
+	default:
+		return __generate_device_pkt_descs(s, descs, ctx_header, packets, desc_count,
+						   s->flags);
+	}
+}
+
 static unsigned int compute_syt(unsigned int syt_offset, unsigned int cycle,
 				unsigned int transfer_delay)
 {
@@ -984,22 +1670,29 @@ static unsigned int compute_syt(unsigned int syt_offset, unsigned int cycle,
 	return syt & CIP_SYT_MASK;
 }
 
-static void generate_pkt_descs(struct amdtp_stream *s, const __be32 *ctx_header, unsigned int packets)
+// The descriptors after the given number of packets are for the packets queued additionally,
+// scheduled for the subsequent cycles.
+static __always_inline void __generate_pkt_descs(struct amdtp_stream *s, const __be32 *ctx_header,
+						 unsigned int packets, unsigned int count,
+						 const unsigned int flags)
 {
 	struct pkt_desc *descs = s->pkt_descs;
 	const struct seq_desc *seq_descs = s->ctx_data.rx.seq.descs;
 	const unsigned int seq_size = s->ctx_data.rx.seq.size;
 	unsigned int dbc = s->data_block_counter;
 	unsigned int seq_head = s->ctx_data.rx.seq.head;
-	bool aware_syt = !(s->flags & CIP_UNAWARE_SYT);
+	unsigned int index = s->packet_index;
+	bool aware_syt = !(flags & CIP_UNAWARE_SYT);
 	int i;
 
-	for (i = 0; i < packets; ++i) {
+	for (i = 0; i < count; ++i) {
 		struct pkt_desc *desc = descs + i;
-		unsigned int index = (s->packet_index + i) % s->queue_size;
 		const struct seq_desc *seq = seq_descs + seq_head;
 
-		desc->cycle = compute_ohci_it_cycle(*ctx_header, s->queue_size);
+		if (i < packets)
+			desc->cycle = compute_ohci_it_cycle(ctx_header[i], s->ctx_data.rx.queue_depth);
+		else
+			desc->cycle = increment_ohci_cycle_count(desc[-1].cycle, 1);
 
 		if (aware_syt && seq->syt_offset != CIP_SYT_NO_INFO)
 			desc->syt = compute_syt(seq->syt_offset, desc->cycle, s->transfer_delay);
@@ -1008,135 +1701,655 @@ static void generate_pkt_descs(struct amdtp_stream *s, const __be32 *ctx_header,
 
 		desc->data_blocks = seq->data_blocks;
 
-		if (s->flags & CIP_DBC_IS_END_EVENT)
+		if (flags & CIP_DBC_IS_END_EVENT)
 			dbc = (dbc + desc->data_blocks) & 0xff;
 
 		desc->data_block_counter = dbc;
 
-		if (!(s->flags & CIP_DBC_IS_END_EVENT))
+		if (!(flags & CIP_DBC_IS_END_EVENT))
 			dbc = (dbc + desc->data_blocks) & 0xff;
 
 		desc->ctx_payload = s->buffer.packets[index].buffer;
 
-		seq_head = (seq_head + 1) % seq_size;
-
-		++ctx_header;
+		if (++index >= s->queue_size)
+			index = 0;
+		if (++seq_head >= seq_size)
+			seq_head = 0;
 	}
 
 	s->data_block_counter = dbc;
 	s->ctx_data.rx.seq.head = seq_head;
 }
 
-static inline void cancel_stream(struct amdtp_stream *s)
+// The flags tested in the loop for packets of rx stream, as well as IR_SPECIALIZED_FLAGS.
+#define IT_SPECIALIZED_FLAGS	(CIP_DBC_IS_END_EVENT | CIP_UNAWARE_SYT)
+
+#define CASE_PKT_DESCS(bits)								\
+	case (bits):									\
+		__generate_pkt_descs(s, ctx_header, packets, count,			\
+				     (s->flags & ~IT_SPECIALIZED_FLAGS) | (bits));	\
+		break
+
+static void generate_pkt_descs(struct amdtp_stream *s, const __be32 *ctx_header,
+			       unsigned int packets, unsigned int count)
 {
-	s->packet_index = -1;
-	if (in_softirq())
-		amdtp_stream_pcm_abort(s);
-	WRITE_ONCE(s->pcm_buffer_pointer, SNDRV_PCM_POS_XRUN);
+	switch (s->flags & IT_SPECIALIZED_FLAGS) {
+	CASE_PKT_DESCS(0);
+	CASE_PKT_DESCS(CIP_DBC_IS_END_EVENT);
+	CASE_PKT_DESCS(CIP_UNAWARE_SYT);
+	CASE_PKT_DESCS(CIP_DBC_IS_END_EVENT | CIP_UNAWARE_SYT);
+	default:
+		__generate_pkt_descs(s, ctx_header, packets, count, s->flags);
+		break;
+	}
 }
 
-static void process_ctx_payloads(struct amdtp_stream *s,
-				 const struct pkt_desc *descs,
-				 unsigned int packets)
+static inline void record_histogram(unsigned long *histogram, unsigned int buckets,
+				    unsigned int value)
 {
-	struct snd_pcm_substream *pcm;
-	unsigned int pcm_frames;
+	unsigned int index = min_t(unsigned int, fls(value), buckets - 1);
 
-	pcm = READ_ONCE(s->pcm);
-	pcm_frames = s->process_ctx_payloads(s, descs, packets, pcm);
-	if (pcm)
-		update_pcm_pointers(s, pcm, pcm_frames);
+	WRITE_ONCE(histogram[index], histogram[index] + 1);
 }
 
-static void process_rx_packets(struct fw_iso_context *context, u32 tstamp, size_t header_length,
-			       void *header, void *private_data)
+// The tstamp of context is for the last packet which 1394 OHCI controller completes to handle.
+// The CYCLE_TIME register is read just when the caller needs the lag, or the histogram of cycle
+// lag is enabled by the module parameter. Returns the lag in cycles, or negative error code when
+// the register is not read or unavailable.
+static int record_callback_histograms(struct amdtp_stream *s, u32 tstamp, unsigned int packets,
+				      bool need_lag)
 {
-	struct amdtp_stream *s = private_data;
-	const struct amdtp_domain *d = s->domain;
-	const __be32 *ctx_header = header;
-	const unsigned int events_per_period = d->events_per_period;
-	unsigned int event_count = s->ctx_data.rx.event_count;
-	unsigned int pkt_header_length;
-	unsigned int packets;
-	bool need_hw_irq;
-	int i;
-
-	if (s->packet_index < 0)
-		return;
-
-	// Calculate the number of packets in buffer and check XRUN.
-	packets = header_length / sizeof(*ctx_header);
-
-	pool_seq_descs(s, packets);
+	int lag = -ENODATA;
+	u32 cycle_time;
 
-	generate_pkt_descs(s, ctx_header, packets);
+	if ((need_lag || READ_ONCE(cycle_lag_histogram)) &&
+	    fw_card_read_cycle_time(fw_parent_device(s->unit)->card, &cycle_time) >= 0) {
+		u32 curr_cycle = compute_ohci_cycle_count_from_cycle_time(cycle_time);
+		u32 ctx_cycle = compute_ohci_cycle_count(cpu_to_be32(tstamp));
 
-	process_ctx_payloads(s, s->pkt_descs, packets);
-
-	if (!(s->flags & CIP_NO_HEADER))
-		pkt_header_length = IT_PKT_HEADER_SIZE_CIP;
-	else
-		pkt_header_length = 0;
+		if (curr_cycle < ctx_cycle)
+			curr_cycle += OHCI_SECOND_MODULUS * CYCLES_PER_SECOND;
+		lag = curr_cycle - ctx_cycle;
 
-	if (s == d->irq_target) {
-		// At NO_PERIOD_WAKEUP mode, the packets for all IT/IR contexts are processed by
-		// the tasks of user process operating ALSA PCM character device by calling ioctl(2)
-		// with some requests, instead of scheduled hardware IRQ of an IT context.
-		struct snd_pcm_substream *pcm = READ_ONCE(s->pcm);
-		need_hw_irq = !pcm || !pcm->runtime->no_period_wakeup;
-	} else {
-		need_hw_irq = false;
+		record_histogram(s->histogram.cycle_lag, ARRAY_SIZE(s->histogram.cycle_lag), lag);
 	}
 
-	for (i = 0; i < packets; ++i) {
-		const struct pkt_desc *desc = s->pkt_descs + i;
-		struct {
-			struct fw_iso_packet params;
-			__be32 header[CIP_HEADER_QUADLETS];
-		} template = { {0}, {0} };
-		bool sched_irq = false;
-
-		build_it_pkt_header(s, desc->cycle, &template.params, pkt_header_length,
-				    desc->data_blocks, desc->data_block_counter,
-				    desc->syt, i);
+	record_histogram(s->histogram.packets, ARRAY_SIZE(s->histogram.packets), packets);
 
-		if (s == s->domain->irq_target) {
-			event_count += desc->data_blocks;
-			if (event_count >= events_per_period) {
-				event_count -= events_per_period;
-				sched_irq = need_hw_irq;
-			}
-		}
+	return lag;
+}
 
-		if (queue_out_packet(s, &template.params, sched_irq) < 0) {
-			cancel_stream(s);
-			return;
-		}
-	}
+static inline void cancel_stream(struct amdtp_stream *s)
+{
+	count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_XRUNS, 1);
+	s->packet_index = -1;
+	if (in_softirq())
+		amdtp_stream_pcm_abort(s);
+	WRITE_ONCE(s->pcm_buffer_pointer, SNDRV_PCM_POS_XRUN);
 
-	s->ctx_data.rx.event_count = event_count;
+	// The waiter for readiness of domain detects the failure immediately.
+	WRITE_ONCE(s->domain->ready.cancelled, true);
+	wake_up(&s->domain->ready.wait);
 }
 
-static void skip_rx_packets(struct fw_iso_context *context, u32 tstamp, size_t header_length,
-			    void *header, void *private_data)
+static void signal_stream_ready(struct amdtp_stream *s)
 {
-	struct amdtp_stream *s = private_data;
 	struct amdtp_domain *d = s->domain;
-	const __be32 *ctx_header = header;
-	unsigned int packets;
-	unsigned int cycle;
-	int i;
 
-	if (s->packet_index < 0)
+	if (s->ready_processing)
 		return;
+	s->ready_processing = true;
 
-	packets = header_length / sizeof(*ctx_header);
+	if (atomic_dec_and_test(&d->ready.pending))
+		wake_up(&d->ready.wait);
+}
 
-	cycle = compute_ohci_it_cycle(ctx_header[packets - 1], s->queue_size);
-	s->next_cycle = increment_ohci_cycle_count(cycle, 1);
+// Returns the index of event in the packet for the timestamp, or negative error code. The time is
+// in ticks modulo RATE_DLL_TSTAMP_MODULUS.
+static int compute_event_tstamp(const struct amdtp_stream *s, const struct pkt_desc *desc,
+				unsigned int *tstamp)
+{
+	unsigned int cycle = desc->cycle;
+	unsigned int dbc;
+	unsigned int index;
 
-	for (i = 0; i < packets; ++i) {
-		struct fw_iso_packet params = {
+	if (desc->data_blocks == 0)
+		return -ENODATA;
+
+	// The packet has no timestamp for event. The event at the beginning of packet is
+	// regarded to be at the beginning of isochronous cycle.
+	if (s->flags & (CIP_NO_HEADER | CIP_UNAWARE_SYT)) {
+		*tstamp = cycle * TICKS_PER_CYCLE;
+		return 0;
+	}
+
+	if (desc->syt == CIP_SYT_NO_INFO)
+		return -ENODATA;
+
+	// The SYT is for the event of which the data block counter is multiple of syt_interval.
+	dbc = desc->data_block_counter;
+	if (s->flags & CIP_DBC_IS_END_EVENT)
+		dbc = (dbc - desc->data_blocks + 1) & CIP_DBC_MASK;
+	index = (s->syt_interval - dbc % s->syt_interval) % s->syt_interval;
+	if (index >= desc->data_blocks)
+		return -ENODATA;
+
+	// The SYT has the lower 4 bits of cycle for presentation later than the arrival.
+	cycle = (cycle & ~(CIP_SYT_CYCLE_MODULUS - 1)) | (desc->syt >> 12);
+	if (cycle < desc->cycle)
+		cycle = increment_ohci_cycle_count(cycle, CIP_SYT_CYCLE_MODULUS);
+	*tstamp = cycle * TICKS_PER_CYCLE + (desc->syt & 0x0fff);
+
+	return index;
+}
+
+static void reset_rate_dll(struct amdtp_stream *s)
+{
+	memset(&s->ctx_data.tx.rate_dll, 0, sizeof(s->ctx_data.tx.rate_dll));
+}
+
+// Update the delay-locked loop with the last timestamp in the packets, once per callback. The
+// loop estimates the period of events, and the difference between the estimated time and the
+// measured time for the last timestamp.
+static void update_rate_dll(struct amdtp_stream *s, const struct pkt_desc *descs,
+			    unsigned int count)
+{
+	typeof(s->ctx_data.tx.rate_dll) *dll = &s->ctx_data.tx.rate_dll;
+	unsigned int events = dll->events;
+	unsigned int point_events = 0;
+	unsigned int tstamp = 0;
+	bool found = false;
+	unsigned int elapsed;
+	u64 period;
+	s64 err;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		const struct pkt_desc *desc = descs + i;
+		unsigned int ts;
+		int index;
+
+		index = compute_event_tstamp(s, desc, &ts);
+		if (index >= 0) {
+			tstamp = ts;
+			point_events = events + index;
+			found = true;
+		}
+		events += desc->data_blocks;
+	}
+
+	if (!found) {
+		dll->events = events;
+		return;
+	}
+	dll->events = events - point_events;
+
+	if (!dll->primed) {
+		dll->nominal_period = div_u64((u64)TICKS_PER_SECOND << 32, amdtp_rate_table[s->sfc]);
+		dll->period = dll->nominal_period;
+		dll->residual = 0;
+		dll->tstamp = tstamp;
+		dll->primed = true;
+		return;
+	}
+
+	if (point_events == 0)
+		return;
+
+	if (tstamp >= dll->tstamp)
+		elapsed = tstamp - dll->tstamp;
+	else
+		elapsed = tstamp + RATE_DLL_TSTAMP_MODULUS - dll->tstamp;
+	dll->tstamp = tstamp;
+
+	// The difference between the measured and the predicted time, relative to the measured
+	// time for the former timestamp.
+	err = ((s64)elapsed << 32) - (dll->residual + (s64)(dll->period * point_events));
+
+	// Discontinuity. Restart the loop.
+	if (abs(err) > ((s64)TICKS_PER_CYCLE << 32) * CIP_SYT_CYCLE_MODULUS) {
+		reset_rate_dll(s);
+		return;
+	}
+
+	dll->residual = -err + (err >> RATE_DLL_SHIFT_B);
+
+	period = dll->period + div_s64(err >> RATE_DLL_SHIFT_C, point_events);
+	period = clamp(period, dll->nominal_period - (dll->nominal_period >> 10),
+		       dll->nominal_period + (dll->nominal_period >> 10));
+	dll->period = period;
+
+	WRITE_ONCE(dll->deviation,
+		   div64_s64((s64)(dll->nominal_period - period) * NSEC_PER_SEC, period));
+	// Paired with amdtp_stream_get_rate_estimate().
+	if (dll->updates < RATE_DLL_LOCK_UPDATES)
+		smp_store_release(&dll->updates, dll->updates + 1);
+}
+
+// Drop the packets in the callback, then re-seed the data block counter and the cycle count by
+// the packets in next callback. The isochronous context keeps running, while the XRUN is reported
+// to the PCM substream. For sequence replay, the dropped packets are cached as empty ones.
+static void resync_tx_stream(struct amdtp_stream *s, const __be32 *ctx_header,
+			     unsigned int packets)
+{
+	struct pkt_desc *descs = s->pkt_descs;
+	unsigned int cycle = 0;
+	int i;
+
+	for (i = 0; i < packets; ++i) {
+		struct pkt_desc *desc = descs + i;
+
+		cycle = compute_ohci_cycle_count(ctx_header[1]);
+
+		desc->cycle = cycle;
+		desc->syt = CIP_SYT_NO_INFO;
+		desc->data_blocks = 0;
+		desc->data_block_counter = 0;
+		desc->ctx_payload = NULL;
+
+		ctx_header += s->ctx_data.tx.ctx_header_size / sizeof(*ctx_header);
+	}
+
+	s->next_cycle = increment_ohci_cycle_count(cycle, 1);
+	s->data_block_counter = UINT_MAX;
+
+	reset_rate_dll(s);
+
+	if (s->domain->replay.enable) {
+		// The timing profile is not recorded for the session including the discontinuity.
+		if (s->timing_profile) {
+			struct timing_profile_rate *rate = &s->timing_profile->rates[s->sfc];
+
+			if (!rate->valid) {
+				rate->count = 0;
+				s->ctx_data.tx.profile_skip = s->ctx_data.tx.cache.size;
+			}
+		}
+
+		cache_seq(s, descs, packets);
+	}
+
+	count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_XRUNS, 1);
+
+	if (in_softirq())
+		amdtp_stream_pcm_abort(s);
+	else
+		WRITE_ONCE(s->pcm_buffer_pointer, SNDRV_PCM_POS_XRUN);
+}
+
+// The PCM buffer position is at the end of the last packet processed.
+static void record_pcm_tstamp(struct amdtp_stream *s, unsigned int cycle)
+{
+	write_seqcount_begin(&s->pcm_tstamp.seq);
+
+	if (!s->pcm_tstamp.valid) {
+		s->pcm_tstamp.elapsed_cycles = 0;
+		s->pcm_tstamp.valid = true;
+	} else if (cycle >= s->pcm_tstamp.cycle) {
+		s->pcm_tstamp.elapsed_cycles += cycle - s->pcm_tstamp.cycle;
+	} else {
+		s->pcm_tstamp.elapsed_cycles += cycle + OHCI_SECOND_MODULUS * CYCLES_PER_SECOND -
+						s->pcm_tstamp.cycle;
+	}
+	s->pcm_tstamp.cycle = cycle;
+
+	write_seqcount_end(&s->pcm_tstamp.seq);
+}
+
+static void update_timing_page(struct amdtp_stream *s, const struct pkt_desc *desc,
+			       unsigned int frames)
+{
+	// Paired with the release in amdtp_stream_timing_mmap().
+	struct snd_firewire_stream_timing_page *page = smp_load_acquire(&s->timing_page);
+	u32 seq;
+
+	s->timing_frames += frames;
+
+	if (!page)
+		return;
+
+	seq = page->sequence + 1;
+	WRITE_ONCE(page->sequence, seq);
+	smp_wmb();
+
+	page->frames = s->timing_frames;
+	page->cycle = desc->cycle;
+	page->syt = desc->syt;
+	page->nominal = amdtp_rate_table[s->sfc];
+	page->flags = 0;
+	page->deviation = 0;
+	if (s->direction == AMDTP_IN_STREAM) {
+		// Paired with update_rate_dll().
+		unsigned int updates = smp_load_acquire(&s->ctx_data.tx.rate_dll.updates);
+
+		if (updates > 0)
+			page->deviation = READ_ONCE(s->ctx_data.tx.rate_dll.deviation);
+		if (updates >= RATE_DLL_LOCK_UPDATES)
+			page->flags |= SNDRV_FIREWIRE_STREAM_RATE_LOCKED;
+	}
+
+	smp_wmb();
+	WRITE_ONCE(page->sequence, seq + 1);
+}
+
+// The first descriptor is for the slot at the current index of packet, since the index is moved
+// forward when queueing the packets after processing them.
+static void update_packets_page(struct amdtp_stream *s, const struct pkt_desc *descs,
+				unsigned int packets)
+{
+	// Paired with the release in map_packets_page().
+	struct snd_firewire_stream_packets_page *page = smp_load_acquire(&s->packets_page);
+	unsigned int index = s->packet_index;
+	unsigned int count = 0;
+	u32 seq;
+	int i;
+
+	if (!page || s->queue_size > PACKETS_PAGE_SLOTS)
+		return;
+
+	seq = page->sequence + 1;
+	WRITE_ONCE(page->sequence, seq);
+	smp_wmb();
+
+	page->queue_size = s->queue_size;
+	page->packet_size = s->buffer.packet_size;
+	page->packets_per_page = s->buffer.packets_per_page;
+
+	for (i = 0; i < packets; ++i) {
+		const struct pkt_desc *desc = descs + i;
+		struct snd_firewire_stream_packet *packet = page->packets + index;
+
+		// The descriptor for the cycle skipped by the device has no slot.
+		if (!desc->ctx_payload)
+			continue;
+
+		packet->cycle = desc->cycle;
+		packet->syt = desc->syt;
+		packet->data_blocks = desc->data_blocks;
+		packet->data_block_counter = desc->data_block_counter;
+
+		if (++index >= s->queue_size)
+			index = 0;
+		++count;
+	}
+	page->head = index;
+	page->count += count;
+
+	smp_wmb();
+	WRITE_ONCE(page->sequence, seq + 1);
+}
+
+static inline unsigned int process_ctx_payloads_for_pcm(struct amdtp_stream *s,
+							const struct pkt_desc *descs,
+							unsigned int packets,
+							struct snd_pcm_substream *pcm)
+{
+	// AM824 in the same module is used by the most of devices. The others are called via the
+	// function pointer since they are in the other modules.
+	return INDIRECT_CALL_2(s->process_ctx_payloads,
+			       amdtp_am824_process_it_ctx_payloads,
+			       amdtp_am824_process_ir_ctx_payloads,
+			       s, descs, packets, pcm);
+}
+
+// Return true when the period of PCM substream elapses.
+static bool process_ctx_payloads(struct amdtp_stream *s,
+				 const struct pkt_desc *descs,
+				 unsigned int packets)
+{
+	struct amdtp_shared_pcms *shared_pcms;
+	struct snd_pcm_substream *pcm;
+	unsigned long shared_running = 0;
+	unsigned int pcm_frames = 0;
+	unsigned int data_blocks = 0;
+	bool period_elapsed = false;
+	u64 begin, elapsed;
+	int i;
+
+	update_packets_page(s, descs, packets);
+
+	// Pairs with the release in amdtp_stream_add_shared_pcm().
+	shared_pcms = smp_load_acquire(&s->shared_pcms);
+	if (shared_pcms)
+		shared_running = READ_ONCE(shared_pcms->running);
+
+	// The source of direct monitoring consumes the payload even if nothing else does.
+	pcm = READ_ONCE(s->pcm);
+	if (!pcm && !shared_running && READ_ONCE(s->idle_payloads) &&
+	    READ_ONCE(s->domain->monitor.source) != s)
+		return false;
+
+	begin = ktime_get_ns();
+
+	if (pcm && READ_ONCE(s->pcm_span.pending)) {
+		unsigned int start_cycle;
+		unsigned int skip;
+
+		// Pairs with the write barrier in amdtp_domain_streams_pcm_trigger().
+		smp_rmb();
+		start_cycle = READ_ONCE(s->pcm_span.cycle);
+
+		if (start_cycle == PCM_SPAN_UNDECIDED) {
+			skip = packets;
+		} else {
+			for (skip = 0; skip < packets; ++skip) {
+				if (compare_ohci_cycle_count(descs[skip].cycle, start_cycle) >= 0)
+					break;
+			}
+		}
+
+		// The packets before the cycle are processed without the PCM substream.
+		if (skip > 0)
+			process_ctx_payloads_for_pcm(s, descs, skip, NULL);
+
+		if (skip < packets) {
+			WRITE_ONCE(s->pcm_span.pending, false);
+			pcm_frames = process_ctx_payloads_for_pcm(s, descs + skip, packets - skip,
+								  pcm);
+		} else {
+			pcm = NULL;
+		}
+	} else {
+		pcm_frames = process_ctx_payloads_for_pcm(s, descs, packets, pcm);
+	}
+
+	if (pcm) {
+		period_elapsed = update_pcm_pointers(s, pcm, pcm_frames);
+		if (packets > 0) {
+			record_pcm_tstamp(s, descs[packets - 1].cycle);
+			update_timing_page(s, descs + packets - 1, pcm_frames);
+		}
+	}
+
+	if (shared_running)
+		process_shared_pcms(s, shared_pcms, shared_running, descs, packets);
+
+	elapsed = ktime_get_ns() - begin;
+	record_histogram(s->histogram.process_ns, ARRAY_SIZE(s->histogram.process_ns),
+			 min_t(u64, elapsed, UINT_MAX));
+
+	for (i = 0; i < packets; ++i)
+		data_blocks += descs[i].data_blocks;
+	WRITE_ONCE(s->histogram.process_total_ns, s->histogram.process_total_ns + elapsed);
+	WRITE_ONCE(s->histogram.data_blocks, s->histogram.data_blocks + data_blocks);
+
+	return period_elapsed;
+}
+
+// Fill the PCM frames for the cycles concealed in tx stream with silence. When the PCM substream
+// spanning several streams starts in the concealed cycles, just the frames for the cycles since
+// the start are filled. When it starts after them, nothing is filled.
+static bool conceal_pcm_frames(struct amdtp_stream *s, const struct pkt_desc *descs,
+			       unsigned int cycles, unsigned int frames, bool span_pending)
+{
+	struct snd_pcm_substream *pcm = READ_ONCE(s->pcm);
+	struct snd_pcm_runtime *runtime;
+	unsigned int ptr, count;
+
+	if (!pcm || READ_ONCE(s->pcm_span.pending))
+		return false;
+	runtime = pcm->runtime;
+
+	if (span_pending) {
+		unsigned int start_cycle = READ_ONCE(s->pcm_span.cycle);
+		unsigned int skip;
+
+		for (skip = 0; skip < cycles; ++skip) {
+			if (compare_ohci_cycle_count(descs[skip].cycle, start_cycle) >= 0)
+				break;
+		}
+		frames -= DIV_ROUND_CLOSEST(frames * skip, cycles);
+	}
+
+	frames = min_t(unsigned int, frames, runtime->buffer_size);
+	ptr = s->pcm_buffer_pointer;
+	count = frames;
+	while (count > 0) {
+		unsigned int len = min_t(unsigned int, count, runtime->buffer_size - ptr);
+
+		if (amdtp_pcm_is_planar(runtime)) {
+			unsigned int bytes = snd_pcm_format_physical_width(runtime->format) / 8;
+			unsigned int c;
+
+			for (c = 0; c < runtime->channels; ++c)
+				snd_pcm_format_set_silence(runtime->format,
+						amdtp_pcm_planar_sample(runtime, c, ptr, bytes),
+						len);
+		} else {
+			snd_pcm_format_set_silence(runtime->format,
+						   runtime->dma_area + frames_to_bytes(runtime, ptr),
+						   len * runtime->channels);
+		}
+
+		count -= len;
+		ptr += len;
+		if (ptr >= runtime->buffer_size)
+			ptr = 0;
+	}
+
+	return update_pcm_pointers(s, pcm, frames);
+}
+
+static void process_rx_packets(struct fw_iso_context *context, u32 tstamp, size_t header_length,
+			       void *header, void *private_data)
+{
+	struct amdtp_stream *s = private_data;
+	const struct amdtp_domain *d = s->domain;
+	const __be32 *ctx_header = header;
+	const unsigned int events_per_period = d->events_per_period;
+	unsigned int event_count = s->ctx_data.rx.event_count;
+	unsigned int queue_depth = s->ctx_data.rx.queue_depth;
+	unsigned int pkt_header_length;
+	unsigned int packets;
+	unsigned int count;
+	bool period_elapsed;
+	bool need_hw_irq;
+	int lag;
+	int i;
+
+	if (s->packet_index < 0)
+		return;
+
+	// Calculate the number of packets in buffer and check XRUN.
+	packets = header_length / sizeof(*ctx_header);
+
+	trace_amdtp_process_packets_enter(s, packets, false);
+
+	// The lag is required just in adaptive queue mode.
+	lag = record_callback_histograms(s, tstamp, packets, queue_depth < s->queue_size);
+
+	// The packets queued in the former callback are left for the cycles till the slack. When
+	// it is short, queue additional packets for the subsequent cycles.
+	count = packets;
+	if (packets > 0 && queue_depth < s->queue_size && lag >= 0) {
+		int slack = (int)queue_depth - (int)packets - lag;
+
+		if (slack < ADAPTIVE_QUEUE_MIN_SLACK) {
+			count += min_t(unsigned int, ADAPTIVE_QUEUE_MIN_SLACK * 2 - max(slack, 0),
+				       s->queue_size - queue_depth);
+			s->ctx_data.rx.queue_depth = queue_depth + count - packets;
+		}
+	}
+
+	pool_seq_descs(s, count);
+
+	generate_pkt_descs(s, ctx_header, packets, count);
+
+	// The PCM substream spanning several streams starts at the cycle after the packets queued
+	// by any of the streams. See amdtp_domain_streams_pcm_trigger().
+	if (count > 0)
+		WRITE_ONCE(s->next_cycle, increment_ohci_cycle_count(s->pkt_descs[count - 1].cycle, 1));
+
+	period_elapsed = process_ctx_payloads(s, s->pkt_descs, count);
+	count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_PACKETS, count);
+
+	if (!(s->flags & CIP_NO_HEADER))
+		pkt_header_length = IT_PKT_HEADER_SIZE_CIP;
+	else
+		pkt_header_length = 0;
+
+	if (s == d->irq_target) {
+		// At NO_PERIOD_WAKEUP mode, the packets for all IT/IR contexts are processed by
+		// the tasks of user process operating ALSA PCM character device by calling ioctl(2)
+		// with some requests, instead of scheduled hardware IRQ of an IT context.
+		struct snd_pcm_substream *pcm = READ_ONCE(s->pcm);
+		need_hw_irq = !pcm || !pcm->runtime->no_period_wakeup;
+	} else {
+		need_hw_irq = false;
+	}
+
+	for (i = 0; i < count; ++i) {
+		const struct pkt_desc *desc = s->pkt_descs + i;
+		// All of fields are filled by build_it_pkt_header() and queue_out_packet().
+		struct {
+			struct fw_iso_packet params;
+			__be32 header[CIP_HEADER_QUADLETS];
+		} template;
+		bool sched_irq = false;
+
+		build_it_pkt_header(s, desc->cycle, &template.params, pkt_header_length,
+				    desc->data_blocks, desc->data_block_counter,
+				    desc->syt, i);
+
+		if (s == s->domain->irq_target) {
+			event_count += desc->data_blocks;
+			if (event_count >= events_per_period) {
+				event_count -= events_per_period;
+				sched_irq = need_hw_irq;
+			}
+		}
+
+		if (queue_out_packet(s, &template.params, sched_irq) < 0) {
+			cancel_stream(s);
+			return;
+		}
+	}
+
+	s->ctx_data.rx.event_count = event_count;
+
+	trace_amdtp_process_packets_exit(s, count, period_elapsed);
+}
+
+static void skip_rx_packets(struct fw_iso_context *context, u32 tstamp, size_t header_length,
+			    void *header, void *private_data)
+{
+	struct amdtp_stream *s = private_data;
+	struct amdtp_domain *d = s->domain;
+	const __be32 *ctx_header = header;
+	unsigned int packets;
+	unsigned int cycle;
+	int i;
+
+	if (s->packet_index < 0)
+		return;
+
+	packets = header_length / sizeof(*ctx_header);
+
+	cycle = compute_ohci_it_cycle(ctx_header[packets - 1], s->ctx_data.rx.queue_depth);
+	s->next_cycle = increment_ohci_cycle_count(cycle, 1);
+
+	for (i = 0; i < packets; ++i) {
+		struct fw_iso_packet params = {
 			.header_length = 0,
 			.payload_length = 0,
 		};
@@ -1158,7 +2371,7 @@ static void process_rx_packets_intermediately(struct fw_iso_context *context, u3
 	struct amdtp_stream *s = private_data;
 	struct amdtp_domain *d = s->domain;
 	__be32 *ctx_header = header;
-	const unsigned int queue_size = s->queue_size;
+	const unsigned int queue_depth = s->ctx_data.rx.queue_depth;
 	unsigned int packets;
 	unsigned int offset;
 
@@ -1169,7 +2382,7 @@ static void process_rx_packets_intermediately(struct fw_iso_context *context, u3
 
 	offset = 0;
 	while (offset < packets) {
-		unsigned int cycle = compute_ohci_it_cycle(ctx_header[offset], queue_size);
+		unsigned int cycle = compute_ohci_it_cycle(ctx_header[offset], queue_depth);
 
 		if (compare_ohci_cycle_count(cycle, d->processing_cycle.rx_start) >= 0)
 			break;
@@ -1189,8 +2402,7 @@ static void process_rx_packets_intermediately(struct fw_iso_context *context, u3
 	}
 
 	if (offset < packets) {
-		s->ready_processing = true;
-		wake_up(&s->ready_wait);
+		signal_stream_ready(s);
 
 		process_rx_packets(context, tstamp, header_length, ctx_header, private_data);
 		if (amdtp_streaming_error(s))
@@ -1210,6 +2422,7 @@ static void process_tx_packets(struct fw_iso_context *context, u32 tstamp, size_
 	__be32 *ctx_header = header;
 	unsigned int packets;
 	unsigned int desc_count;
+	bool period_elapsed = false;
 	int i;
 	int err;
 
@@ -1219,17 +2432,45 @@ static void process_tx_packets(struct fw_iso_context *context, u32 tstamp, size_
 	// Calculate the number of packets in buffer and check XRUN.
 	packets = header_length / s->ctx_data.tx.ctx_header_size;
 
+	trace_amdtp_process_packets_enter(s, packets, false);
+
+	record_callback_histograms(s, tstamp, packets, false);
+	count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_PACKETS, packets);
+
 	desc_count = 0;
 	err = generate_device_pkt_descs(s, s->pkt_descs, ctx_header, packets, &desc_count);
 	if (err < 0) {
 		if (err != -EAGAIN) {
-			cancel_stream(s);
-			return;
+			if (!READ_ONCE(s->domain->resync) || packets == 0) {
+				cancel_stream(s);
+				return;
+			}
+			resync_tx_stream(s, ctx_header, packets);
 		}
 	} else {
 		struct amdtp_domain *d = s->domain;
 
-		process_ctx_payloads(s, s->pkt_descs, desc_count);
+		if (s->ctx_data.tx.conceal.cycles > 0) {
+			unsigned int cycles = s->ctx_data.tx.conceal.cycles;
+			unsigned int index = s->ctx_data.tx.conceal.index;
+			bool span_pending = READ_ONCE(s->pcm_span.pending);
+
+			// The pending start of spanning PCM substream is decided for the concealed
+			// cycles as well as the others.
+			period_elapsed = process_ctx_payloads(s, s->pkt_descs, index);
+			period_elapsed |= conceal_pcm_frames(s, s->pkt_descs + index - cycles, cycles,
+							     s->ctx_data.tx.conceal.frames,
+							     span_pending);
+			period_elapsed |= process_ctx_payloads(s, s->pkt_descs + index,
+							       desc_count - index);
+
+			// The events in the lost cycles are not measured.
+			reset_rate_dll(s);
+		} else {
+			period_elapsed = process_ctx_payloads(s, s->pkt_descs, desc_count);
+		}
+
+		update_rate_dll(s, s->pkt_descs, desc_count);
 
 		if (d->replay.enable)
 			cache_seq(s, s->pkt_descs, desc_count);
@@ -1243,6 +2484,8 @@ static void process_tx_packets(struct fw_iso_context *context, u32 tstamp, size_
 			return;
 		}
 	}
+
+	trace_amdtp_process_packets_exit(s, packets, period_elapsed);
 }
 
 static void drop_tx_packets(struct fw_iso_context *context, u32 tstamp, size_t header_length,
@@ -1313,8 +2556,7 @@ static void process_tx_packets_intermediately(struct fw_iso_context *context, u3
 	}
 
 	if (offset < packets) {
-		s->ready_processing = true;
-		wake_up(&s->ready_wait);
+		signal_stream_ready(s);
 
 		process_tx_packets(context, tstamp, header_length, ctx_header, s);
 		if (amdtp_streaming_error(s))
@@ -1412,26 +2654,24 @@ static void drop_tx_packets_initially(struct fw_iso_context *context, u32 tstamp
 				s->context->callback.sc = process_tx_packets_intermediately;
 			}
 
+			if (d->processing_cycle.aligned) {
+				if (compare_ohci_cycle_count(cycle,
+						d->processing_cycle.aligned_start) <= 0)
+					cycle = d->processing_cycle.aligned_start;
+				else
+					WRITE_ONCE(d->sync_start.missed, true);
+			}
+
 			d->processing_cycle.tx_start = cycle;
 		}
 	}
 }
 
-static void process_ctxs_in_domain(struct amdtp_domain *d)
+static void cancel_streams_in_domain(struct amdtp_domain *d)
 {
 	struct amdtp_stream *s;
 
-	list_for_each_entry(s, &d->streams, list) {
-		if (s != d->irq_target && amdtp_stream_running(s))
-			fw_iso_context_flush_completions(s->context);
-
-		if (amdtp_streaming_error(s))
-			goto error;
-	}
-
-	return;
-error:
-	if (amdtp_stream_running(d->irq_target))
+	if (d->irq_target && amdtp_stream_running(d->irq_target))
 		cancel_stream(d->irq_target);
 
 	list_for_each_entry(s, &d->streams, list) {
@@ -1440,35 +2680,18 @@ error:
 	}
 }
 
-static void irq_target_callback(struct fw_iso_context *context, u32 tstamp, size_t header_length,
-				void *header, void *private_data)
-{
-	struct amdtp_stream *s = private_data;
-	struct amdtp_domain *d = s->domain;
-
-	process_rx_packets(context, tstamp, header_length, header, private_data);
-	process_ctxs_in_domain(d);
-}
-
+static void amdtp_stream_first_callback(struct fw_iso_context *context,
+					u32 tstamp, size_t header_length,
+					void *header, void *private_data);
 static void irq_target_callback_intermediately(struct fw_iso_context *context, u32 tstamp,
-					size_t header_length, void *header, void *private_data)
-{
-	struct amdtp_stream *s = private_data;
-	struct amdtp_domain *d = s->domain;
+					size_t header_length, void *header, void *private_data);
 
-	process_rx_packets_intermediately(context, tstamp, header_length, header, private_data);
-	process_ctxs_in_domain(d);
-}
-
-static void irq_target_callback_skip(struct fw_iso_context *context, u32 tstamp,
-				     size_t header_length, void *header, void *private_data)
+// Decide the cycle count to begin processing content of packet in IT contexts. Return false when
+// any IT context is not ready yet.
+static bool decide_rx_start_cycle(struct amdtp_domain *d)
 {
-	struct amdtp_stream *s = private_data;
-	struct amdtp_domain *d = s->domain;
-	bool ready_to_start;
-
-	skip_rx_packets(context, tstamp, header_length, header, private_data);
-	process_ctxs_in_domain(d);
+	unsigned int cycle = UINT_MAX;
+	struct amdtp_stream *s;
 
 	if (d->replay.enable && !d->replay.on_the_fly) {
 		unsigned int rx_count = 0;
@@ -1485,544 +2708,3372 @@ static void irq_target_callback_skip(struct fw_iso_context *context, u32 tstamp,
 
 			tx = rx->ctx_data.rx.replay_target;
 			cached_cycles = calculate_cached_cycle_count(tx, 0);
-			if (cached_cycles > tx->ctx_data.tx.cache.size / 2)
+			if (rx->ctx_data.rx.profile || cached_cycles > tx->ctx_data.tx.cache.size / 2)
 				++rx_ready_count;
 		}
 
-		ready_to_start = (rx_count == rx_ready_count);
-	} else {
-		ready_to_start = true;
+		if (rx_count != rx_ready_count)
+			return false;
 	}
 
-	// Decide the cycle count to begin processing content of packet in IT contexts. All of IT
-	// contexts are expected to start and get callback when reaching here.
-	if (ready_to_start) {
-		unsigned int cycle = s->next_cycle;
-		list_for_each_entry(s, &d->streams, list) {
-			if (s->direction != AMDTP_OUT_STREAM)
-				continue;
+	// All of IT contexts in leader domain are expected to get callback when reaching here, while
+	// the contexts in follower domain may not get it yet.
+	list_for_each_entry(s, &d->streams, list) {
+		if (s->direction == AMDTP_OUT_STREAM &&
+		    s->context->callback.sc == amdtp_stream_first_callback)
+			return false;
+	}
 
-			if (compare_ohci_cycle_count(s->next_cycle, cycle) > 0)
-				cycle = s->next_cycle;
+	list_for_each_entry(s, &d->streams, list) {
+		if (s->direction != AMDTP_OUT_STREAM)
+			continue;
 
-			if (s == d->irq_target)
-				s->context->callback.sc = irq_target_callback_intermediately;
-			else
-				s->context->callback.sc = process_rx_packets_intermediately;
-		}
+		if (cycle == UINT_MAX || compare_ohci_cycle_count(s->next_cycle, cycle) > 0)
+			cycle = s->next_cycle;
+	}
 
-		d->processing_cycle.rx_start = cycle;
+	// The domain is not ready for the armed cycle when it is already passed.
+	if (d->processing_cycle.aligned) {
+		if (compare_ohci_cycle_count(cycle, d->processing_cycle.aligned_start) <= 0)
+			cycle = d->processing_cycle.aligned_start;
+		else
+			WRITE_ONCE(d->sync_start.missed, true);
 	}
-}
 
-// This is executed one time. For in-stream, first packet has come. For out-stream, prepared to
-// transmit first packet.
-static void amdtp_stream_first_callback(struct fw_iso_context *context,
-					u32 tstamp, size_t header_length,
-					void *header, void *private_data)
-{
-	struct amdtp_stream *s = private_data;
-	struct amdtp_domain *d = s->domain;
+	// The callbacks can run in the other context than the caller.
+	WRITE_ONCE(d->processing_cycle.rx_start, cycle);
+	smp_wmb();
+
+	// The PCM substream spanning several streams was started while the domain was suspended.
+	list_for_each_entry(s, &d->streams, list) {
+		if (READ_ONCE(s->pcm_span.pending) &&
+		    READ_ONCE(s->pcm_span.cycle) == PCM_SPAN_UNDECIDED)
+			WRITE_ONCE(s->pcm_span.cycle,
+				   increment_ohci_cycle_count(cycle, PCM_SPAN_MARGIN_CYCLES));
+	}
+
+	list_for_each_entry(s, &d->streams, list) {
+		if (s->direction != AMDTP_OUT_STREAM)
+			continue;
 
-	if (s->direction == AMDTP_IN_STREAM) {
-		context->callback.sc = drop_tx_packets_initially;
-	} else {
 		if (s == d->irq_target)
-			context->callback.sc = irq_target_callback_skip;
+			WRITE_ONCE(s->context->callback.sc, irq_target_callback_intermediately);
 		else
-			context->callback.sc = skip_rx_packets;
+			WRITE_ONCE(s->context->callback.sc, process_rx_packets_intermediately);
 	}
 
-	context->callback.sc(context, tstamp, header_length, header, s);
+	return true;
 }
 
-/**
- * amdtp_stream_start - start transferring packets
- * @s: the AMDTP stream to start
- * @channel: the isochronous channel on the bus
- * @speed: firewire speed code
- * @queue_size: The number of packets in the queue.
- * @idle_irq_interval: the interval to queue packet during initial state.
- *
- * The stream cannot be started until it has been configured with
- * amdtp_stream_set_parameters() and it must be started before any PCM or MIDI
- * device can be started.
- */
-static int amdtp_stream_start(struct amdtp_stream *s, int channel, int speed,
-			      unsigned int queue_size, unsigned int idle_irq_interval)
+static void mc_flush(struct amdtp_stream *s);
+
+// The stream suspended by the idle policy of domain has no isochronous context.
+static inline bool context_running(const struct amdtp_stream *s)
 {
-	bool is_irq_target = (s == s->domain->irq_target);
-	unsigned int ctx_header_size;
-	unsigned int max_ctx_payload_size;
-	enum dma_data_direction dir;
-	int type, tag, err;
+	return !IS_ERR(s->context);
+}
 
-	mutex_lock(&s->mutex);
+static void flush_stream_completions(struct amdtp_stream *s)
+{
+	if (s->mc)
+		mc_flush(s);
+	else
+		fw_iso_context_flush_completions(s->context);
+}
 
-	if (WARN_ON(amdtp_stream_running(s) ||
-		    (s->data_block_quadlets < 1))) {
-		err = -EBADFD;
-		goto err_unlock;
-	}
+// The isochronous contexts in follower domain are processed in the same callback of the IRQ target
+// in leader domain, therefore they are processed in lockstep.
+static void process_ctxs_in_follower(struct amdtp_domain *d)
+{
+	struct amdtp_stream *s;
 
-	if (s->direction == AMDTP_IN_STREAM) {
-		// NOTE: IT context should be used for constant IRQ.
-		if (is_irq_target) {
-			err = -EINVAL;
-			goto err_unlock;
-		}
+	list_for_each_entry(s, &d->streams, list) {
+		if (context_running(s))
+			flush_stream_completions(s);
 
-		s->data_block_counter = UINT_MAX;
-	} else {
-		s->data_block_counter = 0;
+		if (amdtp_streaming_error(s)) {
+			cancel_streams_in_domain(d);
+			return;
+		}
 	}
 
-	// initialize packet buffer.
-	if (s->direction == AMDTP_IN_STREAM) {
-		dir = DMA_FROM_DEVICE;
-		type = FW_ISO_CONTEXT_RECEIVE;
-		if (!(s->flags & CIP_NO_HEADER))
-			ctx_header_size = IR_CTX_HEADER_SIZE_CIP;
-		else
-			ctx_header_size = IR_CTX_HEADER_SIZE_NO_CIP;
-	} else {
-		dir = DMA_TO_DEVICE;
-		type = FW_ISO_CONTEXT_TRANSMIT;
-		ctx_header_size = 0;	// No effect for IT context.
-	}
-	max_ctx_payload_size = amdtp_stream_get_max_ctx_payload_size(s);
+	if (d->processing_cycle.rx_start_pending && decide_rx_start_cycle(d))
+		d->processing_cycle.rx_start_pending = false;
+}
 
-	err = iso_packets_buffer_init(&s->buffer, s->unit, queue_size, max_ctx_payload_size, dir);
-	if (err < 0)
-		goto err_unlock;
-	s->queue_size = queue_size;
+// The PCM substreams and the MIDI substreams for capture keep the domain active. The bytes for
+// MIDI playback are reported by amdtp_stream_mark_active() at the trigger.
+static bool domain_is_active(const struct amdtp_domain *d)
+{
+	const struct amdtp_stream *s;
 
-	s->context = fw_iso_context_create(fw_parent_device(s->unit)->card,
-					  type, channel, speed, ctx_header_size,
-					  amdtp_stream_first_callback, s);
-	if (IS_ERR(s->context)) {
-		err = PTR_ERR(s->context);
-		if (err == -EBUSY)
-			dev_err(&s->unit->device,
-				"no free stream on this controller\n");
-		goto err_buffer;
+	list_for_each_entry(s, &d->streams, list) {
+		const struct amdtp_shared_pcms *shared_pcms = smp_load_acquire(&s->shared_pcms);
+
+		if (READ_ONCE(s->pcm) || READ_ONCE(s->midi_inputs))
+			return true;
+		if (shared_pcms && READ_ONCE(shared_pcms->running))
+			return true;
 	}
 
-	amdtp_stream_update(s);
+	return false;
+}
 
-	if (s->direction == AMDTP_IN_STREAM) {
-		s->ctx_data.tx.max_ctx_payload_length = max_ctx_payload_size;
-		s->ctx_data.tx.ctx_header_size = ctx_header_size;
-		s->ctx_data.tx.event_starts = false;
+static void check_domain_idle(struct amdtp_domain *d)
+{
+	unsigned int timeout = READ_ONCE(d->idle.timeout);
 
-		if (s->domain->replay.enable) {
-			// struct fw_iso_context.drop_overflow_headers is false therefore it's
-			// possible to cache much unexpectedly.
-			s->ctx_data.tx.cache.size = max_t(unsigned int, s->syt_interval * 2,
-							  queue_size * 3 / 2);
-			s->ctx_data.tx.cache.tail = 0;
-			s->ctx_data.tx.cache.descs = kcalloc(s->ctx_data.tx.cache.size,
-						sizeof(*s->ctx_data.tx.cache.descs), GFP_KERNEL);
-			if (!s->ctx_data.tx.cache.descs) {
-				err = -ENOMEM;
-				goto err_context;
-			}
-		}
-	} else {
-		static const struct {
-			unsigned int data_block;
-			unsigned int syt_offset;
-		} *entry, initial_state[] = {
-			[CIP_SFC_32000]  = {  4, 3072 },
-			[CIP_SFC_48000]  = {  6, 1024 },
-			[CIP_SFC_96000]  = { 12, 1024 },
-			[CIP_SFC_192000] = { 24, 1024 },
-			[CIP_SFC_44100]  = {  0,   67 },
-			[CIP_SFC_88200]  = {  0,   67 },
-			[CIP_SFC_176400] = {  0,   67 },
-		};
+	if (timeout == 0)
+		return;
 
-		s->ctx_data.rx.seq.descs = kcalloc(queue_size, sizeof(*s->ctx_data.rx.seq.descs), GFP_KERNEL);
-		if (!s->ctx_data.rx.seq.descs) {
-			err = -ENOMEM;
-			goto err_context;
-		}
-		s->ctx_data.rx.seq.size = queue_size;
-		s->ctx_data.rx.seq.tail = 0;
-		s->ctx_data.rx.seq.head = 0;
+	if (domain_is_active(d))
+		WRITE_ONCE(d->idle.last_active, jiffies);
+	else if (time_after(jiffies, READ_ONCE(d->idle.last_active) + timeout * HZ))
+		schedule_work(&d->idle.work);
+}
 
-		entry = &initial_state[s->sfc];
-		s->ctx_data.rx.data_block_state = entry->data_block;
-		s->ctx_data.rx.syt_offset_state = entry->syt_offset;
-		s->ctx_data.rx.last_syt_offset = TICKS_PER_CYCLE;
+static void __process_ctxs_in_domain(struct amdtp_domain *d)
+{
+	struct amdtp_domain *follower;
+	struct amdtp_stream *s;
 
-		s->ctx_data.rx.event_count = 0;
-	}
+	list_for_each_entry(s, &d->streams, list) {
+		if (s != d->irq_target && context_running(s))
+			flush_stream_completions(s);
 
-	if (s->flags & CIP_NO_HEADER)
-		s->tag = TAG_NO_CIP_HEADER;
-	else
-		s->tag = TAG_CIP;
+		if (amdtp_streaming_error(s))
+			goto error;
+	}
 
-	s->pkt_descs = kcalloc(s->queue_size, sizeof(*s->pkt_descs),
-			       GFP_KERNEL);
-	if (!s->pkt_descs) {
-		err = -ENOMEM;
-		goto err_context;
+	rcu_read_lock();
+	list_for_each_entry_rcu(follower, &d->group.followers, group.list) {
+		if (smp_load_acquire(&follower->group.active))
+			process_ctxs_in_follower(follower);
 	}
+	rcu_read_unlock();
 
-	s->packet_index = 0;
-	do {
-		struct fw_iso_packet params;
+	if (d->processing_cycle.rx_start_pending && decide_rx_start_cycle(d))
+		d->processing_cycle.rx_start_pending = false;
 
-		if (s->direction == AMDTP_IN_STREAM) {
-			err = queue_in_packet(s, &params);
-		} else {
-			bool sched_irq = false;
+	check_domain_idle(d);
 
-			params.header_length = 0;
-			params.payload_length = 0;
+	return;
+error:
+	cancel_streams_in_domain(d);
 
-			if (is_irq_target) {
-				sched_irq = !((s->packet_index + 1) %
-					      idle_irq_interval);
-			}
+	rcu_read_lock();
+	list_for_each_entry_rcu(follower, &d->group.followers, group.list) {
+		if (smp_load_acquire(&follower->group.active))
+			cancel_streams_in_domain(follower);
+	}
+	rcu_read_unlock();
+}
 
-			err = queue_out_packet(s, &params, sched_irq);
-		}
-		if (err < 0)
-			goto err_pkt_descs;
-	} while (s->packet_index > 0);
+static void process_ctxs_in_domain(struct amdtp_domain *d)
+{
+	// Just signal to the kernel thread.
+	if (READ_ONCE(d->kthread.task)) {
+		trace_amdtp_process_ctxs_enter(d, true);
+		WRITE_ONCE(d->kthread.pending, true);
+		wake_up(&d->kthread.wait);
+		trace_amdtp_process_ctxs_exit(d, true);
+		return;
+	}
 
-	/* NOTE: TAG1 matches CIP. This just affects in stream. */
-	tag = FW_ISO_CONTEXT_MATCH_TAG1;
-	if ((s->flags & CIP_EMPTY_WITH_TAG0) || (s->flags & CIP_NO_HEADER))
-		tag |= FW_ISO_CONTEXT_MATCH_TAG0;
+	trace_amdtp_process_ctxs_enter(d, false);
+	__process_ctxs_in_domain(d);
+	trace_amdtp_process_ctxs_exit(d, false);
+}
 
-	s->ready_processing = false;
-	err = fw_iso_context_start(s->context, -1, 0, tag);
-	if (err < 0)
-		goto err_pkt_descs;
+// The isochronous contexts are processed with disabled software IRQ, like the tasklet for 1394
+// OHCI. It's safe to call snd_pcm_period_elapsed() and to abort PCM substream in the context.
+static int domain_kthread(void *data)
+{
+	struct amdtp_domain *d = data;
 
-	mutex_unlock(&s->mutex);
+	while (true) {
+		wait_event_interruptible(d->kthread.wait,
+					 READ_ONCE(d->kthread.pending) || kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+		WRITE_ONCE(d->kthread.pending, false);
+
+		mutex_lock(&d->kthread.mutex);
+		local_bh_disable();
+		trace_amdtp_process_ctxs_enter(d, false);
+		begin_domain_pass(d);
+		__process_ctxs_in_domain(d);
+		end_domain_pass(d);
+		trace_amdtp_process_ctxs_exit(d, false);
+		local_bh_enable();
+		mutex_unlock(&d->kthread.mutex);
+	}
 
 	return 0;
-err_pkt_descs:
-	kfree(s->pkt_descs);
-err_context:
-	if (s->direction == AMDTP_OUT_STREAM) {
-		kfree(s->ctx_data.rx.seq.descs);
-	} else {
-		if (s->domain->replay.enable)
-			kfree(s->ctx_data.tx.cache.descs);
+}
+
+static int start_domain_kthread(struct amdtp_domain *d)
+{
+	int cpu = READ_ONCE(d->kthread.cpu);
+	struct sched_attr attr = {
+		.sched_policy = SCHED_FIFO,
+		.sched_priority = READ_ONCE(d->kthread.priority),
+	};
+	struct task_struct *task;
+	int err;
+
+	task = kthread_create(domain_kthread, d, "amdtp-domain");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	if (cpu >= 0 && cpu_online(cpu))
+		kthread_bind(task, cpu);
+
+	err = sched_setattr_nocheck(task, &attr);
+	if (err < 0) {
+		kthread_stop(task);
+		return err;
 	}
-	fw_iso_context_destroy(s->context);
-	s->context = ERR_PTR(-1);
-err_buffer:
-	iso_packets_buffer_destroy(&s->buffer, s->unit);
-err_unlock:
-	mutex_unlock(&s->mutex);
 
-	return err;
+	d->kthread.pending = false;
+	WRITE_ONCE(d->kthread.task, task);
+	wake_up_process(task);
+
+	return 0;
 }
 
-/**
- * amdtp_domain_stream_pcm_pointer - get the PCM buffer position
- * @d: the AMDTP domain.
- * @s: the AMDTP stream that transports the PCM data
- *
- * Returns the current buffer position, in frames.
- */
-unsigned long amdtp_domain_stream_pcm_pointer(struct amdtp_domain *d,
-					      struct amdtp_stream *s)
+static void stop_domain_kthread(struct amdtp_domain *d)
 {
-	struct amdtp_stream *irq_target = d->irq_target;
+	struct task_struct *task = d->kthread.task;
 
-	// Process isochronous packets queued till recent isochronous cycle to handle PCM frames.
-	if (irq_target && amdtp_stream_running(irq_target)) {
-		// In software IRQ context, the call causes dead-lock to disable the tasklet
-		// synchronously.
-		if (!in_softirq())
-			fw_iso_context_flush_completions(irq_target->context);
+	if (task) {
+		WRITE_ONCE(d->kthread.task, NULL);
+		kthread_stop(task);
 	}
-
-	return READ_ONCE(s->pcm_buffer_pointer);
 }
-EXPORT_SYMBOL_GPL(amdtp_domain_stream_pcm_pointer);
 
-/**
- * amdtp_domain_stream_pcm_ack - acknowledge queued PCM frames
- * @d: the AMDTP domain.
- * @s: the AMDTP stream that transfers the PCM frames
- *
- * Returns zero always.
- */
-int amdtp_domain_stream_pcm_ack(struct amdtp_domain *d, struct amdtp_stream *s)
+// The callback runs in software IRQ context, like the tasklet of 1394 OHCI.
+static enum hrtimer_restart domain_timer_callback(struct hrtimer *hrtimer)
 {
+	struct amdtp_domain *d = container_of(hrtimer, struct amdtp_domain, timer.hrtimer);
 	struct amdtp_stream *irq_target = d->irq_target;
+	struct snd_pcm_substream *pcm = READ_ONCE(irq_target->pcm);
 
-	// Process isochronous packets for recent isochronous cycle to handle
-	// queued PCM frames.
-	if (irq_target && amdtp_stream_running(irq_target))
+	// Unless at NO_PERIOD_WAKEUP mode, the hardware IRQ is scheduled.
+	if (pcm && pcm->runtime->no_period_wakeup && !amdtp_streaming_error(irq_target))
 		fw_iso_context_flush_completions(irq_target->context);
 
-	return 0;
+	hrtimer_forward_now(hrtimer, d->timer.interval);
+
+	return HRTIMER_RESTART;
+}
+
+static void irq_target_callback(struct fw_iso_context *context, u32 tstamp, size_t header_length,
+				void *header, void *private_data)
+{
+	struct amdtp_stream *s = private_data;
+	struct amdtp_domain *d = s->domain;
+	unsigned int packets = header_length / sizeof(__be32);
+
+	trace_amdtp_irq_target_enter(s, packets);
+	begin_domain_pass(d);
+	process_rx_packets(context, tstamp, header_length, header, private_data);
+	process_ctxs_in_domain(d);
+	end_domain_pass(d);
+	trace_amdtp_irq_target_exit(s, packets);
+}
+
+static void irq_target_callback_intermediately(struct fw_iso_context *context, u32 tstamp,
+					size_t header_length, void *header, void *private_data)
+{
+	struct amdtp_stream *s = private_data;
+	struct amdtp_domain *d = s->domain;
+	unsigned int packets = header_length / sizeof(__be32);
+
+	trace_amdtp_irq_target_enter(s, packets);
+	begin_domain_pass(d);
+	process_rx_packets_intermediately(context, tstamp, header_length, header, private_data);
+	process_ctxs_in_domain(d);
+	end_domain_pass(d);
+	trace_amdtp_irq_target_exit(s, packets);
+}
+
+static void irq_target_callback_skip(struct fw_iso_context *context, u32 tstamp,
+				     size_t header_length, void *header, void *private_data)
+{
+	struct amdtp_stream *s = private_data;
+	struct amdtp_domain *d = s->domain;
+	unsigned int packets = header_length / sizeof(__be32);
+
+	trace_amdtp_irq_target_enter(s, packets);
+	begin_domain_pass(d);
+	skip_rx_packets(context, tstamp, header_length, header, private_data);
+	process_ctxs_in_domain(d);
+	end_domain_pass(d);
+	trace_amdtp_irq_target_exit(s, packets);
+}
+
+// This is executed one time. For in-stream, first packet has come. For out-stream, prepared to
+// transmit first packet.
+static void amdtp_stream_first_callback(struct fw_iso_context *context,
+					u32 tstamp, size_t header_length,
+					void *header, void *private_data)
+{
+	struct amdtp_stream *s = private_data;
+	struct amdtp_domain *d = s->domain;
+
+	if (s->direction == AMDTP_IN_STREAM) {
+		context->callback.sc = drop_tx_packets_initially;
+	} else {
+		if (s == d->irq_target)
+			context->callback.sc = irq_target_callback_skip;
+		else
+			context->callback.sc = skip_rx_packets;
+	}
+
+	context->callback.sc(context, tstamp, header_length, header, s);
+}
+
+// In multichannel mode, the IR streams on the same controller share one IR context of buffer-fill
+// mode, since 1394 OHCI controllers have a few IR contexts. Each packet in the buffer consists of
+// the isochronous header, the payload, and the trailer with the timestamp, in the order of
+// arrival. The receiver demultiplexes the packets by channel into the buffer and the context
+// headers of each stream. The stream is processed by its own domain, which calls the callback of
+// the stream with the headers as if it had own context, thus the streams of the other domains and
+// cards on the same controller are left to their own domains.
+#define MC_BUFFER_PAGES		64
+#define MC_BUFFER_SIZE		(MC_BUFFER_PAGES * PAGE_SIZE)
+
+struct amdtp_mc_receiver {
+	struct list_head list;
+	struct fw_card *card;
+	struct fw_iso_context *context;
+	struct fw_iso_buffer buffer;
+	bool started;
+
+	u64 channels;
+	struct amdtp_stream *streams[64];
+	unsigned int count;
+
+	// The offset in the buffer to parse next, and the page to be queued again next.
+	unsigned int offset;
+	unsigned int requeue_page;
+	spinlock_t lock;
+};
+
+// Serialize the operations for the list of receivers.
+static DEFINE_MUTEX(mc_receivers_mutex);
+static LIST_HEAD(mc_receivers);
+
+static void mc_read(const struct amdtp_mc_receiver *rcv, unsigned int offset, void *dst,
+		    unsigned int length)
+{
+	while (length > 0) {
+		unsigned int page = offset / PAGE_SIZE;
+		unsigned int pos = offset % PAGE_SIZE;
+		unsigned int count = min_t(unsigned int, length, PAGE_SIZE - pos);
+
+		memcpy(dst, page_address(rcv->buffer.pages[page]) + pos, count);
+		dst += count;
+		length -= count;
+		offset = (offset + count) % MC_BUFFER_SIZE;
+	}
+}
+
+static int mc_queue_page(struct amdtp_mc_receiver *rcv, unsigned int page)
+{
+	struct fw_iso_packet params = {
+		.payload_length = PAGE_SIZE,
+		.interrupt = 1,
+	};
+
+	return fw_iso_context_queue(rcv->context, &params, &rcv->buffer, page * PAGE_SIZE);
+}
+
+static void mc_dispatch(struct amdtp_stream *s)
+{
+	unsigned int header_length = s->mc_count * s->ctx_data.tx.ctx_header_size;
+
+	if (s->mc_count == 0)
+		return;
+	s->mc_count = 0;
+
+	if (s->packet_index >= 0)
+		s->context->callback.sc(s->context, s->mc_tstamp, header_length, s->mc_headers, s);
+}
+
+static void mc_deliver(struct amdtp_mc_receiver *rcv, struct amdtp_stream *s, u32 header,
+		       unsigned int offset, u32 tstamp)
+{
+	unsigned int header_quadlets = s->ctx_data.tx.ctx_header_size / sizeof(__be32);
+	unsigned int cip_size = (header_quadlets - IR_CTX_HEADER_DEFAULT_QUADLETS) * sizeof(__be32);
+	unsigned int length = header >> ISO_DATA_LENGTH_SHIFT;
+	__be32 *ctx_header = s->mc_headers + s->mc_count * header_quadlets;
+	unsigned int index = (s->packet_index + s->mc_count) % s->queue_size;
+	unsigned int count;
+
+	// The domain does not process the stream in time. The packet is dropped like the one for
+	// the context without queued packets, then the discontinuity of cycle is detected.
+	if (s->mc_count >= s->queue_size)
+		return;
+
+	ctx_header[0] = cpu_to_be32(header);
+	ctx_header[1] = cpu_to_be32(tstamp);
+
+	count = min(length, cip_size);
+	memset(ctx_header + IR_CTX_HEADER_DEFAULT_QUADLETS, 0, cip_size);
+	mc_read(rcv, offset, ctx_header + IR_CTX_HEADER_DEFAULT_QUADLETS, count);
+
+	// The jumbo payload is detected by the context header.
+	if (length > count) {
+		mc_read(rcv, (offset + count) % MC_BUFFER_SIZE, s->buffer.packets[index].buffer,
+			min(length - count, s->ctx_data.tx.max_ctx_payload_length));
+	}
+
+	s->mc_tstamp = tstamp;
+	++s->mc_count;
+}
+
+// The completed address is the bus address for DMA in the page mapped one by one, thus converted
+// to the offset in the buffer, like fw_iso_buffer_lookup() which is not exported.
+static int mc_lookup_offset(const struct amdtp_mc_receiver *rcv, dma_addr_t completed)
+{
+	int i;
+
+	for (i = 0; i < rcv->buffer.page_count; ++i) {
+		dma_addr_t address = page_private(rcv->buffer.pages[i]);
+
+		if (address <= completed && completed < address + PAGE_SIZE)
+			return i * PAGE_SIZE + (completed - address);
+	}
+
+	// The end of page which is filled up.
+	for (i = 0; i < rcv->buffer.page_count; ++i) {
+		dma_addr_t address = page_private(rcv->buffer.pages[i]);
+
+		if (completed == address + PAGE_SIZE)
+			return ((i + 1) * PAGE_SIZE) % MC_BUFFER_SIZE;
+	}
+
+	return -EINVAL;
+}
+
+static void mc_receiver_callback(struct fw_iso_context *context, dma_addr_t completed,
+				 void *data)
+{
+	struct amdtp_mc_receiver *rcv = data;
+	unsigned int offset;
+	unsigned int end;
+	int pos;
+
+	pos = mc_lookup_offset(rcv, completed);
+	if (pos < 0)
+		return;
+	end = pos;
+
+	spin_lock(&rcv->lock);
+
+	offset = rcv->offset;
+	while (offset != end) {
+		unsigned int avail = (end + MC_BUFFER_SIZE - offset) % MC_BUFFER_SIZE;
+		unsigned int length, size;
+		__le32 quadlet;
+		u32 header, trailer;
+		struct amdtp_stream *s;
+
+		if (avail < sizeof(quadlet) * 2)
+			break;
+
+		mc_read(rcv, offset, &quadlet, sizeof(quadlet));
+		header = le32_to_cpu(quadlet);
+		length = header >> ISO_DATA_LENGTH_SHIFT;
+		size = sizeof(quadlet) + round_up(length, sizeof(quadlet)) + sizeof(quadlet);
+		if (avail < size)
+			break;
+
+		mc_read(rcv, (offset + size - sizeof(quadlet)) % MC_BUFFER_SIZE, &quadlet,
+			sizeof(quadlet));
+		trailer = le32_to_cpu(quadlet);
+
+		s = rcv->streams[(header >> 8) & 0x3f];
+		if (s) {
+			mc_deliver(rcv, s, header, (offset + sizeof(quadlet)) % MC_BUFFER_SIZE,
+				   trailer & HEADER_TSTAMP_MASK);
+		}
+
+		offset = (offset + size) % MC_BUFFER_SIZE;
+	}
+	rcv->offset = offset;
+
+	// The pages already parsed are available again.
+	while (rcv->requeue_page != offset / PAGE_SIZE) {
+		if (mc_queue_page(rcv, rcv->requeue_page) < 0)
+			break;
+		rcv->requeue_page = (rcv->requeue_page + 1) % MC_BUFFER_PAGES;
+	}
+	fw_iso_context_queue_flush(rcv->context);
+
+	spin_unlock(&rcv->lock);
+}
+
+// Demultiplex the packets available in the receiver, then process the ones for the stream only.
+static void mc_flush(struct amdtp_stream *s)
+{
+	struct amdtp_mc_receiver *rcv = s->mc;
+
+	fw_iso_context_flush_completions(rcv->context);
+
+	spin_lock_bh(&rcv->lock);
+	mc_dispatch(s);
+	spin_unlock_bh(&rcv->lock);
+}
+
+static void mc_receiver_destroy(struct amdtp_mc_receiver *rcv)
+{
+	if (rcv->started)
+		fw_iso_context_stop(rcv->context);
+	fw_iso_context_destroy(rcv->context);
+	fw_iso_buffer_destroy(&rcv->buffer, rcv->card);
+	kfree(rcv);
+}
+
+static struct amdtp_mc_receiver *mc_receiver_get(struct fw_card *card)
+{
+	struct amdtp_mc_receiver *rcv;
+	unsigned int i;
+	int err;
+
+	list_for_each_entry(rcv, &mc_receivers, list) {
+		if (rcv->card == card)
+			return rcv;
+	}
+
+	rcv = kzalloc(sizeof(*rcv), GFP_KERNEL);
+	if (!rcv)
+		return ERR_PTR(-ENOMEM);
+	rcv->card = card;
+	spin_lock_init(&rcv->lock);
+
+	err = fw_iso_buffer_init(&rcv->buffer, card, MC_BUFFER_PAGES, DMA_FROM_DEVICE);
+	if (err < 0)
+		goto err_free;
+
+	rcv->context = fw_iso_context_create(card, FW_ISO_CONTEXT_RECEIVE_MULTICHANNEL, 0, 0, 0,
+					     NULL, rcv);
+	if (IS_ERR(rcv->context)) {
+		err = PTR_ERR(rcv->context);
+		goto err_buffer;
+	}
+	rcv->context->callback.mc = mc_receiver_callback;
+
+	for (i = 0; i < MC_BUFFER_PAGES; ++i) {
+		err = mc_queue_page(rcv, i);
+		if (err < 0)
+			goto err_context;
+	}
+
+	list_add_tail(&rcv->list, &mc_receivers);
+
+	return rcv;
+err_context:
+	fw_iso_context_destroy(rcv->context);
+err_buffer:
+	fw_iso_buffer_destroy(&rcv->buffer, card);
+err_free:
+	kfree(rcv);
+	return ERR_PTR(err);
+}
+
+// The stub context keeps the callback of stream. Returns -EBUSY when the multichannel context is
+// not available in the controller, then the caller can fall back to the context of stream.
+static int mc_attach(struct amdtp_stream *s, int channel, unsigned int ctx_header_size)
+{
+	struct fw_card *card = fw_parent_device(s->unit)->card;
+	struct amdtp_mc_receiver *rcv;
+	struct fw_iso_context *stub;
+	int err;
+
+	stub = kzalloc(sizeof(*stub), GFP_KERNEL);
+	if (!stub)
+		return -ENOMEM;
+	stub->card = card;
+	stub->type = FW_ISO_CONTEXT_RECEIVE;
+	stub->channel = channel;
+	stub->header_size = ctx_header_size;
+	stub->callback.sc = amdtp_stream_first_callback;
+	stub->callback_data = s;
+
+	s->mc_headers = kcalloc_node(s->queue_size, ctx_header_size, GFP_KERNEL,
+				     snd_fw_unit_node(s->unit));
+	if (!s->mc_headers) {
+		err = -ENOMEM;
+		goto err_stub;
+	}
+	s->mc_count = 0;
+
+	mutex_lock(&mc_receivers_mutex);
+
+	rcv = mc_receiver_get(card);
+	if (IS_ERR(rcv)) {
+		err = PTR_ERR(rcv);
+		mutex_unlock(&mc_receivers_mutex);
+		goto err_headers;
+	}
+
+	if (rcv->channels & BIT_ULL(channel)) {
+		err = -EBUSY;
+		if (rcv->count == 0) {
+			list_del(&rcv->list);
+			mc_receiver_destroy(rcv);
+		}
+		mutex_unlock(&mc_receivers_mutex);
+		goto err_headers;
+	}
+	rcv->channels |= BIT_ULL(channel);
+	++rcv->count;
+
+	mutex_unlock(&mc_receivers_mutex);
+
+	s->mc = rcv;
+	s->context = stub;
+
+	return 0;
+err_headers:
+	kfree(s->mc_headers);
+	s->mc_headers = NULL;
+err_stub:
+	kfree(stub);
+	return err;
+}
+
+// The packets are delivered to the stream since the call.
+static int mc_start(struct amdtp_stream *s)
+{
+	struct amdtp_mc_receiver *rcv = s->mc;
+	u64 channels;
+	int err;
+
+	mutex_lock(&mc_receivers_mutex);
+
+	channels = rcv->channels;
+	err = fw_iso_context_set_channels(rcv->context, &channels);
+	if (err < 0)
+		goto end;
+
+	spin_lock_bh(&rcv->lock);
+	rcv->streams[s->context->channel] = s;
+	spin_unlock_bh(&rcv->lock);
+
+	if (!rcv->started) {
+		err = fw_iso_context_start(rcv->context, -1, 0, FW_ISO_CONTEXT_MATCH_ALL_TAGS);
+		if (err < 0) {
+			spin_lock_bh(&rcv->lock);
+			rcv->streams[s->context->channel] = NULL;
+			spin_unlock_bh(&rcv->lock);
+			goto end;
+		}
+		rcv->started = true;
+	}
+end:
+	mutex_unlock(&mc_receivers_mutex);
+
+	return err;
+}
+
+static void mc_detach(struct amdtp_stream *s)
+{
+	struct amdtp_mc_receiver *rcv = s->mc;
+	unsigned int channel = s->context->channel;
+
+	mutex_lock(&mc_receivers_mutex);
+
+	// No packet is delivered to the stream after it.
+	spin_lock_bh(&rcv->lock);
+	rcv->streams[channel] = NULL;
+	spin_unlock_bh(&rcv->lock);
+
+	rcv->channels &= ~BIT_ULL(channel);
+	if (--rcv->count == 0) {
+		list_del(&rcv->list);
+		mc_receiver_destroy(rcv);
+	} else {
+		u64 channels = rcv->channels;
+
+		fw_iso_context_set_channels(rcv->context, &channels);
+	}
+
+	mutex_unlock(&mc_receivers_mutex);
+
+	kfree(s->context);
+	s->context = ERR_PTR(-1);
+	kfree(s->mc_headers);
+	s->mc_headers = NULL;
+	s->mc = NULL;
+}
+
+// struct fw_iso_context.drop_overflow_headers is false therefore it's possible to cache much
+// unexpectedly. The size for the queue is the upper bound, and it is reduced to the size measured
+// in former session when all of the rx streams replaying the tx stream have it for the same size
+// of queue.
+static unsigned int decide_replay_cache_size(struct amdtp_stream *s, unsigned int queue_size)
+{
+	unsigned int min_size = s->syt_interval * 2;
+	unsigned int max_size = max(min_size, queue_size * 3 / 2);
+	unsigned int measured = 0;
+	struct amdtp_stream *rx;
+
+	list_for_each_entry(rx, &s->domain->streams, list) {
+		if (rx->direction != AMDTP_OUT_STREAM || rx->ctx_data.rx.replay_target != s)
+			continue;
+
+		if (rx->replay_cache.size == 0 || rx->replay_cache.queue_size != queue_size)
+			return max_size;
+		measured = max(measured, rx->replay_cache.size);
+	}
+
+	if (measured == 0)
+		return max_size;
+
+	return clamp(measured, min_size, max_size);
+}
+
+// The level of cached cycles is around the half of cache, where the rx stream starts replaying.
+// The size is twice the larger swing from the level with margin. When the cache is nearly
+// overrun or underrun, the measurement is discarded so that the next session uses the upper
+// bound.
+static void measure_replay_cache(struct amdtp_stream *s)
+{
+	const struct amdtp_stream *target = s->ctx_data.rx.replay_target;
+	unsigned int cache_size = target->ctx_data.tx.cache.size;
+	unsigned int peak = s->ctx_data.rx.cache_peak;
+	unsigned int trough = s->ctx_data.rx.cache_trough;
+	unsigned int level = cache_size / 2;
+	unsigned int swing;
+
+	// Not replayed in the session. The former measurement is kept.
+	if (peak == 0)
+		return;
+
+	s->replay_cache.size = 0;
+	if (peak + REPLAY_CACHE_MARGIN_CYCLES >= cache_size || trough == 0)
+		return;
+
+	swing = max(peak > level ? peak - level : 0, trough < level ? level - trough : 0);
+
+	s->replay_cache.queue_size = target->queue_size;
+	s->replay_cache.size = 2 * (swing + REPLAY_CACHE_MARGIN_CYCLES);
+}
+
+/**
+ * amdtp_stream_start - start transferring packets
+ * @s: the AMDTP stream to start
+ * @channel: the isochronous channel on the bus
+ * @speed: firewire speed code
+ * @queue_size: The number of packets in the queue.
+ * @queue_depth: The number of packets queued in advance for outgoing stream, up to @queue_size.
+ * @idle_irq_interval: the interval to queue packet during initial state.
+ *
+ * The stream cannot be started until it has been configured with
+ * amdtp_stream_set_parameters() and it must be started before any PCM or MIDI
+ * device can be started.
+ */
+static int amdtp_stream_start(struct amdtp_stream *s, int channel, int speed,
+			      unsigned int queue_size, unsigned int queue_depth,
+			      unsigned int idle_irq_interval)
+{
+	bool is_irq_target = (s == s->domain->irq_target);
+	unsigned int ctx_header_size;
+	unsigned int max_ctx_payload_size;
+	unsigned int cache_size;
+	enum dma_data_direction dir;
+	int type, tag, err;
+
+	mutex_lock(&s->mutex);
+
+	// The suspended stream is restarted with the kept resources.
+	if (WARN_ON(context_running(s) ||
+		    (s->data_block_quadlets < 1))) {
+		err = -EBADFD;
+		goto err_unlock;
+	}
+
+	if (s->direction == AMDTP_IN_STREAM) {
+		// NOTE: IT context should be used for constant IRQ.
+		if (is_irq_target) {
+			err = -EINVAL;
+			goto err_unlock;
+		}
+
+		s->data_block_counter = UINT_MAX;
+	} else {
+		s->data_block_counter = 0;
+	}
+
+	// initialize packet buffer.
+	if (s->direction == AMDTP_IN_STREAM) {
+		dir = DMA_FROM_DEVICE;
+		type = FW_ISO_CONTEXT_RECEIVE;
+		if (!(s->flags & CIP_NO_HEADER))
+			ctx_header_size = IR_CTX_HEADER_SIZE_CIP;
+		else
+			ctx_header_size = IR_CTX_HEADER_SIZE_NO_CIP;
+	} else {
+		dir = DMA_TO_DEVICE;
+		type = FW_ISO_CONTEXT_TRANSMIT;
+		ctx_header_size = 0;	// No effect for IT context.
+	}
+	max_ctx_payload_size = amdtp_stream_get_max_ctx_payload_size(s);
+
+	if (s->direction == AMDTP_IN_STREAM && s->domain->replay.enable)
+		cache_size = decide_replay_cache_size(s, queue_size);
+	else
+		cache_size = 0;
+
+	err = prepare_resources(s, queue_size, max_ctx_payload_size, cache_size, dir);
+	if (err < 0)
+		goto err_unlock;
+	s->queue_size = queue_size;
+
+	if (s->direction == AMDTP_IN_STREAM && READ_ONCE(multichannel_ir)) {
+		err = mc_attach(s, channel, ctx_header_size);
+		if (err < 0 && err != -EBUSY)
+			goto err_buffer;
+	}
+
+	if (!s->mc) {
+		s->context = fw_iso_context_create(fw_parent_device(s->unit)->card,
+						  type, channel, speed, ctx_header_size,
+						  amdtp_stream_first_callback, s);
+		if (IS_ERR(s->context)) {
+			err = PTR_ERR(s->context);
+			if (err == -EBUSY)
+				dev_err(&s->unit->device,
+					"no free stream on this controller\n");
+			goto err_buffer;
+		}
+	}
+
+	amdtp_stream_update(s);
+
+	if (s->direction == AMDTP_IN_STREAM) {
+		s->ctx_data.tx.max_ctx_payload_length = max_ctx_payload_size;
+		s->ctx_data.tx.ctx_header_size = ctx_header_size;
+		s->ctx_data.tx.event_starts = false;
+		reset_rate_dll(s);
+
+		if (s->domain->replay.enable) {
+			s->ctx_data.tx.cache.size = cache_size;
+			s->ctx_data.tx.cache.tail = 0;
+
+			if (s->timing_profile) {
+				err = prepare_timing_profile(s);
+				if (err < 0)
+					goto err_context;
+			}
+		}
+	} else {
+		struct amdtp_stream *target = s->ctx_data.rx.replay_target;
+
+		s->ctx_data.rx.profile = NULL;
+		if (s->domain->replay.enable && !s->domain->replay.on_the_fly && target &&
+		    target->timing_profile && target->sfc == s->sfc) {
+			struct timing_profile_rate *rate = &target->timing_profile->rates[target->sfc];
+
+			// Paired with the store in record_timing_profile().
+			if (smp_load_acquire(&rate->valid)) {
+				s->ctx_data.rx.profile = rate->descs;
+				s->ctx_data.rx.profile_phase = 0;
+			}
+		}
+
+		s->ctx_data.rx.seq.size = queue_size;
+		s->ctx_data.rx.seq.tail = 0;
+		s->ctx_data.rx.seq.head = 0;
+
+		s->ctx_data.rx.seq_phase = 0;
+
+		s->ctx_data.rx.cache_peak = 0;
+		s->ctx_data.rx.cache_trough = UINT_MAX;
+
+		s->ctx_data.rx.event_count = 0;
+
+		s->ctx_data.rx.queue_depth = queue_depth;
+
+		// The format of data block can differ from the former session in warm mode.
+		memset(s->ctx_data.rx.pcm_silence, 0,
+		       queue_size * sizeof(*s->ctx_data.rx.pcm_silence));
+	}
+
+	if (s->flags & CIP_NO_HEADER)
+		s->tag = TAG_NO_CIP_HEADER;
+	else
+		s->tag = TAG_CIP;
+
+	s->packet_index = 0;
+	do {
+		struct fw_iso_packet params;
+
+		if (s->direction == AMDTP_IN_STREAM) {
+			err = queue_in_packet(s, &params);
+		} else {
+			bool sched_irq = false;
+
+			params.header_length = 0;
+			params.payload_length = 0;
+
+			if (is_irq_target) {
+				sched_irq = !((s->packet_index + 1) %
+					      idle_irq_interval);
+			}
+
+			err = queue_out_packet(s, &params, sched_irq);
+		}
+		if (err < 0)
+			goto err_context;
+	} while (s->packet_index > 0 &&
+		 (s->direction == AMDTP_IN_STREAM || s->packet_index < queue_depth));
+
+	/* NOTE: TAG1 matches CIP. This just affects in stream. */
+	tag = FW_ISO_CONTEXT_MATCH_TAG1;
+	if ((s->flags & CIP_EMPTY_WITH_TAG0) || (s->flags & CIP_NO_HEADER))
+		tag |= FW_ISO_CONTEXT_MATCH_TAG0;
+
+	memset(&s->histogram, 0, sizeof(s->histogram));
+
+	s->ready_processing = false;
+	if (s->mc)
+		err = mc_start(s);
+	else
+		err = fw_iso_context_start(s->context, -1, 0, tag);
+	if (err < 0)
+		goto err_context;
+
+	if (s->started)
+		count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_RESTARTS, 1);
+	s->started = true;
+	WRITE_ONCE(s->suspended, false);
+
+	mutex_unlock(&s->mutex);
+
+	return 0;
+err_context:
+	if (s->mc) {
+		mc_detach(s);
+	} else {
+		fw_iso_context_destroy(s->context);
+		s->context = ERR_PTR(-1);
+	}
+err_buffer:
+	release_resources(s);
+err_unlock:
+	mutex_unlock(&s->mutex);
+
+	return err;
+}
+
+// PipeWire and JACK ask the position several times in the same isochronous cycle. Flush the
+// context at most once in the cycle, else the call is just a read of the position.
+static void flush_irq_target_completions(struct amdtp_domain *d, struct amdtp_stream *irq_target)
+{
+	u64 now = ktime_get_ns();
+
+	if ((s64)(now - READ_ONCE(d->next_flush_ns)) < 0)
+		return;
+	WRITE_ONCE(d->next_flush_ns, now + FLUSH_INTERVAL_NS);
+
+	fw_iso_context_flush_completions(irq_target->context);
+}
+
+/**
+ * amdtp_domain_stream_pcm_pointer - get the PCM buffer position
+ * @d: the AMDTP domain.
+ * @s: the AMDTP stream that transports the PCM data
+ *
+ * Returns the current buffer position, in frames.
+ */
+unsigned long amdtp_domain_stream_pcm_pointer(struct amdtp_domain *d,
+					      struct amdtp_stream *s)
+{
+	struct amdtp_stream *irq_target = d->irq_target;
+
+	// Process isochronous packets queued till recent isochronous cycle to handle PCM frames.
+	if (irq_target && context_running(irq_target)) {
+		// In software IRQ context, the call causes dead-lock to disable the tasklet
+		// synchronously.
+		if (!in_softirq())
+			flush_irq_target_completions(d, irq_target);
+	}
+
+	return READ_ONCE(s->pcm_buffer_pointer);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_stream_pcm_pointer);
+
+/**
+ * amdtp_domain_stream_shared_pcm_pointer - get the buffer position of PCM substream sharing the
+ *					    stream
+ * @d: the AMDTP domain.
+ * @s: the AMDTP stream shared by the PCM substream
+ * @pcm: the PCM substream bound by amdtp_stream_add_shared_pcm()
+ *
+ * Returns the current buffer position, in frames.
+ */
+unsigned long amdtp_domain_stream_shared_pcm_pointer(struct amdtp_domain *d,
+						     struct amdtp_stream *s,
+						     struct snd_pcm_substream *pcm)
+{
+	struct amdtp_shared_pcm *shared = find_shared_pcm(s, pcm);
+	struct amdtp_stream *irq_target = d->irq_target;
+
+	if (!shared)
+		return SNDRV_PCM_POS_XRUN;
+
+	// Process isochronous packets queued till recent isochronous cycle to handle PCM frames.
+	if (irq_target && context_running(irq_target)) {
+		// In software IRQ context, the call causes dead-lock to disable the tasklet
+		// synchronously.
+		if (!in_softirq())
+			flush_irq_target_completions(d, irq_target);
+	}
+
+	return READ_ONCE(shared->buffer_pointer);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_stream_shared_pcm_pointer);
+
+/**
+ * amdtp_domain_streams_pcm_trigger - start/stop the PCM substream which spans several streams
+ * @d: the AMDTP domain.
+ * @streams: the array of AMDTP streams in the same direction, which transport the PCM data
+ * @count: the number of streams in the array
+ * @pcm: the PCM substream to be started, or %NULL to stop
+ *
+ * Each stream transfers the samples at its offset of channels in the PCM frame. All of the
+ * streams start handling the PCM frames at the same isochronous cycle in the future so that
+ * the channels are aligned in the PCM frame. The first stream notifies the elapse of period.
+ * This function should be called from the PCM device's .trigger callback, after
+ * amdtp_stream_pcm_prepare() for all of the streams.
+ */
+void amdtp_domain_streams_pcm_trigger(struct amdtp_domain *d, struct amdtp_stream *streams,
+				      unsigned int count, struct snd_pcm_substream *pcm)
+{
+	unsigned int margin;
+	unsigned int cycle;
+	unsigned int i;
+
+	if (count == 0)
+		return;
+
+	if (!pcm) {
+		for (i = 0; i < count; ++i)
+			WRITE_ONCE(streams[i].pcm, NULL);
+		return;
+	}
+
+	// The cycle should be beyond the packets processed by any callback in flight, which
+	// processes the packets for one period at most.
+	margin = PCM_SPAN_MARGIN_CYCLES;
+	if (d->events_per_period > 0)
+		margin += DIV_ROUND_UP(d->events_per_period * CYCLES_PER_SECOND,
+				       amdtp_rate_table[streams[0].sfc]);
+
+	// The cycle is decided at resuming the suspended domain, since the next cycle of streams is
+	// not available.
+	if (READ_ONCE(d->idle.suspended)) {
+		cycle = PCM_SPAN_UNDECIDED;
+	} else {
+		cycle = READ_ONCE(streams[0].next_cycle);
+		for (i = 1; i < count; ++i) {
+			unsigned int next_cycle = READ_ONCE(streams[i].next_cycle);
+
+			if (compare_ohci_cycle_count(next_cycle, cycle) > 0)
+				cycle = next_cycle;
+		}
+		cycle = increment_ohci_cycle_count(cycle, margin);
+	}
+
+	for (i = 0; i < count; ++i) {
+		struct amdtp_stream *s = streams + i;
+
+		s->pcm_span.cycle = cycle;
+		s->pcm_span.follower = (i > 0);
+		WRITE_ONCE(s->pcm_span.pending, true);
+		// Pairs with the read barrier in process_ctx_payloads().
+		smp_wmb();
+		WRITE_ONCE(s->pcm, pcm);
+	}
+
+	amdtp_stream_mark_active(streams);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_streams_pcm_trigger);
+
+/**
+ * amdtp_domain_streams_pcm_pointer - get the buffer position of PCM substream which spans
+ *				      several streams
+ * @d: the AMDTP domain.
+ * @streams: the array of AMDTP streams in the same direction, which transport the PCM data
+ * @count: the number of streams in the array
+ * @pcm: the PCM substream
+ *
+ * Returns the position of the stream most behind, in frames, since the PCM frames at the
+ * position and after are not processed by all of the streams yet.
+ */
+unsigned long amdtp_domain_streams_pcm_pointer(struct amdtp_domain *d,
+					       struct amdtp_stream *streams, unsigned int count,
+					       struct snd_pcm_substream *pcm)
+{
+	snd_pcm_uframes_t buffer_size = pcm->runtime->buffer_size;
+	snd_pcm_uframes_t pos;
+	unsigned int i;
+
+	pos = amdtp_domain_stream_pcm_pointer(d, streams);
+	if (pos == SNDRV_PCM_POS_XRUN)
+		return pos;
+
+	for (i = 1; i < count; ++i) {
+		snd_pcm_uframes_t ptr = READ_ONCE(streams[i].pcm_buffer_pointer);
+
+		if (ptr == SNDRV_PCM_POS_XRUN)
+			return ptr;
+
+		// The streams differ by the frames in a few packets, much less than the half of
+		// buffer.
+		if ((ptr + buffer_size - pos) % buffer_size > buffer_size / 2)
+			pos = ptr;
+	}
+
+	return pos;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_streams_pcm_pointer);
+
+/**
+ * amdtp_stream_pcm_get_time_info - get the audio timestamp of link type for PCM buffer position
+ * @s: the AMDTP stream that transports the PCM data
+ * @pcm: the PCM substream
+ * @system_ts: the system timestamp
+ * @audio_ts: the audio timestamp
+ * @audio_tstamp_config: the configuration of audio timestamp requested by the application
+ * @audio_tstamp_report: the report of audio timestamp
+ *
+ * This function is for .get_time_info callback of PCM substream. The audio timestamp is the time
+ * of isochronous cycles elapsed till the packet which carries the frame at the PCM buffer
+ * position. The system timestamp is corrected to be the time of the cycle by the value of
+ * CYCLE_TIME register. Returns zero always.
+ */
+int amdtp_stream_pcm_get_time_info(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+				   struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				   struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				   struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	const int modulus = OHCI_SECOND_MODULUS * TICKS_PER_SECOND;
+	unsigned int seq;
+	unsigned int cycle;
+	u64 elapsed_cycles;
+	bool valid;
+	u32 cycle_time;
+	int delta;
+
+	if (audio_tstamp_config->type_requested != SNDRV_PCM_AUDIO_TSTAMP_TYPE_LINK)
+		goto default_tstamp;
+
+	do {
+		seq = read_seqcount_begin(&s->pcm_tstamp.seq);
+		valid = s->pcm_tstamp.valid;
+		cycle = s->pcm_tstamp.cycle;
+		elapsed_cycles = s->pcm_tstamp.elapsed_cycles;
+	} while (read_seqcount_retry(&s->pcm_tstamp.seq, seq));
+
+	if (!valid)
+		goto default_tstamp;
+
+	if (fw_card_read_cycle_time(fw_parent_device(s->unit)->card, &cycle_time) < 0)
+		goto default_tstamp;
+	snd_pcm_gettime(pcm->runtime, system_ts);
+
+	// The packet for outgoing stream is scheduled for the cycle later than the current one.
+	delta = compute_ohci_cycle_count_from_cycle_time(cycle_time) * TICKS_PER_CYCLE +
+		(cycle_time & 0x0fff) - cycle * TICKS_PER_CYCLE;
+	if (delta >= modulus / 2)
+		delta -= modulus;
+	else if (delta < -modulus / 2)
+		delta += modulus;
+
+	*system_ts = timespec64_sub(*system_ts,
+				    ns_to_timespec64(div_s64((s64)delta * NSEC_PER_SEC,
+							     TICKS_PER_SECOND)));
+	*audio_ts = ns_to_timespec64(elapsed_cycles * (NSEC_PER_SEC / CYCLES_PER_SECOND));
+
+	audio_tstamp_report->actual_type = SNDRV_PCM_AUDIO_TSTAMP_TYPE_LINK;
+	audio_tstamp_report->accuracy_report = 1;
+	audio_tstamp_report->accuracy = NSEC_PER_SEC / CYCLES_PER_SECOND;
+
+	return 0;
+default_tstamp:
+	audio_tstamp_report->actual_type = SNDRV_PCM_AUDIO_TSTAMP_TYPE_DEFAULT;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_pcm_get_time_info);
+
+/**
+ * amdtp_domain_stream_pcm_ack - acknowledge queued PCM frames
+ * @d: the AMDTP domain.
+ * @s: the AMDTP stream that transfers the PCM frames
+ *
+ * Returns zero always.
+ */
+int amdtp_domain_stream_pcm_ack(struct amdtp_domain *d, struct amdtp_stream *s)
+{
+	struct amdtp_stream *irq_target = d->irq_target;
+
+	// Process isochronous packets for recent isochronous cycle to handle
+	// queued PCM frames.
+	if (irq_target && context_running(irq_target))
+		flush_irq_target_completions(d, irq_target);
+
+	return 0;
 }
 EXPORT_SYMBOL_GPL(amdtp_domain_stream_pcm_ack);
 
-/**
- * amdtp_stream_update - update the stream after a bus reset
- * @s: the AMDTP stream
- */
-void amdtp_stream_update(struct amdtp_stream *s)
+/**
+ * amdtp_stream_get_rate_estimate - get the rate of events estimated for one of tx streams
+ * @streams: the array of AMDTP streams for incoming packets
+ * @count: the number of streams in the array
+ * @arg: the pointer to struct snd_firewire_stream_rate in userspace
+ *
+ * This function is for SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE of hwdep devices. Returns zero on
+ * success, or a negative error code.
+ */
+int amdtp_stream_get_rate_estimate(struct amdtp_stream *streams, unsigned int count,
+				   void __user *arg)
+{
+	struct snd_firewire_stream_rate rate;
+	struct amdtp_stream *s;
+
+	if (copy_from_user(&rate, arg, sizeof(rate)))
+		return -EFAULT;
+	if (rate.index >= count)
+		return -EINVAL;
+	s = streams + rate.index;
+
+	rate.flags = 0;
+	rate.nominal = 0;
+	rate.deviation = 0;
+
+	if (amdtp_stream_running(s)) {
+		// Paired with update_rate_dll().
+		unsigned int updates = smp_load_acquire(&s->ctx_data.tx.rate_dll.updates);
+
+		rate.nominal = amdtp_rate_table[s->sfc];
+		if (updates > 0)
+			rate.deviation = READ_ONCE(s->ctx_data.tx.rate_dll.deviation);
+		if (updates >= RATE_DLL_LOCK_UPDATES)
+			rate.flags |= SNDRV_FIREWIRE_STREAM_RATE_LOCKED;
+	}
+
+	if (copy_to_user(arg, &rate, sizeof(rate)))
+		return -EFAULT;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_get_rate_estimate);
+
+// The pages are allocated at the first call, and kept updated till the stream is destroyed.
+static int map_packets_page(struct amdtp_stream *s, struct vm_area_struct *area)
+{
+	struct snd_firewire_stream_packets_page *page;
+
+	if (area->vm_end - area->vm_start > PACKETS_PAGE_SIZE)
+		return -EINVAL;
+
+	page = s->packets_page;
+	if (!page) {
+		page = vmalloc_user(PACKETS_PAGE_SIZE);
+		if (!page)
+			return -ENOMEM;
+		// Paired with the acquire in update_packets_page().
+		smp_store_release(&s->packets_page, page);
+	}
+
+	return remap_vmalloc_range(area, page, 0);
+}
+
+// The pages for payload are available just while the stream keeps its resources. The mapping is
+// zapped by zap_packets_payload() when the stream releases them.
+static int map_packets_payload(struct amdtp_stream *s, struct vm_area_struct *area)
+{
+	unsigned long limit = (SNDRV_FIREWIRE_STREAM_PACKETS_WINDOW -
+			       SNDRV_FIREWIRE_STREAM_PACKETS_PAYLOAD_OFFSET) >> PAGE_SHIFT;
+	unsigned long pages = vma_pages(area);
+	unsigned long addr = area->vm_start;
+	struct inode *inode = file_inode(area->vm_file);
+	struct fw_iso_buffer *iso;
+	unsigned long i;
+	int err;
+
+	if (!s->resources.allocated)
+		return -ENXIO;
+	if (pages > s->buffer.page_count || pages > limit)
+		return -EINVAL;
+
+	// The mappings by any file of the hwdep device share the inode.
+	if (!s->payload_inode) {
+		ihold(inode);
+		s->payload_inode = inode;
+		s->payload_pgoff = area->vm_pgoff;
+	} else if (s->payload_inode != inode) {
+		return -EBUSY;
+	}
+
+	iso = iso_packets_buffer_iso(&s->buffer);
+	for (i = 0; i < pages; ++i) {
+		err = vm_insert_page(area, addr, iso->pages[s->buffer.page_base + i]);
+		if (err < 0)
+			return err;
+		addr += PAGE_SIZE;
+	}
+
+	return 0;
+}
+
+static int packets_mmap(struct amdtp_stream *const *streams, unsigned int count,
+			struct vm_area_struct *area)
+{
+	unsigned long base = SNDRV_FIREWIRE_STREAM_PACKETS_OFFSET >> PAGE_SHIFT;
+	unsigned long window = SNDRV_FIREWIRE_STREAM_PACKETS_WINDOW >> PAGE_SHIFT;
+	unsigned long offset = area->vm_pgoff - base;
+	struct amdtp_stream *s;
+	int err;
+
+	if (offset / window >= count)
+		return -EINVAL;
+	s = streams[offset / window];
+	if (!s || !s->protocol)
+		return -ENXIO;
+	if (area->vm_flags & VM_WRITE)
+		return -EPERM;
+	area->vm_flags &= ~VM_MAYWRITE;
+
+	offset %= window;
+
+	mutex_lock(&s->mutex);
+	if (offset == 0)
+		err = map_packets_page(s, area);
+	else if (offset == SNDRV_FIREWIRE_STREAM_PACKETS_PAYLOAD_OFFSET >> PAGE_SHIFT)
+		err = map_packets_payload(s, area);
+	else
+		err = -EINVAL;
+	mutex_unlock(&s->mutex);
+
+	return err;
+}
+
+/**
+ * amdtp_stream_timing_mmap - map the page for timing of stream to userspace
+ * @streams: the array of pointers to AMDTP streams of the unit
+ * @count: the number of entries in the array
+ * @area: the virtual memory area given to mmap operation of hwdep device
+ *
+ * The index of stream is given by the offset from SNDRV_FIREWIRE_STREAM_TIMING_PAGE_OFFSET in
+ * pages. The page is allocated at the first call, and kept updated till the stream is destroyed.
+ * The area from SNDRV_FIREWIRE_STREAM_PACKETS_OFFSET is for the descriptors and the payload of
+ * packets in the queue of stream, mapped in read-only as well.
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_stream_timing_mmap(struct amdtp_stream *const *streams, unsigned int count,
+			     struct vm_area_struct *area)
+{
+	unsigned long base = SNDRV_FIREWIRE_STREAM_TIMING_PAGE_OFFSET >> PAGE_SHIFT;
+	struct snd_firewire_stream_timing_page *page;
+	struct amdtp_stream *s;
+
+	if (area->vm_pgoff >= SNDRV_FIREWIRE_STREAM_PACKETS_OFFSET >> PAGE_SHIFT)
+		return packets_mmap(streams, count, area);
+
+	if (area->vm_pgoff < base || area->vm_pgoff - base >= count)
+		return -EINVAL;
+	s = streams[area->vm_pgoff - base];
+	if (!s || !s->protocol)
+		return -ENXIO;
+	if (area->vm_end - area->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	if (area->vm_flags & VM_WRITE)
+		return -EPERM;
+	area->vm_flags &= ~VM_MAYWRITE;
+
+	mutex_lock(&s->mutex);
+	page = s->timing_page;
+	if (!page) {
+		page = vmalloc_user(PAGE_SIZE);
+		if (!page) {
+			mutex_unlock(&s->mutex);
+			return -ENOMEM;
+		}
+		// Paired with the acquire in update_timing_page().
+		smp_store_release(&s->timing_page, page);
+	}
+	mutex_unlock(&s->mutex);
+
+	return remap_vmalloc_range(area, page, 0);
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_timing_mmap);
+
+/**
+ * amdtp_stream_update - update the stream after a bus reset
+ * @s: the AMDTP stream
+ */
+void amdtp_stream_update(struct amdtp_stream *s)
+{
+	unsigned int sid = (fw_parent_device(s->unit)->card->node_id << CIP_SID_SHIFT) &
+			   CIP_SID_MASK;
+
+	// Precompute the fields of CIP header except for data block counter and syt. Just the
+	// source node ID can change in the session due to bus reset.
+	WRITE_ONCE(s->cip_header_template[0],
+		   sid | (s->data_block_quadlets << CIP_DBS_SHIFT) |
+		   ((s->sph << CIP_SPH_SHIFT) & CIP_SPH_MASK));
+	if (s->direction == AMDTP_OUT_STREAM) {
+		s->cip_header_template[1] = CIP_EOH |
+				((s->fmt << CIP_FMT_SHIFT) & CIP_FMT_MASK) |
+				((s->ctx_data.rx.fdf << CIP_FDF_SHIFT) & CIP_FDF_MASK);
+	}
+}
+EXPORT_SYMBOL(amdtp_stream_update);
+
+static int counters_ctl_info(struct snd_kcontrol *kctl, struct snd_ctl_elem_info *einf)
+{
+	einf->type = SNDRV_CTL_ELEM_TYPE_INTEGER64;
+	einf->count = SNDRV_FIREWIRE_STREAM_COUNTER_COUNT;
+	einf->value.integer64.min = 0;
+	einf->value.integer64.max = LLONG_MAX;
+	einf->value.integer64.step = 0;
+
+	return 0;
+}
+
+static int counters_ctl_get(struct snd_kcontrol *kctl, struct snd_ctl_elem_value *elem_value)
+{
+	const struct amdtp_stream *s = kctl->private_data;
+	int i;
+
+	for (i = 0; i < SNDRV_FIREWIRE_STREAM_COUNTER_COUNT; ++i)
+		elem_value->value.integer64.value[i] = READ_ONCE(s->counters[i]);
+
+	return 0;
+}
+
+/**
+ * amdtp_stream_add_counters - add the control element for the counters of streaming events
+ * @s: the AMDTP stream
+ * @card: the sound card to which the control element is added
+ * @index: the index of control element, to distinguish streams in the same direction
+ *
+ * The control element is read-only, named "AMDTP In Stream Counters" or "AMDTP Out Stream
+ * Counters" in card interface, and has the values indexed by SNDRV_FIREWIRE_STREAM_COUNTER_XXX.
+ * The counters are kept across sessions since the call of amdtp_stream_init(). The stream should
+ * live as long as the card.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_stream_add_counters(struct amdtp_stream *s, struct snd_card *card, unsigned int index)
+{
+	struct snd_kcontrol_new template = {
+		.iface = SNDRV_CTL_ELEM_IFACE_CARD,
+		.index = index,
+		.access = SNDRV_CTL_ELEM_ACCESS_READ | SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info = counters_ctl_info,
+		.get = counters_ctl_get,
+	};
+
+	if (s->direction == AMDTP_IN_STREAM)
+		template.name = "AMDTP In Stream Counters";
+	else
+		template.name = "AMDTP Out Stream Counters";
+
+	return snd_ctl_add(card, snd_ctl_new1(&template, s));
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_add_counters);
+
+// The isochronous context is always destroyed since 1394 OHCI context keeps descriptors for the
+// packets unprocessed yet.
+static void stop_context(struct amdtp_stream *s)
+{
+	if (s->mc) {
+		mc_detach(s);
+	} else {
+		fw_iso_context_stop(s->context);
+		fw_iso_context_destroy(s->context);
+		s->context = ERR_PTR(-1);
+	}
+}
+
+/**
+ * amdtp_stream_stop - stop sending packets
+ * @s: the AMDTP stream to stop
+ *
+ * All PCM and MIDI devices of the stream must be stopped before the stream
+ * itself can be stopped.
+ */
+static void amdtp_stream_stop(struct amdtp_stream *s)
+{
+	mutex_lock(&s->mutex);
+
+	if (!amdtp_stream_running(s)) {
+		mutex_unlock(&s->mutex);
+		return;
+	}
+
+	if (s->suspended)
+		WRITE_ONCE(s->suspended, false);
+	else
+		stop_context(s);
+
+	if (s->direction == AMDTP_OUT_STREAM && s->domain->replay.enable &&
+	    s->ctx_data.rx.replay_target)
+		measure_replay_cache(s);
+
+	if (!READ_ONCE(s->domain->warm))
+		release_resources(s);
+
+	mutex_unlock(&s->mutex);
+}
+
+/**
+ * amdtp_stream_pcm_abort - abort the running PCM device
+ * @s: the AMDTP stream about to be stopped
+ *
+ * If the isochronous stream needs to be stopped asynchronously, call this
+ * function first to stop the PCM device.
+ */
+void amdtp_stream_pcm_abort(struct amdtp_stream *s)
+{
+	struct amdtp_shared_pcms *shared_pcms;
+	struct snd_pcm_substream *pcm;
+	unsigned long running;
+	int i;
+
+	pcm = READ_ONCE(s->pcm);
+	if (pcm)
+		snd_pcm_stop_xrun(pcm);
+
+	shared_pcms = smp_load_acquire(&s->shared_pcms);
+	if (!shared_pcms)
+		return;
+
+	running = READ_ONCE(shared_pcms->running);
+	for_each_set_bit(i, &running, AMDTP_STREAM_SHARED_PCMS) {
+		pcm = READ_ONCE(shared_pcms->entries[i].pcm);
+		if (pcm)
+			snd_pcm_stop_xrun(pcm);
+	}
+}
+EXPORT_SYMBOL(amdtp_stream_pcm_abort);
+
+/**
+ * amdtp_stream_add_shared_pcm - bind the PCM substream to the range of PCM channels in the stream
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream
+ * @channel_offset: the index of the first PCM channel in data block for the substream
+ * @channels: the number of PCM channels for the substream
+ *
+ * Several PCM substreams share the stream, each bound to the range of PCM channels which does not
+ * overlap the others. The samples of all of them are encoded or decoded in the same processing of
+ * packets. For outgoing packets, the samples of the range take precedence over the ones of the
+ * PCM substream attached by amdtp_stream_pcm_trigger(). The backend of data block format should
+ * support it. This function should be called from the PCM device's .hw_params callback, and can
+ * be called again to update the range.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_stream_add_shared_pcm(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+				unsigned int channel_offset, unsigned int channels)
+{
+	struct amdtp_shared_pcms *shared_pcms;
+	struct amdtp_shared_pcm *shared = NULL;
+	int err = 0;
+	int i;
+
+	if (!s->process_shared_pcm)
+		return -ENXIO;
+	if (channels == 0)
+		return -EINVAL;
+
+	mutex_lock(&s->mutex);
+
+	shared_pcms = s->shared_pcms;
+	if (!shared_pcms) {
+		shared_pcms = kzalloc(sizeof(*shared_pcms), GFP_KERNEL);
+		if (!shared_pcms) {
+			err = -ENOMEM;
+			goto end;
+		}
+		// Pairs with the acquire in the readers.
+		smp_store_release(&s->shared_pcms, shared_pcms);
+	}
+
+	for (i = 0; i < AMDTP_STREAM_SHARED_PCMS; ++i) {
+		struct amdtp_shared_pcm *entry = shared_pcms->entries + i;
+
+		if (entry->pcm == pcm) {
+			// The parameters are updated.
+			shared = entry;
+			continue;
+		}
+
+		if (!entry->pcm) {
+			if (!shared)
+				shared = entry;
+			continue;
+		}
+
+		if (channel_offset < entry->channel_offset + entry->channels &&
+		    entry->channel_offset < channel_offset + channels) {
+			err = -EBUSY;
+			goto end;
+		}
+	}
+
+	if (!shared) {
+		err = -EBUSY;
+		goto end;
+	}
+
+	shared->channel_offset = channel_offset;
+	shared->channels = channels;
+	shared->buffer_pointer = 0;
+	shared->period_pointer = 0;
+	WRITE_ONCE(shared->pcm, pcm);
+end:
+	mutex_unlock(&s->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_add_shared_pcm);
+
+/**
+ * amdtp_stream_remove_shared_pcm - unbind the PCM substream from the stream
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream bound by amdtp_stream_add_shared_pcm()
+ *
+ * This function should be called from the PCM device's .hw_free callback. Nothing happens when
+ * the substream is not bound.
+ */
+void amdtp_stream_remove_shared_pcm(struct amdtp_stream *s, struct snd_pcm_substream *pcm)
+{
+	struct amdtp_shared_pcm *shared;
+
+	mutex_lock(&s->mutex);
+
+	shared = find_shared_pcm(s, pcm);
+	if (shared) {
+		amdtp_stream_shared_pcm_trigger(s, pcm, false);
+		WRITE_ONCE(shared->pcm, NULL);
+	}
+
+	mutex_unlock(&s->mutex);
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_remove_shared_pcm);
+
+/**
+ * amdtp_stream_shared_pcm_prepare - prepare the PCM substream sharing the stream
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream bound by amdtp_stream_add_shared_pcm()
+ *
+ * This function should be called from the PCM device's .prepare callback.
+ */
+void amdtp_stream_shared_pcm_prepare(struct amdtp_stream *s, struct snd_pcm_substream *pcm)
+{
+	struct amdtp_shared_pcm *shared = find_shared_pcm(s, pcm);
+
+	if (shared) {
+		WRITE_ONCE(shared->buffer_pointer, 0);
+		shared->period_pointer = 0;
+	}
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_shared_pcm_prepare);
+
+/**
+ * amdtp_stream_shared_pcm_trigger - start/stop the PCM substream sharing the stream
+ * @s: the AMDTP stream
+ * @pcm: the PCM substream bound by amdtp_stream_add_shared_pcm()
+ * @running: whether to start or stop
+ *
+ * This function should be called from the PCM device's .trigger callback.
+ */
+void amdtp_stream_shared_pcm_trigger(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+				     bool running)
+{
+	struct amdtp_shared_pcm *shared = find_shared_pcm(s, pcm);
+	unsigned int index;
+
+	if (!shared)
+		return;
+	index = shared - s->shared_pcms->entries;
+
+	if (running) {
+		set_bit(index, &s->shared_pcms->running);
+		amdtp_stream_mark_active(s);
+	} else {
+		clear_bit(index, &s->shared_pcms->running);
+	}
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_shared_pcm_trigger);
+
+/**
+ * amdtp_stream_mark_active - report the activity of PCM or MIDI substream to the domain
+ * @s: the AMDTP stream
+ *
+ * The idle policy of domain counts the seconds since the last activity, and the domain suspended
+ * by the policy is resumed in process context. This function can be called in atomic context,
+ * such as the .trigger callback of PCM and rawmidi substreams.
+ */
+void amdtp_stream_mark_active(struct amdtp_stream *s)
+{
+	struct amdtp_domain *d = READ_ONCE(s->domain);
+
+	if (!d)
+		return;
+
+	WRITE_ONCE(d->idle.last_active, jiffies);
+	if (READ_ONCE(d->idle.suspended))
+		schedule_work(&d->idle.work);
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_mark_active);
+
+/**
+ * amdtp_stream_queue_midi_event - queue incoming MIDI bytes with timestamp
+ * @s: the AMDTP stream
+ * @desc: the descriptor of packet including the bytes
+ * @data_block: the index of data block including the bytes in the packet
+ * @port: the index of MIDI port
+ * @bytes: the MIDI bytes
+ * @length: the number of MIDI bytes, up to 4
+ *
+ * The timestamp consists of the isochronous cycle of the packet and the offset of data block
+ * in the cycle. The event is queued to the ring only while the ring is mapped by userspace
+ * and the optional stages are not shed, and the bytes should be delivered to rawmidi substream
+ * as well. This function is expected
+ * to be called in the process_ctx_payloads callback of the stream.
+ */
+void amdtp_stream_queue_midi_event(struct amdtp_stream *s, const struct pkt_desc *desc,
+				   unsigned int data_block, unsigned int port,
+				   const u8 *bytes, unsigned int length)
+{
+	struct snd_fw_event_ring *ring = s->midi_event_ring;
+	struct snd_firewire_event_midi_timestamp *event;
+
+	if (!ring || !snd_fw_event_ring_is_mapped(ring) || amdtp_stream_shedding(s))
+		return;
+
+	event = snd_fw_event_ring_reserve(ring, sizeof(*event));
+	if (!event)
+		return;
+
+	length = min_t(unsigned int, length, sizeof(event->bytes));
+
+	event->type = SNDRV_FIREWIRE_EVENT_MIDI_TIMESTAMP;
+	event->cycle = desc->cycle;
+	event->offset = data_block * TICKS_PER_CYCLE / desc->data_blocks;
+	event->port = port;
+	event->length = length;
+	memset(event->bytes, 0, sizeof(event->bytes));
+	memcpy(event->bytes, bytes, length);
+
+	snd_fw_event_ring_commit(ring, sizeof(*event));
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_queue_midi_event);
+
+/**
+ * amdtp_stream_midi_trigger - report the trigger of MIDI substream to the domain
+ * @s: the AMDTP stream
+ * @port: the index of MIDI port
+ * @running: whether the substream is running
+ *
+ * The running substream for capture keeps the domain active, since the bytes from the device are
+ * not available while the domain is suspended. The trigger of substream for playback is the
+ * activity of bytes written by userspace, and the isochronous context of IRQ target is flushed to
+ * transmit them without waiting for the next hardware IRQ. This function should be called from
+ * the .trigger callback of rawmidi substream.
+ */
+void amdtp_stream_midi_trigger(struct amdtp_stream *s, unsigned int port, bool running)
+{
+	struct amdtp_domain *d = READ_ONCE(s->domain);
+
+	if (s->direction == AMDTP_IN_STREAM) {
+		if (port >= BITS_PER_LONG)
+			return;
+
+		if (running)
+			set_bit(port, &s->midi_inputs);
+		else
+			clear_bit(port, &s->midi_inputs);
+	}
+
+	if (!running)
+		return;
+
+	amdtp_stream_mark_active(s);
+
+	// Process the completed packets now so that the kicked bytes are encoded into the packets
+	// queued next, instead of waiting for the hardware IRQ.
+	if (s->direction == AMDTP_OUT_STREAM && d && d->irq_target &&
+	    context_running(d->irq_target))
+		flush_irq_target_completions(d, d->irq_target);
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_midi_trigger);
+
+/**
+ * amdtp_midi_batch_fetch - fetch MIDI bytes for the batch of packets
+ * @batch: the batch
+ * @substream: the rawmidi substream to transmit, or %NULL
+ * @count: the maximum number of bytes transferred in the batch of packets
+ *
+ * The bytes are not consumed in the substream until amdtp_midi_batch_commit() is called.
+ */
+void amdtp_midi_batch_fetch(struct amdtp_midi_batch *batch,
+			    struct snd_rawmidi_substream *substream, unsigned int count)
+{
+	int len = 0;
+
+	batch->substream = substream;
+	batch->pos = 0;
+
+	if (substream) {
+		count = min_t(unsigned int, count, sizeof(batch->bytes));
+		len = snd_rawmidi_transmit_peek(substream, batch->bytes, count);
+	}
+
+	batch->len = max(len, 0);
+}
+EXPORT_SYMBOL_GPL(amdtp_midi_batch_fetch);
+
+/**
+ * amdtp_midi_batch_commit - consume MIDI bytes copied to packets in the batch
+ * @batch: the batch
+ */
+void amdtp_midi_batch_commit(struct amdtp_midi_batch *batch)
+{
+	if (batch->substream && batch->pos > 0)
+		snd_rawmidi_transmit_ack(batch->substream, batch->pos);
+	batch->substream = NULL;
+	batch->len = 0;
+	batch->pos = 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_midi_batch_commit);
+
+/**
+ * amdtp_midi_batch_deliver - deliver MIDI bytes accumulated in the batch of packets
+ * @batch: the batch
+ *
+ * The substream receives the bytes at once, thus the reader is woken up once for the batch.
+ */
+void amdtp_midi_batch_deliver(struct amdtp_midi_batch *batch)
+{
+	if (batch->substream && batch->len > 0)
+		snd_rawmidi_receive(batch->substream, batch->bytes, batch->len);
+	batch->substream = NULL;
+	batch->len = 0;
+	batch->pos = 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_midi_batch_deliver);
+
+static void dump_histogram(struct snd_info_buffer *buffer, const char *label,
+			   const unsigned long *histogram, unsigned int buckets)
+{
+	int i;
+
+	snd_iprintf(buffer, "  %s:\n", label);
+	for (i = 0; i < buckets; ++i) {
+		unsigned long count = READ_ONCE(histogram[i]);
+
+		if (count == 0)
+			continue;
+
+		if (i == 0)
+			snd_iprintf(buffer, "    %10u: %lu\n", 0, count);
+		else if (i < buckets - 1)
+			snd_iprintf(buffer, "    %10u: %lu\n", 1u << (i - 1), count);
+		else
+			snd_iprintf(buffer, "  >=%10u: %lu\n", 1u << (i - 1), count);
+	}
+}
+
+/**
+ * amdtp_stream_dump_histograms - dump the histograms for callback of isochronous context
+ * @s: the AMDTP stream
+ * @buffer: the buffer of proc node
+ *
+ * Each line shows the lower bound of bucket and the count of samples in the bucket, since the
+ * stream started lastly. This function is expected to be called by read operation of proc node.
+ */
+void amdtp_stream_dump_histograms(struct amdtp_stream *s, struct snd_info_buffer *buffer)
+{
+	u64 data_blocks;
+
+	dump_histogram(buffer, "cycle lag", s->histogram.cycle_lag,
+		       ARRAY_SIZE(s->histogram.cycle_lag));
+	dump_histogram(buffer, "packets per callback", s->histogram.packets,
+		       ARRAY_SIZE(s->histogram.packets));
+	dump_histogram(buffer, "nsec to process payloads", s->histogram.process_ns,
+		       ARRAY_SIZE(s->histogram.process_ns));
+
+	data_blocks = READ_ONCE(s->histogram.data_blocks);
+	if (data_blocks > 0) {
+		// In the unit of 1/1000 nanosecond.
+		u64 cost = div64_u64(READ_ONCE(s->histogram.process_total_ns) * 1000, data_blocks);
+		u32 rem;
+
+		cost = div_u64_rem(cost, 1000, &rem);
+		snd_iprintf(buffer, "  nsec per data block: %llu.%03u\n", cost, rem);
+	}
+
+	if (s->direction == AMDTP_OUT_STREAM && amdtp_stream_running(s))
+		snd_iprintf(buffer, "  queue depth: %u/%u\n", READ_ONCE(s->ctx_data.rx.queue_depth),
+			    s->queue_size);
+}
+EXPORT_SYMBOL_GPL(amdtp_stream_dump_histograms);
+
+static void domain_idle_work(struct work_struct *work);
+
+/**
+ * amdtp_domain_init - initialize an AMDTP domain structure
+ * @d: the AMDTP domain to initialize.
+ */
+int amdtp_domain_init(struct amdtp_domain *d)
+{
+	INIT_LIST_HEAD(&d->streams);
+
+	atomic_set(&d->ready.pending, 0);
+	d->ready.cancelled = false;
+	init_waitqueue_head(&d->ready.wait);
+
+	d->events_per_period = 0;
+	d->midi_interval_us = MIDI_INTERVAL_US_DEFAULT;
+
+	d->group.leader = NULL;
+	INIT_LIST_HEAD(&d->group.followers);
+	INIT_LIST_HEAD(&d->group.list);
+	d->group.active = false;
+
+	d->kthread.cpu = -1;
+	d->kthread.priority = 0;
+	d->kthread.task = NULL;
+	init_waitqueue_head(&d->kthread.wait);
+	mutex_init(&d->kthread.mutex);
+
+	d->warm = false;
+	d->idle.timeout = 0;
+	d->idle.last_active = jiffies;
+	d->idle.suspended = false;
+	INIT_WORK(&d->idle.work, domain_idle_work);
+	d->shedding.budget_ns = 0;
+	d->shedding.passes = 0;
+	d->shedding.begin_ns = 0;
+	d->resync = false;
+	d->conceal = false;
+	d->adaptive_queue = false;
+	d->coalesce_period = false;
+	spin_lock_init(&d->deferred_period.lock);
+	d->deferred_period.deferring = false;
+	d->deferred_period.count = 0;
+
+	d->timer.interval_us = 0;
+	hrtimer_init(&d->timer.hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	d->timer.hrtimer.function = domain_timer_callback;
+
+	iso_packets_pool_init(&d->packet_pools[AMDTP_OUT_STREAM]);
+	iso_packets_pool_init(&d->packet_pools[AMDTP_IN_STREAM]);
+
+	d->capture.ring = NULL;
+	spin_lock_init(&d->capture.lock);
+	d->capture.quadlets = 0;
+	mutex_init(&d->capture.mutex);
+	d->capture.opened = false;
+
+	d->processing_cycle.aligned = false;
+	d->sync_start.armed = false;
+	d->sync_start.missed = false;
+	spin_lock_init(&d->sync_start.lock);
+
+	d->monitor.state = NULL;
+	d->monitor.source = NULL;
+	d->monitor.sink = NULL;
+	spin_lock_init(&d->monitor.lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_init);
+
+// Serialize the operations for the group of domains.
+static DEFINE_MUTEX(domain_group_mutex);
+
+/**
+ * amdtp_domain_destroy - destroy an AMDTP domain structure
+ * @d: the AMDTP domain to destroy.
+ *
+ * The domain leaves the group of domains. When it is leader, the followers are released.
+ */
+void amdtp_domain_destroy(struct amdtp_domain *d)
+{
+	struct amdtp_domain *follower, *next;
+
+	cancel_work_sync(&d->idle.work);
+
+	mutex_lock(&domain_group_mutex);
+
+	if (d->group.leader) {
+		list_del_rcu(&d->group.list);
+		d->group.leader = NULL;
+	}
+
+	list_for_each_entry_safe(follower, next, &d->group.followers, group.list) {
+		list_del_rcu(&follower->group.list);
+		follower->group.leader = NULL;
+	}
+	INIT_LIST_HEAD(&d->group.followers);
+
+	// Wait for the IRQ target of leader domain to finish walking the list.
+	synchronize_rcu();
+
+	mutex_unlock(&domain_group_mutex);
+
+	// Some drivers destroy the streams after the domain. The memory is freed when the last
+	// stream releases its region.
+	iso_packets_pool_destroy(&d->packet_pools[AMDTP_OUT_STREAM]);
+	iso_packets_pool_destroy(&d->packet_pools[AMDTP_IN_STREAM]);
+
+	if (d->capture.ring) {
+		snd_fw_event_ring_destroy(d->capture.ring);
+		kfree(d->capture.ring);
+		d->capture.ring = NULL;
+	}
+
+	kvfree(d->monitor.state);
+	d->monitor.state = NULL;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_destroy);
+
+/**
+ * amdtp_domain_add_stream - register isoc context into the domain.
+ * @d: the AMDTP domain.
+ * @s: the AMDTP stream.
+ * @channel: the isochronous channel on the bus.
+ * @speed: firewire speed code.
+ */
+int amdtp_domain_add_stream(struct amdtp_domain *d, struct amdtp_stream *s,
+			    int channel, int speed)
+{
+	struct amdtp_stream *tmp;
+
+	list_for_each_entry(tmp, &d->streams, list) {
+		if (s == tmp)
+			return -EBUSY;
+	}
+
+	list_add(&s->list, &d->streams);
+
+	s->channel = channel;
+	s->speed = speed;
+	s->domain = d;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_add_stream);
+
+// Select the first IR and IT contexts of AM824 format as the endpoints of direct monitoring. The
+// captured data blocks in the former runtime are discarded.
+static void set_monitor_endpoints(struct amdtp_domain *d, bool enable)
+{
+	struct amdtp_stream *source = NULL;
+	struct amdtp_stream *sink = NULL;
+	struct amdtp_stream *s;
+
+	if (enable) {
+		list_for_each_entry(s, &d->streams, list) {
+			if (s->fmt != CIP_FMT_AM)
+				continue;
+			if (s->direction == AMDTP_IN_STREAM && !source)
+				source = s;
+			else if (s->direction == AMDTP_OUT_STREAM && !sink)
+				sink = s;
+		}
+	}
+
+	spin_lock_bh(&d->monitor.lock);
+	d->monitor.source = source;
+	d->monitor.sink = sink;
+	if (d->monitor.state) {
+		d->monitor.state->head = 0;
+		d->monitor.state->used = 0;
+	}
+	spin_unlock_bh(&d->monitor.lock);
+}
+
+// Make the reference from rx stream to tx stream for sequence replay. When the number of tx streams
+// is less than the number of rx streams, the first tx stream is selected.
+static int make_association(struct amdtp_domain *d)
+{
+	unsigned int dst_index = 0;
+	struct amdtp_stream *rx;
+
+	// Make association to replay target.
+	list_for_each_entry(rx, &d->streams, list) {
+		if (rx->direction == AMDTP_OUT_STREAM) {
+			unsigned int src_index = 0;
+			struct amdtp_stream *tx = NULL;
+			struct amdtp_stream *s;
+
+			list_for_each_entry(s, &d->streams, list) {
+				if (s->direction == AMDTP_IN_STREAM) {
+					if (dst_index == src_index) {
+						tx = s;
+						break;
+					}
+
+					++src_index;
+				}
+			}
+			if (!tx) {
+				// Select the first entry.
+				list_for_each_entry(s, &d->streams, list) {
+					if (s->direction == AMDTP_IN_STREAM) {
+						tx = s;
+						break;
+					}
+				}
+				// No target is available to replay sequence.
+				if (!tx)
+					return -EINVAL;
+			}
+
+			rx->ctx_data.rx.replay_target = tx;
+			rx->ctx_data.rx.cache_head = 0;
+
+			++dst_index;
+		}
+	}
+
+	return 0;
+}
+
+// Reserve the pool in each direction for the packet buffers of all streams in the domain. The
+// failure is not fatal since each stream falls back to own buffer.
+static void reserve_packet_pools(struct amdtp_domain *d, unsigned int queue_size)
+{
+	unsigned int pages[ARRAY_SIZE(d->packet_pools)] = { 0 };
+	struct fw_card *card = NULL;
+	struct amdtp_stream *s;
+	int i;
+
+	list_for_each_entry(s, &d->streams, list) {
+		enum dma_data_direction dir;
+
+		if (s->direction == AMDTP_IN_STREAM)
+			dir = DMA_FROM_DEVICE;
+		else
+			dir = DMA_TO_DEVICE;
+
+		pages[s->direction] += iso_packets_buffer_pages(queue_size,
+						amdtp_stream_get_max_ctx_payload_size(s), dir);
+		card = fw_parent_device(s->unit)->card;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(pages); ++i) {
+		enum dma_data_direction dir;
+
+		if (pages[i] == 0)
+			continue;
+
+		if (i == AMDTP_IN_STREAM)
+			dir = DMA_FROM_DEVICE;
+		else
+			dir = DMA_TO_DEVICE;
+
+		iso_packets_pool_reserve(&d->packet_pools[i], card, pages[i], dir);
+	}
+}
+
+static int start_domain(struct amdtp_domain *d, unsigned int tx_init_skip_cycles, bool replay_seq,
+			bool replay_on_the_fly)
+{
+	unsigned int events_per_buffer = d->events_per_buffer;
+	unsigned int events_per_period = d->events_per_period;
+	struct amdtp_domain *leader;
+	struct amdtp_stream *irq_target = NULL;
+	unsigned int queue_size;
+	unsigned int queue_depth;
+	unsigned int count;
+	struct amdtp_stream *s;
+	int err;
+
+	// The follower domain is available just when the leader domain is running.
+	leader = d->group.leader;
+	if (leader) {
+		struct fw_card *card;
+
+		if (!leader->irq_target || !amdtp_stream_running(leader->irq_target))
+			return -EAGAIN;
+
+		card = fw_parent_device(leader->irq_target->unit)->card;
+		list_for_each_entry(s, &d->streams, list) {
+			if (fw_parent_device(s->unit)->card != card)
+				return -EXDEV;
+		}
+	}
+
+	if (replay_seq) {
+		err = make_association(d);
+		if (err < 0)
+			return err;
+	}
+	d->replay.enable = replay_seq;
+	d->replay.on_the_fly = replay_on_the_fly;
+
+	// Select an IT context as IRQ target.
+	list_for_each_entry(s, &d->streams, list) {
+		if (s->direction == AMDTP_OUT_STREAM) {
+			irq_target = s;
+			break;
+		}
+	}
+	if (!irq_target)
+		return -ENXIO;
+
+	// The IRQ target of leader domain processes the isochronous contexts of follower domain.
+	if (!leader) {
+		d->irq_target = irq_target;
+		d->next_flush_ns = 0;
+
+		if (READ_ONCE(d->kthread.priority) > 0) {
+			err = start_domain_kthread(d);
+			if (err < 0) {
+				d->irq_target = NULL;
+				return err;
+			}
+		}
+	}
+
+	d->processing_cycle.rx_start_pending = true;
+
+	d->processing_cycle.tx_init_skip = tx_init_skip_cycles;
+
+	// The armed cycle is consumed.
+	spin_lock(&d->sync_start.lock);
+	d->processing_cycle.aligned = d->sync_start.armed;
+	d->processing_cycle.aligned_start = d->sync_start.cycle;
+	d->sync_start.armed = false;
+	d->sync_start.missed = false;
+	spin_unlock(&d->sync_start.lock);
+
+	// This is a case that AMDTP streams in domain run just for MIDI
+	// substream. Use the number of events equivalent to the configured
+	// interval, 10 msec by default, as interval of hardware IRQ.
+	if (events_per_period == 0) {
+		u64 events = (u64)amdtp_rate_table[irq_target->sfc] * READ_ONCE(d->midi_interval_us);
+
+		events_per_period = max_t(unsigned int, div_u64(events, USEC_PER_SEC), 1);
+	}
+	if (events_per_buffer == 0)
+		events_per_buffer = events_per_period * 3;
+
+	queue_size = DIV_ROUND_UP(CYCLES_PER_SECOND * events_per_buffer,
+				  amdtp_rate_table[irq_target->sfc]);
+
+	// The PCM buffer for the period of one isochronous cycle is too short for the queue.
+	if (READ_ONCE(low_latency))
+		queue_size = max_t(unsigned int, queue_size, LOW_LATENCY_MIN_QUEUE_SIZE);
+
+	// In adaptive queue mode, the packets are queued in advance just for the interval of
+	// hardware IRQ and the slack at first.
+	queue_depth = queue_size;
+	if (READ_ONCE(d->adaptive_queue)) {
+		unsigned int irq_cycles = DIV_ROUND_UP(CYCLES_PER_SECOND * events_per_period,
+						       amdtp_rate_table[irq_target->sfc]);
+
+		queue_depth = min(queue_size, irq_cycles + ADAPTIVE_QUEUE_MIN_SLACK);
+	}
+
+	reserve_packet_pools(d, queue_size);
+
+	set_monitor_endpoints(d, true);
+
+	// Each stream signals the readiness once in its callback.
+	count = 0;
+	list_for_each_entry(s, &d->streams, list)
+		++count;
+	atomic_set(&d->ready.pending, count);
+	WRITE_ONCE(d->ready.cancelled, false);
+
+	list_for_each_entry(s, &d->streams, list) {
+		unsigned int idle_irq_interval = 0;
+
+		if (s->direction == AMDTP_OUT_STREAM && s == d->irq_target) {
+			idle_irq_interval = DIV_ROUND_UP(CYCLES_PER_SECOND * events_per_period,
+							 amdtp_rate_table[d->irq_target->sfc]);
+		}
+
+		// Starts immediately but actually DMA context starts several hundred cycles later.
+		err = amdtp_stream_start(s, s->channel, s->speed, queue_size, queue_depth,
+					 idle_irq_interval);
+		if (err < 0)
+			goto error;
+	}
+
+	WRITE_ONCE(d->idle.last_active, jiffies);
+
+	if (leader) {
+		smp_store_release(&d->group.active, true);
+	} else {
+		unsigned int interval_us = READ_ONCE(d->timer.interval_us);
+
+		if (interval_us > 0) {
+			d->timer.interval = us_to_ktime(interval_us);
+			hrtimer_start(&d->timer.hrtimer, d->timer.interval, HRTIMER_MODE_REL_SOFT);
+		}
+	}
+
+	return 0;
+error:
+	set_monitor_endpoints(d, false);
+	if (d->irq_target)
+		amdtp_stream_stop(d->irq_target);
+	stop_domain_kthread(d);
+	list_for_each_entry(s, &d->streams, list)
+		amdtp_stream_stop(s);
+	d->irq_target = NULL;
+
+	return err;
+}
+
+/**
+ * amdtp_domain_start - start sending packets for isoc context in the domain.
+ * @d: the AMDTP domain.
+ * @tx_init_skip_cycles: the number of cycles to skip processing packets at initial stage of IR
+ *			 contexts.
+ * @replay_seq: whether to replay the sequence of packet in IR context for the sequence of packet in
+ *		IT context.
+ * @replay_on_the_fly: transfer rx packets according to nominal frequency, then begin to replay
+ *		       according to arrival of events in tx packets.
+ */
+int amdtp_domain_start(struct amdtp_domain *d, unsigned int tx_init_skip_cycles, bool replay_seq,
+		       bool replay_on_the_fly)
+{
+	int err;
+
+	mutex_lock(&domain_group_mutex);
+	err = start_domain(d, tx_init_skip_cycles, replay_seq, replay_on_the_fly);
+	mutex_unlock(&domain_group_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_start);
+
+// The contexts are stopped in the same order as amdtp_domain_stop(), while the streams are kept in
+// the domain with their resources. The domain in the group is not suspended, since the contexts of
+// follower domain are processed by the IRQ target of leader domain.
+static void suspend_domain(struct amdtp_domain *d)
+{
+	struct amdtp_stream *s;
+
+	if (!d->irq_target || d->group.leader || !list_empty(&d->group.followers))
+		return;
+
+	// The PCM substream spanning several streams is deferred after the flag.
+	WRITE_ONCE(d->idle.suspended, true);
+	smp_mb();
+	if (domain_is_active(d)) {
+		WRITE_ONCE(d->idle.suspended, false);
+		return;
+	}
+
+	hrtimer_cancel(&d->timer.hrtimer);
+
+	set_monitor_endpoints(d, false);
+
+	mutex_lock(&d->irq_target->mutex);
+	stop_context(d->irq_target);
+	WRITE_ONCE(d->irq_target->suspended, true);
+	mutex_unlock(&d->irq_target->mutex);
+
+	stop_domain_kthread(d);
+
+	list_for_each_entry(s, &d->streams, list) {
+		if (s == d->irq_target)
+			continue;
+
+		mutex_lock(&s->mutex);
+		if (context_running(s)) {
+			stop_context(s);
+			WRITE_ONCE(s->suspended, true);
+		}
+		mutex_unlock(&s->mutex);
+	}
+}
+
+// The streams are restarted with the parameters of the former start. At failure, the streams are
+// cancelled so that the driver stops the domain at the next operation.
+static void resume_domain(struct amdtp_domain *d)
+{
+	struct amdtp_stream *s;
+	int err;
+
+	WRITE_ONCE(d->idle.suspended, false);
+
+	err = start_domain(d, d->processing_cycle.tx_init_skip, d->replay.enable,
+			   d->replay.on_the_fly);
+	if (err < 0) {
+		list_for_each_entry(s, &d->streams, list) {
+			cancel_stream(s);
+			amdtp_stream_pcm_abort(s);
+		}
+	}
+}
+
+static void domain_idle_work(struct work_struct *work)
+{
+	struct amdtp_domain *d = container_of(work, struct amdtp_domain, idle.work);
+	unsigned int timeout;
+
+	mutex_lock(&domain_group_mutex);
+
+	timeout = READ_ONCE(d->idle.timeout);
+	if (d->idle.suspended) {
+		if (timeout == 0 || domain_is_active(d) ||
+		    time_before(jiffies, READ_ONCE(d->idle.last_active) + timeout * HZ))
+			resume_domain(d);
+	} else if (timeout > 0 &&
+		   time_after(jiffies, READ_ONCE(d->idle.last_active) + timeout * HZ)) {
+		suspend_domain(d);
+	}
+
+	mutex_unlock(&domain_group_mutex);
+}
+
+/**
+ * amdtp_domain_stop - stop sending packets for isoc context in the same domain.
+ * @d: the AMDTP domain to which the isoc contexts belong.
+ */
+void amdtp_domain_stop(struct amdtp_domain *d)
+{
+	struct amdtp_stream *s, *next;
+	struct amdtp_domain *follower;
+
+	// The work takes the mutex.
+	cancel_work_sync(&d->idle.work);
+
+	mutex_lock(&domain_group_mutex);
+
+	WRITE_ONCE(d->idle.suspended, false);
+
+	if (d->group.leader && d->group.active) {
+		struct amdtp_domain *leader = d->group.leader;
+		struct amdtp_stream *irq_target = leader->irq_target;
+
+		WRITE_ONCE(d->group.active, false);
+
+		// Wait for the IRQ target of leader domain to finish processing the contexts.
+		if (irq_target && context_running(irq_target))
+			fw_iso_context_flush_completions(irq_target->context);
+		if (leader->kthread.task) {
+			mutex_lock(&leader->kthread.mutex);
+			mutex_unlock(&leader->kthread.mutex);
+		}
+	}
+
+	hrtimer_cancel(&d->timer.hrtimer);
+
+	set_monitor_endpoints(d, false);
+
+	if (d->irq_target)
+		amdtp_stream_stop(d->irq_target);
+
+	// No signal is sent to the kernel thread anymore.
+	stop_domain_kthread(d);
+
+	// The contexts of follower domain are not processed anymore.
+	list_for_each_entry(follower, &d->group.followers, group.list) {
+		if (!follower->group.active)
+			continue;
+		WRITE_ONCE(follower->group.active, false);
+
+		list_for_each_entry(s, &follower->streams, list) {
+			if (amdtp_stream_running(s)) {
+				cancel_stream(s);
+				amdtp_stream_pcm_abort(s);
+			}
+		}
+	}
+
+	list_for_each_entry_safe(s, next, &d->streams, list) {
+		list_del(&s->list);
+
+		if (s != d->irq_target)
+			amdtp_stream_stop(s);
+	}
+
+	d->events_per_period = 0;
+	d->irq_target = NULL;
+
+	mutex_unlock(&domain_group_mutex);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_stop);
+
+/**
+ * amdtp_domain_update - update the streams in the domain after a bus reset
+ * @d: the AMDTP domain.
+ *
+ * The caller should call this function instead of stopping the domain when the isochronous
+ * resources and the connections of all streams in the domain are confirmed in the new generation
+ * of bus, thus the isochronous contexts keep running. The precomputed fields of CIP header are
+ * updated for the new node ID.
+ */
+void amdtp_domain_update(struct amdtp_domain *d)
+{
+	struct amdtp_stream *s;
+
+	list_for_each_entry(s, &d->streams, list) {
+		amdtp_stream_update(s);
+		count_stream_event(s, SNDRV_FIREWIRE_STREAM_COUNTER_BUS_RESETS, 1);
+	}
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_update);
+
+/**
+ * amdtp_domain_join - join the AMDTP domain to the other domain as follower.
+ * @leader: the AMDTP domain to lead.
+ * @follower: the AMDTP domain to follow.
+ *
+ * The isochronous contexts of follower domain are processed by the IRQ target of leader domain,
+ * instead of own IRQ target. The units of both domains should be on the same card. The follower
+ * domain can start just while the leader domain is running, and it is cancelled when the leader
+ * domain stops. The PCM substreams in follower domain are processed at the interval of hardware IRQ
+ * in leader domain. Both domains should not be running.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_domain_join(struct amdtp_domain *leader, struct amdtp_domain *follower)
+{
+	int err = 0;
+
+	mutex_lock(&domain_group_mutex);
+
+	if (leader == follower || leader->group.leader || follower->group.leader ||
+	    !list_empty(&follower->group.followers))
+		err = -EINVAL;
+	else if (leader->irq_target || !list_empty(&follower->streams))
+		err = -EBUSY;
+
+	if (err == 0) {
+		follower->group.leader = leader;
+		list_add_tail_rcu(&follower->group.list, &leader->group.followers);
+	}
+
+	mutex_unlock(&domain_group_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_join);
+
+/**
+ * amdtp_domain_leave - leave the AMDTP domain from the group of domains.
+ * @d: the AMDTP domain.
+ *
+ * The domain should not be running. When it is leader, the followers are released.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_domain_leave(struct amdtp_domain *d)
+{
+	struct amdtp_domain *follower, *next;
+	int err = 0;
+
+	mutex_lock(&domain_group_mutex);
+
+	if (d->irq_target || !list_empty(&d->streams)) {
+		err = -EBUSY;
+	} else {
+		if (d->group.leader) {
+			list_del_rcu(&d->group.list);
+			d->group.leader = NULL;
+		}
+
+		// The follower domains are not active while the leader domain is not running.
+		list_for_each_entry_safe(follower, next, &d->group.followers, group.list) {
+			list_del_rcu(&follower->group.list);
+			follower->group.leader = NULL;
+		}
+		INIT_LIST_HEAD(&d->group.followers);
+
+		// The IRQ target of leader domain can be walking the list while the follower leaves.
+		synchronize_rcu();
+	}
+
+	mutex_unlock(&domain_group_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_leave);
+
+/**
+ * amdtp_domain_set_kthread - configure the kernel thread to process isochronous contexts.
+ * @d: the AMDTP domain.
+ * @cpu: the CPU to which the thread is bound, or -1 for any CPU.
+ * @priority: the priority of thread for SCHED_FIFO policy, or zero to process the contexts in the
+ *	      software IRQ context of IRQ target.
+ *
+ * The configuration takes effect when the domain starts next time.
+ *
+ * Returns zero on success, or -EINVAL for invalid argument.
+ */
+int amdtp_domain_set_kthread(struct amdtp_domain *d, int cpu, unsigned int priority)
+{
+	if (cpu < -1 || cpu >= (int)nr_cpu_ids || priority >= MAX_RT_PRIO)
+		return -EINVAL;
+
+	WRITE_ONCE(d->kthread.cpu, cpu);
+	WRITE_ONCE(d->kthread.priority, priority);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_kthread);
+
+/**
+ * amdtp_domain_set_timer_interval - configure the timer to process isochronous contexts.
+ * @d: the AMDTP domain.
+ * @interval_us: the interval of timer in microsecond, or zero to disable the timer. It should be
+ *		 less than one second and equal to or larger than the isochronous cycle (125 usec).
+ *
+ * At NO_PERIOD_WAKEUP mode of PCM substream, the timer processes the isochronous contexts at the
+ * interval, instead of the hardware IRQ. The configuration takes effect when the domain starts next
+ * time.
+ *
+ * Returns zero on success, or -EINVAL for invalid argument.
+ */
+int amdtp_domain_set_timer_interval(struct amdtp_domain *d, unsigned int interval_us)
+{
+	if (interval_us > 0 && (interval_us < 125 || interval_us >= USEC_PER_SEC))
+		return -EINVAL;
+
+	WRITE_ONCE(d->timer.interval_us, interval_us);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_timer_interval);
+
+/**
+ * amdtp_domain_set_midi_interval - configure the interval of hardware IRQ just for MIDI.
+ * @d: the AMDTP domain.
+ * @interval_us: the interval in microsecond. It should be less than one second and equal to or
+ *		 larger than the isochronous cycle (125 usec).
+ *
+ * When the domain starts without PCM substream, the interval decides the number of events per
+ * period, thus the latency of outgoing MIDI bytes. The default is 10 msec. The configuration takes
+ * effect when the domain starts next time.
+ *
+ * Returns zero on success, or -EINVAL for invalid argument.
+ */
+int amdtp_domain_set_midi_interval(struct amdtp_domain *d, unsigned int interval_us)
+{
+	if (interval_us < 125 || interval_us >= USEC_PER_SEC)
+		return -EINVAL;
+
+	WRITE_ONCE(d->midi_interval_us, interval_us);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_midi_interval);
+
+/**
+ * amdtp_domain_set_warm - configure warm mode of the domain.
+ * @d: the AMDTP domain.
+ * @enable: whether to keep the resources of streams when the domain stops.
+ *
+ * In warm mode, the packet buffer and the descriptors of each stream are kept across stop/start,
+ * and reused when the parameters of stream are unchanged. The resources are released when the
+ * stream is destroyed, or when the stream stops after the mode is disabled.
+ */
+void amdtp_domain_set_warm(struct amdtp_domain *d, bool enable)
+{
+	WRITE_ONCE(d->warm, enable);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_warm);
+
+/**
+ * amdtp_domain_set_idle_timeout - configure idle policy of the domain.
+ * @d: the AMDTP domain.
+ * @seconds: the seconds without PCM and MIDI activity till suspending the domain, or zero to
+ *	     disable the policy.
+ *
+ * The isochronous contexts of the domain are stopped after the seconds, while the streams are
+ * regarded as running with their resources and connections. The contexts are restarted in
+ * process context at the next trigger of PCM substream or MIDI substream. The domain in the
+ * group of domains is not suspended. When the policy is disabled, the suspended domain is
+ * resumed.
+ */
+void amdtp_domain_set_idle_timeout(struct amdtp_domain *d, unsigned int seconds)
+{
+	WRITE_ONCE(d->idle.timeout, seconds);
+	if (seconds == 0 && READ_ONCE(d->idle.suspended))
+		schedule_work(&d->idle.work);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_idle_timeout);
+
+/**
+ * amdtp_domain_set_shedding_budget - configure time budget of the pass in the domain.
+ * @d: the AMDTP domain.
+ * @budget_ns: the nanoseconds for the pass in the callback of IRQ target to process the
+ *	       isochronous contexts of domain, or zero to disable the policy.
+ *
+ * When the pass exceeds the budget, the optional stages of payload processing, checked by
+ * amdtp_stream_shedding(), are shed in several following passes. The passes are counted by
+ * SNDRV_FIREWIRE_STREAM_COUNTER_SHED_PASSES in the counters of IRQ target. The delivery of PCM
+ * frames and MIDI bytes is never shed.
+ */
+void amdtp_domain_set_shedding_budget(struct amdtp_domain *d, unsigned int budget_ns)
+{
+	WRITE_ONCE(d->shedding.budget_ns, budget_ns);
+	if (budget_ns == 0)
+		WRITE_ONCE(d->shedding.passes, 0);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_shedding_budget);
+
+/**
+ * amdtp_domain_set_adaptive_queue - configure adaptive queue mode of the domain.
+ * @d: the AMDTP domain.
+ * @enable: whether to start IT contexts with the small number of packets queued in advance.
+ *
+ * By default, the packets for the whole of PCM buffer are queued in advance for IT contexts. In
+ * adaptive queue mode, the packets are queued for the interval of hardware IRQ and a small slack
+ * at first, then queued additionally up to the PCM buffer when the callback runs late. The mode
+ * is effective since the next start of the domain.
+ */
+void amdtp_domain_set_adaptive_queue(struct amdtp_domain *d, bool enable)
+{
+	WRITE_ONCE(d->adaptive_queue, enable);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_adaptive_queue);
+
+/**
+ * amdtp_domain_set_coalesce_period - configure coalescing notification of period elapsed.
+ * @d: the AMDTP domain.
+ * @enable: whether to notify period elapsed of the PCM substreams together.
+ *
+ * By default, the period elapsed is notified to each PCM substream as soon as its stream is
+ * processed, thus the client of several PCM substreams in the domain is woken up several times
+ * per period. When enabled, the notifications in the callback of IRQ target are deferred till
+ * all of the isochronous contexts in the domain are processed.
+ */
+void amdtp_domain_set_coalesce_period(struct amdtp_domain *d, bool enable)
+{
+	WRITE_ONCE(d->coalesce_period, enable);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_coalesce_period);
+
+/**
+ * amdtp_domain_set_resync - configure resynchronization mode of the domain.
+ * @d: the AMDTP domain.
+ * @enable: whether to resynchronize the stream when detecting discontinuity of tx packets.
+ *
+ * By default, any discontinuity of tx packets, such as data block counter and isochronous cycle,
+ * cancels all of streams in the domain, then the caller is expected to restart them. In
+ * resynchronization mode, the packets in the callback are dropped and the data block counter is
+ * re-seeded by the next packet, while the isochronous contexts and the bus resources are kept.
+ * The XRUN is reported to the PCM substream.
+ */
+void amdtp_domain_set_resync(struct amdtp_domain *d, bool enable)
+{
+	WRITE_ONCE(d->resync, enable);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_resync);
+
+/**
+ * amdtp_domain_set_conceal - configure concealment mode of the domain.
+ * @d: the AMDTP domain.
+ * @enable: whether to conceal the isochronous cycles lost in tx packets.
+ *
+ * By default, the isochronous cycles lost beyond the tolerance for the device cancel all of
+ * streams in the domain. In concealment mode, up to IR_CONCEAL_MAX_CYCLES lost cycles in a
+ * callback are filled with empty packets for sequence replay, and the PCM frames expected in
+ * them are delivered as silence to the PCM substream. The event is counted in
+ * SNDRV_FIREWIRE_STREAM_COUNTER_CONCEALED_CYCLES. The data block counter is re-seeded by the
+ * packet after the lost cycles, while the discontinuity of it without lost cycles is not concealed.
+ */
+void amdtp_domain_set_conceal(struct amdtp_domain *d, bool enable)
+{
+	WRITE_ONCE(d->conceal, enable);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_conceal);
+
+/**
+ * amdtp_domain_set_monitor - configure direct monitoring in the domain.
+ * @d: the AMDTP domain.
+ * @routes: the array of routes, each of which has the index of PCM channel in the first IR context,
+ *	    the index of PCM channel in the first IT context, and the gain.
+ * @count: the number of routes, up to AMDTP_MONITOR_MAX_ROUTES. Zero disables the monitoring.
+ *
+ * The samples for the routes in captured data blocks are summed into the outgoing data blocks
+ * with the gain in the same processing of isochronous contexts, thus the latency is the number of
+ * packets queued in advance for the IT context, without the round trip to userspace. Just the
+ * contexts of AM824 format are available. The route to the channel out of the data block is
+ * ignored. The configuration is effective immediately even if the domain is running.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_domain_set_monitor(struct amdtp_domain *d, const struct amdtp_monitor_route *routes,
+			     unsigned int count)
+{
+	struct amdtp_monitor *state = NULL;
+	struct amdtp_monitor *old;
+	unsigned int i;
+
+	if (count > AMDTP_MONITOR_MAX_ROUTES)
+		return -EINVAL;
+
+	for (i = 0; i < count; ++i) {
+		if (routes[i].src >= AM824_MAX_CHANNELS_FOR_PCM ||
+		    routes[i].dst >= AM824_MAX_CHANNELS_FOR_PCM ||
+		    abs(routes[i].gain) > AMDTP_MONITOR_GAIN_MAX)
+			return -EINVAL;
+	}
+
+	if (count > 0) {
+		state = kvzalloc(struct_size(state, samples, AMDTP_MONITOR_FIFO_BLOCKS * count),
+				 GFP_KERNEL);
+		if (!state)
+			return -ENOMEM;
+		memcpy(state->routes, routes, sizeof(*routes) * count);
+		state->route_count = count;
+	}
+
+	spin_lock_bh(&d->monitor.lock);
+	old = d->monitor.state;
+	d->monitor.state = state;
+	spin_unlock_bh(&d->monitor.lock);
+
+	kvfree(old);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_set_monitor);
+
+/**
+ * amdtp_domain_arm_sync_start - arm the cycle to begin processing in the domain.
+ * @d: the AMDTP domain.
+ * @cycle: the isochronous cycle, as seconds * 8000 + cycle in the range of 8 seconds.
+ *
+ * At the next start, the domain begins processing content of packets at the cycle in both
+ * directions instead of the cycle decided by itself, so that several domains for the units on the
+ * same bus begin on the same cycle. When the domain is not ready at the cycle, it begins at the
+ * cycle decided by itself and the miss is reported by amdtp_domain_sync_start_ioctl(). The cycle
+ * should be less than 4 seconds ahead of the start.
+ */
+void amdtp_domain_arm_sync_start(struct amdtp_domain *d, unsigned int cycle)
+{
+	spin_lock(&d->sync_start.lock);
+	d->sync_start.cycle = cycle % (OHCI_SECOND_MODULUS * CYCLES_PER_SECOND);
+	d->sync_start.armed = true;
+	spin_unlock(&d->sync_start.lock);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_arm_sync_start);
+
+/**
+ * amdtp_domain_disarm_sync_start - disarm the cycle to begin processing in the domain.
+ * @d: the AMDTP domain.
+ */
+void amdtp_domain_disarm_sync_start(struct amdtp_domain *d)
+{
+	spin_lock(&d->sync_start.lock);
+	d->sync_start.armed = false;
+	spin_unlock(&d->sync_start.lock);
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_disarm_sync_start);
+
+/**
+ * amdtp_domain_sync_start_ioctl - handle SNDRV_FIREWIRE_IOCTL_SYNC_START of hwdep device.
+ * @d: the AMDTP domain.
+ * @unit: the unit handled by the driver.
+ * @arg: the pointer to struct snd_firewire_sync_start in userspace.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int amdtp_domain_sync_start_ioctl(struct amdtp_domain *d, struct fw_unit *unit, void __user *arg)
+{
+	struct snd_firewire_sync_start sync;
+	u32 cycle_time;
+	int err;
+
+	if (copy_from_user(&sync, arg, sizeof(sync)))
+		return -EFAULT;
+
+	switch (sync.request) {
+	case SNDRV_FIREWIRE_SYNC_START_QUERY:
+		break;
+	case SNDRV_FIREWIRE_SYNC_START_ARM:
+		if (sync.cycle >= OHCI_SECOND_MODULUS * CYCLES_PER_SECOND)
+			return -EINVAL;
+		amdtp_domain_arm_sync_start(d, sync.cycle);
+		break;
+	case SNDRV_FIREWIRE_SYNC_START_DISARM:
+		amdtp_domain_disarm_sync_start(d);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	err = fw_card_read_cycle_time(fw_parent_device(unit)->card, &cycle_time);
+	if (err < 0)
+		return err;
+	sync.cycle = compute_ohci_cycle_count_from_cycle_time(cycle_time);
+
+	sync.flags = 0;
+	if (READ_ONCE(d->sync_start.armed))
+		sync.flags |= SNDRV_FIREWIRE_SYNC_START_ARMED;
+	if (READ_ONCE(d->sync_start.missed))
+		sync.flags |= SNDRV_FIREWIRE_SYNC_START_MISSED;
+
+	if (copy_to_user(arg, &sync, sizeof(sync)))
+		return -EFAULT;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(amdtp_domain_sync_start_ioctl);
+
+static void proc_read_kthread(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%d %u\n", READ_ONCE(d->kthread.cpu), READ_ONCE(d->kthread.priority));
+}
+
+static void proc_write_kthread(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	unsigned int priority;
+	int cpu;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (sscanf(line, "%d %u", &cpu, &priority) != 2)
+		return;
+
+	amdtp_domain_set_kthread(d, cpu, priority);
+}
+
+static void proc_read_timer(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%u\n", READ_ONCE(d->timer.interval_us));
+}
+
+static void proc_write_timer(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	unsigned int interval_us;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtouint(line, 0, &interval_us) < 0)
+		return;
+
+	amdtp_domain_set_timer_interval(d, interval_us);
+}
+
+static void proc_read_midi_interval(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%u\n", READ_ONCE(d->midi_interval_us));
+}
+
+static void proc_write_midi_interval(struct snd_info_entry *entry,
+				     struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	unsigned int interval_us;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtouint(line, 0, &interval_us) < 0)
+		return;
+
+	amdtp_domain_set_midi_interval(d, interval_us);
+}
+
+static void proc_read_warm(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%d\n", READ_ONCE(d->warm));
+}
+
+static void proc_write_warm(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	bool enable;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtobool(line, &enable) < 0)
+		return;
+
+	amdtp_domain_set_warm(d, enable);
+}
+
+static void proc_read_idle_timeout(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%u %s\n", READ_ONCE(d->idle.timeout),
+		    READ_ONCE(d->idle.suspended) ? "suspended" : "active");
+}
+
+static void proc_write_idle_timeout(struct snd_info_entry *entry,
+				    struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	unsigned int seconds;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtouint(line, 0, &seconds) < 0)
+		return;
+
+	amdtp_domain_set_idle_timeout(d, seconds);
+}
+
+static void proc_read_shedding_budget(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
 {
-	/* Precomputing. */
-	WRITE_ONCE(s->source_node_id_field,
-                   (fw_parent_device(s->unit)->card->node_id << CIP_SID_SHIFT) & CIP_SID_MASK);
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%u %s\n", READ_ONCE(d->shedding.budget_ns),
+		    READ_ONCE(d->shedding.passes) > 0 ? "shedding" : "full");
 }
-EXPORT_SYMBOL(amdtp_stream_update);
 
-/**
- * amdtp_stream_stop - stop sending packets
- * @s: the AMDTP stream to stop
- *
- * All PCM and MIDI devices of the stream must be stopped before the stream
- * itself can be stopped.
- */
-static void amdtp_stream_stop(struct amdtp_stream *s)
+static void proc_write_shedding_budget(struct snd_info_entry *entry,
+				       struct snd_info_buffer *buffer)
 {
-	mutex_lock(&s->mutex);
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	unsigned int budget_ns;
 
-	if (!amdtp_stream_running(s)) {
-		mutex_unlock(&s->mutex);
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtouint(line, 0, &budget_ns) < 0)
 		return;
-	}
 
-	fw_iso_context_stop(s->context);
-	fw_iso_context_destroy(s->context);
-	s->context = ERR_PTR(-1);
-	iso_packets_buffer_destroy(&s->buffer, s->unit);
-	kfree(s->pkt_descs);
+	amdtp_domain_set_shedding_budget(d, budget_ns);
+}
 
-	if (s->direction == AMDTP_OUT_STREAM) {
-		kfree(s->ctx_data.rx.seq.descs);
-	} else {
-		if (s->domain->replay.enable)
-			kfree(s->ctx_data.tx.cache.descs);
-	}
+static void proc_read_coalesce_period(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
 
-	mutex_unlock(&s->mutex);
+	snd_iprintf(buffer, "%d\n", READ_ONCE(d->coalesce_period));
 }
 
-/**
- * amdtp_stream_pcm_abort - abort the running PCM device
- * @s: the AMDTP stream about to be stopped
- *
- * If the isochronous stream needs to be stopped asynchronously, call this
- * function first to stop the PCM device.
- */
-void amdtp_stream_pcm_abort(struct amdtp_stream *s)
+static void proc_write_coalesce_period(struct snd_info_entry *entry,
+				       struct snd_info_buffer *buffer)
 {
-	struct snd_pcm_substream *pcm;
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	bool enable;
 
-	pcm = READ_ONCE(s->pcm);
-	if (pcm)
-		snd_pcm_stop_xrun(pcm);
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtobool(line, &enable) < 0)
+		return;
+
+	amdtp_domain_set_coalesce_period(d, enable);
 }
-EXPORT_SYMBOL(amdtp_stream_pcm_abort);
 
-/**
- * amdtp_domain_init - initialize an AMDTP domain structure
- * @d: the AMDTP domain to initialize.
- */
-int amdtp_domain_init(struct amdtp_domain *d)
+static void proc_read_resync(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
 {
-	INIT_LIST_HEAD(&d->streams);
+	struct amdtp_domain *d = entry->private_data;
 
-	d->events_per_period = 0;
+	snd_iprintf(buffer, "%d\n", READ_ONCE(d->resync));
+}
 
-	return 0;
+static void proc_write_resync(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	bool enable;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtobool(line, &enable) < 0)
+		return;
+
+	amdtp_domain_set_resync(d, enable);
 }
-EXPORT_SYMBOL_GPL(amdtp_domain_init);
 
-/**
- * amdtp_domain_destroy - destroy an AMDTP domain structure
- * @d: the AMDTP domain to destroy.
- */
-void amdtp_domain_destroy(struct amdtp_domain *d)
+static void proc_read_conceal(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
 {
-	// At present nothing to do.
-	return;
+	struct amdtp_domain *d = entry->private_data;
+
+	snd_iprintf(buffer, "%d\n", READ_ONCE(d->conceal));
 }
-EXPORT_SYMBOL_GPL(amdtp_domain_destroy);
 
-/**
- * amdtp_domain_add_stream - register isoc context into the domain.
- * @d: the AMDTP domain.
- * @s: the AMDTP stream.
- * @channel: the isochronous channel on the bus.
- * @speed: firewire speed code.
- */
-int amdtp_domain_add_stream(struct amdtp_domain *d, struct amdtp_stream *s,
-			    int channel, int speed)
+static void proc_write_conceal(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
 {
-	struct amdtp_stream *tmp;
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	bool enable;
 
-	list_for_each_entry(tmp, &d->streams, list) {
-		if (s == tmp)
-			return -EBUSY;
-	}
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtobool(line, &enable) < 0)
+		return;
 
-	list_add(&s->list, &d->streams);
+	amdtp_domain_set_conceal(d, enable);
+}
 
-	s->channel = channel;
-	s->speed = speed;
-	s->domain = d;
+static void proc_read_adaptive_queue(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
 
-	return 0;
+	snd_iprintf(buffer, "%d\n", READ_ONCE(d->adaptive_queue));
 }
-EXPORT_SYMBOL_GPL(amdtp_domain_add_stream);
 
-// Make the reference from rx stream to tx stream for sequence replay. When the number of tx streams
-// is less than the number of rx streams, the first tx stream is selected.
-static int make_association(struct amdtp_domain *d)
+static void proc_write_adaptive_queue(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
 {
-	unsigned int dst_index = 0;
-	struct amdtp_stream *rx;
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	bool enable;
 
-	// Make association to replay target.
-	list_for_each_entry(rx, &d->streams, list) {
-		if (rx->direction == AMDTP_OUT_STREAM) {
-			unsigned int src_index = 0;
-			struct amdtp_stream *tx = NULL;
-			struct amdtp_stream *s;
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtobool(line, &enable) < 0)
+		return;
 
-			list_for_each_entry(s, &d->streams, list) {
-				if (s->direction == AMDTP_IN_STREAM) {
-					if (dst_index == src_index) {
-						tx = s;
-						break;
-					}
+	amdtp_domain_set_adaptive_queue(d, enable);
+}
 
-					++src_index;
-				}
-			}
-			if (!tx) {
-				// Select the first entry.
-				list_for_each_entry(s, &d->streams, list) {
-					if (s->direction == AMDTP_IN_STREAM) {
-						tx = s;
-						break;
-					}
-				}
-				// No target is available to replay sequence.
-				if (!tx)
-					return -EINVAL;
-			}
+static void proc_read_monitor(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	struct amdtp_monitor_route routes[AMDTP_MONITOR_MAX_ROUTES];
+	unsigned int count = 0;
+	unsigned int i;
+
+	spin_lock_bh(&d->monitor.lock);
+	if (d->monitor.state) {
+		count = d->monitor.state->route_count;
+		memcpy(routes, d->monitor.state->routes, sizeof(*routes) * count);
+	}
+	spin_unlock_bh(&d->monitor.lock);
 
-			rx->ctx_data.rx.replay_target = tx;
-			rx->ctx_data.rx.cache_head = 0;
+	for (i = 0; i < count; ++i)
+		snd_iprintf(buffer, "%u %u %d\n", routes[i].src, routes[i].dst, routes[i].gain);
+}
 
-			++dst_index;
-		}
+static void proc_write_monitor(struct snd_info_entry *entry, struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	struct amdtp_monitor_route routes[AMDTP_MONITOR_MAX_ROUTES];
+	unsigned int count = 0;
+	char line[64];
+
+	while (!snd_info_get_line(buffer, line, sizeof(line))) {
+		struct amdtp_monitor_route *route = routes + count;
+
+		if (line[0] == '\0')
+			continue;
+		if (count >= AMDTP_MONITOR_MAX_ROUTES)
+			return;
+		if (sscanf(line, "%u %u %d", &route->src, &route->dst, &route->gain) != 3)
+			return;
+		++count;
 	}
 
-	return 0;
+	amdtp_domain_set_monitor(d, routes, count);
 }
 
-/**
- * amdtp_domain_start - start sending packets for isoc context in the domain.
- * @d: the AMDTP domain.
- * @tx_init_skip_cycles: the number of cycles to skip processing packets at initial stage of IR
- *			 contexts.
- * @replay_seq: whether to replay the sequence of packet in IR context for the sequence of packet in
- *		IT context.
- * @replay_on_the_fly: transfer rx packets according to nominal frequency, then begin to replay
- *		       according to arrival of events in tx packets.
- */
-int amdtp_domain_start(struct amdtp_domain *d, unsigned int tx_init_skip_cycles, bool replay_seq,
-		       bool replay_on_the_fly)
+static void proc_read_capture_quadlets(struct snd_info_entry *entry,
+				       struct snd_info_buffer *buffer)
 {
-	unsigned int events_per_buffer = d->events_per_buffer;
-	unsigned int events_per_period = d->events_per_period;
-	unsigned int queue_size;
-	struct amdtp_stream *s;
-	bool found = false;
-	int err;
+	struct amdtp_domain *d = entry->private_data;
 
-	if (replay_seq) {
-		err = make_association(d);
-		if (err < 0)
-			return err;
+	snd_iprintf(buffer, "%u\n", READ_ONCE(d->capture.quadlets));
+}
+
+static void proc_write_capture_quadlets(struct snd_info_entry *entry,
+					struct snd_info_buffer *buffer)
+{
+	struct amdtp_domain *d = entry->private_data;
+	char line[32];
+	unsigned int quadlets;
+
+	if (snd_info_get_line(buffer, line, sizeof(line)))
+		return;
+	if (kstrtouint(line, 0, &quadlets) < 0)
+		return;
+
+	WRITE_ONCE(d->capture.quadlets, min_t(unsigned int, quadlets, CAPTURE_MAX_QUADLETS));
+}
+
+static int capture_open(struct snd_info_entry *entry, unsigned short mode,
+			void **file_private_data)
+{
+	struct amdtp_domain *d = entry->private_data;
+	struct snd_fw_event_ring *ring;
+	int err = 0;
+
+	mutex_lock(&d->capture.mutex);
+
+	if (d->capture.opened) {
+		err = -EBUSY;
+		goto end;
 	}
-	d->replay.enable = replay_seq;
-	d->replay.on_the_fly = replay_on_the_fly;
 
-	// Select an IT context as IRQ target.
-	list_for_each_entry(s, &d->streams, list) {
-		if (s->direction == AMDTP_OUT_STREAM) {
-			found = true;
-			break;
+	// The ring is kept till the domain is destroyed, since the producer refers to it without
+	// any lock.
+	if (!d->capture.ring) {
+		ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+		if (!ring) {
+			err = -ENOMEM;
+			goto end;
+		}
+
+		err = snd_fw_event_ring_init(ring, CAPTURE_RING_SIZE);
+		if (err < 0) {
+			kfree(ring);
+			goto end;
 		}
+
+		WRITE_ONCE(d->capture.ring, ring);
 	}
-	if (!found)
-		return -ENXIO;
-	d->irq_target = s;
 
-	d->processing_cycle.tx_init_skip = tx_init_skip_cycles;
+	d->capture.opened = true;
+end:
+	mutex_unlock(&d->capture.mutex);
 
-	// This is a case that AMDTP streams in domain run just for MIDI
-	// substream. Use the number of events equivalent to 10 msec as
-	// interval of hardware IRQ.
-	if (events_per_period == 0)
-		events_per_period = amdtp_rate_table[d->irq_target->sfc] / 100;
-	if (events_per_buffer == 0)
-		events_per_buffer = events_per_period * 3;
+	return err;
+}
 
-	queue_size = DIV_ROUND_UP(CYCLES_PER_SECOND * events_per_buffer,
-				  amdtp_rate_table[d->irq_target->sfc]);
+static int capture_release(struct snd_info_entry *entry, unsigned short mode,
+			   void *file_private_data)
+{
+	struct amdtp_domain *d = entry->private_data;
 
-	list_for_each_entry(s, &d->streams, list) {
-		unsigned int idle_irq_interval = 0;
+	mutex_lock(&d->capture.mutex);
 
-		if (s->direction == AMDTP_OUT_STREAM && s == d->irq_target) {
-			idle_irq_interval = DIV_ROUND_UP(CYCLES_PER_SECOND * events_per_period,
-							 amdtp_rate_table[d->irq_target->sfc]);
-		}
+	// No producer touches the ring after it.
+	spin_lock_bh(&d->capture.lock);
+	snd_fw_event_ring_unmap(d->capture.ring);
+	spin_unlock_bh(&d->capture.lock);
 
-		// Starts immediately but actually DMA context starts several hundred cycles later.
-		err = amdtp_stream_start(s, s->channel, s->speed, queue_size, idle_irq_interval);
-		if (err < 0)
-			goto error;
-	}
+	d->capture.opened = false;
+
+	mutex_unlock(&d->capture.mutex);
 
 	return 0;
-error:
-	list_for_each_entry(s, &d->streams, list)
-		amdtp_stream_stop(s);
-	return err;
 }
-EXPORT_SYMBOL_GPL(amdtp_domain_start);
 
-/**
- * amdtp_domain_stop - stop sending packets for isoc context in the same domain.
- * @d: the AMDTP domain to which the isoc contexts belong.
- */
-void amdtp_domain_stop(struct amdtp_domain *d)
+// The records are consumed through the mapping.
+static ssize_t capture_read(struct snd_info_entry *entry, void *file_private_data,
+			    struct file *file, char __user *buf, size_t count, loff_t pos)
 {
-	struct amdtp_stream *s, *next;
+	return 0;
+}
 
-	if (d->irq_target)
-		amdtp_stream_stop(d->irq_target);
+static ssize_t capture_write(struct snd_info_entry *entry, void *file_private_data,
+			     struct file *file, const char __user *buf, size_t count, loff_t pos)
+{
+	return -EINVAL;
+}
 
-	list_for_each_entry_safe(s, next, &d->streams, list) {
-		list_del(&s->list);
+static int capture_mmap(struct snd_info_entry *entry, void *file_private_data,
+			struct inode *inode, struct file *file, struct vm_area_struct *area)
+{
+	struct amdtp_domain *d = entry->private_data;
+	int err;
 
-		if (s != d->irq_target)
-			amdtp_stream_stop(s);
+	mutex_lock(&d->capture.mutex);
+	err = snd_fw_event_ring_mmap(d->capture.ring, area);
+	mutex_unlock(&d->capture.mutex);
+
+	return err;
+}
+
+static const struct snd_info_entry_ops capture_ops = {
+	.open		= capture_open,
+	.release	= capture_release,
+	.read		= capture_read,
+	.write		= capture_write,
+	.mmap		= capture_mmap,
+};
+
+static void add_proc_node(struct amdtp_domain *d, struct snd_info_entry *root, const char *name,
+			  void (*read)(struct snd_info_entry *, struct snd_info_buffer *),
+			  void (*write)(struct snd_info_entry *, struct snd_info_buffer *))
+{
+	struct snd_info_entry *entry;
+
+	entry = snd_info_create_card_entry(root->card, name, root);
+	if (entry) {
+		snd_info_set_text_ops(entry, d, read);
+		entry->c.text.write = write;
+		entry->mode |= 0200;
 	}
+}
 
-	d->events_per_period = 0;
-	d->irq_target = NULL;
+/**
+ * amdtp_domain_add_proc_nodes - add proc nodes to configure the domain.
+ * @d: the AMDTP domain.
+ * @root: the proc directory of sound card.
+ *
+ * The "kthread" node accepts the CPU and the priority of kernel thread, as arguments of
+ * amdtp_domain_set_kthread(). The "timer" node accepts the interval of timer, as argument of
+ * amdtp_domain_set_timer_interval(). The "midi_interval" node accepts the interval of hardware
+ * IRQ just for MIDI, as argument of amdtp_domain_set_midi_interval(). The "warm", "resync",
+ * "conceal", "adaptive_queue" and "coalesce_period" nodes accept boolean value, as argument of
+ * amdtp_domain_set_warm(), amdtp_domain_set_resync(), amdtp_domain_set_conceal(),
+ * amdtp_domain_set_adaptive_queue() and amdtp_domain_set_coalesce_period(). The "monitor" node
+ * accepts the routes of direct monitoring as argument of amdtp_domain_set_monitor(), one route
+ * per line in the order of the index of source channel, the index of destination channel, and
+ * the gain in fixed-point with 16 bits fraction. No route disables it. The "idle_timeout" node
+ * accepts the seconds as argument of amdtp_domain_set_idle_timeout(). The "shedding_budget" node
+ * accepts the nanoseconds as argument of amdtp_domain_set_shedding_budget().
+ *
+ * The "capture" node is mapped by userspace to capture packets of the streams in the layout
+ * of struct snd_firewire_event_ring and struct snd_firewire_packet_record. The node should be
+ * opened for both read and write. The "capture_quadlets" node accepts the number of quadlets of
+ * payload to be captured per packet.
+ */
+void amdtp_domain_add_proc_nodes(struct amdtp_domain *d, struct snd_info_entry *root)
+{
+	struct snd_info_entry *entry;
+
+	add_proc_node(d, root, "kthread", proc_read_kthread, proc_write_kthread);
+	add_proc_node(d, root, "timer", proc_read_timer, proc_write_timer);
+	add_proc_node(d, root, "midi_interval", proc_read_midi_interval, proc_write_midi_interval);
+	add_proc_node(d, root, "warm", proc_read_warm, proc_write_warm);
+	add_proc_node(d, root, "idle_timeout", proc_read_idle_timeout, proc_write_idle_timeout);
+	add_proc_node(d, root, "shedding_budget", proc_read_shedding_budget,
+		      proc_write_shedding_budget);
+	add_proc_node(d, root, "resync", proc_read_resync, proc_write_resync);
+	add_proc_node(d, root, "conceal", proc_read_conceal, proc_write_conceal);
+	add_proc_node(d, root, "adaptive_queue", proc_read_adaptive_queue,
+		      proc_write_adaptive_queue);
+	add_proc_node(d, root, "coalesce_period", proc_read_coalesce_period,
+		      proc_write_coalesce_period);
+	add_proc_node(d, root, "monitor", proc_read_monitor, proc_write_monitor);
+	add_proc_node(d, root, "capture_quadlets", proc_read_capture_quadlets,
+		      proc_write_capture_quadlets);
+
+	entry = snd_info_create_card_entry(root->card, "capture", root);
+	if (entry) {
+		entry->content = SNDRV_INFO_CONTENT_DATA;
+		entry->private_data = d;
+		entry->c.ops = &capture_ops;
+		entry->mode = S_IFREG | 0600;
+	}
 }
-EXPORT_SYMBOL_GPL(amdtp_domain_stop);
+EXPORT_SYMBOL_GPL(amdtp_domain_add_proc_nodes);
@@ -2,14 +2,23 @@
 #ifndef SOUND_FIREWIRE_AMDTP_H_INCLUDED
 #define SOUND_FIREWIRE_AMDTP_H_INCLUDED
 
+#include <linux/atomic.h>
+#include <linux/build_bug.h>
+#include <linux/cache.h>
 #include <linux/err.h>
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/stddef.h>
+#include <linux/workqueue.h>
 
 /* TODO: remove when merging to upstream. */
 #include "../../backport.h"
 
 #include <sound/asound.h>
+#include <sound/firewire.h>
 #include "packets-buffer.h"
 
 /**
@@ -90,24 +99,44 @@ enum cip_sfc {
 	CIP_SFC_COUNT
 };
 
+// The formats of PCM sample supported by the shared kernels in amdtp-pcm.h.
+#define AMDTP_PCM_FORMAT_BITS \
+	(SNDRV_PCM_FMTBIT_S32 | SNDRV_PCM_FMTBIT_S24 | SNDRV_PCM_FMTBIT_S24_3LE)
+
 struct fw_unit;
 struct fw_iso_context;
 struct snd_pcm_substream;
 struct snd_pcm_runtime;
+struct snd_pcm_audio_tstamp_config;
+struct snd_pcm_audio_tstamp_report;
+struct snd_info_entry;
+struct snd_card;
 
 enum amdtp_stream_direction {
 	AMDTP_OUT_STREAM = 0,
 	AMDTP_IN_STREAM
 };
 
+// Packed into 16 bytes in 64 bit architecture so that the walk over descriptors for a batch of
+// packets touches fewer cache lines. The cycle is less than 64,000 (3 bits of second and 13 bits
+// of cycle in 1394 OHCI), and the syt is 16 bit field of CIP header.
 struct pkt_desc {
-	u32 cycle;
-	u32 syt;
-	unsigned int data_blocks;
-	unsigned int data_block_counter;
+	u16 cycle;
+	u16 syt;
+	u16 data_blocks;
+	u8 data_block_counter;
 	__be32 *ctx_payload;
 };
 
+// The number of buckets in log2 histograms for callback of isochronous context. The bucket at
+// index n counts the samples in the range [2^(n-1), 2^n), and the last bucket counts the rest.
+#define AMDTP_STREAM_HISTOGRAM_BUCKETS	16
+// The time to process payloads has more buckets, so that the last one starts at about 4 msec,
+// beyond the interval of callback.
+#define AMDTP_STREAM_PROCESS_NS_BUCKETS	24
+
+struct amdtp_timing_profile;
+
 struct amdtp_stream;
 typedef unsigned int (*amdtp_stream_process_ctx_payloads_t)(
 						struct amdtp_stream *s,
@@ -115,13 +144,41 @@ typedef unsigned int (*amdtp_stream_process_ctx_payloads_t)(
 						unsigned int packets,
 						struct snd_pcm_substream *pcm);
 
+// The PCM substream which shares the stream with the others, bound to the range of PCM channels in
+// data block. The frames of substream consist of the channels in the range.
+#define AMDTP_STREAM_SHARED_PCMS	4
+
+struct amdtp_shared_pcm {
+	struct snd_pcm_substream *pcm;
+	unsigned int channel_offset;
+	unsigned int channels;
+	snd_pcm_uframes_t buffer_pointer;
+	unsigned int period_pointer;
+};
+
+// Allocated at the first binding, and kept till the stream is destroyed. The bits of running mask
+// are indexes of the array.
+struct amdtp_shared_pcms {
+	unsigned long running;
+	struct amdtp_shared_pcm entries[AMDTP_STREAM_SHARED_PCMS];
+};
+
+typedef unsigned int (*amdtp_stream_process_shared_pcm_t)(struct amdtp_stream *s,
+							  const struct pkt_desc *desc,
+							  unsigned int packets,
+							  struct amdtp_shared_pcm *shared);
+
 struct amdtp_domain;
+struct amdtp_mc_receiver;
+struct snd_fw_event_ring;
 struct amdtp_stream {
-	struct fw_unit *unit;
+	// The fields touched in the callbacks of isochronous context for each packet. They are
+	// grouped in the leading cache lines apart from the fields for configuration, since many
+	// streams are processed in the same CPU.
+	struct_group_attr(hot, ____cacheline_aligned,
 	// The combination of cip_flags enumeration-constants.
 	unsigned int flags;
 	enum amdtp_stream_direction direction;
-	struct mutex mutex;
 
 	/* For packet processing. */
 	struct fw_iso_context *context;
@@ -129,6 +186,7 @@ struct amdtp_stream {
 	unsigned int queue_size;
 	int packet_index;
 	struct pkt_desc *pkt_descs;
+
 	int tag;
 	union {
 		struct {
@@ -150,6 +208,30 @@ struct amdtp_stream {
 				unsigned int size;
 				unsigned int tail;
 			} cache;
+
+			// The number of cached descriptors to skip before recording timing profile.
+			unsigned int profile_skip;
+
+			// The isochronous cycles concealed in the callback, the index of descriptor
+			// following them, and the number of PCM frames of silence for them.
+			struct {
+				unsigned int cycles;
+				unsigned int index;
+				unsigned int frames;
+			} conceal;
+
+			// The delay-locked loop to estimate the rate of events from the history of
+			// isochronous cycle and SYT. The time is in 1/2^32 tick.
+			struct {
+				bool primed;
+				unsigned int tstamp;
+				unsigned int events;
+				s64 residual;
+				u64 period;
+				u64 nominal_period;
+				int deviation;
+				unsigned int updates;
+			} rate_dll;
 		} tx;
 		struct {
 			// To generate CIP header.
@@ -158,6 +240,13 @@ struct amdtp_stream {
 			// To generate constant hardware IRQ.
 			unsigned int event_count;
 
+			// The number of packets queued in advance, up to the size of queue.
+			unsigned int queue_depth;
+
+			// The number of data blocks filled with silence for PCM channels in each slot
+			// of packet buffer, in the current session.
+			u16 *pcm_silence;
+
 			// To calculate CIP data blocks and tstamp.
 			struct {
 				struct seq_desc *descs;
@@ -166,17 +255,25 @@ struct amdtp_stream {
 				unsigned int head;
 			} seq;
 
-			unsigned int data_block_state;
-			unsigned int syt_offset_state;
-			unsigned int last_syt_offset;
+			// The position in the table of ideal sequence.
+			unsigned int seq_phase;
 
 			struct amdtp_stream *replay_target;
 			unsigned int cache_head;
+			// The most and the least number of cached cycles in replay target observed at
+			// replaying, to measure the size of cache for the next session.
+			unsigned int cache_peak;
+			unsigned int cache_trough;
+
+			// The timing profile of replay target, used till the cache is primed.
+			const struct seq_desc *profile;
+			unsigned int profile_phase;
 		} rx;
 	} ctx_data;
 
 	/* For CIP headers. */
-	unsigned int source_node_id_field;
+	// The fields of CIP header constant in the session, precomputed for rx stream.
+	u32 cip_header_template[2];
 	unsigned int data_block_quadlets;
 	unsigned int data_block_counter;
 	unsigned int sph;
@@ -192,42 +289,243 @@ struct amdtp_stream {
 	snd_pcm_uframes_t pcm_buffer_pointer;
 	unsigned int pcm_period_pointer;
 
+	// For tx stream. Nothing but the PCM substream consumes the payload of packets, thus only
+	// the context header is processed while the PCM substream is not attached.
+	bool idle_payloads;
+
+	// For the PCM substreams sharing the stream, if any is bound.
+	struct amdtp_shared_pcms *shared_pcms;
+
+	/* For backends to process data blocks. */
+	void *protocol;
+	amdtp_stream_process_ctx_payloads_t process_ctx_payloads;
+
+	// The ring to deliver incoming MIDI bytes with timestamp, if the driver supports it.
+	struct snd_fw_event_ring *midi_event_ring;
+
+	struct amdtp_domain *domain;
+	);
+
+	/* For configuration, or touched once per callback at most. */
+	struct fw_unit *unit;
+	struct mutex mutex;
+
+	// The isochronous context is stopped by the idle policy of domain, while the resources and
+	// the connection are kept. The stream is regarded as running.
+	bool suspended;
+
+	// For tx stream. The bits of MIDI ports of which the substream is running, reported by
+	// amdtp_stream_midi_trigger(). Read by the idle policy of domain.
+	unsigned long midi_inputs;
+
+	// Optional, for the PCM substreams sharing the stream. Supplied by the backend of format.
+	amdtp_stream_process_shared_pcm_t process_shared_pcm;
+
+	// For IR stream in multichannel mode, the context is a stub to keep the callback, and the
+	// packets are delivered by the receiver shared by the streams on the same controller. The
+	// headers of packets are queued till the domain of stream processes them.
+	struct amdtp_mc_receiver *mc;
+	__be32 *mc_headers;
+	unsigned int mc_count;
+	u32 mc_tstamp;
+
+	// The parameters of allocated resources for packet processing; the packet buffer and the
+	// descriptors. In warm mode of domain, the resources are kept across stop/start.
+	struct {
+		bool allocated;
+		unsigned int queue_size;
+		unsigned int max_ctx_payload_size;
+		unsigned int cache_size;
+	} resources;
+
+	// For tx stream. The sequence of tx packets observed in former session for each rate,
+	// kept across sessions.
+	struct amdtp_timing_profile *timing_profile;
+
+	// For rx stream. The size of cache in replay target measured in former session for the size
+	// of queue, kept across sessions. Zero means that the size is not measured.
+	struct {
+		unsigned int queue_size;
+		unsigned int size;
+	} replay_cache;
+
+	// The isochronous cycle of the packet which carries the frame at the PCM buffer position, and
+	// the number of cycles elapsed since the first packet for the PCM substream. For audio
+	// timestamp of link type.
+	struct {
+		seqcount_t seq;
+		bool valid;
+		unsigned int cycle;
+		u64 elapsed_cycles;
+	} pcm_tstamp;
+
+	// The page mapped by userspace for the timing of PCM frames, isochronous cycle and SYT, and
+	// the number of PCM frames since prepared.
+	struct snd_firewire_stream_timing_page *timing_page;
+	u64 timing_frames;
+
+	// The pages mapped by userspace for the descriptors of packets in the slots of queue.
+	struct snd_firewire_stream_packets_page *packets_page;
+	// The inode of hwdep device through which userspace maps the payload of packets, and the
+	// offset of the mapping.
+	struct inode *payload_inode;
+	pgoff_t payload_pgoff;
+
 	// To start processing content of packets at the same cycle in several contexts for
 	// each direction.
 	bool ready_processing;
-	wait_queue_head_t ready_wait;
 	unsigned int next_cycle;
 
-	/* For backends to process data blocks. */
-	void *protocol;
-	amdtp_stream_process_ctx_payloads_t process_ctx_payloads;
+	// For the PCM substream which spans several streams in the same direction. The PCM frames
+	// are handled since the cycle in all of the streams so that their channels are aligned in
+	// each PCM frame, and the followers don't notify the elapse of period.
+	struct {
+		bool pending;
+		bool follower;
+		unsigned int cycle;
+	} pcm_span;
+
+	// Log2 histograms for each callback of isochronous context, to see how close the stream
+	// is to underrun.
+	struct {
+		// The lag in cycles between the tstamp of context and the current cycle of bus.
+		unsigned long cycle_lag[AMDTP_STREAM_HISTOGRAM_BUCKETS];
+		// The number of packets handled per callback.
+		unsigned long packets[AMDTP_STREAM_HISTOGRAM_BUCKETS];
+		// The time in nanoseconds spent to process payloads of packets.
+		unsigned long process_ns[AMDTP_STREAM_PROCESS_NS_BUCKETS];
+		// The total time in nanoseconds and the total number of data blocks, to see the cost
+		// of protocol implementation per data block.
+		u64 process_total_ns;
+		u64 data_blocks;
+	} histogram;
+
+	// The counters of streaming events, indexed by SNDRV_FIREWIRE_STREAM_COUNTER_XXX and kept
+	// across sessions. Exposed to userspace by the control added by amdtp_stream_add_counters().
+	unsigned long counters[SNDRV_FIREWIRE_STREAM_COUNTER_COUNT];
+	bool started;
 
 	// For domain.
 	int channel;
 	int speed;
 	struct list_head list;
-	struct amdtp_domain *domain;
 };
 
+// The hot fields should not spill over the cache lines while adding new fields.
+#define AMDTP_STREAM_HOT_BYTES	384
+static_assert(sizeof_field(struct amdtp_stream, hot) <= AMDTP_STREAM_HOT_BYTES);
+
 int amdtp_stream_init(struct amdtp_stream *s, struct fw_unit *unit,
 		      enum amdtp_stream_direction dir, unsigned int flags,
 		      unsigned int fmt,
 		      amdtp_stream_process_ctx_payloads_t process_ctx_payloads,
 		      unsigned int protocol_size);
 void amdtp_stream_destroy(struct amdtp_stream *s);
+int amdtp_stream_enable_timing_profile(struct amdtp_stream *s);
 
 int amdtp_stream_set_parameters(struct amdtp_stream *s, unsigned int rate,
 				unsigned int data_block_quadlets);
 unsigned int amdtp_stream_get_max_payload(struct amdtp_stream *s);
 
 void amdtp_stream_update(struct amdtp_stream *s);
+int amdtp_stream_add_counters(struct amdtp_stream *s, struct snd_card *card, unsigned int index);
 
 int amdtp_stream_add_pcm_hw_constraints(struct amdtp_stream *s,
 					struct snd_pcm_runtime *runtime);
 
 void amdtp_stream_pcm_prepare(struct amdtp_stream *s);
+int amdtp_stream_pcm_get_time_info(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+				   struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				   struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				   struct snd_pcm_audio_tstamp_report *audio_tstamp_report);
 void amdtp_stream_pcm_abort(struct amdtp_stream *s);
 
+int amdtp_stream_add_shared_pcm(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+				unsigned int channel_offset, unsigned int channels);
+void amdtp_stream_remove_shared_pcm(struct amdtp_stream *s, struct snd_pcm_substream *pcm);
+void amdtp_stream_shared_pcm_prepare(struct amdtp_stream *s, struct snd_pcm_substream *pcm);
+void amdtp_stream_shared_pcm_trigger(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
+				     bool running);
+void amdtp_stream_mark_active(struct amdtp_stream *s);
+
+
+struct snd_info_buffer;
+void amdtp_stream_dump_histograms(struct amdtp_stream *s, struct snd_info_buffer *buffer);
+
+void amdtp_stream_build_ideal_seqs(void);
+
+#if IS_ENABLED(CONFIG_KUNIT)
+unsigned int amdtp_stream_cached_cycle_count(struct amdtp_stream *s, unsigned int head);
+void amdtp_stream_cache_seq(struct amdtp_stream *s, const struct pkt_desc *descs,
+			    unsigned int desc_count);
+void amdtp_stream_pool_replayed_seq(struct amdtp_stream *s, unsigned int count);
+#endif
+
+void amdtp_stream_queue_midi_event(struct amdtp_stream *s, const struct pkt_desc *desc,
+				   unsigned int data_block, unsigned int port,
+				   const u8 *bytes, unsigned int length);
+void amdtp_stream_midi_trigger(struct amdtp_stream *s, unsigned int port, bool running);
+
+// The number of MIDI bytes fetched at once for the packets processed in one callback.
+#define AMDTP_MIDI_BATCH_BYTES	32
+
+struct snd_rawmidi_substream;
+
+/**
+ * struct amdtp_midi_batch - MIDI bytes fetched for the batch of packets
+ * @substream: the substream from which the bytes are fetched
+ * @len: the number of fetched bytes
+ * @pos: the number of bytes already copied to packets
+ * @bytes: the fetched bytes
+ *
+ * The bytes are peeked from the substream at once by amdtp_midi_batch_fetch(), copied to
+ * data blocks by amdtp_midi_batch_pull(), then acknowledged by amdtp_midi_batch_commit(), so
+ * that the lock of rawmidi runtime is not taken per data block. In the opposite direction, the
+ * bytes in data blocks are accumulated by amdtp_midi_batch_push(), then received by the substream
+ * at once by amdtp_midi_batch_deliver().
+ */
+struct amdtp_midi_batch {
+	struct snd_rawmidi_substream *substream;
+	unsigned int len;
+	unsigned int pos;
+	u8 bytes[AMDTP_MIDI_BATCH_BYTES];
+};
+
+void amdtp_midi_batch_fetch(struct amdtp_midi_batch *batch,
+			    struct snd_rawmidi_substream *substream, unsigned int count);
+void amdtp_midi_batch_commit(struct amdtp_midi_batch *batch);
+void amdtp_midi_batch_deliver(struct amdtp_midi_batch *batch);
+
+static inline unsigned int amdtp_midi_batch_pull(struct amdtp_midi_batch *batch, u8 *dst,
+						 unsigned int count)
+{
+	count = min(count, batch->len - batch->pos);
+	memcpy(dst, batch->bytes + batch->pos, count);
+	batch->pos += count;
+
+	return count;
+}
+
+static inline void amdtp_midi_batch_push(struct amdtp_midi_batch *batch,
+					 struct snd_rawmidi_substream *substream, const u8 *src,
+					 unsigned int count)
+{
+	if (batch->substream != substream || batch->len + count > sizeof(batch->bytes)) {
+		amdtp_midi_batch_deliver(batch);
+		batch->substream = substream;
+	}
+
+	memcpy(batch->bytes + batch->len, src, count);
+	batch->len += count;
+}
+
+int amdtp_stream_get_rate_estimate(struct amdtp_stream *streams, unsigned int count,
+				   void __user *arg);
+
+struct vm_area_struct;
+int amdtp_stream_timing_mmap(struct amdtp_stream *const *streams, unsigned int count,
+			     struct vm_area_struct *area);
+
 extern const unsigned int amdtp_syt_intervals[CIP_SFC_COUNT];
 extern const unsigned int amdtp_rate_table[CIP_SFC_COUNT];
 
@@ -239,7 +537,36 @@ extern const unsigned int amdtp_rate_table[CIP_SFC_COUNT];
  */
 static inline bool amdtp_stream_running(struct amdtp_stream *s)
 {
-	return !IS_ERR(s->context);
+	return !IS_ERR(s->context) || READ_ONCE(s->suspended);
+}
+
+/**
+ * amdtp_stream_set_midi_event_ring - use the ring to deliver timestamp of incoming MIDI bytes
+ * @s: the AMDTP stream
+ * @ring: the ring, or NULL
+ *
+ * The ring should be published and waiters should be woken up by the driver, after processing
+ * packets in the stream.
+ */
+static inline void amdtp_stream_set_midi_event_ring(struct amdtp_stream *s,
+						    struct snd_fw_event_ring *ring)
+{
+	s->midi_event_ring = ring;
+}
+
+/**
+ * amdtp_stream_set_idle_payloads - inform whether the payload has consumer except for PCM
+ * @s: the AMDTP stream for incoming packets
+ * @idle: true if nothing but PCM substream consumes the payload of packets
+ *
+ * The stream is often used just to recover media clock for the other streams, thus the payload
+ * of packets is not processed when neither PCM substream nor the other consumers are attached.
+ * The context header is still processed. The stream selected as the source of direct monitoring
+ * in the domain processes the payload regardless.
+ */
+static inline void amdtp_stream_set_idle_payloads(struct amdtp_stream *s, bool idle)
+{
+	WRITE_ONCE(s->idle_payloads, idle);
 }
 
 /**
@@ -278,6 +605,8 @@ static inline void amdtp_stream_pcm_trigger(struct amdtp_stream *s,
 					    struct snd_pcm_substream *pcm)
 {
 	WRITE_ONCE(s->pcm, pcm);
+	if (pcm)
+		amdtp_stream_mark_active(s);
 }
 
 static inline bool cip_sfc_is_base_44100(enum cip_sfc sfc)
@@ -285,29 +614,189 @@ static inline bool cip_sfc_is_base_44100(enum cip_sfc sfc)
 	return sfc & 1;
 }
 
+// The syt_offset is less than CIP_SYT_CYCLE_MODULUS * TICKS_PER_CYCLE, or CIP_SYT_NO_INFO.
 struct seq_desc {
-	unsigned int syt_offset;
-	unsigned int data_blocks;
+	u16 syt_offset;
+	u16 data_blocks;
 };
 
+// The gain for the route of direct monitoring is in signed fixed-point with 16 bits fraction.
+#define AMDTP_MONITOR_GAIN_SHIFT	16
+#define AMDTP_MONITOR_GAIN_UNITY	(1 << AMDTP_MONITOR_GAIN_SHIFT)
+#define AMDTP_MONITOR_GAIN_MAX		(8 * AMDTP_MONITOR_GAIN_UNITY)
+#define AMDTP_MONITOR_MAX_ROUTES	32
+#define AMDTP_MONITOR_FIFO_BLOCKS	1024
+
+// The route from the PCM channel of captured data block to the PCM channel of outgoing data block.
+struct amdtp_monitor_route {
+	unsigned int src;
+	unsigned int dst;
+	int gain;
+};
+
+struct amdtp_monitor {
+	struct amdtp_monitor_route routes[AMDTP_MONITOR_MAX_ROUTES];
+	unsigned int route_count;
+
+	// The FIFO of captured data blocks, each of which has the samples just for the routes.
+	unsigned int head;
+	unsigned int used;
+	s32 samples[];
+};
+
+// The number of PCM substreams of which the notification of period elapsed is deferred in the pass
+// of domain. The rest is notified immediately.
+#define AMDTP_DOMAIN_DEFERRED_PCMS	16
+
 struct amdtp_domain {
 	struct list_head streams;
 
+	// The number of streams not ready to process packets yet. The waiter is woken up when it
+	// reaches zero or any stream is cancelled, within one deadline for all of the streams.
+	struct {
+		atomic_t pending;
+		bool cancelled;
+		wait_queue_head_t wait;
+	} ready;
+
 	unsigned int events_per_period;
 	unsigned int events_per_buffer;
 
+	// The interval of hardware IRQ in microseconds when the streams run just for MIDI
+	// substreams, without PCM substream deciding the period.
+	unsigned int midi_interval_us;
+
 	struct amdtp_stream *irq_target;
 
+	// The time in nanoseconds till which the isochronous context of IRQ target is not flushed
+	// again by PCM operations in process context. No packet completes within a cycle.
+	u64 next_flush_ns;
+
+	// Keep the resources of streams across stop/start while the parameters are unchanged.
+	bool warm;
+
+	// For optional suspension of the isochronous contexts after the seconds without PCM and
+	// MIDI activity. The resources and the connections of streams are kept, and the contexts
+	// are restarted at the next activity. Zero in the timeout disables the policy.
+	struct {
+		unsigned int timeout;
+		unsigned long last_active;
+		bool suspended;
+		struct work_struct work;
+	} idle;
+
+	// For optional time budget of the pass in the callback of IRQ target. When the pass exceeds
+	// the budget, the optional stages of payload processing are shed in the following passes.
+	// Zero in the budget disables the policy.
+	struct {
+		unsigned int budget_ns;
+		unsigned int passes;
+		u64 begin_ns;
+	} shedding;
+
+	// Resynchronize the stream in running isochronous context when detecting discontinuity of
+	// tx packets, instead of cancelling all of streams in the domain.
+	bool resync;
+
+	// Fill the isochronous cycles lost in tx packets with empty packets and PCM frames of
+	// silence, instead of cancelling all of streams in the domain.
+	bool conceal;
+
+	// Start IT contexts with the small number of packets queued in advance, then increase it
+	// when the callback runs late.
+	bool adaptive_queue;
+
+	// Notify period elapsed of the PCM substreams together after processing all of the
+	// isochronous contexts in the callback of IRQ target, so that the duplex client is woken up
+	// once per period.
+	bool coalesce_period;
+	struct {
+		spinlock_t lock;
+		bool deferring;
+		unsigned int count;
+		struct snd_pcm_substream *pcms[AMDTP_DOMAIN_DEFERRED_PCMS];
+	} deferred_period;
+
 	struct {
 		unsigned int tx_init_skip;
 		unsigned int tx_start;
 		unsigned int rx_start;
+		bool rx_start_pending;
+		// The cycle armed by amdtp_domain_arm_sync_start(), at which the processing begins in
+		// both directions instead of the cycle decided by the domain.
+		bool aligned;
+		unsigned int aligned_start;
 	} processing_cycle;
 
+	// For several domains to begin processing on the same cycle. The armed cycle is consumed
+	// at starting the domain.
+	struct {
+		bool armed;
+		unsigned int cycle;
+		bool missed;
+		spinlock_t lock;
+	} sync_start;
+
 	struct {
 		bool enable:1;
 		bool on_the_fly:1;
 	} replay;
+
+	// For the domains of several units on the same card to be driven by the IRQ target of
+	// leader domain. The follower domain has no IRQ target.
+	struct {
+		struct amdtp_domain *leader;
+		struct list_head followers;
+		struct list_head list;
+		bool active;
+	} group;
+
+	// For optional processing of the isochronous contexts in the kernel thread, instead of the
+	// software IRQ context for the IRQ target. The priority is for SCHED_FIFO policy, and zero
+	// disables the mode.
+	struct {
+		int cpu;
+		unsigned int priority;
+		struct task_struct *task;
+		wait_queue_head_t wait;
+		struct mutex mutex;
+		bool pending;
+	} kthread;
+
+	// For optional high resolution timer to process isochronous contexts at NO_PERIOD_WAKEUP
+	// mode of PCM substream, in which the hardware IRQ is not scheduled. Zero in the interval
+	// disables the mode.
+	struct {
+		unsigned int interval_us;
+		ktime_t interval;
+		struct hrtimer hrtimer;
+	} timer;
+
+	// The packet buffers of streams are carved from the pool in each direction, allocated once
+	// for the streams in the domain.
+	struct iso_packets_pool packet_pools[2];
+	// For optional capture of packets into the ring mapped by userspace, allocated at the first
+	// open of proc node. The lock serializes the producers, since the IRQ target can be
+	// processed in parallel to the other contexts in kernel thread mode.
+	struct {
+		struct snd_fw_event_ring *ring;
+		spinlock_t lock;
+		unsigned int quadlets;
+		struct mutex mutex;
+		bool opened;
+	} capture;
+
+	// For optional direct monitoring from the first IR context to the first IT context of AM824
+	// format. The samples of routed channels are queued at processing the IR context, then
+	// summed into the outgoing data blocks with the gain at processing the IT context. The lock
+	// serializes them, since the IRQ target can be processed in parallel to the other contexts
+	// in kernel thread mode.
+	struct {
+		struct amdtp_monitor *state;
+		struct amdtp_stream *source;
+		struct amdtp_stream *sink;
+		spinlock_t lock;
+	} monitor;
 };
 
 int amdtp_domain_init(struct amdtp_domain *d);
@@ -319,6 +808,27 @@ int amdtp_domain_add_stream(struct amdtp_domain *d, struct amdtp_stream *s,
 int amdtp_domain_start(struct amdtp_domain *d, unsigned int tx_init_skip_cycles, bool replay_seq,
 		       bool replay_on_the_fly);
 void amdtp_domain_stop(struct amdtp_domain *d);
+void amdtp_domain_update(struct amdtp_domain *d);
+
+int amdtp_domain_join(struct amdtp_domain *leader, struct amdtp_domain *follower);
+int amdtp_domain_leave(struct amdtp_domain *d);
+
+int amdtp_domain_set_kthread(struct amdtp_domain *d, int cpu, unsigned int priority);
+int amdtp_domain_set_timer_interval(struct amdtp_domain *d, unsigned int interval_us);
+int amdtp_domain_set_midi_interval(struct amdtp_domain *d, unsigned int interval_us);
+void amdtp_domain_set_warm(struct amdtp_domain *d, bool enable);
+void amdtp_domain_set_idle_timeout(struct amdtp_domain *d, unsigned int seconds);
+void amdtp_domain_set_shedding_budget(struct amdtp_domain *d, unsigned int budget_ns);
+void amdtp_domain_set_resync(struct amdtp_domain *d, bool enable);
+void amdtp_domain_set_conceal(struct amdtp_domain *d, bool enable);
+void amdtp_domain_set_adaptive_queue(struct amdtp_domain *d, bool enable);
+void amdtp_domain_set_coalesce_period(struct amdtp_domain *d, bool enable);
+void amdtp_domain_arm_sync_start(struct amdtp_domain *d, unsigned int cycle);
+void amdtp_domain_disarm_sync_start(struct amdtp_domain *d);
+int amdtp_domain_sync_start_ioctl(struct amdtp_domain *d, struct fw_unit *unit, void __user *arg);
+int amdtp_domain_set_monitor(struct amdtp_domain *d, const struct amdtp_monitor_route *routes,
+			     unsigned int count);
+void amdtp_domain_add_proc_nodes(struct amdtp_domain *d, struct snd_info_entry *root);
 
 static inline int amdtp_domain_set_events_per_period(struct amdtp_domain *d,
 						unsigned int events_per_period,
@@ -333,6 +843,14 @@ static inline int amdtp_domain_set_events_per_period(struct amdtp_domain *d,
 unsigned long amdtp_domain_stream_pcm_pointer(struct amdtp_domain *d,
 					      struct amdtp_stream *s);
 int amdtp_domain_stream_pcm_ack(struct amdtp_domain *d, struct amdtp_stream *s);
+unsigned long amdtp_domain_stream_shared_pcm_pointer(struct amdtp_domain *d,
+						     struct amdtp_stream *s,
+						     struct snd_pcm_substream *pcm);
+void amdtp_domain_streams_pcm_trigger(struct amdtp_domain *d, struct amdtp_stream *streams,
+				      unsigned int count, struct snd_pcm_substream *pcm);
+unsigned long amdtp_domain_streams_pcm_pointer(struct amdtp_domain *d,
+					       struct amdtp_stream *streams, unsigned int count,
+					       struct snd_pcm_substream *pcm);
 
 /**
  * amdtp_domain_wait_ready - sleep till being ready to process packets or timeout
@@ -343,16 +861,27 @@ int amdtp_domain_stream_pcm_ack(struct amdtp_domain *d, struct amdtp_stream *s);
  */
 static inline bool amdtp_domain_wait_ready(struct amdtp_domain *d, unsigned int timeout_ms)
 {
-	struct amdtp_stream *s;
+	unsigned int j = msecs_to_jiffies(timeout_ms);
 
-	list_for_each_entry(s, &d->streams, list) {
-		unsigned int j = msecs_to_jiffies(timeout_ms);
+	if (wait_event_interruptible_timeout(d->ready.wait,
+					     atomic_read(&d->ready.pending) == 0 ||
+					     READ_ONCE(d->ready.cancelled), j) <= 0)
+		return false;
 
-		if (wait_event_interruptible_timeout(s->ready_wait, s->ready_processing, j) <= 0)
-			return false;
-	}
+	return !READ_ONCE(d->ready.cancelled);
+}
 
-	return true;
+/**
+ * amdtp_stream_shedding - check whether the optional stages of payload processing are shed
+ * @s: the AMDTP stream
+ *
+ * The optional stages are the ones whose skip loses auxiliary information only, such as
+ * tracepoints, the timestamps of MIDI bytes, and the status of device to be scanned again. This
+ * function is expected to be called in the process_ctx_payloads callback of the stream.
+ */
+static inline bool amdtp_stream_shedding(const struct amdtp_stream *s)
+{
+	return READ_ONCE(s->domain->shedding.passes) > 0;
 }
 
 #endif
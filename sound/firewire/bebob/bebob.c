@@ -27,10 +27,18 @@ module_param_array(id, charp, NULL, 0444);
 MODULE_PARM_DESC(id, "ID string");
 module_param_array(enable, bool, NULL, 0444);
 MODULE_PARM_DESC(enable, "enable BeBoB sound card");
+#if IS_ENABLED(CONFIG_SND_UMP)
+static bool ump_endpoint;
+module_param(ump_endpoint, bool, 0444);
+MODULE_PARM_DESC(ump_endpoint, "add UMP endpoint carrying MIDI ports as groups (default: false)");
+#endif
 
 static DEFINE_MUTEX(devices_mutex);
 static DECLARE_BITMAP(devices_used, SNDRV_CARDS);
 
+/* The minimum interval to refresh the cache of meter block. */
+#define METER_CACHE_INTERVAL_MS	50
+
 /* Offsets from information register. */
 #define INFO_OFFSET_BEBOB_VERSION	0x08
 #define INFO_OFFSET_GUID		0x10
@@ -105,6 +113,12 @@ name_device(struct snd_bebob *bebob)
 	if (err < 0)
 		goto end;
 
+	/* get firmware version */
+	err = snd_bebob_read_quad(bebob->unit, INFO_OFFSET_BEBOB_VERSION,
+				  &bebob->version);
+	if (err < 0)
+		goto end;
+
 	strcpy(bebob->card->driver, "BeBoB");
 	strcpy(bebob->card->shortname, model);
 	strcpy(bebob->card->mixername, model);
@@ -128,10 +142,55 @@ bebob_card_free(struct snd_card *card)
 
 	snd_bebob_stream_destroy_duplex(bebob);
 
+	mutex_destroy(&bebob->meter_cache.mutex);
 	mutex_destroy(&bebob->mutex);
 	fw_unit_put(bebob->unit);
 }
 
+/**
+ * snd_bebob_read_meter - read the block of meters via the cache
+ * @bebob: the instance of BeBoB device
+ * @addr: the address of block
+ * @buf: the buffer to copy the block in big endian
+ * @size: the size of block
+ *
+ * The firmware handles asynchronous transactions slowly, and the frequent read of meters
+ * causes drop-outs. The block is read at most once in METER_CACHE_INTERVAL_MS, then the readers
+ * arriving while the read is in flight wait for it and share the result.
+ *
+ * Returns zero or the positive value on success, or a negative error code.
+ */
+int snd_bebob_read_meter(struct snd_bebob *bebob, u64 addr, void *buf,
+			 unsigned int size)
+{
+	int err = 0;
+
+	if (size > SND_BEBOB_METER_CACHE_BYTES)
+		return snd_fw_transaction(bebob->unit, TCODE_READ_BLOCK_REQUEST,
+					  addr, buf, size, 0);
+
+	mutex_lock(&bebob->meter_cache.mutex);
+
+	if (bebob->meter_cache.addr != addr || bebob->meter_cache.size < size ||
+	    time_after_eq(jiffies, bebob->meter_cache.expires)) {
+		err = snd_fw_transaction(bebob->unit, TCODE_READ_BLOCK_REQUEST,
+					 addr, bebob->meter_cache.buf, size, 0);
+		if (err < 0) {
+			bebob->meter_cache.size = 0;
+			goto end;
+		}
+		bebob->meter_cache.addr = addr;
+		bebob->meter_cache.size = size;
+		bebob->meter_cache.expires = jiffies + msecs_to_jiffies(METER_CACHE_INTERVAL_MS);
+	}
+
+	memcpy(buf, bebob->meter_cache.buf, size);
+end:
+	mutex_unlock(&bebob->meter_cache.mutex);
+
+	return err;
+}
+
 static const struct snd_bebob_spec *
 get_saffire_spec(struct fw_unit *unit)
 {
@@ -237,6 +296,7 @@ static int bebob_probe(struct fw_unit *unit, const struct ieee1394_device_id *en
 	mutex_init(&bebob->mutex);
 	spin_lock_init(&bebob->lock);
 	init_waitqueue_head(&bebob->hwdep_wait);
+	mutex_init(&bebob->meter_cache.mutex);
 
 	err = name_device(bebob);
 	if (err < 0)
@@ -267,6 +327,14 @@ static int bebob_probe(struct fw_unit *unit, const struct ieee1394_device_id *en
 		err = snd_bebob_create_midi_devices(bebob);
 		if (err < 0)
 			goto error;
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+		if (ump_endpoint) {
+			err = snd_bebob_create_ump_endpoint(bebob);
+			if (err < 0)
+				goto error;
+		}
+#endif
 	}
 
 	err = snd_bebob_create_pcm_devices(bebob);
@@ -324,6 +392,7 @@ bebob_update(struct fw_unit *unit)
 		return;
 
 	fcp_bus_reset(bebob->unit);
+	snd_bebob_stream_invalidate_clock(bebob);
 }
 
 static void bebob_remove(struct fw_unit *unit)
@@ -491,6 +560,7 @@ static struct fw_driver bebob_driver = {
 		.owner	= THIS_MODULE,
 		.name	= KBUILD_MODNAME,
 		.bus	= &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = bebob_probe,
 	.update	  = bebob_update,
@@ -44,6 +44,9 @@
 struct snd_bebob;
 
 #define SND_BEBOB_STRM_FMT_ENTRIES	7
+
+/* The maximum size of meter block read by vendor-specific code. */
+#define SND_BEBOB_METER_CACHE_BYTES	128
 struct snd_bebob_stream_formation {
 	unsigned int pcm;
 	unsigned int midi;
@@ -110,6 +113,31 @@ struct snd_bebob {
 
 	int sync_input_plug;
 
+	// The cache of channel mapping for each rate, invalidated at the change of stream format.
+	struct snd_bebob_channel_map {
+		bool valid;
+		u64 pcm_mask;
+		u8 pcm_positions[AM824_MAX_CHANNELS_FOR_PCM];
+		bool has_midi;
+		u8 midi_position;
+	} tx_channel_maps[SND_BEBOB_STRM_FMT_ENTRIES],
+	  rx_channel_maps[SND_BEBOB_STRM_FMT_ENTRIES];
+
+	// The cache of clock status, invalidated at starting streams, bus reset, and change.
+	struct {
+		unsigned int generation;
+		bool src_valid;
+		enum snd_bebob_clock_type src;
+		bool rate_valid;
+		unsigned int rate;
+	} clock_cache;
+
+	// The subscription to the change of signal format, to invalidate the cache.
+	struct fcp_avc_notification *clock_notification;
+
+	// The version of BeBoB firmware, to invalidate the cache of discovery.
+	u32 version;
+
 	/* for uapi */
 	int dev_lock_count;
 	bool dev_lock_changed;
@@ -118,6 +146,16 @@ struct snd_bebob {
 	/* for M-Audio special devices */
 	void *maudio_special_quirk;
 
+	// The cache of meter block shared by readers of proc and control, refreshed at most once
+	// in the interval by one read transaction in flight.
+	struct {
+		struct mutex mutex;
+		unsigned long expires;
+		u64 addr;
+		unsigned int size;
+		u8 buf[SND_BEBOB_METER_CACHE_BYTES];
+	} meter_cache;
+
 	struct amdtp_domain domain;
 };
 
@@ -137,6 +175,9 @@ snd_bebob_read_quad(struct fw_unit *unit, u64 addr, u32 *buf)
 				  (void *)buf, sizeof(u32), 0);
 }
 
+int snd_bebob_read_meter(struct snd_bebob *bebob, u64 addr, void *buf,
+			 unsigned int size);
+
 /* AV/C Audio Subunit Specification 1.0 (Oct 2000, 1394TA) */
 int avc_audio_set_selector(struct fw_unit *unit, unsigned int subunit_id,
 			   unsigned int fb_id, unsigned int num);
@@ -213,17 +254,28 @@ int avc_bridgeco_get_plug_input(struct fw_unit *unit,
 int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
 				   u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
 				   unsigned int *len, unsigned int eid);
+int avc_bridgeco_get_plug_strm_fmts(struct fw_unit *unit,
+				    u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
+				    unsigned int len, int *results,
+				    unsigned int first_eid, unsigned int count,
+				    unsigned int depth);
 
 /* for AMDTP streaming */
 int snd_bebob_stream_get_rate(struct snd_bebob *bebob, unsigned int *rate);
 int snd_bebob_stream_set_rate(struct snd_bebob *bebob, unsigned int rate);
 int snd_bebob_stream_get_clock_src(struct snd_bebob *bebob,
 				   enum snd_bebob_clock_type *src);
+int snd_bebob_stream_get_current_rate(struct snd_bebob *bebob,
+				      unsigned int *rate);
+void snd_bebob_stream_invalidate_clock(struct snd_bebob *bebob);
+void snd_bebob_stream_invalidate_channel_maps(struct snd_bebob *bebob);
 int snd_bebob_stream_discover(struct snd_bebob *bebob);
 int snd_bebob_stream_init_duplex(struct snd_bebob *bebob);
 int snd_bebob_stream_reserve_duplex(struct snd_bebob *bebob, unsigned int rate,
 				    unsigned int frames_per_period,
 				    unsigned int frames_per_buffer);
+int snd_bebob_stream_preflight(struct snd_bebob *bebob, unsigned int rate,
+			       struct fw_iso_preflight *preflight);
 int snd_bebob_stream_start_duplex(struct snd_bebob *bebob);
 void snd_bebob_stream_stop_duplex(struct snd_bebob *bebob);
 void snd_bebob_stream_destroy_duplex(struct snd_bebob *bebob);
@@ -235,6 +287,9 @@ void snd_bebob_stream_lock_release(struct snd_bebob *bebob);
 void snd_bebob_proc_init(struct snd_bebob *bebob);
 
 int snd_bebob_create_midi_devices(struct snd_bebob *bebob);
+#if IS_ENABLED(CONFIG_SND_UMP)
+int snd_bebob_create_ump_endpoint(struct snd_bebob *bebob);
+#endif
 
 int snd_bebob_create_pcm_devices(struct snd_bebob *bebob);
 
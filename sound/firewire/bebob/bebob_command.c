@@ -286,27 +286,22 @@ end:
 	return err;
 }
 
-int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
-				   u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
-				   unsigned int *len, unsigned int eid)
-{
-	int err;
-
-	/* check given buffer */
-	if ((buf == NULL) || (*len < 12)) {
-		err = -EINVAL;
-		goto end;
-	}
+#define PLUG_STRM_FMT_MATCH_BYTES \
+	(BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) | BIT(6) | BIT(7) | BIT(10))
 
+static void fill_plug_strm_fmt_command(u8 *buf, u8 addr[AVC_BRIDGECO_ADDR_BYTES],
+				       unsigned int eid)
+{
 	buf[0] = 0x01;	/* AV/C STATUS */
 	buf[2] = 0x2f;	/* AV/C STREAM FORMAT SUPPORT */
 	buf[3] = 0xc1;	/* Bridgeco extension - List Request */
 	avc_bridgeco_fill_extension_addr(buf, addr);
 	buf[10] = 0xff & eid;	/* Entry ID */
+}
 
-	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
-				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
-				  BIT(6) | BIT(7) | BIT(10));
+static int parse_plug_strm_fmt_response(u8 *buf, int err, unsigned int *len,
+					unsigned int eid)
+{
 	if (err < 0)
 		;
 	else if (err < 12)
@@ -329,3 +324,74 @@ int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
 end:
 	return err;
 }
+
+int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
+				   u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
+				   unsigned int *len, unsigned int eid)
+{
+	int err;
+
+	/* check given buffer */
+	if ((buf == NULL) || (*len < 12))
+		return -EINVAL;
+
+	fill_plug_strm_fmt_command(buf, addr, eid);
+
+	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
+				  PLUG_STRM_FMT_MATCH_BYTES);
+
+	return parse_plug_strm_fmt_response(buf, err, len, eid);
+}
+
+/*
+ * The commands for the count of entries from first_eid are in flight at the
+ * same time, up to the depth. The buffer for the i-th entry is at buf + i * len.
+ * The length of stream format info or negative error code for each entry is
+ * stored in results.
+ */
+int avc_bridgeco_get_plug_strm_fmts(struct fw_unit *unit,
+				    u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
+				    unsigned int len, int *results,
+				    unsigned int first_eid, unsigned int count,
+				    unsigned int depth)
+{
+	struct fcp_avc_command *commands;
+	unsigned int i;
+	int err;
+
+	if ((buf == NULL) || (len < 12))
+		return -EINVAL;
+
+	commands = kcalloc(count, sizeof(*commands), GFP_KERNEL);
+	if (commands == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < count; ++i) {
+		u8 *frame = buf + i * len;
+
+		fill_plug_strm_fmt_command(frame, addr, first_eid + i);
+
+		commands[i].command = frame;
+		commands[i].command_size = 12;
+		commands[i].response = frame;
+		commands[i].response_size = len;
+		commands[i].response_match_bytes = PLUG_STRM_FMT_MATCH_BYTES;
+	}
+
+	err = fcp_avc_transactions(unit, commands, count, depth);
+	if (err < 0)
+		goto end;
+
+	for (i = 0; i < count; ++i) {
+		unsigned int size = len;
+
+		results[i] = parse_plug_strm_fmt_response(buf + i * len,
+						commands[i].result, &size,
+						first_eid + i);
+		if (results[i] == 0)
+			results[i] = size;
+	}
+end:
+	kfree(commands);
+	return err;
+}
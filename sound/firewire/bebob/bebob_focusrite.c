@@ -57,26 +57,6 @@ static const unsigned int rates[] = {
 #define SAFFIRE_OFFSET_METER			0x0100
 #define SAFFIRE_LE_OFFSET_METER			0x0168
 
-static inline int
-saffire_read_block(struct snd_bebob *bebob, u64 offset,
-		   u32 *buf, unsigned int size)
-{
-	unsigned int i;
-	int err;
-	__be32 *tmp = (__be32 *)buf;
-
-	err =  snd_fw_transaction(bebob->unit, TCODE_READ_BLOCK_REQUEST,
-				  SAFFIRE_ADDRESS_BASE + offset,
-				  tmp, size, 0);
-	if (err < 0)
-		goto end;
-
-	for (i = 0; i < size / sizeof(u32); i++)
-		buf[i] = be32_to_cpu(tmp[i]);
-end:
-	return err;
-}
-
 static inline int
 saffire_read_quad(struct snd_bebob *bebob, u64 offset, u32 *value)
 {
@@ -232,7 +212,7 @@ static int
 saffire_meter_get(struct snd_bebob *bebob, u32 *buf, unsigned int size)
 {
 	const struct snd_bebob_meter_spec *spec = bebob->spec->meter;
-	unsigned int channels;
+	unsigned int i, channels;
 	u64 offset;
 	int err;
 
@@ -245,8 +225,13 @@ saffire_meter_get(struct snd_bebob *bebob, u32 *buf, unsigned int size)
 	if (size < channels * sizeof(u32))
 		return -EIO;
 
-	err = saffire_read_block(bebob, offset, buf, size);
-	if (err >= 0 && spec->labels == saffire_le_meter_labels) {
+	err = snd_bebob_read_meter(bebob, SAFFIRE_ADDRESS_BASE + offset, buf, size);
+	if (err < 0)
+		return err;
+	for (i = 0; i < size / sizeof(u32); i++)
+		be32_to_cpus(&buf[i]);
+
+	if (spec->labels == saffire_le_meter_labels) {
 		swap(buf[1], buf[3]);
 		swap(buf[2], buf[3]);
 		swap(buf[3], buf[4]);
@@ -122,6 +122,12 @@ hwdep_unlock(struct snd_bebob *bebob)
 
 	spin_unlock_irq(&bebob->lock);
 
+	// User space application may change the status of clock and the format of stream.
+	if (err == 0) {
+		snd_bebob_stream_invalidate_clock(bebob);
+		snd_bebob_stream_invalidate_channel_maps(bebob);
+	}
+
 	return err;
 }
 
@@ -129,12 +135,19 @@ static int
 hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 {
 	struct snd_bebob *bebob = hwdep->private_data;
+	bool locked = false;
 
 	spin_lock_irq(&bebob->lock);
-	if (bebob->dev_lock_count == -1)
+	if (bebob->dev_lock_count == -1) {
 		bebob->dev_lock_count = 0;
+		locked = true;
+	}
 	spin_unlock_irq(&bebob->lock);
 
+	snd_bebob_stream_invalidate_clock(bebob);
+	if (locked)
+		snd_bebob_stream_invalidate_channel_maps(bebob);
+
 	return 0;
 }
 
@@ -151,11 +164,31 @@ hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(bebob);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(bebob);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(&bebob->tx_stream, 1,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&bebob->domain, bebob->unit, (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_GET_PCM_METER:
+		return amdtp_am824_get_pcm_meter(&bebob->tx_stream, 1, &bebob->rx_stream, 1,
+						 (void __user *)arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
 }
 
+static int hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+		      struct vm_area_struct *area)
+{
+	struct snd_bebob *bebob = hwdep->private_data;
+	struct amdtp_stream *const streams[] = {
+		&bebob->tx_stream,
+		&bebob->rx_stream,
+	};
+
+	return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+}
+
 #ifdef CONFIG_COMPAT
 static int
 hwdep_compat_ioctl(struct snd_hwdep *hwdep, struct file *file,
@@ -176,6 +209,7 @@ int snd_bebob_create_hwdep_device(struct snd_bebob *bebob)
 		.poll		= hwdep_poll,
 		.ioctl		= hwdep_ioctl,
 		.ioctl_compat	= hwdep_compat_ioctl,
+		.mmap		= hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
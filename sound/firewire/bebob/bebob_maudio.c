@@ -137,9 +137,8 @@ int snd_bebob_maudio_load_firmware(struct fw_unit *unit)
 static inline int
 get_meter(struct snd_bebob *bebob, void *buf, unsigned int size)
 {
-	return snd_fw_transaction(bebob->unit, TCODE_READ_BLOCK_REQUEST,
-				  MAUDIO_SPECIFIC_ADDRESS + METER_OFFSET,
-				  buf, size, 0);
+	return snd_bebob_read_meter(bebob, MAUDIO_SPECIFIC_ADDRESS + METER_OFFSET,
+				    buf, size);
 }
 
 static int
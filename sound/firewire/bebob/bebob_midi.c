@@ -144,3 +144,105 @@ int snd_bebob_create_midi_devices(struct snd_bebob *bebob)
 
 	return 0;
 }
+
+#if IS_ENABLED(CONFIG_SND_UMP)
+static int ump_open(struct snd_ump_endpoint *ump, int dir)
+{
+	struct snd_bebob *bebob = ump->private_data;
+	int err;
+
+	err = snd_bebob_stream_lock_try(bebob);
+	if (err < 0)
+		return err;
+
+	mutex_lock(&bebob->mutex);
+	err = snd_bebob_stream_reserve_duplex(bebob, 0, 0, 0);
+	if (err >= 0) {
+		++bebob->substreams_counter;
+		err = snd_bebob_stream_start_duplex(bebob);
+		if (err < 0)
+			--bebob->substreams_counter;
+	}
+	mutex_unlock(&bebob->mutex);
+	if (err < 0)
+		snd_bebob_stream_lock_release(bebob);
+
+	return err;
+}
+
+static void ump_close(struct snd_ump_endpoint *ump, int dir)
+{
+	struct snd_bebob *bebob = ump->private_data;
+
+	mutex_lock(&bebob->mutex);
+	bebob->substreams_counter--;
+	snd_bebob_stream_stop_duplex(bebob);
+	mutex_unlock(&bebob->mutex);
+
+	snd_bebob_stream_lock_release(bebob);
+}
+
+static void ump_trigger(struct snd_ump_endpoint *ump, int dir, int up)
+{
+	struct snd_bebob *bebob = ump->private_data;
+	struct amdtp_stream *stream;
+	unsigned long flags;
+
+	if (dir == SNDRV_RAWMIDI_STREAM_INPUT)
+		stream = &bebob->tx_stream;
+	else
+		stream = &bebob->rx_stream;
+
+	spin_lock_irqsave(&bebob->lock, flags);
+	amdtp_am824_ump_trigger(stream, up ? ump : NULL);
+	spin_unlock_irqrestore(&bebob->lock, flags);
+}
+
+// The MIDI ports are carried as the groups of UMP endpoint in MIDI 1.0 protocol, so that the
+// messages in the batch of packets are delivered at once.
+int snd_bebob_create_ump_endpoint(struct snd_bebob *bebob)
+{
+	static const struct snd_ump_ops ops = {
+		.open		= ump_open,
+		.close		= ump_close,
+		.trigger	= ump_trigger,
+	};
+	unsigned int groups = max(bebob->midi_input_ports, bebob->midi_output_ports);
+	struct snd_ump_endpoint *ump;
+	unsigned int i;
+	int err;
+
+	// The device 0 is for rawmidi.
+	err = snd_ump_endpoint_new(bebob->card, bebob->card->driver, 1,
+				   bebob->midi_output_ports > 0,
+				   bebob->midi_input_ports > 0, &ump);
+	if (err < 0)
+		return err;
+
+	ump->ops = &ops;
+	ump->private_data = bebob;
+	ump->info.protocol_caps = SNDRV_UMP_EP_INFO_PROTO_MIDI1;
+	ump->info.protocol = SNDRV_UMP_EP_INFO_PROTO_MIDI1;
+	ump->info.num_blocks = groups;
+	strscpy(ump->info.name, bebob->card->shortname, sizeof(ump->info.name));
+
+	for (i = 0; i < groups; ++i) {
+		struct snd_ump_block *fb;
+		unsigned int dir;
+
+		if (i < bebob->midi_input_ports && i < bebob->midi_output_ports)
+			dir = SNDRV_UMP_DIR_BIDIRECTION;
+		else if (i < bebob->midi_input_ports)
+			dir = SNDRV_UMP_DIR_INPUT;
+		else
+			dir = SNDRV_UMP_DIR_OUTPUT;
+
+		err = snd_ump_block_new(ump, i, dir, i, 1, &fb);
+		if (err < 0)
+			return err;
+		snprintf(fb->info.name, sizeof(fb->info.name), "MIDI %d", i + 1);
+	}
+
+	return 0;
+}
+#endif
@@ -132,7 +132,6 @@ end:
 static int pcm_open(struct snd_pcm_substream *substream)
 {
 	struct snd_bebob *bebob = substream->private_data;
-	const struct snd_bebob_rate_spec *spec = bebob->spec->rate;
 	struct amdtp_domain *d = &bebob->domain;
 	enum snd_bebob_clock_type src;
 	int err;
@@ -160,7 +159,7 @@ static int pcm_open(struct snd_pcm_substream *substream)
 		unsigned int frames_per_buffer = d->events_per_buffer;
 		unsigned int sampling_rate;
 
-		err = spec->get(bebob, &sampling_rate);
+		err = snd_bebob_stream_get_current_rate(bebob, &sampling_rate);
 		if (err < 0) {
 			mutex_unlock(&bebob->mutex);
 			dev_err(&bebob->unit->device,
@@ -337,6 +336,28 @@ static int pcm_playback_ack(struct snd_pcm_substream *substream)
 	return amdtp_domain_stream_pcm_ack(&bebob->domain, &bebob->rx_stream);
 }
 
+static int pcm_capture_time_info(struct snd_pcm_substream *substream,
+				 struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				 struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				 struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_bebob *bebob = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&bebob->tx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
+static int pcm_playback_time_info(struct snd_pcm_substream *substream,
+				  struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				  struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				  struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_bebob *bebob = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&bebob->rx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
 int snd_bebob_create_pcm_devices(struct snd_bebob *bebob)
 {
 	static const struct snd_pcm_ops capture_ops = {
@@ -348,6 +369,7 @@ int snd_bebob_create_pcm_devices(struct snd_bebob *bebob)
 		.trigger	= pcm_capture_trigger,
 		.pointer	= pcm_capture_pointer,
 		.ack		= pcm_capture_ack,
+		.get_time_info	= pcm_capture_time_info,
 	};
 	static const struct snd_pcm_ops playback_ops = {
 		.open		= pcm_open,
@@ -358,6 +380,7 @@ int snd_bebob_create_pcm_devices(struct snd_bebob *bebob)
 		.trigger	= pcm_playback_trigger,
 		.pointer	= pcm_playback_pointer,
 		.ack		= pcm_playback_ack,
+		.get_time_info	= pcm_playback_time_info,
 	};
 	struct snd_pcm *pcm;
 	int err;
@@ -371,7 +394,7 @@ int snd_bebob_create_pcm_devices(struct snd_bebob *bebob)
 		 "%s PCM", bebob->card->shortname);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &playback_ops);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &capture_ops);
-	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_fw_pcm_set_managed_buffer_all(pcm);
 end:
 	return err;
 }
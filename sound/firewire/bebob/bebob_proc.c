@@ -137,12 +137,11 @@ proc_read_clock(struct snd_info_entry *entry,
 		"SYT-Match",
 	};
 	struct snd_bebob *bebob = entry->private_data;
-	const struct snd_bebob_rate_spec *rate_spec = bebob->spec->rate;
 	const struct snd_bebob_clock_spec *clk_spec = bebob->spec->clock;
 	enum snd_bebob_clock_type src;
 	unsigned int rate;
 
-	if (rate_spec->get(bebob, &rate) >= 0)
+	if (snd_bebob_stream_get_current_rate(bebob, &rate) >= 0)
 		snd_iprintf(buffer, "Sampling rate: %d\n", rate);
 
 	if (snd_bebob_stream_get_clock_src(bebob, &src) >= 0) {
@@ -155,6 +154,46 @@ proc_read_clock(struct snd_info_entry *entry,
 	}
 }
 
+static void
+proc_read_histograms(struct snd_info_entry *entry,
+		     struct snd_info_buffer *buffer)
+{
+	struct snd_bebob *bebob = entry->private_data;
+
+	snd_iprintf(buffer, "Output Stream from device:\n");
+	amdtp_stream_dump_histograms(&bebob->tx_stream, buffer);
+	snd_iprintf(buffer, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&bebob->rx_stream, buffer);
+}
+
+static void
+proc_read_preflight(struct snd_info_entry *entry,
+		    struct snd_info_buffer *buffer)
+{
+	struct snd_bebob *bebob = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	unsigned int rate;
+	int err;
+
+	if (snd_bebob_stream_get_current_rate(bebob, &rate) < 0)
+		return;
+
+	mutex_lock(&bebob->mutex);
+	err = snd_bebob_stream_preflight(bebob, rate, &preflight);
+	mutex_unlock(&bebob->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, bebob->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", bebob->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void
 add_node(struct snd_bebob *bebob, struct snd_info_entry *root, const char *name,
 	 void (*op)(struct snd_info_entry *e, struct snd_info_buffer *b))
@@ -183,6 +222,9 @@ void snd_bebob_proc_init(struct snd_bebob *bebob)
 	add_node(bebob, root, "clock", proc_read_clock);
 	add_node(bebob, root, "firmware", proc_read_hw_info);
 	add_node(bebob, root, "formation", proc_read_formation);
+	add_node(bebob, root, "histogram", proc_read_histograms);
+	add_node(bebob, root, "preflight", proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&bebob->domain, root);
 
 	if (bebob->spec->meter != NULL)
 		add_node(bebob, root, "meter", proc_read_meters);
@@ -9,6 +9,10 @@
 
 #define READY_TIMEOUT_MS	4000
 
+// Some devices need a bit time for transition. 300msec is got by some experiments.
+#define RATE_TRANSITION_MS	300
+#define RATE_TRANSITION_POLL_MS	20
+
 /*
  * NOTE;
  * For BeBoB streams, Both of input and output CMP connection are important.
@@ -92,9 +96,27 @@ end:
 	return err;
 }
 
+// Both plugs report the new rate when the transition finishes.
+static bool is_rate_settled(struct snd_bebob *bebob, unsigned int rate)
+{
+	unsigned int curr;
+	int err;
+
+	err = avc_general_get_sig_fmt(bebob->unit, &curr, AVC_GENERAL_PLUG_DIR_OUT, 0);
+	if (err < 0 || curr != rate)
+		return false;
+
+	err = avc_general_get_sig_fmt(bebob->unit, &curr, AVC_GENERAL_PLUG_DIR_IN, 0);
+	if (err < 0 || curr != rate)
+		return false;
+
+	return true;
+}
+
 int
 snd_bebob_stream_set_rate(struct snd_bebob *bebob, unsigned int rate)
 {
+	unsigned long expires;
 	int err;
 
 	err = avc_general_set_sig_fmt(bebob->unit, rate,
@@ -107,17 +129,19 @@ snd_bebob_stream_set_rate(struct snd_bebob *bebob, unsigned int rate)
 	if (err < 0)
 		goto end;
 
-	/*
-	 * Some devices need a bit time for transition.
-	 * 300msec is got by some experiments.
-	 */
-	msleep(300);
+	// Poll till the transition finishes, up to the time for the slowest device.
+	expires = jiffies + msecs_to_jiffies(RATE_TRANSITION_MS);
+	while (!is_rate_settled(bebob, rate)) {
+		if (time_after(jiffies, expires))
+			break;
+		msleep(RATE_TRANSITION_POLL_MS);
+	}
 end:
 	return err;
 }
 
-int snd_bebob_stream_get_clock_src(struct snd_bebob *bebob,
-				   enum snd_bebob_clock_type *src)
+static int read_clock_src(struct snd_bebob *bebob,
+			  enum snd_bebob_clock_type *src)
 {
 	const struct snd_bebob_clock_spec *clk_spec = bebob->spec->clock;
 	u8 addr[AVC_BRIDGECO_ADDR_BYTES], input[7];
@@ -251,7 +275,100 @@ end:
 	return err;
 }
 
-static int map_data_channels(struct snd_bebob *bebob, struct amdtp_stream *s)
+/*
+ * The clock source and the sampling rate are kept in the cache till streams
+ * start, bus reset, or the change by this driver, so that the readers of proc
+ * and PCM open don't issue AV/C transactions each time. The generation count
+ * prevents a query in flight from storing the stale status after invalidation.
+ */
+void snd_bebob_stream_invalidate_clock(struct snd_bebob *bebob)
+{
+	spin_lock_irq(&bebob->lock);
+	bebob->clock_cache.generation++;
+	bebob->clock_cache.src_valid = false;
+	bebob->clock_cache.rate_valid = false;
+	spin_unlock_irq(&bebob->lock);
+}
+
+static void clock_changed(void *private_data, const u8 *frame, int length)
+{
+	struct snd_bebob *bebob = private_data;
+
+	snd_bebob_stream_invalidate_clock(bebob);
+}
+
+int snd_bebob_stream_get_clock_src(struct snd_bebob *bebob,
+				   enum snd_bebob_clock_type *src)
+{
+	unsigned int generation;
+	int err;
+
+	spin_lock_irq(&bebob->lock);
+	if (bebob->clock_cache.src_valid) {
+		*src = bebob->clock_cache.src;
+		spin_unlock_irq(&bebob->lock);
+		return 0;
+	}
+	generation = bebob->clock_cache.generation;
+	spin_unlock_irq(&bebob->lock);
+
+	err = read_clock_src(bebob, src);
+	if (err < 0)
+		return err;
+
+	spin_lock_irq(&bebob->lock);
+	if (generation == bebob->clock_cache.generation) {
+		bebob->clock_cache.src = *src;
+		bebob->clock_cache.src_valid = true;
+	}
+	spin_unlock_irq(&bebob->lock);
+
+	return 0;
+}
+
+/*
+ * The rate follows the external signal, thus it is not cached while the source
+ * of clock is external unless the unit reports the change of signal format.
+ */
+int snd_bebob_stream_get_current_rate(struct snd_bebob *bebob,
+				      unsigned int *rate)
+{
+	enum snd_bebob_clock_type src;
+	unsigned int generation;
+	int err;
+
+	err = snd_bebob_stream_get_clock_src(bebob, &src);
+	if (err < 0)
+		return err;
+	if (src == SND_BEBOB_CLOCK_TYPE_EXTERNAL &&
+	    !fcp_avc_notification_armed(bebob->clock_notification))
+		return bebob->spec->rate->get(bebob, rate);
+
+	spin_lock_irq(&bebob->lock);
+	if (bebob->clock_cache.rate_valid) {
+		*rate = bebob->clock_cache.rate;
+		spin_unlock_irq(&bebob->lock);
+		return 0;
+	}
+	generation = bebob->clock_cache.generation;
+	spin_unlock_irq(&bebob->lock);
+
+	err = bebob->spec->rate->get(bebob, rate);
+	if (err < 0)
+		return err;
+
+	spin_lock_irq(&bebob->lock);
+	if (generation == bebob->clock_cache.generation) {
+		bebob->clock_cache.rate = *rate;
+		bebob->clock_cache.rate_valid = true;
+	}
+	spin_unlock_irq(&bebob->lock);
+
+	return 0;
+}
+
+static int read_channel_map(struct snd_bebob *bebob, struct amdtp_stream *s,
+			    struct snd_bebob_channel_map *map)
 {
 	unsigned int sec, sections, ch, channels;
 	unsigned int pcm, midi, location;
@@ -337,7 +454,8 @@ static int map_data_channels(struct snd_bebob *bebob, struct amdtp_stream *s)
 					err = -ENOSYS;
 					goto end;
 				}
-				amdtp_am824_set_midi_position(s, stm_pos);
+				map->midi_position = stm_pos;
+				map->has_midi = true;
 				midi = stm_pos;
 				break;
 			/* for PCM data channel */
@@ -357,8 +475,8 @@ static int map_data_channels(struct snd_bebob *bebob, struct amdtp_stream *s)
 					err = -ENOSYS;
 					goto end;
 				}
-				amdtp_am824_set_pcm_position(s, location,
-							     stm_pos);
+				map->pcm_positions[location] = stm_pos;
+				map->pcm_mask |= BIT_ULL(location);
 				break;
 			}
 		}
@@ -373,6 +491,54 @@ end:
 	return err;
 }
 
+/*
+ * The mapping is queried by several AV/C transactions, thus it is cached for
+ * the rate of stream till the stream format is changed.
+ */
+static int map_data_channels(struct snd_bebob *bebob, struct amdtp_stream *s)
+{
+	struct snd_bebob_channel_map *map;
+	unsigned int i;
+	int err;
+
+	if (s->sfc >= SND_BEBOB_STRM_FMT_ENTRIES)
+		return -EINVAL;
+
+	if (s == &bebob->tx_stream)
+		map = &bebob->tx_channel_maps[s->sfc];
+	else
+		map = &bebob->rx_channel_maps[s->sfc];
+
+	if (!map->valid) {
+		memset(map, 0, sizeof(*map));
+		err = read_channel_map(bebob, s, map);
+		if (err < 0)
+			return err;
+		map->valid = true;
+	}
+
+	for (i = 0; i < AM824_MAX_CHANNELS_FOR_PCM; ++i) {
+		if (map->pcm_mask & BIT_ULL(i))
+			amdtp_am824_set_pcm_position(s, i, map->pcm_positions[i]);
+	}
+	if (map->has_midi)
+		amdtp_am824_set_midi_position(s, map->midi_position);
+
+	return 0;
+}
+
+void snd_bebob_stream_invalidate_channel_maps(struct snd_bebob *bebob)
+{
+	unsigned int i;
+
+	mutex_lock(&bebob->mutex);
+	for (i = 0; i < SND_BEBOB_STRM_FMT_ENTRIES; ++i) {
+		bebob->tx_channel_maps[i].valid = false;
+		bebob->rx_channel_maps[i].valid = false;
+	}
+	mutex_unlock(&bebob->mutex);
+}
+
 static int
 check_connection_used_by_others(struct snd_bebob *bebob, struct amdtp_stream *s)
 {
@@ -406,26 +572,33 @@ static void break_both_connections(struct snd_bebob *bebob)
 static int start_stream(struct snd_bebob *bebob, struct amdtp_stream *stream)
 {
 	struct cmp_connection *conn;
-	int err = 0;
 
 	if (stream == &bebob->rx_stream)
 		conn = &bebob->in_conn;
 	else
 		conn = &bebob->out_conn;
 
+	return amdtp_domain_add_stream(&bebob->domain, stream,
+				       conn->resources.channel, conn->speed);
+}
+
+static int make_both_connections(struct snd_bebob *bebob)
+{
+	int err;
+
 	// channel mapping.
 	if (bebob->maudio_special_quirk == NULL) {
-		err = map_data_channels(bebob, stream);
+		err = map_data_channels(bebob, &bebob->rx_stream);
 		if (err < 0)
 			return err;
-	}
 
-	err = cmp_connection_establish(conn);
-	if (err < 0)
-		return err;
+		err = map_data_channels(bebob, &bebob->tx_stream);
+		if (err < 0)
+			return err;
+	}
 
-	return amdtp_domain_add_stream(&bebob->domain, stream,
-				       conn->resources.channel, conn->speed);
+	// The lock requests to both plugs are in flight at the same time.
+	return cmp_connections_establish(&bebob->in_conn, &bebob->out_conn);
 }
 
 static int init_stream(struct snd_bebob *bebob, struct amdtp_stream *stream)
@@ -461,6 +634,24 @@ static int init_stream(struct snd_bebob *bebob, struct amdtp_stream *stream)
 		return err;
 	}
 
+	err = amdtp_stream_add_counters(stream, bebob->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(stream);
+		cmp_connection_destroy(conn);
+		return err;
+	}
+
+	// BeBoB takes long time to transfer available packets. Replay the timing of packets
+	// recorded in the former session till the cache of tx packets is primed.
+	if (stream == &bebob->tx_stream) {
+		err = amdtp_stream_enable_timing_profile(stream);
+		if (err < 0) {
+			amdtp_stream_destroy(stream);
+			cmp_connection_destroy(conn);
+			return err;
+		}
+	}
+
 	return 0;
 }
 
@@ -492,34 +683,92 @@ int snd_bebob_stream_init_duplex(struct snd_bebob *bebob)
 	if (err < 0) {
 		destroy_stream(bebob, &bebob->tx_stream);
 		destroy_stream(bebob, &bebob->rx_stream);
+		return err;
 	}
 
-	return err;
+	// The change of sampling rate is reported by the signal format of output plug, if supported.
+	// The firmware customized by M-Audio is operated by its vendor-specific commands instead.
+	if (!bebob->maudio_special_quirk) {
+		bebob->clock_notification = avc_general_notify_sig_fmt(bebob->unit,
+						AVC_GENERAL_PLUG_DIR_OUT, 0, clock_changed, bebob);
+		if (IS_ERR(bebob->clock_notification)) {
+			dev_dbg(&bebob->unit->device, "fail to subscribe to signal format: %ld\n",
+				PTR_ERR(bebob->clock_notification));
+			bebob->clock_notification = NULL;
+		}
+	}
+
+	return 0;
 }
 
-static int keep_resources(struct snd_bebob *bebob, struct amdtp_stream *stream,
-			  unsigned int rate, unsigned int index)
+static int set_stream_parameters(struct snd_bebob *bebob, struct amdtp_stream *stream,
+				 unsigned int rate, unsigned int index)
 {
 	unsigned int pcm_channels;
 	unsigned int midi_ports;
-	struct cmp_connection *conn;
-	int err;
 
 	if (stream == &bebob->tx_stream) {
 		pcm_channels = bebob->tx_stream_formations[index].pcm;
 		midi_ports = bebob->midi_input_ports;
-		conn = &bebob->out_conn;
 	} else {
 		pcm_channels = bebob->rx_stream_formations[index].pcm;
 		midi_ports = bebob->midi_output_ports;
-		conn = &bebob->in_conn;
 	}
 
-	err = amdtp_am824_set_parameters(stream, rate, pcm_channels, midi_ports, false);
+	return amdtp_am824_set_parameters(stream, rate, pcm_channels, midi_ports, false);
+}
+
+static int keep_resources(struct snd_bebob *bebob, struct amdtp_stream *stream,
+			  unsigned int rate, unsigned int index)
+{
+	struct cmp_connection *conn;
+	int err;
+
+	if (stream == &bebob->tx_stream)
+		conn = &bebob->out_conn;
+	else
+		conn = &bebob->in_conn;
+
+	err = set_stream_parameters(bebob, stream, rate, index);
 	if (err < 0)
 		return err;
 
-	return cmp_connection_reserve(conn, amdtp_stream_get_max_payload(stream));
+	return cmp_connection_adjust(conn, amdtp_stream_get_max_payload(stream));
+}
+
+// Count the resources which snd_bebob_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The parameters of streams are changed only when they are not reserved yet.
+int snd_bebob_stream_preflight(struct snd_bebob *bebob, unsigned int rate,
+			       struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(bebob->unit)->max_speed;
+	int err;
+
+	if (bebob->substreams_counter == 0) {
+		unsigned int index;
+
+		err = get_formation_index(rate, &index);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(bebob, &bebob->tx_stream, rate, index);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(bebob, &bebob->rx_stream, rate, index);
+		if (err < 0)
+			return err;
+	}
+
+	// The speed is decided in the same way as CMP connection.
+	fw_iso_preflight_add(preflight, bebob->unit, FW_ISO_CONTEXT_RECEIVE,
+			     amdtp_stream_get_max_payload(&bebob->tx_stream),
+			     min(bebob->out_conn.max_speed, speed));
+	fw_iso_preflight_add(preflight, bebob->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&bebob->rx_stream),
+			     min(bebob->in_conn.max_speed, speed));
+
+	return 0;
 }
 
 int snd_bebob_stream_reserve_duplex(struct snd_bebob *bebob, unsigned int rate,
@@ -540,12 +789,10 @@ int snd_bebob_stream_reserve_duplex(struct snd_bebob *bebob, unsigned int rate,
 		return err;
 	if (rate == 0)
 		rate = curr_rate;
+	// The isochronous resources are kept if they are enough for the new rate.
 	if (curr_rate != rate) {
 		amdtp_domain_stop(&bebob->domain);
 		break_both_connections(bebob);
-
-		cmp_connection_release(&bebob->out_conn);
-		cmp_connection_release(&bebob->in_conn);
 	}
 
 	if (bebob->substreams_counter == 0 || curr_rate != rate) {
@@ -557,6 +804,7 @@ int snd_bebob_stream_reserve_duplex(struct snd_bebob *bebob, unsigned int rate,
 		//
 		// For firmware customized by M-Audio, refer to next NOTE.
 		err = bebob->spec->rate->set(bebob, rate);
+		snd_bebob_stream_invalidate_clock(bebob);
 		if (err < 0) {
 			dev_err(&bebob->unit->device,
 				"fail to set sampling rate: %d\n",
@@ -610,6 +858,9 @@ int snd_bebob_stream_start_duplex(struct snd_bebob *bebob)
 		unsigned int curr_rate;
 		unsigned int tx_init_skip_cycles;
 
+		// The status of clock is read again for the streams.
+		snd_bebob_stream_invalidate_clock(bebob);
+
 		if (bebob->maudio_special_quirk) {
 			err = bebob->spec->rate->get(bebob, &curr_rate);
 			if (err < 0)
@@ -620,6 +871,10 @@ int snd_bebob_stream_start_duplex(struct snd_bebob *bebob)
 		if (err < 0)
 			return err;
 
+		err = make_both_connections(bebob);
+		if (err < 0)
+			goto error;
+
 		err = start_stream(bebob, &bebob->rx_stream);
 		if (err < 0)
 			goto error;
@@ -690,6 +945,9 @@ void snd_bebob_stream_stop_duplex(struct snd_bebob *bebob)
  */
 void snd_bebob_stream_destroy_duplex(struct snd_bebob *bebob)
 {
+	fcp_avc_notification_destroy(bebob->clock_notification);
+	bebob->clock_notification = NULL;
+
 	amdtp_domain_destroy(&bebob->domain);
 
 	destroy_stream(bebob, &bebob->tx_stream);
@@ -776,8 +1034,9 @@ static int fill_stream_formations(struct snd_bebob *bebob, u8 addr[AVC_BRIDGECO_
 				  struct snd_bebob_stream_formation *formations)
 {
 	enum avc_bridgeco_plug_type plug_type;
+	int results[FCP_AVC_MAX_DEPTH];
 	u8 *buf;
-	unsigned int len, eid;
+	unsigned int eid, count, i;
 	int err;
 
 	avc_bridgeco_fill_unit_addr(addr, plug_dir, AVC_BRIDGECO_PLUG_UNIT_ISOC, plug_id);
@@ -790,31 +1049,41 @@ static int fill_stream_formations(struct snd_bebob *bebob, u8 addr[AVC_BRIDGECO_
 	} else if (plug_type != AVC_BRIDGECO_PLUG_TYPE_ISOC)
 		return -ENXIO;
 
-	buf = kmalloc(FORMAT_MAXIMUM_LENGTH, GFP_KERNEL);
+	buf = kmalloc_array(FCP_AVC_MAX_DEPTH, FORMAT_MAXIMUM_LENGTH, GFP_KERNEL);
 	if (buf == NULL)
 		return -ENOMEM;
 
-	for (eid = 0; eid < SND_BEBOB_STRM_FMT_ENTRIES; ++eid) {
-		avc_bridgeco_fill_unit_addr(addr, plug_dir, AVC_BRIDGECO_PLUG_UNIT_ISOC, plug_id);
-
-		len = FORMAT_MAXIMUM_LENGTH;
-		err = avc_bridgeco_get_plug_strm_fmt(bebob->unit, addr, buf, &len, eid);
-		// No entries remained.
-		if (err == -EINVAL && eid > 0) {
-			err = 0;
-			break;
-		} else if (err < 0) {
-			dev_err(&bebob->unit->device,
-				"fail to get stream format %d for isoc %d plug %d:%d\n",
-				eid, plug_dir, plug_id, err);
-			break;
-		}
-
-		err = parse_stream_formation(buf, len, formations);
+	// The commands for the entries in each chunk are in flight at the same time. The query
+	// stops at the chunk including the first rejected entry, thus the commands beyond the end
+	// of list are fewer than the depth.
+	for (eid = 0; eid < SND_BEBOB_STRM_FMT_ENTRIES; eid += count) {
+		count = min_t(unsigned int, FCP_AVC_MAX_DEPTH, SND_BEBOB_STRM_FMT_ENTRIES - eid);
+		err = avc_bridgeco_get_plug_strm_fmts(bebob->unit, addr, buf,
+						      FORMAT_MAXIMUM_LENGTH, results, eid, count,
+						      FCP_AVC_MAX_DEPTH);
 		if (err < 0)
 			break;
-	}
 
+		for (i = 0; i < count; ++i) {
+			err = results[i];
+			// No entries remained.
+			if (err == -EINVAL && eid + i > 0) {
+				err = 0;
+				goto end;
+			} else if (err < 0) {
+				dev_err(&bebob->unit->device,
+					"fail to get stream format %d for isoc %d plug %d:%d\n",
+					eid + i, plug_dir, plug_id, err);
+				goto end;
+			}
+
+			err = parse_stream_formation(buf + i * FORMAT_MAXIMUM_LENGTH, err,
+						     formations);
+			if (err < 0)
+				goto end;
+		}
+	}
+end:
 	kfree(buf);
 	return err;
 }
@@ -905,12 +1174,89 @@ end:
 	return err;
 }
 
+// The result of discovery to be cached.
+struct discovery_cache {
+	struct snd_bebob_stream_formation tx_stream_formations[SND_BEBOB_STRM_FMT_ENTRIES];
+	struct snd_bebob_stream_formation rx_stream_formations[SND_BEBOB_STRM_FMT_ENTRIES];
+	unsigned int midi_input_ports;
+	unsigned int midi_output_ports;
+	int sync_input_plug;
+};
+
+// Just the first entry of stream format for isoc input plug is queried to validate the cache.
+static int load_discovery_cache(struct snd_bebob *bebob)
+{
+	struct snd_bebob_stream_formation formations[SND_BEBOB_STRM_FMT_ENTRIES] = {0};
+	struct discovery_cache cache;
+	u8 addr[AVC_BRIDGECO_ADDR_BYTES];
+	unsigned int len;
+	u8 *buf;
+	int i;
+	int err;
+
+	err = snd_fw_discovery_cache_load(bebob->unit, bebob->version, &cache, sizeof(cache));
+	if (err < 0)
+		return err;
+
+	buf = kmalloc(FORMAT_MAXIMUM_LENGTH, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	avc_bridgeco_fill_unit_addr(addr, AVC_BRIDGECO_PLUG_DIR_IN, AVC_BRIDGECO_PLUG_UNIT_ISOC, 0);
+	len = FORMAT_MAXIMUM_LENGTH;
+	err = avc_bridgeco_get_plug_strm_fmt(bebob->unit, addr, buf, &len, 0);
+	if (err >= 0)
+		err = parse_stream_formation(buf, len, formations);
+	kfree(buf);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < SND_BEBOB_STRM_FMT_ENTRIES; ++i) {
+		if (formations[i].pcm == 0 && formations[i].midi == 0)
+			continue;
+		if (formations[i].pcm != cache.rx_stream_formations[i].pcm ||
+		    formations[i].midi != cache.rx_stream_formations[i].midi) {
+			snd_fw_discovery_cache_invalidate(bebob->unit);
+			return -ENODATA;
+		}
+	}
+
+	memcpy(bebob->tx_stream_formations, cache.tx_stream_formations,
+	       sizeof(bebob->tx_stream_formations));
+	memcpy(bebob->rx_stream_formations, cache.rx_stream_formations,
+	       sizeof(bebob->rx_stream_formations));
+	bebob->midi_input_ports = cache.midi_input_ports;
+	bebob->midi_output_ports = cache.midi_output_ports;
+	bebob->sync_input_plug = cache.sync_input_plug;
+
+	return 0;
+}
+
+static void store_discovery_cache(struct snd_bebob *bebob)
+{
+	struct discovery_cache cache = {0};
+
+	memcpy(cache.tx_stream_formations, bebob->tx_stream_formations,
+	       sizeof(cache.tx_stream_formations));
+	memcpy(cache.rx_stream_formations, bebob->rx_stream_formations,
+	       sizeof(cache.rx_stream_formations));
+	cache.midi_input_ports = bebob->midi_input_ports;
+	cache.midi_output_ports = bebob->midi_output_ports;
+	cache.sync_input_plug = bebob->sync_input_plug;
+
+	// The failure just loses the chance of cache.
+	snd_fw_discovery_cache_store(bebob->unit, bebob->version, &cache, sizeof(cache));
+}
+
 int snd_bebob_stream_discover(struct snd_bebob *bebob)
 {
 	const struct snd_bebob_clock_spec *clk_spec = bebob->spec->clock;
 	u8 plugs[AVC_PLUG_INFO_BUF_BYTES], addr[AVC_BRIDGECO_ADDR_BYTES];
 	int err;
 
+	if (load_discovery_cache(bebob) >= 0)
+		return 0;
+
 	/* the number of plugs for isoc in/out, ext in/out  */
 	err = avc_general_get_plug_info(bebob->unit, 0x1f, 0x07, 0x00, plugs);
 	if (err < 0) {
@@ -950,8 +1296,13 @@ int snd_bebob_stream_discover(struct snd_bebob *bebob)
 		goto end;
 
 	/* for check source of clock later */
-	if (!clk_spec)
+	if (!clk_spec) {
 		err = seek_msu_sync_input_plug(bebob);
+		if (err < 0)
+			goto end;
+	}
+
+	store_discovery_cache(bebob);
 end:
 	return err;
 }
@@ -960,6 +1311,7 @@ void snd_bebob_stream_lock_changed(struct snd_bebob *bebob)
 {
 	bebob->dev_lock_changed = true;
 	wake_up(&bebob->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(bebob->card, bebob->dev_lock_count > 0);
 }
 
 int snd_bebob_stream_lock_try(struct snd_bebob *bebob)
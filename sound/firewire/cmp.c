@@ -9,6 +9,7 @@
 #include <linux/firewire.h>
 #include <linux/firewire-constants.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 #include "lib.h"
 #include "iso-resources.h"
 #include "cmp.h"
@@ -164,10 +165,16 @@ int cmp_connection_check_used(struct cmp_connection *c, bool *used)
 	err = snd_fw_transaction(
 			c->resources.unit, TCODE_READ_QUADLET_REQUEST,
 			pcr_address(c), &pcr, 4, 0);
-	if (err >= 0)
+	if (err >= 0) {
 		*used = !!(pcr & cpu_to_be32(PCR_BCAST_CONN |
 					     PCR_P2P_CONN_MASK));
 
+		// The value is used as the first compare value of lock request.
+		mutex_lock(&c->mutex);
+		c->last_pcr_value = pcr;
+		mutex_unlock(&c->mutex);
+	}
+
 	return err;
 }
 EXPORT_SYMBOL(cmp_connection_check_used);
@@ -208,6 +215,48 @@ end:
 }
 EXPORT_SYMBOL(cmp_connection_reserve);
 
+/**
+ * cmp_connection_adjust - adjust isochronous resources for the new parameters
+ * @c: the connection manager
+ * @max_payload_bytes: the amount of data (including CIP headers) per packet
+ *
+ * When the isochronous resources are already reserved, the channel is kept and
+ * just the difference of bandwidth is allocated or returned to the isochronous
+ * resource manager at changing sampling rate. Otherwise, or when it fails, they
+ * are released if reserved, then reserved again. The connection should be
+ * broken beforehand.
+ */
+int cmp_connection_adjust(struct cmp_connection *c,
+			  unsigned int max_payload_bytes)
+{
+	int err = 0;
+
+	mutex_lock(&c->mutex);
+
+	if (WARN_ON(c->connected)) {
+		err = -EISCONN;
+		goto end;
+	}
+
+	c->speed = min(c->max_speed,
+		       fw_parent_device(c->resources.unit)->max_speed);
+
+	err = fw_iso_resources_resize(&c->resources, max_payload_bytes,
+				      c->speed);
+	if (err >= 0)
+		goto end;
+
+	fw_iso_resources_free(&c->resources);
+
+	err = fw_iso_resources_allocate(&c->resources, max_payload_bytes,
+					c->speed);
+end:
+	mutex_unlock(&c->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(cmp_connection_adjust);
+
 void cmp_connection_release(struct cmp_connection *c)
 {
 	mutex_lock(&c->mutex);
@@ -332,6 +381,146 @@ retry_after_bus_reset:
 }
 EXPORT_SYMBOL(cmp_connection_establish);
 
+static __be32 pcr_break_modify(struct cmp_connection *c, __be32 pcr)
+{
+	return pcr & ~cpu_to_be32(PCR_BCAST_CONN | PCR_P2P_CONN_MASK);
+}
+
+static __be32 pcr_set_modify(struct cmp_connection *c, __be32 pcr)
+{
+	if (c->direction == CMP_OUTPUT)
+		return opcr_set_modify(c, pcr);
+	else
+		return ipcr_set_modify(c, pcr);
+}
+
+/**
+ * cmp_connections_establish - establish connections to the target at once
+ * @in: the connection manager for the input plug
+ * @out: the connection manager for the output plug
+ *
+ * This function is the same as calling cmp_connection_establish() for both
+ * connection managers, while the lock requests to both plugs are in flight at
+ * the same time. On failure, neither of the connections is established.
+ */
+int cmp_connections_establish(struct cmp_connection *in,
+			      struct cmp_connection *out)
+{
+	struct cmp_connection *conns[2] = { in, out };
+	struct snd_fw_request requests[2];
+	__be32 (*buffers)[2];
+	__be32 old_args[2];
+	unsigned int pending;
+	unsigned int generation;
+	int i, err;
+
+	buffers = kmalloc_array(ARRAY_SIZE(conns), sizeof(*buffers), GFP_KERNEL);
+	if (!buffers)
+		return -ENOMEM;
+
+	mutex_lock(&in->mutex);
+	mutex_lock_nested(&out->mutex, SINGLE_DEPTH_NESTING);
+
+	if (WARN_ON(in->connected || out->connected)) {
+		err = -EISCONN;
+		goto end;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(conns); ++i)
+		old_args[i] = conns[i]->last_pcr_value;
+	pending = BIT(0) | BIT(1);
+
+	err = 0;
+	while (pending) {
+		unsigned int count = 0;
+
+		// The requests are sent in the generation of resources. After bus reset,
+		// both of them are updated.
+		generation = in->resources.generation;
+		if (out->resources.generation != generation) {
+			err = fw_iso_resources_update(&in->resources);
+			if (err >= 0)
+				err = fw_iso_resources_update(&out->resources);
+			if (err < 0)
+				break;
+			continue;
+		}
+
+		for (i = 0; i < ARRAY_SIZE(conns); ++i) {
+			struct cmp_connection *c = conns[i];
+
+			if (!(pending & BIT(i)))
+				continue;
+
+			buffers[i][0] = old_args[i];
+			buffers[i][1] = pcr_set_modify(c, old_args[i]);
+
+			requests[count] = (struct snd_fw_request) {
+				.tcode = TCODE_LOCK_COMPARE_SWAP,
+				.offset = pcr_address(c),
+				.buffer = buffers[i],
+				.length = sizeof(buffers[i]),
+			};
+			++count;
+		}
+
+		err = snd_fw_transactions(in->resources.unit, requests, count,
+					  FW_FIXED_GENERATION | generation);
+		if (err < 0)
+			break;
+
+		// Consume all of the results so that any connection established in the device is
+		// rolled back even if the other one fails.
+		count = 0;
+		for (i = 0; i < ARRAY_SIZE(conns); ++i) {
+			struct cmp_connection *c = conns[i];
+			int result;
+
+			if (!(pending & BIT(i)))
+				continue;
+
+			result = requests[count++].result;
+			if (result == -EAGAIN) {
+				result = fw_iso_resources_update(&c->resources);
+			} else if (result >= 0) {
+				if (buffers[i][0] == old_args[i]) {
+					c->last_pcr_value = buffers[i][1];
+					c->connected = true;
+					pending &= ~BIT(i);
+				} else {
+					result = pcr_set_check(c, buffers[i][0]);
+					old_args[i] = buffers[i][0];
+				}
+			}
+			if (result < 0 && err >= 0)
+				err = result;
+		}
+		if (err < 0)
+			break;
+	}
+
+	// Roll back the connection established in the call.
+	if (err < 0) {
+		for (i = 0; i < ARRAY_SIZE(conns); ++i) {
+			struct cmp_connection *c = conns[i];
+
+			if (c->connected) {
+				pcr_modify(c, pcr_break_modify, NULL,
+					   SUCCEED_ON_BUS_RESET);
+				c->connected = false;
+			}
+		}
+	}
+end:
+	mutex_unlock(&out->mutex);
+	mutex_unlock(&in->mutex);
+
+	kfree(buffers);
+
+	return err;
+}
+EXPORT_SYMBOL(cmp_connections_establish);
+
 /**
  * cmp_connection_update - update the connection after a bus reset
  * @c: the connection manager
@@ -379,11 +568,6 @@ err_unconnect:
 }
 EXPORT_SYMBOL(cmp_connection_update);
 
-static __be32 pcr_break_modify(struct cmp_connection *c, __be32 pcr)
-{
-	return pcr & ~cpu_to_be32(PCR_BCAST_CONN | PCR_P2P_CONN_MASK);
-}
-
 /**
  * cmp_connection_break - break the connection to the target
  * @c: the connection manager
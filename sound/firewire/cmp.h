@@ -44,9 +44,13 @@ void cmp_connection_destroy(struct cmp_connection *connection);
 
 int cmp_connection_reserve(struct cmp_connection *connection,
 			   unsigned int max_payload);
+int cmp_connection_adjust(struct cmp_connection *connection,
+			  unsigned int max_payload_bytes);
 void cmp_connection_release(struct cmp_connection *connection);
 
 int cmp_connection_establish(struct cmp_connection *connection);
+int cmp_connections_establish(struct cmp_connection *in,
+			      struct cmp_connection *out);
 int cmp_connection_update(struct cmp_connection *connection);
 void cmp_connection_break(struct cmp_connection *connection);
 
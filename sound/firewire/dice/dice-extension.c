@@ -67,6 +67,9 @@ static int read_stream_entries(struct snd_dice *dice, u64 section_addr,
 	int err;
 	int i;
 
+	// The entries beyond the streams supported by this driver are ignored.
+	stream_count = min_t(unsigned int, stream_count, MAX_STREAMS);
+
 	for (i = 0; i < stream_count; ++i) {
 		entry_offset = base_offset + i * EXT_APP_STREAM_ENTRY_SIZE;
 		err = read_transaction(dice, section_addr,
@@ -124,6 +124,47 @@ static int hwdep_unlock(struct snd_dice *dice)
 	return err;
 }
 
+static int hwdep_join_domain(struct snd_dice *dice, void __user *arg)
+{
+	struct snd_firewire_join_domain join;
+	struct snd_card *card;
+	struct snd_dice *leader;
+	int err;
+
+	if (copy_from_user(&join, arg, sizeof(join)))
+		return -EFAULT;
+
+	if (join.card < 0) {
+		mutex_lock(&dice->mutex);
+		err = amdtp_domain_leave(&dice->domain);
+		mutex_unlock(&dice->mutex);
+		return err;
+	}
+
+	card = snd_card_ref(join.card);
+	if (!card)
+		return -ENODEV;
+
+	// The other unit should be handled by this driver.
+	if (strcmp(card->driver, dice->card->driver) != 0) {
+		err = -EINVAL;
+		goto end;
+	}
+	leader = card->private_data;
+
+	if (fw_parent_device(leader->unit)->card != fw_parent_device(dice->unit)->card) {
+		err = -EXDEV;
+		goto end;
+	}
+
+	mutex_lock(&dice->mutex);
+	err = amdtp_domain_join(&leader->domain, &dice->domain);
+	mutex_unlock(&dice->mutex);
+end:
+	snd_card_unref(card);
+	return err;
+}
+
 static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 {
 	struct snd_dice *dice = hwdep->private_data;
@@ -148,11 +189,36 @@ static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(dice);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(dice);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(dice->tx_stream, MAX_STREAMS,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&dice->domain, dice->unit, (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_GET_PCM_METER:
+		return amdtp_am824_get_pcm_meter(dice->tx_stream, MAX_STREAMS, dice->rx_stream,
+						 MAX_STREAMS, (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_JOIN_DOMAIN:
+		return hwdep_join_domain(dice, (void __user *)arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
 }
 
+static int hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+		      struct vm_area_struct *area)
+{
+	struct snd_dice *dice = hwdep->private_data;
+	struct amdtp_stream *streams[MAX_STREAMS * 2];
+	int i;
+
+	for (i = 0; i < MAX_STREAMS; ++i) {
+		streams[i] = &dice->tx_stream[i];
+		streams[MAX_STREAMS + i] = &dice->rx_stream[i];
+	}
+
+	return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+}
+
 #ifdef CONFIG_COMPAT
 static int hwdep_compat_ioctl(struct snd_hwdep *hwdep, struct file *file,
 			      unsigned int cmd, unsigned long arg)
@@ -172,6 +238,7 @@ int snd_dice_create_hwdep(struct snd_dice *dice)
 		.poll         = hwdep_poll,
 		.ioctl        = hwdep_ioctl,
 		.ioctl_compat = hwdep_compat_ioctl,
+		.mmap         = hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
@@ -8,12 +8,74 @@
 
 #include "dice.h"
 
+// When PCM device spans all streams in the direction, the PCM frame consists of the channels of
+// the streams. The additional substream sharing the stream is bound to the equal part of the
+// channels in the stream.
+static unsigned int get_pcm_channels(struct snd_dice *dice, struct snd_pcm_substream *substream,
+				     enum snd_dice_rate_mode mode)
+{
+	unsigned int (*pcm_chs)[SND_DICE_RATE_MODE_COUNT];
+	unsigned int i, channels;
+
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
+		pcm_chs = dice->tx_pcm_chs;
+	else
+		pcm_chs = dice->rx_pcm_chs;
+
+	if (!dice->merged_pcm) {
+		channels = pcm_chs[substream->pcm->device][mode];
+		if (substream->number > 0)
+			channels /= dice->shared_pcms;
+		return channels;
+	}
+
+	channels = 0;
+	for (i = 0; i < MAX_STREAMS; ++i)
+		channels += pcm_chs[i][mode];
+
+	return channels;
+}
+
+// The streams which transfer PCM frames of the substream. For the merged PCM device, they are the
+// streams up to the last one with PCM channels at current mode.
+static struct amdtp_stream *get_pcm_streams(struct snd_dice *dice,
+					    struct snd_pcm_substream *substream,
+					    unsigned int *count)
+{
+	unsigned int (*pcm_chs)[SND_DICE_RATE_MODE_COUNT];
+	struct amdtp_stream *streams;
+	enum snd_dice_rate_mode mode;
+	unsigned int i;
+
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
+		pcm_chs = dice->tx_pcm_chs;
+		streams = dice->tx_stream;
+	} else {
+		pcm_chs = dice->rx_pcm_chs;
+		streams = dice->rx_stream;
+	}
+
+	if (!dice->merged_pcm) {
+		*count = 1;
+		return streams + substream->pcm->device;
+	}
+
+	*count = 1;
+	if (snd_dice_stream_get_rate_mode(dice, substream->runtime->rate, &mode) >= 0) {
+		for (i = 1; i < MAX_STREAMS; ++i) {
+			if (pcm_chs[i][mode] > 0)
+				*count = i + 1;
+		}
+	}
+
+	return streams;
+}
+
 static int dice_rate_constraint(struct snd_pcm_hw_params *params,
 				struct snd_pcm_hw_rule *rule)
 {
 	struct snd_pcm_substream *substream = rule->private;
 	struct snd_dice *dice = substream->private_data;
-	unsigned int index = substream->pcm->device;
 
 	const struct snd_interval *c =
 		hw_param_interval_c(params, SNDRV_PCM_HW_PARAM_CHANNELS);
@@ -22,21 +84,15 @@ static int dice_rate_constraint(struct snd_pcm_hw_params *params,
 	struct snd_interval rates = {
 		.min = UINT_MAX, .max = 0, .integer = 1
 	};
-	unsigned int *pcm_channels;
 	enum snd_dice_rate_mode mode;
 	unsigned int i, rate;
 
-	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
-		pcm_channels = dice->tx_pcm_chs[index];
-	else
-		pcm_channels = dice->rx_pcm_chs[index];
-
 	for (i = 0; i < ARRAY_SIZE(snd_dice_rates); ++i) {
 		rate = snd_dice_rates[i];
 		if (snd_dice_stream_get_rate_mode(dice, rate, &mode) < 0)
 			continue;
 
-		if (!snd_interval_test(c, pcm_channels[mode]))
+		if (!snd_interval_test(c, get_pcm_channels(dice, substream, mode)))
 			continue;
 
 		rates.min = min(rates.min, rate);
@@ -51,7 +107,6 @@ static int dice_channels_constraint(struct snd_pcm_hw_params *params,
 {
 	struct snd_pcm_substream *substream = rule->private;
 	struct snd_dice *dice = substream->private_data;
-	unsigned int index = substream->pcm->device;
 
 	const struct snd_interval *r =
 		hw_param_interval_c(params, SNDRV_PCM_HW_PARAM_RATE);
@@ -60,14 +115,8 @@ static int dice_channels_constraint(struct snd_pcm_hw_params *params,
 	struct snd_interval channels = {
 		.min = UINT_MAX, .max = 0, .integer = 1
 	};
-	unsigned int *pcm_channels;
 	enum snd_dice_rate_mode mode;
-	unsigned int i, rate;
-
-	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
-		pcm_channels = dice->tx_pcm_chs[index];
-	else
-		pcm_channels = dice->rx_pcm_chs[index];
+	unsigned int i, rate, pcm_channels;
 
 	for (i = 0; i < ARRAY_SIZE(snd_dice_rates); ++i) {
 		rate = snd_dice_rates[i];
@@ -77,27 +126,21 @@ static int dice_channels_constraint(struct snd_pcm_hw_params *params,
 		if (!snd_interval_test(r, rate))
 			continue;
 
-		channels.min = min(channels.min, pcm_channels[mode]);
-		channels.max = max(channels.max, pcm_channels[mode]);
+		pcm_channels = get_pcm_channels(dice, substream, mode);
+		channels.min = min(channels.min, pcm_channels);
+		channels.max = max(channels.max, pcm_channels);
 	}
 
 	return snd_interval_refine(c, &channels);
 }
 
 static int limit_channels_and_rates(struct snd_dice *dice,
-				    struct snd_pcm_runtime *runtime,
-				    enum amdtp_stream_direction dir,
-				    unsigned int index)
+				    struct snd_pcm_substream *substream)
 {
+	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct snd_pcm_hardware *hw = &runtime->hw;
-	unsigned int *pcm_channels;
 	unsigned int i;
 
-	if (dir == AMDTP_IN_STREAM)
-		pcm_channels = dice->tx_pcm_chs[index];
-	else
-		pcm_channels = dice->rx_pcm_chs[index];
-
 	hw->channels_min = UINT_MAX;
 	hw->channels_max = 0;
 
@@ -110,7 +153,7 @@ static int limit_channels_and_rates(struct snd_dice *dice,
 			continue;
 		hw->rates |= snd_pcm_rate_to_rate_bit(rate);
 
-		channels = pcm_channels[mode];
+		channels = get_pcm_channels(dice, substream, mode);
 		if (channels == 0)
 			continue;
 		hw->channels_min = min(hw->channels_min, channels);
@@ -128,22 +171,18 @@ static int init_hw_info(struct snd_dice *dice,
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct snd_pcm_hardware *hw = &runtime->hw;
 	unsigned int index = substream->pcm->device;
-	enum amdtp_stream_direction dir;
 	struct amdtp_stream *stream;
 	int err;
 
 	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
 		hw->formats = AM824_IN_PCM_FORMAT_BITS;
-		dir = AMDTP_IN_STREAM;
 		stream = &dice->tx_stream[index];
 	} else {
 		hw->formats = AM824_OUT_PCM_FORMAT_BITS;
-		dir = AMDTP_OUT_STREAM;
 		stream = &dice->rx_stream[index];
 	}
 
-	err = limit_channels_and_rates(dice, substream->runtime, dir,
-				       index);
+	err = limit_channels_and_rates(dice, substream);
 	if (err < 0)
 		return err;
 
@@ -266,6 +305,20 @@ static int pcm_hw_params(struct snd_pcm_substream *substream,
 	struct snd_dice *dice = substream->private_data;
 	int err = 0;
 
+	// For playback, the samples of the part take precedence over the ones of the first
+	// substream.
+	if (substream->number > 0) {
+		unsigned int channels = params_channels(hw_params);
+		struct amdtp_stream *stream;
+		unsigned int count;
+
+		stream = get_pcm_streams(dice, substream, &count);
+		err = amdtp_stream_add_shared_pcm(stream, substream,
+						  channels * (substream->number - 1), channels);
+		if (err < 0)
+			return err;
+	}
+
 	if (substream->runtime->status->state == SNDRV_PCM_STATE_OPEN) {
 		unsigned int rate = params_rate(hw_params);
 		unsigned int events_per_period = params_period_size(hw_params);
@@ -291,6 +344,14 @@ static int pcm_hw_free(struct snd_pcm_substream *substream)
 {
 	struct snd_dice *dice = substream->private_data;
 
+	if (substream->number > 0) {
+		struct amdtp_stream *stream;
+		unsigned int count;
+
+		stream = get_pcm_streams(dice, substream, &count);
+		amdtp_stream_remove_shared_pcm(stream, substream);
+	}
+
 	mutex_lock(&dice->mutex);
 
 	if (substream->runtime->status->state != SNDRV_PCM_STATE_OPEN)
@@ -306,28 +367,46 @@ static int pcm_hw_free(struct snd_pcm_substream *substream)
 static int capture_prepare(struct snd_pcm_substream *substream)
 {
 	struct snd_dice *dice = substream->private_data;
-	struct amdtp_stream *stream = &dice->tx_stream[substream->pcm->device];
+	struct amdtp_stream *streams;
+	unsigned int i, count;
 	int err;
 
+	streams = get_pcm_streams(dice, substream, &count);
+
 	mutex_lock(&dice->mutex);
 	err = snd_dice_stream_start_duplex(dice);
 	mutex_unlock(&dice->mutex);
-	if (err >= 0)
-		amdtp_stream_pcm_prepare(stream);
+	if (err >= 0) {
+		if (substream->number > 0) {
+			amdtp_stream_shared_pcm_prepare(streams, substream);
+		} else {
+			for (i = 0; i < count; ++i)
+				amdtp_stream_pcm_prepare(streams + i);
+		}
+	}
 
 	return 0;
 }
 static int playback_prepare(struct snd_pcm_substream *substream)
 {
 	struct snd_dice *dice = substream->private_data;
-	struct amdtp_stream *stream = &dice->rx_stream[substream->pcm->device];
+	struct amdtp_stream *streams;
+	unsigned int i, count;
 	int err;
 
+	streams = get_pcm_streams(dice, substream, &count);
+
 	mutex_lock(&dice->mutex);
 	err = snd_dice_stream_start_duplex(dice);
 	mutex_unlock(&dice->mutex);
-	if (err >= 0)
-		amdtp_stream_pcm_prepare(stream);
+	if (err >= 0) {
+		if (substream->number > 0) {
+			amdtp_stream_shared_pcm_prepare(streams, substream);
+		} else {
+			for (i = 0; i < count; ++i)
+				amdtp_stream_pcm_prepare(streams + i);
+		}
+	}
 
 	return err;
 }
@@ -335,14 +414,27 @@ static int playback_prepare(struct snd_pcm_substream *substream)
 static int capture_trigger(struct snd_pcm_substream *substream, int cmd)
 {
 	struct snd_dice *dice = substream->private_data;
-	struct amdtp_stream *stream = &dice->tx_stream[substream->pcm->device];
+	struct amdtp_stream *streams;
+	unsigned int count;
+
+	streams = get_pcm_streams(dice, substream, &count);
 
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
-		amdtp_stream_pcm_trigger(stream, substream);
+		if (substream->number > 0)
+			amdtp_stream_shared_pcm_trigger(streams, substream, true);
+		else if (count > 1)
+			amdtp_domain_streams_pcm_trigger(&dice->domain, streams, count, substream);
+		else
+			amdtp_stream_pcm_trigger(streams, substream);
 		break;
 	case SNDRV_PCM_TRIGGER_STOP:
-		amdtp_stream_pcm_trigger(stream, NULL);
+		if (substream->number > 0)
+			amdtp_stream_shared_pcm_trigger(streams, substream, false);
+		else if (count > 1)
+			amdtp_domain_streams_pcm_trigger(&dice->domain, streams, count, NULL);
+		else
+			amdtp_stream_pcm_trigger(streams, NULL);
 		break;
 	default:
 		return -EINVAL;
@@ -353,14 +445,27 @@ static int capture_trigger(struct snd_pcm_substream *substream, int cmd)
 static int playback_trigger(struct snd_pcm_substream *substream, int cmd)
 {
 	struct snd_dice *dice = substream->private_data;
-	struct amdtp_stream *stream = &dice->rx_stream[substream->pcm->device];
+	struct amdtp_stream *streams;
+	unsigned int count;
+
+	streams = get_pcm_streams(dice, substream, &count);
 
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
-		amdtp_stream_pcm_trigger(stream, substream);
+		if (substream->number > 0)
+			amdtp_stream_shared_pcm_trigger(streams, substream, true);
+		else if (count > 1)
+			amdtp_domain_streams_pcm_trigger(&dice->domain, streams, count, substream);
+		else
+			amdtp_stream_pcm_trigger(streams, substream);
 		break;
 	case SNDRV_PCM_TRIGGER_STOP:
-		amdtp_stream_pcm_trigger(stream, NULL);
+		if (substream->number > 0)
+			amdtp_stream_shared_pcm_trigger(streams, substream, false);
+		else if (count > 1)
+			amdtp_domain_streams_pcm_trigger(&dice->domain, streams, count, NULL);
+		else
+			amdtp_stream_pcm_trigger(streams, NULL);
 		break;
 	default:
 		return -EINVAL;
@@ -372,16 +477,30 @@ static int playback_trigger(struct snd_pcm_substream *substream, int cmd)
 static snd_pcm_uframes_t capture_pointer(struct snd_pcm_substream *substream)
 {
 	struct snd_dice *dice = substream->private_data;
-	struct amdtp_stream *stream = &dice->tx_stream[substream->pcm->device];
+	struct amdtp_stream *streams;
+	unsigned int count;
 
-	return amdtp_domain_stream_pcm_pointer(&dice->domain, stream);
+	streams = get_pcm_streams(dice, substream, &count);
+	if (substream->number > 0)
+		return amdtp_domain_stream_shared_pcm_pointer(&dice->domain, streams, substream);
+	if (count > 1)
+		return amdtp_domain_streams_pcm_pointer(&dice->domain, streams, count, substream);
+
+	return amdtp_domain_stream_pcm_pointer(&dice->domain, streams);
 }
 static snd_pcm_uframes_t playback_pointer(struct snd_pcm_substream *substream)
 {
 	struct snd_dice *dice = substream->private_data;
-	struct amdtp_stream *stream = &dice->rx_stream[substream->pcm->device];
+	struct amdtp_stream *streams;
+	unsigned int count;
+
+	streams = get_pcm_streams(dice, substream, &count);
+	if (substream->number > 0)
+		return amdtp_domain_stream_shared_pcm_pointer(&dice->domain, streams, substream);
+	if (count > 1)
+		return amdtp_domain_streams_pcm_pointer(&dice->domain, streams, count, substream);
 
-	return amdtp_domain_stream_pcm_pointer(&dice->domain, stream);
+	return amdtp_domain_stream_pcm_pointer(&dice->domain, streams);
 }
 
 static int capture_ack(struct snd_pcm_substream *substream)
@@ -400,6 +519,42 @@ static int playback_ack(struct snd_pcm_substream *substream)
 	return amdtp_domain_stream_pcm_ack(&dice->domain, stream);
 }
 
+static int capture_time_info(struct snd_pcm_substream *substream,
+			     struct timespec64 *system_ts, struct timespec64 *audio_ts,
+			     struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+			     struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_dice *dice = substream->private_data;
+	struct amdtp_stream *stream = &dice->tx_stream[substream->pcm->device];
+
+	// The timestamp of stream is for the first substream.
+	if (substream->number > 0) {
+		audio_tstamp_report->actual_type = SNDRV_PCM_AUDIO_TSTAMP_TYPE_DEFAULT;
+		return 0;
+	}
+
+	return amdtp_stream_pcm_get_time_info(stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
+static int playback_time_info(struct snd_pcm_substream *substream,
+			      struct timespec64 *system_ts, struct timespec64 *audio_ts,
+			      struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+			      struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_dice *dice = substream->private_data;
+	struct amdtp_stream *stream = &dice->rx_stream[substream->pcm->device];
+
+	// The timestamp of stream is for the first substream.
+	if (substream->number > 0) {
+		audio_tstamp_report->actual_type = SNDRV_PCM_AUDIO_TSTAMP_TYPE_DEFAULT;
+		return 0;
+	}
+
+	return amdtp_stream_pcm_get_time_info(stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
 int snd_dice_create_pcm(struct snd_dice *dice)
 {
 	static const struct snd_pcm_ops capture_ops = {
@@ -411,6 +566,7 @@ int snd_dice_create_pcm(struct snd_dice *dice)
 		.trigger   = capture_trigger,
 		.pointer   = capture_pointer,
 		.ack       = capture_ack,
+		.get_time_info = capture_time_info,
 	};
 	static const struct snd_pcm_ops playback_ops = {
 		.open      = pcm_open,
@@ -421,23 +577,41 @@ int snd_dice_create_pcm(struct snd_dice *dice)
 		.trigger   = playback_trigger,
 		.pointer   = playback_pointer,
 		.ack       = playback_ack,
+		.get_time_info = playback_time_info,
 	};
 	struct snd_pcm *pcm;
 	unsigned int capture, playback;
-	int i, j;
+	int i, j, k;
 	int err;
 
 	for (i = 0; i < MAX_STREAMS; i++) {
+		unsigned int last = i;
+
+		// The merged PCM device is numbered 0 and spans all of the streams.
+		if (dice->merged_pcm) {
+			if (i > 0)
+				break;
+			last = MAX_STREAMS - 1;
+		}
+
 		capture = playback = 0;
-		for (j = 0; j < SND_DICE_RATE_MODE_COUNT; ++j) {
-			if (dice->tx_pcm_chs[i][j] > 0)
-				capture = 1;
-			if (dice->rx_pcm_chs[i][j] > 0)
-				playback = 1;
+		for (k = i; k <= last; ++k) {
+			for (j = 0; j < SND_DICE_RATE_MODE_COUNT; ++j) {
+				if (dice->tx_pcm_chs[k][j] > 0)
+					capture = 1;
+				if (dice->rx_pcm_chs[k][j] > 0)
+					playback = 1;
+			}
 		}
 
-		err = snd_pcm_new(dice->card, "DICE", i, playback, capture,
-				  &pcm);
+		// The number of PCM device is the index of stream.
+		if (capture == 0 && playback == 0)
+			continue;
+
+		// The additional substreams share the stream with the first one.
+		err = snd_pcm_new(dice->card, "DICE", i,
+				  playback > 0 ? 1 + dice->shared_pcms : 0,
+				  capture > 0 ? 1 + dice->shared_pcms : 0, &pcm);
 		if (err < 0)
 			return err;
 		pcm->private_data = dice;
@@ -451,8 +625,7 @@ int snd_dice_create_pcm(struct snd_dice *dice)
 			snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK,
 					&playback_ops);
 
-		snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC,
-					       NULL, 0, 0);
+		snd_fw_pcm_set_managed_buffer_all(pcm);
 	}
 
 	return 0;
@@ -276,6 +276,50 @@ static void dice_proc_read_formation(struct snd_info_entry *entry,
 	}
 }
 
+static void dice_proc_read_histograms(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
+{
+	struct snd_dice *dice = entry->private_data;
+	int i;
+
+	for (i = 0; i < MAX_STREAMS; ++i) {
+		snd_iprintf(buffer, "Tx %u:\n", i);
+		amdtp_stream_dump_histograms(&dice->tx_stream[i], buffer);
+	}
+
+	for (i = 0; i < MAX_STREAMS; ++i) {
+		snd_iprintf(buffer, "Rx %u:\n", i);
+		amdtp_stream_dump_histograms(&dice->rx_stream[i], buffer);
+	}
+}
+
+static void dice_proc_read_preflight(struct snd_info_entry *entry,
+				     struct snd_info_buffer *buffer)
+{
+	struct snd_dice *dice = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	unsigned int rate;
+	int err;
+
+	if (snd_dice_transaction_get_rate(dice, &rate) < 0)
+		return;
+
+	mutex_lock(&dice->mutex);
+	err = snd_dice_stream_preflight(dice, rate, &preflight);
+	mutex_unlock(&dice->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, dice->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", dice->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void add_node(struct snd_dice *dice, struct snd_info_entry *root,
 		     const char *name,
 		     void (*op)(struct snd_info_entry *entry,
@@ -304,4 +348,7 @@ void snd_dice_create_proc(struct snd_dice *dice)
 
 	add_node(dice, root, "dice", dice_proc_read);
 	add_node(dice, root, "formation", dice_proc_read_formation);
+	add_node(dice, root, "histogram", dice_proc_read_histograms);
+	add_node(dice, root, "preflight", dice_proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&dice->domain, root);
 }
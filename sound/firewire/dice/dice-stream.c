@@ -103,6 +103,12 @@ static int get_register_params(struct snd_dice *dice,
 	__be32 reg[2];
 	int err;
 
+	// The registers in both sections are read by the following operations. Read each
+	// section at once with the requests in flight together.
+	err = snd_dice_transaction_refresh_snapshots(dice);
+	if (err < 0)
+		return err;
+
 	err = snd_dice_transaction_read_tx(dice, TX_NUMBER, reg, sizeof(reg));
 	if (err < 0)
 		return err;
@@ -150,9 +156,9 @@ static void stop_streams(struct snd_dice *dice, enum amdtp_stream_direction dir,
 	}
 }
 
-static int keep_resources(struct snd_dice *dice, struct amdtp_stream *stream,
-			  struct fw_iso_resources *resources, unsigned int rate,
-			  unsigned int pcm_chs, unsigned int midi_ports)
+static int set_stream_parameters(struct snd_dice *dice, struct amdtp_stream *stream,
+				 unsigned int rate, unsigned int pcm_chs,
+				 unsigned int midi_ports)
 {
 	bool double_pcm_frames;
 	unsigned int i;
@@ -187,16 +193,30 @@ static int keep_resources(struct snd_dice *dice, struct amdtp_stream *stream,
 		}
 	}
 
+	return 0;
+}
+
+static int keep_resources(struct snd_dice *dice, struct amdtp_stream *stream,
+			  struct fw_iso_resources *resources, unsigned int rate,
+			  unsigned int pcm_chs, unsigned int midi_ports)
+{
+	int err;
+
+	err = set_stream_parameters(dice, stream, rate, pcm_chs, midi_ports);
+	if (err < 0)
+		return err;
+
 	return fw_iso_resources_allocate(resources,
 				amdtp_stream_get_max_payload(stream),
 				fw_parent_device(dice->unit)->max_speed);
 }
 
-static int keep_dual_resources(struct snd_dice *dice, unsigned int rate,
-			       enum amdtp_stream_direction dir,
-			       struct reg_params *params)
+static int keep_stream_resources(struct snd_dice *dice, unsigned int rate,
+				 enum amdtp_stream_direction dir,
+				 struct reg_params *params)
 {
 	enum snd_dice_rate_mode mode;
+	unsigned int pcm_channel_offset = 0;
 	int i;
 	int err;
 
@@ -246,6 +266,13 @@ static int keep_dual_resources(struct snd_dice *dice, unsigned int rate,
 				     midi_ports);
 		if (err < 0)
 			return err;
+
+		// The stream transfers the channels next to the ones of former streams in the
+		// PCM frame.
+		if (dice->merged_pcm) {
+			amdtp_am824_set_pcm_channel_offset(stream, pcm_channel_offset);
+			pcm_channel_offset += pcm_chs;
+		}
 	}
 
 	return 0;
@@ -260,6 +287,68 @@ static void finish_session(struct snd_dice *dice, struct reg_params *tx_params,
 	snd_dice_transaction_clear_enable(dice);
 }
 
+static int preflight_streams(struct snd_dice *dice, unsigned int rate,
+			     enum amdtp_stream_direction dir,
+			     struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(dice->unit)->max_speed;
+	enum snd_dice_rate_mode mode;
+	int i;
+	int err;
+
+	err = snd_dice_stream_get_rate_mode(dice, rate, &mode);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < MAX_STREAMS; ++i) {
+		struct amdtp_stream *stream;
+		unsigned int pcm_chs;
+		unsigned int midi_ports;
+		int type;
+
+		if (dir == AMDTP_IN_STREAM) {
+			stream = &dice->tx_stream[i];
+			pcm_chs = dice->tx_pcm_chs[i][mode];
+			midi_ports = dice->tx_midi_ports[i];
+			type = FW_ISO_CONTEXT_RECEIVE;
+		} else {
+			stream = &dice->rx_stream[i];
+			pcm_chs = dice->rx_pcm_chs[i][mode];
+			midi_ports = dice->rx_midi_ports[i];
+			type = FW_ISO_CONTEXT_TRANSMIT;
+		}
+		if (pcm_chs == 0 && midi_ports == 0)
+			continue;
+
+		if (dice->substreams_counter == 0) {
+			err = set_stream_parameters(dice, stream, rate, pcm_chs,
+						    midi_ports);
+			if (err < 0)
+				return err;
+		}
+
+		fw_iso_preflight_add(preflight, dice->unit, type,
+				     amdtp_stream_get_max_payload(stream), speed);
+	}
+
+	return 0;
+}
+
+// Count the resources which snd_dice_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The streams are counted by the cached formats. The parameters of streams are
+// changed only when they are not reserved yet.
+int snd_dice_stream_preflight(struct snd_dice *dice, unsigned int rate,
+			      struct fw_iso_preflight *preflight)
+{
+	int err;
+
+	err = preflight_streams(dice, rate, AMDTP_IN_STREAM, preflight);
+	if (err < 0)
+		return err;
+
+	return preflight_streams(dice, rate, AMDTP_OUT_STREAM, preflight);
+}
+
 int snd_dice_stream_reserve_duplex(struct snd_dice *dice, unsigned int rate,
 				   unsigned int events_per_period,
 				   unsigned int events_per_buffer)
@@ -299,13 +388,13 @@ int snd_dice_stream_reserve_duplex(struct snd_dice *dice, unsigned int rate,
 		if (err < 0)
 			return err;
 
-		err = keep_dual_resources(dice, rate, AMDTP_IN_STREAM,
-					  &tx_params);
+		err = keep_stream_resources(dice, rate, AMDTP_IN_STREAM,
+					    &tx_params);
 		if (err < 0)
 			goto error;
 
-		err = keep_dual_resources(dice, rate, AMDTP_OUT_STREAM,
-					  &rx_params);
+		err = keep_stream_resources(dice, rate, AMDTP_OUT_STREAM,
+					    &rx_params);
 		if (err < 0)
 			goto error;
 
@@ -504,6 +593,13 @@ static int init_stream(struct snd_dice *dice, enum amdtp_stream_direction dir,
 	resources->channels_mask = 0x00000000ffffffffuLL;
 
 	err = amdtp_am824_init(stream, dice->unit, dir, CIP_BLOCKING);
+	if (err < 0) {
+		amdtp_stream_destroy(stream);
+		fw_iso_resources_destroy(resources);
+		goto end;
+	}
+
+	err = amdtp_stream_add_counters(stream, dice->card, index);
 	if (err < 0) {
 		amdtp_stream_destroy(stream);
 		fw_iso_resources_destroy(resources);
@@ -542,8 +638,8 @@ int snd_dice_stream_init_duplex(struct snd_dice *dice)
 	for (i = 0; i < MAX_STREAMS; i++) {
 		err = init_stream(dice, AMDTP_IN_STREAM, i);
 		if (err < 0) {
-			for (; i >= 0; i--)
-				destroy_stream(dice, AMDTP_OUT_STREAM, i);
+			while (--i >= 0)
+				destroy_stream(dice, AMDTP_IN_STREAM, i);
 			goto end;
 		}
 	}
@@ -551,7 +647,7 @@ int snd_dice_stream_init_duplex(struct snd_dice *dice)
 	for (i = 0; i < MAX_STREAMS; i++) {
 		err = init_stream(dice, AMDTP_OUT_STREAM, i);
 		if (err < 0) {
-			for (; i >= 0; i--)
+			while (--i >= 0)
 				destroy_stream(dice, AMDTP_OUT_STREAM, i);
 			for (i = 0; i < MAX_STREAMS; i++)
 				destroy_stream(dice, AMDTP_IN_STREAM, i);
@@ -671,6 +767,7 @@ static void dice_lock_changed(struct snd_dice *dice)
 {
 	dice->dev_lock_changed = true;
 	wake_up(&dice->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(dice->card, dice->dev_lock_count > 0);
 }
 
 int snd_dice_stream_lock_try(struct snd_dice *dice)
@@ -33,24 +33,199 @@ static u64 get_subaddr(struct snd_dice *dice, enum snd_dice_addr_type type,
 	return offset;
 }
 
+/* Indexes of snapshot for TX/RX sections. */
+enum snapshot_section {
+	SNAPSHOT_SECTION_TX = 0,
+	SNAPSHOT_SECTION_RX,
+};
+
+static int get_snapshot_section(enum snd_dice_addr_type type)
+{
+	switch (type) {
+	case SND_DICE_ADDR_TYPE_TX:
+		return SNAPSHOT_SECTION_TX;
+	case SND_DICE_ADDR_TYPE_RX:
+		return SNAPSHOT_SECTION_RX;
+	default:
+		return -EINVAL;
+	}
+}
+
+static void free_snapshot(struct snd_dice *dice)
+{
+	kfree(dice->snapshot.sections[SNAPSHOT_SECTION_TX].image);
+	dice->snapshot.sections[SNAPSHOT_SECTION_TX].image = NULL;
+	kfree(dice->snapshot.sections[SNAPSHOT_SECTION_RX].image);
+	dice->snapshot.sections[SNAPSHOT_SECTION_RX].image = NULL;
+}
+
+static void invalidate_snapshot(struct snd_dice *dice,
+				enum snapshot_section section)
+{
+	set_bit(section, &dice->snapshot.stale);
+}
+
+static const enum snd_dice_addr_type snapshot_types[] = {
+	[SNAPSHOT_SECTION_TX] = SND_DICE_ADDR_TYPE_TX,
+	[SNAPSHOT_SECTION_RX] = SND_DICE_ADDR_TYPE_RX,
+};
+
+/*
+ * Read the whole sections by the largest block which the device allows. All of
+ * the requests are in flight at the same time.
+ */
+static int refresh_snapshots(struct snd_dice *dice, unsigned long sections)
+{
+	struct fw_device *device = fw_parent_device(dice->unit);
+	struct snd_fw_request *requests;
+	unsigned int max_block;
+	unsigned int count;
+	unsigned int i, pos;
+	int err;
+
+	max_block = min(1u << (device->max_rec + 1), 512u << device->max_speed);
+	max_block = rounddown(max_block, 4);
+
+	count = 0;
+	for (i = 0; i < ARRAY_SIZE(snapshot_types); ++i) {
+		if (sections & BIT(i))
+			count += DIV_ROUND_UP(dice->snapshot.sections[i].size,
+					      max_block);
+	}
+	if (count == 0)
+		return 0;
+
+	requests = kcalloc(count, sizeof(*requests), GFP_KERNEL);
+	if (!requests)
+		return -ENOMEM;
+
+	count = 0;
+	for (i = 0; i < ARRAY_SIZE(snapshot_types); ++i) {
+		__be32 *image = dice->snapshot.sections[i].image;
+		unsigned int size = dice->snapshot.sections[i].size;
+
+		if (!(sections & BIT(i)))
+			continue;
+
+		for (pos = 0; pos < size; pos += max_block) {
+			struct snd_fw_request *r = requests + count++;
+
+			r->length = min(size - pos, max_block);
+			r->tcode = (r->length == 4) ? TCODE_READ_QUADLET_REQUEST :
+						      TCODE_READ_BLOCK_REQUEST;
+			r->offset = get_subaddr(dice, snapshot_types[i], pos);
+			r->buffer = (u8 *)image + pos;
+		}
+	}
+
+	err = snd_fw_transactions(dice->unit, requests, count, 0);
+	for (i = 0; err >= 0 && i < count; ++i)
+		err = requests[i].result;
+
+	kfree(requests);
+
+	return err;
+}
+
+/* Call with the mutex for snapshot held. */
+static int update_snapshots(struct snd_dice *dice, unsigned long sections)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_types); ++i) {
+		if (!(sections & BIT(i)))
+			continue;
+
+		if (test_and_clear_bit(i, &dice->snapshot.stale))
+			dice->snapshot.sections[i].valid = false;
+		if (dice->snapshot.sections[i].valid)
+			sections &= ~BIT(i);
+	}
+
+	err = refresh_snapshots(dice, sections);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_types); ++i) {
+		if (sections & BIT(i))
+			dice->snapshot.sections[i].valid = true;
+	}
+
+	return 0;
+}
+
+/*
+ * Refresh the stale snapshots of TX/RX sections at once, so that the following
+ * reads of both sections need no more round trip.
+ */
+int snd_dice_transaction_refresh_snapshots(struct snd_dice *dice)
+{
+	unsigned long sections = 0;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_types); ++i) {
+		if (dice->snapshot.sections[i].image)
+			sections |= BIT(i);
+	}
+
+	mutex_lock(&dice->snapshot.mutex);
+	err = update_snapshots(dice, sections);
+	mutex_unlock(&dice->snapshot.mutex);
+
+	return err;
+}
+
 int snd_dice_transaction_write(struct snd_dice *dice,
 			       enum snd_dice_addr_type type,
 			       unsigned int offset, void *buf, unsigned int len)
 {
-	return snd_fw_transaction(dice->unit,
-				  (len == 4) ? TCODE_WRITE_QUADLET_REQUEST :
-					       TCODE_WRITE_BLOCK_REQUEST,
-				  get_subaddr(dice, type, offset), buf, len, 0);
+	int section;
+	int err;
+
+	err = snd_fw_transaction(dice->unit,
+				 (len == 4) ? TCODE_WRITE_QUADLET_REQUEST :
+					      TCODE_WRITE_BLOCK_REQUEST,
+				 get_subaddr(dice, type, offset), buf, len, 0);
+
+	section = get_snapshot_section(type);
+	if (section >= 0)
+		invalidate_snapshot(dice, section);
+
+	return err;
 }
 
 int snd_dice_transaction_read(struct snd_dice *dice,
 			      enum snd_dice_addr_type type, unsigned int offset,
 			      void *buf, unsigned int len)
 {
-	return snd_fw_transaction(dice->unit,
-				  (len == 4) ? TCODE_READ_QUADLET_REQUEST :
-					       TCODE_READ_BLOCK_REQUEST,
-				  get_subaddr(dice, type, offset), buf, len, 0);
+	int section;
+	int err;
+
+	section = get_snapshot_section(type);
+	if (section < 0 || !dice->snapshot.sections[section].image ||
+	    offset + len > dice->snapshot.sections[section].size) {
+		return snd_fw_transaction(dice->unit,
+					  (len == 4) ? TCODE_READ_QUADLET_REQUEST :
+						       TCODE_READ_BLOCK_REQUEST,
+					  get_subaddr(dice, type, offset),
+					  buf, len, 0);
+	}
+
+	mutex_lock(&dice->snapshot.mutex);
+
+	err = update_snapshots(dice, BIT(section));
+	if (err < 0)
+		goto end;
+
+	memcpy(buf, (u8 *)dice->snapshot.sections[section].image + offset,
+	       len);
+	err = 0;
+end:
+	mutex_unlock(&dice->snapshot.mutex);
+
+	return err;
 }
 
 static unsigned int get_clock_info(struct snd_dice *dice, __be32 *info)
@@ -155,9 +330,16 @@ static void dice_notification(struct fw_card *card, struct fw_request *request,
 
 	fw_send_response(card, request, RCODE_COMPLETE);
 
+	if (bits & (NOTIFY_TX_CFG_CHG | NOTIFY_CLOCK_ACCEPTED))
+		invalidate_snapshot(dice, SNAPSHOT_SECTION_TX);
+	if (bits & (NOTIFY_RX_CFG_CHG | NOTIFY_CLOCK_ACCEPTED))
+		invalidate_snapshot(dice, SNAPSHOT_SECTION_RX);
+
 	if (bits & NOTIFY_CLOCK_ACCEPTED)
 		complete(&dice->clock_accepted);
 	wake_up(&dice->hwdep_wait);
+	snd_fw_event_mux_post(dice->card, SNDRV_FIREWIRE_EVENT_DICE_NOTIFICATION, &bits,
+			      sizeof(bits));
 }
 
 static int register_notification_address(struct snd_dice *dice, bool retry)
@@ -249,6 +431,8 @@ void snd_dice_transaction_destroy(struct snd_dice *dice)
 
 	fw_core_remove_address_handler(handler);
 	handler->callback_data = NULL;
+
+	free_snapshot(dice);
 }
 
 int snd_dice_transaction_reinit(struct snd_dice *dice)
@@ -258,6 +442,10 @@ int snd_dice_transaction_reinit(struct snd_dice *dice)
 	if (handler->callback_data == NULL)
 		return -EINVAL;
 
+	/* The device may lose its configuration at bus reset. */
+	invalidate_snapshot(dice, SNAPSHOT_SECTION_TX);
+	invalidate_snapshot(dice, SNAPSHOT_SECTION_RX);
+
 	return register_notification_address(dice, false);
 }
 
@@ -334,6 +522,18 @@ static int get_subaddrs(struct snd_dice *dice)
 		dice->sync_offset = be32_to_cpu(pointers[6]) * 4;
 	if (pointers[9])
 		dice->rsrv_offset = be32_to_cpu(pointers[8]) * 4;
+
+	/* A failure just disables the snapshot. */
+	dice->snapshot.sections[SNAPSHOT_SECTION_TX].size =
+						be32_to_cpu(pointers[3]) * 4;
+	dice->snapshot.sections[SNAPSHOT_SECTION_TX].image =
+		kmalloc(dice->snapshot.sections[SNAPSHOT_SECTION_TX].size,
+			GFP_KERNEL);
+	dice->snapshot.sections[SNAPSHOT_SECTION_RX].size =
+						be32_to_cpu(pointers[5]) * 4;
+	dice->snapshot.sections[SNAPSHOT_SECTION_RX].image =
+		kmalloc(dice->snapshot.sections[SNAPSHOT_SECTION_RX].size,
+			GFP_KERNEL);
 end:
 	kfree(pointers);
 	return err;
@@ -344,6 +544,11 @@ int snd_dice_transaction_init(struct snd_dice *dice)
 	struct fw_address_handler *handler = &dice->notification_handler;
 	int err;
 
+	mutex_init(&dice->snapshot.mutex);
+	dice->snapshot.stale = 0;
+	dice->snapshot.sections[SNAPSHOT_SECTION_TX].valid = false;
+	dice->snapshot.sections[SNAPSHOT_SECTION_RX].valid = false;
+
 	err = get_subaddrs(dice);
 	if (err < 0)
 		return err;
@@ -355,6 +560,7 @@ int snd_dice_transaction_init(struct snd_dice *dice)
 	err = fw_core_add_address_handler(handler, &fw_high_memory_region);
 	if (err < 0) {
 		handler->callback_data = NULL;
+		free_snapshot(dice);
 		return err;
 	}
 
@@ -363,6 +569,7 @@ int snd_dice_transaction_init(struct snd_dice *dice)
 	if (err < 0) {
 		fw_core_remove_address_handler(handler);
 		handler->callback_data = NULL;
+		free_snapshot(dice);
 	}
 
 	return err;
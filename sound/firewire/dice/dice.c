@@ -11,6 +11,15 @@ MODULE_DESCRIPTION("DICE driver");
 MODULE_AUTHOR("Clemens Ladisch <clemens@ladisch.de>");
 MODULE_LICENSE("GPL v2");
 
+static bool merged_pcm;
+module_param(merged_pcm, bool, 0444);
+MODULE_PARM_DESC(merged_pcm, "one PCM device spans all streams in each direction (default: no)");
+
+static unsigned int shared_pcms;
+module_param(shared_pcms, uint, 0444);
+MODULE_PARM_DESC(shared_pcms, "additional PCM substreams each bound to an equal part of channels "
+		 "in the stream, up to 4 (default: 0)");
+
 #define OUI_WEISS		0x001c6a
 #define OUI_LOUD		0x000ff2
 #define OUI_FOCUSRITE		0x00130e
@@ -176,6 +185,10 @@ static int dice_probe(struct fw_unit *unit, const struct ieee1394_device_id *ent
 	if (entry->vendor_id == OUI_MAUDIO || entry->vendor_id == OUI_AVID)
 		dice->disable_double_pcm_frames = true;
 
+	dice->merged_pcm = merged_pcm;
+	if (!merged_pcm)
+		dice->shared_pcms = min_t(unsigned int, shared_pcms, AMDTP_STREAM_SHARED_PCMS);
+
 	spin_lock_init(&dice->lock);
 	mutex_init(&dice->mutex);
 	init_completion(&dice->clock_accepted);
@@ -395,6 +408,7 @@ static struct fw_driver dice_driver = {
 		.owner	= THIS_MODULE,
 		.name	= KBUILD_MODNAME,
 		.bus	= &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = dice_probe,
 	.update   = dice_bus_reset,
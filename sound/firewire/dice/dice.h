@@ -43,8 +43,9 @@
 #include "dice-interface.h"
 
 /*
- * This module support maximum 2 pairs of tx/rx isochronous streams for
- * our convinience.
+ * This module support maximum 4 pairs of tx/rx isochronous streams, for large
+ * routers and units derived from TCAT designs at high rates of sampling
+ * transfer frequency. All of them are in the same AMDTP domain.
  *
  * In documents for ASICs called with a name of 'DICE':
  *  - ASIC for DICE II:
@@ -63,7 +64,7 @@
  * For the above, MIDI conformant data channel is just on the first isochronous
  * stream.
  */
-#define MAX_STREAMS	2
+#define MAX_STREAMS	4
 
 enum snd_dice_rate_mode {
 	SND_DICE_RATE_MODE_LOW = 0,
@@ -88,6 +89,20 @@ struct snd_dice {
 	unsigned int sync_offset;
 	unsigned int rsrv_offset;
 
+	/*
+	 * The images of TX/RX sections, read by block. They are refreshed
+	 * when the device notifies the change of configuration.
+	 */
+	struct {
+		struct mutex mutex;
+		unsigned long stale;
+		struct {
+			__be32 *image;
+			unsigned int size;
+			bool valid;
+		} sections[2];
+	} snapshot;
+
 	unsigned int clock_caps;
 	unsigned int tx_pcm_chs[MAX_STREAMS][SND_DICE_RATE_MODE_COUNT];
 	unsigned int rx_pcm_chs[MAX_STREAMS][SND_DICE_RATE_MODE_COUNT];
@@ -110,6 +125,11 @@ struct snd_dice {
 	struct amdtp_stream rx_stream[MAX_STREAMS];
 	bool global_enabled:1;
 	bool disable_double_pcm_frames:1;
+	// PCM device 0 spans all streams in each direction.
+	bool merged_pcm:1;
+	// The number of additional PCM substreams in each direction of PCM device, which share the
+	// stream with the first substream.
+	unsigned int shared_pcms;
 	struct completion clock_accepted;
 	unsigned int substreams_counter;
 
@@ -195,6 +215,7 @@ static inline int snd_dice_transaction_read_sync(struct snd_dice *dice,
 int snd_dice_transaction_get_clock_source(struct snd_dice *dice,
 					  unsigned int *source);
 int snd_dice_transaction_get_rate(struct snd_dice *dice, unsigned int *rate);
+int snd_dice_transaction_refresh_snapshots(struct snd_dice *dice);
 int snd_dice_transaction_set_enable(struct snd_dice *dice);
 void snd_dice_transaction_clear_enable(struct snd_dice *dice);
 int snd_dice_transaction_init(struct snd_dice *dice);
@@ -213,6 +234,8 @@ void snd_dice_stream_destroy_duplex(struct snd_dice *dice);
 int snd_dice_stream_reserve_duplex(struct snd_dice *dice, unsigned int rate,
 				   unsigned int events_per_period,
 				   unsigned int events_per_buffer);
+int snd_dice_stream_preflight(struct snd_dice *dice, unsigned int rate,
+			      struct fw_iso_preflight *preflight);
 void snd_dice_stream_update_duplex(struct snd_dice *dice);
 int snd_dice_stream_detect_current_formats(struct snd_dice *dice);
 
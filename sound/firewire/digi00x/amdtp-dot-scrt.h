@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * amdtp-dot-scrt.h - a part of driver for Digidesign Digi 002/003 family
+ *
+ * Copyright (c) 2014-2015 Takashi Sakamoto
+ * Copyright (C) 2012 Robin Gareus <robin@gareus.org>
+ * Copyright (C) 2012 Damien Zammit <damien@zamaudio.com>
+ */
+
+#ifndef SOUND_DIGI00X_AMDTP_DOT_SCRT_H_INCLUDED
+#define SOUND_DIGI00X_AMDTP_DOT_SCRT_H_INCLUDED
+
+// The scrambler depends on nothing but the definitions in this header, so that it is built also
+// in userspace by pcmbench.c with a shim header for the definitions.
+#include <linux/types.h>
+
+/*
+ * The double-oh-three algorithm was discovered by Robin Gareus and Damien
+ * Zammit in 2012, with reverse-engineering for Digi 003 Rack.
+ */
+struct dot_state {
+	u8 carry;
+	u8 idx;
+	unsigned int off;
+};
+
+#define BYTE_PER_SAMPLE (4)
+#define MAGIC_DOT_BYTE (2)
+#define MAGIC_BYTE_OFF(x) (((x) * BYTE_PER_SAMPLE) + MAGIC_DOT_BYTE)
+
+/*
+ * The salt is always zero for the offset larger than the maximum length of
+ * pattern, thus the offset is saturated at the last entry.
+ */
+#define DOT_SCRT_OFFSETS	16
+extern u8 dot_scrt_table[256][DOT_SCRT_OFFSETS];
+
+void amdtp_dot_build_scrt_table(void);
+
+static inline void dot_encode_step(struct dot_state *state, __be32 *const buffer)
+{
+	u8 * const data = (u8 *) buffer;
+
+	if (data[MAGIC_DOT_BYTE] != 0x00) {
+		state->off = 0;
+		state->idx = data[MAGIC_DOT_BYTE] ^ state->carry;
+	}
+	data[MAGIC_DOT_BYTE] ^= state->carry;
+	if (state->off < DOT_SCRT_OFFSETS - 1)
+		++state->off;
+	state->carry = dot_scrt_table[state->idx][state->off];
+}
+
+#endif
@@ -7,8 +7,10 @@
  * Copyright (C) 2012 Damien Zammit <damien@zamaudio.com>
  */
 
+#include <linux/module.h>
 #include <sound/pcm.h>
 #include "digi00x.h"
+#include "../amdtp-pcm.h"
 
 #define CIP_FMT_AM		0x10
 
@@ -27,19 +29,14 @@
  */
 #define MAX_MIDI_RX_BLOCKS	8
 
+static bool fast_midi;
+module_param(fast_midi, bool, 0644);
+MODULE_PARM_DESC(fast_midi,
+		 "Transfer MIDI bytes without the ratelimit of MIDI DIN port (default: false)");
+
 /* 3 = MAX(DOT_MIDI_IN_PORTS, DOT_MIDI_OUT_PORTS) + 1. */
 #define MAX_MIDI_PORTS		3
 
-/*
- * The double-oh-three algorithm was discovered by Robin Gareus and Damien
- * Zammit in 2012, with reverse-engineering for Digi 003 Rack.
- */
-struct dot_state {
-	u8 carry;
-	u8 idx;
-	unsigned int off;
-};
-
 struct amdtp_dot {
 	unsigned int pcm_channels;
 	struct dot_state state;
@@ -47,68 +44,10 @@ struct amdtp_dot {
 	struct snd_rawmidi_substream *midi[MAX_MIDI_PORTS];
 	int midi_fifo_used[MAX_MIDI_PORTS];
 	int midi_fifo_limit;
-};
-
-/*
- * double-oh-three look up table
- *
- * @param idx index byte (audio-sample data) 0x00..0xff
- * @param off channel offset shift
- * @return salt to XOR with given data
- */
-#define BYTE_PER_SAMPLE (4)
-#define MAGIC_DOT_BYTE (2)
-#define MAGIC_BYTE_OFF(x) (((x) * BYTE_PER_SAMPLE) + MAGIC_DOT_BYTE)
-static u8 dot_scrt(const u8 idx, const unsigned int off)
-{
-	/*
-	 * the length of the added pattern only depends on the lower nibble
-	 * of the last non-zero data
-	 */
-	static const u8 len[16] = {0, 1, 3, 5, 7, 9, 11, 13, 14,
-				   12, 10, 8, 6, 4, 2, 0};
-
-	/*
-	 * the lower nibble of the salt. Interleaved sequence.
-	 * this is walked backwards according to len[]
-	 */
-	static const u8 nib[15] = {0x8, 0x7, 0x9, 0x6, 0xa, 0x5, 0xb, 0x4,
-				   0xc, 0x3, 0xd, 0x2, 0xe, 0x1, 0xf};
-
-	/* circular list for the salt's hi nibble. */
-	static const u8 hir[15] = {0x0, 0x6, 0xf, 0x8, 0x7, 0x5, 0x3, 0x4,
-				   0xc, 0xd, 0xe, 0x1, 0x2, 0xb, 0xa};
-
-	/*
-	 * start offset for upper nibble mapping.
-	 * note: 9 is /special/. In the case where the high nibble == 0x9,
-	 * hir[] is not used and - coincidentally - the salt's hi nibble is
-	 * 0x09 regardless of the offset.
-	 */
-	static const u8 hio[16] = {0, 11, 12, 6, 7, 5, 1, 4,
-				   3, 0x00, 14, 13, 8, 9, 10, 2};
-
-	const u8 ln = idx & 0xf;
-	const u8 hn = (idx >> 4) & 0xf;
-	const u8 hr = (hn == 0x9) ? 0x9 : hir[(hio[hn] + off) % 15];
 
-	if (len[ln] < off)
-		return 0x00;
-
-	return ((nib[14 + off - len[ln]]) | (hr << 4));
-}
-
-static void dot_encode_step(struct dot_state *state, __be32 *const buffer)
-{
-	u8 * const data = (u8 *) buffer;
-
-	if (data[MAGIC_DOT_BYTE] != 0x00) {
-		state->off = 0;
-		state->idx = data[MAGIC_DOT_BYTE] ^ state->carry;
-	}
-	data[MAGIC_DOT_BYTE] ^= state->carry;
-	state->carry = dot_scrt(state->idx, ++(state->off));
-}
+	// The bytes for each port in the packets processed in one callback.
+	struct amdtp_midi_batch midi_batch[MAX_MIDI_PORTS];
+};
 
 int amdtp_dot_set_parameters(struct amdtp_stream *s, unsigned int rate,
 			     unsigned int pcm_channels)
@@ -149,29 +88,52 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 	struct amdtp_dot *p = s->protocol;
 	unsigned int channels = p->pcm_channels;
 	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
+	unsigned int bytes = amdtp_pcm_sample_bytes(runtime->format);
+	// The state is kept in local storage during the packet.
+	struct dot_state state = p->state;
 	int remaining_frames;
-	const u32 *src;
+	const void *src;
 	int i, c;
 
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
+	buffer++;
+
+	// The scrambler should be applied to the data channels in the order of data block.
+	if (amdtp_pcm_is_planar(runtime)) {
+		unsigned int frame = amdtp_pcm_planar_position(s, runtime, pcm_frames);
+
+		for (i = 0; i < frames; ++i) {
+			for (c = 0; c < channels; ++c) {
+				u32 sample;
+
+				src = amdtp_pcm_planar_sample(runtime, c, frame, bytes);
+				sample = amdtp_pcm_load_sample(src, runtime->format);
+				buffer[c] = cpu_to_be32((sample >> 8) | 0x40000000);
+				dot_encode_step(&state, &buffer[c]);
+			}
+			buffer += s->data_block_quadlets;
+			if (++frame >= runtime->buffer_size)
+				frame = 0;
+		}
+		p->state = state;
+		return;
+	}
 
-	src = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
+	src = amdtp_pcm_buffer_position(s, runtime, pcm_frames, &remaining_frames);
 
-	buffer++;
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c) {
-			buffer[c] = cpu_to_be32((*src >> 8) | 0x40000000);
-			dot_encode_step(&p->state, &buffer[c]);
-			src++;
+			u32 sample = amdtp_pcm_load_sample(src, runtime->format);
+
+			buffer[c] = cpu_to_be32((sample >> 8) | 0x40000000);
+			dot_encode_step(&state, &buffer[c]);
+			src += bytes;
 		}
 		buffer += s->data_block_quadlets;
 		if (--remaining_frames == 0)
 			src = (void *)runtime->dma_area;
 	}
+
+	p->state = state;
 }
 
 static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
@@ -179,46 +141,17 @@ static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			 unsigned int pcm_frames)
 {
 	struct amdtp_dot *p = s->protocol;
-	unsigned int channels = p->pcm_channels;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	u32 *dst;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
 
-	dst  = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
-
-	buffer++;
-	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			*dst = be32_to_cpu(buffer[c]) << 8;
-			dst++;
-		}
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			dst = (void *)runtime->dma_area;
-	}
+	amdtp_pcm_read(s, pcm, buffer + 1, frames, pcm_frames, p->pcm_channels,
+		       8, 0xffffffff, false);
 }
 
 static void write_pcm_silence(struct amdtp_stream *s, __be32 *buffer,
 			      unsigned int data_blocks)
 {
 	struct amdtp_dot *p = s->protocol;
-	unsigned int channels, i, c;
 
-	channels = p->pcm_channels;
-
-	buffer++;
-	for (i = 0; i < data_blocks; ++i) {
-		for (c = 0; c < channels; ++c)
-			buffer[c] = cpu_to_be32(0x40000000);
-		buffer += s->data_block_quadlets;
-	}
+	amdtp_pcm_write_silence(s, buffer + 1, data_blocks, p->pcm_channels, 0x40000000, false);
 }
 
 static bool midi_ratelimit_per_packet(struct amdtp_stream *s, unsigned int port)
@@ -259,9 +192,8 @@ static void write_midi_messages(struct amdtp_stream *s, __be32 *buffer,
 
 		len = 0;
 		if (port < MAX_MIDI_PORTS &&
-		    midi_ratelimit_per_packet(s, port) &&
-		    p->midi[port] != NULL)
-			len = snd_rawmidi_transmit(p->midi[port], b + 1, 2);
+		    (READ_ONCE(fast_midi) || midi_ratelimit_per_packet(s, port)))
+			len = amdtp_midi_batch_pull(&p->midi_batch[port], b + 1, 2);
 
 		if (len > 0) {
 			/*
@@ -289,14 +221,35 @@ static void write_midi_messages(struct amdtp_stream *s, __be32 *buffer,
 	}
 }
 
-static void read_midi_messages(struct amdtp_stream *s, __be32 *buffer,
-			       unsigned int data_blocks)
+// Each port has one data block in every eight data blocks, thus the bytes for the packets are
+// fetched from rawmidi substream at once.
+static void fetch_midi_messages(struct amdtp_stream *s, unsigned int packets)
+{
+	struct amdtp_dot *p = s->protocol;
+	unsigned int count = packets * DIV_ROUND_UP(s->syt_interval, 8) * 2;
+	unsigned int port;
+
+	for (port = 0; port < MAX_MIDI_PORTS; ++port)
+		amdtp_midi_batch_fetch(&p->midi_batch[port], READ_ONCE(p->midi[port]), count);
+}
+
+static void commit_midi_messages(struct amdtp_stream *s)
+{
+	struct amdtp_dot *p = s->protocol;
+	unsigned int port;
+
+	for (port = 0; port < MAX_MIDI_PORTS; ++port)
+		amdtp_midi_batch_commit(&p->midi_batch[port]);
+}
+
+static void read_midi_messages(struct amdtp_stream *s, const struct pkt_desc *desc)
 {
 	struct amdtp_dot *p = s->protocol;
+	__be32 *buffer = desc->ctx_payload;
 	unsigned int f, port, len;
 	u8 *b;
 
-	for (f = 0; f < data_blocks; f++) {
+	for (f = 0; f < desc->data_blocks; f++) {
 		b = (u8 *)&buffer[0];
 
 		len = b[3] & 0x0f;
@@ -311,8 +264,10 @@ static void read_midi_messages(struct amdtp_stream *s, __be32 *buffer,
 			else
 				port = 0;
 
-			if (port < MAX_MIDI_PORTS && p->midi[port])
-				snd_rawmidi_receive(p->midi[port], b + 1, len);
+			if (port < MAX_MIDI_PORTS && p->midi[port]) {
+				amdtp_midi_batch_push(&p->midi_batch[port], p->midi[port], b + 1, len);
+				amdtp_stream_queue_midi_event(s, desc, f, port, b + 1, len);
+			}
 		}
 
 		buffer += s->data_block_quadlets;
@@ -337,8 +292,21 @@ void amdtp_dot_midi_trigger(struct amdtp_stream *s, unsigned int port,
 {
 	struct amdtp_dot *p = s->protocol;
 
-	if (port < MAX_MIDI_PORTS)
-		WRITE_ONCE(p->midi[port], midi);
+	unsigned int i;
+
+	if (port >= MAX_MIDI_PORTS)
+		return;
+
+	WRITE_ONCE(p->midi[port], midi);
+	amdtp_stream_midi_trigger(s, port, midi != NULL);
+
+	if (s->direction == AMDTP_IN_STREAM) {
+		for (i = 0; i < MAX_MIDI_PORTS; ++i) {
+			if (p->midi[i])
+				break;
+		}
+		amdtp_stream_set_idle_payloads(s, i == MAX_MIDI_PORTS);
+	}
 }
 
 static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
@@ -346,6 +314,7 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 					    unsigned int packets,
 					    struct snd_pcm_substream *pcm)
 {
+	struct amdtp_dot *p = s->protocol;
 	unsigned int pcm_frames = 0;
 	int i;
 
@@ -359,9 +328,13 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 			pcm_frames += data_blocks;
 		}
 
-		read_midi_messages(s, buf, data_blocks);
+		read_midi_messages(s, desc);
 	}
 
+	// The bytes in the batch of packets are delivered at once.
+	for (i = 0; i < MAX_MIDI_PORTS; ++i)
+		amdtp_midi_batch_deliver(&p->midi_batch[i]);
+
 	return pcm_frames;
 }
 
@@ -373,6 +346,8 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 	unsigned int pcm_frames = 0;
 	int i;
 
+	fetch_midi_messages(s, packets);
+
 	for (i = 0; i < packets; ++i) {
 		const struct pkt_desc *desc = descs + i;
 		__be32 *buf = desc->ctx_payload;
@@ -381,7 +356,8 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 		if (pcm) {
 			write_pcm_s32(s, pcm, buf, data_blocks, pcm_frames);
 			pcm_frames += data_blocks;
-		} else {
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+		} else if (!amdtp_stream_pcm_silence_cached(s, desc, data_blocks)) {
 			write_pcm_silence(s, buf, data_blocks);
 		}
 
@@ -389,6 +365,8 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 				    desc->data_block_counter);
 	}
 
+	commit_midi_messages(s);
+
 	return pcm_frames;
 }
 
@@ -397,6 +375,7 @@ int amdtp_dot_init(struct amdtp_stream *s, struct fw_unit *unit,
 {
 	amdtp_stream_process_ctx_payloads_t process_ctx_payloads;
 	unsigned int flags = CIP_NONBLOCKING | CIP_UNAWARE_SYT;
+	int err;
 
 	// Use different mode between incoming/outgoing.
 	if (dir == AMDTP_IN_STREAM)
@@ -404,8 +383,16 @@ int amdtp_dot_init(struct amdtp_stream *s, struct fw_unit *unit,
 	else
 		process_ctx_payloads = process_it_ctx_payloads;
 
-	return amdtp_stream_init(s, unit, dir, flags, CIP_FMT_AM,
+	err = amdtp_stream_init(s, unit, dir, flags, CIP_FMT_AM,
 				process_ctx_payloads, sizeof(struct amdtp_dot));
+	if (err < 0)
+		return err;
+
+	// MIDI substreams are not attached yet.
+	if (dir == AMDTP_IN_STREAM)
+		amdtp_stream_set_idle_payloads(s, true);
+
+	return 0;
 }
 
 void amdtp_dot_reset(struct amdtp_stream *s)
@@ -156,11 +156,28 @@ static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(dg00x);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(dg00x);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(&dg00x->tx_stream, 1,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&dg00x->domain, dg00x->unit, (void __user *)arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
 }
 
+static int hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+		      struct vm_area_struct *area)
+{
+	struct snd_dg00x *dg00x = hwdep->private_data;
+	struct amdtp_stream *const streams[] = {
+		&dg00x->tx_stream,
+		&dg00x->rx_stream,
+	};
+
+	return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+}
+
 #ifdef CONFIG_COMPAT
 static int hwdep_compat_ioctl(struct snd_hwdep *hwdep, struct file *file,
 			      unsigned int cmd, unsigned long arg)
@@ -180,6 +197,7 @@ int snd_dg00x_create_hwdep_device(struct snd_dg00x *dg00x)
 		.poll		= hwdep_poll,
 		.ioctl		= hwdep_ioctl,
 		.ioctl_compat	= hwdep_compat_ioctl,
+		.mmap		= hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
@@ -63,10 +63,10 @@ static int pcm_init_hw_params(struct snd_dg00x *dg00x,
 	int err;
 
 	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
-		substream->runtime->hw.formats = SNDRV_PCM_FMTBIT_S32;
+		substream->runtime->hw.formats = AMDTP_PCM_FORMAT_BITS;
 		s = &dg00x->tx_stream;
 	} else {
-		substream->runtime->hw.formats = SNDRV_PCM_FMTBIT_S32;
+		substream->runtime->hw.formats = AMDTP_PCM_FORMAT_BITS;
 		s = &dg00x->rx_stream;
 	}
 
@@ -319,6 +319,28 @@ static int pcm_playback_ack(struct snd_pcm_substream *substream)
 	return amdtp_domain_stream_pcm_ack(&dg00x->domain, &dg00x->rx_stream);
 }
 
+static int pcm_capture_time_info(struct snd_pcm_substream *substream,
+				 struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				 struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				 struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_dg00x *dg00x = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&dg00x->tx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
+static int pcm_playback_time_info(struct snd_pcm_substream *substream,
+				  struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				  struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				  struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_dg00x *dg00x = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&dg00x->rx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
 int snd_dg00x_create_pcm_devices(struct snd_dg00x *dg00x)
 {
 	static const struct snd_pcm_ops capture_ops = {
@@ -330,6 +352,7 @@ int snd_dg00x_create_pcm_devices(struct snd_dg00x *dg00x)
 		.trigger	= pcm_capture_trigger,
 		.pointer	= pcm_capture_pointer,
 		.ack		= pcm_capture_ack,
+		.get_time_info	= pcm_capture_time_info,
 	};
 	static const struct snd_pcm_ops playback_ops = {
 		.open		= pcm_open,
@@ -340,6 +363,7 @@ int snd_dg00x_create_pcm_devices(struct snd_dg00x *dg00x)
 		.trigger	= pcm_playback_trigger,
 		.pointer	= pcm_playback_pointer,
 		.ack		= pcm_playback_ack,
+		.get_time_info	= pcm_playback_time_info,
 	};
 	struct snd_pcm *pcm;
 	int err;
@@ -353,7 +377,7 @@ int snd_dg00x_create_pcm_devices(struct snd_dg00x *dg00x)
 		 "%s PCM", dg00x->card->shortname);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &playback_ops);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &capture_ops);
-	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_fw_pcm_set_managed_buffer_all(pcm);
 
 	return 0;
 }
@@ -10,14 +10,12 @@
 static int get_optical_iface_mode(struct snd_dg00x *dg00x,
 				  enum snd_dg00x_optical_mode *mode)
 {
-	__be32 data;
+	u32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
-				 DG00X_ADDR_BASE + DG00X_OFFSET_OPT_IFACE_MODE,
-				 &data, sizeof(data), 0);
+	err = snd_dg00x_transaction_read_status(dg00x, DG00X_OFFSET_OPT_IFACE_MODE, &data);
 	if (err >= 0)
-		*mode = be32_to_cpu(data) & 0x01;
+		*mode = data & 0x01;
 
 	return err;
 }
@@ -65,6 +63,44 @@ static void proc_read_clock(struct snd_info_entry *entry,
 		snd_iprintf(buf, "External sampling rate: %d\n", rate);
 }
 
+static void proc_read_histograms(struct snd_info_entry *entry,
+				 struct snd_info_buffer *buf)
+{
+	struct snd_dg00x *dg00x = entry->private_data;
+
+	snd_iprintf(buf, "Output Stream from device:\n");
+	amdtp_stream_dump_histograms(&dg00x->tx_stream, buf);
+	snd_iprintf(buf, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&dg00x->rx_stream, buf);
+}
+
+static void proc_read_preflight(struct snd_info_entry *entry,
+				struct snd_info_buffer *buf)
+{
+	struct snd_dg00x *dg00x = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	unsigned int rate;
+	int err;
+
+	if (snd_dg00x_stream_get_local_rate(dg00x, &rate) < 0)
+		return;
+
+	mutex_lock(&dg00x->mutex);
+	err = snd_dg00x_stream_preflight(dg00x, rate, &preflight);
+	mutex_unlock(&dg00x->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, dg00x->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buf, "Rate:\t%u\n", rate);
+	snd_iprintf(buf, "Reserved:\t%s\n", dg00x->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buf);
+}
+
 void snd_dg00x_proc_init(struct snd_dg00x *dg00x)
 {
 	struct snd_info_entry *root, *entry;
@@ -83,4 +119,14 @@ void snd_dg00x_proc_init(struct snd_dg00x *dg00x)
 	entry = snd_info_create_card_entry(dg00x->card, "clock", root);
 	if (entry)
 		snd_info_set_text_ops(entry, dg00x, proc_read_clock);
+
+	entry = snd_info_create_card_entry(dg00x->card, "histogram", root);
+	if (entry)
+		snd_info_set_text_ops(entry, dg00x, proc_read_histograms);
+
+	entry = snd_info_create_card_entry(dg00x->card, "preflight", root);
+	if (entry)
+		snd_info_set_text_ops(entry, dg00x, proc_read_preflight);
+
+	amdtp_domain_add_proc_nodes(&dg00x->domain, root);
 }
@@ -8,6 +8,8 @@
 #include "digi00x.h"
 
 #define READY_TIMEOUT_MS	200
+#define SESSION_FINISH_MS	50
+#define STREAMING_STEP_MS	20
 
 const unsigned int snd_dg00x_stream_rates[SND_DG00X_RATE_COUNT] = {
 	[SND_DG00X_RATE_44100] = 44100,
@@ -30,16 +32,13 @@ snd_dg00x_stream_pcm_channels[SND_DG00X_RATE_COUNT] = {
 int snd_dg00x_stream_get_local_rate(struct snd_dg00x *dg00x, unsigned int *rate)
 {
 	u32 data;
-	__be32 reg;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
-				 DG00X_ADDR_BASE + DG00X_OFFSET_LOCAL_RATE,
-				 &reg, sizeof(reg), 0);
+	err = snd_dg00x_transaction_read_status(dg00x, DG00X_OFFSET_LOCAL_RATE, &data);
 	if (err < 0)
 		return err;
 
-	data = be32_to_cpu(reg) & 0x0f;
+	data &= 0x0f;
 	if (data < ARRAY_SIZE(snd_dg00x_stream_rates))
 		*rate = snd_dg00x_stream_rates[data];
 	else
@@ -52,6 +51,7 @@ int snd_dg00x_stream_set_local_rate(struct snd_dg00x *dg00x, unsigned int rate)
 {
 	__be32 reg;
 	unsigned int i;
+	int err;
 
 	for (i = 0; i < ARRAY_SIZE(snd_dg00x_stream_rates); i++) {
 		if (rate == snd_dg00x_stream_rates[i])
@@ -61,24 +61,27 @@ int snd_dg00x_stream_set_local_rate(struct snd_dg00x *dg00x, unsigned int rate)
 		return -EINVAL;
 
 	reg = cpu_to_be32(i);
-	return snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
-				  DG00X_ADDR_BASE + DG00X_OFFSET_LOCAL_RATE,
-				  &reg, sizeof(reg), 0);
+	err = snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+				 DG00X_ADDR_BASE + DG00X_OFFSET_LOCAL_RATE,
+				 &reg, sizeof(reg), 0);
+
+	// The other registers for clock status can follow the change.
+	snd_dg00x_transaction_invalidate_status(dg00x);
+
+	return err;
 }
 
 int snd_dg00x_stream_get_clock(struct snd_dg00x *dg00x,
 			       enum snd_dg00x_clock *clock)
 {
-	__be32 reg;
+	u32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
-				 DG00X_ADDR_BASE + DG00X_OFFSET_CLOCK_SOURCE,
-				 &reg, sizeof(reg), 0);
+	err = snd_dg00x_transaction_read_status(dg00x, DG00X_OFFSET_CLOCK_SOURCE, &data);
 	if (err < 0)
 		return err;
 
-	*clock = be32_to_cpu(reg) & 0x0f;
+	*clock = data & 0x0f;
 	if (*clock >= SND_DG00X_CLOCK_COUNT)
 		err = -EIO;
 
@@ -87,14 +90,12 @@ int snd_dg00x_stream_get_clock(struct snd_dg00x *dg00x,
 
 int snd_dg00x_stream_check_external_clock(struct snd_dg00x *dg00x, bool *detect)
 {
-	__be32 reg;
+	u32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
-				 DG00X_ADDR_BASE + DG00X_OFFSET_DETECT_EXTERNAL,
-				 &reg, sizeof(reg), 0);
+	err = snd_dg00x_transaction_read_status(dg00x, DG00X_OFFSET_DETECT_EXTERNAL, &data);
 	if (err >= 0)
-		*detect = be32_to_cpu(reg) > 0;
+		*detect = data > 0;
 
 	return err;
 }
@@ -103,16 +104,13 @@ int snd_dg00x_stream_get_external_rate(struct snd_dg00x *dg00x,
 				       unsigned int *rate)
 {
 	u32 data;
-	__be32 reg;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
-				 DG00X_ADDR_BASE + DG00X_OFFSET_EXTERNAL_RATE,
-				 &reg, sizeof(reg), 0);
+	err = snd_dg00x_transaction_read_status(dg00x, DG00X_OFFSET_EXTERNAL_RATE, &data);
 	if (err < 0)
 		return err;
 
-	data = be32_to_cpu(reg) & 0x0f;
+	data &= 0x0f;
 	if (data < ARRAY_SIZE(snd_dg00x_stream_rates))
 		*rate = snd_dg00x_stream_rates[data];
 	/* This means desync. */
@@ -138,8 +136,40 @@ static void finish_session(struct snd_dg00x *dg00x)
 			   &data, sizeof(data), 0);
 
 	// Just after finishing the session, the device may lost transmitting
-	// functionality for a short time.
-	msleep(50);
+	// functionality for a short time. Instead of sleeping here, the time is spent for the
+	// other work till the next session.
+	dg00x->session_finishes_at = jiffies + msecs_to_jiffies(SESSION_FINISH_MS);
+	dg00x->session_finishing = true;
+}
+
+static void wait_session_finished(struct snd_dg00x *dg00x)
+{
+	if (dg00x->session_finishing) {
+		long remaining = (long)(dg00x->session_finishes_at - jiffies);
+
+		if (remaining > 0)
+			schedule_timeout_uninterruptible(remaining);
+		dg00x->session_finishing = false;
+	}
+}
+
+// Poll the state till it reflects the step, up to the interval in which the stepping was done.
+static int wait_streaming_state(struct snd_dg00x *dg00x, u32 step)
+{
+	unsigned long expires = jiffies + msecs_to_jiffies(STREAMING_STEP_MS);
+	__be32 data;
+	int err;
+
+	while (true) {
+		err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
+					 DG00X_ADDR_BASE + DG00X_OFFSET_STREAMING_STATE,
+					 &data, sizeof(data), 0);
+		if (err < 0)
+			return err;
+		if (be32_to_cpu(data) == step || time_after(jiffies, expires))
+			return 0;
+		usleep_range(1000, 2000);
+	}
 }
 
 static int begin_session(struct snd_dg00x *dg00x)
@@ -148,6 +178,8 @@ static int begin_session(struct snd_dg00x *dg00x)
 	u32 curr;
 	int err;
 
+	wait_session_finished(dg00x);
+
 	// Register isochronous channels for both direction.
 	data = cpu_to_be32((dg00x->tx_resources.channel << 16) |
 			   dg00x->rx_resources.channel);
@@ -178,19 +210,18 @@ static int begin_session(struct snd_dg00x *dg00x)
 		if (err < 0)
 			break;
 
-		msleep(20);
+		err = wait_streaming_state(dg00x, curr);
+		if (err < 0)
+			break;
 		curr--;
 	}
 
 	return err;
 }
 
-static int keep_resources(struct snd_dg00x *dg00x, struct amdtp_stream *stream,
-			  unsigned int rate)
+static int set_stream_parameters(struct amdtp_stream *stream, unsigned int rate)
 {
-	struct fw_iso_resources *resources;
 	int i;
-	int err;
 
 	// Check sampling rate.
 	for (i = 0; i < SND_DG00X_RATE_COUNT; i++) {
@@ -200,13 +231,22 @@ static int keep_resources(struct snd_dg00x *dg00x, struct amdtp_stream *stream,
 	if (i == SND_DG00X_RATE_COUNT)
 		return -EINVAL;
 
+	return amdtp_dot_set_parameters(stream, rate,
+					snd_dg00x_stream_pcm_channels[i]);
+}
+
+static int keep_resources(struct snd_dg00x *dg00x, struct amdtp_stream *stream,
+			  unsigned int rate)
+{
+	struct fw_iso_resources *resources;
+	int err;
+
 	if (stream == &dg00x->tx_stream)
 		resources = &dg00x->tx_resources;
 	else
 		resources = &dg00x->rx_resources;
 
-	err = amdtp_dot_set_parameters(stream, rate,
-				       snd_dg00x_stream_pcm_channels[i]);
+	err = set_stream_parameters(stream, rate);
 	if (err < 0)
 		return err;
 
@@ -234,8 +274,16 @@ static int init_stream(struct snd_dg00x *dg00x, struct amdtp_stream *s)
 		return err;
 
 	err = amdtp_dot_init(s, dg00x->unit, dir);
-	if (err < 0)
+	if (err < 0) {
 		fw_iso_resources_destroy(resources);
+		return err;
+	}
+
+	err = amdtp_stream_add_counters(s, dg00x->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(s);
+		fw_iso_resources_destroy(resources);
+	}
 
 	return err;
 }
@@ -283,6 +331,32 @@ void snd_dg00x_stream_destroy_duplex(struct snd_dg00x *dg00x)
 	destroy_stream(dg00x, &dg00x->tx_stream);
 }
 
+// Count the resources which snd_dg00x_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The parameters of streams are changed only when they are not reserved yet.
+int snd_dg00x_stream_preflight(struct snd_dg00x *dg00x, unsigned int rate,
+			       struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(dg00x->unit)->max_speed;
+	int err;
+
+	if (dg00x->substreams_counter == 0) {
+		err = set_stream_parameters(&dg00x->tx_stream, rate);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(&dg00x->rx_stream, rate);
+		if (err < 0)
+			return err;
+	}
+
+	fw_iso_preflight_add(preflight, dg00x->unit, FW_ISO_CONTEXT_RECEIVE,
+			     amdtp_stream_get_max_payload(&dg00x->tx_stream), speed);
+	fw_iso_preflight_add(preflight, dg00x->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&dg00x->rx_stream), speed);
+
+	return 0;
+}
+
 int snd_dg00x_stream_reserve_duplex(struct snd_dg00x *dg00x, unsigned int rate,
 				    unsigned int frames_per_period,
 				    unsigned int frames_per_buffer)
@@ -413,14 +487,14 @@ void snd_dg00x_stream_update_duplex(struct snd_dg00x *dg00x)
 	fw_iso_resources_update(&dg00x->tx_resources);
 	fw_iso_resources_update(&dg00x->rx_resources);
 
-	amdtp_stream_update(&dg00x->tx_stream);
-	amdtp_stream_update(&dg00x->rx_stream);
+	amdtp_domain_update(&dg00x->domain);
 }
 
 void snd_dg00x_stream_lock_changed(struct snd_dg00x *dg00x)
 {
 	dg00x->dev_lock_changed = true;
 	wake_up(&dg00x->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(dg00x->card, dg00x->dev_lock_count > 0);
 }
 
 int snd_dg00x_stream_lock_try(struct snd_dg00x *dg00x)
@@ -8,16 +8,81 @@
 #include <sound/asound.h>
 #include "digi00x.h"
 
+// The cached status is read again after the expiration, since the content of message is unknown
+// and the device may change the status without it.
+#define STATUS_EXPIRE_MS	1000
+
+static void invalidate_status(struct snd_dg00x *dg00x)
+{
+	dg00x->status.valid = 0;
+	++dg00x->status.generation;
+}
+
+// Read the quadlet register for clock status from the cache, or by the transaction to fill the
+// cache.
+int snd_dg00x_transaction_read_status(struct snd_dg00x *dg00x, unsigned int offset, u32 *value)
+{
+	unsigned int index = (offset - DG00X_OFFSET_LOCAL_RATE) / sizeof(__be32);
+	unsigned int generation;
+	__be32 reg;
+	int err;
+
+	BUILD_BUG_ON(DG00X_OFFSET_DETECT_EXTERNAL - DG00X_OFFSET_LOCAL_RATE >=
+		     DG00X_STATUS_QUADLETS * sizeof(__be32));
+
+	if (WARN_ON(offset < DG00X_OFFSET_LOCAL_RATE || index >= DG00X_STATUS_QUADLETS))
+		return -EINVAL;
+
+	spin_lock_irq(&dg00x->lock);
+	if (dg00x->status.valid && time_after(jiffies, dg00x->status.expires))
+		invalidate_status(dg00x);
+	if (test_bit(index, &dg00x->status.valid)) {
+		*value = dg00x->status.regs[index];
+		spin_unlock_irq(&dg00x->lock);
+		return 0;
+	}
+	generation = dg00x->status.generation;
+	spin_unlock_irq(&dg00x->lock);
+
+	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST, DG00X_ADDR_BASE + offset,
+				 &reg, sizeof(reg), 0);
+	if (err < 0)
+		return err;
+	*value = be32_to_cpu(reg);
+
+	spin_lock_irq(&dg00x->lock);
+	if (dg00x->status.generation == generation) {
+		if (!dg00x->status.valid)
+			dg00x->status.expires = jiffies + msecs_to_jiffies(STATUS_EXPIRE_MS);
+		dg00x->status.regs[index] = *value;
+		__set_bit(index, &dg00x->status.valid);
+	}
+	spin_unlock_irq(&dg00x->lock);
+
+	return 0;
+}
+
+void snd_dg00x_transaction_invalidate_status(struct snd_dg00x *dg00x)
+{
+	spin_lock_irq(&dg00x->lock);
+	invalidate_status(dg00x);
+	spin_unlock_irq(&dg00x->lock);
+}
+
 static void handle_unknown_message(struct snd_dg00x *dg00x,
 				   unsigned long long offset, __be32 *buf)
 {
+	u32 msg = be32_to_cpu(*buf);
 	unsigned long flags;
 
 	spin_lock_irqsave(&dg00x->lock, flags);
-	dg00x->msg = be32_to_cpu(*buf);
+	dg00x->msg = msg;
+	// The content of message is unknown, thus any message invalidates the cached status.
+	invalidate_status(dg00x);
 	spin_unlock_irqrestore(&dg00x->lock, flags);
 
 	wake_up(&dg00x->hwdep_wait);
+	snd_fw_event_mux_post(dg00x->card, SNDRV_FIREWIRE_EVENT_DIGI00X_MESSAGE, &msg, sizeof(msg));
 }
 
 static void handle_message(struct fw_card *card, struct fw_request *request,
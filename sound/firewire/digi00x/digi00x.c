@@ -114,6 +114,7 @@ static void snd_dg00x_update(struct fw_unit *unit)
 {
 	struct snd_dg00x *dg00x = dev_get_drvdata(&unit->device);
 
+	snd_dg00x_transaction_invalidate_status(dg00x);
 	snd_dg00x_transaction_reregister(dg00x);
 
 	mutex_lock(&dg00x->mutex);
@@ -156,6 +157,7 @@ static struct fw_driver dg00x_driver = {
 		.owner = THIS_MODULE,
 		.name = KBUILD_MODNAME,
 		.bus = &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = snd_dg00x_probe,
 	.update   = snd_dg00x_update,
@@ -165,6 +167,8 @@ static struct fw_driver dg00x_driver = {
 
 static int __init snd_dg00x_init(void)
 {
+	amdtp_dot_build_scrt_table();
+
 	return driver_register(&dg00x_driver.driver);
 }
 
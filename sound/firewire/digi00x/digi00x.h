@@ -32,6 +32,11 @@
 #include "../lib.h"
 #include "../iso-resources.h"
 #include "../amdtp-stream.h"
+#include "amdtp-dot-scrt.h"
+
+// The number of quadlets for clock status, from DG00X_OFFSET_LOCAL_RATE to
+// DG00X_OFFSET_DETECT_EXTERNAL.
+#define DG00X_STATUS_QUADLETS	8
 
 struct snd_dg00x {
 	struct snd_card *card;
@@ -47,6 +52,10 @@ struct snd_dg00x {
 	struct fw_iso_resources rx_resources;
 
 	unsigned int substreams_counter;
+	// The device may lose transmitting functionality for a short time after finishing the
+	// session. The next session begins after the expiration.
+	bool session_finishing;
+	unsigned long session_finishes_at;
 
 	/* for uapi */
 	int dev_lock_count;
@@ -57,6 +66,16 @@ struct snd_dg00x {
 	struct fw_address_handler async_handler;
 	u32 msg;
 
+	// The cache of registers for clock status. The cache is invalidated by any message from the
+	// device, bus reset, and change of local rate, or expires. The generation is incremented at
+	// invalidation so that the value read before it is not cached.
+	struct {
+		u32 regs[DG00X_STATUS_QUADLETS];
+		unsigned long valid;
+		unsigned int generation;
+		unsigned long expires;
+	} status;
+
 	/* Console models have additional MIDI ports for control surface. */
 	bool is_console;
 
@@ -128,6 +147,8 @@ void amdtp_dot_midi_trigger(struct amdtp_stream *s, unsigned int port,
 int snd_dg00x_transaction_register(struct snd_dg00x *dg00x);
 int snd_dg00x_transaction_reregister(struct snd_dg00x *dg00x);
 void snd_dg00x_transaction_unregister(struct snd_dg00x *dg00x);
+int snd_dg00x_transaction_read_status(struct snd_dg00x *dg00x, unsigned int offset, u32 *value);
+void snd_dg00x_transaction_invalidate_status(struct snd_dg00x *dg00x);
 
 extern const unsigned int snd_dg00x_stream_rates[SND_DG00X_RATE_COUNT];
 extern const unsigned int snd_dg00x_stream_pcm_channels[SND_DG00X_RATE_COUNT];
@@ -144,6 +165,8 @@ int snd_dg00x_stream_init_duplex(struct snd_dg00x *dg00x);
 int snd_dg00x_stream_reserve_duplex(struct snd_dg00x *dg00x, unsigned int rate,
 				    unsigned int frames_per_period,
 				    unsigned int frames_per_buffer);
+int snd_dg00x_stream_preflight(struct snd_dg00x *dg00x, unsigned int rate,
+			       struct fw_iso_preflight *preflight);
 int snd_dg00x_stream_start_duplex(struct snd_dg00x *dg00x);
 void snd_dg00x_stream_stop_duplex(struct snd_dg00x *dg00x);
 void snd_dg00x_stream_update_duplex(struct snd_dg00x *dg00x);
@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * The multiplexer of events from all of sound cards for audio and music units on IEEE 1394 bus
+ *
+ * Copyright (c) Clemens Ladisch <clemens@ladisch.de>
+ */
+
+#include <linux/kfifo.h>
+#include <linux/module.h>
+#include <linux/poll.h>
+#include <linux/sched/signal.h>
+#include <sound/core.h>
+#include <sound/info.h>
+#include "lib.h"
+
+#define EVENT_MUX_FIFO_SIZE	(16 * PAGE_SIZE)
+
+// The events are copied to the fifo only while the node is opened. The lock serializes the
+// producers in several cards, while the reader is serialized by the mutex.
+static struct {
+	struct snd_info_entry *entry;
+	DECLARE_KFIFO_PTR(fifo, u8);
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	struct mutex mutex;
+	unsigned int dropped;
+	bool opened;
+} event_mux = {
+	.lock = __SPIN_LOCK_UNLOCKED(event_mux.lock),
+	.wait = __WAIT_QUEUE_HEAD_INITIALIZER(event_mux.wait),
+	.mutex = __MUTEX_INITIALIZER(event_mux.mutex),
+};
+
+/**
+ * snd_fw_event_mux_is_open - check whether the multiplexer of events is opened by userspace
+ *
+ * The producer can skip building the event for the multiplexer when this returns false.
+ */
+bool snd_fw_event_mux_is_open(void)
+{
+	return READ_ONCE(event_mux.opened);
+}
+EXPORT_SYMBOL(snd_fw_event_mux_is_open);
+
+/**
+ * snd_fw_event_mux_post - post one event to the multiplexer of all of sound cards
+ * @card: the sound card from which the event comes
+ * @type: the type of event, one of SNDRV_FIREWIRE_EVENT_XXX
+ * @data: the content of event following the type field in union snd_firewire_event
+ * @length: the length of content in bytes, up to SND_FW_EVENT_MUX_MAX_LENGTH
+ *
+ * The event is copied when the multiplexer is opened by userspace, else discarded. The event
+ * should be delivered through the hwdep device of the card as well. This function can be
+ * called in any context.
+ */
+void snd_fw_event_mux_post(struct snd_card *card, unsigned int type, const void *data,
+			   unsigned int length)
+{
+	struct snd_firewire_event_record record;
+	unsigned long flags;
+	bool posted = false;
+
+	if (!snd_fw_event_mux_is_open())
+		return;
+
+	record.length = sizeof(record) + sizeof(type) + ALIGN(length, sizeof(u32));
+	record.card = card->number;
+
+	spin_lock_irqsave(&event_mux.lock, flags);
+
+	if (!event_mux.opened)
+		goto end;
+
+	if (length > SND_FW_EVENT_MUX_MAX_LENGTH || kfifo_avail(&event_mux.fifo) < record.length) {
+		++event_mux.dropped;
+		goto end;
+	}
+
+	record.dropped = event_mux.dropped;
+	event_mux.dropped = 0;
+
+	kfifo_in(&event_mux.fifo, (const u8 *)&record, sizeof(record));
+	kfifo_in(&event_mux.fifo, (const u8 *)&type, sizeof(type));
+	kfifo_in(&event_mux.fifo, (const u8 *)data, length);
+	if (length % sizeof(u32)) {
+		static const u8 padding[sizeof(u32)];
+
+		kfifo_in(&event_mux.fifo, padding, sizeof(u32) - length % sizeof(u32));
+	}
+	posted = true;
+end:
+	spin_unlock_irqrestore(&event_mux.lock, flags);
+
+	if (posted)
+		wake_up(&event_mux.wait);
+}
+EXPORT_SYMBOL(snd_fw_event_mux_post);
+
+/**
+ * snd_fw_event_mux_post_lock_status - post the event of lock status to the multiplexer
+ * @card: the sound card from which the event comes
+ * @locked: whether the streaming is locked or not
+ */
+void snd_fw_event_mux_post_lock_status(struct snd_card *card, bool locked)
+{
+	unsigned int status = locked;
+
+	snd_fw_event_mux_post(card, SNDRV_FIREWIRE_EVENT_LOCK_STATUS, &status, sizeof(status));
+}
+EXPORT_SYMBOL(snd_fw_event_mux_post_lock_status);
+
+static int event_mux_open(struct snd_info_entry *entry, unsigned short mode,
+			  void **file_private_data)
+{
+	int err = 0;
+
+	mutex_lock(&event_mux.mutex);
+
+	if (event_mux.opened) {
+		err = -EBUSY;
+		goto end;
+	}
+
+	// The fifo is kept till the module is unloaded.
+	if (!kfifo_initialized(&event_mux.fifo)) {
+		err = kfifo_alloc(&event_mux.fifo, EVENT_MUX_FIFO_SIZE, GFP_KERNEL);
+		if (err < 0)
+			goto end;
+	}
+
+	spin_lock_irq(&event_mux.lock);
+	kfifo_reset(&event_mux.fifo);
+	event_mux.dropped = 0;
+	WRITE_ONCE(event_mux.opened, true);
+	spin_unlock_irq(&event_mux.lock);
+end:
+	mutex_unlock(&event_mux.mutex);
+
+	return err;
+}
+
+static int event_mux_release(struct snd_info_entry *entry, unsigned short mode,
+			     void *file_private_data)
+{
+	mutex_lock(&event_mux.mutex);
+
+	spin_lock_irq(&event_mux.lock);
+	WRITE_ONCE(event_mux.opened, false);
+	spin_unlock_irq(&event_mux.lock);
+
+	mutex_unlock(&event_mux.mutex);
+
+	return 0;
+}
+
+// As many whole records as fit in the buffer are read at once.
+static ssize_t event_mux_read(struct snd_info_entry *entry, void *file_private_data,
+			      struct file *file, char __user *buf, size_t count, loff_t pos)
+{
+	struct snd_firewire_event_record record;
+	unsigned int copied;
+	ssize_t consumed = 0;
+	int err;
+
+	if (mutex_lock_interruptible(&event_mux.mutex))
+		return -ERESTARTSYS;
+
+	while (kfifo_is_empty(&event_mux.fifo)) {
+		mutex_unlock(&event_mux.mutex);
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(event_mux.wait, !kfifo_is_empty(&event_mux.fifo)))
+			return -ERESTARTSYS;
+
+		if (mutex_lock_interruptible(&event_mux.mutex))
+			return -ERESTARTSYS;
+	}
+
+	while (kfifo_out_peek(&event_mux.fifo, (u8 *)&record, sizeof(record)) == sizeof(record)) {
+		if (record.length > count - consumed)
+			break;
+
+		err = kfifo_to_user(&event_mux.fifo, buf + consumed, record.length, &copied);
+		if (err < 0) {
+			if (consumed == 0)
+				consumed = err;
+			break;
+		}
+		consumed += copied;
+	}
+
+	// The buffer is too small for the first record.
+	if (consumed == 0)
+		consumed = -EINVAL;
+
+	mutex_unlock(&event_mux.mutex);
+
+	return consumed;
+}
+
+static __poll_t event_mux_poll(struct snd_info_entry *entry, void *file_private_data,
+			       struct file *file, poll_table *wait)
+{
+	poll_wait(file, &event_mux.wait, wait);
+
+	if (!kfifo_is_empty(&event_mux.fifo))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+static const struct snd_info_entry_ops event_mux_ops = {
+	.open		= event_mux_open,
+	.release	= event_mux_release,
+	.read		= event_mux_read,
+	.poll		= event_mux_poll,
+};
+
+void __init snd_fw_event_mux_module_init(void)
+{
+	struct snd_info_entry *entry;
+	int err;
+
+	// The multiplexer is optional, thus the failure is not fatal.
+	entry = snd_info_create_module_entry(THIS_MODULE, "firewire_events", NULL);
+	if (!entry)
+		return;
+
+	entry->content = SNDRV_INFO_CONTENT_DATA;
+	entry->c.ops = &event_mux_ops;
+	entry->mode = S_IFREG | 0400;
+
+	err = snd_info_register(entry);
+	if (err < 0) {
+		snd_info_free_entry(entry);
+		return;
+	}
+	event_mux.entry = entry;
+}
+
+void __exit snd_fw_event_mux_module_exit(void)
+{
+	snd_info_free_entry(event_mux.entry);
+	kfifo_free(&event_mux.fifo);
+}
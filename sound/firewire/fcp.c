@@ -8,12 +8,16 @@
 #include <linux/device.h>
 #include <linux/firewire.h>
 #include <linux/firewire-constants.h>
+#include <linux/hash.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/delay.h>
+#include <linux/err.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include "fcp.h"
 #include "lib.h"
 #include "amdtp-stream.h"
@@ -135,6 +139,48 @@ end:
 }
 EXPORT_SYMBOL(avc_general_get_sig_fmt);
 
+/**
+ * avc_general_notify_sig_fmt - subscribe to the change of signal format
+ * @unit: a unit on the target device
+ * @dir: the direction of plug
+ * @plug: the ID of plug
+ * @changed: the function called with the response frame of the change
+ * @private_data: the data passed to @changed
+ *
+ * This function sends AV/C NOTIFY command of INPUT/OUTPUT PLUG SIGNAL FORMAT,
+ * then @changed is called each time the target reports the change of signal
+ * format. See fcp_avc_notification_create() for the details.
+ *
+ * Returns the subscription, or an error pointer.
+ */
+struct fcp_avc_notification *
+avc_general_notify_sig_fmt(struct fw_unit *unit, enum avc_general_plug_dir dir,
+			   unsigned short plug,
+			   void (*changed)(void *private_data, const u8 *frame,
+					   int length),
+			   void *private_data)
+{
+	u8 buf[8];
+
+	buf[0] = 0x03;		/* AV/C NOTIFY */
+	buf[1] = 0xff;		/* Unit */
+	if (dir == AVC_GENERAL_PLUG_DIR_IN)
+		buf[2] = 0x19;	/* INPUT PLUG SIGNAL FORMAT */
+	else
+		buf[2] = 0x18;	/* OUTPUT PLUG SIGNAL FORMAT */
+	buf[3] = 0xff & plug;	/* plug id */
+	buf[4] = 0xff;		/* format is reported in response */
+	buf[5] = 0xff;
+	buf[6] = 0xff;
+	buf[7] = 0xff;
+
+	/* check buf[1-3] are the same against command */
+	return fcp_avc_notification_create(unit, buf, sizeof(buf),
+					   BIT(1) | BIT(2) | BIT(3),
+					   changed, private_data);
+}
+EXPORT_SYMBOL(avc_general_notify_sig_fmt);
+
 int avc_general_get_plug_info(struct fw_unit *unit, unsigned int subunit_type,
 			      unsigned int subunit_id, unsigned int subfunction,
 			      u8 info[AVC_PLUG_INFO_BUF_BYTES])
@@ -182,8 +228,19 @@ end:
 }
 EXPORT_SYMBOL(avc_general_get_plug_info);
 
-static DEFINE_SPINLOCK(transactions_lock);
-static LIST_HEAD(transactions);
+/*
+ * The pending transactions are indexed by the card and the node ID of target
+ * device, so that the response handler needs to walk only the transactions for
+ * the source of response frame, without contention to the other devices.
+ */
+#define TRANSACTION_HASH_BITS	6
+
+struct fcp_transaction_bucket {
+	spinlock_t lock;
+	struct list_head transactions;
+};
+
+static struct fcp_transaction_bucket buckets[1 << TRANSACTION_HASH_BITS];
 
 enum fcp_state {
 	STATE_PENDING,
@@ -195,14 +252,139 @@ enum fcp_state {
 struct fcp_transaction {
 	struct list_head list;
 	struct fw_unit *unit;
+	const void *command;
+	unsigned int command_size;
 	void *response_buffer;
 	unsigned int response_size;
 	unsigned int response_match_bytes;
 	enum fcp_state state;
 	wait_queue_head_t wait;
 	bool deferrable;
+	struct fcp_transaction_bucket *bucket;
+	struct fcp_avc_notification *notification;
 };
 
+/*
+ * The subscription to AV/C NOTIFY command. The transaction stays in the bucket
+ * after the INTERIM response, and the final response is handled in the work.
+ */
+struct fcp_avc_notification {
+	struct fcp_transaction t;
+	u8 command[FCP_NOTIFICATION_MAX_BYTES];
+	u8 response[FCP_NOTIFICATION_MAX_BYTES];
+	void (*changed)(void *private_data, const u8 *frame, int length);
+	void *private_data;
+
+	/* Serialize the work against destruction. */
+	struct mutex mutex;
+	struct delayed_work work;
+	unsigned int tries;
+	bool active;
+};
+
+static struct fcp_transaction_bucket *find_bucket(const struct fw_card *card,
+						  int node_id)
+{
+	return &buckets[hash_long((unsigned long)card ^ node_id,
+				  TRANSACTION_HASH_BITS)];
+}
+
+static void dequeue_transaction(struct fcp_transaction *t)
+{
+	if (t->bucket) {
+		spin_lock_irq(&t->bucket->lock);
+		list_del(&t->list);
+		spin_unlock_irq(&t->bucket->lock);
+		t->bucket = NULL;
+	}
+}
+
+/* The node ID of the device can be changed by bus reset. */
+static void enqueue_transaction(struct fcp_transaction *t)
+{
+	struct fw_device *device = fw_parent_device(t->unit);
+	struct fcp_transaction_bucket *bucket;
+	int node_id;
+
+	node_id = READ_ONCE(device->node_id);
+	bucket = find_bucket(device->card, node_id);
+	if (bucket == t->bucket)
+		return;
+
+	dequeue_transaction(t);
+
+	spin_lock_irq(&bucket->lock);
+	list_add_tail(&t->list, &bucket->transactions);
+	spin_unlock_irq(&bucket->lock);
+	t->bucket = bucket;
+}
+
+static void init_transaction(struct fcp_transaction *t, struct fw_unit *unit,
+			     const void *command, unsigned int command_size,
+			     void *response, unsigned int response_size,
+			     unsigned int response_match_bytes)
+{
+	t->unit = unit;
+	t->command = command;
+	t->command_size = command_size;
+	t->response_buffer = response;
+	t->response_size = response_size;
+	t->response_match_bytes = response_match_bytes;
+	t->state = STATE_PENDING;
+	init_waitqueue_head(&t->wait);
+	t->deferrable = (*(const u8 *)command == 0x00 || *(const u8 *)command == 0x03);
+	t->bucket = NULL;
+	t->notification = NULL;
+}
+
+static int send_transaction(struct fcp_transaction *t)
+{
+	int tcode;
+
+	enqueue_transaction(t);
+
+	tcode = t->command_size == 4 ? TCODE_WRITE_QUADLET_REQUEST
+				     : TCODE_WRITE_BLOCK_REQUEST;
+	return snd_fw_transaction(t->unit, tcode,
+				  CSR_REGISTER_BASE + CSR_FCP_COMMAND,
+				  (void *)t->command, t->command_size, 0);
+}
+
+/* Wait for the response of the sent command, and send it again if required. */
+static int wait_transaction(struct fcp_transaction *t)
+{
+	int ret, tries = 0;
+
+	for (;;) {
+		wait_event_timeout(t->wait, t->state != STATE_PENDING,
+				   msecs_to_jiffies(FCP_TIMEOUT_MS));
+
+		if (t->state == STATE_DEFERRED) {
+			/*
+			 * 'AV/C General Specification' define no time limit
+			 * on command completion once an INTERIM response has
+			 * been sent. but we promise to finish this function
+			 * for a caller. Here we use FCP_TIMEOUT_MS for next
+			 * interval. This is not in the specification.
+			 */
+			t->state = STATE_PENDING;
+			continue;
+		} else if (t->state == STATE_COMPLETE) {
+			return t->response_size;
+		} else if (t->state == STATE_BUS_RESET) {
+			msleep(ERROR_DELAY_MS);
+			t->state = STATE_PENDING;
+		} else if (++tries >= ERROR_RETRIES) {
+			dev_err(&t->unit->device, "FCP command timed out\n");
+			return -EIO;
+		}
+
+		ret = send_transaction(t);
+		if (ret < 0)
+			return ret;
+	}
+}
+
 /**
  * fcp_avc_transaction - send an AV/C command and wait for its response
  * @unit: a unit on the target device
@@ -231,61 +413,288 @@ int fcp_avc_transaction(struct fw_unit *unit,
 			unsigned int response_match_bytes)
 {
 	struct fcp_transaction t;
-	int tcode, ret, tries = 0;
+	int ret;
 
-	t.unit = unit;
-	t.response_buffer = response;
-	t.response_size = response_size;
-	t.response_match_bytes = response_match_bytes;
-	t.state = STATE_PENDING;
-	init_waitqueue_head(&t.wait);
-	t.deferrable = (*(const u8 *)command == 0x00 || *(const u8 *)command == 0x03);
+	init_transaction(&t, unit, command, command_size, response,
+			 response_size, response_match_bytes);
 
-	spin_lock_irq(&transactions_lock);
-	list_add_tail(&t.list, &transactions);
-	spin_unlock_irq(&transactions_lock);
+	ret = send_transaction(&t);
+	if (ret >= 0)
+		ret = wait_transaction(&t);
 
-	for (;;) {
-		tcode = command_size == 4 ? TCODE_WRITE_QUADLET_REQUEST
-					  : TCODE_WRITE_BLOCK_REQUEST;
-		ret = snd_fw_transaction(t.unit, tcode,
-					 CSR_REGISTER_BASE + CSR_FCP_COMMAND,
-					 (void *)command, command_size, 0);
-		if (ret < 0)
-			break;
-deferred:
-		wait_event_timeout(t.wait, t.state != STATE_PENDING,
-				   msecs_to_jiffies(FCP_TIMEOUT_MS));
+	dequeue_transaction(&t);
 
-		if (t.state == STATE_DEFERRED) {
-			/*
-			 * 'AV/C General Specification' define no time limit
-			 * on command completion once an INTERIM response has
-			 * been sent. but we promise to finish this function
-			 * for a caller. Here we use FCP_TIMEOUT_MS for next
-			 * interval. This is not in the specification.
-			 */
-			t.state = STATE_PENDING;
-			goto deferred;
-		} else if (t.state == STATE_COMPLETE) {
-			ret = t.response_size;
-			break;
-		} else if (t.state == STATE_BUS_RESET) {
-			msleep(ERROR_DELAY_MS);
-		} else if (++tries >= ERROR_RETRIES) {
-			dev_err(&t.unit->device, "FCP command timed out\n");
-			ret = -EIO;
-			break;
+	return ret;
+}
+EXPORT_SYMBOL(fcp_avc_transaction);
+
+/**
+ * fcp_avc_transactions - send several AV/C commands and wait for responses
+ * @unit: a unit on the target device
+ * @commands: an array of the commands
+ * @count: the number of entries in @commands
+ * @depth: the maximum number of commands in flight at the same time, up to
+ *	   FCP_AVC_MAX_DEPTH; 1 to send the commands one by one
+ *
+ * This function keeps up to @depth of FCP command frames in flight. The next
+ * command is sent when the response frame for the oldest one arrives. Each
+ * entry of @commands has the same meaning as the arguments of
+ * fcp_avc_transaction(), and the result is stored in the result member:
+ * the actual size of the response frame, or a negative error code.
+ *
+ * The response frames for the commands in flight must be distinguishable by
+ * the bytes specified in the response_match_bytes member of each entry.
+ *
+ * Returns zero when the commands are processed, or a negative error code.
+ */
+int fcp_avc_transactions(struct fw_unit *unit,
+			 struct fcp_avc_command *commands, unsigned int count,
+			 unsigned int depth)
+{
+	struct fcp_transaction *ts;
+	unsigned int sent = 0;
+	int i;
+
+	if (depth == 0 || depth > FCP_AVC_MAX_DEPTH)
+		return -EINVAL;
+
+	ts = kcalloc(count, sizeof(*ts), GFP_KERNEL);
+	if (!ts)
+		return -ENOMEM;
+
+	for (i = 0; i < count; ++i) {
+		struct fcp_avc_command *c;
+
+		for (; sent < count && sent < i + depth; ++sent) {
+			c = commands + sent;
+			init_transaction(ts + sent, unit, c->command,
+					 c->command_size, c->response,
+					 c->response_size,
+					 c->response_match_bytes);
+			c->result = send_transaction(ts + sent);
 		}
+
+		c = commands + i;
+		if (c->result >= 0)
+			c->result = wait_transaction(ts + i);
+		dequeue_transaction(ts + i);
 	}
 
-	spin_lock_irq(&transactions_lock);
-	list_del(&t.list);
-	spin_unlock_irq(&transactions_lock);
+	kfree(ts);
 
-	return ret;
+	return 0;
+}
+EXPORT_SYMBOL(fcp_avc_transactions);
+
+static enum fcp_state read_state(struct fcp_transaction *t)
+{
+	enum fcp_state state;
+
+	spin_lock_irq(&t->bucket->lock);
+	state = t->state;
+	spin_unlock_irq(&t->bucket->lock);
+
+	return state;
+}
+
+/* Send the NOTIFY command again to wait for the next change. */
+static int arm_notification(struct fcp_avc_notification *n)
+{
+	struct fcp_transaction *t = &n->t;
+	int err;
+
+	/* Out of the bucket, no response handler touches the transaction. */
+	dequeue_transaction(t);
+
+	memcpy(n->response, n->command, t->command_size);
+	t->response_size = sizeof(n->response);
+	t->state = STATE_PENDING;
+
+	err = send_transaction(t);
+	if (err < 0)
+		return err;
+
+	/* Check the INTERIM response after the timeout. */
+	mod_delayed_work(system_wq, &n->work, msecs_to_jiffies(FCP_TIMEOUT_MS));
+
+	return 0;
+}
+
+static void notification_work(struct work_struct *work)
+{
+	struct fcp_avc_notification *n =
+		container_of(to_delayed_work(work), struct fcp_avc_notification,
+			     work);
+	struct fcp_transaction *t = &n->t;
+	int result;
+
+	mutex_lock(&n->mutex);
+
+	if (!n->active || !t->bucket)
+		goto end;
+
+	switch (read_state(t)) {
+	case STATE_DEFERRED:
+		/* Armed. The final response is reported at the change. */
+		n->tries = 0;
+		goto end;
+	case STATE_COMPLETE:
+		result = t->response_size;
+		break;
+	case STATE_BUS_RESET:
+		/* The target discards the subscription at bus reset. */
+		n->tries = 0;
+		goto rearm;
+	case STATE_PENDING:
+	default:
+		if (++n->tries < ERROR_RETRIES)
+			goto rearm;
+		dev_err(&t->unit->device, "FCP notification timed out\n");
+		result = -EIO;
+		break;
+	}
+
+	n->changed(n->private_data, n->response, result);
+
+	/* The subscription finishes unless the response is CHANGED. */
+	if (result < 1 || n->response[0] != 0x0d) {
+		n->active = false;
+		dequeue_transaction(t);
+		goto end;
+	}
+	n->tries = 0;
+rearm:
+	result = arm_notification(n);
+	if (result < 0) {
+		n->active = false;
+		dequeue_transaction(t);
+		n->changed(n->private_data, NULL, result);
+	}
+end:
+	mutex_unlock(&n->mutex);
 }
-EXPORT_SYMBOL(fcp_avc_transaction);
+
+/**
+ * fcp_avc_notification_create - subscribe to the change reported by AV/C NOTIFY
+ * @unit: a unit on the target device
+ * @command: a buffer containing the NOTIFY command frame
+ * @command_size: the size of @command, up to FCP_NOTIFICATION_MAX_BYTES
+ * @response_match_bytes: a bitmap specifying the bytes used to detect the
+ *                        correct response frame
+ * @changed: the function called with the final response frame
+ * @private_data: the data passed to @changed
+ *
+ * This function sends the NOTIFY command frame and returns without waiting for
+ * the response. The target returns INTERIM response, then the final response
+ * when the state is changed. At the final response, @changed is called with
+ * the frame and its length, and the command is sent again to keep the
+ * subscription as long as the final response is CHANGED. The subscription is
+ * sent again at bus reset as well, since the target discards it.
+ *
+ * When the subscription finishes due to REJECTED or NOT IMPLEMENTED response,
+ * or an error, @changed is called at last with the frame, or NULL with a
+ * negative error code. @changed is called in process context and must not
+ * destroy the subscription.
+ *
+ * The bytes specified in @response_match_bytes are compared with @command.
+ *
+ * Returns the subscription, or an error pointer.
+ */
+struct fcp_avc_notification *
+fcp_avc_notification_create(struct fw_unit *unit,
+			    const void *command, unsigned int command_size,
+			    unsigned int response_match_bytes,
+			    void (*changed)(void *private_data, const u8 *frame,
+					    int length),
+			    void *private_data)
+{
+	struct fcp_avc_notification *n;
+	int err;
+
+	if (command_size > FCP_NOTIFICATION_MAX_BYTES ||
+	    *(const u8 *)command != 0x03)
+		return ERR_PTR(-EINVAL);
+
+	/* The command is in the buffer allocated by kmalloc to be DMA-able. */
+	n = kzalloc(sizeof(*n), GFP_KERNEL);
+	if (!n)
+		return ERR_PTR(-ENOMEM);
+	memcpy(n->command, command, command_size);
+
+	init_transaction(&n->t, unit, n->command, command_size, n->response,
+			 sizeof(n->response), response_match_bytes);
+	n->t.notification = n;
+	n->changed = changed;
+	n->private_data = private_data;
+	mutex_init(&n->mutex);
+	INIT_DELAYED_WORK(&n->work, notification_work);
+
+	mutex_lock(&n->mutex);
+	n->active = true;
+	err = arm_notification(n);
+	if (err < 0) {
+		n->active = false;
+		dequeue_transaction(&n->t);
+	}
+	mutex_unlock(&n->mutex);
+
+	if (err < 0) {
+		cancel_delayed_work_sync(&n->work);
+		mutex_destroy(&n->mutex);
+		kfree(n);
+		return ERR_PTR(err);
+	}
+
+	return n;
+}
+EXPORT_SYMBOL(fcp_avc_notification_create);
+
+/**
+ * fcp_avc_notification_armed - check whether the subscription is effective
+ * @n: the subscription, or NULL
+ *
+ * Returns true when the target has accepted the subscription by INTERIM
+ * response and is going to report the change.
+ */
+bool fcp_avc_notification_armed(struct fcp_avc_notification *n)
+{
+	bool armed = false;
+
+	if (IS_ERR_OR_NULL(n))
+		return false;
+
+	mutex_lock(&n->mutex);
+	if (n->active && n->t.bucket)
+		armed = read_state(&n->t) == STATE_DEFERRED;
+	mutex_unlock(&n->mutex);
+
+	return armed;
+}
+EXPORT_SYMBOL(fcp_avc_notification_armed);
+
+/**
+ * fcp_avc_notification_destroy - finish the subscription
+ * @n: the subscription, or NULL
+ *
+ * This function must not be called in @changed of the subscription.
+ */
+void fcp_avc_notification_destroy(struct fcp_avc_notification *n)
+{
+	if (IS_ERR_OR_NULL(n))
+		return;
+
+	mutex_lock(&n->mutex);
+	n->active = false;
+	dequeue_transaction(&n->t);
+	mutex_unlock(&n->mutex);
+
+	/* No response handler schedules the work out of the bucket. */
+	cancel_delayed_work_sync(&n->work);
+
+	mutex_destroy(&n->mutex);
+	kfree(n);
+}
+EXPORT_SYMBOL(fcp_avc_notification_destroy);
 
 /**
  * fcp_bus_reset - inform the target handler about a bus reset
@@ -298,17 +707,27 @@ EXPORT_SYMBOL(fcp_avc_transaction);
 void fcp_bus_reset(struct fw_unit *unit)
 {
 	struct fcp_transaction *t;
-
-	spin_lock_irq(&transactions_lock);
-	list_for_each_entry(t, &transactions, list) {
-		if (t->unit == unit &&
-		    (t->state == STATE_PENDING ||
-		     t->state == STATE_DEFERRED)) {
-			t->state = STATE_BUS_RESET;
-			wake_up(&t->wait);
+	int i;
+
+	/* The transactions may be indexed by the former node ID. */
+	for (i = 0; i < ARRAY_SIZE(buckets); ++i) {
+		struct fcp_transaction_bucket *bucket = &buckets[i];
+
+		spin_lock_irq(&bucket->lock);
+		list_for_each_entry(t, &bucket->transactions, list) {
+			if (t->unit == unit &&
+			    (t->state == STATE_PENDING ||
+			     t->state == STATE_DEFERRED)) {
+				t->state = STATE_BUS_RESET;
+				wake_up(&t->wait);
+				if (t->notification)
+					mod_delayed_work(system_wq,
+						&t->notification->work,
+						msecs_to_jiffies(ERROR_DELAY_MS));
+			}
 		}
+		spin_unlock_irq(&bucket->lock);
 	}
-	spin_unlock_irq(&transactions_lock);
 }
 EXPORT_SYMBOL(fcp_bus_reset);
 
@@ -339,14 +758,17 @@ static void fcp_response(struct fw_card *card, struct fw_request *request,
 			 int generation, unsigned long long offset,
 			 void *data, size_t length, void *callback_data)
 {
+	struct fcp_transaction_bucket *bucket;
 	struct fcp_transaction *t;
 	unsigned long flags;
 
 	if (length < 1 || (*(const u8 *)data & 0xf0) != CTS_AVC)
 		return;
 
-	spin_lock_irqsave(&transactions_lock, flags);
-	list_for_each_entry(t, &transactions, list) {
+	bucket = find_bucket(card, source);
+
+	spin_lock_irqsave(&bucket->lock, flags);
+	list_for_each_entry(t, &bucket->transactions, list) {
 		struct fw_device *device = fw_parent_device(t->unit);
 		if (device->card != card ||
 		    device->generation != generation)
@@ -355,7 +777,9 @@ static void fcp_response(struct fw_card *card, struct fw_request *request,
 		if (device->node_id != source)
 			continue;
 
-		if (t->state == STATE_PENDING &&
+		/* The subscription waits for the final response after INTERIM. */
+		if ((t->state == STATE_PENDING ||
+		     (t->notification && t->state == STATE_DEFERRED)) &&
 		    is_matching_response(t, data, length)) {
 			if (t->deferrable && *(const u8 *)data == 0x0f) {
 				t->state = STATE_DEFERRED;
@@ -365,11 +789,14 @@ static void fcp_response(struct fw_card *card, struct fw_request *request,
 							 t->response_size);
 				memcpy(t->response_buffer, data,
 				       t->response_size);
+				if (t->notification)
+					mod_delayed_work(system_wq,
+							 &t->notification->work, 0);
 			}
 			wake_up(&t->wait);
 		}
 	}
-	spin_unlock_irqrestore(&transactions_lock, flags);
+	spin_unlock_irqrestore(&bucket->lock, flags);
 }
 
 static struct fw_address_handler response_register_handler = {
@@ -377,12 +804,18 @@ static struct fw_address_handler response_register_handler = {
 	.address_callback = fcp_response,
 };
 
-static int __init fcp_module_init(void)
+int __init fcp_module_init(void)
 {
 	static const struct fw_address_region response_register_region = {
 		.start = CSR_REGISTER_BASE + CSR_FCP_RESPONSE,
 		.end = CSR_REGISTER_BASE + CSR_FCP_END,
 	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(buckets); ++i) {
+		spin_lock_init(&buckets[i].lock);
+		INIT_LIST_HEAD(&buckets[i].transactions);
+	}
 
 	fw_core_add_address_handler(&response_register_handler,
 				    &response_register_region);
@@ -390,11 +823,11 @@ static int __init fcp_module_init(void)
 	return 0;
 }
 
-static void __exit fcp_module_exit(void)
+void __exit fcp_module_exit(void)
 {
-	WARN_ON(!list_empty(&transactions));
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(buckets); ++i)
+		WARN_ON(!list_empty(&buckets[i].transactions));
 	fw_core_remove_address_handler(&response_register_handler);
 }
-
-module_init(fcp_module_init);
-module_exit(fcp_module_exit);
@@ -21,6 +21,12 @@ int avc_general_set_sig_fmt(struct fw_unit *unit, unsigned int rate,
 int avc_general_get_sig_fmt(struct fw_unit *unit, unsigned int *rate,
 			    enum avc_general_plug_dir dir,
 			    unsigned short plug);
+struct fcp_avc_notification *
+avc_general_notify_sig_fmt(struct fw_unit *unit, enum avc_general_plug_dir dir,
+			   unsigned short plug,
+			   void (*changed)(void *private_data, const u8 *frame,
+					   int length),
+			   void *private_data);
 int avc_general_get_plug_info(struct fw_unit *unit, unsigned int subunit_type,
 			      unsigned int subunit_id, unsigned int subfunction,
 			      u8 info[AVC_PLUG_INFO_BUF_BYTES]);
@@ -29,6 +35,52 @@ int fcp_avc_transaction(struct fw_unit *unit,
 			const void *command, unsigned int command_size,
 			void *response, unsigned int response_size,
 			unsigned int response_match_bytes);
+
+/**
+ * struct fcp_avc_command - an AV/C command for fcp_avc_transactions()
+ * @command: a buffer containing the command frame; must be DMA-able
+ * @command_size: the size of @command
+ * @response: a buffer for the response frame
+ * @response_size: the maximum size of @response
+ * @response_match_bytes: a bitmap specifying the bytes used to detect the
+ *                        correct response frame
+ * @result: the actual size of the response frame, or a negative error code
+ */
+struct fcp_avc_command {
+	const void *command;
+	unsigned int command_size;
+	void *response;
+	unsigned int response_size;
+	unsigned int response_match_bytes;
+	int result;
+};
+
+int fcp_avc_transactions(struct fw_unit *unit,
+			 struct fcp_avc_command *commands, unsigned int count,
+			 unsigned int depth);
+
+// The number of AV/C commands in flight at the same time for the unit. Some AV/C targets reject
+// deeper overlap of FCP transactions, and some handle just one.
+#define FCP_AVC_MAX_DEPTH	2
+
+// The maximum size of the command frame for fcp_avc_notification_create().
+#define FCP_NOTIFICATION_MAX_BYTES	16
+
+struct fcp_avc_notification;
+struct fcp_avc_notification *
+fcp_avc_notification_create(struct fw_unit *unit,
+			    const void *command, unsigned int command_size,
+			    unsigned int response_match_bytes,
+			    void (*changed)(void *private_data, const u8 *frame,
+					    int length),
+			    void *private_data);
+bool fcp_avc_notification_armed(struct fcp_avc_notification *n);
+void fcp_avc_notification_destroy(struct fcp_avc_notification *n);
+
 void fcp_bus_reset(struct fw_unit *unit);
 
+// For module initialization of snd-firewire-lib.
+int fcp_module_init(void);
+void fcp_module_exit(void);
+
 #endif
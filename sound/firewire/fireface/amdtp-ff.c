@@ -7,9 +7,18 @@
 
 #include <sound/pcm.h>
 #include "ff.h"
+#include "../amdtp-pcm.h"
+
+static bool unmasked_capture;
+module_param(unmasked_capture, bool, 0644);
+MODULE_PARM_DESC(unmasked_capture,
+		 "Deliver captured samples without masking the least significant byte for the stream started later (default: false)");
 
 struct amdtp_ff {
 	unsigned int pcm_channels;
+	// The mask for captured samples. Without masking, the quadlets in payload are copied at
+	// once in little endian host, while userspace should ignore the bits out of msbits.
+	u32 capture_mask;
 };
 
 int amdtp_ff_set_parameters(struct amdtp_stream *s, unsigned int rate,
@@ -24,6 +33,11 @@ int amdtp_ff_set_parameters(struct amdtp_stream *s, unsigned int rate,
 	p->pcm_channels = pcm_channels;
 	data_channels = pcm_channels;
 
+	if (s->direction == AMDTP_IN_STREAM && READ_ONCE(unmasked_capture))
+		p->capture_mask = 0xffffffff;
+	else
+		p->capture_mask = 0xffffff00;
+
 	return amdtp_stream_set_parameters(s, rate, data_channels);
 }
 
@@ -32,29 +46,9 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			  unsigned int pcm_frames)
 {
 	struct amdtp_ff *p = s->protocol;
-	unsigned int channels = p->pcm_channels;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	const u32 *src;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
-
-	src = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
-
-	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			buffer[c] = cpu_to_le32(*src);
-			src++;
-		}
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			src = (void *)runtime->dma_area;
-	}
+
+	amdtp_pcm_write(s, pcm, buffer, frames, pcm_frames, p->pcm_channels,
+			0, 0x00000000, true);
 }
 
 static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
@@ -62,42 +56,21 @@ static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			 unsigned int pcm_frames)
 {
 	struct amdtp_ff *p = s->protocol;
-	unsigned int channels = p->pcm_channels;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	u32 *dst;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
-
-	dst  = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
-
-	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			*dst = le32_to_cpu(buffer[c]) & 0xffffff00;
-			dst++;
-		}
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			dst = (void *)runtime->dma_area;
-	}
+
+	if (p->capture_mask == 0xffffffff)
+		amdtp_pcm_read(s, pcm, buffer, frames, pcm_frames, p->pcm_channels,
+			       0, 0xffffffff, true);
+	else
+		amdtp_pcm_read(s, pcm, buffer, frames, pcm_frames, p->pcm_channels,
+			       0, 0xffffff00, true);
 }
 
 static void write_pcm_silence(struct amdtp_stream *s,
 			      __le32 *buffer, unsigned int frames)
 {
 	struct amdtp_ff *p = s->protocol;
-	unsigned int i, c, channels = p->pcm_channels;
 
-	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c)
-			buffer[c] = cpu_to_le32(0x00000000);
-		buffer += s->data_block_quadlets;
-	}
+	amdtp_pcm_write_silence(s, buffer, frames, p->pcm_channels, 0x00000000, true);
 }
 
 int amdtp_ff_add_pcm_hw_constraints(struct amdtp_stream *s,
@@ -128,7 +101,8 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 		if (pcm) {
 			write_pcm_s32(s, pcm, buf, data_blocks, pcm_frames);
 			pcm_frames += data_blocks;
-		} else {
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+		} else if (!amdtp_stream_pcm_silence_cached(s, desc, data_blocks)) {
 			write_pcm_silence(s, buf, data_blocks);
 		}
 	}
@@ -162,12 +136,21 @@ int amdtp_ff_init(struct amdtp_stream *s, struct fw_unit *unit,
 		  enum amdtp_stream_direction dir)
 {
 	amdtp_stream_process_ctx_payloads_t process_ctx_payloads;
+	int err;
 
 	if (dir == AMDTP_IN_STREAM)
 		process_ctx_payloads = process_ir_ctx_payloads;
 	else
 		process_ctx_payloads = process_it_ctx_payloads;
 
-	return amdtp_stream_init(s, unit, dir, CIP_BLOCKING | CIP_UNAWARE_SYT | CIP_NO_HEADER, 0,
-				 process_ctx_payloads, sizeof(struct amdtp_ff));
+	err = amdtp_stream_init(s, unit, dir, CIP_BLOCKING | CIP_UNAWARE_SYT | CIP_NO_HEADER, 0,
+				process_ctx_payloads, sizeof(struct amdtp_ff));
+	if (err < 0)
+		return err;
+
+	// The payload of incoming packets includes PCM frames only.
+	if (dir == AMDTP_IN_STREAM)
+		amdtp_stream_set_idle_payloads(s, true);
+
+	return 0;
 }
@@ -19,9 +19,6 @@ static int midi_playback_open(struct snd_rawmidi_substream *substream)
 
 	/* Initialize internal status. */
 	ff->on_sysex[substream->number] = 0;
-	ff->rx_midi_error[substream->number] = false;
-
-	WRITE_ONCE(ff->rx_midi_substreams[substream->number], substream);
 
 	return 0;
 }
@@ -36,8 +33,7 @@ static int midi_playback_close(struct snd_rawmidi_substream *substream)
 {
 	struct snd_ff *ff = substream->rmidi->private_data;
 
-	cancel_work_sync(&ff->rx_midi_work[substream->number]);
-	WRITE_ONCE(ff->rx_midi_substreams[substream->number], NULL);
+	snd_fw_async_midi_port_finish(&ff->rx_midi_ports[substream->number]);
 
 	return 0;
 }
@@ -67,8 +63,9 @@ static void midi_playback_trigger(struct snd_rawmidi_substream *substream,
 
 	spin_lock_irqsave(&ff->lock, flags);
 
-	if (up || !ff->rx_midi_error[substream->number])
-		schedule_work(&ff->rx_midi_work[substream->number]);
+	if (up)
+		snd_fw_async_midi_port_run(&ff->rx_midi_ports[substream->number],
+					   substream);
 
 	spin_unlock_irqrestore(&ff->lock, flags);
 }
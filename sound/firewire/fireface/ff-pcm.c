@@ -7,10 +7,33 @@
 
 #include "ff.h"
 
+static const unsigned int *get_spec_pcm_channels(const struct snd_ff *ff,
+					const struct snd_pcm_substream *substream)
+{
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
+		return ff->spec->pcm_capture_channels;
+	else
+		return ff->spec->pcm_playback_channels;
+}
+
+// When the unit can be configured to transfer the first channels only, any number of PCM channels
+// between the minimum and the maximum at the mode is available.
+static void get_pcm_channels_range(const struct snd_ff *ff, const unsigned int *pcm_channels,
+				   enum snd_ff_stream_mode mode, unsigned int *min,
+				   unsigned int *max)
+{
+	*max = pcm_channels[mode];
+	*min = *max;
+	if (ff->spec->pcm_min_channels > 0 && *max > 0)
+		*min = min(ff->spec->pcm_min_channels, *max);
+}
+
 static int hw_rule_rate(struct snd_pcm_hw_params *params,
 			struct snd_pcm_hw_rule *rule)
 {
-	const unsigned int *pcm_channels = rule->private;
+	struct snd_pcm_substream *substream = rule->private;
+	struct snd_ff *ff = substream->private_data;
+	const unsigned int *pcm_channels = get_spec_pcm_channels(ff, substream);
 	struct snd_interval *r =
 		hw_param_interval(params, SNDRV_PCM_HW_PARAM_RATE);
 	const struct snd_interval *c =
@@ -22,13 +45,15 @@ static int hw_rule_rate(struct snd_pcm_hw_params *params,
 
 	for (i = 0; i < ARRAY_SIZE(amdtp_rate_table); i++) {
 		enum snd_ff_stream_mode mode;
+		unsigned int ch_min, ch_max;
 		int err;
 
 		err = snd_ff_stream_get_multiplier_mode(i, &mode);
 		if (err < 0)
 			continue;
 
-		if (!snd_interval_test(c, pcm_channels[mode]))
+		get_pcm_channels_range(ff, pcm_channels, mode, &ch_min, &ch_max);
+		if (c->min > ch_max || c->max < ch_min)
 			continue;
 
 		t.min = min(t.min, amdtp_rate_table[i]);
@@ -41,7 +66,9 @@ static int hw_rule_rate(struct snd_pcm_hw_params *params,
 static int hw_rule_channels(struct snd_pcm_hw_params *params,
 			    struct snd_pcm_hw_rule *rule)
 {
-	const unsigned int *pcm_channels = rule->private;
+	struct snd_pcm_substream *substream = rule->private;
+	struct snd_ff *ff = substream->private_data;
+	const unsigned int *pcm_channels = get_spec_pcm_channels(ff, substream);
 	struct snd_interval *c =
 		hw_param_interval(params, SNDRV_PCM_HW_PARAM_CHANNELS);
 	const struct snd_interval *r =
@@ -53,6 +80,7 @@ static int hw_rule_channels(struct snd_pcm_hw_params *params,
 
 	for (i = 0; i < ARRAY_SIZE(amdtp_rate_table); i++) {
 		enum snd_ff_stream_mode mode;
+		unsigned int ch_min, ch_max;
 		int err;
 
 		err = snd_ff_stream_get_multiplier_mode(i, &mode);
@@ -62,17 +90,19 @@ static int hw_rule_channels(struct snd_pcm_hw_params *params,
 		if (!snd_interval_test(r, amdtp_rate_table[i]))
 			continue;
 
-		t.min = min(t.min, pcm_channels[mode]);
-		t.max = max(t.max, pcm_channels[mode]);
+		get_pcm_channels_range(ff, pcm_channels, mode, &ch_min, &ch_max);
+		t.min = min(t.min, ch_min);
+		t.max = max(t.max, ch_max);
 	}
 
 	return snd_interval_refine(c, &t);
 }
 
-static void limit_channels_and_rates(struct snd_pcm_hardware *hw,
+static void limit_channels_and_rates(const struct snd_ff *ff,
+				     struct snd_pcm_hardware *hw,
 				     const unsigned int *pcm_channels)
 {
-	unsigned int rate, channels;
+	unsigned int rate;
 	int i;
 
 	hw->channels_min = UINT_MAX;
@@ -82,17 +112,18 @@ static void limit_channels_and_rates(struct snd_pcm_hardware *hw,
 
 	for (i = 0; i < ARRAY_SIZE(amdtp_rate_table); i++) {
 		enum snd_ff_stream_mode mode;
+		unsigned int ch_min, ch_max;
 		int err;
 
 		err = snd_ff_stream_get_multiplier_mode(i, &mode);
 		if (err < 0)
 			continue;
 
-		channels = pcm_channels[mode];
 		if (pcm_channels[mode] == 0)
 			continue;
-		hw->channels_min = min(hw->channels_min, channels);
-		hw->channels_max = max(hw->channels_max, channels);
+		get_pcm_channels_range(ff, pcm_channels, mode, &ch_min, &ch_max);
+		hw->channels_min = min(hw->channels_min, ch_min);
+		hw->channels_max = max(hw->channels_max, ch_max);
 
 		rate = amdtp_rate_table[i];
 		hw->rates |= snd_pcm_rate_to_rate_bit(rate);
@@ -106,29 +137,27 @@ static int pcm_init_hw_params(struct snd_ff *ff,
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct amdtp_stream *s;
-	const unsigned int *pcm_channels;
 	int err;
 
 	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
-		runtime->hw.formats = SNDRV_PCM_FMTBIT_S32;
+		runtime->hw.formats = AMDTP_PCM_FORMAT_BITS;
 		s = &ff->tx_stream;
-		pcm_channels = ff->spec->pcm_capture_channels;
 	} else {
-		runtime->hw.formats = SNDRV_PCM_FMTBIT_S32;
+		runtime->hw.formats = AMDTP_PCM_FORMAT_BITS;
 		s = &ff->rx_stream;
-		pcm_channels = ff->spec->pcm_playback_channels;
 	}
 
-	limit_channels_and_rates(&runtime->hw, pcm_channels);
+	limit_channels_and_rates(ff, &runtime->hw,
+				 get_spec_pcm_channels(ff, substream));
 
 	err = snd_pcm_hw_rule_add(runtime, 0, SNDRV_PCM_HW_PARAM_CHANNELS,
-				  hw_rule_channels, (void *)pcm_channels,
+				  hw_rule_channels, substream,
 				  SNDRV_PCM_HW_PARAM_RATE, -1);
 	if (err < 0)
 		return err;
 
 	err = snd_pcm_hw_rule_add(runtime, 0, SNDRV_PCM_HW_PARAM_RATE,
-				  hw_rule_rate, (void *)pcm_channels,
+				  hw_rule_rate, substream,
 				  SNDRV_PCM_HW_PARAM_CHANNELS, -1);
 	if (err < 0)
 		return err;
@@ -186,6 +215,12 @@ static int pcm_open(struct snd_pcm_substream *substream)
 			substream->runtime->hw.rate_min = rate;
 			substream->runtime->hw.rate_max = rate;
 
+			// The number of PCM channels is also common to both directions.
+			if (ff->spec->pcm_min_channels > 0) {
+				substream->runtime->hw.channels_min = ff->pcm_channels;
+				substream->runtime->hw.channels_max = ff->pcm_channels;
+			}
+
 			err = snd_pcm_hw_constraint_minmax(substream->runtime,
 					SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
 					frames_per_period, frames_per_period);
@@ -232,11 +267,13 @@ static int pcm_hw_params(struct snd_pcm_substream *substream,
 
 	if (substream->runtime->status->state == SNDRV_PCM_STATE_OPEN) {
 		unsigned int rate = params_rate(hw_params);
+		unsigned int channels = params_channels(hw_params);
 		unsigned int frames_per_period = params_period_size(hw_params);
 		unsigned int frames_per_buffer = params_buffer_size(hw_params);
 
 		mutex_lock(&ff->mutex);
-		err = snd_ff_stream_reserve_duplex(ff, rate, frames_per_period,
+		err = snd_ff_stream_reserve_duplex(ff, rate, channels,
+						   frames_per_period,
 						   frames_per_buffer);
 		if (err >= 0)
 			++ff->substreams_counter;
@@ -360,6 +397,28 @@ static int pcm_playback_ack(struct snd_pcm_substream *substream)
 	return amdtp_domain_stream_pcm_ack(&ff->domain, &ff->rx_stream);
 }
 
+static int pcm_capture_time_info(struct snd_pcm_substream *substream,
+				 struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				 struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				 struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_ff *ff = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&ff->tx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
+static int pcm_playback_time_info(struct snd_pcm_substream *substream,
+				  struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				  struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				  struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_ff *ff = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&ff->rx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
 int snd_ff_create_pcm_devices(struct snd_ff *ff)
 {
 	static const struct snd_pcm_ops pcm_capture_ops = {
@@ -371,6 +430,7 @@ int snd_ff_create_pcm_devices(struct snd_ff *ff)
 		.trigger	= pcm_capture_trigger,
 		.pointer	= pcm_capture_pointer,
 		.ack		= pcm_capture_ack,
+		.get_time_info	= pcm_capture_time_info,
 	};
 	static const struct snd_pcm_ops pcm_playback_ops = {
 		.open		= pcm_open,
@@ -381,6 +441,7 @@ int snd_ff_create_pcm_devices(struct snd_ff *ff)
 		.trigger	= pcm_playback_trigger,
 		.pointer	= pcm_playback_pointer,
 		.ack		= pcm_playback_ack,
+		.get_time_info	= pcm_playback_time_info,
 	};
 	struct snd_pcm *pcm;
 	int err;
@@ -394,7 +455,7 @@ int snd_ff_create_pcm_devices(struct snd_ff *ff)
 		 "%s PCM", ff->card->shortname);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &pcm_playback_ops);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &pcm_capture_ops);
-	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_fw_pcm_set_managed_buffer_all(pcm);
 
 	return 0;
 }
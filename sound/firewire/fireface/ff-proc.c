@@ -32,6 +32,45 @@ static void proc_dump_status(struct snd_info_entry *entry,
 	ff->spec->protocol->dump_status(ff, buffer);
 }
 
+static void proc_read_histograms(struct snd_info_entry *entry,
+				 struct snd_info_buffer *buffer)
+{
+	struct snd_ff *ff = entry->private_data;
+
+	snd_iprintf(buffer, "Output Stream from device:\n");
+	amdtp_stream_dump_histograms(&ff->tx_stream, buffer);
+	snd_iprintf(buffer, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&ff->rx_stream, buffer);
+}
+
+static void proc_read_preflight(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct snd_ff *ff = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	enum snd_ff_clock_src src;
+	unsigned int rate;
+	int err;
+
+	if (ff->spec->protocol->get_clock(ff, &rate, &src) < 0)
+		return;
+
+	mutex_lock(&ff->mutex);
+	err = snd_ff_stream_preflight(ff, rate, 0, &preflight);
+	mutex_unlock(&ff->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, ff->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", ff->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void add_node(struct snd_ff *ff, struct snd_info_entry *root,
 		     const char *name,
 		     void (*op)(struct snd_info_entry *e,
@@ -59,4 +98,7 @@ void snd_ff_proc_init(struct snd_ff *ff)
 	root->mode = S_IFDIR | 0555;
 
 	add_node(ff, root, "status", proc_dump_status);
+	add_node(ff, root, "histogram", proc_read_histograms);
+	add_node(ff, root, "preflight", proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&ff->domain, root);
 }
@@ -70,20 +70,35 @@ static int parse_clock_bits(u32 data, unsigned int *rate,
 	return 0;
 }
 
+// The clock configuration register follows the sync status register.
+static int former_read_status(struct snd_ff *ff, u32 *regs)
+{
+	__le32 reg[SND_FF_STATUS_QUADLETS];
+	int i;
+	int err;
+
+	err = snd_fw_transaction(ff->unit, TCODE_READ_BLOCK_REQUEST,
+				 FORMER_REG_SYNC_STATUS, reg, sizeof(reg), 0);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < SND_FF_STATUS_QUADLETS; ++i)
+		regs[i] = le32_to_cpu(reg[i]);
+
+	return 0;
+}
+
 static int former_get_clock(struct snd_ff *ff, unsigned int *rate,
 			    enum snd_ff_clock_src *src)
 {
-	__le32 reg;
-	u32 data;
+	u32 regs[SND_FF_STATUS_QUADLETS];
 	int err;
 
-	err = snd_fw_transaction(ff->unit, TCODE_READ_QUADLET_REQUEST,
-				 FORMER_REG_CLOCK_CONFIG, &reg, sizeof(reg), 0);
+	err = snd_ff_get_status(ff, regs);
 	if (err < 0)
 		return err;
-	data = le32_to_cpu(reg);
 
-	return parse_clock_bits(data, rate, src);
+	return parse_clock_bits(regs[1], rate, src);
 }
 
 static int former_switch_fetching_mode(struct snd_ff *ff, bool enable)
@@ -120,21 +135,13 @@ static int former_switch_fetching_mode(struct snd_ff *ff, bool enable)
 	return err;
 }
 
-static void dump_clock_config(struct snd_ff *ff, struct snd_info_buffer *buffer)
+static void dump_clock_config(u32 data, struct snd_info_buffer *buffer)
 {
-	__le32 reg;
-	u32 data;
 	unsigned int rate;
 	enum snd_ff_clock_src src;
 	const char *label;
 	int err;
 
-	err = snd_fw_transaction(ff->unit, TCODE_READ_BLOCK_REQUEST,
-				 FORMER_REG_CLOCK_CONFIG, &reg, sizeof(reg), 0);
-	if (err < 0)
-		return;
-	data = le32_to_cpu(reg);
-
 	snd_iprintf(buffer, "Output S/PDIF format: %s (Emphasis: %s)\n",
 		    (data & 0x00000020) ? "Professional" : "Consumer",
 		    (data & 0x00000040) ? "on" : "off");
@@ -158,7 +165,7 @@ static void dump_clock_config(struct snd_ff *ff, struct snd_info_buffer *buffer)
 	snd_iprintf(buffer, "Clock configuration: %d %s\n", rate, label);
 }
 
-static void dump_sync_status(struct snd_ff *ff, struct snd_info_buffer *buffer)
+static void dump_sync_status(const u32 *data, struct snd_info_buffer *buffer)
 {
 	static const struct {
 		char *const label;
@@ -194,17 +201,7 @@ static void dump_sync_status(struct snd_ff *ff, struct snd_info_buffer *buffer)
 		{ 176400,	0x10000000, },
 		{ 192000,	0x12000000, },
 	};
-	__le32 reg[2];
-	u32 data[2];
 	int i;
-	int err;
-
-	err = snd_fw_transaction(ff->unit, TCODE_READ_BLOCK_REQUEST,
-				 FORMER_REG_SYNC_STATUS, reg, sizeof(reg), 0);
-	if (err < 0)
-		return;
-	data[0] = le32_to_cpu(reg[0]);
-	data[1] = le32_to_cpu(reg[1]);
 
 	snd_iprintf(buffer, "External source detection:\n");
 
@@ -259,8 +256,13 @@ static void dump_sync_status(struct snd_ff *ff, struct snd_info_buffer *buffer)
 static void former_dump_status(struct snd_ff *ff,
 			       struct snd_info_buffer *buffer)
 {
-	dump_clock_config(ff, buffer);
-	dump_sync_status(ff, buffer);
+	u32 regs[SND_FF_STATUS_QUADLETS];
+
+	if (snd_ff_get_status(ff, regs) < 0)
+		return;
+
+	dump_clock_config(regs[1], buffer);
+	dump_sync_status(regs, buffer);
 }
 
 static int former_fill_midi_msg(struct snd_ff *ff,
@@ -422,6 +424,7 @@ static void ff800_handle_midi_msg(struct snd_ff *ff, unsigned int offset,
 const struct snd_ff_protocol snd_ff_protocol_ff800 = {
 	.handle_midi_msg	= ff800_handle_midi_msg,
 	.fill_midi_msg		= former_fill_midi_msg,
+	.read_status		= former_read_status,
 	.get_clock		= former_get_clock,
 	.switch_fetching_mode	= former_switch_fetching_mode,
 	.allocate_resources	= ff800_allocate_resources,
@@ -466,23 +469,10 @@ static int ff400_allocate_resources(struct snd_ff *ff, unsigned int rate)
 	if (err < 0)
 		return err;
 
-	// Keep resources for in-stream.
+	// Keep resources for in-stream and out-stream at once.
 	ff->tx_resources.channels_mask = 0x00000000000000ffuLL;
-	err = fw_iso_resources_allocate(&ff->tx_resources,
-			amdtp_stream_get_max_payload(&ff->tx_stream),
-			fw_parent_device(ff->unit)->max_speed);
-	if (err < 0)
-		return err;
-
-	// Keep resources for out-stream.
 	ff->rx_resources.channels_mask = 0x00000000000000ffuLL;
-	err = fw_iso_resources_allocate(&ff->rx_resources,
-			amdtp_stream_get_max_payload(&ff->rx_stream),
-			fw_parent_device(ff->unit)->max_speed);
-	if (err < 0)
-		fw_iso_resources_free(&ff->tx_resources);
-
-	return err;
+	return snd_ff_stream_keep_resources(ff);
 }
 
 static int ff400_begin_session(struct snd_ff *ff, unsigned int rate)
@@ -596,6 +586,7 @@ static void ff400_handle_midi_msg(struct snd_ff *ff, unsigned int offset,
 const struct snd_ff_protocol snd_ff_protocol_ff400 = {
 	.handle_midi_msg	= ff400_handle_midi_msg,
 	.fill_midi_msg		= former_fill_midi_msg,
+	.read_status		= former_read_status,
 	.get_clock		= former_get_clock,
 	.switch_fetching_mode	= former_switch_fetching_mode,
 	.allocate_resources	= ff400_allocate_resources,
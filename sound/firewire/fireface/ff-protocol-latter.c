@@ -140,20 +140,39 @@ static int parse_clock_bits(u32 data, unsigned int *rate,
 	return 0;
 }
 
-static int latter_get_clock(struct snd_ff *ff, unsigned int *rate,
-			   enum snd_ff_clock_src *src)
+static int read_sync_status(struct snd_ff *ff, u32 *data)
 {
 	__le32 reg;
-	u32 data;
 	int err;
 
 	err = snd_fw_transaction(ff->unit, TCODE_READ_QUADLET_REQUEST,
 				 LATTER_SYNC_STATUS, &reg, sizeof(reg), 0);
 	if (err < 0)
 		return err;
-	data = le32_to_cpu(reg);
+	*data = le32_to_cpu(reg);
 
-	return parse_clock_bits(data, rate, src, ff->unit_version);
+	return 0;
+}
+
+// The sync status register includes the configuration of clock.
+static int latter_read_status(struct snd_ff *ff, u32 *regs)
+{
+	memset(regs, 0, sizeof(*regs) * SND_FF_STATUS_QUADLETS);
+
+	return read_sync_status(ff, regs);
+}
+
+static int latter_get_clock(struct snd_ff *ff, unsigned int *rate,
+			   enum snd_ff_clock_src *src)
+{
+	u32 regs[SND_FF_STATUS_QUADLETS];
+	int err;
+
+	err = snd_ff_get_status(ff, regs);
+	if (err < 0)
+		return err;
+
+	return parse_clock_bits(regs[0], rate, src, ff->unit_version);
 }
 
 static int latter_switch_fetching_mode(struct snd_ff *ff, bool enable)
@@ -206,8 +225,14 @@ static int latter_allocate_resources(struct snd_ff *ff, unsigned int rate)
 	while (count++ < 10) {
 		unsigned int curr_rate;
 		enum snd_ff_clock_src src;
+		u32 data;
+
+		// The register is read directly to see the transition.
+		err = read_sync_status(ff, &data);
+		if (err < 0)
+			return err;
 
-		err = latter_get_clock(ff, &curr_rate, &src);
+		err = parse_clock_bits(data, &curr_rate, &src, ff->unit_version);
 		if (err < 0)
 			return err;
 
@@ -228,23 +253,10 @@ static int latter_allocate_resources(struct snd_ff *ff, unsigned int rate)
 	if (err < 0)
 		return err;
 
-	// Keep resources for in-stream.
+	// Keep resources for in-stream and out-stream at once.
 	ff->tx_resources.channels_mask = 0x00000000000000ffuLL;
-	err = fw_iso_resources_allocate(&ff->tx_resources,
-			amdtp_stream_get_max_payload(&ff->tx_stream),
-			fw_parent_device(ff->unit)->max_speed);
-	if (err < 0)
-		return err;
-
-	// Keep resources for out-stream.
 	ff->rx_resources.channels_mask = 0x00000000000000ffuLL;
-	err = fw_iso_resources_allocate(&ff->rx_resources,
-			amdtp_stream_get_max_payload(&ff->rx_stream),
-			fw_parent_device(ff->unit)->max_speed);
-	if (err < 0)
-		fw_iso_resources_free(&ff->tx_resources);
-
-	return err;
+	return snd_ff_stream_keep_resources(ff);
 }
 
 static int latter_begin_session(struct snd_ff *ff, unsigned int rate)
@@ -255,30 +267,14 @@ static int latter_begin_session(struct snd_ff *ff, unsigned int rate)
 	__le32 reg;
 	int err;
 
-	if (ff->unit_version == SND_FF_UNIT_VERSION_UCX) {
-		// For Fireface UCX. Always use the maximum number of data
-		// channels in data block of packet.
-		if (rate >= 32000 && rate <= 48000)
-			flag = 0x92;
-		else if (rate >= 64000 && rate <= 96000)
-			flag = 0x8e;
-		else if (rate >= 128000 && rate <= 192000)
-			flag = 0x8c;
-		else
-			return -EINVAL;
-	} else {
-		// For Fireface UFX and 802. Due to bandwidth limitation on
-		// IEEE 1394a (400 Mbps), Analog 1-12 and AES are available
-		// without any ADAT at quadruple speed.
-		if (rate >= 32000 && rate <= 48000)
-			flag = 0x9e;
-		else if (rate >= 64000 && rate <= 96000)
-			flag = 0x96;
-		else if (rate >= 128000 && rate <= 192000)
-			flag = 0x8e;
-		else
-			return -EINVAL;
-	}
+	// The lower bits of the flag express the number of data channels in data block of packet,
+	// up to 18, 14, 12 for Fireface UCX and 30, 22, 14 for Fireface UFX and 802 in each range
+	// of sampling rate. For the latter, due to bandwidth limitation on IEEE 1394a (400 Mbps),
+	// Analog 1-12 and AES are available without any ADAT at quadruple speed. A smaller number
+	// restricts the transfer to the first channels.
+	if (rate < 32000 || rate > 192000 || ff->pcm_channels == 0)
+		return -EINVAL;
+	flag = 0x80 | ff->pcm_channels;
 
 	if (generation != fw_parent_device(ff->unit)->card->generation) {
 		err = fw_iso_resources_update(&ff->tx_resources);
@@ -327,7 +323,7 @@ static void latter_dump_status(struct snd_ff *ff, struct snd_info_buffer *buffer
 		{ "ADAT-A",	0x00000004, 0x00000040, },
 		{ "ADAT-B",	0x00000008, 0x00000080, },
 	};
-	__le32 reg;
+	u32 regs[SND_FF_STATUS_QUADLETS];
 	u32 data;
 	unsigned int rate;
 	enum snd_ff_clock_src src;
@@ -336,11 +332,10 @@ static void latter_dump_status(struct snd_ff *ff, struct snd_info_buffer *buffer
 	int i;
 	int err;
 
-	err = snd_fw_transaction(ff->unit, TCODE_READ_QUADLET_REQUEST,
-				 LATTER_SYNC_STATUS, &reg, sizeof(reg), 0);
+	err = snd_ff_get_status(ff, regs);
 	if (err < 0)
 		return;
-	data = le32_to_cpu(reg);
+	data = regs[0];
 
 	snd_iprintf(buffer, "External source detection:\n");
 
@@ -533,6 +528,7 @@ static int latter_fill_midi_msg(struct snd_ff *ff,
 const struct snd_ff_protocol snd_ff_protocol_latter = {
 	.handle_midi_msg	= latter_handle_midi_msg,
 	.fill_midi_msg		= latter_fill_midi_msg,
+	.read_status		= latter_read_status,
 	.get_clock		= latter_get_clock,
 	.switch_fetching_mode	= latter_switch_fetching_mode,
 	.allocate_resources	= latter_allocate_resources,
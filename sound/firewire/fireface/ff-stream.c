@@ -55,8 +55,16 @@ static int init_stream(struct snd_ff *ff, struct amdtp_stream *s)
 		return err;
 
 	err = amdtp_ff_init(s, ff->unit, dir);
-	if (err < 0)
+	if (err < 0) {
+		fw_iso_resources_destroy(resources);
+		return err;
+	}
+
+	err = amdtp_stream_add_counters(s, ff->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(s);
 		fw_iso_resources_destroy(resources);
+	}
 
 	return err;
 }
@@ -106,7 +114,88 @@ void snd_ff_stream_destroy_duplex(struct snd_ff *ff)
 	destroy_stream(ff, &ff->tx_stream);
 }
 
+// Allocate isochronous resources for both streams by one batch of transactions. The protocol
+// implementation configures the mask of channels beforehand.
+int snd_ff_stream_keep_resources(struct snd_ff *ff)
+{
+	struct fw_iso_resources *resources[] = {
+		&ff->tx_resources,
+		&ff->rx_resources,
+	};
+	unsigned int max_payloads[] = {
+		amdtp_stream_get_max_payload(&ff->tx_stream),
+		amdtp_stream_get_max_payload(&ff->rx_stream),
+	};
+
+	return fw_iso_resources_allocate_batch(resources, max_payloads,
+					       ARRAY_SIZE(resources),
+					       fw_parent_device(ff->unit)->max_speed);
+}
+
+static int set_stream_parameters(struct snd_ff *ff, unsigned int rate,
+				 unsigned int pcm_channels, unsigned int *rx_pcm_channels)
+{
+	unsigned int tx_pcm_channels;
+	enum snd_ff_stream_mode mode;
+	int i, err;
+
+	for (i = 0; i < CIP_SFC_COUNT; ++i) {
+		if (amdtp_rate_table[i] == rate)
+			break;
+	}
+	if (i >= CIP_SFC_COUNT)
+		return -EINVAL;
+
+	err = snd_ff_stream_get_multiplier_mode(i, &mode);
+	if (err < 0)
+		return err;
+
+	tx_pcm_channels = ff->spec->pcm_capture_channels[mode];
+	*rx_pcm_channels = ff->spec->pcm_playback_channels[mode];
+
+	// The unit can be configured to transfer the first channels only, to save bandwidth
+	// on the bus. The number is common to both directions. Zero stands for all of them.
+	if (ff->spec->pcm_min_channels > 0 && pcm_channels > 0) {
+		if (pcm_channels < ff->spec->pcm_min_channels ||
+		    pcm_channels > min(tx_pcm_channels, *rx_pcm_channels))
+			return -EINVAL;
+		tx_pcm_channels = pcm_channels;
+		*rx_pcm_channels = pcm_channels;
+	}
+
+	err = amdtp_ff_set_parameters(&ff->tx_stream, rate, tx_pcm_channels);
+	if (err < 0)
+		return err;
+
+	return amdtp_ff_set_parameters(&ff->rx_stream, rate, *rx_pcm_channels);
+}
+
+// Count the resources which snd_ff_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The parameters of streams are changed only when they are not reserved yet.
+int snd_ff_stream_preflight(struct snd_ff *ff, unsigned int rate, unsigned int pcm_channels,
+			    struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(ff->unit)->max_speed;
+	int err;
+
+	if (ff->substreams_counter == 0) {
+		unsigned int rx_pcm_channels;
+
+		err = set_stream_parameters(ff, rate, pcm_channels, &rx_pcm_channels);
+		if (err < 0)
+			return err;
+	}
+
+	fw_iso_preflight_add(preflight, ff->unit, FW_ISO_CONTEXT_RECEIVE,
+			     amdtp_stream_get_max_payload(&ff->tx_stream), speed);
+	fw_iso_preflight_add(preflight, ff->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&ff->rx_stream), speed);
+
+	return 0;
+}
+
 int snd_ff_stream_reserve_duplex(struct snd_ff *ff, unsigned int rate,
+				 unsigned int pcm_channels,
 				 unsigned int frames_per_period,
 				 unsigned int frames_per_buffer)
 {
@@ -114,13 +203,16 @@ int snd_ff_stream_reserve_duplex(struct snd_ff *ff, unsigned int rate,
 	enum snd_ff_clock_src src;
 	int err;
 
+	// The status of clock is read again for the streams.
+	snd_ff_invalidate_status(ff);
+
 	err = ff->spec->protocol->get_clock(ff, &curr_rate, &src);
 	if (err < 0)
 		return err;
 
-	if (ff->substreams_counter == 0 || curr_rate != rate) {
-		enum snd_ff_stream_mode mode;
-		int i;
+	if (ff->substreams_counter == 0 || curr_rate != rate ||
+	    (ff->spec->pcm_min_channels > 0 && ff->pcm_channels != pcm_channels)) {
+		unsigned int rx_pcm_channels;
 
 		amdtp_domain_stop(&ff->domain);
 		finish_session(ff);
@@ -128,28 +220,14 @@ int snd_ff_stream_reserve_duplex(struct snd_ff *ff, unsigned int rate,
 		fw_iso_resources_free(&ff->tx_resources);
 		fw_iso_resources_free(&ff->rx_resources);
 
-		for (i = 0; i < CIP_SFC_COUNT; ++i) {
-			if (amdtp_rate_table[i] == rate)
-				break;
-		}
-		if (i >= CIP_SFC_COUNT)
-			return -EINVAL;
-
-		err = snd_ff_stream_get_multiplier_mode(i, &mode);
-		if (err < 0)
-			return err;
-
-		err = amdtp_ff_set_parameters(&ff->tx_stream, rate,
-					ff->spec->pcm_capture_channels[mode]);
+		err = set_stream_parameters(ff, rate, pcm_channels, &rx_pcm_channels);
 		if (err < 0)
 			return err;
 
-		err = amdtp_ff_set_parameters(&ff->rx_stream, rate,
-					ff->spec->pcm_playback_channels[mode]);
-		if (err < 0)
-			return err;
+		ff->pcm_channels = rx_pcm_channels;
 
 		err = ff->spec->protocol->allocate_resources(ff, rate);
+		snd_ff_invalidate_status(ff);
 		if (err < 0)
 			return err;
 
@@ -186,6 +264,7 @@ int snd_ff_stream_start_duplex(struct snd_ff *ff, unsigned int rate)
 		int spd = fw_parent_device(ff->unit)->max_speed;
 
 		err = ff->spec->protocol->begin_session(ff, rate);
+		snd_ff_invalidate_status(ff);
 		if (err < 0)
 			goto error;
 
@@ -249,6 +328,7 @@ void snd_ff_stream_lock_changed(struct snd_ff *ff)
 {
 	ff->dev_lock_changed = true;
 	wake_up(&ff->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(ff->card, ff->dev_lock_count > 0);
 }
 
 int snd_ff_stream_lock_try(struct snd_ff *ff)
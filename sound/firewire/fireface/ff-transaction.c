@@ -7,122 +7,22 @@
 
 #include "ff.h"
 
-static void finish_transmit_midi_msg(struct snd_ff *ff, unsigned int port,
-				     int rcode)
+static int fill_midi_msg(struct snd_fw_async_midi_port *port,
+			 struct snd_rawmidi_substream *substream,
+			 u8 *buf, unsigned int *consumed)
 {
-	struct snd_rawmidi_substream *substream =
-				READ_ONCE(ff->rx_midi_substreams[port]);
-
-	if (rcode_is_permanent_error(rcode)) {
-		ff->rx_midi_error[port] = true;
-		return;
-	}
-
-	if (rcode != RCODE_COMPLETE) {
-		/* Transfer the message again, immediately. */
-		ff->next_ktime[port] = 0;
-		schedule_work(&ff->rx_midi_work[port]);
-		return;
-	}
-
-	snd_rawmidi_transmit_ack(substream, ff->rx_bytes[port]);
-	ff->rx_bytes[port] = 0;
-
-	if (!snd_rawmidi_transmit_empty(substream))
-		schedule_work(&ff->rx_midi_work[port]);
-}
-
-static void finish_transmit_midi0_msg(struct fw_card *card, int rcode,
-				      void *data, size_t length,
-				      void *callback_data)
-{
-	struct snd_ff *ff =
-		container_of(callback_data, struct snd_ff, transactions[0]);
-	finish_transmit_midi_msg(ff, 0, rcode);
-}
-
-static void finish_transmit_midi1_msg(struct fw_card *card, int rcode,
-				      void *data, size_t length,
-				      void *callback_data)
-{
-	struct snd_ff *ff =
-		container_of(callback_data, struct snd_ff, transactions[1]);
-	finish_transmit_midi_msg(ff, 1, rcode);
-}
-
-static void transmit_midi_msg(struct snd_ff *ff, unsigned int port)
-{
-	struct snd_rawmidi_substream *substream =
-			READ_ONCE(ff->rx_midi_substreams[port]);
+	struct snd_ff *ff = substream->rmidi->private_data;
+	unsigned int index = substream->number;
 	int quad_count;
 
-	struct fw_device *fw_dev = fw_parent_device(ff->unit);
-	unsigned long long addr;
-	int generation;
-	fw_transaction_callback_t callback;
-	int tcode;
-
-	if (substream == NULL || snd_rawmidi_transmit_empty(substream))
-		return;
-
-	if (ff->rx_bytes[port] > 0 || ff->rx_midi_error[port])
-		return;
-
-	/* Do it in next chance. */
-	if (ktime_after(ff->next_ktime[port], ktime_get())) {
-		schedule_work(&ff->rx_midi_work[port]);
-		return;
-	}
-
-	quad_count = ff->spec->protocol->fill_midi_msg(ff, substream, port);
+	quad_count = ff->spec->protocol->fill_midi_msg(ff, substream, index);
 	if (quad_count <= 0)
-		return;
-
-	if (port == 0) {
-		addr = ff->spec->midi_rx_addrs[0];
-		callback = finish_transmit_midi0_msg;
-	} else {
-		addr = ff->spec->midi_rx_addrs[1];
-		callback = finish_transmit_midi1_msg;
-	}
-
-	/* Set interval to next transaction. */
-	ff->next_ktime[port] = ktime_add_ns(ktime_get(),
-			ff->rx_bytes[port] * 8 * (NSEC_PER_SEC / 31250));
-
-	if (quad_count == 1)
-		tcode = TCODE_WRITE_QUADLET_REQUEST;
-	else
-		tcode = TCODE_WRITE_BLOCK_REQUEST;
+		return quad_count;
 
-	/*
-	 * In Linux FireWire core, when generation is updated with memory
-	 * barrier, node id has already been updated. In this module, After
-	 * this smp_rmb(), load/store instructions to memory are completed.
-	 * Thus, both of generation and node id are available with recent
-	 * values. This is a light-serialization solution to handle bus reset
-	 * events on IEEE 1394 bus.
-	 */
-	generation = fw_dev->generation;
-	smp_rmb();
-	fw_send_request(fw_dev->card, &ff->transactions[port], tcode,
-			fw_dev->node_id, generation, fw_dev->max_speed,
-			addr, &ff->msg_buf[port], quad_count * 4,
-			callback, &ff->transactions[port]);
-}
-
-static void transmit_midi0_msg(struct work_struct *work)
-{
-	struct snd_ff *ff = container_of(work, struct snd_ff, rx_midi_work[0]);
+	memcpy(buf, ff->msg_buf[index], quad_count * 4);
+	*consumed = ff->rx_bytes[index];
 
-	transmit_midi_msg(ff, 0);
-}
-
-static void transmit_midi1_msg(struct work_struct *work)
-{
-	struct snd_ff *ff = container_of(work, struct snd_ff, rx_midi_work[1]);
-
-	transmit_midi_msg(ff, 1);
+	return quad_count * 4;
 }
 
 static void handle_midi_msg(struct fw_card *card, struct fw_request *request,
@@ -208,8 +108,11 @@ int snd_ff_transaction_register(struct snd_ff *ff)
 	if (err < 0)
 		return err;
 
-	INIT_WORK(&ff->rx_midi_work[0], transmit_midi0_msg);
-	INIT_WORK(&ff->rx_midi_work[1], transmit_midi1_msg);
+	for (i = 0; i < SND_FF_OUT_MIDI_PORTS; ++i) {
+		snd_fw_async_midi_port_init(&ff->rx_midi_ports[i], ff->unit,
+					    ff->spec->midi_rx_addrs[i],
+					    fill_midi_msg);
+	}
 
 	return 0;
 }
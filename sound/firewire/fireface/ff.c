@@ -36,6 +36,38 @@ static void name_card(struct snd_ff *ff)
 		 dev_name(&ff->unit->device), 100 << fw_dev->max_speed);
 }
 
+#define STATUS_CACHE_INTERVAL_MS	100
+
+// Each read of the registers costs asynchronous transaction. The result is shared by the readers
+// till the interval elapses, and the readers in the interval wait for the transaction in flight.
+int snd_ff_get_status(struct snd_ff *ff, u32 *regs)
+{
+	int err = 0;
+
+	mutex_lock(&ff->status_cache.mutex);
+
+	if (!ff->status_cache.valid ||
+	    time_after_eq(jiffies, ff->status_cache.expires)) {
+		err = ff->spec->protocol->read_status(ff, ff->status_cache.regs);
+		ff->status_cache.valid = (err >= 0);
+		ff->status_cache.expires = jiffies + msecs_to_jiffies(STATUS_CACHE_INTERVAL_MS);
+	}
+
+	if (err >= 0)
+		memcpy(regs, ff->status_cache.regs, sizeof(ff->status_cache.regs));
+
+	mutex_unlock(&ff->status_cache.mutex);
+
+	return err;
+}
+
+void snd_ff_invalidate_status(struct snd_ff *ff)
+{
+	mutex_lock(&ff->status_cache.mutex);
+	ff->status_cache.valid = false;
+	mutex_unlock(&ff->status_cache.mutex);
+}
+
 static void ff_card_free(struct snd_card *card)
 {
 	struct snd_ff *ff = card->private_data;
@@ -43,6 +75,7 @@ static void ff_card_free(struct snd_card *card)
 	snd_ff_stream_destroy_duplex(ff);
 	snd_ff_transaction_unregister(ff);
 
+	mutex_destroy(&ff->status_cache.mutex);
 	mutex_destroy(&ff->mutex);
 	fw_unit_put(ff->unit);
 }
@@ -65,6 +98,7 @@ static int snd_ff_probe(struct fw_unit *unit, const struct ieee1394_device_id *e
 
 	mutex_init(&ff->mutex);
 	spin_lock_init(&ff->lock);
+	mutex_init(&ff->status_cache.mutex);
 	init_waitqueue_head(&ff->hwdep_wait);
 
 	ff->unit_version = entry->version;
@@ -109,6 +143,7 @@ static void snd_ff_update(struct fw_unit *unit)
 	struct snd_ff *ff = dev_get_drvdata(&unit->device);
 
 	snd_ff_transaction_reregister(ff);
+	snd_ff_invalidate_status(ff);
 
 	snd_ff_stream_update_duplex(ff);
 }
@@ -146,6 +181,7 @@ static const struct snd_ff_spec spec_ff400 = {
 static const struct snd_ff_spec spec_ucx = {
 	.pcm_capture_channels = {18, 14, 12},
 	.pcm_playback_channels = {18, 14, 12},
+	.pcm_min_channels = 2,
 	.midi_in_ports = 2,
 	.midi_out_ports = 2,
 	.protocol = &snd_ff_protocol_latter,
@@ -157,6 +193,7 @@ static const struct snd_ff_spec spec_ucx = {
 static const struct snd_ff_spec spec_ufx_802 = {
 	.pcm_capture_channels = {30, 22, 14},
 	.pcm_playback_channels = {30, 22, 14},
+	.pcm_min_channels = 2,
 	.midi_in_ports = 1,
 	.midi_out_ports = 1,
 	.protocol = &snd_ff_protocol_latter,
@@ -235,6 +272,7 @@ static struct fw_driver ff_driver = {
 		.owner	= THIS_MODULE,
 		.name	= KBUILD_MODNAME,
 		.bus	= &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = snd_ff_probe,
 	.update   = snd_ff_update,
@@ -37,6 +37,9 @@
 #define SND_FF_IN_MIDI_PORTS		2
 #define SND_FF_OUT_MIDI_PORTS		2
 
+// The number of quadlets in the cache of clock and status registers.
+#define SND_FF_STATUS_QUADLETS		2
+
 enum snd_ff_unit_version {
 	SND_FF_UNIT_VERSION_FF800	= 0x000001,
 	SND_FF_UNIT_VERSION_FF400	= 0x000002,
@@ -56,6 +59,9 @@ struct snd_ff_protocol;
 struct snd_ff_spec {
 	const unsigned int pcm_capture_channels[SND_FF_STREAM_MODE_COUNT];
 	const unsigned int pcm_playback_channels[SND_FF_STREAM_MODE_COUNT];
+	// The minimum number of PCM channels in data block of packet when the unit can be
+	// configured to transfer the first channels only. Zero when the number is fixed.
+	unsigned int pcm_min_channels;
 
 	unsigned int midi_in_ports;
 	unsigned int midi_out_ports;
@@ -80,16 +86,14 @@ struct snd_ff {
 	struct fw_address_handler async_handler;
 
 	/* TO handle MIDI rx. */
-	struct snd_rawmidi_substream *rx_midi_substreams[SND_FF_OUT_MIDI_PORTS];
+	struct snd_fw_async_midi_port rx_midi_ports[SND_FF_OUT_MIDI_PORTS];
 	bool on_sysex[SND_FF_OUT_MIDI_PORTS];
 	__le32 msg_buf[SND_FF_OUT_MIDI_PORTS][SND_FF_MAXIMIM_MIDI_QUADS];
-	struct work_struct rx_midi_work[SND_FF_OUT_MIDI_PORTS];
-	struct fw_transaction transactions[SND_FF_OUT_MIDI_PORTS];
-	ktime_t next_ktime[SND_FF_OUT_MIDI_PORTS];
-	bool rx_midi_error[SND_FF_OUT_MIDI_PORTS];
 	unsigned int rx_bytes[SND_FF_OUT_MIDI_PORTS];
 
 	unsigned int substreams_counter;
+	// The number of PCM channels in data block of packet for the reserved streams.
+	unsigned int pcm_channels;
 	struct amdtp_stream tx_stream;
 	struct amdtp_stream rx_stream;
 	struct fw_iso_resources tx_resources;
@@ -99,6 +103,15 @@ struct snd_ff {
 	bool dev_lock_changed;
 	wait_queue_head_t hwdep_wait;
 
+	// The cache of clock and status registers shared by readers of proc and PCM, refreshed at
+	// most once in the interval, at starting streams, and at bus reset.
+	struct {
+		struct mutex mutex;
+		unsigned long expires;
+		bool valid;
+		u32 regs[SND_FF_STATUS_QUADLETS];
+	} status_cache;
+
 	struct amdtp_domain domain;
 };
 
@@ -118,6 +131,7 @@ struct snd_ff_protocol {
 	int (*fill_midi_msg)(struct snd_ff *ff,
 			     struct snd_rawmidi_substream *substream,
 			     unsigned int port);
+	int (*read_status)(struct snd_ff *ff, u32 *regs);
 	int (*get_clock)(struct snd_ff *ff, unsigned int *rate,
 			 enum snd_ff_clock_src *src);
 	int (*switch_fetching_mode)(struct snd_ff *ff, bool enable);
@@ -146,9 +160,13 @@ int snd_ff_stream_get_multiplier_mode(enum cip_sfc sfc,
 				      enum snd_ff_stream_mode *mode);
 int snd_ff_stream_init_duplex(struct snd_ff *ff);
 void snd_ff_stream_destroy_duplex(struct snd_ff *ff);
+int snd_ff_stream_keep_resources(struct snd_ff *ff);
 int snd_ff_stream_reserve_duplex(struct snd_ff *ff, unsigned int rate,
+				 unsigned int pcm_channels,
 				 unsigned int frames_per_period,
 				 unsigned int frames_per_buffer);
+int snd_ff_stream_preflight(struct snd_ff *ff, unsigned int rate, unsigned int pcm_channels,
+			    struct fw_iso_preflight *preflight);
 int snd_ff_stream_start_duplex(struct snd_ff *ff, unsigned int rate);
 void snd_ff_stream_stop_duplex(struct snd_ff *ff);
 void snd_ff_stream_update_duplex(struct snd_ff *ff);
@@ -157,6 +175,9 @@ void snd_ff_stream_lock_changed(struct snd_ff *ff);
 int snd_ff_stream_lock_try(struct snd_ff *ff);
 void snd_ff_stream_lock_release(struct snd_ff *ff);
 
+int snd_ff_get_status(struct snd_ff *ff, u32 *regs);
+void snd_ff_invalidate_status(struct snd_ff *ff);
+
 void snd_ff_proc_init(struct snd_ff *ff);
 const char *snd_ff_proc_get_clk_label(enum snd_ff_clock_src src);
 
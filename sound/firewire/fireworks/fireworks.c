@@ -23,8 +23,10 @@ MODULE_LICENSE("GPL v2");
 static int index[SNDRV_CARDS]	= SNDRV_DEFAULT_IDX;
 static char *id[SNDRV_CARDS]	= SNDRV_DEFAULT_STR;
 static bool enable[SNDRV_CARDS]	= SNDRV_DEFAULT_ENABLE_PNP;
+static bool unidirectional[SNDRV_CARDS];
 unsigned int snd_efw_resp_buf_size	= 1024;
 bool snd_efw_resp_buf_debug		= false;
+unsigned int snd_efw_meter_interval	= 0;
 
 module_param_array(index, int, NULL, 0444);
 MODULE_PARM_DESC(index, "card index");
@@ -32,11 +34,16 @@ module_param_array(id, charp, NULL, 0444);
 MODULE_PARM_DESC(id, "ID string");
 module_param_array(enable, bool, NULL, 0444);
 MODULE_PARM_DESC(enable, "enable Fireworks sound card");
+module_param_array(unidirectional, bool, NULL, 0444);
+MODULE_PARM_DESC(unidirectional, "start stream for capture only when required (default off)");
 module_param_named(resp_buf_size, snd_efw_resp_buf_size, uint, 0444);
 MODULE_PARM_DESC(resp_buf_size,
 		 "response buffer size (max 4096, default 1024)");
 module_param_named(resp_buf_debug, snd_efw_resp_buf_debug, bool, 0444);
 MODULE_PARM_DESC(resp_buf_debug, "store all responses to buffer");
+module_param_named(meter_interval, snd_efw_meter_interval, uint, 0444);
+MODULE_PARM_DESC(meter_interval,
+		 "interval in msec to poll physical meters (default 0, disabled)");
 
 static DEFINE_MUTEX(devices_mutex);
 static DECLARE_BITMAP(devices_used, SNDRV_CARDS);
@@ -192,6 +199,7 @@ efw_card_free(struct snd_card *card)
 	clear_bit(efw->card_index, devices_used);
 	mutex_unlock(&devices_mutex);
 
+	snd_efw_meter_destroy(efw);
 	snd_efw_stream_destroy_duplex(efw);
 	snd_efw_transaction_remove_instance(efw);
 
@@ -232,6 +240,7 @@ static int efw_probe(struct fw_unit *unit, const struct ieee1394_device_id *entr
 	dev_set_drvdata(&unit->device, efw);
 	efw->card = card;
 	efw->card_index = card_index;
+	efw->unidirectional = unidirectional[card_index];
 
 	mutex_init(&efw->mutex);
 	spin_lock_init(&efw->lock);
@@ -251,6 +260,10 @@ static int efw_probe(struct fw_unit *unit, const struct ieee1394_device_id *entr
 	if (err < 0)
 		goto error;
 
+	err = snd_efw_meter_init(efw);
+	if (err < 0)
+		goto error;
+
 	err = snd_efw_stream_init_duplex(efw);
 	if (err < 0)
 		goto error;
@@ -275,6 +288,8 @@ static int efw_probe(struct fw_unit *unit, const struct ieee1394_device_id *entr
 	if (err < 0)
 		goto error;
 
+	snd_efw_meter_start(efw);
+
 	return 0;
 error:
 	snd_card_free(card);
@@ -285,7 +300,7 @@ static void efw_update(struct fw_unit *unit)
 {
 	struct snd_efw *efw = dev_get_drvdata(&unit->device);
 
-	snd_efw_transaction_bus_reset(efw->unit);
+	snd_efw_transaction_bus_reset(efw);
 
 	mutex_lock(&efw->mutex);
 	snd_efw_stream_update_duplex(efw);
@@ -338,6 +353,7 @@ static struct fw_driver efw_driver = {
 		.owner = THIS_MODULE,
 		.name = KBUILD_MODNAME,
 		.bus = &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = efw_probe,
 	.update   = efw_update,
@@ -17,6 +17,8 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/sched/signal.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 /* TODO: remove when merging to upstream. */
 #include "../../../backport.h"
@@ -51,9 +53,12 @@
  * IEEE Std 1394-1995.
  */
 #define SND_EFW_RESPONSE_MAXIMUM_BYTES	0x200U
+/* The maximum number of transactions in flight for each device. */
+#define SND_EFW_TRANSACTION_SLOTS	8
 
 extern unsigned int snd_efw_resp_buf_size;
 extern bool snd_efw_resp_buf_debug;
+extern unsigned int snd_efw_meter_interval;
 
 struct snd_efw_phys_grp {
 	u8 type;	/* see enum snd_efw_grp_type */
@@ -71,10 +76,16 @@ struct snd_efw {
 	/* for transaction */
 	u32 seqnum;
 	bool resp_addr_changable;
+	spinlock_t transaction_lock;
+	wait_queue_head_t transaction_wait;
+	struct snd_efw_transaction_queue *transactions[SND_EFW_TRANSACTION_SLOTS];
 
 	/* for quirks */
 	bool is_af9;
 	bool is_fireworks3;
+	// The device can recover media clock from the nominal sequence of packets, thus the
+	// stream for capture is not required to replay its sequence.
+	bool unidirectional;
 	u32 firmware_version;
 
 	unsigned int midi_in_ports;
@@ -89,6 +100,8 @@ struct snd_efw {
 	struct cmp_connection out_conn;
 	struct cmp_connection in_conn;
 	unsigned int substreams_counter;
+	// The number of substreams for capture, included in the above.
+	unsigned int capture_substreams;
 
 	/* hardware metering parameters */
 	unsigned int phys_out;
@@ -108,17 +121,25 @@ struct snd_efw {
 	u8 *pull_ptr;
 	u8 *push_ptr;
 
+	/* snapshot of physical meters kept by poller */
+	struct delayed_work meter_work;
+	struct snd_efw_phys_meters *meter_snapshot;
+	unsigned int meter_snapshot_size;
+	bool meter_snapshot_valid;
+	struct snd_firewire_efw_meter_page *meter_page;
+	bool meter_page_mapped;
+
 	struct amdtp_domain domain;
 };
 
 int snd_efw_transaction_cmd(struct fw_unit *unit,
 			    const void *cmd, unsigned int size);
-int snd_efw_transaction_run(struct fw_unit *unit,
-			    const void *cmd, unsigned int cmd_size,
+int snd_efw_transaction_run(struct snd_efw *efw,
+			    void *cmd, unsigned int cmd_size,
 			    void *resp, unsigned int resp_size);
 int snd_efw_transaction_register(void);
 void snd_efw_transaction_unregister(void);
-void snd_efw_transaction_bus_reset(struct fw_unit *unit);
+void snd_efw_transaction_bus_reset(struct snd_efw *efw);
 void snd_efw_transaction_add_instance(struct snd_efw *efw);
 void snd_efw_transaction_remove_instance(struct snd_efw *efw);
 
@@ -210,6 +231,8 @@ int snd_efw_stream_init_duplex(struct snd_efw *efw);
 int snd_efw_stream_reserve_duplex(struct snd_efw *efw, unsigned int rate,
 				  unsigned int frames_per_period,
 				  unsigned int frames_per_buffer);
+int snd_efw_stream_preflight(struct snd_efw *efw, unsigned int rate,
+			     struct fw_iso_preflight *preflight);
 int snd_efw_stream_start_duplex(struct snd_efw *efw);
 void snd_efw_stream_stop_duplex(struct snd_efw *efw);
 void snd_efw_stream_update_duplex(struct snd_efw *efw);
@@ -227,4 +250,12 @@ int snd_efw_get_multiplier_mode(unsigned int sampling_rate, unsigned int *mode);
 
 int snd_efw_create_hwdep_device(struct snd_efw *efw);
 
+int snd_efw_meter_init(struct snd_efw *efw);
+void snd_efw_meter_destroy(struct snd_efw *efw);
+void snd_efw_meter_start(struct snd_efw *efw);
+int snd_efw_meter_get(struct snd_efw *efw, struct snd_efw_phys_meters *meters,
+		      unsigned int len);
+int snd_efw_meter_mmap(struct snd_efw *efw, struct vm_area_struct *area);
+void snd_efw_meter_unmap(struct snd_efw *efw);
+
 #endif
@@ -21,9 +21,6 @@
  * Information commands. But this module don't use them.
  */
 
-#define KERNEL_SEQNUM_MIN	(SND_EFW_TRANSACTION_USER_SEQNUM_MAX + 2)
-#define KERNEL_SEQNUM_MAX	((u32)~0)
-
 /* for clock source and sampling rate */
 struct efc_clock {
 	u32 source;
@@ -105,7 +102,6 @@ efw_transaction(struct snd_efw *efw, unsigned int category,
 {
 	struct snd_efw_transaction *header;
 	__be32 *buf;
-	u32 seqnum;
 	unsigned int buf_bytes, cmd_bytes;
 	int err;
 
@@ -118,22 +114,11 @@ efw_transaction(struct snd_efw *efw, unsigned int category,
 	if (buf == NULL)
 		return -ENOMEM;
 
-	/* to keep consistency of sequence number */
-	spin_lock(&efw->lock);
-	if ((efw->seqnum < KERNEL_SEQNUM_MIN) ||
-	    (efw->seqnum >= KERNEL_SEQNUM_MAX - 2))
-		efw->seqnum = KERNEL_SEQNUM_MIN;
-	else
-		efw->seqnum += 2;
-	seqnum = efw->seqnum;
-	spin_unlock(&efw->lock);
-
-	/* fill transaction header fields */
+	/* fill transaction header fields, except for sequence number */
 	cmd_bytes = sizeof(struct snd_efw_transaction) + param_bytes;
 	header = (struct snd_efw_transaction *)buf;
 	header->length	 = cpu_to_be32(cmd_bytes / sizeof(__be32));
 	header->version	 = cpu_to_be32(1);
-	header->seqnum	 = cpu_to_be32(seqnum);
 	header->category = cpu_to_be32(category);
 	header->command	 = cpu_to_be32(command);
 	header->status	 = 0;
@@ -141,7 +126,7 @@ efw_transaction(struct snd_efw *efw, unsigned int category,
 	/* fill transaction command parameters */
 	memcpy(header->params, params, param_bytes);
 
-	err = snd_efw_transaction_run(efw->unit, buf, cmd_bytes,
+	err = snd_efw_transaction_run(efw, buf, cmd_bytes,
 				      buf, buf_bytes);
 	if (err < 0)
 		goto end;
@@ -6,13 +6,15 @@
  */
 
 /*
- * This codes have five functionalities.
+ * This codes have six functionalities.
  *
  * 1.get information about firewire node
  * 2.get notification about starting/stopping stream
  * 3.lock/unlock streaming
  * 4.transmit command of EFW transaction
  * 5.receive response of EFW transaction
+ * 6.map the snapshot of physical meters
+ * 7.run EFW transaction with response delivered to the caller
  *
  */
 
@@ -270,9 +272,96 @@ hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 		efw->dev_lock_count = 0;
 	spin_unlock_irq(&efw->lock);
 
+	snd_efw_meter_unmap(efw);
+
 	return 0;
 }
 
+static int
+hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+	   struct vm_area_struct *area)
+{
+	struct snd_efw *efw = hwdep->private_data;
+
+	if (area->vm_pgoff >= SNDRV_FIREWIRE_STREAM_TIMING_PAGE_OFFSET >> PAGE_SHIFT) {
+		struct amdtp_stream *const streams[] = {
+			&efw->tx_stream,
+			&efw->rx_stream,
+		};
+
+		return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+	}
+
+	if (area->vm_pgoff != SNDRV_FIREWIRE_EFW_METER_PAGE_OFFSET >> PAGE_SHIFT)
+		return -EINVAL;
+
+	return snd_efw_meter_mmap(efw, area);
+}
+
+/*
+ * The response is matched to the slot of transaction for kernel, thus it is delivered to the
+ * caller without the response queue shared by readers.
+ */
+static int
+hwdep_efw_transaction(struct snd_efw *efw, void __user *arg)
+{
+	struct snd_firewire_efw_transaction req;
+	struct snd_efw_transaction *cmd, *resp;
+	unsigned int resp_size;
+	u32 seqnum;
+	int err;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (req.command_size < sizeof(*cmd) ||
+	    req.command_size > SND_EFW_RESPONSE_MAXIMUM_BYTES ||
+	    req.response_size < sizeof(*resp))
+		return -EINVAL;
+	resp_size = min_t(unsigned int, req.response_size,
+			  SND_EFW_RESPONSE_MAXIMUM_BYTES);
+
+	cmd = memdup_user(u64_to_user_ptr(req.command), req.command_size);
+	if (IS_ERR(cmd))
+		return PTR_ERR(cmd);
+
+	resp = kmalloc(resp_size, GFP_KERNEL);
+	if (!resp) {
+		err = -ENOMEM;
+		goto end;
+	}
+
+	/* check seqnum is not for kernel-land */
+	seqnum = be32_to_cpu(cmd->seqnum);
+	if (seqnum > SND_EFW_TRANSACTION_USER_SEQNUM_MAX) {
+		err = -EINVAL;
+		goto end;
+	}
+
+	err = snd_efw_transaction_run(efw, cmd, req.command_size, resp,
+				      resp_size);
+	if (err < 0)
+		goto end;
+	if (err < sizeof(*resp)) {
+		err = -EIO;
+		goto end;
+	}
+
+	/* the sequence number for kernel is replaced with the one of caller */
+	resp->seqnum = cpu_to_be32(seqnum + 1);
+
+	req.response_size = err;
+	if (copy_to_user(u64_to_user_ptr(req.response), resp, err) ||
+	    copy_to_user(arg, &req, sizeof(req)))
+		err = -EFAULT;
+	else
+		err = 0;
+end:
+	kfree(resp);
+	kfree(cmd);
+	return err;
+}
+
 static int
 hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 	    unsigned int cmd, unsigned long arg)
@@ -286,6 +375,16 @@ hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(efw);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(efw);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(&efw->tx_stream, 1,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&efw->domain, efw->unit, (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_GET_PCM_METER:
+		return amdtp_am824_get_pcm_meter(&efw->tx_stream, 1, &efw->rx_stream, 1,
+						 (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_EFW_TRANSACTION:
+		return hwdep_efw_transaction(efw, (void __user *)arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -312,6 +411,7 @@ int snd_efw_create_hwdep_device(struct snd_efw *efw)
 		.poll		= hwdep_poll,
 		.ioctl		= hwdep_ioctl,
 		.ioctl_compat	= hwdep_compat_ioctl,
+		.mmap		= hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * fireworks_meter.c - a part of driver for Fireworks based devices
+ */
+
+/*
+ * Each read of physical meters costs one EFW transaction. When the module
+ * parameter "meter_interval" is not zero, the driver polls the meters at the
+ * interval in milliseconds and keeps one snapshot, then the readers via proc
+ * node and the page mapped by hwdep device share it without issuing
+ * transactions.
+ */
+
+#include "./fireworks.h"
+
+static void meter_work(struct work_struct *work)
+{
+	struct snd_efw *efw = container_of(work, struct snd_efw,
+					   meter_work.work);
+	struct snd_efw_phys_meters *meters = efw->meter_snapshot;
+	struct snd_firewire_efw_meter_page *page = efw->meter_page;
+	unsigned int interval = READ_ONCE(snd_efw_meter_interval);
+	struct snd_efw_phys_meters *buf;
+	unsigned int count, max;
+	u32 seq;
+	int err;
+
+	if (interval == 0)
+		return;
+
+	buf = kzalloc(efw->meter_snapshot_size, GFP_KERNEL);
+	if (buf == NULL)
+		goto end;
+
+	err = snd_efw_command_get_phys_meters(efw, buf,
+					      efw->meter_snapshot_size);
+	if (err < 0) {
+		kfree(buf);
+		goto end;
+	}
+
+	spin_lock_irq(&efw->lock);
+	memcpy(meters, buf, efw->meter_snapshot_size);
+	efw->meter_snapshot_valid = true;
+	spin_unlock_irq(&efw->lock);
+
+	if (READ_ONCE(efw->meter_page_mapped)) {
+		max = (PAGE_SIZE - sizeof(*page)) / sizeof(page->values[0]);
+		count = min3(buf->out_meters + buf->in_meters,
+			     efw->phys_out + efw->phys_in, max);
+
+		seq = page->sequence + 1;
+		WRITE_ONCE(page->sequence, seq);
+		smp_wmb();
+		page->status = buf->status;
+		page->out_meters = min(buf->out_meters, count);
+		page->in_meters = count - page->out_meters;
+		memcpy(page->values, buf->values, count * sizeof(u32));
+		smp_wmb();
+		WRITE_ONCE(page->sequence, seq + 1);
+	}
+
+	kfree(buf);
+end:
+	schedule_delayed_work(&efw->meter_work, msecs_to_jiffies(interval));
+}
+
+int snd_efw_meter_init(struct snd_efw *efw)
+{
+	INIT_DELAYED_WORK(&efw->meter_work, meter_work);
+
+	efw->meter_snapshot_size = sizeof(struct snd_efw_phys_meters) +
+				   (efw->phys_in + efw->phys_out) * sizeof(u32);
+	efw->meter_snapshot = kzalloc(efw->meter_snapshot_size, GFP_KERNEL);
+	if (efw->meter_snapshot == NULL)
+		return -ENOMEM;
+
+	efw->meter_page = vmalloc_user(PAGE_SIZE);
+	if (efw->meter_page == NULL) {
+		kfree(efw->meter_snapshot);
+		efw->meter_snapshot = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void snd_efw_meter_destroy(struct snd_efw *efw)
+{
+	if (efw->meter_snapshot == NULL)
+		return;
+
+	cancel_delayed_work_sync(&efw->meter_work);
+
+	vfree(efw->meter_page);
+	efw->meter_page = NULL;
+	kfree(efw->meter_snapshot);
+	efw->meter_snapshot = NULL;
+}
+
+void snd_efw_meter_start(struct snd_efw *efw)
+{
+	if (efw->meter_snapshot != NULL && READ_ONCE(snd_efw_meter_interval) > 0)
+		schedule_delayed_work(&efw->meter_work, 0);
+}
+
+/*
+ * Copy the snapshot when the poller keeps it, else issue the transaction to
+ * read the meters.
+ */
+int snd_efw_meter_get(struct snd_efw *efw, struct snd_efw_phys_meters *meters,
+		      unsigned int len)
+{
+	bool valid;
+
+	if (efw->meter_snapshot == NULL || READ_ONCE(snd_efw_meter_interval) == 0)
+		return snd_efw_command_get_phys_meters(efw, meters, len);
+
+	spin_lock_irq(&efw->lock);
+	valid = efw->meter_snapshot_valid;
+	if (valid) {
+		len = min(len, efw->meter_snapshot_size);
+		memcpy(meters, efw->meter_snapshot, len);
+	}
+	spin_unlock_irq(&efw->lock);
+
+	if (!valid)
+		return snd_efw_command_get_phys_meters(efw, meters, len);
+
+	return 0;
+}
+
+int snd_efw_meter_mmap(struct snd_efw *efw, struct vm_area_struct *area)
+{
+	int err;
+
+	if (efw->meter_page == NULL)
+		return -ENXIO;
+	if (area->vm_end - area->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	if (area->vm_flags & VM_WRITE)
+		return -EPERM;
+	area->vm_flags &= ~VM_MAYWRITE;
+
+	err = remap_vmalloc_range(area, efw->meter_page, 0);
+	if (err < 0)
+		return err;
+
+	/* The page is kept updated till the hwdep device is released. */
+	WRITE_ONCE(efw->meter_page_mapped, true);
+
+	return 0;
+}
+
+void snd_efw_meter_unmap(struct snd_efw *efw)
+{
+	WRITE_ONCE(efw->meter_page_mapped, false);
+}
@@ -10,6 +10,7 @@
 static int midi_open(struct snd_rawmidi_substream *substream)
 {
 	struct snd_efw *efw = substream->rmidi->private_data;
+	bool capture = substream->stream == SNDRV_RAWMIDI_STREAM_INPUT;
 	int err;
 
 	err = snd_efw_stream_lock_try(efw);
@@ -17,6 +18,8 @@ static int midi_open(struct snd_rawmidi_substream *substream)
 		goto end;
 
 	mutex_lock(&efw->mutex);
+	if (capture)
+		++efw->capture_substreams;
 	err = snd_efw_stream_reserve_duplex(efw, 0, 0, 0);
 	if (err >= 0) {
 		++efw->substreams_counter;
@@ -24,6 +27,8 @@ static int midi_open(struct snd_rawmidi_substream *substream)
 		if (err < 0)
 			--efw->substreams_counter;
 	}
+	if (err < 0 && capture)
+		--efw->capture_substreams;
 	mutex_unlock(&efw->mutex);
 	if (err < 0)
 		snd_efw_stream_lock_release(efw);
@@ -37,6 +42,8 @@ static int midi_close(struct snd_rawmidi_substream *substream)
 
 	mutex_lock(&efw->mutex);
 	--efw->substreams_counter;
+	if (substream->stream == SNDRV_RAWMIDI_STREAM_INPUT)
+		--efw->capture_substreams;
 	snd_efw_stream_stop_duplex(efw);
 	mutex_unlock(&efw->mutex);
 
@@ -255,11 +255,17 @@ static int pcm_hw_params(struct snd_pcm_substream *substream,
 		unsigned int frames_per_period = params_period_size(hw_params);
 		unsigned int frames_per_buffer = params_buffer_size(hw_params);
 
+		bool capture = substream->stream == SNDRV_PCM_STREAM_CAPTURE;
+
 		mutex_lock(&efw->mutex);
+		if (capture)
+			++efw->capture_substreams;
 		err = snd_efw_stream_reserve_duplex(efw, rate,
 					frames_per_period, frames_per_buffer);
 		if (err >= 0)
 			++efw->substreams_counter;
+		else if (capture)
+			--efw->capture_substreams;
 		mutex_unlock(&efw->mutex);
 	}
 
@@ -272,8 +278,11 @@ static int pcm_hw_free(struct snd_pcm_substream *substream)
 
 	mutex_lock(&efw->mutex);
 
-	if (substream->runtime->status->state != SNDRV_PCM_STATE_OPEN)
+	if (substream->runtime->status->state != SNDRV_PCM_STATE_OPEN) {
 		--efw->substreams_counter;
+		if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
+			--efw->capture_substreams;
+	}
 
 	snd_efw_stream_stop_duplex(efw);
 
@@ -367,6 +376,28 @@ static int pcm_playback_ack(struct snd_pcm_substream *substream)
 	return amdtp_domain_stream_pcm_ack(&efw->domain, &efw->rx_stream);
 }
 
+static int pcm_capture_time_info(struct snd_pcm_substream *substream,
+				 struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				 struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				 struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_efw *efw = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&efw->tx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
+static int pcm_playback_time_info(struct snd_pcm_substream *substream,
+				  struct timespec64 *system_ts, struct timespec64 *audio_ts,
+				  struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+				  struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_efw *efw = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&efw->rx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
 int snd_efw_create_pcm_devices(struct snd_efw *efw)
 {
 	static const struct snd_pcm_ops capture_ops = {
@@ -378,6 +409,7 @@ int snd_efw_create_pcm_devices(struct snd_efw *efw)
 		.trigger	= pcm_capture_trigger,
 		.pointer	= pcm_capture_pointer,
 		.ack		= pcm_capture_ack,
+		.get_time_info	= pcm_capture_time_info,
 	};
 	static const struct snd_pcm_ops playback_ops = {
 		.open		= pcm_open,
@@ -388,6 +420,7 @@ int snd_efw_create_pcm_devices(struct snd_efw *efw)
 		.trigger	= pcm_playback_trigger,
 		.pointer	= pcm_playback_pointer,
 		.ack		= pcm_playback_ack,
+		.get_time_info	= pcm_playback_time_info,
 	};
 	struct snd_pcm *pcm;
 	int err;
@@ -400,7 +433,7 @@ int snd_efw_create_pcm_devices(struct snd_efw *efw)
 	snprintf(pcm->name, sizeof(pcm->name), "%s PCM", efw->card->shortname);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &playback_ops);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &capture_ops);
-	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_fw_pcm_set_managed_buffer_all(pcm);
 end:
 	return err;
 }
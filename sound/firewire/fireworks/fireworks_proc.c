@@ -140,7 +140,7 @@ proc_read_phys_meters(struct snd_info_entry *entry,
 	if (meters == NULL)
 		return;
 
-	err = snd_efw_command_get_phys_meters(efw, meters, size);
+	err = snd_efw_meter_get(efw, meters, size);
 	if (err < 0)
 		goto end;
 
@@ -191,6 +191,46 @@ proc_read_queues_state(struct snd_info_entry *entry,
 		    consumed, snd_efw_resp_buf_size);
 }
 
+static void
+proc_read_histograms(struct snd_info_entry *entry,
+		     struct snd_info_buffer *buffer)
+{
+	struct snd_efw *efw = entry->private_data;
+
+	snd_iprintf(buffer, "Output Stream from device:\n");
+	amdtp_stream_dump_histograms(&efw->tx_stream, buffer);
+	snd_iprintf(buffer, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&efw->rx_stream, buffer);
+}
+
+static void
+proc_read_preflight(struct snd_info_entry *entry,
+		    struct snd_info_buffer *buffer)
+{
+	struct snd_efw *efw = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	unsigned int rate;
+	int err;
+
+	if (snd_efw_command_get_sampling_rate(efw, &rate) < 0)
+		return;
+
+	mutex_lock(&efw->mutex);
+	err = snd_efw_stream_preflight(efw, rate, &preflight);
+	mutex_unlock(&efw->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, efw->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", efw->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void
 add_node(struct snd_efw *efw, struct snd_info_entry *root, const char *name,
 	 void (*op)(struct snd_info_entry *e, struct snd_info_buffer *b))
@@ -220,4 +260,7 @@ void snd_efw_proc_init(struct snd_efw *efw)
 	add_node(efw, root, "firmware", proc_read_hwinfo);
 	add_node(efw, root, "meters", proc_read_phys_meters);
 	add_node(efw, root, "queues", proc_read_queues_state);
+	add_node(efw, root, "histogram", proc_read_histograms);
+	add_node(efw, root, "preflight", proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&efw->domain, root);
 }
@@ -36,6 +36,13 @@ static int init_stream(struct snd_efw *efw, struct amdtp_stream *stream)
 		return err;
 	}
 
+	err = amdtp_stream_add_counters(stream, efw->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(stream);
+		cmp_connection_destroy(conn);
+		return err;
+	}
+
 	if (stream == &efw->tx_stream) {
 		// Fireworks transmits NODATA packets with TAG0.
 		efw->tx_stream.flags |= CIP_EMPTY_WITH_TAG0;
@@ -57,6 +64,15 @@ static int init_stream(struct snd_efw *efw, struct amdtp_stream *stream)
 		// Firmware version 5.5 reports fixed interval for dbc.
 		if (efw->firmware_version == 0x5050000)
 			efw->tx_stream.ctx_data.tx.dbc_interval = 8;
+
+		// Fireworks takes long time to transfer available packets. Replay the timing of
+		// packets recorded in the former session till the cache of tx packets is primed.
+		err = amdtp_stream_enable_timing_profile(stream);
+		if (err < 0) {
+			amdtp_stream_destroy(stream);
+			cmp_connection_destroy(conn);
+			return err;
+		}
 	}
 
 	return err;
@@ -66,27 +82,15 @@ static int start_stream(struct snd_efw *efw, struct amdtp_stream *stream,
 			unsigned int rate)
 {
 	struct cmp_connection *conn;
-	int err;
 
 	if (stream == &efw->tx_stream)
 		conn = &efw->out_conn;
 	else
 		conn = &efw->in_conn;
 
-	// Establish connection via CMP.
-	err = cmp_connection_establish(conn);
-	if (err < 0)
-		return err;
-
-	// Start amdtp stream.
-	err = amdtp_domain_add_stream(&efw->domain, stream,
-				      conn->resources.channel, conn->speed);
-	if (err < 0) {
-		cmp_connection_break(conn);
-		return err;
-	}
-
-	return 0;
+	// Start amdtp stream on the established connection.
+	return amdtp_domain_add_stream(&efw->domain, stream,
+				       conn->resources.channel, conn->speed);
 }
 
 // This function should be called before starting the stream or after stopping
@@ -156,30 +160,84 @@ int snd_efw_stream_init_duplex(struct snd_efw *efw)
 	return err;
 }
 
-static int keep_resources(struct snd_efw *efw, struct amdtp_stream *stream,
-			  unsigned int rate, unsigned int mode)
+static int set_stream_parameters(struct snd_efw *efw, struct amdtp_stream *stream,
+				 unsigned int rate, unsigned int mode)
 {
 	unsigned int pcm_channels;
 	unsigned int midi_ports;
-	struct cmp_connection *conn;
-	int err;
 
 	if (stream == &efw->tx_stream) {
 		pcm_channels = efw->pcm_capture_channels[mode];
 		midi_ports = efw->midi_out_ports;
-		conn = &efw->out_conn;
 	} else {
 		pcm_channels = efw->pcm_playback_channels[mode];
 		midi_ports = efw->midi_in_ports;
-		conn = &efw->in_conn;
 	}
 
-	err = amdtp_am824_set_parameters(stream, rate, pcm_channels,
-					 midi_ports, false);
+	return amdtp_am824_set_parameters(stream, rate, pcm_channels,
+					  midi_ports, false);
+}
+
+static int keep_resources(struct snd_efw *efw, struct amdtp_stream *stream,
+			  unsigned int rate, unsigned int mode)
+{
+	struct cmp_connection *conn;
+	int err;
+
+	if (stream == &efw->tx_stream)
+		conn = &efw->out_conn;
+	else
+		conn = &efw->in_conn;
+
+	err = set_stream_parameters(efw, stream, rate, mode);
 	if (err < 0)
 		return err;
 
-	return cmp_connection_reserve(conn, amdtp_stream_get_max_payload(stream));
+	return cmp_connection_adjust(conn, amdtp_stream_get_max_payload(stream));
+}
+
+// The stream for capture is not required just to replay the sequence of packets when the device
+// recovers media clock from the nominal sequence.
+static bool need_tx_stream(struct snd_efw *efw)
+{
+	return !efw->unidirectional || efw->capture_substreams > 0;
+}
+
+// Count the resources which snd_efw_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The parameters of streams are changed only when they are not reserved yet.
+int snd_efw_stream_preflight(struct snd_efw *efw, unsigned int rate,
+			     struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(efw->unit)->max_speed;
+	int err;
+
+	if (efw->substreams_counter == 0) {
+		unsigned int mode;
+
+		err = snd_efw_get_multiplier_mode(rate, &mode);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(efw, &efw->tx_stream, rate, mode);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(efw, &efw->rx_stream, rate, mode);
+		if (err < 0)
+			return err;
+	}
+
+	// The speed is decided in the same way as CMP connection.
+	if (need_tx_stream(efw)) {
+		fw_iso_preflight_add(preflight, efw->unit, FW_ISO_CONTEXT_RECEIVE,
+				     amdtp_stream_get_max_payload(&efw->tx_stream),
+				     min(efw->out_conn.max_speed, speed));
+	}
+	fw_iso_preflight_add(preflight, efw->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&efw->rx_stream),
+			     min(efw->in_conn.max_speed, speed));
+
+	return 0;
 }
 
 int snd_efw_stream_reserve_duplex(struct snd_efw *efw, unsigned int rate,
@@ -201,14 +259,12 @@ int snd_efw_stream_reserve_duplex(struct snd_efw *efw, unsigned int rate,
 		return err;
 	if (rate == 0)
 		rate = curr_rate;
+	// The isochronous resources are kept if they are enough for the new rate.
 	if (rate != curr_rate) {
 		amdtp_domain_stop(&efw->domain);
 
 		cmp_connection_break(&efw->out_conn);
 		cmp_connection_break(&efw->in_conn);
-
-		cmp_connection_release(&efw->out_conn);
-		cmp_connection_release(&efw->in_conn);
 	}
 
 	if (efw->substreams_counter == 0 || rate != curr_rate) {
@@ -222,13 +278,15 @@ int snd_efw_stream_reserve_duplex(struct snd_efw *efw, unsigned int rate,
 		if (err < 0)
 			return err;
 
-		err = keep_resources(efw, &efw->tx_stream, rate, mode);
-		if (err < 0)
-			return err;
+		if (need_tx_stream(efw)) {
+			err = keep_resources(efw, &efw->tx_stream, rate, mode);
+			if (err < 0)
+				return err;
+		}
 
 		err = keep_resources(efw, &efw->rx_stream, rate, mode);
 		if (err < 0) {
-			cmp_connection_release(&efw->in_conn);
+			cmp_connection_release(&efw->out_conn);
 			return err;
 		}
 
@@ -239,6 +297,17 @@ int snd_efw_stream_reserve_duplex(struct snd_efw *efw, unsigned int rate,
 			cmp_connection_release(&efw->out_conn);
 			return err;
 		}
+	} else if (need_tx_stream(efw) && !amdtp_stream_running(&efw->tx_stream)) {
+		unsigned int mode;
+
+		// The session in one direction is about to include the stream for capture.
+		err = snd_efw_get_multiplier_mode(rate, &mode);
+		if (err < 0)
+			return err;
+
+		err = keep_resources(efw, &efw->tx_stream, rate, mode);
+		if (err < 0)
+			return err;
 	}
 
 	return 0;
@@ -260,32 +329,50 @@ int snd_efw_stream_start_duplex(struct snd_efw *efw)
 		cmp_connection_break(&efw->in_conn);
 	}
 
+	// The session in one direction is restarted for both directions.
+	if (amdtp_stream_running(&efw->rx_stream) && need_tx_stream(efw) &&
+	    !amdtp_stream_running(&efw->tx_stream)) {
+		amdtp_domain_stop(&efw->domain);
+		cmp_connection_break(&efw->in_conn);
+	}
+
 	err = snd_efw_command_get_sampling_rate(efw, &rate);
 	if (err < 0)
 		return err;
 
 	if (!amdtp_stream_running(&efw->rx_stream)) {
-		unsigned int tx_init_skip_cycles;
-
-		// Audiofire 2/4 skip an isochronous cycle several thousands after starting
-		// packet transmission.
-		if (efw->is_fireworks3 && !efw->is_af9)
-			tx_init_skip_cycles = 6000;
-		else
-			tx_init_skip_cycles = 0;
-
-		err = start_stream(efw, &efw->rx_stream, rate);
+		bool with_tx = need_tx_stream(efw);
+		unsigned int tx_init_skip_cycles = 0;
+
+		if (with_tx) {
+			// Audiofire 2/4 skip an isochronous cycle several thousands after starting
+			// packet transmission.
+			if (efw->is_fireworks3 && !efw->is_af9)
+				tx_init_skip_cycles = 6000;
+
+			// Establish connections via CMP for both directions at once.
+			err = cmp_connections_establish(&efw->in_conn, &efw->out_conn);
+		} else {
+			err = cmp_connection_establish(&efw->in_conn);
+		}
 		if (err < 0)
 			goto error;
 
-		err = start_stream(efw, &efw->tx_stream, rate);
+		err = start_stream(efw, &efw->rx_stream, rate);
 		if (err < 0)
 			goto error;
 
+		if (with_tx) {
+			err = start_stream(efw, &efw->tx_stream, rate);
+			if (err < 0)
+				goto error;
+		}
+
 		// NOTE: The device ignores presentation time expressed by the value of syt field
 		// of CIP header in received packets. The sequence of the number of data blocks per
-		// packet is important for media clock recovery.
-		err = amdtp_domain_start(&efw->domain, tx_init_skip_cycles, true, false);
+		// packet is important for media clock recovery. Without the stream for capture,
+		// the nominal sequence is used.
+		err = amdtp_domain_start(&efw->domain, tx_init_skip_cycles, with_tx, false);
 		if (err < 0)
 			goto error;
 
@@ -320,6 +407,14 @@ void snd_efw_stream_stop_duplex(struct snd_efw *efw)
 
 void snd_efw_stream_update_duplex(struct snd_efw *efw)
 {
+	// Keep the streams running when the channel and the bandwidth are reallocated in the new
+	// generation of bus, and the connections are restored.
+	if (cmp_connection_update(&efw->out_conn) >= 0 &&
+	    cmp_connection_update(&efw->in_conn) >= 0) {
+		amdtp_domain_update(&efw->domain);
+		return;
+	}
+
 	amdtp_domain_stop(&efw->domain);
 
 	cmp_connection_break(&efw->out_conn);
@@ -341,6 +436,7 @@ void snd_efw_stream_lock_changed(struct snd_efw *efw)
 {
 	efw->dev_lock_changed = true;
 	wake_up(&efw->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(efw->card, efw->dev_lock_count > 0);
 }
 
 int snd_efw_stream_lock_try(struct snd_efw *efw)
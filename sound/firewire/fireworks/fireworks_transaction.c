@@ -40,8 +40,16 @@
 static DEFINE_SPINLOCK(instances_lock);
 static struct snd_efw *instances[SNDRV_CARDS] = SNDRV_DEFAULT_PTR;
 
-static DEFINE_SPINLOCK(transaction_queues_lock);
-static LIST_HEAD(transaction_queues);
+/*
+ * The sequence number for kernel is incremented by 2 and the response has the
+ * number plus 1. The transaction in flight is put into the slot of the device
+ * indexed by the sequence number, thus the response is matched without
+ * searching, and several transactions can be in flight.
+ */
+#define KERNEL_SEQNUM_MIN	(SND_EFW_TRANSACTION_USER_SEQNUM_MAX + 2)
+#define KERNEL_SEQNUM_MAX	((u32)~0)
+
+#define SEQNUM_TO_SLOT(seqnum)	(((seqnum) / 2) % SND_EFW_TRANSACTION_SLOTS)
 
 enum transaction_queue_state {
 	STATE_PENDING,
@@ -49,9 +57,7 @@ enum transaction_queue_state {
 	STATE_COMPLETE
 };
 
-struct transaction_queue {
-	struct list_head list;
-	struct fw_unit *unit;
+struct snd_efw_transaction_queue {
 	void *buf;
 	unsigned int size;
 	u32 seqnum;
@@ -67,49 +73,91 @@ int snd_efw_transaction_cmd(struct fw_unit *unit,
 				  (void *)cmd, size, 0);
 }
 
-int snd_efw_transaction_run(struct fw_unit *unit,
-			    const void *cmd, unsigned int cmd_size,
+/* Assign the sequence number whose slot is free, or return false. */
+static bool reserve_slot(struct snd_efw *efw,
+			 struct snd_efw_transaction_queue *t, u32 *seqnum)
+{
+	unsigned int i;
+	bool reserved = false;
+
+	spin_lock_irq(&efw->transaction_lock);
+
+	for (i = 0; i < SND_EFW_TRANSACTION_SLOTS; i++) {
+		if ((efw->seqnum < KERNEL_SEQNUM_MIN) ||
+		    (efw->seqnum >= KERNEL_SEQNUM_MAX - 2))
+			efw->seqnum = KERNEL_SEQNUM_MIN;
+		else
+			efw->seqnum += 2;
+
+		if (efw->transactions[SEQNUM_TO_SLOT(efw->seqnum)] == NULL) {
+			*seqnum = efw->seqnum;
+			t->seqnum = *seqnum + 1;
+			efw->transactions[SEQNUM_TO_SLOT(*seqnum)] = t;
+			reserved = true;
+			break;
+		}
+	}
+
+	spin_unlock_irq(&efw->transaction_lock);
+
+	return reserved;
+}
+
+static void release_slot(struct snd_efw *efw, u32 seqnum)
+{
+	spin_lock_irq(&efw->transaction_lock);
+	efw->transactions[SEQNUM_TO_SLOT(seqnum)] = NULL;
+	spin_unlock_irq(&efw->transaction_lock);
+
+	wake_up(&efw->transaction_wait);
+}
+
+int snd_efw_transaction_run(struct snd_efw *efw,
+			    void *cmd, unsigned int cmd_size,
 			    void *resp, unsigned int resp_size)
 {
-	struct transaction_queue t;
+	struct snd_efw_transaction_queue t;
 	unsigned int tries;
+	u32 seqnum;
 	int ret;
 
-	t.unit = unit;
 	t.buf = resp;
 	t.size = resp_size;
-	t.seqnum = be32_to_cpu(((struct snd_efw_transaction *)cmd)->seqnum) + 1;
 	t.state = STATE_PENDING;
 	init_waitqueue_head(&t.wait);
 
-	spin_lock_irq(&transaction_queues_lock);
-	list_add_tail(&t.list, &transaction_queues);
-	spin_unlock_irq(&transaction_queues_lock);
+	/* wait till any slot is available when the slots are full */
+	wait_event(efw->transaction_wait, reserve_slot(efw, &t, &seqnum));
+	((struct snd_efw_transaction *)cmd)->seqnum = cpu_to_be32(seqnum);
 
 	tries = 0;
 	do {
-		ret = snd_efw_transaction_cmd(t.unit, (void *)cmd, cmd_size);
+		ret = snd_efw_transaction_cmd(efw->unit, cmd, cmd_size);
 		if (ret < 0)
 			break;
 
-		wait_event_timeout(t.wait, t.state != STATE_PENDING,
+		wait_event_timeout(t.wait,
+				   smp_load_acquire(&t.state) != STATE_PENDING,
 				   msecs_to_jiffies(EFC_TIMEOUT_MS));
 
 		if (t.state == STATE_COMPLETE) {
 			ret = t.size;
 			break;
 		} else if (t.state == STATE_BUS_RESET) {
+			/* the response for the former command is not expected */
+			spin_lock_irq(&efw->transaction_lock);
+			if (t.state == STATE_BUS_RESET)
+				t.state = STATE_PENDING;
+			spin_unlock_irq(&efw->transaction_lock);
 			msleep(ERROR_DELAY_MS);
 		} else if (++tries >= ERROR_RETRIES) {
-			dev_err(&t.unit->device, "EFW transaction timed out\n");
+			dev_err(&efw->unit->device, "EFW transaction timed out\n");
 			ret = -EIO;
 			break;
 		}
 	} while (1);
 
-	spin_lock_irq(&transaction_queues_lock);
-	list_del(&t.list);
-	spin_unlock_irq(&transaction_queues_lock);
+	release_slot(efw, seqnum);
 
 	return ret;
 }
@@ -137,6 +185,8 @@ copy_resp_to_buf(struct snd_efw *efw, void *data, size_t length, int *rcode)
 		goto end;
 	}
 
+	snd_fw_event_mux_post(efw->card, SNDRV_FIREWIRE_EVENT_EFW_RESPONSE, data, length);
+
 	/* copy to ring buffer */
 	while (length > 0) {
 		till_end = snd_efw_resp_buf_size -
@@ -161,16 +211,14 @@ end:
 	spin_unlock_irq(&efw->lock);
 }
 
-static void
-handle_resp_for_user(struct fw_card *card, int generation, int source,
-		     void *data, size_t length, int *rcode)
+/* The caller should hold instances_lock. */
+static struct snd_efw *
+find_instance(struct fw_card *card, int generation, int source)
 {
 	struct fw_device *device;
 	struct snd_efw *efw;
 	unsigned int i;
 
-	spin_lock_irq(&instances_lock);
-
 	for (i = 0; i < SNDRV_CARDS; i++) {
 		efw = instances[i];
 		if (efw == NULL)
@@ -183,9 +231,22 @@ handle_resp_for_user(struct fw_card *card, int generation, int source,
 		if (device->node_id != source)
 			continue;
 
-		break;
+		return efw;
 	}
-	if (i == SNDRV_CARDS)
+
+	return NULL;
+}
+
+static void
+handle_resp_for_user(struct fw_card *card, int generation, int source,
+		     void *data, size_t length, int *rcode)
+{
+	struct snd_efw *efw;
+
+	spin_lock_irq(&instances_lock);
+
+	efw = find_instance(card, generation, source);
+	if (efw == NULL)
 		goto end;
 
 	copy_resp_to_buf(efw, data, length, rcode);
@@ -197,29 +258,29 @@ static void
 handle_resp_for_kernel(struct fw_card *card, int generation, int source,
 		       void *data, size_t length, int *rcode, u32 seqnum)
 {
-	struct fw_device *device;
-	struct transaction_queue *t;
+	struct snd_efw_transaction_queue *t;
+	struct snd_efw *efw;
 	unsigned long flags;
 
-	spin_lock_irqsave(&transaction_queues_lock, flags);
-	list_for_each_entry(t, &transaction_queues, list) {
-		device = fw_parent_device(t->unit);
-		if ((device->card != card) ||
-		    (device->generation != generation))
-			continue;
-		smp_rmb();	/* node_id vs. generation */
-		if (device->node_id != source)
-			continue;
+	spin_lock_irqsave(&instances_lock, flags);
 
-		if ((t->state == STATE_PENDING) && (t->seqnum == seqnum)) {
-			t->state = STATE_COMPLETE;
-			t->size = min_t(unsigned int, length, t->size);
-			memcpy(t->buf, data, t->size);
-			wake_up(&t->wait);
-			*rcode = RCODE_COMPLETE;
-		}
+	efw = find_instance(card, generation, source);
+	if (efw == NULL)
+		goto end;
+
+	spin_lock(&efw->transaction_lock);
+	t = efw->transactions[SEQNUM_TO_SLOT(seqnum - 1)];
+	if (t && (t->state == STATE_PENDING) && (t->seqnum == seqnum)) {
+		t->size = min_t(unsigned int, length, t->size);
+		memcpy(t->buf, data, t->size);
+		/* paired with the load in snd_efw_transaction_run() */
+		smp_store_release(&t->state, STATE_COMPLETE);
+		wake_up(&t->wait);
+		*rcode = RCODE_COMPLETE;
 	}
-	spin_unlock_irqrestore(&transaction_queues_lock, flags);
+	spin_unlock(&efw->transaction_lock);
+end:
+	spin_unlock_irqrestore(&instances_lock, flags);
 }
 
 static void
@@ -259,6 +320,9 @@ void snd_efw_transaction_add_instance(struct snd_efw *efw)
 {
 	unsigned int i;
 
+	spin_lock_init(&efw->transaction_lock);
+	init_waitqueue_head(&efw->transaction_wait);
+
 	spin_lock_irq(&instances_lock);
 
 	for (i = 0; i < SNDRV_CARDS; i++) {
@@ -286,19 +350,20 @@ void snd_efw_transaction_remove_instance(struct snd_efw *efw)
 	spin_unlock_irq(&instances_lock);
 }
 
-void snd_efw_transaction_bus_reset(struct fw_unit *unit)
+void snd_efw_transaction_bus_reset(struct snd_efw *efw)
 {
-	struct transaction_queue *t;
+	struct snd_efw_transaction_queue *t;
+	unsigned int i;
 
-	spin_lock_irq(&transaction_queues_lock);
-	list_for_each_entry(t, &transaction_queues, list) {
-		if ((t->unit == unit) &&
-		    (t->state == STATE_PENDING)) {
-			t->state = STATE_BUS_RESET;
+	spin_lock_irq(&efw->transaction_lock);
+	for (i = 0; i < SND_EFW_TRANSACTION_SLOTS; i++) {
+		t = efw->transactions[i];
+		if (t && (t->state == STATE_PENDING)) {
+			WRITE_ONCE(t->state, STATE_BUS_RESET);
 			wake_up(&t->wait);
 		}
 	}
-	spin_unlock_irq(&transaction_queues_lock);
+	spin_unlock_irq(&efw->transaction_lock);
 }
 
 static struct fw_address_handler resp_register_handler = {
@@ -319,6 +384,5 @@ int snd_efw_transaction_register(void)
 
 void snd_efw_transaction_unregister(void)
 {
-	WARN_ON(!list_empty(&transaction_queues));
 	fw_core_remove_address_handler(&resp_register_handler);
 }
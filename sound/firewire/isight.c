@@ -47,8 +47,9 @@
 #define REG_MUTE		0x504
 
 #define MAX_FRAMES_PER_PACKET	475
+#define FRAMES_PER_PACKET	6	/* at 48.0 kHz */
 
-#define QUEUE_LENGTH		20
+#define QUEUE_LENGTH		48
 
 struct isight {
 	struct snd_card *card;
@@ -64,6 +65,8 @@ struct isight {
 	bool pcm_running;
 	bool first_packet;
 	int packet_index;
+	unsigned int irq_interval;
+	unsigned int irq_countdown;
 	u32 total_samples;
 	unsigned int buffer_pointer;
 	unsigned int period_counter;
@@ -83,12 +86,6 @@ MODULE_DESCRIPTION("iSight audio driver");
 MODULE_AUTHOR("Clemens Ladisch <clemens@ladisch.de>");
 MODULE_LICENSE("GPL v2");
 
-static struct fw_iso_packet audio_packet = {
-	.payload_length = sizeof(struct audio_payload),
-	.interrupt = 1,
-	.header_length = 4,
-};
-
 static void isight_update_pointers(struct isight *isight, unsigned int count)
 {
 	struct snd_pcm_runtime *runtime = isight->pcm->runtime;
@@ -105,7 +102,14 @@ static void isight_update_pointers(struct isight *isight, unsigned int count)
 	isight->period_counter += count;
 	if (isight->period_counter >= runtime->period_size) {
 		isight->period_counter -= runtime->period_size;
-		snd_pcm_period_elapsed(isight->pcm);
+
+		if (!runtime->no_period_wakeup) {
+			/* The pointer callback can process packets. */
+			if (in_softirq())
+				snd_pcm_period_elapsed(isight->pcm);
+			else
+				snd_pcm_period_elapsed_under_stream_lock(isight->pcm);
+		}
 	}
 }
 
@@ -135,8 +139,13 @@ static void isight_samples(struct isight *isight,
 
 static void isight_pcm_abort(struct isight *isight)
 {
-	if (READ_ONCE(isight->pcm_active))
-		snd_pcm_stop_xrun(isight->pcm);
+	if (READ_ONCE(isight->pcm_active)) {
+		/* The pointer callback can process packets. */
+		if (in_softirq())
+			snd_pcm_stop_xrun(isight->pcm);
+		else
+			snd_pcm_stop(isight->pcm, SNDRV_PCM_STATE_XRUN);
+	}
 }
 
 static void isight_dropped_samples(struct isight *isight, unsigned int total)
@@ -166,19 +175,29 @@ static void isight_dropped_samples(struct isight *isight, unsigned int total)
 	}
 }
 
-static void isight_packet(struct fw_iso_context *context, u32 cycle,
-			  size_t header_length, void *header, void *data)
+static int isight_queue_packet(struct isight *isight, unsigned int index)
 {
-	struct isight *isight = data;
-	const struct audio_payload *payload;
-	unsigned int index, length, count, total;
-	int err;
+	struct fw_iso_packet packet = {
+		.payload_length = sizeof(struct audio_payload),
+		.header_length = 4,
+	};
 
-	if (isight->packet_index < 0)
-		return;
-	index = isight->packet_index;
-	payload = isight->buffer.packets[index].buffer;
-	length = be32_to_cpup(header) >> 16;
+	/* Request hardware IRQ just at the interval of packets. */
+	if (--isight->irq_countdown == 0) {
+		packet.interrupt = 1;
+		isight->irq_countdown = isight->irq_interval;
+	}
+
+	return fw_iso_context_queue(isight->context, &packet,
+				    &isight->buffer.iso_buffer,
+				    isight->buffer.packets[index].offset);
+}
+
+static void isight_payload(struct isight *isight,
+			   const struct audio_payload *payload,
+			   unsigned int length)
+{
+	unsigned int count, total;
 
 	if (likely(length >= 16 &&
 		   payload->signature == cpu_to_be32(0x73676874/*"sght"*/))) {
@@ -196,21 +215,41 @@ static void isight_packet(struct fw_iso_context *context, u32 cycle,
 			isight->total_samples += count;
 		}
 	}
+}
 
-	err = fw_iso_context_queue(isight->context, &audio_packet,
-				   &isight->buffer.iso_buffer,
-				   isight->buffer.packets[index].offset);
-	if (err < 0) {
-		dev_err(&isight->unit->device, "queueing error: %d\n", err);
-		isight_pcm_abort(isight);
-		isight->packet_index = -1;
+static void isight_packet(struct fw_iso_context *context, u32 cycle,
+			  size_t header_length, void *header, void *data)
+{
+	struct isight *isight = data;
+	const __be32 *headers = header;
+	unsigned int packets = header_length / 4;
+	unsigned int i, index;
+	int err;
+
+	if (isight->packet_index < 0)
 		return;
+
+	/* The headers of all packets completed since the last callback. */
+	for (i = 0; i < packets; ++i) {
+		index = isight->packet_index;
+		isight_payload(isight, isight->buffer.packets[index].buffer,
+			       be32_to_cpu(headers[i]) >> 16);
+
+		err = isight_queue_packet(isight, index);
+		if (err < 0) {
+			dev_err(&isight->unit->device,
+				"queueing error: %d\n", err);
+			isight_pcm_abort(isight);
+			isight->packet_index = -1;
+			return;
+		}
+
+		if (++index >= QUEUE_LENGTH)
+			index = 0;
+		isight->packet_index = index;
 	}
-	fw_iso_context_queue_flush(isight->context);
 
-	if (++index >= QUEUE_LENGTH)
-		index = 0;
-	isight->packet_index = index;
+	fw_iso_context_queue_flush(isight->context);
 }
 
 static int isight_connect(struct isight *isight)
@@ -254,7 +293,8 @@ static int isight_open(struct snd_pcm_substream *substream)
 			SNDRV_PCM_INFO_MMAP_VALID |
 			SNDRV_PCM_INFO_BATCH |
 			SNDRV_PCM_INFO_INTERLEAVED |
-			SNDRV_PCM_INFO_BLOCK_TRANSFER,
+			SNDRV_PCM_INFO_BLOCK_TRANSFER |
+			SNDRV_PCM_INFO_NO_PERIOD_WAKEUP,
 		.formats = SNDRV_PCM_FMTBIT_S16_BE,
 		.rates = SNDRV_PCM_RATE_48000,
 		.rate_min = 48000,
@@ -373,10 +413,9 @@ static int isight_start_streaming(struct isight *isight)
 		goto err_resources;
 	}
 
+	isight->irq_countdown = isight->irq_interval;
 	for (i = 0; i < QUEUE_LENGTH; ++i) {
-		err = fw_iso_context_queue(isight->context, &audio_packet,
-					   &isight->buffer.iso_buffer,
-					   isight->buffer.packets[i].offset);
+		err = isight_queue_packet(isight, i);
 		if (err < 0)
 			goto err_context;
 	}
@@ -409,6 +448,14 @@ static int isight_prepare(struct snd_pcm_substream *substream)
 	isight->buffer_pointer = 0;
 	isight->period_counter = 0;
 
+	/*
+	 * One interrupt per period is enough, however the half of queue is
+	 * the upper limit so that the packets are queued again in time.
+	 */
+	isight->irq_interval = clamp_t(unsigned int,
+			substream->runtime->period_size / FRAMES_PER_PACKET,
+			1, QUEUE_LENGTH / 2);
+
 	mutex_lock(&isight->mutex);
 	err = isight_start_streaming(isight);
 	mutex_unlock(&isight->mutex);
@@ -437,6 +484,13 @@ static snd_pcm_uframes_t isight_pointer(struct snd_pcm_substream *substream)
 {
 	struct isight *isight = substream->private_data;
 
+	/*
+	 * Process packets queued till recent cycle. In software IRQ context,
+	 * the call causes dead-lock to disable the tasklet synchronously.
+	 */
+	if (isight->context && !in_softirq())
+		fw_iso_context_flush_completions(isight->context);
+
 	return READ_ONCE(isight->buffer_pointer);
 }
 
@@ -461,7 +515,7 @@ static int isight_create_pcm(struct isight *isight)
 	strcpy(pcm->name, "iSight");
 	isight->pcm = pcm->streams[SNDRV_PCM_STREAM_CAPTURE].substream;
 	isight->pcm->ops = &ops;
-	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_fw_pcm_set_managed_buffer_all(pcm);
 
 	return 0;
 }
@@ -721,6 +775,7 @@ static struct fw_driver isight_driver = {
 		.owner	= THIS_MODULE,
 		.name	= KBUILD_MODNAME,
 		.bus	= &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = isight_probe,
 	.update   = isight_bus_reset,
@@ -10,13 +10,54 @@
 #include <linux/firewire-constants.h>
 #include <linux/export.h>
 #include <linux/jiffies.h>
+#include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <sound/info.h>
 #include "iso-resources.h"
 
 /* TODO: remove when merging to upstream. */
 #include "../../backport.h"
 
+#define ISOC_RESOURCE_DELAY_CARDS	8
+
+/*
+ * IEEE 1394 requires the delay of one second after bus reset before new
+ * allocation, so that the former owners can reclaim their resources. On the
+ * bus dedicated to audio devices, nobody else competes for them, thus the
+ * delay can be shortened for each card.
+ */
+static int isoc_resource_delay_ms[ISOC_RESOURCE_DELAY_CARDS] = {
+	[0 ... ISOC_RESOURCE_DELAY_CARDS - 1] = -1,
+};
+module_param_array(isoc_resource_delay_ms, int, NULL, 0644);
+MODULE_PARM_DESC(isoc_resource_delay_ms,
+		 "Delay in msec before new allocation of isochronous resources after bus reset, for each index of 1394 card (default: -1 for 1000 as IEEE 1394 requires)");
+
+/*
+ * The registry of allocated resources for all of drivers using this module,
+ * reported by the proc file. The parameters of allocation in each entry are
+ * changed under the lock as well.
+ */
+static DEFINE_MUTEX(registry_mutex);
+static LIST_HEAD(registry);
+static struct snd_info_entry *registry_entry;
+
+static void register_allocation(struct fw_iso_resources *r)
+{
+	mutex_lock(&registry_mutex);
+	list_add_tail(&r->list, &registry);
+	mutex_unlock(&registry_mutex);
+}
+
+static void unregister_allocation(struct fw_iso_resources *r)
+{
+	mutex_lock(&registry_mutex);
+	list_del_init(&r->list);
+	mutex_unlock(&registry_mutex);
+}
+
 /**
  * fw_iso_resources_init - initializes a &struct fw_iso_resources
  * @r: the resource manager to initialize
@@ -31,6 +72,7 @@ int fw_iso_resources_init(struct fw_iso_resources *r, struct fw_unit *unit)
 	r->unit = unit;
 	mutex_init(&r->mutex);
 	r->allocated = false;
+	INIT_LIST_HEAD(&r->list);
 
 	return 0;
 }
@@ -78,10 +120,25 @@ static int current_bandwidth_overhead(struct fw_card *card)
 	return card->gap_count < 63 ? card->gap_count * 97 / 10 + 89 : 512;
 }
 
+static u64 isoch_resource_delay(struct fw_card *card)
+{
+	int delay_ms = -1;
+
+	if (card->index >= 0 && card->index < ISOC_RESOURCE_DELAY_CARDS)
+		delay_ms = READ_ONCE(isoc_resource_delay_ms[card->index]);
+
+	if (delay_ms < 0 || delay_ms >= MSEC_PER_SEC)
+		return HZ;
+
+	return msecs_to_jiffies(delay_ms);
+}
+
 static int wait_isoch_resource_delay_after_bus_reset(struct fw_card *card)
 {
+	u64 interval = isoch_resource_delay(card);
+
 	for (;;) {
-		s64 delay = (card->reset_jiffies + HZ) - get_jiffies_64();
+		s64 delay = (card->reset_jiffies + interval) - get_jiffies_64();
 		if (delay <= 0)
 			return 0;
 		if (schedule_timeout_interruptible(delay) > 0)
@@ -137,6 +194,7 @@ retry_after_bus_reset:
 	if (channel >= 0) {
 		r->channel = channel;
 		r->allocated = true;
+		register_allocation(r);
 	} else {
 		if (channel == -EBUSY)
 			dev_err(&r->unit->device,
@@ -152,13 +210,129 @@ retry_after_bus_reset:
 }
 EXPORT_SYMBOL(fw_iso_resources_allocate);
 
+/**
+ * fw_iso_resources_allocate_batch - allocate resources for several streams
+ * @rs: the array of resource managers
+ * @max_payload_bytes: the array of the amount of data (including CIP headers)
+ *		       per packet for each resource manager
+ * @count: the number of entries in the arrays
+ * @speed: the speed (e.g., SCODE_400) at which the packets will be sent
+ *
+ * This function is the same as calling fw_iso_resources_allocate() for each
+ * resource manager, while the bandwidth for all of them is allocated by one
+ * transaction to the isochronous resource manager, followed by one transaction
+ * for the channel of each. On failure, nothing is allocated.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int fw_iso_resources_allocate_batch(struct fw_iso_resources *const *rs,
+				    const unsigned int *max_payload_bytes,
+				    unsigned int count, int speed)
+{
+	struct fw_card *card;
+	int generation, overhead, total, bandwidth, channel;
+	int i, err;
+
+	if (count == 0)
+		return 0;
+	card = fw_parent_device(rs[0]->unit)->card;
+
+	for (i = 0; i < count; ++i) {
+		if (WARN_ON(rs[i]->allocated))
+			return -EBADFD;
+	}
+
+retry_after_bus_reset:
+	spin_lock_irq(&card->lock);
+	generation = card->generation;
+	overhead = current_bandwidth_overhead(card);
+	spin_unlock_irq(&card->lock);
+
+	err = wait_isoch_resource_delay_after_bus_reset(card);
+	if (err < 0)
+		return err;
+
+	total = 0;
+	for (i = 0; i < count; ++i)
+		total += packet_bandwidth(max_payload_bytes[i], speed) + overhead;
+
+	/* No channel is managed when the mask is zero. */
+	bandwidth = total;
+	fw_iso_resource_manage(card, generation, 0, &channel, &bandwidth, true);
+	if (bandwidth == 0) {
+		if (channel == -EAGAIN)
+			goto retry_after_bus_reset;
+		err = channel;
+		goto error;
+	}
+
+	for (i = 0; i < count; ++i) {
+		struct fw_iso_resources *r = rs[i];
+
+		/* No bandwidth is managed when it is zero. */
+		bandwidth = 0;
+
+		mutex_lock(&r->mutex);
+		fw_iso_resource_manage(card, generation, r->channels_mask,
+				       &channel, &bandwidth, true);
+		if (channel >= 0) {
+			r->channel = channel;
+			r->generation = generation;
+			r->bandwidth = packet_bandwidth(max_payload_bytes[i],
+							speed);
+			r->bandwidth_overhead = overhead;
+			r->allocated = true;
+			register_allocation(r);
+		}
+		mutex_unlock(&r->mutex);
+
+		if (channel < 0) {
+			err = channel;
+			break;
+		}
+	}
+	if (i == count)
+		return 0;
+
+	/* Roll back the partial allocation. */
+	while (i-- > 0) {
+		struct fw_iso_resources *r = rs[i];
+
+		bandwidth = 0;
+
+		mutex_lock(&r->mutex);
+		fw_iso_resource_manage(card, generation, 1uLL << r->channel,
+				       &channel, &bandwidth, false);
+		r->allocated = false;
+		unregister_allocation(r);
+		mutex_unlock(&r->mutex);
+	}
+	bandwidth = total;
+	fw_iso_resource_manage(card, generation, 0, &channel, &bandwidth,
+			       false);
+
+	if (err == -EAGAIN)
+		goto retry_after_bus_reset;
+error:
+	if (err == -EBUSY)
+		dev_err(&rs[0]->unit->device,
+			"isochronous resources exhausted\n");
+	else
+		dev_err(&rs[0]->unit->device,
+			"isochronous resource allocation failed\n");
+
+	return err;
+}
+EXPORT_SYMBOL(fw_iso_resources_allocate_batch);
+
 /**
  * fw_iso_resources_update - update resource allocations after a bus reset
  * @r: the resource manager
  *
  * This function must be called from the driver's .update handler to reallocate
  * any resources that were allocated before the bus reset.  It is safe to call
- * this function if no resources are currently allocated.
+ * this function if no resources are currently allocated.  The reclaim is done
+ * immediately, without the delay for new allocation after bus reset.
  *
  * Returns a negative error code on failure.  If this happens, the caller must
  * stop streaming.
@@ -175,10 +349,12 @@ int fw_iso_resources_update(struct fw_iso_resources *r)
 		return 0;
 	}
 
+	mutex_lock(&registry_mutex);
 	spin_lock_irq(&card->lock);
 	r->generation = card->generation;
 	r->bandwidth_overhead = current_bandwidth_overhead(card);
 	spin_unlock_irq(&card->lock);
+	mutex_unlock(&registry_mutex);
 
 	bandwidth = r->bandwidth + r->bandwidth_overhead;
 
@@ -190,6 +366,7 @@ int fw_iso_resources_update(struct fw_iso_resources *r)
 	 */
 	if (channel < 0 && channel != -EAGAIN) {
 		r->allocated = false;
+		unregister_allocation(r);
 		if (channel == -EBUSY)
 			dev_err(&r->unit->device,
 				"isochronous resources exhausted\n");
@@ -204,6 +381,73 @@ int fw_iso_resources_update(struct fw_iso_resources *r)
 }
 EXPORT_SYMBOL(fw_iso_resources_update);
 
+/**
+ * fw_iso_resources_resize - change the bandwidth of allocated resources
+ * @r: the resource manager
+ * @max_payload_bytes: the new amount of data (including CIP headers) per packet
+ * @speed: the speed (e.g., SCODE_400) at which the packets will be sent
+ *
+ * This function allocates or deallocates the difference of bandwidth, while
+ * the channel is kept. It is useful when the sampling rate of the stream is
+ * changed. When a bus reset happened since the last allocation, the caller
+ * should call fw_iso_resources_update() beforehand.
+ *
+ * Returns zero on success, or a negative error code. On failure, the former
+ * allocation is kept.
+ */
+int fw_iso_resources_resize(struct fw_iso_resources *r,
+			    unsigned int max_payload_bytes, int speed)
+{
+	struct fw_card *card = fw_parent_device(r->unit)->card;
+	unsigned int bandwidth;
+	int channel, delta;
+	bool allocate;
+	int err = 0;
+
+	bandwidth = packet_bandwidth(max_payload_bytes, speed);
+
+	mutex_lock(&r->mutex);
+
+	if (!r->allocated) {
+		err = -EBADFD;
+		goto end;
+	}
+
+	if (bandwidth == r->bandwidth)
+		goto end;
+
+	allocate = bandwidth > r->bandwidth;
+	if (allocate)
+		delta = bandwidth - r->bandwidth;
+	else
+		delta = r->bandwidth - bandwidth;
+
+	/* No channel is managed when the mask is zero. */
+	fw_iso_resource_manage(card, r->generation, 0, &channel, &delta,
+			       allocate);
+	if (delta == 0) {
+		if (allocate) {
+			dev_err(&r->unit->device,
+				"isochronous resources exhausted\n");
+			err = -EBUSY;
+		} else {
+			dev_err(&r->unit->device,
+				"isochronous resource deallocation failed\n");
+			err = -EIO;
+		}
+		goto end;
+	}
+
+	mutex_lock(&registry_mutex);
+	r->bandwidth = bandwidth;
+	mutex_unlock(&registry_mutex);
+end:
+	mutex_unlock(&r->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(fw_iso_resources_resize);
+
 /**
  * fw_iso_resources_free - frees allocated resources
  * @r: the resource manager
@@ -231,8 +475,278 @@ void fw_iso_resources_free(struct fw_iso_resources *r)
 				"isochronous resource deallocation failed\n");
 
 		r->allocated = false;
+		unregister_allocation(r);
 	}
 
 	mutex_unlock(&r->mutex);
 }
 EXPORT_SYMBOL(fw_iso_resources_free);
+
+/**
+ * fw_iso_preflight_add - add the demand of one isochronous stream
+ * @p: the preflight
+ * @unit: the device unit for which the stream is needed
+ * @type: FW_ISO_CONTEXT_TRANSMIT for the packets to the device, or
+ *	  FW_ISO_CONTEXT_RECEIVE for the packets from the device
+ * @max_payload_bytes: the amount of data (including CIP headers) per packet
+ * @speed: the speed (e.g., SCODE_400) at which the packets will be sent
+ *
+ * Each stream requires one isochronous context of the type and one channel.
+ * The bandwidth is computed in the same way as fw_iso_resources_allocate().
+ */
+void fw_iso_preflight_add(struct fw_iso_preflight *p, struct fw_unit *unit,
+			  int type, unsigned int max_payload_bytes, int speed)
+{
+	struct fw_card *card = fw_parent_device(unit)->card;
+	int overhead;
+
+	spin_lock_irq(&card->lock);
+	overhead = current_bandwidth_overhead(card);
+	spin_unlock_irq(&card->lock);
+
+	if (type == FW_ISO_CONTEXT_TRANSMIT)
+		++p->it_contexts;
+	else
+		++p->ir_contexts;
+	++p->channels;
+	p->bandwidth += packet_bandwidth(max_payload_bytes, speed) + overhead;
+}
+EXPORT_SYMBOL(fw_iso_preflight_add);
+
+/*
+ * The node of IRM is the one with the largest physical ID in which both link
+ * active and contender bits are set in its self ID packet. The self ID packets
+ * are available in the topology map of the local node. The node ID in
+ * card->irm_node is not available here, since struct fw_node is private to
+ * firewire-core.
+ */
+static int find_irm_node(struct fw_card *card, int *generation)
+{
+	const __be32 *map = card->topology_map;
+	unsigned int count;
+	int i, node_id = -ENODEV;
+
+	spin_lock_irq(&card->lock);
+
+	*generation = card->generation;
+	count = be32_to_cpu(map[2]) & 0xffff;
+	if (count > ARRAY_SIZE(card->topology_map) - 3)
+		count = ARRAY_SIZE(card->topology_map) - 3;
+
+	for (i = 0; i < count; ++i) {
+		u32 self_id = be32_to_cpu(map[3 + i]);
+
+		/* Extended packets. */
+		if (self_id & BIT(23))
+			continue;
+		if ((self_id & BIT(22)) && (self_id & BIT(11)))
+			node_id = 0xffc0 | ((self_id >> 24) & 0x3f);
+	}
+
+	spin_unlock_irq(&card->lock);
+
+	return node_id;
+}
+
+static int read_irm_register(struct fw_card *card, int node_id, int generation,
+			     unsigned int offset, u32 *value)
+{
+	__be32 data;
+	int rcode;
+
+	rcode = fw_run_transaction(card, TCODE_READ_QUADLET_REQUEST, node_id,
+				   generation, SCODE_100,
+				   CSR_REGISTER_BASE + offset, &data,
+				   sizeof(data));
+	if (rcode != RCODE_COMPLETE)
+		return rcode == RCODE_GENERATION ? -EAGAIN : -EIO;
+
+	*value = be32_to_cpu(data);
+
+	return 0;
+}
+
+/**
+ * fw_iso_preflight_check - check whether the demand fits available resources
+ * @p: the preflight with the demand
+ * @unit: the device unit for which the resources will be needed
+ *
+ * This function reads the channels and bandwidth available in the isochronous
+ * resource manager, without allocation of them. The IT/IR contexts available
+ * in the controller are not checked, since they can not be counted without
+ * reserving them. The result is useful to decide the
+ * placement of devices before the allocation and CMP connections, while it is
+ * just a snapshot and the allocation can still fail due to competitors.
+ *
+ * Returns zero when the demand fits, -ENOSPC when it does not, or another
+ * negative error code when the supply is not retrieved.
+ */
+int fw_iso_preflight_check(struct fw_iso_preflight *p, struct fw_unit *unit)
+{
+	struct fw_card *card = fw_parent_device(unit)->card;
+	u32 bandwidth, channels_hi, channels_lo;
+	int node_id, generation, err;
+
+retry_after_bus_reset:
+	node_id = find_irm_node(card, &generation);
+	if (node_id < 0)
+		return node_id;
+
+	err = read_irm_register(card, node_id, generation,
+				CSR_BANDWIDTH_AVAILABLE, &bandwidth);
+	if (err >= 0)
+		err = read_irm_register(card, node_id, generation,
+					CSR_CHANNELS_AVAILABLE_HI,
+					&channels_hi);
+	if (err >= 0)
+		err = read_irm_register(card, node_id, generation,
+					CSR_CHANNELS_AVAILABLE_LO,
+					&channels_lo);
+	if (err == -EAGAIN)
+		goto retry_after_bus_reset;
+	if (err < 0)
+		return err;
+
+	p->free_bandwidth = bandwidth;
+	p->free_channels = hweight32(channels_hi) + hweight32(channels_lo);
+
+	if (p->channels > p->free_channels ||
+	    p->bandwidth > p->free_bandwidth)
+		return -ENOSPC;
+
+	return 0;
+}
+EXPORT_SYMBOL(fw_iso_preflight_check);
+
+/**
+ * fw_iso_preflight_dump - print the demand and supply in proc node
+ * @p: the preflight checked by fw_iso_preflight_check()
+ * @buffer: the buffer of proc node
+ */
+void fw_iso_preflight_dump(const struct fw_iso_preflight *p,
+			   struct snd_info_buffer *buffer)
+{
+	snd_iprintf(buffer, "%-12s %8s %8s\n", "", "required", "free");
+	snd_iprintf(buffer, "%-12s %8u %8s\n", "IT contexts:", p->it_contexts, "-");
+	snd_iprintf(buffer, "%-12s %8u %8s\n", "IR contexts:", p->ir_contexts, "-");
+	snd_iprintf(buffer, "%-12s %8u %8u\n", "channels:",
+		    p->channels, p->free_channels);
+	snd_iprintf(buffer, "%-12s %8u %8u\n", "bandwidth:",
+		    p->bandwidth, p->free_bandwidth);
+	snd_iprintf(buffer, "fit: %s\n",
+		    (p->channels <= p->free_channels &&
+		     p->bandwidth <= p->free_bandwidth) ? "yes" : "no");
+}
+EXPORT_SYMBOL(fw_iso_preflight_dump);
+
+#define REGISTRY_MAX_CARDS	8
+
+struct registry_card {
+	struct fw_card *card;
+	unsigned int channels;
+	unsigned int bandwidth;
+};
+
+static void print_card_headroom(struct snd_info_buffer *buffer,
+				const struct registry_card *c)
+{
+	u32 bandwidth, channels_hi, channels_lo;
+	int node_id, generation, err;
+
+	snd_iprintf(buffer, "card %d: channels %u, bandwidth %u",
+		    c->card->index, c->channels, c->bandwidth);
+
+	node_id = find_irm_node(c->card, &generation);
+	if (node_id < 0) {
+		snd_iprintf(buffer, "\n");
+		return;
+	}
+
+	err = read_irm_register(c->card, node_id, generation,
+				CSR_BANDWIDTH_AVAILABLE, &bandwidth);
+	if (err >= 0)
+		err = read_irm_register(c->card, node_id, generation,
+					CSR_CHANNELS_AVAILABLE_HI,
+					&channels_hi);
+	if (err >= 0)
+		err = read_irm_register(c->card, node_id, generation,
+					CSR_CHANNELS_AVAILABLE_LO,
+					&channels_lo);
+	if (err < 0) {
+		snd_iprintf(buffer, "\n");
+		return;
+	}
+
+	/* The headroom is for any node on the bus, not only this host. */
+	snd_iprintf(buffer, ", headroom: channels %u, bandwidth %u\n",
+		    hweight32(channels_hi) + hweight32(channels_lo), bandwidth);
+}
+
+static void proc_read_registry(struct snd_info_entry *entry,
+			       struct snd_info_buffer *buffer)
+{
+	struct registry_card cards[REGISTRY_MAX_CARDS];
+	struct fw_iso_resources *r;
+	unsigned int count = 0;
+	int i;
+
+	snd_iprintf(buffer, "%-4s %-12s %-16s %7s %9s %8s\n",
+		    "card", "unit", "driver", "channel", "bandwidth",
+		    "overhead");
+
+	mutex_lock(&registry_mutex);
+	list_for_each_entry(r, &registry, list) {
+		struct fw_card *card = fw_parent_device(r->unit)->card;
+
+		snd_iprintf(buffer, "%-4d %-12s %-16s %7u %9u %8u\n",
+			    card->index, dev_name(&r->unit->device),
+			    dev_driver_string(&r->unit->device), r->channel,
+			    r->bandwidth, r->bandwidth_overhead);
+
+		for (i = 0; i < count; ++i) {
+			if (cards[i].card == card)
+				break;
+		}
+		if (i == count) {
+			if (count >= ARRAY_SIZE(cards))
+				continue;
+			cards[i].card = fw_card_get(card);
+			cards[i].channels = 0;
+			cards[i].bandwidth = 0;
+			++count;
+		}
+		++cards[i].channels;
+		cards[i].bandwidth += r->bandwidth + r->bandwidth_overhead;
+	}
+	mutex_unlock(&registry_mutex);
+
+	/* The transactions to IRM are done without the lock. */
+	for (i = 0; i < count; ++i) {
+		print_card_headroom(buffer, &cards[i]);
+		fw_card_put(cards[i].card);
+	}
+}
+
+int __init fw_iso_resources_module_init(void)
+{
+	struct snd_info_entry *entry;
+
+	entry = snd_info_create_module_entry(THIS_MODULE,
+					     "firewire-iso-resources", NULL);
+	if (!entry)
+		return 0;
+	snd_info_set_text_ops(entry, NULL, proc_read_registry);
+
+	if (snd_info_register(entry) < 0) {
+		snd_info_free_entry(entry);
+		return 0;
+	}
+	registry_entry = entry;
+
+	return 0;
+}
+
+void __exit fw_iso_resources_module_exit(void)
+{
+	snd_info_free_entry(registry_entry);
+}
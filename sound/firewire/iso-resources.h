@@ -2,6 +2,7 @@
 #ifndef SOUND_FIREWIRE_ISO_RESOURCES_H_INCLUDED
 #define SOUND_FIREWIRE_ISO_RESOURCES_H_INCLUDED
 
+#include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/types.h>
 
@@ -25,6 +26,7 @@ struct fw_iso_resources {
 	unsigned int bandwidth_overhead;
 	int generation; /* in which allocation is valid */
 	bool allocated;
+	struct list_head list; /* in the registry while allocated */
 };
 
 int fw_iso_resources_init(struct fw_iso_resources *r,
@@ -33,7 +35,47 @@ void fw_iso_resources_destroy(struct fw_iso_resources *r);
 
 int fw_iso_resources_allocate(struct fw_iso_resources *r,
 			      unsigned int max_payload_bytes, int speed);
+int fw_iso_resources_allocate_batch(struct fw_iso_resources *const *rs,
+				    const unsigned int *max_payload_bytes,
+				    unsigned int count, int speed);
 int fw_iso_resources_update(struct fw_iso_resources *r);
+int fw_iso_resources_resize(struct fw_iso_resources *r,
+			    unsigned int max_payload_bytes, int speed);
 void fw_iso_resources_free(struct fw_iso_resources *r);
 
+/**
+ * struct fw_iso_preflight - demand and supply of isochronous resources
+ * @it_contexts: the number of IT contexts required in the controller
+ * @ir_contexts: the number of IR contexts required in the controller
+ * @channels: the number of isochronous channels required
+ * @bandwidth: the bandwidth required, in bandwidth units with overhead
+ * @free_channels: the number of channels available in the IRM
+ * @free_bandwidth: the bandwidth available in the IRM
+ *
+ * The caller fills the demand by fw_iso_preflight_add() for each stream, then
+ * fw_iso_preflight_check() fills the supply. The free IT/IR contexts are not
+ * reported, since they can not be counted without reserving them.
+ */
+struct fw_iso_preflight {
+	unsigned int it_contexts;
+	unsigned int ir_contexts;
+	unsigned int channels;
+	unsigned int bandwidth;
+
+	unsigned int free_channels;
+	unsigned int free_bandwidth;
+};
+
+struct snd_info_buffer;
+
+void fw_iso_preflight_add(struct fw_iso_preflight *p, struct fw_unit *unit,
+			  int type, unsigned int max_payload_bytes, int speed);
+int fw_iso_preflight_check(struct fw_iso_preflight *p, struct fw_unit *unit);
+void fw_iso_preflight_dump(const struct fw_iso_preflight *p,
+			   struct snd_info_buffer *buffer);
+
+/* For module initialization of snd-firewire-lib. */
+int fw_iso_resources_module_init(void);
+void fw_iso_resources_module_exit(void);
+
 #endif
@@ -5,12 +5,20 @@
  * Copyright (c) Clemens Ladisch <clemens@ladisch.de>
  */
 
+#include <linux/completion.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/firewire.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/vmalloc.h>
+#include <sound/pcm.h>
 #include "lib.h"
+#include "fcp.h"
+#include "iso-resources.h"
+#include "amdtp-stream.h"
 
 /* TODO: remove when merging to upstream. */
 #include "../../backport.h"
@@ -70,6 +78,860 @@ int snd_fw_transaction(struct fw_unit *unit, int tcode,
 }
 EXPORT_SYMBOL(snd_fw_transaction);
 
+static void send_async_transaction(struct snd_fw_async_transaction *t);
+
+static void async_transaction_callback(struct fw_card *card, int rcode,
+				       void *data, size_t length,
+				       void *callback_data)
+{
+	struct snd_fw_async_transaction *t = callback_data;
+
+	if (rcode == RCODE_COMPLETE) {
+		/*
+		 * The same as fw_run_transaction(); the response of read
+		 * request has the data, and the response of lock request has
+		 * the old value. The response of write request has nothing.
+		 */
+		memcpy(t->buffer, data, min(length, t->length));
+		t->callback(t, 0);
+		return;
+	}
+
+	if (rcode == RCODE_GENERATION && (t->flags & FW_FIXED_GENERATION)) {
+		t->callback(t, -EAGAIN);
+		return;
+	}
+
+	if (rcode_is_permanent_error(rcode) || ++t->tries >= 3) {
+		if (!(t->flags & FW_QUIET))
+			dev_err_ratelimited(&t->unit->device,
+					    "transaction failed: %s\n",
+					    fw_rcode_string(rcode));
+		t->callback(t, -EIO);
+		return;
+	}
+
+	/* The callback runs in atomic context. */
+	schedule_delayed_work(&t->retry_work,
+			      msecs_to_jiffies(ERROR_RETRY_DELAY_MS));
+}
+
+static void retry_async_transaction(struct work_struct *work)
+{
+	struct snd_fw_async_transaction *t =
+		container_of(to_delayed_work(work),
+			     struct snd_fw_async_transaction, retry_work);
+
+	send_async_transaction(t);
+}
+
+static void send_async_transaction(struct snd_fw_async_transaction *t)
+{
+	struct fw_device *device = fw_parent_device(t->unit);
+	int generation;
+
+	if (!(t->flags & FW_FIXED_GENERATION)) {
+		generation = device->generation;
+		smp_rmb(); /* node_id vs. generation */
+	} else {
+		generation = t->flags & FW_GENERATION_MASK;
+	}
+
+	fw_send_request(device->card, &t->transaction, t->tcode,
+			device->node_id, generation, device->max_speed,
+			t->offset, t->buffer, t->length,
+			async_transaction_callback, t);
+}
+
+/**
+ * snd_fw_transaction_async - send a request and complete it by callback
+ * @t: the transaction, which should be kept till the callback is called
+ * @unit: the driver's unit on the target device
+ * @tcode: the transaction code
+ * @offset: the address in the target's address space
+ * @buffer: input/output data; must be DMA-able
+ * @length: length of @buffer
+ * @flags: the same as snd_fw_transaction()
+ * @callback: the function called with zero on success, or a negative error
+ *	      code
+ *
+ * The asynchronous variant of snd_fw_transaction() with the same semantics of
+ * generation and retries. The @callback is called just once, usually in
+ * atomic context.
+ */
+void snd_fw_transaction_async(struct snd_fw_async_transaction *t,
+			      struct fw_unit *unit, int tcode, u64 offset,
+			      void *buffer, size_t length, unsigned int flags,
+			      snd_fw_async_callback_t callback)
+{
+	t->unit = unit;
+	t->tcode = tcode;
+	t->offset = offset;
+	t->buffer = buffer;
+	t->length = length;
+	t->flags = flags;
+	t->tries = 0;
+	INIT_DELAYED_WORK(&t->retry_work, retry_async_transaction);
+	t->callback = callback;
+
+	send_async_transaction(t);
+}
+EXPORT_SYMBOL(snd_fw_transaction_async);
+
+struct batched_transaction {
+	struct snd_fw_async_transaction t;
+	struct snd_fw_request *request;
+	atomic_t *pending;
+	struct completion *done;
+};
+
+static void batched_transaction_callback(struct snd_fw_async_transaction *t,
+					 int err)
+{
+	struct batched_transaction *b =
+		container_of(t, struct batched_transaction, t);
+
+	b->request->result = err;
+	if (atomic_dec_and_test(b->pending))
+		complete(b->done);
+}
+
+/**
+ * snd_fw_transactions - send several requests and wait for their completion
+ * @unit: the driver's unit on the target device
+ * @requests: an array of the requests
+ * @count: the number of entries in @requests
+ * @flags: the same as snd_fw_transaction(), applied to all of the requests
+ *
+ * The requests are in flight at the same time, thus the round trips on the bus
+ * are overlapped. The result of each request is stored in the result member:
+ * zero on success, or a negative error code.
+ *
+ * Returns zero when the requests are processed, or a negative error code.
+ */
+int snd_fw_transactions(struct fw_unit *unit, struct snd_fw_request *requests,
+			unsigned int count, unsigned int flags)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct batched_transaction *bs;
+	atomic_t pending;
+	int i;
+
+	if (count == 0)
+		return 0;
+
+	bs = kcalloc(count, sizeof(*bs), GFP_KERNEL);
+	if (!bs)
+		return -ENOMEM;
+
+	atomic_set(&pending, count);
+
+	for (i = 0; i < count; ++i) {
+		struct snd_fw_request *r = requests + i;
+
+		bs[i].request = r;
+		bs[i].pending = &pending;
+		bs[i].done = &done;
+		snd_fw_transaction_async(&bs[i].t, unit, r->tcode, r->offset,
+					 r->buffer, r->length, flags,
+					 batched_transaction_callback);
+	}
+
+	wait_for_completion(&done);
+
+	kfree(bs);
+
+	return 0;
+}
+EXPORT_SYMBOL(snd_fw_transactions);
+
+/*
+ * The cache of the result of discovery, keyed by GUID and model ID of the
+ * unit, and firmware version given by the driver. It's kept till the module
+ * is unloaded, so that reconnection of the device needs no full discovery.
+ * It can be saved and restored by userspace through the binary attribute
+ * "discovery_cache" of the module, so that it survives reboot.
+ */
+struct discovery_cache_entry {
+	struct list_head list;
+	u64 guid;
+	u32 model;
+	u32 firmware_version;
+	size_t size;
+	u8 data[];
+};
+
+static DEFINE_MUTEX(discovery_cache_mutex);
+static LIST_HEAD(discovery_cache);
+
+static void compute_discovery_cache_key(struct fw_unit *unit, u64 *guid,
+					u32 *model)
+{
+	struct fw_device *device = fw_parent_device(unit);
+	struct fw_csr_iterator it;
+	int key, val;
+
+	*guid = ((u64)device->config_rom[3] << 32) | device->config_rom[4];
+
+	*model = 0;
+	fw_csr_iterator_init(&it, unit->directory);
+	while (fw_csr_iterator_next(&it, &key, &val)) {
+		if (key == CSR_MODEL) {
+			*model = val;
+			break;
+		}
+	}
+}
+
+static struct discovery_cache_entry *
+find_discovery_cache(u64 guid, u32 model, u32 firmware_version)
+{
+	struct discovery_cache_entry *entry;
+
+	list_for_each_entry(entry, &discovery_cache, list) {
+		if (entry->guid == guid && entry->model == model &&
+		    entry->firmware_version == firmware_version)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * snd_fw_discovery_cache_load - load the cached result of discovery
+ * @unit: the driver's unit on the target device
+ * @firmware_version: the version of firmware, to invalidate the cache
+ * @data: the buffer to copy the cached result into
+ * @size: the size of @data
+ *
+ * The caller should validate the loaded result against the device by a cheap
+ * query, and call snd_fw_discovery_cache_invalidate() when it is stale. The
+ * result may be restored by userspace, thus the caller should check the bounds
+ * of any length or offset in it as well.
+ *
+ * Returns zero on success, or -ENOENT when no result is cached for the unit.
+ */
+int snd_fw_discovery_cache_load(struct fw_unit *unit, u32 firmware_version,
+				void *data, size_t size)
+{
+	struct discovery_cache_entry *entry;
+	u64 guid;
+	u32 model;
+	int err = -ENOENT;
+
+	compute_discovery_cache_key(unit, &guid, &model);
+
+	mutex_lock(&discovery_cache_mutex);
+	entry = find_discovery_cache(guid, model, firmware_version);
+	if (entry && entry->size == size) {
+		memcpy(data, entry->data, size);
+		err = 0;
+	}
+	mutex_unlock(&discovery_cache_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(snd_fw_discovery_cache_load);
+
+/**
+ * snd_fw_discovery_cache_store - store the result of discovery into the cache
+ * @unit: the driver's unit on the target device
+ * @firmware_version: the version of firmware, to invalidate the cache
+ * @data: the result of discovery
+ * @size: the size of @data
+ *
+ * The former result for the unit is replaced.
+ *
+ * Returns zero on success, or a negative error code.
+ */
+int snd_fw_discovery_cache_store(struct fw_unit *unit, u32 firmware_version,
+				 const void *data, size_t size)
+{
+	struct discovery_cache_entry *entry, *old;
+	u64 guid;
+	u32 model;
+
+	compute_discovery_cache_key(unit, &guid, &model);
+
+	entry = kmalloc(struct_size(entry, data, size), GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+	entry->guid = guid;
+	entry->model = model;
+	entry->firmware_version = firmware_version;
+	entry->size = size;
+	memcpy(entry->data, data, size);
+
+	mutex_lock(&discovery_cache_mutex);
+	old = find_discovery_cache(guid, model, firmware_version);
+	if (old) {
+		list_del(&old->list);
+		kfree(old);
+	}
+	list_add_tail(&entry->list, &discovery_cache);
+	mutex_unlock(&discovery_cache_mutex);
+
+	return 0;
+}
+EXPORT_SYMBOL(snd_fw_discovery_cache_store);
+
+/**
+ * snd_fw_discovery_cache_invalidate - drop the cached result of discovery
+ * @unit: the driver's unit on the target device
+ *
+ * All of the results for the unit are dropped regardless of firmware version.
+ */
+void snd_fw_discovery_cache_invalidate(struct fw_unit *unit)
+{
+	struct discovery_cache_entry *entry, *next;
+	u64 guid;
+	u32 model;
+
+	compute_discovery_cache_key(unit, &guid, &model);
+
+	mutex_lock(&discovery_cache_mutex);
+	list_for_each_entry_safe(entry, next, &discovery_cache, list) {
+		if (entry->guid == guid && entry->model == model) {
+			list_del(&entry->list);
+			kfree(entry);
+		}
+	}
+	mutex_unlock(&discovery_cache_mutex);
+}
+EXPORT_SYMBOL(snd_fw_discovery_cache_invalidate);
+
+/*
+ * Each entry of the cache is exported as one record, in little endian. The
+ * data of record is opaque to userspace, and the version of format is bumped
+ * when the layout of data in any driver changes. One write(2) to the attribute
+ * should include whole records, up to PAGE_SIZE.
+ */
+#define DISCOVERY_CACHE_RECORD_MAGIC	0x43444653	/* "SFDC" */
+#define DISCOVERY_CACHE_RECORD_VERSION	1
+
+struct discovery_cache_record {
+	__le32 magic;
+	__le32 version;
+	__le32 length;	/* in bytes, including the header */
+	__le32 model;
+	__le32 firmware_version;
+	__le32 reserved;
+	__le64 guid;
+	u8 data[];
+} __packed;
+
+// Copy the part of source in the window of read operation.
+static void copy_window(char *buf, loff_t off, size_t count, loff_t *pos, const void *src,
+			size_t length)
+{
+	loff_t begin = max_t(loff_t, *pos, off);
+	loff_t end = min_t(loff_t, *pos + length, off + count);
+
+	if (begin < end)
+		memcpy(buf + (begin - off), src + (begin - *pos), end - begin);
+	*pos += length;
+}
+
+static ssize_t discovery_cache_read(struct file *file, struct kobject *kobj,
+				    struct bin_attribute *attr, char *buf, loff_t off,
+				    size_t count)
+{
+	struct discovery_cache_entry *entry;
+	loff_t pos = 0;
+
+	mutex_lock(&discovery_cache_mutex);
+	list_for_each_entry(entry, &discovery_cache, list) {
+		struct discovery_cache_record record = {
+			.magic = cpu_to_le32(DISCOVERY_CACHE_RECORD_MAGIC),
+			.version = cpu_to_le32(DISCOVERY_CACHE_RECORD_VERSION),
+			.length = cpu_to_le32(sizeof(record) + entry->size),
+			.model = cpu_to_le32(entry->model),
+			.firmware_version = cpu_to_le32(entry->firmware_version),
+			.guid = cpu_to_le64(entry->guid),
+		};
+
+		copy_window(buf, off, count, &pos, &record, sizeof(record));
+		copy_window(buf, off, count, &pos, entry->data, entry->size);
+	}
+	mutex_unlock(&discovery_cache_mutex);
+
+	if (pos <= off)
+		return 0;
+
+	return min_t(loff_t, pos - off, count);
+}
+
+static ssize_t discovery_cache_write(struct file *file, struct kobject *kobj,
+				     struct bin_attribute *attr, char *buf, loff_t off,
+				     size_t count)
+{
+	size_t pos = 0;
+
+	while (pos < count) {
+		const struct discovery_cache_record *record = (void *)(buf + pos);
+		struct discovery_cache_entry *entry, *old;
+		size_t length;
+
+		if (count - pos < sizeof(*record))
+			return -EINVAL;
+		if (le32_to_cpu(record->magic) != DISCOVERY_CACHE_RECORD_MAGIC ||
+		    le32_to_cpu(record->version) != DISCOVERY_CACHE_RECORD_VERSION)
+			return -EINVAL;
+
+		length = le32_to_cpu(record->length);
+		if (length <= sizeof(*record) || length > count - pos)
+			return -EINVAL;
+		length -= sizeof(*record);
+
+		entry = kmalloc(struct_size(entry, data, length), GFP_KERNEL);
+		if (!entry)
+			return -ENOMEM;
+		entry->guid = le64_to_cpu(record->guid);
+		entry->model = le32_to_cpu(record->model);
+		entry->firmware_version = le32_to_cpu(record->firmware_version);
+		entry->size = length;
+		memcpy(entry->data, record->data, length);
+
+		mutex_lock(&discovery_cache_mutex);
+		old = find_discovery_cache(entry->guid, entry->model, entry->firmware_version);
+		if (old) {
+			list_del(&old->list);
+			kfree(old);
+		}
+		list_add_tail(&entry->list, &discovery_cache);
+		mutex_unlock(&discovery_cache_mutex);
+
+		pos += sizeof(*record) + length;
+	}
+
+	return count;
+}
+
+static BIN_ATTR_ADMIN_RW(discovery_cache, 0);
+
+/**
+ * snd_fw_event_ring_init - allocate a ring of events to be mapped by userspace
+ * @ring: the ring to initialize
+ * @size: the size of data area in bytes, multiple of PAGE_SIZE
+ *
+ * The control structure occupies the first page, and the data area follows.
+ */
+int snd_fw_event_ring_init(struct snd_fw_event_ring *ring, unsigned int size)
+{
+	if (size == 0 || size % PAGE_SIZE)
+		return -EINVAL;
+
+	ring->ctrl = vmalloc_user(PAGE_SIZE + size);
+	if (!ring->ctrl)
+		return -ENOMEM;
+	ring->data = (u8 *)ring->ctrl + PAGE_SIZE;
+	ring->size = size;
+	ring->head = 0;
+	ring->mapped = false;
+
+	ring->ctrl->size = size;
+	ring->ctrl->offset = PAGE_SIZE;
+
+	return 0;
+}
+EXPORT_SYMBOL(snd_fw_event_ring_init);
+
+/**
+ * snd_fw_event_ring_destroy - release the ring of events
+ * @ring: the ring to release
+ */
+void snd_fw_event_ring_destroy(struct snd_fw_event_ring *ring)
+{
+	vfree(ring->ctrl);
+	ring->ctrl = NULL;
+	ring->data = NULL;
+}
+EXPORT_SYMBOL(snd_fw_event_ring_destroy);
+
+/**
+ * snd_fw_event_ring_mmap - map the ring of events to userspace
+ * @ring: the ring to map
+ * @area: the virtual memory area given to mmap operation of hwdep device
+ *
+ * After the call, the producer delivers events through the ring instead of
+ * read(2). The hwdep device is expected to be exclusive.
+ */
+int snd_fw_event_ring_mmap(struct snd_fw_event_ring *ring,
+			   struct vm_area_struct *area)
+{
+	int err;
+
+	if (!ring->ctrl)
+		return -ENXIO;
+	if (area->vm_pgoff != 0 ||
+	    area->vm_end - area->vm_start > PAGE_SIZE + ring->size)
+		return -EINVAL;
+	if (ring->mapped)
+		return -EBUSY;
+
+	/* The producer doesn't touch the ring till it is published as mapped. */
+	ring->head = 0;
+	ring->ctrl->head = 0;
+	ring->ctrl->tail = 0;
+	ring->ctrl->dropped = 0;
+
+	err = remap_vmalloc_range(area, ring->ctrl, 0);
+	if (err < 0)
+		return err;
+
+	smp_store_release(&ring->mapped, true);
+
+	return 0;
+}
+EXPORT_SYMBOL(snd_fw_event_ring_mmap);
+
+/**
+ * snd_fw_event_ring_unmap - stop delivering events through the ring
+ * @ring: the ring
+ *
+ * This is expected to be called in release operation of hwdep device, since the
+ * mapping holds the reference to the file.
+ */
+void snd_fw_event_ring_unmap(struct snd_fw_event_ring *ring)
+{
+	WRITE_ONCE(ring->mapped, false);
+}
+EXPORT_SYMBOL(snd_fw_event_ring_unmap);
+
+/**
+ * snd_fw_event_ring_reserve - reserve space for one event in the ring
+ * @ring: the ring
+ * @length: the maximum length of the event in bytes
+ *
+ * Returns the pointer to contiguous space for the event, or NULL when the ring
+ * has no space for it. The space is not visible to userspace till it is
+ * committed by snd_fw_event_ring_commit() and snd_fw_event_ring_publish() is
+ * called. The caller should serialize calls for the same ring.
+ */
+void *snd_fw_event_ring_reserve(struct snd_fw_event_ring *ring,
+				unsigned int length)
+{
+	unsigned int head = ring->head;
+	unsigned int tail;
+
+	length = sizeof(u32) + ALIGN(length, sizeof(u32));
+
+	/* The tail comes from userspace, thus should be validated. */
+	tail = smp_load_acquire(&ring->ctrl->tail);
+	if (tail >= ring->size || tail % sizeof(u32))
+		goto dropped;
+
+	/* One quadlet is always left so that the full ring is distinguishable. */
+	if (head >= tail) {
+		if (head + length < ring->size ||
+		    (head + length == ring->size && tail > 0))
+			return ring->data + head + sizeof(u32);
+		if (length >= tail)
+			goto dropped;
+
+		/* Put the marker of wrap around, then start at the beginning. */
+		*(u32 *)(ring->data + head) = 0;
+		ring->head = 0;
+		return ring->data + sizeof(u32);
+	} else if (head + length < tail) {
+		return ring->data + head + sizeof(u32);
+	}
+dropped:
+	WRITE_ONCE(ring->ctrl->dropped, READ_ONCE(ring->ctrl->dropped) + 1);
+	return NULL;
+}
+EXPORT_SYMBOL(snd_fw_event_ring_reserve);
+
+/**
+ * snd_fw_event_ring_commit - finish writing the reserved event
+ * @ring: the ring
+ * @length: the length of the written event in bytes, not more than reserved
+ */
+void snd_fw_event_ring_commit(struct snd_fw_event_ring *ring,
+			      unsigned int length)
+{
+	unsigned int head = ring->head;
+
+	length = sizeof(u32) + ALIGN(length, sizeof(u32));
+	*(u32 *)(ring->data + head) = length;
+
+	head += length;
+	if (head >= ring->size)
+		head = 0;
+	ring->head = head;
+}
+EXPORT_SYMBOL(snd_fw_event_ring_commit);
+
+/**
+ * snd_fw_event_ring_publish - make committed events visible to userspace
+ * @ring: the ring
+ *
+ * Returns true if any event is newly published, thus waiters should be woken up.
+ */
+bool snd_fw_event_ring_publish(struct snd_fw_event_ring *ring)
+{
+	if (READ_ONCE(ring->ctrl->head) == ring->head)
+		return false;
+
+	smp_store_release(&ring->ctrl->head, ring->head);
+	return true;
+}
+EXPORT_SYMBOL(snd_fw_event_ring_publish);
+
+/**
+ * snd_fw_event_ring_has_event - check whether userspace has events to consume
+ * @ring: the ring
+ */
+bool snd_fw_event_ring_has_event(struct snd_fw_event_ring *ring)
+{
+	return READ_ONCE(ring->ctrl->head) != READ_ONCE(ring->ctrl->tail);
+}
+EXPORT_SYMBOL(snd_fw_event_ring_has_event);
+
+static void submit_async_midi_port(struct snd_fw_async_midi_port *port);
+
+static void async_midi_port_callback(struct fw_card *card, int rcode,
+				     void *data, size_t length,
+				     void *callback_data)
+{
+	struct snd_fw_async_midi_port *port = callback_data;
+	struct snd_rawmidi_substream *substream;
+	unsigned long flags;
+
+	spin_lock_irqsave(&port->lock, flags);
+
+	/* The port can be closed during the transaction. */
+	substream = port->substream;
+	if (substream) {
+		if (rcode == RCODE_COMPLETE)
+			snd_rawmidi_transmit_ack(substream,
+						 port->consume_bytes);
+		else if (!rcode_is_permanent_error(rcode))
+			/* To start next transaction immediately for recovery. */
+			port->next_ktime = 0;
+		else
+			/* Don't continue processing. */
+			port->error = true;
+	}
+	port->idling = true;
+
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	/* Continue without scheduling any work. */
+	submit_async_midi_port(port);
+}
+
+static enum hrtimer_restart async_midi_port_timer(struct hrtimer *timer)
+{
+	struct snd_fw_async_midi_port *port =
+		container_of(timer, struct snd_fw_async_midi_port, timer);
+
+	submit_async_midi_port(port);
+
+	return HRTIMER_NORESTART;
+}
+
+static void submit_async_midi_port(struct snd_fw_async_midi_port *port)
+{
+	struct fw_device *device = port->parent;
+	struct snd_rawmidi_substream *substream;
+	unsigned long flags;
+	ktime_t now;
+	int generation;
+	int tcode;
+	int len;
+
+	spin_lock_irqsave(&port->lock, flags);
+
+	/* Under transacting or error state. */
+	substream = port->substream;
+	if (!port->idling || port->error || !substream ||
+	    snd_rawmidi_transmit_empty(substream))
+		goto end;
+
+	/* Keep the rate of MIDI DIN port, resumed by the timer. */
+	now = ktime_get();
+	if (ktime_after(port->next_ktime, now)) {
+		if (!hrtimer_active(&port->timer))
+			hrtimer_start(&port->timer, port->next_ktime,
+				      HRTIMER_MODE_ABS_SOFT);
+		goto end;
+	}
+
+	/*
+	 * The callee must use snd_rawmidi_transmit_peek(). Later,
+	 * snd_rawmidi_transmit_ack() is called. When it needs more bytes, next
+	 * trigger of the substream starts it again.
+	 */
+	len = port->fill(port, substream, port->buf, &port->consume_bytes);
+	if (len <= 0) {
+		if (len < 0)
+			port->error = true;
+		goto end;
+	}
+
+	/* Set interval to next transaction. */
+	port->next_ktime = ktime_add_ns(now,
+			port->consume_bytes * 8 * (NSEC_PER_SEC / 31250));
+	port->idling = false;
+
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	if (len == 4)
+		tcode = TCODE_WRITE_QUADLET_REQUEST;
+	else
+		tcode = TCODE_WRITE_BLOCK_REQUEST;
+
+	generation = device->generation;
+	smp_rmb(); /* node_id vs. generation */
+	fw_send_request(device->card, &port->transaction, tcode,
+			device->node_id, generation, device->max_speed,
+			port->offset, port->buf, len,
+			async_midi_port_callback, port);
+	return;
+end:
+	spin_unlock_irqrestore(&port->lock, flags);
+}
+
+/**
+ * snd_fw_async_midi_port_init - initialize the port to transmit MIDI messages
+ * @port: the port to initialize
+ * @unit: the driver's unit on the target device
+ * @offset: the address in the target's address space to receive messages
+ * @fill: the callback to fill the buffer with messages
+ *
+ * The port transmits messages by asynchronous transaction at the rate of MIDI
+ * DIN port. The transaction is submitted directly from the trigger of rawmidi
+ * substream and the completion of previous transaction, or from the timer
+ * while waiting for the rate. This should be called once before use.
+ */
+void snd_fw_async_midi_port_init(struct snd_fw_async_midi_port *port,
+				 struct fw_unit *unit, u64 offset,
+				 snd_fw_async_midi_port_fill_t fill)
+{
+	port->parent = fw_parent_device(unit);
+	port->offset = offset;
+	port->fill = fill;
+	spin_lock_init(&port->lock);
+	hrtimer_init(&port->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+	port->timer.function = async_midi_port_timer;
+	port->substream = NULL;
+	port->idling = true;
+	port->error = false;
+	port->next_ktime = 0;
+}
+EXPORT_SYMBOL(snd_fw_async_midi_port_init);
+
+/**
+ * snd_fw_async_midi_port_run - start transmission of MIDI messages
+ * @port: the port
+ * @substream: the rawmidi substream with messages to transmit
+ *
+ * This is expected to be called in the trigger operation of rawmidi substream.
+ */
+void snd_fw_async_midi_port_run(struct snd_fw_async_midi_port *port,
+				struct snd_rawmidi_substream *substream)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&port->lock, flags);
+	port->substream = substream;
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	submit_async_midi_port(port);
+}
+EXPORT_SYMBOL(snd_fw_async_midi_port_run);
+
+/**
+ * snd_fw_async_midi_port_finish - stop transmission of MIDI messages
+ * @port: the port
+ *
+ * The transaction in flight is completed without acknowledgement to the
+ * substream.
+ */
+void snd_fw_async_midi_port_finish(struct snd_fw_async_midi_port *port)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&port->lock, flags);
+	port->substream = NULL;
+	port->error = false;
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	hrtimer_cancel(&port->timer);
+}
+EXPORT_SYMBOL(snd_fw_async_midi_port_finish);
+
+static bool contiguous_pcm_buffer;
+module_param(contiguous_pcm_buffer, bool, 0444);
+MODULE_PARM_DESC(contiguous_pcm_buffer,
+		 "Allocate PCM buffers from physically contiguous pages for the PCM devices added later (default: false)");
+
+/**
+ * snd_fw_pcm_set_managed_buffer_all - set up managed buffers for all PCM substreams
+ * @pcm: the PCM device
+ *
+ * The buffers are allocated from vmalloc area by default. When the module parameter
+ * contiguous_pcm_buffer is enabled, they are allocated from physically contiguous pages, so that
+ * the loops of packet processing in software IRQ context walk less pages for the PCM frames. The
+ * allocation of large buffer can fail when the memory is fragmented.
+ */
+void snd_fw_pcm_set_managed_buffer_all(struct snd_pcm *pcm)
+{
+	int type = SNDRV_DMA_TYPE_VMALLOC;
+
+	if (READ_ONCE(contiguous_pcm_buffer))
+		type = SNDRV_DMA_TYPE_CONTINUOUS;
+
+	snd_pcm_set_managed_buffer_all(pcm, type, NULL, 0, 0);
+}
+EXPORT_SYMBOL(snd_fw_pcm_set_managed_buffer_all);
+
+static int __init snd_firewire_lib_init(void)
+{
+	int err;
+
+	amdtp_stream_build_ideal_seqs();
+
+	err = fcp_module_init();
+	if (err < 0)
+		return err;
+
+	err = fw_iso_resources_module_init();
+	if (err < 0) {
+		fcp_module_exit();
+		return err;
+	}
+
+	snd_fw_event_mux_module_init();
+
+#ifdef MODULE
+	// The failure just loses the chance to restore the cache.
+	if (sysfs_create_bin_file(&THIS_MODULE->mkobj.kobj, &bin_attr_discovery_cache) < 0)
+		pr_warn("snd-firewire-lib: failed to add the attribute of discovery cache\n");
+#endif
+
+	return 0;
+}
+
+static void __exit snd_firewire_lib_exit(void)
+{
+	struct discovery_cache_entry *entry, *next;
+
+#ifdef MODULE
+	sysfs_remove_bin_file(&THIS_MODULE->mkobj.kobj, &bin_attr_discovery_cache);
+#endif
+	snd_fw_event_mux_module_exit();
+	fw_iso_resources_module_exit();
+	fcp_module_exit();
+
+	list_for_each_entry_safe(entry, next, &discovery_cache, list)
+		kfree(entry);
+}
+
+module_init(snd_firewire_lib_init);
+module_exit(snd_firewire_lib_exit);
+
 MODULE_DESCRIPTION("FireWire audio helper functions");
 MODULE_AUTHOR("Clemens Ladisch <clemens@ladisch.de>");
 MODULE_LICENSE("GPL v2");
@@ -2,12 +2,17 @@
 #ifndef SOUND_FIREWIRE_LIB_H_INCLUDED
 #define SOUND_FIREWIRE_LIB_H_INCLUDED
 
+#include <linux/firewire.h>
 #include <linux/firewire-constants.h>
+#include <linux/hrtimer.h>
 #include <linux/types.h>
 #include <linux/sched.h>
+#include <linux/workqueue.h>
 #include <sound/rawmidi.h>
+#include <sound/firewire.h>
 
 struct fw_unit;
+struct vm_area_struct;
 
 #define FW_GENERATION_MASK	0x00ff
 #define FW_FIXED_GENERATION	0x0100
@@ -17,7 +22,144 @@ int snd_fw_transaction(struct fw_unit *unit, int tcode,
 		       u64 offset, void *buffer, size_t length,
 		       unsigned int flags);
 
+struct snd_fw_async_transaction;
+typedef void (*snd_fw_async_callback_t)(struct snd_fw_async_transaction *t,
+					int err);
+
+struct snd_fw_async_transaction {
+	/* private: */
+	struct fw_transaction transaction;
+	struct fw_unit *unit;
+	int tcode;
+	u64 offset;
+	void *buffer;
+	size_t length;
+	unsigned int flags;
+	unsigned int tries;
+	struct delayed_work retry_work;
+	snd_fw_async_callback_t callback;
+};
+
+void snd_fw_transaction_async(struct snd_fw_async_transaction *t,
+			      struct fw_unit *unit, int tcode, u64 offset,
+			      void *buffer, size_t length, unsigned int flags,
+			      snd_fw_async_callback_t callback);
+
+/**
+ * struct snd_fw_request - a request for snd_fw_transactions()
+ * @tcode: the transaction code
+ * @offset: the address in the target's address space
+ * @buffer: input/output data; must be DMA-able
+ * @length: length of @buffer
+ * @result: zero on success, or a negative error code
+ */
+struct snd_fw_request {
+	int tcode;
+	u64 offset;
+	void *buffer;
+	size_t length;
+	int result;
+};
+
+int snd_fw_transactions(struct fw_unit *unit, struct snd_fw_request *requests,
+			unsigned int count, unsigned int flags);
+
+int snd_fw_discovery_cache_load(struct fw_unit *unit, u32 firmware_version,
+				void *data, size_t size);
+int snd_fw_discovery_cache_store(struct fw_unit *unit, u32 firmware_version,
+				 const void *data, size_t size);
+void snd_fw_discovery_cache_invalidate(struct fw_unit *unit);
+
+struct snd_pcm;
+void snd_fw_pcm_set_managed_buffer_all(struct snd_pcm *pcm);
+
+#define SND_FW_EVENT_RING_SIZE	(16 * PAGE_SIZE)
+
+struct snd_fw_event_ring {
+	/* private: */
+	struct snd_firewire_event_ring *ctrl;
+	u8 *data;
+	unsigned int size;
+	unsigned int head;
+	bool mapped;
+};
+
+int snd_fw_event_ring_init(struct snd_fw_event_ring *ring, unsigned int size);
+void snd_fw_event_ring_destroy(struct snd_fw_event_ring *ring);
+int snd_fw_event_ring_mmap(struct snd_fw_event_ring *ring,
+			   struct vm_area_struct *area);
+void snd_fw_event_ring_unmap(struct snd_fw_event_ring *ring);
+void *snd_fw_event_ring_reserve(struct snd_fw_event_ring *ring,
+				unsigned int length);
+void snd_fw_event_ring_commit(struct snd_fw_event_ring *ring,
+			      unsigned int length);
+bool snd_fw_event_ring_publish(struct snd_fw_event_ring *ring);
+bool snd_fw_event_ring_has_event(struct snd_fw_event_ring *ring);
+
+/* returns true if events should be delivered through the ring */
+static inline bool snd_fw_event_ring_is_mapped(struct snd_fw_event_ring *ring)
+{
+	return smp_load_acquire(&ring->mapped);
+}
+
+/* The maximum length of event posted to the multiplexer of all cards. */
+#define SND_FW_EVENT_MUX_MAX_LENGTH	1024
+
+struct snd_card;
+bool snd_fw_event_mux_is_open(void);
+void snd_fw_event_mux_post(struct snd_card *card, unsigned int type, const void *data,
+			   unsigned int length);
+void snd_fw_event_mux_post_lock_status(struct snd_card *card, bool locked);
+void snd_fw_event_mux_module_init(void);
+void snd_fw_event_mux_module_exit(void);
+
+#define SND_FW_ASYNC_MIDI_PORT_MAX_BYTES	36
+
+struct snd_fw_async_midi_port;
+
+/*
+ * The callback to fill the buffer with MIDI messages peeked by
+ * snd_rawmidi_transmit_peek(). It returns the length of buffer in bytes which
+ * is multiple of 4, 0 to wait for more bytes, or a negative error code. The
+ * number of bytes to be acknowledged at completion is set to @consumed.
+ */
+typedef int (*snd_fw_async_midi_port_fill_t)(struct snd_fw_async_midi_port *port,
+					      struct snd_rawmidi_substream *substream,
+					      u8 *buf, unsigned int *consumed);
+
+struct snd_fw_async_midi_port {
+	/* private: */
+	struct fw_device *parent;
+	u64 offset;
+	snd_fw_async_midi_port_fill_t fill;
+	spinlock_t lock;
+	struct hrtimer timer;
+	struct fw_transaction transaction;
+	struct snd_rawmidi_substream *substream;
+	bool idling;
+	bool error;
+	ktime_t next_ktime;
+	unsigned int consume_bytes;
+	u8 buf[SND_FW_ASYNC_MIDI_PORT_MAX_BYTES] __aligned(4);
+};
+
+void snd_fw_async_midi_port_init(struct snd_fw_async_midi_port *port,
+				 struct fw_unit *unit, u64 offset,
+				 snd_fw_async_midi_port_fill_t fill);
+void snd_fw_async_midi_port_run(struct snd_fw_async_midi_port *port,
+				struct snd_rawmidi_substream *substream);
+void snd_fw_async_midi_port_finish(struct snd_fw_async_midi_port *port);
+
 /* returns true if retrying the transaction would not make sense */
+/*
+ * The NUMA node of the 1394 OHCI controller, on which the memory accessed by the handler of
+ * isochronous context in software IRQ is allocated.
+ */
+static inline int snd_fw_unit_node(struct fw_unit *unit)
+{
+	return dev_to_node(fw_parent_device(unit)->card->device);
+}
+
 static inline bool rcode_is_permanent_error(int rcode)
 {
 	return rcode == RCODE_TYPE_ERROR || rcode == RCODE_ADDRESS_ERROR;
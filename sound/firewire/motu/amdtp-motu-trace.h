@@ -17,6 +17,12 @@ static void copy_sph(u32 *frame, __be32 *buffer, unsigned int data_blocks,
 		     unsigned int data_block_quadlets);
 static void copy_message(u64 *frames, __be32 *buffer, unsigned int data_blocks,
 			 unsigned int data_block_quadlets);
+static void copy_packets_sph(u32 *frames, const struct pkt_desc *descs, unsigned int packets,
+			     unsigned int data_block_quadlets);
+static void copy_packets_message(u64 *frames, const struct pkt_desc *descs, unsigned int packets,
+				 unsigned int data_block_quadlets);
+static void copy_packets_data_blocks(u8 *counts, const struct pkt_desc *descs,
+				     unsigned int packets);
 
 TRACE_EVENT(data_block_sph,
 	TP_PROTO(struct amdtp_stream *s, unsigned int data_blocks, __be32 *buffer),
@@ -76,6 +82,86 @@ TRACE_EVENT(data_block_message,
 	)
 );
 
+// The events for the batch of packets. The number of data blocks in each packet is followed by
+// the values for all of data blocks in the packets.
+TRACE_EVENT(data_block_sph_batch,
+	TP_PROTO(struct amdtp_stream *s, const struct pkt_desc *descs, unsigned int packets,
+		 unsigned int data_blocks),
+	TP_ARGS(s, descs, packets, data_blocks),
+	TP_STRUCT__entry(
+		__field(int, src)
+		__field(int, dst)
+		__field(unsigned int, cycle)
+		__field(unsigned int, packets)
+		__field(unsigned int, data_blocks)
+		__dynamic_array(u8, counts, packets)
+		__dynamic_array(u32, tstamps, data_blocks)
+	),
+	TP_fast_assign(
+		if (s->direction == AMDTP_IN_STREAM) {
+			__entry->src = fw_parent_device(s->unit)->node_id;
+			__entry->dst = fw_parent_device(s->unit)->card->node_id;
+		} else {
+			__entry->src = fw_parent_device(s->unit)->card->node_id;
+			__entry->dst = fw_parent_device(s->unit)->node_id;
+		}
+		__entry->cycle = descs->cycle;
+		__entry->packets = packets;
+		__entry->data_blocks = data_blocks;
+		copy_packets_data_blocks(__get_dynamic_array(counts), descs, packets);
+		copy_packets_sph(__get_dynamic_array(tstamps), descs, packets,
+				 s->data_block_quadlets);
+	),
+	TP_printk(
+		"%04x %04x %u %u %s %s",
+		__entry->src,
+		__entry->dst,
+		__entry->cycle,
+		__entry->packets,
+		__print_array(__get_dynamic_array(counts), __entry->packets, 1),
+		__print_array(__get_dynamic_array(tstamps), __entry->data_blocks, 4)
+	)
+);
+
+TRACE_EVENT(data_block_message_batch,
+	TP_PROTO(struct amdtp_stream *s, const struct pkt_desc *descs, unsigned int packets,
+		 unsigned int data_blocks),
+	TP_ARGS(s, descs, packets, data_blocks),
+	TP_STRUCT__entry(
+		__field(int, src)
+		__field(int, dst)
+		__field(unsigned int, cycle)
+		__field(unsigned int, packets)
+		__field(unsigned int, data_blocks)
+		__dynamic_array(u8, counts, packets)
+		__dynamic_array(u64, messages, data_blocks)
+	),
+	TP_fast_assign(
+		if (s->direction == AMDTP_IN_STREAM) {
+			__entry->src = fw_parent_device(s->unit)->node_id;
+			__entry->dst = fw_parent_device(s->unit)->card->node_id;
+		} else {
+			__entry->src = fw_parent_device(s->unit)->card->node_id;
+			__entry->dst = fw_parent_device(s->unit)->node_id;
+		}
+		__entry->cycle = descs->cycle;
+		__entry->packets = packets;
+		__entry->data_blocks = data_blocks;
+		copy_packets_data_blocks(__get_dynamic_array(counts), descs, packets);
+		copy_packets_message(__get_dynamic_array(messages), descs, packets,
+				     s->data_block_quadlets);
+	),
+	TP_printk(
+		"%04x %04x %u %u %s %s",
+		__entry->src,
+		__entry->dst,
+		__entry->cycle,
+		__entry->packets,
+		__print_array(__get_dynamic_array(counts), __entry->packets, 1),
+		__print_array(__get_dynamic_array(messages), __entry->data_blocks, 8)
+	)
+);
+
 #endif
 
 #undef TRACE_INCLUDE_PATH
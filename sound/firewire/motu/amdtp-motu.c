@@ -8,6 +8,7 @@
 #include <linux/slab.h>
 #include <sound/pcm.h>
 #include "motu.h"
+#include "../amdtp-pcm.h"
 
 #define CREATE_TRACE_POINTS
 #include "amdtp-motu-trace.h"
@@ -18,7 +19,6 @@
 
 #define TICKS_PER_CYCLE		3072
 #define CYCLES_PER_SECOND	8000
-#define TICKS_PER_SECOND	(TICKS_PER_CYCLE * CYCLES_PER_SECOND)
 
 #define CIP_SPH_CYCLE_SHIFT	12
 #define CIP_SPH_CYCLE_MASK	0x01fff000
@@ -42,6 +42,9 @@ struct amdtp_motu {
 	int midi_db_count;
 	unsigned int midi_db_interval;
 
+	// The bytes in the packets processed in one callback.
+	struct amdtp_midi_batch midi_batch;
+
 	struct amdtp_motu_cache *cache;
 };
 
@@ -95,35 +98,9 @@ static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			 unsigned int pcm_frames)
 {
 	struct amdtp_motu *p = s->protocol;
-	unsigned int channels = p->pcm_chunks;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	u8 *byte;
-	u32 *dst;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
-
-	dst = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
 
-	for (i = 0; i < data_blocks; ++i) {
-		byte = (u8 *)buffer + p->pcm_byte_offset;
-
-		for (c = 0; c < channels; ++c) {
-			*dst = (byte[0] << 24) |
-			       (byte[1] << 16) |
-			       (byte[2] << 8);
-			byte += 3;
-			dst++;
-		}
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			dst = (void *)runtime->dma_area;
-	}
+	amdtp_pcm_read_packed24(s, pcm, (u8 *)buffer + p->pcm_byte_offset, data_blocks,
+				pcm_frames, p->pcm_chunks);
 }
 
 static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
@@ -131,59 +108,18 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			  unsigned int pcm_frames)
 {
 	struct amdtp_motu *p = s->protocol;
-	unsigned int channels = p->pcm_chunks;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	u8 *byte;
-	const u32 *src;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
-
-	src = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
 
-	for (i = 0; i < data_blocks; ++i) {
-		byte = (u8 *)buffer + p->pcm_byte_offset;
-
-		for (c = 0; c < channels; ++c) {
-			byte[0] = (*src >> 24) & 0xff;
-			byte[1] = (*src >> 16) & 0xff;
-			byte[2] = (*src >>  8) & 0xff;
-			byte += 3;
-			src++;
-		}
-
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			src = (void *)runtime->dma_area;
-	}
+	amdtp_pcm_write_packed24(s, pcm, (u8 *)buffer + p->pcm_byte_offset, data_blocks,
+				 pcm_frames, p->pcm_chunks);
 }
 
 static void write_pcm_silence(struct amdtp_stream *s, __be32 *buffer,
 			      unsigned int data_blocks)
 {
 	struct amdtp_motu *p = s->protocol;
-	unsigned int channels, i, c;
-	u8 *byte;
-
-	channels = p->pcm_chunks;
-
-	for (i = 0; i < data_blocks; ++i) {
-		byte = (u8 *)buffer + p->pcm_byte_offset;
 
-		for (c = 0; c < channels; ++c) {
-			byte[0] = 0;
-			byte[1] = 0;
-			byte[2] = 0;
-			byte += 3;
-		}
-
-		buffer += s->data_block_quadlets;
-	}
+	amdtp_pcm_write_silence_packed24(s, (u8 *)buffer + p->pcm_byte_offset, data_blocks,
+					 p->pcm_chunks);
 }
 
 int amdtp_motu_add_pcm_hw_constraints(struct amdtp_stream *s,
@@ -204,8 +140,10 @@ void amdtp_motu_midi_trigger(struct amdtp_stream *s, unsigned int port,
 {
 	struct amdtp_motu *p = s->protocol;
 
-	if (port < p->midi_ports)
+	if (port < p->midi_ports) {
 		WRITE_ONCE(p->midi, midi);
+		amdtp_stream_midi_trigger(s, port, midi != NULL);
+	}
 }
 
 static void write_midi_messages(struct amdtp_stream *s, __be32 *buffer,
@@ -234,20 +172,22 @@ static void write_midi_messages(struct amdtp_stream *s, __be32 *buffer,
 	}
 }
 
-static void read_midi_messages(struct amdtp_stream *s, __be32 *buffer,
-			       unsigned int data_blocks)
+static void read_midi_messages(struct amdtp_stream *s, const struct pkt_desc *desc)
 {
 	struct amdtp_motu *p = s->protocol;
+	__be32 *buffer = desc->ctx_payload;
 	struct snd_rawmidi_substream *midi;
 	u8 *b;
 	int i;
 
-	for (i = 0; i < data_blocks; i++) {
+	for (i = 0; i < desc->data_blocks; i++) {
 		b = (u8 *)buffer;
 		midi = READ_ONCE(p->midi);
 
-		if (midi && (b[p->midi_flag_offset] & 0x01))
-			snd_rawmidi_receive(midi, b + p->midi_byte_offset, 1);
+		if (midi && (b[p->midi_flag_offset] & 0x01)) {
+			amdtp_midi_batch_push(&p->midi_batch, midi, b + p->midi_byte_offset, 1);
+			amdtp_stream_queue_midi_event(s, desc, i, 0, b + p->midi_byte_offset, 1);
+		}
 
 		buffer += s->data_block_quadlets;
 	}
@@ -284,6 +224,43 @@ static void __maybe_unused copy_message(u64 *frames, __be32 *buffer,
 	}
 }
 
+/* For tracepoints. */
+static void __maybe_unused copy_packets_sph(u32 *frames, const struct pkt_desc *descs,
+					    unsigned int packets,
+					    unsigned int data_block_quadlets)
+{
+	unsigned int i;
+
+	for (i = 0; i < packets; ++i) {
+		copy_sph(frames, descs[i].ctx_payload, descs[i].data_blocks, data_block_quadlets);
+		frames += descs[i].data_blocks;
+	}
+}
+
+/* For tracepoints. */
+static void __maybe_unused copy_packets_message(u64 *frames, const struct pkt_desc *descs,
+						unsigned int packets,
+						unsigned int data_block_quadlets)
+{
+	unsigned int i;
+
+	for (i = 0; i < packets; ++i) {
+		copy_message(frames, descs[i].ctx_payload, descs[i].data_blocks,
+			     data_block_quadlets);
+		frames += descs[i].data_blocks;
+	}
+}
+
+/* For tracepoints. */
+static void __maybe_unused copy_packets_data_blocks(u8 *counts, const struct pkt_desc *descs,
+						    unsigned int packets)
+{
+	unsigned int i;
+
+	for (i = 0; i < packets; ++i)
+		counts[i] = descs[i].data_blocks;
+}
+
 static void probe_tracepoints_events(struct amdtp_stream *s,
 				     const struct pkt_desc *descs,
 				     unsigned int packets)
@@ -300,32 +277,68 @@ static void probe_tracepoints_events(struct amdtp_stream *s,
 	}
 }
 
+// The event in ring buffer of tracing is limited within a page, thus the packets processed in the
+// callback are split into the batches of data blocks up to the number.
+#define TRACE_BATCH_MAX_DATA_BLOCKS	128
+
+static void probe_tracepoints_batch_events(struct amdtp_stream *s,
+					   const struct pkt_desc *descs,
+					   unsigned int packets)
+{
+	unsigned int first = 0;
+	unsigned int data_blocks = 0;
+	unsigned int i;
+
+	for (i = 0; i <= packets; ++i) {
+		if (i == packets ||
+		    data_blocks + descs[i].data_blocks > TRACE_BATCH_MAX_DATA_BLOCKS) {
+			if (i > first) {
+				trace_data_block_sph_batch(s, descs + first, i - first,
+							   data_blocks);
+				trace_data_block_message_batch(s, descs + first, i - first,
+							       data_blocks);
+			}
+			first = i;
+			data_blocks = 0;
+		}
+
+		if (i < packets)
+			data_blocks += descs[i].data_blocks;
+	}
+}
+
+// The offset of event is cached in the same layout as SPH; the number of cycles since the cycle
+// of packet, and the ticks in the cycle. Then no division is required to compute SPH at
+// transmission.
 static void cache_event_offsets(struct amdtp_motu_cache *cache, const __be32 *buf,
 				unsigned int data_blocks, unsigned int data_block_quadlets)
 {
 	unsigned int *event_offsets = cache->event_offsets;
-	const unsigned int cache_size = cache->size;
+	const unsigned int cache_mask = cache->size - 1;
 	unsigned int cache_tail = cache->tail;
-	unsigned int base_tick = cache->tx_cycle_count * TICKS_PER_CYCLE;
+	unsigned int base_cycle = cache->tx_cycle_count;
 	int i;
 
 	for (i = 0; i < data_blocks; ++i) {
 		u32 sph = be32_to_cpu(*buf);
-		unsigned int tick;
+		unsigned int cycle = (sph & CIP_SPH_CYCLE_MASK) >> CIP_SPH_CYCLE_SHIFT;
+		unsigned int offset = sph & CIP_SPH_OFFSET_MASK;
 
-		tick = ((sph & CIP_SPH_CYCLE_MASK) >> CIP_SPH_CYCLE_SHIFT) * TICKS_PER_CYCLE +
-		       (sph & CIP_SPH_OFFSET_MASK);
-
-		if (tick < base_tick)
-			tick += TICKS_PER_SECOND;
-		event_offsets[cache_tail] = tick - base_tick;
+		if (offset >= TICKS_PER_CYCLE) {
+			offset -= TICKS_PER_CYCLE;
+			++cycle;
+		}
+		if (cycle < base_cycle)
+			cycle += CYCLES_PER_SECOND;
+		event_offsets[cache_tail] = ((cycle - base_cycle) << CIP_SPH_CYCLE_SHIFT) | offset;
 
-		cache_tail = (cache_tail + 1) % cache_size;
+		cache_tail = (cache_tail + 1) & cache_mask;
 		buf += data_block_quadlets;
 	}
 
 	cache->tail = cache_tail;
-	cache->tx_cycle_count = (cache->tx_cycle_count + 1) % CYCLES_PER_SECOND;
+	if (++cache->tx_cycle_count >= CYCLES_PER_SECOND)
+		cache->tx_cycle_count = 0;
 }
 
 static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
@@ -341,7 +354,13 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 	if (p->cache->tx_cycle_count == UINT_MAX)
 		p->cache->tx_cycle_count = (s->domain->processing_cycle.tx_start % CYCLES_PER_SECOND);
 
-	// For data block processing.
+	if (motu->spec->flags & SND_MOTU_SPEC_REGISTER_DSP)
+		snd_motu_register_dsp_message_parser_begin(motu);
+	else if (motu->spec->flags & SND_MOTU_SPEC_COMMAND_DSP)
+		snd_motu_command_dsp_message_parser_begin(motu);
+
+	// For data block processing. The messages of DSP are parsed in the same pass so that the
+	// payload of packet is still in cache.
 	for (i = 0; i < packets; ++i) {
 		const struct pkt_desc *desc = descs + i;
 		__be32 *buf = desc->ctx_payload;
@@ -355,21 +374,35 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 		}
 
 		if (p->midi_ports)
-			read_midi_messages(s, buf, data_blocks);
+			read_midi_messages(s, desc);
+
+		if (motu->spec->flags & SND_MOTU_SPEC_REGISTER_DSP) {
+			snd_motu_register_dsp_message_parser_parse(motu, desc,
+								   s->data_block_quadlets);
+		} else if (motu->spec->flags & SND_MOTU_SPEC_COMMAND_DSP) {
+			snd_motu_command_dsp_message_parser_parse(motu, desc,
+								  s->data_block_quadlets);
+		}
 	}
 
-	if (motu->spec->flags & SND_MOTU_SPEC_REGISTER_DSP) {
-		snd_motu_register_dsp_message_parser_parse(motu, descs, packets,
-							   s->data_block_quadlets);
-	} else if (motu->spec->flags & SND_MOTU_SPEC_COMMAND_DSP) {
-		snd_motu_command_dsp_message_parser_parse(motu, descs, packets,
-							  s->data_block_quadlets);
-	}
+	// The bytes in the batch of packets are delivered at once.
+	if (p->midi_ports)
+		amdtp_midi_batch_deliver(&p->midi_batch);
 
-	// For tracepoints.
+	if (motu->spec->flags & SND_MOTU_SPEC_REGISTER_DSP)
+		snd_motu_register_dsp_message_parser_end(motu);
+	else if (motu->spec->flags & SND_MOTU_SPEC_COMMAND_DSP)
+		snd_motu_command_dsp_message_parser_end(motu);
+
+	// For tracepoints, shed when the pass exceeds the budget.
+	if (amdtp_stream_shedding(s))
+		return pcm_frames;
 	if (trace_data_block_sph_enabled() ||
 	    trace_data_block_message_enabled())
 		probe_tracepoints_events(s, descs, packets);
+	if (trace_data_block_sph_batch_enabled() ||
+	    trace_data_block_message_batch_enabled())
+		probe_tracepoints_batch_events(s, descs, packets);
 
 	return pcm_frames;
 }
@@ -377,23 +410,28 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 static void write_sph(struct amdtp_motu_cache *cache, __be32 *buffer, unsigned int data_blocks,
 		      unsigned int data_block_quadlets)
 {
-	unsigned int *event_offsets = cache->event_offsets;
-	const unsigned int cache_size = cache->size;
+	const unsigned int *event_offsets = cache->event_offsets;
+	const unsigned int cache_mask = cache->size - 1;
 	unsigned int cache_head = cache->head;
-	unsigned int base_tick = cache->rx_cycle_count * TICKS_PER_CYCLE;
+	unsigned int base_cycle = cache->rx_cycle_count;
 	int i;
 
 	for (i = 0; i < data_blocks; i++) {
-		unsigned int tick = (base_tick + event_offsets[cache_head]) % TICKS_PER_SECOND;
-		u32 sph = ((tick / TICKS_PER_CYCLE) << CIP_SPH_CYCLE_SHIFT) | (tick % TICKS_PER_CYCLE);
-		*buffer = cpu_to_be32(sph);
+		unsigned int event_offset = event_offsets[cache_head];
+		unsigned int cycle = base_cycle + (event_offset >> CIP_SPH_CYCLE_SHIFT);
 
-		cache_head = (cache_head + 1) % cache_size;
+		if (cycle >= CYCLES_PER_SECOND)
+			cycle -= CYCLES_PER_SECOND;
+		*buffer = cpu_to_be32((cycle << CIP_SPH_CYCLE_SHIFT) |
+				      (event_offset & CIP_SPH_OFFSET_MASK));
+
+		cache_head = (cache_head + 1) & cache_mask;
 		buffer += data_block_quadlets;
 	}
 
 	cache->head = cache_head;
-	cache->rx_cycle_count = (cache->rx_cycle_count + 1) % CYCLES_PER_SECOND;
+	if (++cache->rx_cycle_count >= CYCLES_PER_SECOND)
+		cache->rx_cycle_count = 0;
 }
 
 static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
@@ -417,7 +455,8 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 		if (pcm) {
 			write_pcm_s32(s, pcm, buf, data_blocks, pcm_frames);
 			pcm_frames += data_blocks;
-		} else {
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+		} else if (!amdtp_stream_pcm_silence_cached(s, desc, data_blocks)) {
 			write_pcm_silence(s, buf, data_blocks);
 		}
 
@@ -427,10 +466,15 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 		write_sph(p->cache, buf, data_blocks, s->data_block_quadlets);
 	}
 
-	// For tracepoints.
+	// For tracepoints, shed when the pass exceeds the budget.
+	if (amdtp_stream_shedding(s))
+		return pcm_frames;
 	if (trace_data_block_sph_enabled() ||
 	    trace_data_block_message_enabled())
 		probe_tracepoints_events(s, descs, packets);
+	if (trace_data_block_sph_batch_enabled() ||
+	    trace_data_block_message_batch_enabled())
+		probe_tracepoints_batch_events(s, descs, packets);
 
 	return pcm_frames;
 }
@@ -31,6 +31,10 @@ struct msg_parser {
 	unsigned int value_index;
 	u64 value;
 	struct snd_firewire_motu_command_dsp_meter meter;
+
+	// For the batch of packets under the lock.
+	unsigned long flags;
+	bool used;
 };
 
 int snd_motu_command_dsp_message_parser_new(struct snd_motu *motu)
@@ -80,93 +84,118 @@ int snd_motu_command_dsp_message_parser_init(struct snd_motu *motu, enum cip_sfc
 #define FRAGMENTS_PER_VALUE		4
 #define VALUES_AT_IMAGE_END		0xffffffffffffffff
 
-void snd_motu_command_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *descs,
-					unsigned int desc_count, unsigned int data_block_quadlets)
+// The messages in the batch of packets are parsed between the calls of _begin() and _end(), so
+// that each packet is parsed together with the other data in the packet while it is still hot in
+// cache.
+void snd_motu_command_dsp_message_parser_begin(struct snd_motu *motu)
 {
 	struct msg_parser *parser = motu->message_parser;
-	unsigned int interval = parser->interval;
 	unsigned long flags;
-	int i;
-
-	spin_lock_irqsave(&parser->lock, flags);
 
-	for (i = 0; i < desc_count; ++i) {
-		const struct pkt_desc *desc = descs + i;
-		__be32 *buffer = desc->ctx_payload;
-		unsigned int data_blocks = desc->data_blocks;
-		int j;
+	// The meter is available just via hwdep device, thus it's useless to parse messages while
+	// nobody opens it. The end of image is detected again at next time.
+	parser->used = motu->hwdep && READ_ONCE(motu->hwdep->used) > 0;
+	if (!parser->used) {
+		WRITE_ONCE(parser->state, INITIALIZED);
+		return;
+	}
 
-		for (j = 0; j < data_blocks; ++j) {
-			u8 *b = (u8 *)buffer;
-			buffer += data_block_quadlets;
+	spin_lock_irqsave(&parser->lock, flags);
+	parser->flags = flags;
+}
 
-			switch (parser->state) {
-			case INITIALIZED:
-			{
+void snd_motu_command_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *desc,
+					       unsigned int data_block_quadlets)
+{
+	struct msg_parser *parser = motu->message_parser;
+	unsigned int interval = parser->interval;
+	__be32 *buffer = desc->ctx_payload;
+	unsigned int data_blocks = desc->data_blocks;
+	int j;
+
+	if (!parser->used)
+		return;
+
+	for (j = 0; j < data_blocks; ++j) {
+		u8 *b = (u8 *)buffer;
+		buffer += data_block_quadlets;
+
+		switch (parser->state) {
+		case INITIALIZED:
+		{
+			u8 fragment = b[FRAGMENT_POS];
+
+			if (fragment > 0) {
+				parser->value = fragment;
+				parser->message_count = 1;
+				parser->state = FRAGMENT_DETECTED;
+			}
+			break;
+		}
+		case FRAGMENT_DETECTED:
+		{
+			if (parser->message_count % interval == 0) {
 				u8 fragment = b[FRAGMENT_POS];
 
-				if (fragment > 0) {
-					parser->value = fragment;
-					parser->message_count = 1;
-					parser->state = FRAGMENT_DETECTED;
+				parser->value >>= 8;
+				parser->value |= (u64)fragment << 56;
+
+				if (parser->value == VALUES_AT_IMAGE_END) {
+					parser->state = AVAILABLE;
+					parser->fragment_pos = 0;
+					parser->value_index = 0;
+					parser->message_count = 0;
 				}
-				break;
 			}
-			case FRAGMENT_DETECTED:
-			{
-				if (parser->message_count % interval == 0) {
-					u8 fragment = b[FRAGMENT_POS];
-
-					parser->value >>= 8;
-					parser->value |= (u64)fragment << 56;
-
-					if (parser->value == VALUES_AT_IMAGE_END) {
-						parser->state = AVAILABLE;
-						parser->fragment_pos = 0;
-						parser->value_index = 0;
-						parser->message_count = 0;
+			++parser->message_count;
+			break;
+		}
+		case AVAILABLE:
+		default:
+		{
+			if (parser->message_count % interval == 0) {
+				u8 fragment = b[FRAGMENT_POS];
+
+				parser->value >>= 8;
+				parser->value |= (u64)fragment << 56;
+				++parser->fragment_pos;
+
+				if (parser->fragment_pos == 4) {
+					// Skip the last two quadlets since they could be
+					// invalid value (0xffffffff) as floating point
+					// number.
+					if (parser->value_index <
+					    SNDRV_FIREWIRE_MOTU_COMMAND_DSP_METER_COUNT - 2) {
+						u32 val = (u32)(parser->value >> 32);
+						parser->meter.data[parser->value_index] = val;
 					}
+					++parser->value_index;
+					parser->fragment_pos = 0;
 				}
-				++parser->message_count;
-				break;
-			}
-			case AVAILABLE:
-			default:
-			{
-				if (parser->message_count % interval == 0) {
-					u8 fragment = b[FRAGMENT_POS];
-
-					parser->value >>= 8;
-					parser->value |= (u64)fragment << 56;
-					++parser->fragment_pos;
-
-					if (parser->fragment_pos == 4) {
-						// Skip the last two quadlets since they could be
-						// invalid value (0xffffffff) as floating point
-						// number.
-						if (parser->value_index <
-						    SNDRV_FIREWIRE_MOTU_COMMAND_DSP_METER_COUNT - 2) {
-							u32 val = (u32)(parser->value >> 32);
-							parser->meter.data[parser->value_index] = val;
-						}
-						++parser->value_index;
-						parser->fragment_pos = 0;
-					}
 
-					if (parser->value == VALUES_AT_IMAGE_END) {
-						parser->value_index = 0;
-						parser->fragment_pos = 0;
-						parser->message_count = 0;
-					}
+				if (parser->value == VALUES_AT_IMAGE_END) {
+					parser->value_index = 0;
+					parser->fragment_pos = 0;
+					parser->message_count = 0;
 				}
-				++parser->message_count;
-				break;
-			}
 			}
+			++parser->message_count;
+			break;
+		}
 		}
 	}
+}
 
-	spin_unlock_irqrestore(&parser->lock, flags);
+void snd_motu_command_dsp_message_parser_end(struct snd_motu *motu)
+{
+	struct msg_parser *parser = motu->message_parser;
+
+	if (!parser->used)
+		return;
+
+	spin_unlock_irqrestore(&parser->lock, parser->flags);
+
+	snd_motu_hwdep_update_meter_page(motu, &parser->meter, sizeof(parser->meter));
 }
 
 void snd_motu_command_dsp_message_parser_copy_meter(struct snd_motu *motu,
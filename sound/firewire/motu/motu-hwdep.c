@@ -11,6 +11,8 @@
  * 1.get information about firewire node
  * 2.get notification about starting/stopping stream
  * 3.lock/unlock streaming
+ * 4.get change of register DSP via mapped ring
+ * 5.get meter of DSP via mapped page
  *
  */
 
@@ -63,30 +65,34 @@ static long hwdep_read(struct snd_hwdep *hwdep, char __user *buf, long count,
 		if (copy_to_user(buf, &event, count))
 			return -EFAULT;
 	} else if (has_dsp_event(motu)) {
-		size_t consumed = 0;
-		u32 __user *ptr;
-		u32 ev;
+		size_t header = sizeof(event.motu_register_dsp_change);
+		unsigned int capacity = 0;
+		u32 *changes;
 
 		spin_unlock_irq(&motu->lock);
 
-		// Header is filled later.
-		consumed += sizeof(event.motu_register_dsp_change);
+		if (count > header)
+			capacity = (count - header) / sizeof(*changes);
+		capacity = min(capacity, snd_motu_register_dsp_message_parser_count_event(motu));
 
-		while (consumed < count &&
-		       snd_motu_register_dsp_message_parser_copy_event(motu, &ev)) {
-			ptr = (u32 __user *)(buf + consumed);
-			if (put_user(ev, ptr))
-				return -EFAULT;
-			consumed += sizeof(ev);
-		}
+		changes = kmalloc_array(max(capacity, 1u), sizeof(*changes), GFP_KERNEL);
+		if (!changes)
+			return -ENOMEM;
+
+		// The latest changes are drained in one batch.
+		capacity = snd_motu_register_dsp_message_parser_copy_events(motu, changes,
+									    capacity);
 
 		event.motu_register_dsp_change.type = SNDRV_FIREWIRE_EVENT_MOTU_REGISTER_DSP_CHANGE;
-		event.motu_register_dsp_change.count =
-			(consumed - sizeof(event.motu_register_dsp_change)) / 4;
-		if (copy_to_user(buf, &event, sizeof(event.motu_register_dsp_change)))
+		event.motu_register_dsp_change.count = capacity;
+		if (copy_to_user(buf, &event, header) ||
+		    copy_to_user(buf + header, changes, capacity * sizeof(*changes))) {
+			kfree(changes);
 			return -EFAULT;
+		}
+		kfree(changes);
 
-		count = consumed;
+		count = header + capacity * sizeof(*changes);
 	}
 
 	return count;
@@ -103,6 +109,9 @@ static __poll_t hwdep_poll(struct snd_hwdep *hwdep, struct file *file,
 	spin_lock_irq(&motu->lock);
 	if (motu->dev_lock_changed || motu->msg || has_dsp_event(motu))
 		events = EPOLLIN | EPOLLRDNORM;
+	else if (snd_fw_event_ring_is_mapped(&motu->event_ring) &&
+		 snd_fw_event_ring_has_event(&motu->event_ring))
+		events = EPOLLIN | EPOLLRDNORM;
 	else
 		events = 0;
 	spin_unlock_irq(&motu->lock);
@@ -162,6 +171,10 @@ static int hwdep_unlock(struct snd_motu *motu)
 
 	spin_unlock_irq(&motu->lock);
 
+	// The application can change the configuration of device while holding the lock.
+	if (err == 0)
+		snd_motu_stream_invalidate_packet_formats(motu);
+
 	return err;
 }
 
@@ -174,9 +187,73 @@ static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 		motu->dev_lock_count = 0;
 	spin_unlock_irq(&motu->lock);
 
+	snd_motu_stream_invalidate_packet_formats(motu);
+
+	snd_fw_event_ring_unmap(&motu->event_ring);
+	WRITE_ONCE(motu->meter_page_mapped, false);
+
+	return 0;
+}
+
+static int map_meter_page(struct snd_motu *motu, struct vm_area_struct *area)
+{
+	int err;
+
+	if (!motu->meter_page)
+		return -ENXIO;
+	if (area->vm_end - area->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	if (area->vm_flags & VM_WRITE)
+		return -EPERM;
+	area->vm_flags &= ~VM_MAYWRITE;
+
+	err = remap_vmalloc_range(area, motu->meter_page, 0);
+	if (err < 0)
+		return err;
+
+	// Any reader can map the page at any time, thus it's kept updated till release.
+	WRITE_ONCE(motu->meter_page_mapped, true);
+
 	return 0;
 }
 
+static int hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+		      struct vm_area_struct *area)
+{
+	struct snd_motu *motu = hwdep->private_data;
+
+	if (area->vm_pgoff == SNDRV_FIREWIRE_MOTU_METER_PAGE_OFFSET >> PAGE_SHIFT)
+		return map_meter_page(motu, area);
+
+	if (area->vm_pgoff >= SNDRV_FIREWIRE_STREAM_TIMING_PAGE_OFFSET >> PAGE_SHIFT) {
+		struct amdtp_stream *const streams[] = {
+			&motu->tx_stream,
+			&motu->rx_stream,
+		};
+
+		return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+	}
+
+	return snd_fw_event_ring_mmap(&motu->event_ring, area);
+}
+
+// Called by the parser of DSP messages after processing the batch of packets.
+void snd_motu_hwdep_update_meter_page(struct snd_motu *motu, const void *meter, size_t size)
+{
+	struct snd_firewire_motu_meter_page *page = motu->meter_page;
+	u32 seq;
+
+	if (!page || !READ_ONCE(motu->meter_page_mapped))
+		return;
+
+	seq = page->sequence + 1;
+	WRITE_ONCE(page->sequence, seq);
+	smp_wmb();
+	memcpy(&page->register_dsp, meter, size);
+	smp_wmb();
+	WRITE_ONCE(page->sequence, seq + 1);
+}
+
 static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 	    unsigned int cmd, unsigned long arg)
 {
@@ -189,6 +266,11 @@ static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(motu);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(motu);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(&motu->tx_stream, 1,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&motu->domain, motu->unit, (void __user *)arg);
 	case SNDRV_FIREWIRE_IOCTL_MOTU_REGISTER_DSP_METER:
 	{
 		struct snd_firewire_motu_register_dsp_meter *meter;
@@ -278,10 +360,28 @@ int snd_motu_create_hwdep_device(struct snd_motu *motu)
 		.poll		= hwdep_poll,
 		.ioctl		= hwdep_ioctl,
 		.ioctl_compat	= hwdep_compat_ioctl,
+		.mmap		= hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
 
+	// The ring is available just for models with register DSP.
+	if (motu->spec->flags & SND_MOTU_SPEC_REGISTER_DSP) {
+		err = snd_fw_event_ring_init(&motu->event_ring, SND_FW_EVENT_RING_SIZE);
+		if (err < 0)
+			return err;
+
+		// The ring is published by the parser after processing packets.
+		amdtp_stream_set_midi_event_ring(&motu->tx_stream, &motu->event_ring);
+	}
+
+	if (motu->spec->flags & (SND_MOTU_SPEC_REGISTER_DSP | SND_MOTU_SPEC_COMMAND_DSP)) {
+		BUILD_BUG_ON(sizeof(*motu->meter_page) > PAGE_SIZE);
+		motu->meter_page = vmalloc_user(PAGE_SIZE);
+		if (!motu->meter_page)
+			return -ENOMEM;
+	}
+
 	err = snd_hwdep_new(motu->card, motu->card->driver, 0, &hwdep);
 	if (err < 0)
 		return err;
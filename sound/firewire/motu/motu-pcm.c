@@ -102,11 +102,11 @@ static int init_hw_info(struct snd_motu *motu,
 	int err;
 
 	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
-		hw->formats = SNDRV_PCM_FMTBIT_S32;
+		hw->formats = AMDTP_PCM_FORMAT_BITS;
 		stream = &motu->tx_stream;
 		formats = &motu->tx_packet_formats;
 	} else {
-		hw->formats = SNDRV_PCM_FMTBIT_S32;
+		hw->formats = AMDTP_PCM_FORMAT_BITS;
 		stream = &motu->rx_stream;
 		formats = &motu->rx_packet_formats;
 	}
@@ -331,6 +331,28 @@ static int playback_ack(struct snd_pcm_substream *substream)
 	return amdtp_domain_stream_pcm_ack(&motu->domain, &motu->rx_stream);
 }
 
+static int capture_time_info(struct snd_pcm_substream *substream,
+			     struct timespec64 *system_ts, struct timespec64 *audio_ts,
+			     struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+			     struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_motu *motu = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&motu->tx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
+static int playback_time_info(struct snd_pcm_substream *substream,
+			      struct timespec64 *system_ts, struct timespec64 *audio_ts,
+			      struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+			      struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct snd_motu *motu = substream->private_data;
+
+	return amdtp_stream_pcm_get_time_info(&motu->rx_stream, substream, system_ts, audio_ts,
+					      audio_tstamp_config, audio_tstamp_report);
+}
+
 int snd_motu_create_pcm_devices(struct snd_motu *motu)
 {
 	static const struct snd_pcm_ops capture_ops = {
@@ -342,6 +364,7 @@ int snd_motu_create_pcm_devices(struct snd_motu *motu)
 		.trigger   = capture_trigger,
 		.pointer   = capture_pointer,
 		.ack       = capture_ack,
+		.get_time_info = capture_time_info,
 	};
 	static const struct snd_pcm_ops playback_ops = {
 		.open      = pcm_open,
@@ -352,6 +375,7 @@ int snd_motu_create_pcm_devices(struct snd_motu *motu)
 		.trigger   = playback_trigger,
 		.pointer   = playback_pointer,
 		.ack       = playback_ack,
+		.get_time_info = playback_time_info,
 	};
 	struct snd_pcm *pcm;
 	int err;
@@ -364,7 +388,7 @@ int snd_motu_create_pcm_devices(struct snd_motu *motu)
 
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &capture_ops);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &playback_ops);
-	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_fw_pcm_set_managed_buffer_all(pcm);
 
 	return 0;
 }
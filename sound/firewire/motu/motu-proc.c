@@ -47,8 +47,12 @@ static void proc_read_format(struct snd_info_entry *entry,
 	unsigned int mode;
 	struct snd_motu_packet_format *formats;
 	int i;
+	int err;
 
-	if (snd_motu_protocol_cache_packet_formats(motu) < 0)
+	mutex_lock(&motu->mutex);
+	err = snd_motu_stream_cache_packet_formats(motu);
+	mutex_unlock(&motu->mutex);
+	if (err < 0)
 		return;
 
 	snd_iprintf(buffer, "tx:\tmsg\tfixed\ttotal\n");
@@ -78,6 +82,44 @@ static void proc_read_format(struct snd_info_entry *entry,
 	}
 }
 
+static void proc_read_histograms(struct snd_info_entry *entry,
+				 struct snd_info_buffer *buffer)
+{
+	struct snd_motu *motu = entry->private_data;
+
+	snd_iprintf(buffer, "Output Stream from device:\n");
+	amdtp_stream_dump_histograms(&motu->tx_stream, buffer);
+	snd_iprintf(buffer, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&motu->rx_stream, buffer);
+}
+
+static void proc_read_preflight(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct snd_motu *motu = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	unsigned int rate;
+	int err;
+
+	if (snd_motu_protocol_get_clock_rate(motu, &rate) < 0)
+		return;
+
+	mutex_lock(&motu->mutex);
+	err = snd_motu_stream_preflight(motu, rate, &preflight);
+	mutex_unlock(&motu->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, motu->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", motu->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void add_node(struct snd_motu *motu, struct snd_info_entry *root,
 		     const char *name,
 		     void (*op)(struct snd_info_entry *e,
@@ -106,4 +148,7 @@ void snd_motu_proc_init(struct snd_motu *motu)
 
 	add_node(motu, root, "clock", proc_read_clock);
 	add_node(motu, root, "format", proc_read_format);
+	add_node(motu, root, "histogram", proc_read_histograms);
+	add_node(motu, root, "preflight", proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&motu->domain, root);
 }
@@ -78,10 +78,36 @@ enum register_dsp_msg_type {
 	METER = 0x1f,
 };
 
-#define EVENT_QUEUE_SIZE	16
+#define MIXER_SRC_SLOTS \
+	(SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT * SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_SRC_COUNT)
+
+// The slots to coalesce the changes of each parameter.
+enum param_slot {
+	SLOT_MIXER_SRC_GAIN = 0,
+	SLOT_MIXER_SRC_PAN = SLOT_MIXER_SRC_GAIN + MIXER_SRC_SLOTS,
+	SLOT_MIXER_SRC_FLAG = SLOT_MIXER_SRC_PAN + MIXER_SRC_SLOTS,
+	SLOT_MIXER_SRC_PAIRED_BALANCE = SLOT_MIXER_SRC_FLAG + MIXER_SRC_SLOTS,
+	SLOT_MIXER_SRC_PAIRED_WIDTH = SLOT_MIXER_SRC_PAIRED_BALANCE + MIXER_SRC_SLOTS,
+	SLOT_MIXER_OUTPUT_PAIRED_VOLUME = SLOT_MIXER_SRC_PAIRED_WIDTH + MIXER_SRC_SLOTS,
+	SLOT_MIXER_OUTPUT_PAIRED_FLAG =
+		SLOT_MIXER_OUTPUT_PAIRED_VOLUME + SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT,
+	SLOT_MAIN_OUTPUT_PAIRED_VOLUME =
+		SLOT_MIXER_OUTPUT_PAIRED_FLAG + SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT,
+	SLOT_HP_OUTPUT_PAIRED_VOLUME,
+	SLOT_HP_OUTPUT_PAIRED_ASSIGNMENT,
+	SLOT_LINE_INPUT_BOOST,
+	SLOT_LINE_INPUT_NOMINAL_LEVEL,
+	SLOT_INPUT_GAIN_AND_INVERT,
+	SLOT_INPUT_FLAG = SLOT_INPUT_GAIN_AND_INVERT + SNDRV_FIREWIRE_MOTU_REGISTER_DSP_INPUT_COUNT,
+	SLOT_COUNT = SLOT_INPUT_FLAG + SNDRV_FIREWIRE_MOTU_REGISTER_DSP_INPUT_COUNT,
+};
 
+// The lock serializes writers. Readers of meter and parameter don't wait for the writer, and retry
+// by the sequence counter instead. The changes of parameter are coalesced so that the latest
+// change for each parameter is kept till delivered, under the lock.
 struct msg_parser {
 	spinlock_t lock;
+	seqcount_spinlock_t seq;
 	struct snd_firewire_motu_register_dsp_meter meter;
 	bool meter_pos_quirk;
 
@@ -93,9 +119,14 @@ struct msg_parser {
 	u8 input_ch;
 	u8 prev_msg_type;
 
-	u32 event_queue[EVENT_QUEUE_SIZE];
-	unsigned int push_pos;
-	unsigned int pull_pos;
+	DECLARE_BITMAP(dirty, SLOT_COUNT);
+	u32 changes[SLOT_COUNT];
+	unsigned int dirty_count;
+
+	// For the batch of packets under the lock.
+	unsigned long flags;
+	bool used;
+	bool queued;
 };
 
 int snd_motu_register_dsp_message_parser_new(struct snd_motu *motu)
@@ -105,6 +136,7 @@ int snd_motu_register_dsp_message_parser_new(struct snd_motu *motu)
 	if (!parser)
 		return -ENOMEM;
 	spin_lock_init(&parser->lock);
+	seqcount_spinlock_init(&parser->seq, &parser->lock);
 	if (motu->spec == &snd_motu_spec_4pre || motu->spec == &snd_motu_spec_audio_express)
 		parser->meter_pos_quirk = true;
 	motu->message_parser = parser;
@@ -123,298 +155,352 @@ int snd_motu_register_dsp_message_parser_init(struct snd_motu *motu)
 	return 0;
 }
 
-// Rough implementaion of queue without overrun check.
-static void queue_event(struct snd_motu *motu, u8 msg_type, u8 identifier0, u8 identifier1, u8 val)
+static void queue_event(struct snd_motu *motu, unsigned int slot, u8 msg_type, u8 identifier0,
+			u8 identifier1, u8 val)
 {
 	struct msg_parser *parser = motu->message_parser;
-	unsigned int pos = parser->push_pos;
-	u32 entry;
 
-	if (!motu->hwdep || motu->hwdep->used == 0)
+	if (!parser->used)
 		return;
 
-	entry = (msg_type << 24) | (identifier0 << 16) | (identifier1 << 8) | val;
-	parser->event_queue[pos] = entry;
+	parser->changes[slot] = (msg_type << 24) | (identifier0 << 16) | (identifier1 << 8) | val;
+	if (!__test_and_set_bit(slot, parser->dirty)) {
+		++parser->dirty_count;
+		parser->queued = true;
+	}
+}
 
-	++pos;
-	if (pos >= EVENT_QUEUE_SIZE)
-		pos = 0;
-	parser->push_pos = pos;
+// Call with the lock held.
+static unsigned int drain_events(struct msg_parser *parser, u32 *changes, unsigned int count)
+{
+	unsigned int slot;
+	unsigned int i = 0;
+
+	for_each_set_bit(slot, parser->dirty, SLOT_COUNT) {
+		if (i >= count)
+			break;
+		changes[i++] = parser->changes[slot];
+		__clear_bit(slot, parser->dirty);
+	}
+	parser->dirty_count -= i;
+
+	return i;
 }
 
-void snd_motu_register_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *descs,
-					unsigned int desc_count, unsigned int data_block_quadlets)
+// The messages in the batch of packets are parsed between the calls of _begin() and _end(), so
+// that each packet is parsed together with the other data in the packet while it is still hot in
+// cache.
+void snd_motu_register_dsp_message_parser_begin(struct snd_motu *motu)
 {
 	struct msg_parser *parser = motu->message_parser;
-	bool meter_pos_quirk = parser->meter_pos_quirk;
-	unsigned int pos = parser->push_pos;
 	unsigned long flags;
-	int i;
 
 	spin_lock_irqsave(&parser->lock, flags);
+	write_seqcount_begin(&parser->seq);
 
-	for (i = 0; i < desc_count; ++i) {
-		const struct pkt_desc *desc = descs + i;
-		__be32 *buffer = desc->ctx_payload;
-		unsigned int data_blocks = desc->data_blocks;
-		int j;
-
-		for (j = 0; j < data_blocks; ++j) {
-			u8 *b = (u8 *)buffer;
-			u8 msg_type = (b[MSG_FLAG_POS] & MSG_FLAG_TYPE_MASK) >> MSG_FLAG_TYPE_SHIFT;
-			u8 val = b[MSG_VALUE_POS];
-
-			buffer += data_block_quadlets;
-
-			switch (msg_type) {
-			case MIXER_SELECT:
-			{
-				u8 mixer_ch = val / 0x20;
-				if (mixer_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT) {
-					parser->mixer_src_ch = 0;
-					parser->mixer_ch = mixer_ch;
-				}
-				break;
+	parser->flags = flags;
+	parser->used = motu->hwdep && READ_ONCE(motu->hwdep->used) > 0;
+	parser->queued = false;
+}
+
+void snd_motu_register_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *desc,
+						unsigned int data_block_quadlets)
+{
+	struct msg_parser *parser = motu->message_parser;
+	bool meter_pos_quirk = parser->meter_pos_quirk;
+	bool used = parser->used;
+	__be32 *buffer = desc->ctx_payload;
+	unsigned int data_blocks = desc->data_blocks;
+	int j;
+
+	for (j = 0; j < data_blocks; ++j) {
+		u8 *b = (u8 *)buffer;
+		u8 msg_type = (b[MSG_FLAG_POS] & MSG_FLAG_TYPE_MASK) >> MSG_FLAG_TYPE_SHIFT;
+		u8 val = b[MSG_VALUE_POS];
+
+		buffer += data_block_quadlets;
+
+		switch (msg_type) {
+		case MIXER_SELECT:
+		{
+			u8 mixer_ch = val / 0x20;
+			if (mixer_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT) {
+				parser->mixer_src_ch = 0;
+				parser->mixer_ch = mixer_ch;
 			}
-			case MIXER_SRC_GAIN:
-			case MIXER_SRC_PAN:
-			case MIXER_SRC_FLAG:
-			case MIXER_SRC_PAIRED_BALANCE:
-			case MIXER_SRC_PAIRED_WIDTH:
-			{
-				struct snd_firewire_motu_register_dsp_parameter *param = &parser->param;
+			break;
+		}
+		case MIXER_SRC_GAIN:
+		case MIXER_SRC_PAN:
+		case MIXER_SRC_FLAG:
+		case MIXER_SRC_PAIRED_BALANCE:
+		case MIXER_SRC_PAIRED_WIDTH:
+		{
+			struct snd_firewire_motu_register_dsp_parameter *param = &parser->param;
+			u8 mixer_ch = parser->mixer_ch;
+			u8 mixer_src_ch = parser->mixer_src_ch;
+
+			if (msg_type != parser->prev_mixer_src_type)
+				mixer_src_ch = 0;
+			else
+				++mixer_src_ch;
+			parser->prev_mixer_src_type = msg_type;
+
+			if (mixer_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT &&
+			    mixer_src_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_SRC_COUNT) {
 				u8 mixer_ch = parser->mixer_ch;
-				u8 mixer_src_ch = parser->mixer_src_ch;
-
-				if (msg_type != parser->prev_mixer_src_type)
-					mixer_src_ch = 0;
-				else
-					++mixer_src_ch;
-				parser->prev_mixer_src_type = msg_type;
-
-				if (mixer_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT &&
-				    mixer_src_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_SRC_COUNT) {
-					u8 mixer_ch = parser->mixer_ch;
-
-					switch (msg_type) {
-					case MIXER_SRC_GAIN:
-						if (param->mixer.source[mixer_ch].gain[mixer_src_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, mixer_src_ch, val);
-							param->mixer.source[mixer_ch].gain[mixer_src_ch] = val;
-						}
-						break;
-					case MIXER_SRC_PAN:
-						if (param->mixer.source[mixer_ch].pan[mixer_src_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, mixer_src_ch, val);
-							param->mixer.source[mixer_ch].pan[mixer_src_ch] = val;
-						}
-						break;
-					case MIXER_SRC_FLAG:
-						if (param->mixer.source[mixer_ch].flag[mixer_src_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, mixer_src_ch, val);
-							param->mixer.source[mixer_ch].flag[mixer_src_ch] = val;
-						}
-						break;
-					case MIXER_SRC_PAIRED_BALANCE:
-						if (param->mixer.source[mixer_ch].paired_balance[mixer_src_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, mixer_src_ch, val);
-							param->mixer.source[mixer_ch].paired_balance[mixer_src_ch] = val;
-						}
-						break;
-					case MIXER_SRC_PAIRED_WIDTH:
-						if (param->mixer.source[mixer_ch].paired_width[mixer_src_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, mixer_src_ch, val);
-							param->mixer.source[mixer_ch].paired_width[mixer_src_ch] = val;
-						}
-						break;
-					default:
-						break;
+				unsigned int slot = mixer_ch *
+					SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_SRC_COUNT + mixer_src_ch;
+
+				switch (msg_type) {
+				case MIXER_SRC_GAIN:
+					if (param->mixer.source[mixer_ch].gain[mixer_src_ch] != val) {
+						queue_event(motu, SLOT_MIXER_SRC_GAIN + slot, msg_type,
+							    mixer_ch, mixer_src_ch, val);
+						param->mixer.source[mixer_ch].gain[mixer_src_ch] = val;
 					}
-
-					parser->mixer_src_ch = mixer_src_ch;
+					break;
+				case MIXER_SRC_PAN:
+					if (param->mixer.source[mixer_ch].pan[mixer_src_ch] != val) {
+						queue_event(motu, SLOT_MIXER_SRC_PAN + slot, msg_type,
+							    mixer_ch, mixer_src_ch, val);
+						param->mixer.source[mixer_ch].pan[mixer_src_ch] = val;
+					}
+					break;
+				case MIXER_SRC_FLAG:
+					if (param->mixer.source[mixer_ch].flag[mixer_src_ch] != val) {
+						queue_event(motu, SLOT_MIXER_SRC_FLAG + slot, msg_type,
+							    mixer_ch, mixer_src_ch, val);
+						param->mixer.source[mixer_ch].flag[mixer_src_ch] = val;
+					}
+					break;
+				case MIXER_SRC_PAIRED_BALANCE:
+					if (param->mixer.source[mixer_ch].paired_balance[mixer_src_ch] != val) {
+						queue_event(motu, SLOT_MIXER_SRC_PAIRED_BALANCE + slot, msg_type,
+							    mixer_ch, mixer_src_ch, val);
+						param->mixer.source[mixer_ch].paired_balance[mixer_src_ch] = val;
+					}
+					break;
+				case MIXER_SRC_PAIRED_WIDTH:
+					if (param->mixer.source[mixer_ch].paired_width[mixer_src_ch] != val) {
+						queue_event(motu, SLOT_MIXER_SRC_PAIRED_WIDTH + slot, msg_type,
+							    mixer_ch, mixer_src_ch, val);
+						param->mixer.source[mixer_ch].paired_width[mixer_src_ch] = val;
+					}
+					break;
+				default:
+					break;
 				}
-				break;
-			}
-			case MIXER_OUTPUT_PAIRED_VOLUME:
-			case MIXER_OUTPUT_PAIRED_FLAG:
-			{
-				struct snd_firewire_motu_register_dsp_parameter *param = &parser->param;
-				u8 mixer_ch = parser->mixer_ch;
 
-				if (mixer_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT) {
-					switch (msg_type) {
-					case MIXER_OUTPUT_PAIRED_VOLUME:
-						if (param->mixer.output.paired_volume[mixer_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, 0, val);
-							param->mixer.output.paired_volume[mixer_ch] = val;
-						}
-						break;
-					case MIXER_OUTPUT_PAIRED_FLAG:
-						if (param->mixer.output.paired_flag[mixer_ch] != val) {
-							queue_event(motu, msg_type, mixer_ch, 0, val);
-							param->mixer.output.paired_flag[mixer_ch] = val;
-						}
-						break;
-					default:
-						break;
+				parser->mixer_src_ch = mixer_src_ch;
+			}
+			break;
+		}
+		case MIXER_OUTPUT_PAIRED_VOLUME:
+		case MIXER_OUTPUT_PAIRED_FLAG:
+		{
+			struct snd_firewire_motu_register_dsp_parameter *param = &parser->param;
+			u8 mixer_ch = parser->mixer_ch;
+
+			if (mixer_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_MIXER_COUNT) {
+				switch (msg_type) {
+				case MIXER_OUTPUT_PAIRED_VOLUME:
+					if (param->mixer.output.paired_volume[mixer_ch] != val) {
+						queue_event(motu, SLOT_MIXER_OUTPUT_PAIRED_VOLUME + mixer_ch,
+							    msg_type, mixer_ch, 0, val);
+						param->mixer.output.paired_volume[mixer_ch] = val;
+					}
+					break;
+				case MIXER_OUTPUT_PAIRED_FLAG:
+					if (param->mixer.output.paired_flag[mixer_ch] != val) {
+						queue_event(motu, SLOT_MIXER_OUTPUT_PAIRED_FLAG + mixer_ch,
+							    msg_type, mixer_ch, 0, val);
+						param->mixer.output.paired_flag[mixer_ch] = val;
 					}
+					break;
+				default:
+					break;
 				}
-				break;
 			}
-			case MAIN_OUTPUT_PAIRED_VOLUME:
-				if (parser->param.output.main_paired_volume != val) {
-					queue_event(motu, msg_type, 0, 0, val);
-					parser->param.output.main_paired_volume = val;
-				}
-				break;
-			case HP_OUTPUT_PAIRED_VOLUME:
-				if (parser->param.output.hp_paired_volume != val) {
-					queue_event(motu, msg_type, 0, 0, val);
-					parser->param.output.hp_paired_volume = val;
-				}
-				break;
-			case HP_OUTPUT_PAIRED_ASSIGNMENT:
-				if (parser->param.output.hp_paired_assignment != val) {
-					queue_event(motu, msg_type, 0, 0, val);
-					parser->param.output.hp_paired_assignment = val;
-				}
-				break;
-			case LINE_INPUT_BOOST:
-				if (parser->param.line_input.boost_flag != val) {
-					queue_event(motu, msg_type, 0, 0, val);
-					parser->param.line_input.boost_flag = val;
-				}
-				break;
-			case LINE_INPUT_NOMINAL_LEVEL:
-				if (parser->param.line_input.nominal_level_flag != val) {
-					queue_event(motu, msg_type, 0, 0, val);
-					parser->param.line_input.nominal_level_flag = val;
-				}
-				break;
-			case INPUT_GAIN_AND_INVERT:
-			case INPUT_FLAG:
-			{
-				struct snd_firewire_motu_register_dsp_parameter *param = &parser->param;
-				u8 input_ch = parser->input_ch;
-
-				if (parser->prev_msg_type != msg_type)
-					input_ch = 0;
-				else
-					++input_ch;
-
-				if (input_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_INPUT_COUNT) {
-					switch (msg_type) {
-					case INPUT_GAIN_AND_INVERT:
-						if (param->input.gain_and_invert[input_ch] != val) {
-							queue_event(motu, msg_type, input_ch, 0, val);
-							param->input.gain_and_invert[input_ch] = val;
-						}
-						break;
-					case INPUT_FLAG:
-						if (param->input.flag[input_ch] != val) {
-							queue_event(motu, msg_type, input_ch, 0, val);
-							param->input.flag[input_ch] = val;
-						}
-						break;
-					default:
-						break;
+			break;
+		}
+		case MAIN_OUTPUT_PAIRED_VOLUME:
+			if (parser->param.output.main_paired_volume != val) {
+				queue_event(motu, SLOT_MAIN_OUTPUT_PAIRED_VOLUME, msg_type, 0, 0, val);
+				parser->param.output.main_paired_volume = val;
+			}
+			break;
+		case HP_OUTPUT_PAIRED_VOLUME:
+			if (parser->param.output.hp_paired_volume != val) {
+				queue_event(motu, SLOT_HP_OUTPUT_PAIRED_VOLUME, msg_type, 0, 0, val);
+				parser->param.output.hp_paired_volume = val;
+			}
+			break;
+		case HP_OUTPUT_PAIRED_ASSIGNMENT:
+			if (parser->param.output.hp_paired_assignment != val) {
+				queue_event(motu, SLOT_HP_OUTPUT_PAIRED_ASSIGNMENT, msg_type, 0, 0, val);
+				parser->param.output.hp_paired_assignment = val;
+			}
+			break;
+		case LINE_INPUT_BOOST:
+			if (parser->param.line_input.boost_flag != val) {
+				queue_event(motu, SLOT_LINE_INPUT_BOOST, msg_type, 0, 0, val);
+				parser->param.line_input.boost_flag = val;
+			}
+			break;
+		case LINE_INPUT_NOMINAL_LEVEL:
+			if (parser->param.line_input.nominal_level_flag != val) {
+				queue_event(motu, SLOT_LINE_INPUT_NOMINAL_LEVEL, msg_type, 0, 0, val);
+				parser->param.line_input.nominal_level_flag = val;
+			}
+			break;
+		case INPUT_GAIN_AND_INVERT:
+		case INPUT_FLAG:
+		{
+			struct snd_firewire_motu_register_dsp_parameter *param = &parser->param;
+			u8 input_ch = parser->input_ch;
+
+			if (parser->prev_msg_type != msg_type)
+				input_ch = 0;
+			else
+				++input_ch;
+
+			if (input_ch < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_INPUT_COUNT) {
+				switch (msg_type) {
+				case INPUT_GAIN_AND_INVERT:
+					if (param->input.gain_and_invert[input_ch] != val) {
+						queue_event(motu, SLOT_INPUT_GAIN_AND_INVERT + input_ch, msg_type,
+							    input_ch, 0, val);
+						param->input.gain_and_invert[input_ch] = val;
 					}
-					parser->input_ch = input_ch;
+					break;
+				case INPUT_FLAG:
+					if (param->input.flag[input_ch] != val) {
+						queue_event(motu, SLOT_INPUT_FLAG + input_ch, msg_type,
+							    input_ch, 0, val);
+						param->input.flag[input_ch] = val;
+					}
+					break;
+				default:
+					break;
 				}
-				break;
+				parser->input_ch = input_ch;
 			}
-			case UNKNOWN_0:
-			case UNKNOWN_2:
-				break;
-			case METER:
-			{
-				u8 pos;
-
-				if (!meter_pos_quirk)
-					pos = b[MSG_METER_IDX_POS];
-				else
-					pos = b[MSG_METER_IDX_POS_4PRE_AE];
-
-				if (pos < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_METER_INPUT_COUNT) {
-					parser->meter.data[pos] = val;
-				} else if (pos >= 0x80) {
-					pos -= (0x80 - SNDRV_FIREWIRE_MOTU_REGISTER_DSP_METER_INPUT_COUNT);
+			break;
+		}
+		case UNKNOWN_0:
+		case UNKNOWN_2:
+			break;
+		case METER:
+		{
+			u8 pos;
+
+			// The meter is available just via hwdep device, while the parameters
+			// should be tracked always since they are notified just at change.
+			if (!used)
+				continue;
 
-					if (pos < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_METER_COUNT)
-						parser->meter.data[pos] = val;
-				}
+			if (!meter_pos_quirk)
+				pos = b[MSG_METER_IDX_POS];
+			else
+				pos = b[MSG_METER_IDX_POS_4PRE_AE];
 
-				// The message for meter is interruptible to the series of other
-				// types of messages. Don't cache it.
-				fallthrough;
-			}
-			case INVALID:
-			default:
-				// Don't cache it.
-				continue;
+			if (pos < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_METER_INPUT_COUNT) {
+				parser->meter.data[pos] = val;
+			} else if (pos >= 0x80) {
+				pos -= (0x80 - SNDRV_FIREWIRE_MOTU_REGISTER_DSP_METER_INPUT_COUNT);
+
+				if (pos < SNDRV_FIREWIRE_MOTU_REGISTER_DSP_METER_COUNT)
+					parser->meter.data[pos] = val;
 			}
 
-			parser->prev_msg_type = msg_type;
+			// The message for meter is interruptible to the series of other
+			// types of messages. Don't cache it.
+			fallthrough;
+		}
+		case INVALID:
+		default:
+			// Don't cache it.
+			continue;
 		}
+
+		parser->prev_msg_type = msg_type;
 	}
+}
 
-	if (pos != parser->push_pos)
-		wake_up(&motu->hwdep_wait);
+void snd_motu_register_dsp_message_parser_end(struct snd_motu *motu)
+{
+	struct msg_parser *parser = motu->message_parser;
+	bool queued = parser->queued;
+
+	// All of the changes in the ring are delivered by one event. When the ring has no space,
+	// they are kept to be coalesced with the later changes.
+	if (parser->dirty_count > 0 && snd_fw_event_ring_is_mapped(&motu->event_ring)) {
+		struct snd_firewire_event_motu_register_dsp_change *event;
+		unsigned int length = struct_size(event, changes, parser->dirty_count);
+
+		event = snd_fw_event_ring_reserve(&motu->event_ring, length);
+		if (event) {
+			event->type = SNDRV_FIREWIRE_EVENT_MOTU_REGISTER_DSP_CHANGE;
+			event->count = drain_events(parser, event->changes, parser->dirty_count);
+			snd_fw_event_ring_commit(&motu->event_ring, length);
+		}
+	}
 
-	spin_unlock_irqrestore(&parser->lock, flags);
+	// The events in the ring are published at once for the batch of packets.
+	write_seqcount_end(&parser->seq);
+	spin_unlock_irqrestore(&parser->lock, parser->flags);
+
+	snd_motu_hwdep_update_meter_page(motu, &parser->meter, sizeof(parser->meter));
+
+	if (queued ||
+	    (snd_fw_event_ring_is_mapped(&motu->event_ring) &&
+	     snd_fw_event_ring_publish(&motu->event_ring)))
+		wake_up(&motu->hwdep_wait);
 }
 
 void snd_motu_register_dsp_message_parser_copy_meter(struct snd_motu *motu,
 						struct snd_firewire_motu_register_dsp_meter *meter)
 {
 	struct msg_parser *parser = motu->message_parser;
-	unsigned long flags;
+	unsigned int seq;
 
-	spin_lock_irqsave(&parser->lock, flags);
-	memcpy(meter, &parser->meter, sizeof(*meter));
-	spin_unlock_irqrestore(&parser->lock, flags);
+	do {
+		seq = read_seqcount_begin(&parser->seq);
+		memcpy(meter, &parser->meter, sizeof(*meter));
+	} while (read_seqcount_retry(&parser->seq, seq));
 }
 
 void snd_motu_register_dsp_message_parser_copy_parameter(struct snd_motu *motu,
 					struct snd_firewire_motu_register_dsp_parameter *param)
 {
 	struct msg_parser *parser = motu->message_parser;
-	unsigned long flags;
+	unsigned int seq;
 
-	spin_lock_irqsave(&parser->lock, flags);
-	memcpy(param, &parser->param, sizeof(*param));
-	spin_unlock_irqrestore(&parser->lock, flags);
+	do {
+		seq = read_seqcount_begin(&parser->seq);
+		memcpy(param, &parser->param, sizeof(*param));
+	} while (read_seqcount_retry(&parser->seq, seq));
 }
 
 unsigned int snd_motu_register_dsp_message_parser_count_event(struct snd_motu *motu)
 {
 	struct msg_parser *parser = motu->message_parser;
 
-	if (parser->pull_pos > parser->push_pos)
-		return EVENT_QUEUE_SIZE - parser->pull_pos + parser->push_pos;
-	else
-		return parser->push_pos - parser->pull_pos;
+	return READ_ONCE(parser->dirty_count);
 }
 
-bool snd_motu_register_dsp_message_parser_copy_event(struct snd_motu *motu, u32 *event)
+// The latest changes of parameters are copied at once. The order of parameters is fixed, instead
+// of the order of changes.
+unsigned int snd_motu_register_dsp_message_parser_copy_events(struct snd_motu *motu, u32 *changes,
+							      unsigned int count)
 {
 	struct msg_parser *parser = motu->message_parser;
-	unsigned int pos = parser->pull_pos;
 	unsigned long flags;
 
-	if (pos == parser->push_pos)
-		return false;
-
 	spin_lock_irqsave(&parser->lock, flags);
-
-	*event = parser->event_queue[pos];
-
-	++pos;
-	if (pos >= EVENT_QUEUE_SIZE)
-		pos = 0;
-	parser->pull_pos = pos;
-
+	count = drain_events(parser, changes, count);
 	spin_unlock_irqrestore(&parser->lock, flags);
 
-	return true;
+	return count;
 }
@@ -25,23 +25,19 @@
 #define  RX_PACKET_EXCLUDE_DIFFERED_DATA_CHUNKS	0x00000040
 #define  TX_PACKET_TRANSMISSION_SPEED_MASK	0x0000000f
 
-static int keep_resources(struct snd_motu *motu, unsigned int rate,
-			  struct amdtp_stream *stream)
+static int set_stream_parameters(struct snd_motu *motu, unsigned int rate,
+				 struct amdtp_stream *stream)
 {
-	struct fw_iso_resources *resources;
 	struct snd_motu_packet_format *packet_format;
 	unsigned int midi_ports = 0;
-	int err;
 
 	if (stream == &motu->rx_stream) {
-		resources = &motu->rx_resources;
 		packet_format = &motu->rx_packet_formats;
 
 		if ((motu->spec->flags & SND_MOTU_SPEC_RX_MIDI_2ND_Q) ||
 		    (motu->spec->flags & SND_MOTU_SPEC_RX_MIDI_3RD_Q))
 			midi_ports = 1;
 	} else {
-		resources = &motu->tx_resources;
 		packet_format = &motu->tx_packet_formats;
 
 		if ((motu->spec->flags & SND_MOTU_SPEC_TX_MIDI_2ND_Q) ||
@@ -49,14 +45,25 @@ static int keep_resources(struct snd_motu *motu, unsigned int rate,
 			midi_ports = 1;
 	}
 
-	err = amdtp_motu_set_parameters(stream, rate, midi_ports,
-					packet_format);
-	if (err < 0)
-		return err;
+	return amdtp_motu_set_parameters(stream, rate, midi_ports,
+					 packet_format);
+}
 
-	return fw_iso_resources_allocate(resources,
-				amdtp_stream_get_max_payload(stream),
-				fw_parent_device(motu->unit)->max_speed);
+// Allocate isochronous resources for both streams by one batch of transactions.
+static int keep_resources(struct snd_motu *motu)
+{
+	struct fw_iso_resources *resources[] = {
+		&motu->tx_resources,
+		&motu->rx_resources,
+	};
+	unsigned int max_payloads[] = {
+		amdtp_stream_get_max_payload(&motu->tx_stream),
+		amdtp_stream_get_max_payload(&motu->rx_stream),
+	};
+
+	return fw_iso_resources_allocate_batch(resources, max_payloads,
+					       ARRAY_SIZE(resources),
+					       fw_parent_device(motu->unit)->max_speed);
 }
 
 static int begin_session(struct snd_motu *motu)
@@ -108,8 +115,18 @@ static void finish_session(struct snd_motu *motu)
 
 int snd_motu_stream_cache_packet_formats(struct snd_motu *motu)
 {
+	unsigned int generation;
+	bool valid;
 	int err;
 
+	spin_lock_irq(&motu->lock);
+	valid = motu->packet_formats_cache.valid;
+	generation = motu->packet_formats_cache.generation;
+	spin_unlock_irq(&motu->lock);
+
+	if (valid)
+		return 0;
+
 	err = snd_motu_protocol_cache_packet_formats(motu);
 	if (err < 0)
 		return err;
@@ -130,9 +147,26 @@ int snd_motu_stream_cache_packet_formats(struct snd_motu *motu)
 		motu->rx_packet_formats.midi_byte_offset = 7;
 	}
 
+	spin_lock_irq(&motu->lock);
+	if (motu->packet_formats_cache.generation == generation)
+		motu->packet_formats_cache.valid = true;
+	spin_unlock_irq(&motu->lock);
+
 	return 0;
 }
 
+// The device can change its configuration at any message, at bus reset, and by the operation of
+// userspace application.
+void snd_motu_stream_invalidate_packet_formats(struct snd_motu *motu)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&motu->lock, flags);
+	++motu->packet_formats_cache.generation;
+	motu->packet_formats_cache.valid = false;
+	spin_unlock_irqrestore(&motu->lock, flags);
+}
+
 int snd_motu_stream_reserve_duplex(struct snd_motu *motu, unsigned int rate,
 				   unsigned int frames_per_period,
 				   unsigned int frames_per_buffer)
@@ -162,20 +196,24 @@ int snd_motu_stream_reserve_duplex(struct snd_motu *motu, unsigned int rate,
 				"fail to set sampling rate: %d\n", err);
 			return err;
 		}
+		if (curr_rate != rate)
+			snd_motu_stream_invalidate_packet_formats(motu);
 
 		err = snd_motu_stream_cache_packet_formats(motu);
 		if (err < 0)
 			return err;
 
-		err = keep_resources(motu, rate, &motu->tx_stream);
+		err = set_stream_parameters(motu, rate, &motu->tx_stream);
 		if (err < 0)
 			return err;
 
-		err = keep_resources(motu, rate, &motu->rx_stream);
-		if (err < 0) {
-			fw_iso_resources_free(&motu->tx_resources);
+		err = set_stream_parameters(motu, rate, &motu->rx_stream);
+		if (err < 0)
+			return err;
+
+		err = keep_resources(motu);
+		if (err < 0)
 			return err;
-		}
 
 		err = amdtp_domain_set_events_per_period(&motu->domain,
 					frames_per_period, frames_per_buffer);
@@ -185,7 +223,9 @@ int snd_motu_stream_reserve_duplex(struct snd_motu *motu, unsigned int rate,
 			return err;
 		}
 
-		motu->cache.size = motu->tx_stream.syt_interval * frames_per_buffer;
+		// The size is power of two so that the position in the cache is computed by mask.
+		motu->cache.size = roundup_pow_of_two(motu->tx_stream.syt_interval *
+						      frames_per_buffer);
 		motu->cache.event_offsets = kcalloc(motu->cache.size, sizeof(*motu->cache.event_offsets),
 						  GFP_KERNEL);
 		if (!motu->cache.event_offsets) {
@@ -198,6 +238,36 @@ int snd_motu_stream_reserve_duplex(struct snd_motu *motu, unsigned int rate,
 	return 0;
 }
 
+// Count the resources which snd_motu_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The parameters of streams are changed only when they are not reserved yet.
+int snd_motu_stream_preflight(struct snd_motu *motu, unsigned int rate,
+			      struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(motu->unit)->max_speed;
+	int err;
+
+	if (motu->substreams_counter == 0) {
+		err = snd_motu_stream_cache_packet_formats(motu);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(motu, rate, &motu->tx_stream);
+		if (err < 0)
+			return err;
+
+		err = set_stream_parameters(motu, rate, &motu->rx_stream);
+		if (err < 0)
+			return err;
+	}
+
+	fw_iso_preflight_add(preflight, motu->unit, FW_ISO_CONTEXT_RECEIVE,
+			     amdtp_stream_get_max_payload(&motu->tx_stream), speed);
+	fw_iso_preflight_add(preflight, motu->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&motu->rx_stream), speed);
+
+	return 0;
+}
+
 static int ensure_packet_formats(struct snd_motu *motu)
 {
 	__be32 reg;
@@ -348,8 +418,16 @@ static int init_stream(struct snd_motu *motu, struct amdtp_stream *s)
 		return err;
 
 	err = amdtp_motu_init(s, motu->unit, dir, motu->spec, &motu->cache);
-	if (err < 0)
+	if (err < 0) {
 		fw_iso_resources_destroy(resources);
+		return err;
+	}
+
+	err = amdtp_stream_add_counters(s, motu->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(s);
+		fw_iso_resources_destroy(resources);
+	}
 
 	return err;
 }
@@ -403,6 +481,7 @@ static void motu_lock_changed(struct snd_motu *motu)
 {
 	motu->dev_lock_changed = true;
 	wake_up(&motu->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(motu->card, motu->dev_lock_count > 0);
 }
 
 int snd_motu_stream_lock_try(struct snd_motu *motu)
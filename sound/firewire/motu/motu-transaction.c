@@ -52,6 +52,7 @@ static void handle_message(struct fw_card *card, struct fw_request *request,
 	struct snd_motu *motu = callback_data;
 	__be32 *buf = (__be32 *)data;
 	unsigned long flags;
+	u32 msg;
 
 	if (tcode != TCODE_WRITE_QUADLET_REQUEST) {
 		fw_send_response(card, request, RCODE_COMPLETE);
@@ -63,13 +64,19 @@ static void handle_message(struct fw_card *card, struct fw_request *request,
 		return;
 	}
 
+	msg = be32_to_cpu(*buf);
+
 	spin_lock_irqsave(&motu->lock, flags);
-	motu->msg = be32_to_cpu(*buf);
+	motu->msg = msg;
 	spin_unlock_irqrestore(&motu->lock, flags);
 
 	fw_send_response(card, request, RCODE_COMPLETE);
 
+	snd_motu_stream_invalidate_packet_formats(motu);
+
 	wake_up(&motu->hwdep_wait);
+	snd_fw_event_mux_post(motu->card, SNDRV_FIREWIRE_EVENT_MOTU_NOTIFICATION, &msg,
+			      sizeof(msg));
 }
 
 int snd_motu_transaction_reregister(struct snd_motu *motu)
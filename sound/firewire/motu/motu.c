@@ -57,6 +57,8 @@ static void motu_card_free(struct snd_card *card)
 
 	snd_motu_transaction_unregister(motu);
 	snd_motu_stream_destroy_duplex(motu);
+	snd_fw_event_ring_destroy(&motu->event_ring);
+	vfree(motu->meter_page);
 
 	mutex_destroy(&motu->mutex);
 	fw_unit_put(motu->unit);
@@ -146,6 +148,8 @@ static void motu_bus_update(struct fw_unit *unit)
 
 	/* The handler address register becomes initialized. */
 	snd_motu_transaction_reregister(motu);
+
+	snd_motu_stream_invalidate_packet_formats(motu);
 }
 
 #define SND_MOTU_DEV_ENTRY(model, data)			\
@@ -184,6 +188,7 @@ static struct fw_driver motu_driver = {
 		.owner	= THIS_MODULE,
 		.name	= KBUILD_MODNAME,
 		.bus	= &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = motu_probe,
 	.update   = motu_bus_update,
@@ -11,12 +11,14 @@
 #include <linux/device.h>
 #include <linux/firewire.h>
 #include <linux/firewire-constants.h>
+#include <linux/log2.h>
 #include <linux/module.h>
 #include <linux/mod_devicetable.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/compat.h>
 #include <linux/sched/signal.h>
+#include <linux/vmalloc.h>
 
 /* TODO: remove when merging to upstream. */
 #include "../../../backport.h"
@@ -43,7 +45,9 @@ struct snd_motu_packet_format {
 };
 
 struct amdtp_motu_cache {
+	// In the layout of SPH; the cycles since the cycle of packet and the ticks in the cycle.
 	unsigned int *event_offsets;
+	// Power of two.
 	unsigned int size;
 	unsigned int tail;
 	unsigned int tx_cycle_count;
@@ -63,6 +67,12 @@ struct snd_motu {
 	/* For packet streaming */
 	struct snd_motu_packet_format tx_packet_formats;
 	struct snd_motu_packet_format rx_packet_formats;
+	// The packet formats are kept across sessions till the device can change its
+	// configuration. The generation detects invalidation while reading the registers.
+	struct {
+		unsigned int generation;
+		bool valid;
+	} packet_formats_cache;
 	struct amdtp_stream tx_stream;
 	struct amdtp_stream rx_stream;
 	struct fw_iso_resources tx_resources;
@@ -78,6 +88,9 @@ struct snd_motu {
 	bool dev_lock_changed;
 	wait_queue_head_t hwdep_wait;
 	struct snd_hwdep *hwdep;
+	struct snd_fw_event_ring event_ring;
+	struct snd_firewire_motu_meter_page *meter_page;
+	bool meter_page_mapped;
 
 	struct amdtp_domain domain;
 
@@ -170,9 +183,12 @@ void snd_motu_transaction_unregister(struct snd_motu *motu);
 int snd_motu_stream_init_duplex(struct snd_motu *motu);
 void snd_motu_stream_destroy_duplex(struct snd_motu *motu);
 int snd_motu_stream_cache_packet_formats(struct snd_motu *motu);
+void snd_motu_stream_invalidate_packet_formats(struct snd_motu *motu);
 int snd_motu_stream_reserve_duplex(struct snd_motu *motu, unsigned int rate,
 				   unsigned int frames_per_period,
 				   unsigned int frames_per_buffer);
+int snd_motu_stream_preflight(struct snd_motu *motu, unsigned int rate,
+			      struct fw_iso_preflight *preflight);
 int snd_motu_stream_start_duplex(struct snd_motu *motu);
 void snd_motu_stream_stop_duplex(struct snd_motu *motu);
 int snd_motu_stream_lock_try(struct snd_motu *motu);
@@ -185,6 +201,7 @@ int snd_motu_create_pcm_devices(struct snd_motu *motu);
 int snd_motu_create_midi_devices(struct snd_motu *motu);
 
 int snd_motu_create_hwdep_device(struct snd_motu *motu);
+void snd_motu_hwdep_update_meter_page(struct snd_motu *motu, const void *meter, size_t size);
 
 int snd_motu_protocol_v1_get_clock_rate(struct snd_motu *motu,
 					unsigned int *rate);
@@ -282,19 +299,24 @@ static inline int snd_motu_protocol_cache_packet_formats(struct snd_motu *motu)
 
 int snd_motu_register_dsp_message_parser_new(struct snd_motu *motu);
 int snd_motu_register_dsp_message_parser_init(struct snd_motu *motu);
-void snd_motu_register_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *descs,
-					unsigned int desc_count, unsigned int data_block_quadlets);
+void snd_motu_register_dsp_message_parser_begin(struct snd_motu *motu);
+void snd_motu_register_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *desc,
+						unsigned int data_block_quadlets);
+void snd_motu_register_dsp_message_parser_end(struct snd_motu *motu);
 void snd_motu_register_dsp_message_parser_copy_meter(struct snd_motu *motu,
 					struct snd_firewire_motu_register_dsp_meter *meter);
 void snd_motu_register_dsp_message_parser_copy_parameter(struct snd_motu *motu,
 					struct snd_firewire_motu_register_dsp_parameter *params);
 unsigned int snd_motu_register_dsp_message_parser_count_event(struct snd_motu *motu);
-bool snd_motu_register_dsp_message_parser_copy_event(struct snd_motu *motu, u32 *event);
+unsigned int snd_motu_register_dsp_message_parser_copy_events(struct snd_motu *motu, u32 *changes,
+							      unsigned int count);
 
 int snd_motu_command_dsp_message_parser_new(struct snd_motu *motu);
 int snd_motu_command_dsp_message_parser_init(struct snd_motu *motu, enum cip_sfc sfc);
-void snd_motu_command_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *descs,
-					unsigned int desc_count, unsigned int data_block_quadlets);
+void snd_motu_command_dsp_message_parser_begin(struct snd_motu *motu);
+void snd_motu_command_dsp_message_parser_parse(struct snd_motu *motu, const struct pkt_desc *desc,
+					       unsigned int data_block_quadlets);
+void snd_motu_command_dsp_message_parser_end(struct snd_motu *motu);
 void snd_motu_command_dsp_message_parser_copy_meter(struct snd_motu *motu,
 					struct snd_firewire_motu_command_dsp_meter *meter);
 
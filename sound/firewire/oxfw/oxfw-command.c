@@ -49,12 +49,10 @@ int avc_stream_set_format(struct fw_unit *unit, enum avc_general_plug_dir dir,
 	return err;
 }
 
-int avc_stream_get_format(struct fw_unit *unit,
-			  enum avc_general_plug_dir dir, unsigned int pid,
-			  u8 *buf, unsigned int *len, unsigned int eid)
+static unsigned int fill_get_format_command(u8 *buf, enum avc_general_plug_dir dir,
+					    unsigned int pid, unsigned int eid)
 {
 	unsigned int subfunc;
-	int err;
 
 	if (eid == 0xff)
 		subfunc = 0xc0;	/* SINGLE */
@@ -74,10 +72,12 @@ int avc_stream_get_format(struct fw_unit *unit,
 	buf[10] = 0xff & eid;	/* entry ID for LIST subfunction */
 	buf[11] = 0xff;		/* padding */
 
-	/* do transaction and check buf[1-7] are the same against command */
-	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
-				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
-				  BIT(6) | BIT(7));
+	return subfunc;
+}
+
+static int parse_get_format_response(u8 *buf, int err, unsigned int *len,
+				     unsigned int subfunc, unsigned int eid)
+{
 	if (err < 0)
 		;
 	else if (err < 12)
@@ -108,6 +108,77 @@ end:
 	return err;
 }
 
+int avc_stream_get_format(struct fw_unit *unit,
+			  enum avc_general_plug_dir dir, unsigned int pid,
+			  u8 *buf, unsigned int *len, unsigned int eid)
+{
+	unsigned int subfunc;
+	int err;
+
+	subfunc = fill_get_format_command(buf, dir, pid, eid);
+
+	/* do transaction and check buf[1-7] are the same against command */
+	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
+				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
+				  BIT(6) | BIT(7));
+
+	return parse_get_format_response(buf, err, len, subfunc, eid);
+}
+
+/*
+ * The commands of LIST subfunction for the count of entries from first_eid are
+ * in flight at the same time, up to the depth. The buffer for the i-th entry is
+ * at buf + i * len. The length of stream format information or negative error
+ * code for each entry is stored in results.
+ */
+int avc_stream_get_format_lists(struct fw_unit *unit,
+				enum avc_general_plug_dir dir, unsigned int pid,
+				u8 *buf, unsigned int len, int *results,
+				unsigned int first_eid, unsigned int count,
+				unsigned int depth)
+{
+	struct fcp_avc_command *commands;
+	unsigned int i;
+	int err;
+
+	commands = kcalloc(count, sizeof(*commands), GFP_KERNEL);
+	if (commands == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < count; ++i) {
+		u8 *frame = buf + i * len;
+
+		fill_get_format_command(frame, dir, pid, first_eid + i);
+
+		/* check buf[1-7] and the entry ID are the same against command */
+		commands[i].command = frame;
+		commands[i].command_size = 12;
+		commands[i].response = frame;
+		commands[i].response_size = len;
+		commands[i].response_match_bytes =
+			BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) | BIT(6) |
+			BIT(7) | BIT(10);
+	}
+
+	err = fcp_avc_transactions(unit, commands, count, depth);
+	if (err < 0)
+		goto end;
+
+	for (i = 0; i < count; ++i) {
+		unsigned int size = len;
+
+		results[i] = parse_get_format_response(buf + i * len,
+						       commands[i].result,
+						       &size, 0xc1,
+						       first_eid + i);
+		if (results[i] == 0)
+			results[i] = size;
+	}
+end:
+	kfree(commands);
+	return err;
+}
+
 int avc_general_inquiry_sig_fmt(struct fw_unit *unit, unsigned int rate,
 				enum avc_general_plug_dir dir,
 				unsigned short pid)
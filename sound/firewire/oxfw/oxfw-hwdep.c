@@ -119,6 +119,10 @@ static int hwdep_unlock(struct snd_oxfw *oxfw)
 
 	spin_unlock_irq(&oxfw->lock);
 
+	// User space application may change the formation.
+	if (err == 0)
+		snd_oxfw_stream_invalidate_formation(oxfw);
+
 	return err;
 }
 
@@ -131,6 +135,8 @@ static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 		oxfw->dev_lock_count = 0;
 	spin_unlock_irq(&oxfw->lock);
 
+	snd_oxfw_stream_invalidate_formation(oxfw);
+
 	return 0;
 }
 
@@ -146,11 +152,31 @@ static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(oxfw);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(oxfw);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(&oxfw->tx_stream, oxfw->has_output ? 1 : 0,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&oxfw->domain, oxfw->unit, (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_GET_PCM_METER:
+		return amdtp_am824_get_pcm_meter(&oxfw->tx_stream, oxfw->has_output ? 1 : 0,
+						 &oxfw->rx_stream, 1, (void __user *)arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
 }
 
+static int hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+		      struct vm_area_struct *area)
+{
+	struct snd_oxfw *oxfw = hwdep->private_data;
+	struct amdtp_stream *const streams[] = {
+		&oxfw->tx_stream,
+		&oxfw->rx_stream,
+	};
+
+	return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+}
+
 #ifdef CONFIG_COMPAT
 static int hwdep_compat_ioctl(struct snd_hwdep *hwdep, struct file *file,
 			      unsigned int cmd, unsigned long arg)
@@ -170,6 +196,7 @@ int snd_oxfw_create_hwdep(struct snd_oxfw *oxfw)
 		.poll		= hwdep_poll,
 		.ioctl		= hwdep_ioctl,
 		.ioctl_compat	= hwdep_compat_ioctl,
+		.mmap		= hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
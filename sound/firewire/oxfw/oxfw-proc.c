@@ -74,6 +74,46 @@ static void proc_read_formation(struct snd_info_entry *entry,
 	}
 }
 
+static void proc_read_histograms(struct snd_info_entry *entry,
+				 struct snd_info_buffer *buffer)
+{
+	struct snd_oxfw *oxfw = entry->private_data;
+
+	snd_iprintf(buffer, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&oxfw->rx_stream, buffer);
+	if (oxfw->has_output) {
+		snd_iprintf(buffer, "Output Stream from device:\n");
+		amdtp_stream_dump_histograms(&oxfw->tx_stream, buffer);
+	}
+}
+
+static void proc_read_preflight(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct snd_oxfw *oxfw = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	struct snd_oxfw_stream_formation formation;
+	int err;
+
+	if (snd_oxfw_stream_get_current_formation(oxfw, AVC_GENERAL_PLUG_DIR_IN, &formation) < 0)
+		return;
+
+	mutex_lock(&oxfw->mutex);
+	err = snd_oxfw_stream_preflight(oxfw, &preflight);
+	mutex_unlock(&oxfw->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, oxfw->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", formation.rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", oxfw->substreams_count > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void add_node(struct snd_oxfw *oxfw, struct snd_info_entry *root,
 		     const char *name,
 		     void (*op)(struct snd_info_entry *e,
@@ -101,4 +141,7 @@ void snd_oxfw_proc_init(struct snd_oxfw *oxfw)
 	root->mode = S_IFDIR | 0555;
 
 	add_node(oxfw, root, "formation", proc_read_formation);
+	add_node(oxfw, root, "histogram", proc_read_histograms);
+	add_node(oxfw, root, "preflight", proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&oxfw->domain, root);
 }
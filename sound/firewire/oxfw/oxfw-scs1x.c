@@ -13,6 +13,14 @@
 #define HSS1394_TAG_USER_DATA		0x00
 #define HSS1394_TAG_CHANGE_ADDRESS	0xf1
 
+/* The maximum length of message which can be packed with the others. */
+#define SHORT_MESSAGE_BYTES		4
+
+static int coalesce_us = -1;
+module_param(coalesce_us, int, 0644);
+MODULE_PARM_DESC(coalesce_us,
+		 "Microseconds to wait for more MIDI messages to be packed in one transaction, 0 to pack just pending messages, or -1 to disable (default: -1)");
+
 struct fw_scs1x {
 	struct fw_address_handler hss_handler;
 	u8 input_escape_count;
@@ -25,9 +33,14 @@ struct fw_scs1x {
 	u8 output_bytes;
 	bool output_escaped;
 	bool output_escape_high_nibble;
-	struct work_struct work;
+	struct delayed_work work;
 	wait_queue_head_t idle_wait;
 	u8 buffer[HSS1394_MAX_PACKET_SIZE];
+	unsigned int message_bytes;
+	/* For the packet including several short messages. */
+	u8 packet[HSS1394_MAX_PACKET_SIZE];
+	unsigned int packet_bytes;
+	unsigned long packet_deadline;
 	bool transaction_running;
 	struct fw_transaction transaction;
 	unsigned int transaction_bytes;
@@ -135,7 +148,7 @@ static void scs_write_callback(struct fw_card *card, int rcode,
 	}
 
 	scs->transaction_running = false;
-	schedule_work(&scs->work);
+	schedule_delayed_work(&scs->work, 0);
 }
 
 static bool is_valid_running_status(u8 status)
@@ -171,34 +184,21 @@ static bool is_invalid_cmd(u8 status)
 	       status == 0xfd;
 }
 
-static void scs_output_work(struct work_struct *work)
+/*
+ * Returns the length of message parsed into the buffer, or 0 when the message
+ * is not completed yet.
+ */
+static unsigned int parse_output_message(struct fw_scs1x *scs,
+					 struct snd_rawmidi_substream *stream)
 {
-	struct fw_scs1x *scs = container_of(work, struct fw_scs1x, work);
-	struct snd_rawmidi_substream *stream;
 	unsigned int i;
 	u8 byte;
-	int generation;
-
-	if (scs->transaction_running)
-		return;
-
-	stream = READ_ONCE(scs->output);
-	if (!stream || scs->error) {
-		scs->output_idle = true;
-		wake_up(&scs->idle_wait);
-		return;
-	}
-
-	if (scs->transaction_bytes > 0)
-		goto retry;
 
 	i = scs->output_bytes;
 	for (;;) {
 		if (snd_rawmidi_transmit(stream, &byte, 1) != 1) {
 			scs->output_bytes = i;
-			scs->output_idle = true;
-			wake_up(&scs->idle_wait);
-			return;
+			return 0;
 		}
 		/*
 		 * Convert from real MIDI to what I think the device expects (no
@@ -262,7 +262,85 @@ static void scs_output_work(struct work_struct *work)
 	scs->output_bytes = 1;
 	scs->output_escaped = false;
 
-	scs->transaction_bytes = i;
+	return i;
+}
+
+static bool is_short_message(const struct fw_scs1x *scs, unsigned int bytes)
+{
+	return scs->buffer[0] == HSS1394_TAG_USER_DATA &&
+	       bytes <= SHORT_MESSAGE_BYTES && scs->output_status != 0xf0;
+}
+
+static void scs_output_work(struct work_struct *work)
+{
+	struct fw_scs1x *scs = container_of(to_delayed_work(work),
+					    struct fw_scs1x, work);
+	int coalesce = READ_ONCE(coalesce_us);
+	struct snd_rawmidi_substream *stream;
+	unsigned int bytes;
+	int generation;
+
+	if (scs->transaction_running)
+		return;
+
+	stream = READ_ONCE(scs->output);
+	if (!stream || scs->error) {
+		scs->output_idle = true;
+		wake_up(&scs->idle_wait);
+		return;
+	}
+
+	if (scs->transaction_bytes > 0)
+		goto retry;
+
+	/*
+	 * Pack short messages as many as possible into one packet. The others
+	 * are sent in own packet.
+	 */
+	for (;;) {
+		if (scs->message_bytes == 0)
+			scs->message_bytes = parse_output_message(scs, stream);
+		bytes = scs->message_bytes;
+		if (bytes == 0)
+			break;
+
+		if (coalesce < 0 || !is_short_message(scs, bytes)) {
+			if (scs->packet_bytes == 0) {
+				memcpy(scs->packet, scs->buffer, bytes);
+				scs->packet_bytes = bytes;
+				scs->message_bytes = 0;
+			}
+			goto send;
+		}
+
+		if (scs->packet_bytes + bytes - 1 > HSS1394_MAX_PACKET_SIZE)
+			goto send;
+		if (scs->packet_bytes == 0) {
+			scs->packet[0] = HSS1394_TAG_USER_DATA;
+			scs->packet_bytes = 1;
+			scs->packet_deadline = jiffies + usecs_to_jiffies(coalesce);
+		}
+		memcpy(scs->packet + scs->packet_bytes, scs->buffer + 1,
+		       bytes - 1);
+		scs->packet_bytes += bytes - 1;
+		scs->message_bytes = 0;
+	}
+
+	if (scs->packet_bytes == 0) {
+		scs->output_idle = true;
+		wake_up(&scs->idle_wait);
+		return;
+	}
+
+	/* Wait for more messages till the deadline. */
+	if (coalesce > 0 && time_before(jiffies, scs->packet_deadline)) {
+		schedule_delayed_work(&scs->work,
+				      scs->packet_deadline - jiffies);
+		return;
+	}
+send:
+	scs->transaction_bytes = scs->packet_bytes;
+	scs->packet_bytes = 0;
 retry:
 	scs->transaction_running = true;
 	generation = scs->fw_dev->generation;
@@ -270,7 +348,7 @@ retry:
 	fw_send_request(scs->fw_dev->card, &scs->transaction,
 			TCODE_WRITE_BLOCK_REQUEST, scs->fw_dev->node_id,
 			generation, scs->fw_dev->max_speed, HSS1394_ADDRESS,
-			scs->buffer, scs->transaction_bytes,
+			scs->packet, scs->transaction_bytes,
 			scs_write_callback, scs);
 }
 
@@ -318,8 +396,15 @@ static void midi_playback_trigger(struct snd_rawmidi_substream *stream, int up)
 		scs->transaction_bytes = 0;
 		scs->error = false;
 
+		/* The trigger is called for each write. Keep pending messages. */
+		if (!READ_ONCE(scs->output)) {
+			scs->message_bytes = 0;
+			scs->packet_bytes = 0;
+		}
+
 		WRITE_ONCE(scs->output, stream);
-		schedule_work(&scs->work);
+		/* New messages are packed with the pending ones immediately. */
+		mod_delayed_work(system_wq, &scs->work, 0);
 	} else {
 		WRITE_ONCE(scs->output, NULL);
 	}
@@ -347,6 +432,7 @@ static void remove_scs1x(struct snd_rawmidi *rmidi)
 	struct fw_scs1x *scs = rmidi->private_data;
 
 	fw_core_remove_address_handler(&scs->hss_handler);
+	cancel_delayed_work_sync(&scs->work);
 }
 
 void snd_oxfw_scs1x_update(struct snd_oxfw *oxfw)
@@ -409,7 +495,7 @@ int snd_oxfw_scs1x_add(struct snd_oxfw *oxfw)
 	snd_rawmidi_set_ops(rmidi, SNDRV_RAWMIDI_STREAM_OUTPUT,
 			    &midi_playback_ops);
 
-	INIT_WORK(&scs->work, scs_output_work);
+	INIT_DELAYED_WORK(&scs->work, scs_output_work);
 	init_waitqueue_head(&scs->idle_wait);
 	scs->output_idle = true;
 
@@ -81,67 +81,111 @@ error:
 	return err;
 }
 
-static int avc_audio_feature_volume(struct fw_unit *unit, u8 fb_id, s16 *value,
-				    unsigned int channel,
-				    enum control_attribute attribute,
-				    enum control_action action)
+/*
+ * The commands for several channels are in flight at the same time up to the
+ * depth, since the unit drops isochronous packets while it handles each
+ * transaction.
+ */
+static int avc_audio_feature_volumes(struct fw_unit *unit, u8 fb_id,
+				     s16 *values, const u8 *channels,
+				     unsigned int count, unsigned int depth,
+				     enum control_attribute attribute,
+				     enum control_action action)
 {
+	struct fcp_avc_command *commands;
 	u8 *buf;
 	u8 response_ok;
+	unsigned int i;
 	int err;
 
-	buf = kmalloc(12, GFP_KERNEL);
-	if (!buf)
-		return -ENOMEM;
-
-	if (action == CTL_READ) {
-		buf[0] = 0x01;		/* AV/C, STATUS */
-		response_ok = 0x0c;	/*       STABLE */
-	} else {
-		buf[0] = 0x00;		/* AV/C, CONTROL */
-		response_ok = 0x09;	/*       ACCEPTED */
+	buf = kmalloc_array(count, 12, GFP_KERNEL);
+	commands = kcalloc(count, sizeof(*commands), GFP_KERNEL);
+	if (!buf || !commands) {
+		err = -ENOMEM;
+		goto error;
 	}
-	buf[1] = 0x08;			/* audio unit 0 */
-	buf[2] = 0xb8;			/* FUNCTION BLOCK */
-	buf[3] = 0x81;			/* function block type: feature */
-	buf[4] = fb_id;			/* function block ID */
-	buf[5] = attribute;		/* control attribute */
-	buf[6] = 0x02;			/* selector length */
-	buf[7] = channel;		/* audio channel number */
-	buf[8] = 0x02;			/* control selector: volume */
-	buf[9] = 0x02;			/* control data length */
-	if (action == CTL_READ) {
-		buf[10] = 0xff;
-		buf[11] = 0xff;
-	} else {
-		buf[10] = *value >> 8;
-		buf[11] = *value;
+
+	if (action == CTL_READ)
+		response_ok = 0x0c;	/* STABLE */
+	else
+		response_ok = 0x09;	/* ACCEPTED */
+
+	for (i = 0; i < count; ++i) {
+		u8 *frame = buf + i * 12;
+
+		if (action == CTL_READ)
+			frame[0] = 0x01;	/* AV/C, STATUS */
+		else
+			frame[0] = 0x00;	/* AV/C, CONTROL */
+		frame[1] = 0x08;		/* audio unit 0 */
+		frame[2] = 0xb8;		/* FUNCTION BLOCK */
+		frame[3] = 0x81;		/* function block type: feature */
+		frame[4] = fb_id;		/* function block ID */
+		frame[5] = attribute;		/* control attribute */
+		frame[6] = 0x02;		/* selector length */
+		frame[7] = channels[i];		/* audio channel number */
+		frame[8] = 0x02;		/* control selector: volume */
+		frame[9] = 0x02;		/* control data length */
+		if (action == CTL_READ) {
+			frame[10] = 0xff;
+			frame[11] = 0xff;
+		} else {
+			frame[10] = values[i] >> 8;
+			frame[11] = values[i];
+		}
+
+		/* The channel number distinguishes the responses. */
+		commands[i].command = frame;
+		commands[i].command_size = 12;
+		commands[i].response = frame;
+		commands[i].response_size = 12;
+		commands[i].response_match_bytes = 0x3fe;
 	}
 
-	err = fcp_avc_transaction(unit, buf, 12, buf, 12, 0x3fe);
+	err = fcp_avc_transactions(unit, commands, count, depth);
 	if (err < 0)
 		goto error;
-	if (err < 12) {
-		dev_err(&unit->device, "short FCP response\n");
-		err = -EIO;
-		goto error;
-	}
-	if (buf[0] != response_ok) {
-		dev_err(&unit->device, "volume command failed\n");
-		err = -EIO;
-		goto error;
+
+	for (i = 0; i < count; ++i) {
+		u8 *frame = buf + i * 12;
+
+		err = commands[i].result;
+		if (err < 0)
+			goto error;
+		if (err < 12) {
+			dev_err(&unit->device, "short FCP response\n");
+			err = -EIO;
+			goto error;
+		}
+		if (frame[0] != response_ok) {
+			dev_err(&unit->device, "volume command failed\n");
+			err = -EIO;
+			goto error;
+		}
+		if (action == CTL_READ)
+			values[i] = (frame[10] << 8) | frame[11];
 	}
-	if (action == CTL_READ)
-		*value = (buf[10] << 8) | buf[11];
 
 	err = 0;
 
 error:
+	kfree(commands);
 	kfree(buf);
 
 	return err;
 }
 
+static int avc_audio_feature_volume(struct fw_unit *unit, u8 fb_id, s16 *value,
+				    unsigned int channel,
+				    enum control_attribute attribute,
+				    enum control_action action)
+{
+	u8 ch = channel;
+
+	return avc_audio_feature_volumes(unit, fb_id, value, &ch, 1, 1,
+					 attribute, action);
+}
+
 static int spkr_mute_get(struct snd_kcontrol *control,
 			 struct snd_ctl_elem_value *value)
 {
@@ -166,8 +210,10 @@ static int spkr_mute_put(struct snd_kcontrol *control,
 	if (mute == spkr->mute)
 		return 0;
 
+	snd_oxfw_transaction_gate_enter(oxfw);
 	err = avc_audio_feature_mute(oxfw->unit, spkr->mute_fb_id, &mute,
 				     CTL_WRITE);
+	snd_oxfw_transaction_gate_leave(oxfw);
 	if (err < 0)
 		return err;
 	spkr->mute = mute;
@@ -209,9 +255,10 @@ static int spkr_volume_put(struct snd_kcontrol *control,
 {
 	struct snd_oxfw *oxfw = control->private_data;
 	struct fw_spkr *spkr = oxfw->spec;
-	unsigned int i, changed_channels;
+	unsigned int i, changed_channels, count;
 	bool equal_values = true;
-	s16 volume;
+	s16 volumes[ARRAY_SIZE(spkr->volume) + 1];
+	u8 channels[ARRAY_SIZE(spkr->volume) + 1];
 	int err;
 
 	for (i = 0; i < spkr->mixer_channels; ++i) {
@@ -232,19 +279,29 @@ static int spkr_volume_put(struct snd_kcontrol *control,
 	if (equal_values && changed_channels != 0)
 		changed_channels = 1 << 0;
 
+	count = 0;
 	for (i = 0; i <= spkr->mixer_channels; ++i) {
-		volume = value->value.integer.value[channel_map[i ? i - 1 : 0]];
 		if (changed_channels & (1 << i)) {
-			err = avc_audio_feature_volume(oxfw->unit,
-						  spkr->volume_fb_id, &volume,
-						  i, CTL_CURRENT, CTL_WRITE);
-			if (err < 0)
-				return err;
+			volumes[count] = value->value.integer.value[channel_map[i ? i - 1 : 0]];
+			channels[count] = i;
+			++count;
 		}
-		if (i > 0)
-			spkr->volume[i - 1] = volume;
 	}
 
+	if (count > 0) {
+		snd_oxfw_transaction_gate_enter(oxfw);
+		err = avc_audio_feature_volumes(oxfw->unit, spkr->volume_fb_id,
+						volumes, channels, count,
+						snd_oxfw_fcp_depth(oxfw),
+						CTL_CURRENT, CTL_WRITE);
+		snd_oxfw_transaction_gate_leave(oxfw);
+		if (err < 0)
+			return err;
+	}
+
+	for (i = 0; i < spkr->mixer_channels; ++i)
+		spkr->volume[i] = value->value.integer.value[channel_map[i]];
+
 	return changed_channels != 0;
 }
 
@@ -267,6 +324,7 @@ int snd_oxfw_add_spkr(struct snd_oxfw *oxfw, bool is_lacie)
 		},
 	};
 	struct fw_spkr *spkr;
+	u8 channels[ARRAY_SIZE(spkr->volume)];
 	unsigned int i, first_ch;
 	int err;
 
@@ -301,13 +359,15 @@ int snd_oxfw_add_spkr(struct snd_oxfw *oxfw, bool is_lacie)
 		return err;
 
 	first_ch = spkr->mixer_channels == 1 ? 0 : 1;
-	for (i = 0; i < spkr->mixer_channels; ++i) {
-		err = avc_audio_feature_volume(oxfw->unit, spkr->volume_fb_id,
-					       &spkr->volume[i], first_ch + i,
-					       CTL_CURRENT, CTL_READ);
-		if (err < 0)
-			return err;
-	}
+	for (i = 0; i < spkr->mixer_channels; ++i)
+		channels[i] = first_ch + i;
+	err = avc_audio_feature_volumes(oxfw->unit, spkr->volume_fb_id,
+					spkr->volume, channels,
+					spkr->mixer_channels,
+					snd_oxfw_fcp_depth(oxfw), CTL_CURRENT,
+					CTL_READ);
+	if (err < 0)
+		return err;
 
 	for (i = 0; i < ARRAY_SIZE(controls); ++i) {
 		err = snd_ctl_add(oxfw->card,
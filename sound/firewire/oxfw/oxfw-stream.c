@@ -10,6 +10,8 @@
 
 #define AVC_GENERIC_FRAME_MAXIMUM_BYTES	512
 #define READY_TIMEOUT_MS	600
+#define FORMAT_SETTLE_MS	100
+#define TRANSACTION_SLOT_MS	50
 
 /*
  * According to datasheet of Oxford Semiconductor:
@@ -38,10 +40,25 @@ static const unsigned int avc_stream_rate_table[] = {
 	[5] = 0x07,
 };
 
+// Instead of sleeping just after changing format, the time is spent for the other work such as
+// reservation of isochronous resources.
+static void wait_format_settled(struct snd_oxfw *oxfw)
+{
+	if (oxfw->format_settling) {
+		long remaining = (long)(oxfw->format_settles_at - jiffies);
+
+		if (remaining > 0)
+			schedule_timeout_uninterruptible(remaining);
+		oxfw->format_settling = false;
+	}
+}
+
 static int set_rate(struct snd_oxfw *oxfw, unsigned int rate)
 {
 	int err;
 
+	wait_format_settled(oxfw);
+
 	err = avc_general_set_sig_fmt(oxfw->unit, rate,
 				      AVC_GENERAL_PLUG_DIR_IN, 0);
 	if (err < 0)
@@ -90,12 +107,14 @@ static int set_stream_format(struct snd_oxfw *oxfw, struct amdtp_stream *s,
 	/* Calculate format length. */
 	len = 5 + formats[i][4] * 2;
 
+	wait_format_settled(oxfw);
+
 	err = avc_stream_set_format(oxfw->unit, dir, 0, formats[i], len);
 	if (err < 0)
 		return err;
 
-	/* Some requests just after changing format causes freezing. */
-	msleep(100);
+	oxfw->format_settles_at = jiffies + msecs_to_jiffies(FORMAT_SETTLE_MS);
+	oxfw->format_settling = true;
 
 	return 0;
 }
@@ -110,6 +129,8 @@ static int start_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 	else
 		conn = &oxfw->out_conn;
 
+	wait_format_settled(oxfw);
+
 	err = cmp_connection_establish(conn);
 	if (err < 0)
 		return err;
@@ -193,29 +214,93 @@ static int init_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 		return err;
 	}
 
+	err = amdtp_stream_add_counters(stream, oxfw->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(stream);
+		cmp_connection_destroy(conn);
+		return err;
+	}
+
 	return 0;
 }
 
-static int keep_resources(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
+static bool is_streaming(struct snd_oxfw *oxfw)
+{
+	return amdtp_stream_running(&oxfw->rx_stream) ||
+	       (oxfw->has_output && amdtp_stream_running(&oxfw->tx_stream));
+}
+
+// The unit with SND_OXFW_QUIRK_JUMBO_PAYLOAD skips the cycles to transmit packets while it handles
+// an asynchronous transaction. While packet streaming, the transactions for control are serialized
+// and released once in TRANSACTION_SLOT_MS, so that the gap of packets in the stream is within the
+// tolerance. The caller calls snd_oxfw_transaction_gate_leave() after the transaction.
+void snd_oxfw_transaction_gate_enter(struct snd_oxfw *oxfw)
+{
+	mutex_lock(&oxfw->transaction_gate.mutex);
+
+	if ((oxfw->quirks & SND_OXFW_QUIRK_JUMBO_PAYLOAD) && is_streaming(oxfw)) {
+		long remaining = (long)(oxfw->transaction_gate.next_slot - jiffies);
+
+		if (remaining > 0)
+			schedule_timeout_uninterruptible(remaining);
+	}
+}
+
+void snd_oxfw_transaction_gate_leave(struct snd_oxfw *oxfw)
+{
+	oxfw->transaction_gate.next_slot = jiffies + msecs_to_jiffies(TRANSACTION_SLOT_MS);
+
+	mutex_unlock(&oxfw->transaction_gate.mutex);
+}
+
+static int read_current_formation(struct snd_oxfw *oxfw,
+				  enum avc_general_plug_dir dir,
+				  struct snd_oxfw_stream_formation *formation)
+{
+	u8 *format;
+	unsigned int len;
+	int err;
+
+	len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
+	format = kmalloc(len, GFP_KERNEL);
+	if (format == NULL)
+		return -ENOMEM;
+
+	wait_format_settled(oxfw);
+
+	snd_oxfw_transaction_gate_enter(oxfw);
+	err = avc_stream_get_format_single(oxfw->unit, dir, 0, format, &len);
+	snd_oxfw_transaction_gate_leave(oxfw);
+	if (err < 0)
+		goto end;
+	if (len < 3) {
+		err = -EIO;
+		goto end;
+	}
+
+	err = snd_oxfw_stream_parse_format(format, formation);
+end:
+	kfree(format);
+	return err;
+}
+
+static int set_stream_parameters(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 {
 	enum avc_general_plug_dir dir;
 	u8 **formats;
 	struct snd_oxfw_stream_formation formation;
-	struct cmp_connection *conn;
 	int i;
 	int err;
 
 	if (stream == &oxfw->rx_stream) {
 		dir = AVC_GENERAL_PLUG_DIR_IN;
 		formats = oxfw->rx_stream_formats;
-		conn = &oxfw->in_conn;
 	} else {
 		dir = AVC_GENERAL_PLUG_DIR_OUT;
 		formats = oxfw->tx_stream_formats;
-		conn = &oxfw->out_conn;
 	}
 
-	err = snd_oxfw_stream_get_current_formation(oxfw, dir, &formation);
+	err = read_current_formation(oxfw, dir, &formation);
 	if (err < 0)
 		return err;
 
@@ -240,12 +325,58 @@ static int keep_resources(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 	if (formation.pcm == 0)
 		return -EINVAL;
 
-	err = amdtp_am824_set_parameters(stream, formation.rate, formation.pcm,
-					 formation.midi * 8, false);
+	return amdtp_am824_set_parameters(stream, formation.rate, formation.pcm,
+					  formation.midi * 8, false);
+}
+
+static int keep_resources(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
+{
+	struct cmp_connection *conn;
+	int err;
+
+	if (stream == &oxfw->rx_stream)
+		conn = &oxfw->in_conn;
+	else
+		conn = &oxfw->out_conn;
+
+	err = set_stream_parameters(oxfw, stream);
 	if (err < 0)
 		return err;
 
-	return cmp_connection_reserve(conn, amdtp_stream_get_max_payload(stream));
+	return cmp_connection_adjust(conn, amdtp_stream_get_max_payload(stream));
+}
+
+// Count the resources which snd_oxfw_stream_reserve_duplex() requires for the current formation,
+// without any allocation of them. The parameters of streams are changed only when they are not
+// reserved yet.
+int snd_oxfw_stream_preflight(struct snd_oxfw *oxfw, struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(oxfw->unit)->max_speed;
+	int err;
+
+	if (oxfw->substreams_count == 0) {
+		err = set_stream_parameters(oxfw, &oxfw->rx_stream);
+		if (err < 0)
+			return err;
+
+		if (oxfw->has_output) {
+			err = set_stream_parameters(oxfw, &oxfw->tx_stream);
+			if (err < 0)
+				return err;
+		}
+	}
+
+	// The speed is decided in the same way as CMP connection.
+	fw_iso_preflight_add(preflight, oxfw->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&oxfw->rx_stream),
+			     min(oxfw->in_conn.max_speed, speed));
+	if (oxfw->has_output) {
+		fw_iso_preflight_add(preflight, oxfw->unit, FW_ISO_CONTEXT_RECEIVE,
+				     amdtp_stream_get_max_payload(&oxfw->tx_stream),
+				     min(oxfw->out_conn.max_speed, speed));
+	}
+
+	return 0;
 }
 
 int snd_oxfw_stream_reserve_duplex(struct snd_oxfw *oxfw,
@@ -274,6 +405,9 @@ int snd_oxfw_stream_reserve_duplex(struct snd_oxfw *oxfw,
 	else
 		dir = AVC_GENERAL_PLUG_DIR_IN;
 
+	// The formation is read again for the streams.
+	snd_oxfw_stream_invalidate_formation(oxfw);
+
 	err = snd_oxfw_stream_get_current_formation(oxfw, dir, &formation);
 	if (err < 0)
 		return err;
@@ -281,21 +415,19 @@ int snd_oxfw_stream_reserve_duplex(struct snd_oxfw *oxfw,
 		rate = formation.rate;
 		pcm_channels = formation.pcm;
 	}
+	// The isochronous resources are kept if they are enough for the new formation.
 	if (formation.rate != rate || formation.pcm != pcm_channels) {
 		amdtp_domain_stop(&oxfw->domain);
 
 		cmp_connection_break(&oxfw->in_conn);
-		cmp_connection_release(&oxfw->in_conn);
-
-		if (oxfw->has_output) {
+		if (oxfw->has_output)
 			cmp_connection_break(&oxfw->out_conn);
-			cmp_connection_release(&oxfw->out_conn);
-		}
 	}
 
 	if (oxfw->substreams_count == 0 ||
 	    formation.rate != rate || formation.pcm != pcm_channels) {
 		err = set_stream_format(oxfw, stream, rate, pcm_channels);
+		snd_oxfw_stream_invalidate_formation(oxfw);
 		if (err < 0) {
 			dev_err(&oxfw->unit->device,
 				"fail to set stream format: %d\n", err);
@@ -429,6 +561,27 @@ static void destroy_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 	cmp_connection_destroy(conn);
 }
 
+static void formation_changed(void *private_data, const u8 *frame, int length)
+{
+	struct snd_oxfw *oxfw = private_data;
+
+	snd_oxfw_stream_invalidate_formation(oxfw);
+}
+
+// The unit reports the change of signal format by the plug, if supported.
+static void subscribe_formation(struct snd_oxfw *oxfw, enum avc_general_plug_dir dir)
+{
+	struct fcp_avc_notification *n;
+
+	n = avc_general_notify_sig_fmt(oxfw->unit, dir, 0, formation_changed, oxfw);
+	if (IS_ERR(n)) {
+		dev_dbg(&oxfw->unit->device, "fail to subscribe to signal format: %ld\n",
+			PTR_ERR(n));
+		n = NULL;
+	}
+	oxfw->formation_notifications[dir] = n;
+}
+
 int snd_oxfw_stream_init_duplex(struct snd_oxfw *oxfw)
 {
 	int err;
@@ -450,15 +603,27 @@ int snd_oxfw_stream_init_duplex(struct snd_oxfw *oxfw)
 		destroy_stream(oxfw, &oxfw->rx_stream);
 		if (oxfw->has_output)
 			destroy_stream(oxfw, &oxfw->tx_stream);
+		return err;
 	}
 
-	return err;
+	subscribe_formation(oxfw, AVC_GENERAL_PLUG_DIR_IN);
+	if (oxfw->has_output)
+		subscribe_formation(oxfw, AVC_GENERAL_PLUG_DIR_OUT);
+
+	return 0;
 }
 
 // This function should be called before starting the stream or after stopping
 // the streams.
 void snd_oxfw_stream_destroy_duplex(struct snd_oxfw *oxfw)
 {
+	int i;
+
+	for (i = 0; i < AVC_GENERAL_PLUG_DIR_COUNT; ++i) {
+		fcp_avc_notification_destroy(oxfw->formation_notifications[i]);
+		oxfw->formation_notifications[i] = NULL;
+	}
+
 	amdtp_domain_destroy(&oxfw->domain);
 
 	destroy_stream(oxfw, &oxfw->rx_stream);
@@ -469,6 +634,14 @@ void snd_oxfw_stream_destroy_duplex(struct snd_oxfw *oxfw)
 
 void snd_oxfw_stream_update_duplex(struct snd_oxfw *oxfw)
 {
+	// Keep the streams running when the channel and the bandwidth are reallocated in the new
+	// generation of bus, and the connections are restored.
+	if (cmp_connection_update(&oxfw->in_conn) >= 0 &&
+	    (!oxfw->has_output || cmp_connection_update(&oxfw->out_conn) >= 0)) {
+		amdtp_domain_update(&oxfw->domain);
+		return;
+	}
+
 	amdtp_domain_stop(&oxfw->domain);
 
 	cmp_connection_break(&oxfw->in_conn);
@@ -482,31 +655,49 @@ void snd_oxfw_stream_update_duplex(struct snd_oxfw *oxfw)
 	}
 }
 
+// The current formation is kept in the cache till streams start, bus reset, or the change by
+// this driver, so that the readers of proc and PCM open don't issue AV/C transactions each time.
+// The generation count prevents a query in flight from storing the stale formation after
+// invalidation.
+void snd_oxfw_stream_invalidate_formation(struct snd_oxfw *oxfw)
+{
+	spin_lock_irq(&oxfw->lock);
+	oxfw->formation_cache.generation++;
+	memset(oxfw->formation_cache.valid, 0, sizeof(oxfw->formation_cache.valid));
+	spin_unlock_irq(&oxfw->lock);
+}
+
 int snd_oxfw_stream_get_current_formation(struct snd_oxfw *oxfw,
 				enum avc_general_plug_dir dir,
 				struct snd_oxfw_stream_formation *formation)
 {
-	u8 *format;
-	unsigned int len;
+	unsigned int generation;
 	int err;
 
-	len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
-	format = kmalloc(len, GFP_KERNEL);
-	if (format == NULL)
-		return -ENOMEM;
+	if (dir >= AVC_GENERAL_PLUG_DIR_COUNT)
+		return -EINVAL;
 
-	err = avc_stream_get_format_single(oxfw->unit, dir, 0, format, &len);
+	spin_lock_irq(&oxfw->lock);
+	if (oxfw->formation_cache.valid[dir]) {
+		*formation = oxfw->formation_cache.formations[dir];
+		spin_unlock_irq(&oxfw->lock);
+		return 0;
+	}
+	generation = oxfw->formation_cache.generation;
+	spin_unlock_irq(&oxfw->lock);
+
+	err = read_current_formation(oxfw, dir, formation);
 	if (err < 0)
-		goto end;
-	if (len < 3) {
-		err = -EIO;
-		goto end;
+		return err;
+
+	spin_lock_irq(&oxfw->lock);
+	if (generation == oxfw->formation_cache.generation) {
+		oxfw->formation_cache.formations[dir] = *formation;
+		oxfw->formation_cache.valid[dir] = true;
 	}
+	spin_unlock_irq(&oxfw->lock);
 
-	err = snd_oxfw_stream_parse_format(format, formation);
-end:
-	kfree(format);
-	return err;
+	return 0;
 }
 
 /*
@@ -654,12 +845,16 @@ static int fill_stream_formats(struct snd_oxfw *oxfw,
 			       enum avc_general_plug_dir dir,
 			       unsigned short pid)
 {
+	int results[FCP_AVC_MAX_DEPTH];
 	u8 *buf, **formats;
 	unsigned int len, eid = 0;
+	unsigned int depth = snd_oxfw_fcp_depth(oxfw);
+	unsigned int count, i;
 	struct snd_oxfw_stream_formation dummy;
 	int err;
 
-	buf = kmalloc(AVC_GENERIC_FRAME_MAXIMUM_BYTES, GFP_KERNEL);
+	buf = kmalloc_array(FCP_AVC_MAX_DEPTH, AVC_GENERIC_FRAME_MAXIMUM_BYTES,
+			    GFP_KERNEL);
 	if (buf == NULL)
 		return -ENOMEM;
 
@@ -685,48 +880,260 @@ static int fill_stream_formats(struct snd_oxfw *oxfw,
 		goto end;
 	}
 
-	/* LIST subfunction is implemented */
-	while (eid < SND_OXFW_STREAM_FORMAT_ENTRIES) {
-		/* The format is too short. */
-		if (len < 3) {
-			err = -EIO;
-			break;
+	/*
+	 * LIST subfunction is implemented. The commands for the rest of entries
+	 * are in flight at the same time by chunk of the depth. The query stops
+	 * at the chunk including the first rejected entry.
+	 */
+	results[0] = len;
+	count = 1;
+	for (;;) {
+		for (i = 0; i < count; ++i, ++eid) {
+			u8 *format = buf + i * AVC_GENERIC_FRAME_MAXIMUM_BYTES;
+
+			err = results[i];
+			/* No entries remained. */
+			if (err == -EINVAL) {
+				err = 0;
+				goto end;
+			} else if (err < 0) {
+				dev_err(&oxfw->unit->device,
+				"fail to get stream format %d for isoc %s plug %d:%d\n",
+					eid,
+					(dir == AVC_GENERAL_PLUG_DIR_IN) ? "in" : "out",
+					pid, err);
+				goto end;
+			}
+			len = err;
+
+			/* The format is too short. */
+			if (len < 3) {
+				err = -EIO;
+				goto end;
+			}
+
+			/* parse and set stream format */
+			err = snd_oxfw_stream_parse_format(format, &dummy);
+			if (err < 0)
+				goto end;
+
+			formats[eid] = devm_kmemdup(&oxfw->card->card_dev,
+						    format, len, GFP_KERNEL);
+			if (!formats[eid]) {
+				err = -ENOMEM;
+				goto end;
+			}
 		}
 
-		/* parse and set stream format */
-		err = snd_oxfw_stream_parse_format(buf, &dummy);
-		if (err < 0)
+		if (eid >= SND_OXFW_STREAM_FORMAT_ENTRIES)
 			break;
 
-		formats[eid] = devm_kmemdup(&oxfw->card->card_dev, buf, len,
-					    GFP_KERNEL);
-		if (!formats[eid]) {
-			err = -ENOMEM;
+		/* get next entries */
+		count = min_t(unsigned int, depth,
+			      SND_OXFW_STREAM_FORMAT_ENTRIES - eid);
+		err = avc_stream_get_format_lists(oxfw->unit, dir, 0, buf,
+						  AVC_GENERIC_FRAME_MAXIMUM_BYTES,
+						  results, eid, count, depth);
+		if (err < 0)
 			break;
+	}
+end:
+	kfree(buf);
+	return err;
+}
+
+// The result of discovery to be cached. The formats for both directions are packed in the
+// order of entries.
+#define DISCOVERY_CACHE_FORMAT_BYTES	1024
+
+struct discovery_cache {
+	u16 format_lengths[AVC_GENERAL_PLUG_DIR_COUNT][SND_OXFW_STREAM_FORMAT_ENTRIES];
+	u8 formats[DISCOVERY_CACHE_FORMAT_BYTES];
+	bool has_output;
+	bool has_input;
+	bool assumed;
+	unsigned int midi_input_ports;
+	unsigned int midi_output_ports;
+};
+
+static u8 **get_stream_formats(struct snd_oxfw *oxfw, enum avc_general_plug_dir dir)
+{
+	if (dir == AVC_GENERAL_PLUG_DIR_OUT)
+		return oxfw->tx_stream_formats;
+	else
+		return oxfw->rx_stream_formats;
+}
+
+// For the unit to implement LIST subfunction, just the first entry of stream format for one
+// direction is queried to validate the cache. Else the number of plugs is queried.
+static int validate_discovery_cache(struct snd_oxfw *oxfw, const struct discovery_cache *cache)
+{
+	enum avc_general_plug_dir dir;
+	unsigned int len;
+	u8 *buf;
+	int err;
+
+	if (cache->assumed) {
+		u8 plugs[AVC_PLUG_INFO_BUF_BYTES];
+
+		err = avc_general_get_plug_info(oxfw->unit, 0x1f, 0x07, 0x00, plugs);
+		if (err < 0)
+			return err;
+		if ((cache->has_input && plugs[0] == 0) || (cache->has_output && plugs[1] == 0))
+			return -ENODATA;
+		return 0;
+	}
+
+	if (cache->has_input)
+		dir = AVC_GENERAL_PLUG_DIR_IN;
+	else if (cache->has_output)
+		dir = AVC_GENERAL_PLUG_DIR_OUT;
+	else
+		return -ENODATA;
+
+	buf = kmalloc(AVC_GENERIC_FRAME_MAXIMUM_BYTES, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
+	err = avc_stream_get_format_list(oxfw->unit, dir, 0, buf, &len, 0);
+	if (err >= 0) {
+		// The first entry is at the head of packed formats in the direction.
+		unsigned int offset = 0;
+
+		if (dir == AVC_GENERAL_PLUG_DIR_OUT) {
+			unsigned int i;
+
+			for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; ++i)
+				offset += cache->format_lengths[AVC_GENERAL_PLUG_DIR_IN][i];
 		}
 
-		/* get next entry */
-		len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
-		err = avc_stream_get_format_list(oxfw->unit, dir, 0,
-						 buf, &len, ++eid);
-		/* No entries remained. */
-		if (err == -EINVAL) {
-			err = 0;
-			break;
-		} else if (err < 0) {
-			dev_err(&oxfw->unit->device,
-			"fail to get stream format %d for isoc %s plug %d:%d\n",
-				eid, (dir == AVC_GENERAL_PLUG_DIR_IN) ? "in" :
-									"out",
-				pid, err);
-			break;
+		if (len != cache->format_lengths[dir][0] ||
+		    memcmp(buf, cache->formats + offset, len))
+			err = -ENODATA;
+	}
+	kfree(buf);
+
+	return err;
+}
+
+// The cache may be restored by userspace, thus the packed formats should be within the buffer.
+static int check_discovery_cache_bounds(const struct discovery_cache *cache)
+{
+	unsigned int offset = 0;
+	int dir, i;
+
+	for (dir = 0; dir < AVC_GENERAL_PLUG_DIR_COUNT; ++dir) {
+		for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; ++i) {
+			unsigned int len = cache->format_lengths[dir][i];
+
+			if (len == 0)
+				continue;
+			if (len < 5 || len > sizeof(cache->formats) - offset ||
+			    len != 5 + cache->formats[offset + 4] * 2)
+				return -ENODATA;
+			offset += len;
 		}
 	}
+
+	return 0;
+}
+
+static int load_discovery_cache(struct snd_oxfw *oxfw)
+{
+	struct discovery_cache *cache;
+	unsigned int offset = 0;
+	int dir, i;
+	int err;
+
+	cache = kmalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return -ENOMEM;
+
+	err = snd_fw_discovery_cache_load(oxfw->unit, oxfw->firmware, cache, sizeof(*cache));
+	if (err < 0)
+		goto end;
+
+	err = check_discovery_cache_bounds(cache);
+	if (err >= 0)
+		err = validate_discovery_cache(oxfw, cache);
+	if (err < 0) {
+		if (err == -ENODATA)
+			snd_fw_discovery_cache_invalidate(oxfw->unit);
+		goto end;
+	}
+
+	for (dir = 0; dir < AVC_GENERAL_PLUG_DIR_COUNT; ++dir) {
+		u8 **formats = get_stream_formats(oxfw, dir);
+
+		for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; ++i) {
+			unsigned int len = cache->format_lengths[dir][i];
+
+			if (len == 0)
+				continue;
+
+			formats[i] = devm_kmemdup(&oxfw->card->card_dev, cache->formats + offset, len,
+						  GFP_KERNEL);
+			if (!formats[i]) {
+				err = -ENOMEM;
+				goto end;
+			}
+			offset += len;
+		}
+	}
+
+	oxfw->has_output = cache->has_output;
+	oxfw->has_input = cache->has_input;
+	oxfw->assumed = cache->assumed;
+	oxfw->midi_input_ports = cache->midi_input_ports;
+	oxfw->midi_output_ports = cache->midi_output_ports;
 end:
-	kfree(buf);
+	kfree(cache);
 	return err;
 }
 
+static void store_discovery_cache(struct snd_oxfw *oxfw)
+{
+	struct discovery_cache *cache;
+	unsigned int offset = 0;
+	int dir, i;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return;
+
+	for (dir = 0; dir < AVC_GENERAL_PLUG_DIR_COUNT; ++dir) {
+		u8 **formats = get_stream_formats(oxfw, dir);
+
+		for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; ++i) {
+			unsigned int len;
+
+			if (!formats[i])
+				continue;
+
+			len = 5 + formats[i][4] * 2;
+			// The result is just not cached.
+			if (offset + len > sizeof(cache->formats))
+				goto end;
+
+			memcpy(cache->formats + offset, formats[i], len);
+			cache->format_lengths[dir][i] = len;
+			offset += len;
+		}
+	}
+
+	cache->has_output = oxfw->has_output;
+	cache->has_input = oxfw->has_input;
+	cache->assumed = oxfw->assumed;
+	cache->midi_input_ports = oxfw->midi_input_ports;
+	cache->midi_output_ports = oxfw->midi_output_ports;
+
+	// The failure just loses the chance of cache.
+	snd_fw_discovery_cache_store(oxfw->unit, oxfw->firmware, cache, sizeof(*cache));
+end:
+	kfree(cache);
+}
+
 int snd_oxfw_stream_discover(struct snd_oxfw *oxfw)
 {
 	u8 plugs[AVC_PLUG_INFO_BUF_BYTES];
@@ -735,6 +1142,9 @@ int snd_oxfw_stream_discover(struct snd_oxfw *oxfw)
 	unsigned int i;
 	int err;
 
+	if (load_discovery_cache(oxfw) >= 0)
+		return 0;
+
 	/* the number of plugs for isoc in/out, ext in/out  */
 	err = avc_general_get_plug_info(oxfw->unit, 0x1f, 0x07, 0x00, plugs);
 	if (err < 0) {
@@ -802,6 +1212,9 @@ int snd_oxfw_stream_discover(struct snd_oxfw *oxfw)
 			oxfw->has_input = true;
 		}
 	}
+
+	if (err >= 0)
+		store_discovery_cache(oxfw);
 end:
 	return err;
 }
@@ -810,6 +1223,7 @@ void snd_oxfw_stream_lock_changed(struct snd_oxfw *oxfw)
 {
 	oxfw->dev_lock_changed = true;
 	wake_up(&oxfw->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(oxfw->card, oxfw->dev_lock_count > 0);
 }
 
 int snd_oxfw_stream_lock_try(struct snd_oxfw *oxfw)
@@ -88,9 +88,10 @@ static int name_card(struct snd_oxfw *oxfw, const struct ieee1394_device_id *ent
 	if (err < 0)
 		goto end;
 	be32_to_cpus(&firmware);
+	oxfw->firmware = firmware;
 
 	if (firmware >> 20 == 0x970)
-		oxfw->quirks |= SND_OXFW_QUIRK_JUMBO_PAYLOAD;
+		oxfw->quirks |= SND_OXFW_QUIRK_JUMBO_PAYLOAD | SND_OXFW_QUIRK_SERIAL_FCP;
 
 	/* to apply card definitions */
 	if (entry->vendor_id == VENDOR_GRIFFIN || entry->vendor_id == VENDOR_LACIE) {
@@ -124,6 +125,7 @@ static void oxfw_card_free(struct snd_card *card)
 	if (oxfw->has_output || oxfw->has_input)
 		snd_oxfw_stream_destroy_duplex(oxfw);
 
+	mutex_destroy(&oxfw->transaction_gate.mutex);
 	mutex_destroy(&oxfw->mutex);
 	fw_unit_put(oxfw->unit);
 }
@@ -225,6 +227,8 @@ static int oxfw_probe(struct fw_unit *unit, const struct ieee1394_device_id *ent
 	oxfw->card = card;
 
 	mutex_init(&oxfw->mutex);
+	mutex_init(&oxfw->transaction_gate.mutex);
+	oxfw->transaction_gate.next_slot = jiffies;
 	spin_lock_init(&oxfw->lock);
 	init_waitqueue_head(&oxfw->hwdep_wait);
 
@@ -275,6 +279,7 @@ static void oxfw_bus_reset(struct fw_unit *unit)
 	struct snd_oxfw *oxfw = dev_get_drvdata(&unit->device);
 
 	fcp_bus_reset(oxfw->unit);
+	snd_oxfw_stream_invalidate_formation(oxfw);
 
 	if (oxfw->has_output || oxfw->has_input) {
 		mutex_lock(&oxfw->mutex);
@@ -376,6 +381,7 @@ static struct fw_driver oxfw_driver = {
 		.owner	= THIS_MODULE,
 		.name	= KBUILD_MODNAME,
 		.bus	= &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = oxfw_probe,
 	.update   = oxfw_bus_reset,
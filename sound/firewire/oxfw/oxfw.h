@@ -55,10 +55,18 @@ enum snd_oxfw_quirk {
 	// performs media clock recovery voluntarily. In the recovery, the packets with NO_INFO
 	// are ignored, thus driver should transfer packets with timestamp.
 	SND_OXFW_QUIRK_VOLUNTARY_RECOVERY = 0x20,
+	// OXFW970 handles one asynchronous transaction at a time while it postpones isochronous
+	// packets, thus AV/C commands are sent one by one.
+	SND_OXFW_QUIRK_SERIAL_FCP = 0x40,
 };
 
 /* This is an arbitrary number for convinience. */
 #define	SND_OXFW_STREAM_FORMAT_ENTRIES	10
+struct snd_oxfw_stream_formation {
+	unsigned int rate;
+	unsigned int pcm;
+	unsigned int midi;
+};
 struct snd_oxfw {
 	struct snd_card *card;
 	struct fw_unit *unit;
@@ -67,6 +75,8 @@ struct snd_oxfw {
 
 	// The combination of snd_oxfw_quirk enumeration-constants.
 	unsigned int quirks;
+	// The value of firmware identifier register, to key the cache of discovery.
+	u32 firmware;
 	bool has_output;
 	bool has_input;
 	u8 *tx_stream_formats[SND_OXFW_STREAM_FORMAT_ENTRIES];
@@ -87,6 +97,30 @@ struct snd_oxfw {
 
 	void *spec;
 
+	// The cache of current formation for each direction, invalidated at starting streams, bus
+	// reset, and change.
+	struct {
+		unsigned int generation;
+		bool valid[AVC_GENERAL_PLUG_DIR_COUNT];
+		struct snd_oxfw_stream_formation formations[AVC_GENERAL_PLUG_DIR_COUNT];
+	} formation_cache;
+
+	// The subscriptions to the change of signal format for each direction, to invalidate the
+	// cache.
+	struct fcp_avc_notification *formation_notifications[AVC_GENERAL_PLUG_DIR_COUNT];
+
+	// Some requests just after changing stream format cause freezing. The next request to the
+	// unit waits till the expiration.
+	bool format_settling;
+	unsigned long format_settles_at;
+
+	// The unit stops transmitting packets while it handles an asynchronous transaction. The
+	// transactions for control are released in slots while packet streaming.
+	struct {
+		struct mutex mutex;
+		unsigned long next_slot;
+	} transaction_gate;
+
 	struct amdtp_domain domain;
 };
 
@@ -114,6 +148,19 @@ avc_stream_get_format_list(struct fw_unit *unit,
 {
 	return avc_stream_get_format(unit, dir, pid, buf, len, eid);
 }
+int avc_stream_get_format_lists(struct fw_unit *unit,
+				enum avc_general_plug_dir dir, unsigned int pid,
+				u8 *buf, unsigned int len, int *results,
+				unsigned int first_eid, unsigned int count,
+				unsigned int depth);
+
+/* The number of AV/C commands in flight at the same time for the unit. */
+static inline unsigned int snd_oxfw_fcp_depth(const struct snd_oxfw *oxfw)
+{
+	if (oxfw->quirks & SND_OXFW_QUIRK_SERIAL_FCP)
+		return 1;
+	return FCP_AVC_MAX_DEPTH;
+}
 
 /*
  * AV/C Digital Interface Command Set General Specification 4.2
@@ -129,21 +176,20 @@ int snd_oxfw_stream_reserve_duplex(struct snd_oxfw *oxfw,
 				   unsigned int rate, unsigned int pcm_channels,
 				   unsigned int frames_per_period,
 				   unsigned int frames_per_buffer);
+int snd_oxfw_stream_preflight(struct snd_oxfw *oxfw, struct fw_iso_preflight *preflight);
 int snd_oxfw_stream_start_duplex(struct snd_oxfw *oxfw);
 void snd_oxfw_stream_stop_duplex(struct snd_oxfw *oxfw);
 void snd_oxfw_stream_destroy_duplex(struct snd_oxfw *oxfw);
 void snd_oxfw_stream_update_duplex(struct snd_oxfw *oxfw);
 
-struct snd_oxfw_stream_formation {
-	unsigned int rate;
-	unsigned int pcm;
-	unsigned int midi;
-};
 int snd_oxfw_stream_parse_format(u8 *format,
 				 struct snd_oxfw_stream_formation *formation);
 int snd_oxfw_stream_get_current_formation(struct snd_oxfw *oxfw,
 				enum avc_general_plug_dir dir,
 				struct snd_oxfw_stream_formation *formation);
+void snd_oxfw_stream_invalidate_formation(struct snd_oxfw *oxfw);
+void snd_oxfw_transaction_gate_enter(struct snd_oxfw *oxfw);
+void snd_oxfw_transaction_gate_leave(struct snd_oxfw *oxfw);
 
 int snd_oxfw_stream_discover(struct snd_oxfw *oxfw);
 
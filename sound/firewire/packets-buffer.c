@@ -8,7 +8,102 @@
 #include <linux/firewire.h>
 #include <linux/export.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include "packets-buffer.h"
+#include "lib.h"
+
+/*
+ * Decide the layout of packets. The aligned size of packet is returned to
+ * @packet_size, and the number of packets per page to @packets_per_page, which
+ * is zero in compact layout.
+ */
+static unsigned int decide_layout(unsigned int count, unsigned int *packet_size,
+				  unsigned int *packets_per_page,
+				  enum dma_data_direction direction)
+{
+	unsigned int compact_size, compact_pages;
+	unsigned int pages;
+
+	if (direction == DMA_TO_DEVICE)
+		compact_size = ALIGN(*packet_size, sizeof(__be32));
+	else
+		compact_size = L1_CACHE_ALIGN(*packet_size);
+	compact_pages = DIV_ROUND_UP(count * compact_size, PAGE_SIZE);
+
+	*packet_size = L1_CACHE_ALIGN(*packet_size);
+	*packets_per_page = PAGE_SIZE / *packet_size;
+	if (*packets_per_page > 0)
+		pages = DIV_ROUND_UP(count, *packets_per_page);
+	else
+		pages = UINT_MAX;
+
+	if (compact_pages < pages) {
+		*packet_size = compact_size;
+		*packets_per_page = 0;
+		pages = compact_pages;
+	}
+
+	return pages;
+}
+
+/*
+ * Fill the array of packets in the pages. The offset of packet is relative to
+ * the page at @page_base.
+ */
+static int layout_packets(struct iso_packets_buffer *b, struct page **pages,
+			  unsigned int page_base, unsigned int page_count,
+			  unsigned int count, unsigned int packet_size,
+			  unsigned int packets_per_page)
+{
+	unsigned int i, page_index, offset_in_page;
+	void *p;
+
+	b->page_base = page_base;
+	b->page_count = page_count;
+	b->packet_size = packet_size;
+	b->packets_per_page = packets_per_page;
+
+	if (packets_per_page == 0) {
+		b->vaddr = vmap(pages, page_count, VM_MAP, PAGE_KERNEL);
+		if (!b->vaddr)
+			return -ENOMEM;
+
+		for (i = 0; i < count; ++i) {
+			b->packets[i].buffer = b->vaddr + i * packet_size;
+			b->packets[i].offset = page_base * PAGE_SIZE +
+					       i * packet_size;
+		}
+	} else {
+		for (i = 0; i < count; ++i) {
+			page_index = i / packets_per_page;
+			p = page_address(pages[page_index]);
+			offset_in_page = (i % packets_per_page) * packet_size;
+			b->packets[i].buffer = p + offset_in_page;
+			b->packets[i].offset = (page_base + page_index) * PAGE_SIZE +
+					       offset_in_page;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * iso_packets_buffer_pages - calculate the number of pages for packets
+ * @count: the number of packets
+ * @packet_size: the (maximum) size of a packet, in bytes
+ * @direction: %DMA_TO_DEVICE or %DMA_FROM_DEVICE
+ *
+ * Returns the number of pages which iso_packets_buffer_init() allocates, or
+ * iso_packets_buffer_init_in_pool() carves from the pool.
+ */
+unsigned int iso_packets_buffer_pages(unsigned int count, unsigned int packet_size,
+				      enum dma_data_direction direction)
+{
+	unsigned int packets_per_page;
+
+	return decide_layout(count, &packet_size, &packets_per_page, direction);
+}
+EXPORT_SYMBOL(iso_packets_buffer_pages);
 
 /**
  * iso_packets_buffer_init - allocates the memory for packets
@@ -17,45 +112,45 @@
  * @count: the number of packets
  * @packet_size: the (maximum) size of a packet, in bytes
  * @direction: %DMA_TO_DEVICE or %DMA_FROM_DEVICE
+ *
+ * By default, each packet is aligned to cache line and does not straddle pages.
+ * When the alignment wastes some pages, the packets are packed in compact
+ * layout instead. In the layout, the packet can straddle pages, thus the pages
+ * are mapped to virtually contiguous area. The packets for outgoing stream are
+ * aligned just to quadlet, since the device only reads them.
  */
 int iso_packets_buffer_init(struct iso_packets_buffer *b, struct fw_unit *unit,
 			    unsigned int count, unsigned int packet_size,
 			    enum dma_data_direction direction)
 {
 	unsigned int packets_per_page, pages;
-	unsigned int i, page_index, offset_in_page;
-	void *p;
 	int err;
 
-	b->packets = kmalloc_array(count, sizeof(*b->packets), GFP_KERNEL);
+	b->packets = kmalloc_array_node(count, sizeof(*b->packets), GFP_KERNEL,
+					snd_fw_unit_node(unit));
 	if (!b->packets) {
 		err = -ENOMEM;
 		goto error;
 	}
+	b->pool = NULL;
+	b->vaddr = NULL;
 
-	packet_size = L1_CACHE_ALIGN(packet_size);
-	packets_per_page = PAGE_SIZE / packet_size;
-	if (WARN_ON(!packets_per_page)) {
-		err = -EINVAL;
-		goto err_packets;
-	}
-	pages = DIV_ROUND_UP(count, packets_per_page);
+	pages = decide_layout(count, &packet_size, &packets_per_page, direction);
 
 	err = fw_iso_buffer_init(&b->iso_buffer, fw_parent_device(unit)->card,
 				 pages, direction);
 	if (err < 0)
 		goto err_packets;
 
-	for (i = 0; i < count; ++i) {
-		page_index = i / packets_per_page;
-		p = page_address(b->iso_buffer.pages[page_index]);
-		offset_in_page = (i % packets_per_page) * packet_size;
-		b->packets[i].buffer = p + offset_in_page;
-		b->packets[i].offset = page_index * PAGE_SIZE + offset_in_page;
-	}
+	err = layout_packets(b, b->iso_buffer.pages, 0, pages, count,
+			     packet_size, packets_per_page);
+	if (err < 0)
+		goto err_iso_buffer;
 
 	return 0;
 
+err_iso_buffer:
+	fw_iso_buffer_destroy(&b->iso_buffer, fw_parent_device(unit)->card);
 err_packets:
 	kfree(b->packets);
 error:
@@ -63,6 +158,63 @@ error:
 }
 EXPORT_SYMBOL(iso_packets_buffer_init);
 
+/**
+ * iso_packets_buffer_init_in_pool - carves the memory for packets from a pool
+ * @b: the buffer structure to initialize
+ * @pool: the pool reserved by iso_packets_pool_reserve()
+ * @count: the number of packets
+ * @packet_size: the (maximum) size of a packet, in bytes
+ * @direction: %DMA_TO_DEVICE or %DMA_FROM_DEVICE
+ *
+ * The layout of packets is the same as iso_packets_buffer_init(). The region
+ * starts at page boundary. Returns -ENOSPC when the rest of pool is not enough
+ * for the packets, then the caller can fall back to iso_packets_buffer_init().
+ */
+int iso_packets_buffer_init_in_pool(struct iso_packets_buffer *b,
+				    struct iso_packets_pool *pool,
+				    unsigned int count, unsigned int packet_size,
+				    enum dma_data_direction direction)
+{
+	unsigned int packets_per_page, pages;
+	int err;
+
+	if (!pool->allocated || pool->detached ||
+	    pool->iso_buffer.direction != direction)
+		return -ENODEV;
+
+	pages = decide_layout(count, &packet_size, &packets_per_page, direction);
+	if (pages > pool->iso_buffer.page_count - pool->used)
+		return -ENOSPC;
+
+	b->packets = kmalloc_array_node(count, sizeof(*b->packets), GFP_KERNEL,
+					dev_to_node(pool->card->device));
+	if (!b->packets)
+		return -ENOMEM;
+	b->vaddr = NULL;
+
+	err = layout_packets(b, pool->iso_buffer.pages + pool->used, pool->used,
+			     pages, count, packet_size, packets_per_page);
+	if (err < 0) {
+		kfree(b->packets);
+		return err;
+	}
+
+	b->pool = pool;
+	pool->used += pages;
+	++pool->regions;
+
+	return 0;
+}
+EXPORT_SYMBOL(iso_packets_buffer_init_in_pool);
+
+static void release_pool(struct iso_packets_pool *pool)
+{
+	if (pool->allocated) {
+		fw_iso_buffer_destroy(&pool->iso_buffer, pool->card);
+		pool->allocated = false;
+	}
+}
+
 /**
  * iso_packets_buffer_destroy - frees packet buffer resources
  * @b: the buffer structure to free
@@ -71,7 +223,95 @@ EXPORT_SYMBOL(iso_packets_buffer_init);
 void iso_packets_buffer_destroy(struct iso_packets_buffer *b,
 				struct fw_unit *unit)
 {
-	fw_iso_buffer_destroy(&b->iso_buffer, fw_parent_device(unit)->card);
+	struct iso_packets_pool *pool = b->pool;
+
+	if (b->vaddr)
+		vunmap(b->vaddr);
+
+	if (pool) {
+		/* The region is reused at next reservation. */
+		if (--pool->regions == 0) {
+			pool->used = 0;
+			if (pool->detached)
+				release_pool(pool);
+		}
+		b->pool = NULL;
+	} else {
+		fw_iso_buffer_destroy(&b->iso_buffer,
+				      fw_parent_device(unit)->card);
+	}
+
 	kfree(b->packets);
 }
 EXPORT_SYMBOL(iso_packets_buffer_destroy);
+
+/**
+ * iso_packets_pool_init - initializes a pool of packet buffers
+ * @pool: the pool structure to initialize
+ *
+ * No memory is allocated till iso_packets_pool_reserve().
+ */
+void iso_packets_pool_init(struct iso_packets_pool *pool)
+{
+	pool->card = NULL;
+	pool->used = 0;
+	pool->regions = 0;
+	pool->allocated = false;
+	pool->detached = false;
+}
+EXPORT_SYMBOL(iso_packets_pool_init);
+
+/**
+ * iso_packets_pool_reserve - allocates the memory for the pool
+ * @pool: the pool structure
+ * @card: the card for which the memory is mapped
+ * @pages: the number of pages at least
+ * @direction: %DMA_TO_DEVICE or %DMA_FROM_DEVICE
+ *
+ * The memory already allocated is kept when it is large enough, therefore the
+ * allocation happens just once as long as the parameters of streams are the
+ * same. The memory can not be reallocated while any region is used.
+ */
+int iso_packets_pool_reserve(struct iso_packets_pool *pool,
+			     struct fw_card *card, unsigned int pages,
+			     enum dma_data_direction direction)
+{
+	int err;
+
+	if (pool->allocated && pool->card == card &&
+	    pool->iso_buffer.direction == direction &&
+	    pool->iso_buffer.page_count >= pages)
+		return 0;
+
+	if (pool->regions > 0)
+		return -EBUSY;
+
+	release_pool(pool);
+
+	err = fw_iso_buffer_init(&pool->iso_buffer, card, pages, direction);
+	if (err < 0)
+		return err;
+
+	pool->card = card;
+	pool->used = 0;
+	pool->allocated = true;
+	pool->detached = false;
+
+	return 0;
+}
+EXPORT_SYMBOL(iso_packets_pool_reserve);
+
+/**
+ * iso_packets_pool_destroy - frees the memory for the pool
+ * @pool: the pool structure
+ *
+ * When any region is still used, the memory is freed at the last call of
+ * iso_packets_buffer_destroy() for the region.
+ */
+void iso_packets_pool_destroy(struct iso_packets_pool *pool)
+{
+	pool->detached = true;
+	if (pool->regions == 0)
+		release_pool(pool);
+}
+EXPORT_SYMBOL(iso_packets_pool_destroy);
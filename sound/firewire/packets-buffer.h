@@ -5,23 +5,72 @@
 #include <linux/dma-mapping.h>
 #include <linux/firewire.h>
 
+/**
+ * struct iso_packets_pool - manages a buffer shared by several packet buffers
+ * @iso_buffer: the memory carved into the regions for packet buffers
+ * @card: the card for which the memory is mapped
+ * @used: the number of pages already carved
+ * @regions: the number of packet buffers in the pool
+ * @allocated: whether @iso_buffer is allocated
+ * @detached: whether the memory is released as soon as no region is used
+ */
+struct iso_packets_pool {
+	struct fw_iso_buffer iso_buffer;
+	struct fw_card *card;
+	unsigned int used;
+	unsigned int regions;
+	bool allocated;
+	bool detached;
+};
+
 /**
  * struct iso_packets_buffer - manages a buffer for many packets
  * @iso_buffer: the memory containing the packets
+ * @pool: the pool in which the packets are, or NULL
+ * @vaddr: the virtually contiguous mapping of the pages in compact layout, or NULL
+ * @page_base: the index of the first page for the packets in the memory
+ * @page_count: the number of pages for the packets
+ * @packet_size: the aligned size of packet
+ * @packets_per_page: the number of packets per page, or zero in compact layout
  * @packets: an array, with each element pointing to one packet
  */
 struct iso_packets_buffer {
 	struct fw_iso_buffer iso_buffer;
+	struct iso_packets_pool *pool;
+	void *vaddr;
+	unsigned int page_base;
+	unsigned int page_count;
+	unsigned int packet_size;
+	unsigned int packets_per_page;
 	struct {
 		void *buffer;
 		unsigned int offset;
 	} *packets;
 };
 
+unsigned int iso_packets_buffer_pages(unsigned int count, unsigned int packet_size,
+				      enum dma_data_direction direction);
 int iso_packets_buffer_init(struct iso_packets_buffer *b, struct fw_unit *unit,
 			    unsigned int count, unsigned int packet_size,
 			    enum dma_data_direction direction);
+int iso_packets_buffer_init_in_pool(struct iso_packets_buffer *b,
+				    struct iso_packets_pool *pool,
+				    unsigned int count, unsigned int packet_size,
+				    enum dma_data_direction direction);
 void iso_packets_buffer_destroy(struct iso_packets_buffer *b,
 				struct fw_unit *unit);
 
+void iso_packets_pool_init(struct iso_packets_pool *pool);
+int iso_packets_pool_reserve(struct iso_packets_pool *pool,
+			     struct fw_card *card, unsigned int pages,
+			     enum dma_data_direction direction);
+void iso_packets_pool_destroy(struct iso_packets_pool *pool);
+
+/* returns the memory to which the offsets of packets are relative */
+static inline struct fw_iso_buffer *
+iso_packets_buffer_iso(struct iso_packets_buffer *b)
+{
+	return b->pool ? &b->pool->iso_buffer : &b->iso_buffer;
+}
+
 #endif
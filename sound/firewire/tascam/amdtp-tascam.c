@@ -7,6 +7,7 @@
 
 #include <sound/pcm.h>
 #include "tascam.h"
+#include "../amdtp-pcm.h"
 
 #define AMDTP_FMT_TSCM_TX	0x1e
 #define AMDTP_FMT_TSCM_RX	0x3e
@@ -37,29 +38,9 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			  unsigned int pcm_frames)
 {
 	struct amdtp_tscm *p = s->protocol;
-	unsigned int channels = p->pcm_channels;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	const u32 *src;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
-
-	src = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
-
-	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			buffer[c] = cpu_to_be32(*src);
-			src++;
-		}
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			src = (void *)runtime->dma_area;
-	}
+
+	amdtp_pcm_write(s, pcm, buffer, frames, pcm_frames, p->pcm_channels,
+			0, 0x00000000, false);
 }
 
 static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
@@ -67,47 +48,18 @@ static void read_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			 unsigned int pcm_frames)
 {
 	struct amdtp_tscm *p = s->protocol;
-	unsigned int channels = p->pcm_channels;
-	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int pcm_buffer_pointer;
-	int remaining_frames;
-	u32 *dst;
-	int i, c;
-
-	pcm_buffer_pointer = s->pcm_buffer_pointer + pcm_frames;
-	pcm_buffer_pointer %= runtime->buffer_size;
-
-	dst  = (void *)runtime->dma_area +
-				frames_to_bytes(runtime, pcm_buffer_pointer);
-	remaining_frames = runtime->buffer_size - pcm_buffer_pointer;
 
 	/* The first data channel is for event counter. */
-	buffer += 1;
-
-	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			*dst = be32_to_cpu(buffer[c]);
-			dst++;
-		}
-		buffer += s->data_block_quadlets;
-		if (--remaining_frames == 0)
-			dst = (void *)runtime->dma_area;
-	}
+	amdtp_pcm_read(s, pcm, buffer + 1, frames, pcm_frames, p->pcm_channels,
+		       0, 0xffffffff, false);
 }
 
 static void write_pcm_silence(struct amdtp_stream *s, __be32 *buffer,
 			      unsigned int data_blocks)
 {
 	struct amdtp_tscm *p = s->protocol;
-	unsigned int channels, i, c;
-
-	channels = p->pcm_channels;
 
-	for (i = 0; i < data_blocks; ++i) {
-		for (c = 0; c < channels; ++c)
-			buffer[c] = 0x00000000;
-		buffer += s->data_block_quadlets;
-	}
+	amdtp_pcm_write_silence(s, buffer, data_blocks, p->pcm_channels, 0x00000000, false);
 }
 
 int amdtp_tscm_add_pcm_hw_constraints(struct amdtp_stream *s,
@@ -126,11 +78,33 @@ int amdtp_tscm_add_pcm_hw_constraints(struct amdtp_stream *s,
 	return amdtp_stream_add_pcm_hw_constraints(s, runtime);
 }
 
-static void read_status_messages(struct amdtp_stream *s,
-				 __be32 *buffer, unsigned int data_blocks)
+// Whether any consumer of hwdep is active. Without it, the state is not scanned at all.
+static bool is_state_consumed(struct snd_tscm *tscm)
+{
+	if (snd_fw_event_mux_is_open())
+		return true;
+	if (!READ_ONCE(tscm->hwdep->used))
+		return false;
+
+	return snd_fw_event_ring_is_mapped(&tscm->event_ring) ||
+	       waitqueue_active(&tscm->hwdep_wait) ||
+	       time_before(jiffies, READ_ONCE(tscm->state_expires));
+}
+
+// Returns true if any state changed.
+static bool read_status_messages(struct amdtp_stream *s,
+				 __be32 *buffer, unsigned int data_blocks,
+				 unsigned int pull_pos, unsigned int *push_pos,
+				 u32 generation)
 {
 	struct snd_tscm *tscm = container_of(s, struct snd_tscm, tx_stream);
 	bool used = READ_ONCE(tscm->hwdep->used);
+	bool mapped = used && snd_fw_event_ring_is_mapped(&tscm->event_ring);
+	bool muxed = snd_fw_event_mux_is_open();
+	struct snd_firewire_event_tascam_control *event = NULL;
+	bool reserved = false;
+	unsigned int count = 0;
+	bool changed = false;
 	int i;
 
 	for (i = 0; i < data_blocks; i++) {
@@ -142,7 +116,9 @@ static void read_status_messages(struct amdtp_stream *s,
 		before = tscm->state[index];
 		after = buffer[s->data_block_quadlets - 1];
 
-		if (used && index > 4 && index < 16) {
+		// The change of stale entry is not notified.
+		if ((used || muxed) && index > 4 && index < 16 &&
+		    (tscm->state_synced & BIT_ULL(index))) {
 			__be32 mask;
 
 			if (index == 5)
@@ -154,26 +130,65 @@ static void read_status_messages(struct amdtp_stream *s,
 			else
 				mask = cpu_to_be32(~0x00000000);
 
-			if ((before ^ after) & mask) {
-				struct snd_firewire_tascam_change *entry =
-						&tscm->queue[tscm->push_pos];
-				unsigned long flag;
+			// One event per change for the multiplexer of all cards.
+			if (((before ^ after) & mask) && muxed) {
+				struct snd_firewire_tascam_change change = {
+					.index = index,
+					.before = before,
+					.after = after,
+				};
 
-				spin_lock_irqsave(&tscm->lock, flag);
-				entry->index = index;
-				entry->before = before;
-				entry->after = after;
-				if (++tscm->push_pos >= SND_TSCM_QUEUE_COUNT)
-					tscm->push_pos = 0;
-				spin_unlock_irqrestore(&tscm->lock, flag);
+				snd_fw_event_mux_post(tscm->card, SNDRV_FIREWIRE_EVENT_TASCAM_CONTROL,
+						      &change, sizeof(change));
+			}
 
-				wake_up(&tscm->hwdep_wait);
+			if (((before ^ after) & mask) && mapped) {
+				struct snd_firewire_tascam_change *entry;
+
+				// One event per packet for all of changes in it.
+				if (!reserved) {
+					event = snd_fw_event_ring_reserve(&tscm->event_ring,
+							struct_size(event, changes, data_blocks));
+					reserved = true;
+				}
+				if (event) {
+					entry = &event->changes[count++];
+					entry->index = index;
+					entry->before = before;
+					entry->after = after;
+				}
+			} else if (((before ^ after) & mask) && used) {
+				// The change is dropped when the queue is full.
+				if (*push_pos - pull_pos < SND_TSCM_QUEUE_COUNT) {
+					struct snd_firewire_tascam_change *entry =
+						&tscm->queue[*push_pos % SND_TSCM_QUEUE_COUNT];
+
+					entry->index = index;
+					entry->before = before;
+					entry->after = after;
+					++*push_pos;
+				}
 			}
 		}
 
-		tscm->state[index] = after;
+		if (before != after) {
+			WRITE_ONCE(tscm->state[index], after);
+			// The state should be visible when the generation is.
+			smp_wmb();
+			WRITE_ONCE(tscm->state_generations[index], generation);
+			changed = true;
+		}
+		tscm->state_synced |= BIT_ULL(index);
 		buffer += s->data_block_quadlets;
 	}
+
+	if (event && count > 0) {
+		event->type = SNDRV_FIREWIRE_EVENT_TASCAM_CONTROL;
+		snd_fw_event_ring_commit(&tscm->event_ring,
+					 struct_size(event, changes, count));
+	}
+
+	return changed;
 }
 
 static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
@@ -181,9 +196,25 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 					    unsigned int packets,
 					    struct snd_pcm_substream *pcm)
 {
+	struct snd_tscm *tscm = container_of(s, struct snd_tscm, tx_stream);
+	unsigned int pull_pos = smp_load_acquire(&tscm->pull_pos);
+	unsigned int push_pos = tscm->push_pos;
+	u32 generation = tscm->state_generation + 1;
+	// The scan is shed as well when the pass exceeds the budget.
+	bool consumed = is_state_consumed(tscm) && !amdtp_stream_shedding(s);
+	bool changed = false;
+	bool published;
 	unsigned int pcm_frames = 0;
 	int i;
 
+	// The generation 0 is reserved to retrieve all of the state.
+	if (generation == 0)
+		generation = 1;
+
+	// The state is refreshed lazily when the scan resumes.
+	if (!consumed)
+		tscm->state_synced = 0;
+
 	for (i = 0; i < packets; ++i) {
 		const struct pkt_desc *desc = descs + i;
 		__be32 *buf = desc->ctx_payload;
@@ -194,8 +225,27 @@ static unsigned int process_ir_ctx_payloads(struct amdtp_stream *s,
 			pcm_frames += data_blocks;
 		}
 
-		read_status_messages(s, buf, data_blocks);
+		if (consumed &&
+		    read_status_messages(s, buf, data_blocks, pull_pos, &push_pos,
+					 generation))
+			changed = true;
+	}
+
+	// Publish the changes in the batch of packets at once, then wake up.
+	published = false;
+	if (changed) {
+		smp_store_release(&tscm->state_generation, generation);
+		published = true;
+	}
+	if (push_pos != tscm->push_pos) {
+		smp_store_release(&tscm->push_pos, push_pos);
+		published = true;
 	}
+	if (snd_fw_event_ring_is_mapped(&tscm->event_ring) &&
+	    snd_fw_event_ring_publish(&tscm->event_ring))
+		published = true;
+	if (published)
+		wake_up(&tscm->hwdep_wait);
 
 	return pcm_frames;
 }
@@ -216,7 +266,8 @@ static unsigned int process_it_ctx_payloads(struct amdtp_stream *s,
 		if (pcm) {
 			write_pcm_s32(s, pcm, buf, data_blocks, pcm_frames);
 			pcm_frames += data_blocks;
-		} else {
+			amdtp_stream_pcm_silence_invalidate(s, desc);
+		} else if (!amdtp_stream_pcm_silence_cached(s, desc, data_blocks)) {
 			write_pcm_silence(s, buf, data_blocks);
 		}
 	}
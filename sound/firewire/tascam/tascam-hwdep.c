@@ -11,10 +11,18 @@
  * 1.get firewire node information
  * 2.get notification about starting/stopping stream
  * 3.lock/unlock stream
+ * 4.get change of control status via mapped ring
  */
 
 #include "tascam.h"
 
+// Keep the state scanned in packet processing for a while.
+static void touch_state(struct snd_tscm *tscm)
+{
+	WRITE_ONCE(tscm->state_expires,
+		   jiffies + msecs_to_jiffies(SND_TSCM_STATE_IDLE_MS));
+}
+
 static long tscm_hwdep_read_locked(struct snd_tscm *tscm, char __user *buf,
 				   long count, loff_t *offset)
 	__releases(&tscm->lock)
@@ -55,18 +63,19 @@ static long tscm_hwdep_read_queue(struct snd_tscm *tscm, char __user *buf,
 	remained -= sizeof(type);
 	pos += sizeof(type);
 
+	// The lock serializes consumers. The producer in softirq doesn't use it.
 	while (true) {
+		unsigned int push_pos = smp_load_acquire(&tscm->push_pos);
+		unsigned int pull_pos = tscm->pull_pos;
 		unsigned int head_pos;
 		unsigned int tail_pos;
 		unsigned int length;
 
-		if (tscm->pull_pos == tscm->push_pos)
+		if (pull_pos == push_pos)
 			break;
-		else if (tscm->pull_pos < tscm->push_pos)
-			tail_pos = tscm->push_pos;
-		else
-			tail_pos = SND_TSCM_QUEUE_COUNT;
-		head_pos = tscm->pull_pos;
+		head_pos = pull_pos % SND_TSCM_QUEUE_COUNT;
+		tail_pos = head_pos + min(push_pos - pull_pos,
+					  SND_TSCM_QUEUE_COUNT - head_pos);
 
 		length = (tail_pos - head_pos) * sizeof(*entries);
 		if (remained < length)
@@ -80,7 +89,8 @@ static long tscm_hwdep_read_queue(struct snd_tscm *tscm, char __user *buf,
 
 		spin_lock_irq(&tscm->lock);
 
-		tscm->pull_pos = tail_pos % SND_TSCM_QUEUE_COUNT;
+		smp_store_release(&tscm->pull_pos,
+				  pull_pos + length / sizeof(*entries));
 
 		count += length;
 		remained -= length;
@@ -99,24 +109,28 @@ static long hwdep_read(struct snd_hwdep *hwdep, char __user *buf, long count,
 		       loff_t *offset)
 {
 	struct snd_tscm *tscm = hwdep->private_data;
-	DEFINE_WAIT(wait);
+	int err;
+
+	touch_state(tscm);
 
 	spin_lock_irq(&tscm->lock);
 
-	while (!tscm->dev_lock_changed && tscm->push_pos == tscm->pull_pos) {
-		prepare_to_wait(&tscm->hwdep_wait, &wait, TASK_INTERRUPTIBLE);
+	// The producer in softirq doesn't take the lock. The task is queued to the wait queue
+	// before evaluating the condition, thus the wake up after the release of push_pos is not
+	// lost. The acquire of push_pos pairs with the release by the producer.
+	err = wait_event_interruptible_lock_irq(tscm->hwdep_wait,
+			tscm->dev_lock_changed ||
+			smp_load_acquire(&tscm->push_pos) != tscm->pull_pos,
+			tscm->lock);
+	if (err < 0) {
 		spin_unlock_irq(&tscm->lock);
-		schedule();
-		finish_wait(&tscm->hwdep_wait, &wait);
-		if (signal_pending(current))
-			return -ERESTARTSYS;
-		spin_lock_irq(&tscm->lock);
+		return err;
 	}
 
 	// NOTE: The acquired lock should be released in callee side.
 	if (tscm->dev_lock_changed) {
 		count = tscm_hwdep_read_locked(tscm, buf, count, offset);
-	} else if (tscm->push_pos != tscm->pull_pos) {
+	} else if (smp_load_acquire(&tscm->push_pos) != tscm->pull_pos) {
 		count = tscm_hwdep_read_queue(tscm, buf, count, offset);
 	} else {
 		spin_unlock_irq(&tscm->lock);
@@ -133,9 +147,15 @@ static __poll_t hwdep_poll(struct snd_hwdep *hwdep, struct file *file,
 	__poll_t events;
 
 	poll_wait(file, &tscm->hwdep_wait, wait);
+	touch_state(tscm);
 
+	// The wait queue is registered above before evaluating the condition. The acquire of
+	// push_pos pairs with the release by the producer.
 	spin_lock_irq(&tscm->lock);
-	if (tscm->dev_lock_changed || tscm->push_pos != tscm->pull_pos)
+	if (tscm->dev_lock_changed || smp_load_acquire(&tscm->push_pos) != tscm->pull_pos)
+		events = EPOLLIN | EPOLLRDNORM;
+	else if (snd_fw_event_ring_is_mapped(&tscm->event_ring) &&
+		 snd_fw_event_ring_has_event(&tscm->event_ring))
 		events = EPOLLIN | EPOLLRDNORM;
 	else
 		events = 0;
@@ -201,12 +221,73 @@ static int hwdep_unlock(struct snd_tscm *tscm)
 
 static int tscm_hwdep_state(struct snd_tscm *tscm, void __user *arg)
 {
+	touch_state(tscm);
+
 	if (copy_to_user(arg, tscm->state, sizeof(tscm->state)))
 		return -EFAULT;
 
 	return 0;
 }
 
+static int tscm_hwdep_state_delta(struct snd_tscm *tscm, void __user *arg)
+{
+	struct snd_firewire_tascam_state_delta *delta;
+	u32 since;
+	u32 generation;
+	int i;
+	int err = 0;
+
+	delta = kzalloc(sizeof(*delta), GFP_KERNEL);
+	if (!delta)
+		return -ENOMEM;
+
+	if (copy_from_user(delta, arg, offsetof(typeof(*delta), mask))) {
+		err = -EFAULT;
+		goto end;
+	}
+	since = delta->generation;
+
+	touch_state(tscm);
+
+	if (delta->flags & SNDRV_FIREWIRE_TASCAM_STATE_DELTA_WAIT) {
+		err = wait_event_interruptible(tscm->hwdep_wait,
+				smp_load_acquire(&tscm->state_generation) != since);
+		if (err < 0)
+			goto end;
+	}
+
+	generation = smp_load_acquire(&tscm->state_generation);
+
+	delta->mask = 0;
+	for (i = 0; i < SNDRV_FIREWIRE_TASCAM_STATE_COUNT; ++i) {
+		u32 changed_at = READ_ONCE(tscm->state_generations[i]);
+
+		// The state is newer than or equal to the generation.
+		smp_rmb();
+		if (since == 0 || (s32)(changed_at - since) > 0) {
+			delta->mask |= BIT_ULL(i);
+			delta->data[i] = READ_ONCE(tscm->state[i]);
+		}
+	}
+	delta->generation = generation;
+
+	if (copy_to_user(arg, delta, sizeof(*delta)))
+		err = -EFAULT;
+end:
+	kfree(delta);
+	return err;
+}
+
+static int hwdep_open(struct snd_hwdep *hwdep, struct file *file)
+{
+	struct snd_tscm *tscm = hwdep->private_data;
+
+	// The state scanned before is possibly stale. It is refreshed in packet processing.
+	touch_state(tscm);
+
+	return 0;
+}
+
 static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 {
 	struct snd_tscm *tscm = hwdep->private_data;
@@ -216,9 +297,28 @@ static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 		tscm->dev_lock_count = 0;
 	spin_unlock_irq(&tscm->lock);
 
+	snd_fw_event_ring_unmap(&tscm->event_ring);
+
 	return 0;
 }
 
+static int hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+		      struct vm_area_struct *area)
+{
+	struct snd_tscm *tscm = hwdep->private_data;
+
+	if (area->vm_pgoff >= SNDRV_FIREWIRE_STREAM_TIMING_PAGE_OFFSET >> PAGE_SHIFT) {
+		struct amdtp_stream *const streams[] = {
+			&tscm->tx_stream,
+			&tscm->rx_stream,
+		};
+
+		return amdtp_stream_timing_mmap(streams, ARRAY_SIZE(streams), area);
+	}
+
+	return snd_fw_event_ring_mmap(&tscm->event_ring, area);
+}
+
 static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 	    unsigned int cmd, unsigned long arg)
 {
@@ -231,8 +331,15 @@ static int hwdep_ioctl(struct snd_hwdep *hwdep, struct file *file,
 		return hwdep_lock(tscm);
 	case SNDRV_FIREWIRE_IOCTL_UNLOCK:
 		return hwdep_unlock(tscm);
+	case SNDRV_FIREWIRE_IOCTL_GET_STREAM_RATE:
+		return amdtp_stream_get_rate_estimate(&tscm->tx_stream, 1,
+						      (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_SYNC_START:
+		return amdtp_domain_sync_start_ioctl(&tscm->domain, tscm->unit, (void __user *)arg);
 	case SNDRV_FIREWIRE_IOCTL_TASCAM_STATE:
 		return tscm_hwdep_state(tscm, (void __user *)arg);
+	case SNDRV_FIREWIRE_IOCTL_TASCAM_STATE_DELTA:
+		return tscm_hwdep_state_delta(tscm, (void __user *)arg);
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -252,15 +359,21 @@ static int hwdep_compat_ioctl(struct snd_hwdep *hwdep, struct file *file,
 int snd_tscm_create_hwdep_device(struct snd_tscm *tscm)
 {
 	static const struct snd_hwdep_ops ops = {
+		.open		= hwdep_open,
 		.read		= hwdep_read,
 		.release	= hwdep_release,
 		.poll		= hwdep_poll,
 		.ioctl		= hwdep_ioctl,
 		.ioctl_compat	= hwdep_compat_ioctl,
+		.mmap		= hwdep_mmap,
 	};
 	struct snd_hwdep *hwdep;
 	int err;
 
+	err = snd_fw_event_ring_init(&tscm->event_ring, SND_FW_EVENT_RING_SIZE);
+	if (err < 0)
+		return err;
+
 	err = snd_hwdep_new(tscm->card, "Tascam", 0, &hwdep);
 	if (err < 0)
 		return err;
@@ -17,7 +17,11 @@ static int midi_playback_open(struct snd_rawmidi_substream *substream)
 {
 	struct snd_tscm *tscm = substream->rmidi->private_data;
 
-	snd_fw_async_midi_port_init(&tscm->out_ports[substream->number]);
+	struct snd_tscm_midi_out_port *out_port =
+					&tscm->out_ports[substream->number];
+
+	out_port->running_status = 0;
+	out_port->on_sysex = false;
 
 	return 0;
 }
@@ -30,6 +34,10 @@ static int midi_capture_close(struct snd_rawmidi_substream *substream)
 
 static int midi_playback_close(struct snd_rawmidi_substream *substream)
 {
+	struct snd_tscm *tscm = substream->rmidi->private_data;
+
+	snd_fw_async_midi_port_finish(&tscm->out_ports[substream->number].port);
+
 	return 0;
 }
 
@@ -37,7 +45,7 @@ static void midi_playback_drain(struct snd_rawmidi_substream *substream)
 {
 	struct snd_tscm *tscm = substream->rmidi->private_data;
 
-	snd_fw_async_midi_port_finish(&tscm->out_ports[substream->number]);
+	snd_fw_async_midi_port_finish(&tscm->out_ports[substream->number].port);
 }
 
 static void midi_capture_trigger(struct snd_rawmidi_substream *substrm, int up)
@@ -63,7 +71,7 @@ static void midi_playback_trigger(struct snd_rawmidi_substream *substrm, int up)
 	spin_lock_irqsave(&tscm->lock, flags);
 
 	if (up)
-		snd_fw_async_midi_port_run(&tscm->out_ports[substrm->number],
+		snd_fw_async_midi_port_run(&tscm->out_ports[substrm->number].port,
 					   substrm);
 
 	spin_unlock_irqrestore(&tscm->lock, flags);
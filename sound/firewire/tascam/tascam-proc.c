@@ -49,6 +49,44 @@ static void proc_read_firmware(struct snd_info_entry *entry,
 	snd_iprintf(buffer, "Hardware: %d (0x%08x)\n", hw >> 16, hw);
 }
 
+static void proc_read_histograms(struct snd_info_entry *entry,
+				 struct snd_info_buffer *buffer)
+{
+	struct snd_tscm *tscm = entry->private_data;
+
+	snd_iprintf(buffer, "Output Stream from device:\n");
+	amdtp_stream_dump_histograms(&tscm->tx_stream, buffer);
+	snd_iprintf(buffer, "Input Stream to device:\n");
+	amdtp_stream_dump_histograms(&tscm->rx_stream, buffer);
+}
+
+static void proc_read_preflight(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct snd_tscm *tscm = entry->private_data;
+	struct fw_iso_preflight preflight = {0};
+	unsigned int rate;
+	int err;
+
+	if (snd_tscm_stream_get_rate(tscm, &rate) < 0)
+		return;
+
+	mutex_lock(&tscm->mutex);
+	err = snd_tscm_stream_preflight(tscm, rate, &preflight);
+	mutex_unlock(&tscm->mutex);
+	if (err < 0)
+		return;
+
+	// The resources for the reserved streams are already out of the free ones.
+	err = fw_iso_preflight_check(&preflight, tscm->unit);
+	if (err < 0 && err != -ENOSPC)
+		return;
+
+	snd_iprintf(buffer, "Rate:\t%u\n", rate);
+	snd_iprintf(buffer, "Reserved:\t%s\n", tscm->substreams_counter > 0 ? "yes" : "no");
+	fw_iso_preflight_dump(&preflight, buffer);
+}
+
 static void add_node(struct snd_tscm *tscm, struct snd_info_entry *root,
 		     const char *name,
 		     void (*op)(struct snd_info_entry *e,
@@ -76,4 +114,7 @@ void snd_tscm_proc_init(struct snd_tscm *tscm)
 	root->mode = S_IFDIR | 0555;
 
 	add_node(tscm, root, "firmware", proc_read_firmware);
+	add_node(tscm, root, "histogram", proc_read_histograms);
+	add_node(tscm, root, "preflight", proc_read_preflight);
+	amdtp_domain_add_proc_nodes(&tscm->domain, root);
 }
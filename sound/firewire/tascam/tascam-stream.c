@@ -13,13 +13,17 @@
 
 #define READY_TIMEOUT_MS	4000
 
+// The clock status is in intermediate state for a while after changing it.
+#define CLOCK_TRANSITION_MS	250
+#define CLOCK_TRANSITION_POLL_US	5000
+
 static int get_clock(struct snd_tscm *tscm, u32 *data)
 {
-	int trial = 0;
+	unsigned long expires = jiffies + msecs_to_jiffies(CLOCK_TRANSITION_MS);
 	__be32 reg;
 	int err;
 
-	while (trial++ < 5) {
+	while (true) {
 		err = snd_fw_transaction(tscm->unit, TCODE_READ_QUADLET_REQUEST,
 				TSCM_ADDR_BASE + TSCM_OFFSET_CLOCK_STATUS,
 				&reg, sizeof(reg), 0);
@@ -30,13 +34,14 @@ static int get_clock(struct snd_tscm *tscm, u32 *data)
 		if (*data & CLOCK_STATUS_MASK)
 			break;
 
-		// In intermediate state after changing clock status.
-		msleep(50);
-	}
+		// Still in the intermediate state.
+		if (time_after(jiffies, expires))
+			return -EAGAIN;
 
-	// Still in the intermediate state.
-	if (trial >= 5)
-		return -EAGAIN;
+		// In intermediate state after changing clock status. Poll in short interval so
+		// that the fast transition is detected soon.
+		usleep_range(CLOCK_TRANSITION_POLL_US, CLOCK_TRANSITION_POLL_US * 2);
+	}
 
 	return 0;
 }
@@ -325,8 +330,16 @@ static int init_stream(struct snd_tscm *tscm, struct amdtp_stream *s)
 		return err;
 
 	err = amdtp_tscm_init(s, tscm->unit, dir, pcm_channels);
-	if (err < 0)
+	if (err < 0) {
 		fw_iso_resources_free(resources);
+		return err;
+	}
+
+	err = amdtp_stream_add_counters(s, tscm->card, 0);
+	if (err < 0) {
+		amdtp_stream_destroy(s);
+		fw_iso_resources_free(resources);
+	}
 
 	return err;
 }
@@ -383,6 +396,32 @@ void snd_tscm_stream_destroy_duplex(struct snd_tscm *tscm)
 	destroy_stream(tscm, &tscm->tx_stream);
 }
 
+// Count the resources which snd_tscm_stream_reserve_duplex() requires for the rate, without any
+// allocation of them. The parameters of streams are changed only when they are not reserved yet.
+int snd_tscm_stream_preflight(struct snd_tscm *tscm, unsigned int rate,
+			      struct fw_iso_preflight *preflight)
+{
+	int speed = fw_parent_device(tscm->unit)->max_speed;
+	int err;
+
+	if (tscm->substreams_counter == 0) {
+		err = amdtp_tscm_set_parameters(&tscm->tx_stream, rate);
+		if (err < 0)
+			return err;
+
+		err = amdtp_tscm_set_parameters(&tscm->rx_stream, rate);
+		if (err < 0)
+			return err;
+	}
+
+	fw_iso_preflight_add(preflight, tscm->unit, FW_ISO_CONTEXT_RECEIVE,
+			     amdtp_stream_get_max_payload(&tscm->tx_stream), speed);
+	fw_iso_preflight_add(preflight, tscm->unit, FW_ISO_CONTEXT_TRANSMIT,
+			     amdtp_stream_get_max_payload(&tscm->rx_stream), speed);
+
+	return 0;
+}
+
 int snd_tscm_stream_reserve_duplex(struct snd_tscm *tscm, unsigned int rate,
 				   unsigned int frames_per_period,
 				   unsigned int frames_per_buffer)
@@ -523,6 +562,7 @@ void snd_tscm_stream_lock_changed(struct snd_tscm *tscm)
 {
 	tscm->dev_lock_changed = true;
 	wake_up(&tscm->hwdep_wait);
+	snd_fw_event_mux_post_lock_status(tscm->card, tscm->dev_lock_count > 0);
 }
 
 int snd_tscm_stream_lock_try(struct snd_tscm *tscm)
@@ -58,32 +58,40 @@ static inline int calculate_message_bytes(u8 status)
 }
 
 static int fill_message(struct snd_fw_async_midi_port *port,
-			struct snd_rawmidi_substream *substream)
+			struct snd_rawmidi_substream *substream,
+			u8 *buf, unsigned int *consumed)
 {
+	struct snd_tscm_midi_out_port *out_port =
+			container_of(port, struct snd_tscm_midi_out_port, port);
 	int i, len, consume;
 	u8 *label, *msg;
 	u8 status;
 
 	/* The first byte is used for label, the rest for MIDI bytes. */
-	label = port->buf;
-	msg = port->buf + 1;
+	memset(buf, 0, 4);
+	label = buf;
+	msg = buf + 1;
 
 	consume = snd_rawmidi_transmit_peek(substream, msg, 3);
 	if (consume == 0)
 		return 0;
 
+	/* The beginning of exclusives. */
+	if (!out_port->on_sysex && msg[0] == 0xf0)
+		out_port->on_sysex = true;
+
 	/* On exclusive message. */
-	if (port->on_sysex) {
+	if (out_port->on_sysex) {
 		/* Seek the end of exclusives. */
 		for (i = 0; i < consume; ++i) {
 			if (msg[i] == 0xf7) {
-				port->on_sysex = false;
+				out_port->on_sysex = false;
 				break;
 			}
 		}
 
 		/* At the end of exclusive message, use label 0x07. */
-		if (!port->on_sysex) {
+		if (!out_port->on_sysex) {
 			consume = i + 1;
 			*label = (substream->number << 4) | 0x07;
 		/* During exclusive message, use label 0x04. */
@@ -96,41 +104,34 @@ static int fill_message(struct snd_fw_async_midi_port *port,
 
 		len = consume;
 	} else {
-		/* The beginning of exclusives. */
-		if (msg[0] == 0xf0) {
-			/* Transfer it in next chance in another condition. */
-			port->on_sysex = true;
+		/* On running-status. */
+		if ((msg[0] & 0x80) != 0x80)
+			status = out_port->running_status;
+		else
+			status = msg[0];
+
+		/* Calculate consume bytes. */
+		len = calculate_message_bytes(status);
+		if (len <= 0)
 			return 0;
+
+		/* On running-status. */
+		if ((msg[0] & 0x80) != 0x80) {
+			/* Enough MIDI bytes were not retrieved. */
+			if (consume < len - 1)
+				return 0;
+			consume = len - 1;
+
+			msg[2] = msg[1];
+			msg[1] = msg[0];
+			msg[0] = out_port->running_status;
 		} else {
-			/* On running-status. */
-			if ((msg[0] & 0x80) != 0x80)
-				status = port->running_status;
-			else
-				status = msg[0];
-
-			/* Calculate consume bytes. */
-			len = calculate_message_bytes(status);
-			if (len <= 0)
+			/* Enough MIDI bytes were not retrieved. */
+			if (consume < len)
 				return 0;
+			consume = len;
 
-			/* On running-status. */
-			if ((msg[0] & 0x80) != 0x80) {
-				/* Enough MIDI bytes were not retrieved. */
-				if (consume < len - 1)
-					return 0;
-				consume = len - 1;
-
-				msg[2] = msg[1];
-				msg[1] = msg[0];
-				msg[0] = port->running_status;
-			} else {
-				/* Enough MIDI bytes were not retrieved. */
-				if (consume < len)
-					return 0;
-				consume = len;
-
-				port->running_status = msg[0];
-			}
+			out_port->running_status = msg[0];
 		}
 
 		*label = (substream->number << 4) | (msg[0] >> 4);
@@ -139,107 +140,10 @@ static int fill_message(struct snd_fw_async_midi_port *port,
 	if (len > 0 && len < 3)
 		memset(msg + len, 0, 3 - len);
 
-	return consume;
-}
-
-static void async_midi_port_callback(struct fw_card *card, int rcode,
-				     void *data, size_t length,
-				     void *callback_data)
-{
-	struct snd_fw_async_midi_port *port = callback_data;
-	struct snd_rawmidi_substream *substream = READ_ONCE(port->substream);
-
-	/* This port is closed. */
-	if (substream == NULL)
-		return;
-
-	if (rcode == RCODE_COMPLETE)
-		snd_rawmidi_transmit_ack(substream, port->consume_bytes);
-	else if (!rcode_is_permanent_error(rcode))
-		/* To start next transaction immediately for recovery. */
-		port->next_ktime = 0;
-	else
-		/* Don't continue processing. */
-		port->error = true;
-
-	port->idling = true;
-
-	if (!snd_rawmidi_transmit_empty(substream))
-		schedule_work(&port->work);
-}
-
-static void midi_port_work(struct work_struct *work)
-{
-	struct snd_fw_async_midi_port *port =
-			container_of(work, struct snd_fw_async_midi_port, work);
-	struct snd_rawmidi_substream *substream = READ_ONCE(port->substream);
-	int generation;
-
-	/* Under transacting or error state. */
-	if (!port->idling || port->error)
-		return;
-
-	/* Nothing to do. */
-	if (substream == NULL || snd_rawmidi_transmit_empty(substream))
-		return;
+	*consumed = consume;
 
-	/* Do it in next chance. */
-	if (ktime_after(port->next_ktime, ktime_get())) {
-		schedule_work(&port->work);
-		return;
-	}
-
-	/*
-	 * Fill the buffer. The callee must use snd_rawmidi_transmit_peek().
-	 * Later, snd_rawmidi_transmit_ack() is called.
-	 */
-	memset(port->buf, 0, 4);
-	port->consume_bytes = fill_message(port, substream);
-	if (port->consume_bytes <= 0) {
-		/* Do it in next chance, immediately. */
-		if (port->consume_bytes == 0) {
-			port->next_ktime = 0;
-			schedule_work(&port->work);
-		} else {
-			/* Fatal error. */
-			port->error = true;
-		}
-		return;
-	}
-
-	/* Set interval to next transaction. */
-	port->next_ktime = ktime_add_ns(ktime_get(),
-			port->consume_bytes * 8 * (NSEC_PER_SEC / 31250));
-
-	/* Start this transaction. */
-	port->idling = false;
-
-	/*
-	 * In Linux FireWire core, when generation is updated with memory
-	 * barrier, node id has already been updated. In this module, After
-	 * this smp_rmb(), load/store instructions to memory are completed.
-	 * Thus, both of generation and node id are available with recent
-	 * values. This is a light-serialization solution to handle bus reset
-	 * events on IEEE 1394 bus.
-	 */
-	generation = port->parent->generation;
-	smp_rmb();
-
-	fw_send_request(port->parent->card, &port->transaction,
-			TCODE_WRITE_QUADLET_REQUEST,
-			port->parent->node_id, generation,
-			port->parent->max_speed,
-			TSCM_ADDR_BASE + TSCM_OFFSET_MIDI_RX_QUAD,
-			port->buf, 4, async_midi_port_callback,
-			port);
-}
-
-void snd_fw_async_midi_port_init(struct snd_fw_async_midi_port *port)
-{
-	port->idling = true;
-	port->error = false;
-	port->running_status = 0;
-	port->on_sysex = false;
+	/* One quadlet per transaction. */
+	return 4;
 }
 
 static void handle_midi_tx(struct fw_card *card, struct fw_request *request,
@@ -248,6 +152,8 @@ static void handle_midi_tx(struct fw_card *card, struct fw_request *request,
 			   void *data, size_t length, void *callback_data)
 {
 	struct snd_tscm *tscm = callback_data;
+	// The bytes for each port in the request are delivered at once.
+	struct amdtp_midi_batch batches[TSCM_MIDI_IN_PORT_MAX] = {};
 	u32 *buf = (u32 *)data;
 	unsigned int messages;
 	unsigned int i;
@@ -266,7 +172,7 @@ static void handle_midi_tx(struct fw_card *card, struct fw_request *request,
 		port = b[0] >> 4;
 		/* TODO: support virtual MIDI ports. */
 		if (port >= tscm->spec->midi_capture_ports)
-			goto end;
+			break;
 
 		/* Assume the message length. */
 		bytes = calculate_message_bytes(b[1]);
@@ -283,8 +189,11 @@ static void handle_midi_tx(struct fw_card *card, struct fw_request *request,
 
 		substream = READ_ONCE(tscm->tx_midi_substreams[port]);
 		if (substream != NULL)
-			snd_rawmidi_receive(substream, b + 1, bytes);
+			amdtp_midi_batch_push(&batches[port], substream, b + 1, bytes);
 	}
+
+	for (i = 0; i < TSCM_MIDI_IN_PORT_MAX; ++i)
+		amdtp_midi_batch_deliver(&batches[i]);
 end:
 	fw_send_response(card, request, RCODE_COMPLETE);
 }
@@ -317,9 +226,9 @@ int snd_tscm_transaction_register(struct snd_tscm *tscm)
 		goto error;
 
 	for (i = 0; i < TSCM_MIDI_OUT_PORT_MAX; i++) {
-		tscm->out_ports[i].parent = fw_parent_device(tscm->unit);
-		tscm->out_ports[i].next_ktime = 0;
-		INIT_WORK(&tscm->out_ports[i].work, midi_port_work);
+		snd_fw_async_midi_port_init(&tscm->out_ports[i].port,
+				tscm->unit, TSCM_ADDR_BASE + TSCM_OFFSET_MIDI_RX_QUAD,
+				fill_message);
 	}
 
 	return err;
@@ -90,6 +90,7 @@ static void tscm_card_free(struct snd_card *card)
 
 	snd_tscm_transaction_unregister(tscm);
 	snd_tscm_stream_destroy_duplex(tscm);
+	snd_fw_event_ring_destroy(&tscm->event_ring);
 
 	mutex_destroy(&tscm->mutex);
 	fw_unit_put(tscm->unit);
@@ -215,6 +216,7 @@ static struct fw_driver tscm_driver = {
 		.owner = THIS_MODULE,
 		.name = KBUILD_MODNAME,
 		.bus = &fw_bus_type,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe    = snd_tscm_probe,
 	.update   = snd_tscm_update,
@@ -47,24 +47,17 @@ struct snd_tscm_spec {
 #define TSCM_MIDI_IN_PORT_MAX	4
 #define TSCM_MIDI_OUT_PORT_MAX	4
 
-struct snd_fw_async_midi_port {
-	struct fw_device *parent;
-	struct work_struct work;
-	bool idling;
-	ktime_t next_ktime;
-	bool error;
-
-	struct fw_transaction transaction;
-
-	u8 buf[4];
+struct snd_tscm_midi_out_port {
+	struct snd_fw_async_midi_port port;
 	u8 running_status;
 	bool on_sysex;
-
-	struct snd_rawmidi_substream *substream;
-	int consume_bytes;
 };
 
-#define SND_TSCM_QUEUE_COUNT	16
+// The size of queue for control events. It should be power of 2.
+#define SND_TSCM_QUEUE_COUNT	512
+
+// The interval in which the state is kept scanned since the last access by consumer.
+#define SND_TSCM_STATE_IDLE_MS	1000
 
 struct snd_tscm {
 	struct snd_card *card;
@@ -90,14 +83,25 @@ struct snd_tscm {
 	struct snd_rawmidi_substream *tx_midi_substreams[TSCM_MIDI_IN_PORT_MAX];
 
 	/* For MIDI message outgoing transactions. */
-	struct snd_fw_async_midi_port out_ports[TSCM_MIDI_OUT_PORT_MAX];
+	struct snd_tscm_midi_out_port out_ports[TSCM_MIDI_OUT_PORT_MAX];
 
 	// A cache of status information in tx isoc packets.
 	__be32 state[SNDRV_FIREWIRE_TASCAM_STATE_COUNT];
+	// The generation at which each state changed last, and the latest one.
+	u32 state_generations[SNDRV_FIREWIRE_TASCAM_STATE_COUNT];
+	u32 state_generation;
+	// The state is scanned only while any consumer of hwdep is active; i.e. the ring is mapped,
+	// any task waits for events, or the state was accessed till the expiration. The bit flags
+	// represent the entries refreshed since the scan resumed, and the others can be stale.
+	unsigned long state_expires;
+	u64 state_synced;
 	struct snd_hwdep *hwdep;
+	// Single-producer/single-consumer queue. The positions run freely and
+	// are published with release semantics by each side.
 	struct snd_firewire_tascam_change queue[SND_TSCM_QUEUE_COUNT];
 	unsigned int pull_pos;
 	unsigned int push_pos;
+	struct snd_fw_event_ring event_ring;
 
 	struct amdtp_domain domain;
 	bool need_long_tx_init_skip;
@@ -173,6 +177,8 @@ void snd_tscm_stream_destroy_duplex(struct snd_tscm *tscm);
 int snd_tscm_stream_reserve_duplex(struct snd_tscm *tscm, unsigned int rate,
 				   unsigned int frames_per_period,
 				   unsigned int frames_per_buffer);
+int snd_tscm_stream_preflight(struct snd_tscm *tscm, unsigned int rate,
+			      struct fw_iso_preflight *preflight);
 int snd_tscm_stream_start_duplex(struct snd_tscm *tscm, unsigned int rate);
 void snd_tscm_stream_stop_duplex(struct snd_tscm *tscm);
 
@@ -180,26 +186,6 @@ void snd_tscm_stream_lock_changed(struct snd_tscm *tscm);
 int snd_tscm_stream_lock_try(struct snd_tscm *tscm);
 void snd_tscm_stream_lock_release(struct snd_tscm *tscm);
 
-void snd_fw_async_midi_port_init(struct snd_fw_async_midi_port *port);
-
-static inline void
-snd_fw_async_midi_port_run(struct snd_fw_async_midi_port *port,
-			   struct snd_rawmidi_substream *substream)
-{
-	if (!port->error) {
-		port->substream = substream;
-		schedule_work(&port->work);
-	}
-}
-
-static inline void
-snd_fw_async_midi_port_finish(struct snd_fw_async_midi_port *port)
-{
-	port->substream = NULL;
-	cancel_work_sync(&port->work);
-	port->error = false;
-}
-
 int snd_tscm_transaction_register(struct snd_tscm *tscm);
 int snd_tscm_transaction_reregister(struct snd_tscm *tscm);
 void snd_tscm_transaction_unregister(struct snd_tscm *tscm);
@@ -0,0 +1,84 @@
+/*
+ * timestamp-shim.h - definitions for sound/firewire/amdtp-ideal-seq.c in
+ * userspace
+ *
+ * The definitions are the same as sound/firewire/amdtp-stream.h and
+ * amdtp-stream.c. Keep them in sync.
+ */
+
+#ifndef TIMESTAMP_SHIM_H_INCLUDED
+#define TIMESTAMP_SHIM_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* amdtp-stream.h of kernel is not included. */
+#define SOUND_FIREWIRE_AMDTP_H_INCLUDED
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+
+#define __init
+
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+static unsigned int shim_warnings;
+
+#define WARN(condition, ...)				\
+({							\
+	bool __ret = !!(condition);			\
+	if (__ret) {					\
+		shim_warnings++;			\
+		fprintf(stderr, __VA_ARGS__);		\
+	}						\
+	__ret;						\
+})
+
+#define CIP_NONBLOCKING		0x00
+#define CIP_BLOCKING		0x01
+
+enum cip_sfc {
+	CIP_SFC_32000  = 0,
+	CIP_SFC_44100  = 1,
+	CIP_SFC_48000  = 2,
+	CIP_SFC_88200  = 3,
+	CIP_SFC_96000  = 4,
+	CIP_SFC_176400 = 5,
+	CIP_SFC_192000 = 6,
+	CIP_SFC_COUNT
+};
+
+static inline bool cip_sfc_is_base_44100(enum cip_sfc sfc)
+{
+	return sfc & 1;
+}
+
+struct seq_desc {
+	u16 syt_offset;
+	u16 data_blocks;
+};
+
+static const unsigned int amdtp_syt_intervals[CIP_SFC_COUNT] = {
+	[CIP_SFC_32000]  =  8,
+	[CIP_SFC_44100]  =  8,
+	[CIP_SFC_48000]  =  8,
+	[CIP_SFC_88200]  = 16,
+	[CIP_SFC_96000]  = 16,
+	[CIP_SFC_176400] = 32,
+	[CIP_SFC_192000] = 32,
+};
+
+static const unsigned int amdtp_rate_table[CIP_SFC_COUNT] = {
+	[CIP_SFC_32000]  =  32000,
+	[CIP_SFC_44100]  =  44100,
+	[CIP_SFC_48000]  =  48000,
+	[CIP_SFC_88200]  =  88200,
+	[CIP_SFC_96000]  =  96000,
+	[CIP_SFC_176400] = 176400,
+	[CIP_SFC_192000] = 192000,
+};
+
+void amdtp_stream_build_ideal_seqs(void);
+
+#endif
@@ -1,112 +1,261 @@
+/*
+ * timestamp.c - reference model and benchmark for the sequence of ideal
+ * packets
+ *
+ * The code to generate the sequence of ideal packets in
+ * sound/firewire/amdtp-ideal-seq.c is built in userspace with the shim header,
+ * then the sequence is compared against the reference model below, or
+ * benchmarked.
+ *
+ * gcc -O2 -I. ./timestamp.c -o ./timestamp
+ *
+ */
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timestamp-shim.h"
+#include "sound/firewire/amdtp-ideal-seq.c"
+
+/* The size of ring for sequence descriptors, and the number per callback. */
+#define SEQ_SIZE		256
+#define SEQ_CHUNK		16
+
+/* One minute of isochronous cycles, longer than the period of any table. */
+#define CHECK_CYCLES		(CYCLES_PER_SECOND * 60)
+#define BENCH_CYCLES		(CYCLES_PER_SECOND * 60 * 60)
 
-struct params {
-	unsigned int syt_interval;
-	unsigned int nominal_tick_gap;
-	unsigned int normalized_ticks_per_event;
+/*
+ * The reference model. The presentation time of the n'th event is
+ *   n * 24576000 / sample_rate
+ * in ticks. The number of data blocks in non-blocking mode is the number of
+ * events whose time is within the cycle. The SYT is the time of the first
+ * event in each SYT_INTERVAL events, rounded to the SYT precision.
+ */
+struct reference {
+	enum cip_sfc sfc;
+	uint64_t cycle;
+	uint64_t events;
+	uint64_t syts;
 };
 
-static void calculate_timestamp(struct params *p)
+static void
+reference_init(struct reference *ref, enum cip_sfc sfc)
 {
-	unsigned int cycles;
+	memset(ref, 0, sizeof(*ref));
+	ref->sfc = sfc;
+}
 
-	unsigned int accumulate;
-	unsigned int offsets;
+static void
+reference_next(struct reference *ref, unsigned int *syt_offset,
+	       unsigned int *data_blocks)
+{
+	uint64_t rate = amdtp_rate_table[ref->sfc];
+	uint64_t syt_interval = amdtp_syt_intervals[ref->sfc];
+	uint64_t begin = ref->cycle * TICKS_PER_CYCLE;
+	uint64_t end = begin + TICKS_PER_CYCLE;
+	uint64_t tick;
 
-	uint32_t sph;
-	unsigned int syt, previous_syt;
+	*data_blocks = 0;
+	while (ref->events * TICKS_PER_SECOND < end * rate) {
+		ref->events++;
+		(*data_blocks)++;
+	}
 
-	unsigned int total;
-	unsigned int data_blocks;
+	/* Round to nearest. The half never appears for the supported rates. */
+	tick = (2 * ref->syts * syt_interval * TICKS_PER_SECOND + rate) /
+	       (2 * rate);
+	if (tick < end) {
+		*syt_offset = tick - begin;
+		ref->syts++;
+	} else {
+		*syt_offset = CIP_SYT_NO_INFO;
+	}
+
+	ref->cycle++;
+}
 
-	accumulate = 0;
-	offsets = 0;
+static int
+check_seq(enum cip_sfc sfc, unsigned int mode)
+{
+	struct seq_desc descs[SEQ_SIZE];
+	unsigned int tail = 0, phase = 0;
+	struct reference ref;
+	unsigned int cycle, i;
+
+	reference_init(&ref, sfc);
 
-	sph = 0;
-	syt = 0;
-	previous_syt = 0xffff;
+	for (cycle = 0; cycle < CHECK_CYCLES; cycle += SEQ_CHUNK) {
+		unsigned int head = tail;
 
-	total = 0;
-	cycles = 0;
+		amdtp_ideal_seq_pool(descs, SEQ_SIZE, &tail, &phase, sfc, mode,
+				     SEQ_CHUNK);
 
-	printf("db  tstamp  syt\n");
+		for (i = 0; i < SEQ_CHUNK; i++) {
+			const struct seq_desc *desc = descs + (head + i) % SEQ_SIZE;
+			unsigned int syt_offset, data_blocks;
 
-	while (cycles < 8000) {
-		data_blocks = 0;
-		while (1) {
-			sph = (cycles << 13) | offsets;
-			data_blocks++;
-			if (total++ % p->syt_interval == 0) {
-				syt = (((cycles & 0x7) << 13) | offsets);
-				printf("    %08x *  \n", sph);
-			} else {
-				printf("    %08x\n", sph);
+			reference_next(&ref, &syt_offset, &data_blocks);
+			if (mode == CIP_BLOCKING) {
+				if (syt_offset != CIP_SYT_NO_INFO)
+					data_blocks = amdtp_syt_intervals[sfc];
+				else
+					data_blocks = 0;
 			}
 
-			accumulate += p->nominal_tick_gap;
-			if (accumulate >= 441) {
-				accumulate -= 441;
-				offsets++;
+			if (desc->syt_offset != syt_offset ||
+			    desc->data_blocks != data_blocks) {
+				printf("SFC %u, %s: cycle %u: %04x/%u, expected %04x/%u\n",
+				       sfc, mode == CIP_BLOCKING ? "blocking" : "non-blocking",
+				       cycle + i, desc->syt_offset, desc->data_blocks,
+				       syt_offset, data_blocks);
+				return -1;
 			}
+		}
+	}
+
+	return 0;
+}
+
+static int
+check(void)
+{
+	unsigned int sfc, mode;
+	int failures = 0;
+
+	for (sfc = 0; sfc < CIP_SFC_COUNT; sfc++) {
+		for (mode = CIP_NONBLOCKING; mode <= CIP_BLOCKING; mode++) {
+			int err = check_seq(sfc, mode);
+
+			printf("%6u %-12s %s\n", amdtp_rate_table[sfc],
+			       mode == CIP_BLOCKING ? "blocking" : "non-blocking",
+			       err < 0 ? "FAIL" : "ok");
+			if (err < 0)
+				failures++;
+		}
+	}
+
+	return failures;
+}
+
+static double
+elapsed_seconds(const struct timespec *begin, const struct timespec *end)
+{
+	return (end->tv_sec - begin->tv_sec) +
+	       (end->tv_nsec - begin->tv_nsec) / 1000000000.0;
+}
+
+static void
+bench(unsigned long long cycles)
+{
+	static struct seq_desc descs[SEQ_SIZE];
+	unsigned int sfc, mode;
 
-			offsets += p->normalized_ticks_per_event;
-			if (offsets >= 3072) {
-				offsets -= 3072;
-				break;
+	for (sfc = 0; sfc < CIP_SFC_COUNT; sfc++) {
+		for (mode = CIP_NONBLOCKING; mode <= CIP_BLOCKING; mode++) {
+			unsigned int tail = 0, phase = 0;
+			struct timespec begin, end;
+			unsigned long long count;
+			unsigned long sum = 0;
+			double elapsed;
+
+			clock_gettime(CLOCK_MONOTONIC, &begin);
+			for (count = 0; count < cycles; count += SEQ_CHUNK) {
+				unsigned int head = tail;
+
+				amdtp_ideal_seq_pool(descs, SEQ_SIZE, &tail,
+						     &phase, sfc, mode,
+						     SEQ_CHUNK);
+				/* Keep the result alive. */
+				sum += descs[head].data_blocks;
 			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			elapsed = elapsed_seconds(&begin, &end);
+			printf("%6u %-12s %12.0f packets/sec %8.3f ns/packet (%lu)\n",
+			       amdtp_rate_table[sfc],
+			       mode == CIP_BLOCKING ? "blocking" : "non-blocking",
+			       count / elapsed, elapsed * 1000000000.0 / count,
+			       sum);
 		}
+	}
+}
 
-		if (previous_syt == syt)
-			previous_syt = 0xffff;
-		else
-			previous_syt = syt;
-		printf("%02d          %04x\n", data_blocks, previous_syt);
+static void
+dump(enum cip_sfc sfc, unsigned int cycles)
+{
+	struct reference ref;
+	unsigned int cycle;
+
+	reference_init(&ref, sfc);
+
+	printf("cycle  db  syt\n");
+	for (cycle = 0; cycle < cycles; cycle++) {
+		unsigned int syt_offset, data_blocks;
 
-		cycles++;
+		reference_next(&ref, &syt_offset, &data_blocks);
+		if (syt_offset != CIP_SYT_NO_INFO)
+			printf("%5u  %2u  %04x\n", cycle, data_blocks,
+			       ((cycle & 0xf) << 12) | syt_offset);
+		else
+			printf("%5u  %2u  ffff\n", cycle, data_blocks);
 	}
+}
 
-	printf("total: %d\n", total);
+static void
+print_usage(void)
+{
+	printf("./timestamp check\n");
+	printf("    compare the tables against the reference model\n");
+	printf("./timestamp bench [CYCLES]\n");
+	printf("    benchmark the generation of sequence\n");
+	printf("./timestamp SFC [CYCLES]\n");
+	printf("    dump the sequence of the reference model\n");
+	printf("    32,000: 0\n");
+	printf("    44,100: 1\n");
+	printf("    48,000: 2\n");
+	printf("    88,200: 3\n");
+	printf("    96,000: 4\n");
+	printf("   176,400: 5\n");
+	printf("   192,000: 6\n");
 }
 
 int main(int argc, char *argv[])
 {
-	static const struct {
-		unsigned int syt_interval;
-		unsigned int normalized_ticks_per_event;
-		unsigned int nominal_tick_gap;
-	} initial_state[] = {
-		[0]  = {  8, 768,   0 },	/*  32000 */
-		[1]  = {  8, 557, 123 },	/*  44100 */
-		[2]  = {  8, 512,   0 },	/*  48000 */
-		[3]  = { 16, 278, 282 },	/*  88200 */
-		[4]  = { 16, 256,   0 },	/*  96000 */
-		[5] =  { 32, 139, 141 },	/* 176400 */
-		[6] =  { 32, 128,   0 },	/* 192000 */
-	};
-	static struct params p = {0};
 	unsigned long sfc;
 
 	if (argc < 2) {
-		printf("./timestamp SFC\n");
-		printf("    32,000: 0\n");
-		printf("    44,100: 1\n");
-		printf("    48,000: 2\n");
-		printf("    88,200: 3\n");
-		printf("    96,000: 4\n");
-		printf("   176,400: 5\n");
-		printf("   192,000: 6\n");
+		print_usage();
 		return EXIT_FAILURE;
 	}
 
-	sfc = strtoul(argv[1], NULL, 10);
+	amdtp_stream_build_ideal_seqs();
+	if (shim_warnings > 0)
+		return EXIT_FAILURE;
+
+	if (strcmp(argv[1], "check") == 0)
+		return check() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 
-	p.syt_interval = initial_state[sfc].syt_interval;
-	p.normalized_ticks_per_event =
-				initial_state[sfc].normalized_ticks_per_event;
-	p.nominal_tick_gap = initial_state[sfc].nominal_tick_gap;
+	if (strcmp(argv[1], "bench") == 0) {
+		unsigned long long cycles = BENCH_CYCLES;
+
+		if (argc > 2)
+			cycles = strtoull(argv[2], NULL, 10);
+		if (cycles == 0)
+			cycles = BENCH_CYCLES;
+		bench(cycles);
+		return EXIT_SUCCESS;
+	}
+
+	sfc = strtoul(argv[1], NULL, 10);
+	if (sfc >= CIP_SFC_COUNT) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
 
-	calculate_timestamp(&p);
+	dump(sfc, argc > 2 ? strtoul(argv[2], NULL, 10) : CYCLES_PER_SECOND);
 	return EXIT_SUCCESS;
 }